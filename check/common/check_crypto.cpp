@@ -1,6 +1,9 @@
+#include <pthread.h>
 #include <stdio.h>
+#include <time.h>
 
 #include <openssl/ec.h>
+#include <openssl/evp.h>
 #include <openssl/rand.h>
 
 extern "C" {
@@ -12,6 +15,12 @@ extern "C" {
 
 #define N_SERIALIZATION_TESTS  20
 #define N_SIGNATURE_TIER_TESTS 5
+#define N_SIGNATURE_BATCH      64
+#define N_SIGNATURE_BATCH_KEYS 4
+#define N_AES_ROUNDS           200
+#define N_AES_THREADS          4
+#define N_BENCH_AES_CHUNKS     100000
+#define N_BENCH_SIG_ROUNDS     100
 
 static unsigned char *gen_random_data(size_t minlen, size_t maxlen, size_t *outlen) {
 
@@ -300,3 +309,239 @@ TEST(DIME, check_ed25519_signatures)
 
     free_ed25519_key(key);
 }
+
+TEST(DIME, check_ed25519_batch_signatures)
+{
+    ED25519_KEY *keys[N_SIGNATURE_BATCH_KEYS], *sigkeys[N_SIGNATURE_BATCH];
+    ed25519_signature sigs[N_SIGNATURE_BATCH];
+    const unsigned char *data[N_SIGNATURE_BATCH], *sigptrs[N_SIGNATURE_BATCH];
+    unsigned char *rdata[N_SIGNATURE_BATCH];
+    size_t dlens[N_SIGNATURE_BATCH], nums[] = { N_SIGNATURE_BATCH, 3 };
+    int valid[N_SIGNATURE_BATCH];
+
+    ASSERT_EQ(0, crypto_init()) << "Crypto initialization routine failed.";
+
+    for (size_t i = 0; i < N_SIGNATURE_BATCH_KEYS; i++) {
+        keys[i] = generate_ed25519_keypair();
+        ASSERT_TRUE(keys[i] != NULL) << "ed25519 batch verification check failed: could not generate key pair.";
+    }
+
+    // The signatures in a batch are made by several different keys.
+    for (size_t i = 0; i < N_SIGNATURE_BATCH; i++) {
+        rdata[i] = gen_random_data(1, 1024, &(dlens[i]));
+        ASSERT_TRUE(rdata[i] != NULL) << "ed25519 batch verification check failed: could not generate random data.";
+        sigkeys[i] = keys[i % N_SIGNATURE_BATCH_KEYS];
+        ASSERT_EQ(0, ed25519_sign_data(rdata[i], dlens[i], sigkeys[i], sigs[i]));
+        data[i] = rdata[i];
+        sigptrs[i] = sigs[i];
+    }
+
+    // Batches of 3 signatures or fewer are verified one signature at a time.
+    for (size_t i = 0; i < (sizeof(nums) / sizeof(nums[0])); i++) {
+        memset(valid, 0, sizeof(valid));
+        ASSERT_EQ(1, ed25519_verify_sig_batch(data, dlens, sigkeys, sigptrs, nums[i], valid)) << "A batch of " << nums[i] << " valid signatures did not verify.";
+
+        for (size_t j = 0; j < nums[i]; j++) {
+            ASSERT_EQ(1, valid[j]) << "Valid signature #" << j << " was not reported as valid.";
+        }
+
+    }
+
+    // Once the batch fails, the signature that did not match is singled out.
+    sigs[17][0] ^= 1;
+    rdata[1][0] ^= 1;
+
+    for (size_t i = 0; i < (sizeof(nums) / sizeof(nums[0])); i++) {
+        ASSERT_EQ(0, ed25519_verify_sig_batch(data, dlens, sigkeys, sigptrs, nums[i], valid)) << "A batch of " << nums[i] << " signatures with a bad one verified.";
+
+        for (size_t j = 0; j < nums[i]; j++) {
+            ASSERT_EQ((j == 1 || j == 17) ? 0 : 1, valid[j]) << "Signature #" << j << " was misreported.";
+        }
+
+    }
+
+    ASSERT_EQ(0, ed25519_verify_sig_batch(data, dlens, sigkeys, sigptrs, N_SIGNATURE_BATCH, NULL)) << "A batch with bad signatures verified without a result array.";
+    ASSERT_EQ(-1, ed25519_verify_sig_batch(data, dlens, sigkeys, sigptrs, 0, valid)) << "An empty batch of signatures was verified.";
+
+    for (size_t i = 0; i < N_SIGNATURE_BATCH; i++) {
+        free(rdata[i]);
+    }
+
+    for (size_t i = 0; i < N_SIGNATURE_BATCH_KEYS; i++) {
+        free_ed25519_key(keys[i]);
+    }
+
+}
+
+// Encrypt or decrypt a buffer with a cipher context of its own, the way every AES-256 operation used to be done.
+static int reference_aes_256(unsigned char *outbuf, const unsigned char *data, size_t dlen, const unsigned char *key, const unsigned char *iv, int encrypt) {
+
+    EVP_CIPHER_CTX *ctx;
+    int len, result = -1;
+
+    if (!(ctx = EVP_CIPHER_CTX_new())) {
+        return -1;
+    }
+
+    if ((EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv, encrypt) == 1) && (EVP_CIPHER_CTX_set_padding(ctx, 0) == 1) &&
+        (EVP_CipherUpdate(ctx, outbuf, &len, data, dlen) == 1)) {
+        result = len;
+
+        if (EVP_CipherFinal_ex(ctx, outbuf + result, &len) == 1) {
+            result += len;
+        } else {
+            result = -1;
+        }
+
+    }
+
+    EVP_CIPHER_CTX_free(ctx);
+
+    return result;
+}
+
+// Run rounds of encryption and decryption with fresh keys, and check each result against a separately set up cipher context.
+static void *check_aes_256_rounds(void *arg) {
+
+    unsigned char key[32], iv[32], data[4096], cipher[4096], expected[4096], plain[4096];
+    size_t dlen;
+    long failures = 0;
+
+    for (size_t i = 0; i < N_AES_ROUNDS; i++) {
+        dlen = (1 + (i % (sizeof(data) / 16))) * 16;
+
+        if ((RAND_bytes(key, sizeof(key)) != 1) || (RAND_bytes(iv, sizeof(iv)) != 1) || (RAND_bytes(data, dlen) != 1)) {
+            failures++;
+            continue;
+        }
+
+        if ((_encrypt_aes_256(cipher, data, dlen, key, iv) != (int)dlen) || (reference_aes_256(expected, data, dlen, key, iv, 1) != (int)dlen) ||
+            memcmp(cipher, expected, dlen) || (_decrypt_aes_256(plain, cipher, dlen, key, iv) != (int)dlen) || memcmp(plain, data, dlen)) {
+            failures++;
+        }
+
+    }
+
+    return (void *)failures;
+}
+
+TEST(DIME, check_aes_256_encryption)
+{
+    pthread_t threads[N_AES_THREADS];
+    unsigned char key[32], iv[32], data[64], outbuf[64];
+    void *failures;
+
+    ASSERT_EQ(0, crypto_init()) << "Crypto initialization routine failed.";
+
+    ASSERT_EQ(-1, _encrypt_aes_256(outbuf, data, 33, key, iv)) << "Unaligned AES-256 input was encrypted.";
+    ASSERT_EQ(-1, _decrypt_aes_256(outbuf, data, 0, key, iv)) << "Empty AES-256 input was decrypted.";
+
+    // Encryption and decryption take turns with the same thread's cipher context, which must be rekeyed cleanly every time.
+    failures = check_aes_256_rounds(NULL);
+    ASSERT_EQ(0, (long)failures) << "AES-256 operations did not match those of a fresh cipher context.";
+
+    // Every thread has a cipher context of its own.
+    for (size_t i = 0; i < N_AES_THREADS; i++) {
+        ASSERT_EQ(0, pthread_create(&(threads[i]), NULL, check_aes_256_rounds, NULL));
+    }
+
+    for (size_t i = 0; i < N_AES_THREADS; i++) {
+        ASSERT_EQ(0, pthread_join(threads[i], &failures));
+        ASSERT_EQ(0, (long)failures) << "AES-256 operations went wrong with multiple threads.";
+    }
+
+}
+
+static uint64_t clock_ns(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+TEST(DIME, DISABLED_bench_aes_256_small_chunks)
+{
+    unsigned char keys[16][32], iv[32], data[4096], outbuf[4096];
+    size_t sizes[] = { 64, 256, 1024, 4096 };
+    uint64_t start, fresh, reused;
+
+    ASSERT_EQ(0, crypto_init()) << "Crypto initialization routine failed.";
+    ASSERT_EQ(1, RAND_bytes((unsigned char *)keys, sizeof(keys)));
+    ASSERT_EQ(1, RAND_bytes(iv, sizeof(iv)));
+    ASSERT_EQ(1, RAND_bytes(data, sizeof(data)));
+
+    // Every chunk is encrypted with a different key, like the chunks and keyslots of a message are.
+    for (size_t i = 0; i < (sizeof(sizes) / sizeof(sizes[0])); i++) {
+        start = clock_ns();
+
+        for (size_t j = 0; j < N_BENCH_AES_CHUNKS; j++) {
+            ASSERT_EQ((int)sizes[i], reference_aes_256(outbuf, data, sizes[i], keys[j % 16], iv, 1));
+        }
+
+        fresh = clock_ns() - start;
+        start = clock_ns();
+
+        for (size_t j = 0; j < N_BENCH_AES_CHUNKS; j++) {
+            ASSERT_EQ((int)sizes[i], _encrypt_aes_256(outbuf, data, sizes[i], keys[j % 16], iv));
+        }
+
+        reused = clock_ns() - start;
+
+        printf("%4zu byte chunks: %.0f ns per chunk (%.1f MB/s) with a new cipher context, %.0f ns per chunk (%.1f MB/s) with the thread's context\n",
+            sizes[i], (double)fresh / N_BENCH_AES_CHUNKS, (sizes[i] * N_BENCH_AES_CHUNKS * 1000.0) / fresh,
+            (double)reused / N_BENCH_AES_CHUNKS, (sizes[i] * N_BENCH_AES_CHUNKS * 1000.0) / reused);
+    }
+
+}
+
+TEST(DIME, DISABLED_bench_ed25519_batch_verify)
+{
+    ED25519_KEY *key, *keys[N_SIGNATURE_BATCH];
+    ed25519_signature sigs[N_SIGNATURE_BATCH];
+    const unsigned char *data[N_SIGNATURE_BATCH], *sigptrs[N_SIGNATURE_BATCH];
+    unsigned char buf[N_SIGNATURE_BATCH][256];
+    size_t dlens[N_SIGNATURE_BATCH], nums[] = { 4, 16, N_SIGNATURE_BATCH };
+    uint64_t start, single, batch;
+    int valid[N_SIGNATURE_BATCH];
+
+    ASSERT_EQ(0, crypto_init()) << "Crypto initialization routine failed.";
+    ASSERT_TRUE((key = generate_ed25519_keypair()) != NULL);
+    ASSERT_EQ(1, RAND_bytes((unsigned char *)buf, sizeof(buf)));
+
+    // Like the chunk signatures of a message, which are all made with the author's key.
+    for (size_t i = 0; i < N_SIGNATURE_BATCH; i++) {
+        dlens[i] = sizeof(buf[i]);
+        data[i] = buf[i];
+        keys[i] = key;
+        sigptrs[i] = sigs[i];
+        ASSERT_EQ(0, _ed25519_sign_data(buf[i], dlens[i], key, sigs[i]));
+    }
+
+    for (size_t i = 0; i < (sizeof(nums) / sizeof(nums[0])); i++) {
+        start = clock_ns();
+
+        for (size_t j = 0; j < N_BENCH_SIG_ROUNDS; j++) {
+
+            for (size_t k = 0; k < nums[i]; k++) {
+                ASSERT_EQ(1, _ed25519_verify_sig(data[k], dlens[k], keys[k], sigs[k]));
+            }
+
+        }
+
+        single = clock_ns() - start;
+        start = clock_ns();
+
+        for (size_t j = 0; j < N_BENCH_SIG_ROUNDS; j++) {
+            ASSERT_EQ(1, _ed25519_verify_sig_batch(data, dlens, keys, sigptrs, nums[i], valid));
+        }
+
+        batch = clock_ns() - start;
+
+        printf("%2zu signatures: %.0f ns per signature verified one at a time, %.0f ns per signature verified as a batch\n",
+            nums[i], (double)single / (N_BENCH_SIG_ROUNDS * nums[i]), (double)batch / (N_BENCH_SIG_ROUNDS * nums[i]));
+    }
+
+    _free_ed25519_key(key);
+}
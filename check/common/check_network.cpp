@@ -0,0 +1,115 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+#include "dime/common/network.h"
+}
+#include "gtest/gtest.h"
+
+static int listen_loopback(int backlog, struct sockaddr_in *addr) {
+
+    socklen_t alen = sizeof(struct sockaddr_in);
+    int fd;
+
+    memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    } else if (bind(fd, (struct sockaddr *)addr, sizeof(struct sockaddr_in)) || listen(fd, backlog) ||
+        getsockname(fd, (struct sockaddr *)addr, &alen)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void init_test_address(struct addrinfo *address, struct sockaddr_in *addr, int family, struct addrinfo *next) {
+
+    memset(address, 0, sizeof(struct addrinfo));
+    address->ai_family = family;
+    address->ai_socktype = SOCK_STREAM;
+    address->ai_addr = (struct sockaddr *)addr;
+    address->ai_addrlen = sizeof(struct sockaddr_in);
+    address->ai_next = next;
+}
+
+TEST(DIME, check_network_interleave)
+{
+    struct addrinfo address[5], *aptr;
+    struct sockaddr_in addr;
+    int families[5] = { AF_INET6, AF_INET6, AF_INET6, AF_INET, AF_INET }, expected[5] = { 0, 3, 1, 4, 2 };
+
+    for (int i = 4; i >= 0; i--) {
+        init_test_address(&(address[i]), &addr, families[i], (i < 4) ? &(address[i + 1]) : NULL);
+    }
+
+    // The families alternate, starting with the preferred one, and any left over come last.
+    aptr = _interleave_addresses(address);
+
+    for (int i = 0; i < 5; i++, aptr = aptr->ai_next) {
+        ASSERT_TRUE(aptr == &(address[expected[i]])) << "Address #" << i << " was out of order.";
+    }
+
+    ASSERT_TRUE(aptr == NULL);
+}
+
+TEST(DIME, check_network_connect_race)
+{
+    struct addrinfo address[3];
+    struct addrinfo const *connected = NULL;
+    struct sockaddr_in blackhole, reachable, refused;
+    struct timespec start, end;
+    int bfd, rfd, filler, fd;
+    long elapsed;
+
+    // Once the one slot of its backlog is taken, a listening socket silently drops any further connection attempts.
+    ASSERT_GE((bfd = listen_loopback(0, &blackhole)), 0);
+    ASSERT_GE((rfd = listen_loopback(16, &reachable)), 0);
+    ASSERT_GE((filler = socket(AF_INET, SOCK_STREAM, 0)), 0);
+    ASSERT_EQ(0, connect(filler, (struct sockaddr *)&blackhole, sizeof(blackhole)));
+
+    init_test_address(&(address[1]), &reachable, AF_INET, NULL);
+    init_test_address(&(address[0]), &blackhole, AF_INET, &(address[1]));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_GE((fd = _connect_addresses(address, 0, &connected)), 0) << "Connection race failed.";
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = ((end.tv_sec - start.tv_sec) * 1000) + ((end.tv_nsec - start.tv_nsec) / 1000000);
+
+    ASSERT_TRUE(connected == &(address[1])) << "Connection was made to the wrong address.";
+    ASSERT_LT(elapsed, 2000) << "Unresponsive address held up the connection race.";
+    ASSERT_FALSE(fcntl(fd, F_GETFL) & O_NONBLOCK) << "Connected socket was left in non-blocking mode.";
+    close(fd);
+
+    // An attempt that is refused doesn't get a head start, so the one after it is started right away.
+    ASSERT_GE((fd = listen_loopback(1, &refused)), 0);
+    close(fd);
+
+    init_test_address(&(address[2]), &reachable, AF_INET, NULL);
+    init_test_address(&(address[1]), &refused, AF_INET, &(address[2]));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_GE((fd = _connect_addresses(address, 0, &connected)), 0) << "Connection race failed.";
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = ((end.tv_sec - start.tv_sec) * 1000) + ((end.tv_nsec - start.tv_nsec) / 1000000);
+
+    ASSERT_TRUE(connected == &(address[2])) << "Connection was made to the wrong address.";
+    ASSERT_LT(elapsed, 450) << "Refused address held up the connection race.";
+    close(fd);
+    init_test_address(&(address[1]), &reachable, AF_INET, NULL);
+
+    // Once nothing is listening, the race fails right away.
+    close(rfd);
+    address[0].ai_next = NULL;
+    ASSERT_EQ(-1, _connect_addresses(&(address[1]), 0, NULL));
+    ASSERT_EQ(-1, _connect_addresses(&(address[1]), AF_INET6, NULL));
+
+    close(filler);
+    close(bfd);
+}
@@ -1,3 +1,8 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
 extern "C" {
 #include "dime/signet/keys.h"
 #include "dime/signet/signet.h"
@@ -7,6 +12,146 @@ extern "C" {
 #include "gtest/gtest.h"
 #include "error-assert.h"
 
+/**
+ * Reads a memory counter, in kilobytes, from the status file of the current process.
+ */
+static long read_status_kb(const char *field) {
+
+    char line[256];
+    long result = -1;
+    size_t flen = strlen(field);
+    FILE *fp;
+
+    if (!(fp = fopen("/proc/self/status", "r"))) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+
+        if (!strncmp(line, field, flen) && line[flen] == ':') {
+            result = strtol(line + flen + 1, NULL, 10);
+            break;
+        }
+
+    }
+
+    fclose(fp);
+    return result;
+}
+
+/**
+ * Resets the peak resident set size of the current process to its current value, which is returned.
+ */
+static long reset_peak_rss(void) {
+
+    FILE *fp;
+
+    if (!(fp = fopen("/proc/self/clear_refs", "w"))) {
+        return -1;
+    }
+
+    fputs("5", fp);
+    fclose(fp);
+
+    return read_status_kb("VmRSS");
+}
+
+/**
+ * Builds a complete draft with the requested number of attachment chunks, each holding attach_size bytes of data.
+ */
+static dmime_object_t *create_attachment_draft(size_t nattach, size_t attach_size, ED25519_KEY **auth_signkey) {
+
+    const char *auth = "ivan@darkmail.info", *orig = "darkmail.info", *dest = "lavabit.com", *recp = "ryan@lavabit.com";
+    const char *auth_keys = ".out/attach_auth.keys", *orig_keys = ".out/attach_orig.keys", *dest_keys = ".out/attach_dest.keys", *recp_keys = ".out/attach_recp.keys";
+    const char *display = "This is a test\r\nCan you read this?\r\n";
+    dmime_object_t *draft;
+    dmime_object_chunk_t **next;
+    signet_t *signet_auth, *signet_orig, *signet_dest, *signet_recp;
+    ED25519_KEY *orig_signkey, *dest_signkey, *recp_signkey;
+    unsigned char *data;
+
+    if (!(signet_orig = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_ORG, orig_keys)) || !(signet_dest = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_ORG, dest_keys)) ||
+        !(signet_auth = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_SSR, auth_keys)) || !(signet_recp = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_SSR, recp_keys))) {
+        return NULL;
+    }
+
+    if (!(orig_signkey = dime_keys_signkey_fetch(orig_keys)) || !(dest_signkey = dime_keys_signkey_fetch(dest_keys)) ||
+        !(*auth_signkey = dime_keys_signkey_fetch(auth_keys)) || !(recp_signkey = dime_keys_signkey_fetch(recp_keys))) {
+        return NULL;
+    }
+
+    dime_sgnt_sig_crypto_sign(signet_orig, orig_signkey);
+    dime_sgnt_sig_full_sign(signet_orig, orig_signkey);
+    dime_sgnt_sig_crypto_sign(signet_dest, dest_signkey);
+    dime_sgnt_sig_full_sign(signet_dest, dest_signkey);
+    dime_sgnt_sig_ssr_sign(signet_auth, *auth_signkey);
+    dime_sgnt_sig_crypto_sign(signet_auth, orig_signkey);
+    dime_sgnt_sig_full_sign(signet_auth, orig_signkey);
+    dime_sgnt_sig_ssr_sign(signet_recp, recp_signkey);
+    dime_sgnt_sig_crypto_sign(signet_recp, dest_signkey);
+    dime_sgnt_sig_full_sign(signet_recp, dest_signkey);
+
+    _free_ed25519_key(orig_signkey);
+    _free_ed25519_key(dest_signkey);
+    _free_ed25519_key(recp_signkey);
+
+    draft = (dmime_object_t *)malloc(sizeof(dmime_object_t));
+    memset(draft, 0, sizeof(dmime_object_t));
+
+    draft->common_headers = dime_prsr_headers_create();
+    draft->actor = id_author;
+    draft->author = sdsnew(auth);
+    draft->recipient = sdsnew(recp);
+    draft->origin = sdsnew(orig);
+    draft->destination = sdsnew(dest);
+    draft->signet_author = signet_auth;
+    draft->signet_origin = signet_orig;
+    draft->signet_destination = signet_dest;
+    draft->signet_recipient = signet_recp;
+    draft->common_headers->headers[HEADER_TYPE_DATE] = sdsnew("12 minutes ago");
+    draft->common_headers->headers[HEADER_TYPE_FROM] = sdsnew("Ivan <ivan@darkmail.info>");
+    draft->common_headers->headers[HEADER_TYPE_ORGANIZATION] = sdsnew("Lavabit");
+    draft->common_headers->headers[HEADER_TYPE_SUBJECT] = sdsnew("Attachment benchmark");
+    draft->common_headers->headers[HEADER_TYPE_TO] = sdsnew("Ryan <ryan@lavabit.com>");
+    draft->other_headers = sdsnew("SECRET METADATA\r\n");
+    draft->display = dime_dmsg_object_chunk_create(CHUNK_TYPE_DISPLAY_CONTENT, (unsigned char *)display, strlen(display), DEFAULT_CHUNK_FLAGS);
+
+    // The attachment data is built one chunk at a time so the draft itself doesn't set the peak memory mark.
+    next = &(draft->attach);
+
+    for (size_t i = 0; i < nattach; i++, next = &((*next)->next)) {
+
+        if (!(data = (unsigned char *)malloc(attach_size))) {
+            dime_dmsg_object_destroy(draft);
+            return NULL;
+        }
+
+        for (size_t j = 0; j < attach_size; j++) {
+            data[j] = (unsigned char)(i + j);
+        }
+
+        *next = dime_dmsg_object_chunk_create(CHUNK_TYPE_ATTACH_CONTENT, data, attach_size, DEFAULT_CHUNK_FLAGS);
+        free(data);
+
+        if (!*next) {
+            dime_dmsg_object_destroy(draft);
+            return NULL;
+        }
+
+    }
+
+    return draft;
+}
+
+static uint64_t clock_ns(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
 /**
  * Demonstrates how a message travels from the author to the recipient.
  */
@@ -318,3 +463,293 @@ TEST(DIME, message_encryption_and_decryption)
     free(from_dest_bin);
     ASSERT_DIME_NO_ERROR();
 }
+
+/**
+ * Reports how much encrypting and decrypting a message with a 16 MB attachment raises the peak resident set size.
+ */
+TEST(DIME, DISABLED_bench_message_attachment_rss)
+{
+    EC_KEY *auth_enckey;
+    dmime_kek_t auth_kek;
+    dmime_message_t *message;
+    dmime_object_t *draft, *at_auth;
+    ED25519_KEY *signkey = NULL;
+    long before, peak;
+    int res;
+
+    ASSERT_DIME_NO_ERROR();
+    _crypto_init();
+    ASSERT_DIME_NO_ERROR();
+
+    draft = create_attachment_draft(1, 16000000, &signkey);
+    ASSERT_TRUE(draft != NULL) << "Failed to create the benchmark draft.";
+    auth_enckey = dime_keys_enckey_fetch(".out/attach_auth.keys");
+    ASSERT_TRUE(auth_enckey != NULL) << "Failed to retrieve author encryption keys.";
+    ASSERT_DIME_NO_ERROR();
+
+    ASSERT_GT((before = reset_peak_rss()), 0) << "Unable to reset the peak resident set size.";
+    message = dime_dmsg_message_encrypt(draft, signkey);
+    peak = read_status_kb("VmHWM");
+    ASSERT_TRUE(message != NULL) << "Failed to encrypt the message.";
+    ASSERT_DIME_NO_ERROR();
+
+    printf("Encrypting a 16 MB attachment raised the peak RSS by %ld KB (from %ld KB to %ld KB).\n", peak - before, before, peak);
+
+    // The author can read back every chunk without the origin having signed the message first.
+    res = dime_dmsg_kek_in_derive(message, auth_enckey, &auth_kek);
+    ASSERT_EQ(0, res) << "Failed to derive author key encryption key.";
+    at_auth = dime_dmsg_message_envelope_decrypt(message, id_author, &auth_kek);
+    ASSERT_TRUE(at_auth != NULL) << "Failed to decrypt the envelope as the author.";
+    ASSERT_DIME_NO_ERROR();
+
+    at_auth->signet_author = dime_sgnt_signet_dupe(draft->signet_author);
+    at_auth->signet_origin = dime_sgnt_signet_dupe(draft->signet_origin);
+    at_auth->signet_destination = dime_sgnt_signet_dupe(draft->signet_destination);
+    at_auth->signet_recipient = dime_sgnt_signet_dupe(draft->signet_recipient);
+
+    ASSERT_GT((before = reset_peak_rss()), 0) << "Unable to reset the peak resident set size.";
+    res = dime_dmsg_message_decrypt_as_auth(at_auth, message, &auth_kek);
+    peak = read_status_kb("VmHWM");
+    ASSERT_EQ(0, res) << "Failed to decrypt the message as author.";
+    ASSERT_DIME_NO_ERROR();
+
+    printf("Decrypting a 16 MB attachment raised the peak RSS by %ld KB (from %ld KB to %ld KB).\n", peak - before, before, peak);
+
+    ASSERT_TRUE(at_auth->attach != NULL && at_auth->attach->data_size == draft->attach->data_size) << "Attachment size was corrupted.";
+    ASSERT_EQ(0, memcmp(draft->attach->data, at_auth->attach->data, draft->attach->data_size)) << "Attachment data was corrupted.";
+
+    dime_dmsg_message_destroy(message);
+    dime_dmsg_object_destroy(draft);
+    dime_dmsg_object_destroy(at_auth);
+    _free_ec_key(auth_enckey);
+    _free_ed25519_key(signkey);
+}
+
+/**
+ * Encrypts a message with several attachments on multiple threads, and checks that the author can read every attachment back in order.
+ */
+TEST(DIME, message_parallel_encryption)
+{
+    EC_KEY *auth_enckey;
+    dmime_kek_t auth_kek;
+    dmime_message_t *message;
+    dmime_object_t *draft, *at_auth;
+    dmime_object_chunk_t *sent, *received;
+    ED25519_KEY *signkey = NULL;
+    int res;
+
+    ASSERT_DIME_NO_ERROR();
+    _crypto_init();
+    ASSERT_DIME_NO_ERROR();
+
+    draft = create_attachment_draft(8, 65536, &signkey);
+    ASSERT_TRUE(draft != NULL) << "Failed to create the draft.";
+    auth_enckey = dime_keys_enckey_fetch(".out/attach_auth.keys");
+    ASSERT_TRUE(auth_enckey != NULL) << "Failed to retrieve author encryption keys.";
+    ASSERT_DIME_NO_ERROR();
+
+    message = dime_dmsg_message_encrypt_parallel(draft, signkey, 4);
+    ASSERT_TRUE(message != NULL) << "Failed to encrypt the message on multiple threads.";
+    ASSERT_DIME_NO_ERROR();
+
+    res = dime_dmsg_kek_in_derive(message, auth_enckey, &auth_kek);
+    ASSERT_EQ(0, res) << "Failed to derive author key encryption key.";
+    at_auth = dime_dmsg_message_envelope_decrypt(message, id_author, &auth_kek);
+    ASSERT_TRUE(at_auth != NULL) << "Failed to decrypt the envelope as the author.";
+
+    at_auth->signet_author = dime_sgnt_signet_dupe(draft->signet_author);
+    at_auth->signet_origin = dime_sgnt_signet_dupe(draft->signet_origin);
+    at_auth->signet_destination = dime_sgnt_signet_dupe(draft->signet_destination);
+    at_auth->signet_recipient = dime_sgnt_signet_dupe(draft->signet_recipient);
+
+    res = dime_dmsg_message_decrypt_as_auth(at_auth, message, &auth_kek);
+    ASSERT_EQ(0, res) << "Failed to decrypt the message as author.";
+    ASSERT_DIME_NO_ERROR();
+
+    sent = draft->attach;
+    received = at_auth->attach;
+
+    for (size_t i = 0; sent; i++, sent = sent->next, received = received->next) {
+        ASSERT_TRUE(received != NULL) << "Attachment " << i << " is missing.";
+        ASSERT_EQ(sent->data_size, received->data_size) << "Attachment " << i << " size was corrupted.";
+        ASSERT_EQ(0, memcmp(sent->data, received->data, sent->data_size)) << "Attachment " << i << " data was corrupted.";
+    }
+
+    ASSERT_TRUE(received == NULL) << "The message has more attachments than were sent.";
+
+    dime_dmsg_message_destroy(message);
+    dime_dmsg_object_destroy(draft);
+    dime_dmsg_object_destroy(at_auth);
+    _free_ec_key(auth_enckey);
+    _free_ed25519_key(signkey);
+}
+
+/**
+ * Checks that the iovec form of an encrypted message describes exactly the same bytes as its serialized form.
+ */
+TEST(DIME, message_binary_iovec)
+{
+    dmime_message_t *message;
+    dmime_object_t *draft;
+    ED25519_KEY *signkey = NULL;
+    size_t bin_size, iov_count, iov_size, at = 0, mismatch;
+    struct iovec *iov;
+    unsigned char *bin;
+
+    ASSERT_DIME_NO_ERROR();
+    _crypto_init();
+    ASSERT_DIME_NO_ERROR();
+
+    draft = create_attachment_draft(4, 4096, &signkey);
+    ASSERT_TRUE(draft != NULL) << "Failed to create the draft.";
+
+    message = dime_dmsg_message_encrypt(draft, signkey);
+    ASSERT_TRUE(message != NULL) << "Failed to encrypt the message.";
+    ASSERT_DIME_NO_ERROR();
+
+    bin = dime_dmsg_message_binary_serialize(message, 0xFF, 0, &bin_size);
+    ASSERT_TRUE(bin != NULL) << "Failed to serialize the message.";
+
+    iov = dime_dmsg_message_binary_iovec(message, 0xFF, 0, &iov_count, &iov_size);
+    ASSERT_TRUE(iov != NULL) << "Failed to describe the message as an iovec.";
+    ASSERT_DIME_NO_ERROR();
+
+    // compare every entry before asserting anything, so the iovec array is released even when the test fails
+    mismatch = iov_count;
+
+    for (size_t i = 0; i < iov_count; i++) {
+
+        if (at + iov[i].iov_len > bin_size || memcmp(bin + at, iov[i].iov_base, iov[i].iov_len)) {
+            mismatch = i;
+            break;
+        }
+
+        at += iov[i].iov_len;
+    }
+
+    free(iov);
+
+    ASSERT_EQ(bin_size, iov_size) << "Message iovec size does not match its serialized size.";
+    ASSERT_EQ(iov_count, mismatch) << "Message iovec entry " << mismatch << " does not match its serialized form.";
+    ASSERT_EQ(bin_size, at) << "Message iovec entries do not add up to its serialized size.";
+
+    free(bin);
+    dime_dmsg_message_destroy(message);
+    dime_dmsg_object_destroy(draft);
+    _free_ed25519_key(signkey);
+}
+
+TEST(DIME, message_batch_signature_verification)
+{
+    EC_KEY *auth_enckey;
+    dmime_kek_t auth_kek;
+    dmime_message_t *message;
+    dmime_object_t *draft, *at_auth;
+    ED25519_KEY *signkey = NULL, *forged;
+    size_t nattach[2] = { 70, 2 };
+    int res;
+
+    ASSERT_DIME_NO_ERROR();
+    _crypto_init();
+    ASSERT_DIME_NO_ERROR();
+
+    forged = _generate_ed25519_keypair();
+    ASSERT_TRUE(forged != NULL) << "Failed to generate a signing key that does not belong to the author.";
+
+    // More chunk signatures than fit in one verification batch, and few enough that they are only verified at the end.
+    for (size_t j = 0; j < 2; j++) {
+        draft = create_attachment_draft(nattach[j], 256, &signkey);
+        ASSERT_TRUE(draft != NULL) << "Failed to create the draft.";
+        auth_enckey = dime_keys_enckey_fetch(".out/attach_auth.keys");
+        ASSERT_TRUE(auth_enckey != NULL) << "Failed to retrieve author encryption keys.";
+        ASSERT_DIME_NO_ERROR();
+
+        for (int i = 0; i < 2; i++) {
+            message = dime_dmsg_message_encrypt(draft, i ? forged : signkey);
+            ASSERT_TRUE(message != NULL) << "Failed to encrypt the message.";
+            ASSERT_DIME_NO_ERROR();
+
+            res = dime_dmsg_kek_in_derive(message, auth_enckey, &auth_kek);
+            ASSERT_EQ(0, res) << "Failed to derive author key encryption key.";
+            at_auth = dime_dmsg_message_envelope_decrypt(message, id_author, &auth_kek);
+            ASSERT_TRUE(at_auth != NULL) << "Failed to decrypt the envelope as the author.";
+
+            at_auth->signet_author = dime_sgnt_signet_dupe(draft->signet_author);
+            at_auth->signet_origin = dime_sgnt_signet_dupe(draft->signet_origin);
+            at_auth->signet_destination = dime_sgnt_signet_dupe(draft->signet_destination);
+            at_auth->signet_recipient = dime_sgnt_signet_dupe(draft->signet_recipient);
+
+            res = dime_dmsg_message_decrypt_as_auth(at_auth, message, &auth_kek);
+
+            if (!i) {
+                ASSERT_EQ(0, res) << "Failed to decrypt the message as author.";
+                ASSERT_DIME_NO_ERROR();
+            } else {
+                ASSERT_EQ(-1, res) << "A message signed with the wrong key was decrypted.";
+                ASSERT_NE(DMIME_OBJECT_STATE_COMPLETE, at_auth->state) << "A message with invalid signatures was marked complete.";
+                ASSERT_TRUE(at_auth->common_headers == NULL && at_auth->other_headers == NULL) << "Unverified headers were left in the object.";
+                ASSERT_TRUE(at_auth->display == NULL && at_auth->attach == NULL) << "Unverified content was left in the object.";
+                _clear_error_stack();
+            }
+
+            dime_dmsg_message_destroy(message);
+            dime_dmsg_object_destroy(at_auth);
+        }
+
+        dime_dmsg_object_destroy(draft);
+        _free_ec_key(auth_enckey);
+        _free_ed25519_key(signkey);
+    }
+
+    _free_ed25519_key(forged);
+}
+
+/**
+ * Times the encryption of a message with 8 attachments on 1, 4 and 16 threads.
+ */
+TEST(DIME, DISABLED_bench_message_encrypt_parallel)
+{
+    dmime_message_t *message;
+    dmime_object_t *draft;
+    ED25519_KEY *signkey = NULL;
+    unsigned int workers[] = { 1, 4, 16 };
+    uint64_t start, elapsed, serial = 0;
+
+    ASSERT_DIME_NO_ERROR();
+    _crypto_init();
+    ASSERT_DIME_NO_ERROR();
+
+    draft = create_attachment_draft(8, 2000000, &signkey);
+    ASSERT_TRUE(draft != NULL) << "Failed to create the benchmark draft.";
+    ASSERT_DIME_NO_ERROR();
+
+    printf("%ld processors online.\n", sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (size_t i = 0; i < (sizeof(workers) / sizeof(workers[0])); i++) {
+        elapsed = 0;
+
+        // The fastest of several runs is kept, so a stray scheduling delay doesn't skew the comparison.
+        for (size_t j = 0; j < 5; j++) {
+            start = clock_ns();
+            message = dime_dmsg_message_encrypt_parallel(draft, signkey, workers[i]);
+            start = clock_ns() - start;
+            ASSERT_TRUE(message != NULL) << "Failed to encrypt the message.";
+            dime_dmsg_message_destroy(message);
+
+            if (!elapsed || start < elapsed) {
+                elapsed = start;
+            }
+
+        }
+
+        if (!serial) {
+            serial = elapsed;
+        }
+
+        printf("%2u workers: %.1f ms per message (%.2fx)\n", workers[i], elapsed / 1000000.0, (double)serial / elapsed);
+    }
+
+    ASSERT_DIME_NO_ERROR();
+    dime_dmsg_object_destroy(draft);
+    _free_ed25519_key(signkey);
+}
@@ -1,11 +1,352 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/ocsp.h>
+#include <openssl/ssl.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
 extern "C" {
 #include "dime/signet-resolver/signet-ssl.h"
+#include "dime/signet-resolver/cache.h"
 }
 #include "gtest/gtest.h"
 
+#define TLS_TEST_HOST "dx.resume.example.test"
+#define N_BENCH_HANDSHAKES 200
+
 TEST(DIME, domain_wildcard) {
     ASSERT_EQ(1, _domain_wildcard_check("www.google.com", "www.google.com"));
     ASSERT_EQ(1, _domain_wildcard_check("*.google.com", "abc.google.com"));
     ASSERT_EQ(1, _domain_wildcard_check("*.google.com", "abc.def.google.com"));
     ASSERT_EQ(0, _domain_wildcard_check("*.google.com", "google.com"));
 }
+
+/*
+ * A stub TLS server with a throwaway self-signed RSA certificate. It accepts one TLS connection per socket pair,
+ * writes a banner, and waits for the client to hang up.
+ */
+typedef struct {
+    SSL_CTX *ctx;
+    int fd;
+} stub_tls_server_t;
+
+static EVP_PKEY *create_stub_key(void) {
+
+    EVP_PKEY *result;
+    RSA *rsa;
+    BIGNUM *e;
+
+    e = BN_new();
+    BN_set_word(e, RSA_F4);
+    rsa = RSA_new();
+    RSA_generate_key_ex(rsa, 2048, e, NULL);
+    BN_free(e);
+    result = EVP_PKEY_new();
+    EVP_PKEY_assign_RSA(result, rsa);
+
+    return result;
+}
+
+// Create a certificate for the key, which is self-signed unless an issuer is given.
+static X509 *create_stub_cert(const char *cn, EVP_PKEY *pkey, X509 *issuer, EVP_PKEY *issuer_key, long serial) {
+
+    X509 *result;
+
+    result = X509_new();
+    X509_set_version(result, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(result), serial);
+    X509_gmtime_adj(X509_get_notBefore(result), 0);
+    X509_gmtime_adj(X509_get_notAfter(result), 3600);
+    X509_set_pubkey(result, pkey);
+    X509_NAME_add_entry_by_txt(X509_get_subject_name(result), "CN", MBSTRING_ASC, (const unsigned char *)cn, -1, -1, 0);
+    X509_set_issuer_name(result, X509_get_subject_name(issuer ? issuer : result));
+    X509_sign(result, issuer_key ? issuer_key : pkey, EVP_sha256());
+
+    return result;
+}
+
+static SSL_CTX *create_stub_tls_context(void) {
+
+    SSL_CTX *result;
+    EVP_PKEY *pkey;
+    X509 *cert;
+
+    pkey = create_stub_key();
+    cert = create_stub_cert(TLS_TEST_HOST, pkey, NULL, NULL, 1);
+
+    result = SSL_CTX_new(SSLv23_server_method());
+    SSL_CTX_use_certificate(result, cert);
+    SSL_CTX_use_PrivateKey(result, pkey);
+    (void)SSL_CTX_set_ecdh_auto(result, 1);
+    X509_free(cert);
+    EVP_PKEY_free(pkey);
+
+    return result;
+}
+
+static void *run_stub_tls_server(void *arg) {
+
+    stub_tls_server_t *server = (stub_tls_server_t *)arg;
+    char buf[64];
+    SSL *ssl;
+
+    ssl = SSL_new(server->ctx);
+    SSL_set_fd(ssl, server->fd);
+
+    if (SSL_accept(ssl) == 1) {
+        SSL_write(ssl, "220 OK\r\n", 8);
+        while (SSL_read(ssl, buf, sizeof(buf)) > 0);
+    }
+
+    SSL_free(ssl);
+    close(server->fd);
+
+    return NULL;
+}
+
+// Start the stub server on one end of a socket pair, and connect to it over STARTTLS from the other.
+static SSL *open_stub_tls_connection(stub_tls_server_t *server, pthread_t *thread) {
+
+    SSL *result;
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        return NULL;
+    }
+
+    server->fd = fds[1];
+
+    if (pthread_create(thread, NULL, run_stub_tls_server, server)) {
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+
+    if (!(result = _ssl_starttls(fds[0], TLS_TEST_HOST))) {
+        close(fds[0]);
+        pthread_join(*thread, NULL);
+    }
+
+    return result;
+}
+
+// Connect to the stub server over STARTTLS, and return whether the TLS session was resumed, or -1 on failure.
+static int connect_stub_tls_server(SSL_CTX *ctx) {
+
+    stub_tls_server_t server;
+    pthread_t thread;
+    char buf[16];
+    SSL *con;
+    int result = -1;
+
+    server.ctx = ctx;
+
+    if (!(con = open_stub_tls_connection(&server, &thread))) {
+        return -1;
+    }
+
+    // Reading the banner also processes any session tickets the server sent after the handshake.
+    if (SSL_read(con, buf, sizeof(buf)) > 0) {
+        result = SSL_session_reused(con) ? 1 : 0;
+    }
+
+    _ssl_disconnect(con);
+    pthread_join(thread, NULL);
+
+    return result;
+}
+
+// Create an OCSP response from the issuer of a certificate reporting its status, which is current for the next hour.
+static OCSP_RESPONSE *create_stub_ocsp_response(X509 *cert, X509 *issuer, EVP_PKEY *issuer_key, int status) {
+
+    OCSP_RESPONSE *result;
+    OCSP_BASICRESP *basic;
+    OCSP_CERTID *cid;
+    ASN1_TIME *thisupd, *nextupd, *revtime;
+
+    cid = OCSP_cert_to_id(NULL, cert, issuer);
+    thisupd = X509_gmtime_adj(NULL, 0);
+    nextupd = X509_gmtime_adj(NULL, 3600);
+    revtime = X509_gmtime_adj(NULL, -60);
+
+    basic = OCSP_BASICRESP_new();
+    OCSP_basic_add1_status(basic, cid, status, OCSP_REVOKED_STATUS_NOSTATUS, (status == V_OCSP_CERTSTATUS_REVOKED) ? revtime : NULL, thisupd, nextupd);
+    OCSP_basic_sign(basic, issuer, issuer_key, EVP_sha256(), NULL, 0);
+    result = OCSP_response_create(OCSP_RESPONSE_STATUS_SUCCESSFUL, basic);
+
+    OCSP_BASICRESP_free(basic);
+    OCSP_CERTID_free(cid);
+    ASN1_TIME_free(thisupd);
+    ASN1_TIME_free(nextupd);
+    ASN1_TIME_free(revtime);
+
+    return result;
+}
+
+static int stub_status_requests = 0;
+
+// The stub server's OCSP status callback, which staples the response it was set up with, if any.
+static int staple_stub_ocsp_response(SSL *s, void *arg) {
+
+    unsigned char *der = NULL;
+    int len;
+
+    __atomic_add_fetch(&stub_status_requests, 1, __ATOMIC_SEQ_CST);
+
+    if (!arg || ((len = i2d_OCSP_RESPONSE((OCSP_RESPONSE *)arg, &der)) <= 0)) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+
+    SSL_set_tlsext_status_ocsp_resp(s, der, len);
+
+    return SSL_TLSEXT_ERR_OK;
+}
+
+static uint64_t clock_ns(clockid_t clock) {
+
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+TEST(DIME, check_ssl_session_resumption)
+{
+    SSL_CTX *ctx;
+
+    ctx = create_stub_tls_context();
+    ASSERT_TRUE(ctx != NULL) << "Failed to create stub TLS server context.";
+    remove_cached_object(TLS_TEST_HOST, &(cached_stores[cached_data_tls_session]));
+
+    // The first connection to a host makes a full handshake, and later ones resume its session.
+    ASSERT_EQ(0, ssl_set_session_cache(ssl_session_cache_memory));
+    ASSERT_EQ(0, connect_stub_tls_server(ctx)) << "First TLS connection to host was unexpectedly resumed.";
+    ASSERT_EQ(1, connect_stub_tls_server(ctx)) << "Second TLS connection to host did not resume the cached session.";
+    ASSERT_EQ(1, connect_stub_tls_server(ctx)) << "Third TLS connection to host did not resume the cached session.";
+
+    // Without session caching, every connection makes a full handshake.
+    ASSERT_EQ(0, ssl_set_session_cache(ssl_session_cache_off));
+    ASSERT_EQ(0, connect_stub_tls_server(ctx)) << "TLS connection was resumed with session caching disabled.";
+
+    ASSERT_EQ(0, ssl_set_session_cache(ssl_session_cache_memory));
+    remove_cached_object(TLS_TEST_HOST, &(cached_stores[cached_data_tls_session]));
+    SSL_CTX_free(ctx);
+}
+
+TEST(DIME, check_ssl_ocsp_stapling)
+{
+    stub_tls_server_t server;
+    OCSP_RESPONSE *staple;
+    OCSP_CERTID *cid;
+    EVP_PKEY *ca_key, *key;
+    X509 *ca, *cert;
+    pthread_t thread;
+    char cidstr[512];
+    int fallthrough;
+    SSL *con;
+
+    ca_key = create_stub_key();
+    key = create_stub_key();
+    ca = create_stub_cert("Stub OCSP Test CA", ca_key, NULL, NULL, 1);
+    cert = create_stub_cert(TLS_TEST_HOST, key, ca, ca_key, 2);
+    staple = create_stub_ocsp_response(cert, ca, ca_key, V_OCSP_CERTSTATUS_GOOD);
+
+    server.ctx = SSL_CTX_new(SSLv23_server_method());
+    SSL_CTX_use_certificate(server.ctx, cert);
+    SSL_CTX_use_PrivateKey(server.ctx, key);
+    SSL_CTX_add_extra_chain_cert(server.ctx, X509_dup(ca));
+    (void)SSL_CTX_set_ecdh_auto(server.ctx, 1);
+    SSL_CTX_set_tlsext_status_cb(server.ctx, staple_stub_ocsp_response);
+    SSL_CTX_set_tlsext_status_arg(server.ctx, staple);
+
+    cid = OCSP_cert_to_id(NULL, cert, ca);
+    ASSERT_TRUE(_get_cache_ocsp_id(cert, cid, cidstr, sizeof(cidstr)) != NULL) << "Failed to derive OCSP cache id of certificate.";
+    remove_cached_object(cidstr, &(cached_stores[cached_data_ocsp]));
+
+    // A resumed session skips the certificate exchange, and with it the stapled response.
+    ASSERT_EQ(0, ssl_set_session_cache(ssl_session_cache_off));
+
+    // The server is asked to staple a response, but ours isn't signed by a trusted root, so the client ignores it. With no
+    // verdict cached and no OCSP responder named in the certificate, validation falls through.
+    __atomic_store_n(&stub_status_requests, 0, __ATOMIC_SEQ_CST);
+    ASSERT_TRUE((con = open_stub_tls_connection(&server, &thread)) != NULL) << "Unverifiable stapled OCSP response aborted the handshake.";
+    ASSERT_EQ(1, __atomic_load_n(&stub_status_requests, __ATOMIC_SEQ_CST)) << "OCSP stapling was not requested in the TLS handshake.";
+    ASSERT_EQ(1, _do_ocsp_validation(con, &fallthrough));
+    ASSERT_EQ(1, fallthrough) << "OCSP validation completed without a verdict.";
+    _ssl_disconnect(con);
+    pthread_join(thread, NULL);
+
+    // Cached verdicts are trusted without the response being verified again, or the responder being asked.
+    ASSERT_TRUE(_add_cached_object(cidstr, &(cached_stores[cached_data_ocsp]), 0, time(NULL) + 3600,
+        create_stub_ocsp_response(cert, ca, ca_key, V_OCSP_CERTSTATUS_GOOD), 0, 0) != NULL);
+    ASSERT_TRUE((con = open_stub_tls_connection(&server, &thread)) != NULL);
+    ASSERT_EQ(1, _do_ocsp_validation(con, &fallthrough)) << "Certificate failed validation against a good cached OCSP verdict.";
+    ASSERT_EQ(0, fallthrough);
+    _ssl_disconnect(con);
+    pthread_join(thread, NULL);
+
+    ASSERT_EQ(1, remove_cached_object(cidstr, &(cached_stores[cached_data_ocsp])));
+    ASSERT_TRUE(_add_cached_object(cidstr, &(cached_stores[cached_data_ocsp]), 0, time(NULL) + 3600,
+        create_stub_ocsp_response(cert, ca, ca_key, V_OCSP_CERTSTATUS_REVOKED), 0, 0) != NULL);
+
+    SSL_CTX_set_tlsext_status_arg(server.ctx, NULL);
+    ASSERT_TRUE((con = open_stub_tls_connection(&server, &thread)) != NULL);
+    ASSERT_EQ(0, _do_ocsp_validation(con, &fallthrough)) << "Certificate passed validation against a revoked cached OCSP verdict.";
+    ASSERT_EQ(0, fallthrough);
+    _ssl_disconnect(con);
+    pthread_join(thread, NULL);
+
+    // Once the certificate is known to be revoked, a handshake that staples a response for it is aborted.
+    SSL_CTX_set_tlsext_status_arg(server.ctx, staple);
+    ASSERT_TRUE(open_stub_tls_connection(&server, &thread) == NULL) << "Handshake with a revoked certificate was not aborted.";
+    _clear_error_stack();
+
+    remove_cached_object(cidstr, &(cached_stores[cached_data_ocsp]));
+    ASSERT_EQ(0, ssl_set_session_cache(ssl_session_cache_memory));
+    OCSP_CERTID_free(cid);
+    OCSP_RESPONSE_free(staple);
+    SSL_CTX_free(server.ctx);
+    X509_free(cert);
+    X509_free(ca);
+    EVP_PKEY_free(key);
+    EVP_PKEY_free(ca_key);
+}
+
+TEST(DIME, DISABLED_bench_ssl_session_resumption)
+{
+    ssl_session_cache_t modes[2] = { ssl_session_cache_off, ssl_session_cache_memory };
+    uint64_t start_cpu, start_wall;
+    SSL_CTX *ctx;
+    int resumed;
+
+    ctx = create_stub_tls_context();
+    ASSERT_TRUE(ctx != NULL) << "Failed to create stub TLS server context.";
+
+    for (size_t i = 0; i < (sizeof(modes) / sizeof(modes[0])); i++) {
+        ASSERT_EQ(0, ssl_set_session_cache(modes[i]));
+        remove_cached_object(TLS_TEST_HOST, &(cached_stores[cached_data_tls_session]));
+        ASSERT_LE(0, connect_stub_tls_server(ctx));
+
+        resumed = 0;
+        start_cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+        start_wall = clock_ns(CLOCK_MONOTONIC);
+
+        for (size_t j = 0; j < N_BENCH_HANDSHAKES; j++) {
+            resumed += connect_stub_tls_server(ctx);
+        }
+
+        // CPU time covers both ends of the handshake, since most of what resumption saves is the server's signature.
+        printf("session cache %s: %d/%d handshakes resumed, %.1f us elapsed and %.1f us of CPU per handshake\n", (modes[i] == ssl_session_cache_off) ? "off" : "on",
+            resumed, N_BENCH_HANDSHAKES, (clock_ns(CLOCK_MONOTONIC) - start_wall) / (1000.0 * N_BENCH_HANDSHAKES),
+            (clock_ns(CLOCK_PROCESS_CPUTIME_ID) - start_cpu) / (1000.0 * N_BENCH_HANDSHAKES));
+    }
+
+    ASSERT_EQ(0, ssl_set_session_cache(ssl_session_cache_memory));
+    SSL_CTX_free(ctx);
+}
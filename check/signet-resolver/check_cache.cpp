@@ -0,0 +1,828 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+#include "dime/signet-resolver/cache.h"
+#include "dime/signet/signet.h"
+}
+#include "gtest/gtest.h"
+
+#define N_INDEX_TEST_OBJECTS 5000
+#define N_MAPPED_TEST_SIGNETS 20
+#define N_THREADED_TEST_OBJECTS 1000
+#define N_BUDGET_TEST_SIGNETS 50
+#define N_THREADED_TEST_THREADS 8
+
+typedef struct {
+    cached_store_t *store;
+    size_t nobjects;
+    size_t nlookups;
+    size_t misses;
+} lookup_thread_t;
+
+// Internal stores hand out the cached objects themselves, so only the copies handed out by other stores are destroyed.
+static void release_cached_object(cached_store_t *store, cached_object_t *obj) {
+
+    if (obj && !store->internal) {
+        destroy_cache_entry(obj);
+    }
+
+}
+
+static void fill_cached_store(cached_store_t *store, size_t start, size_t end) {
+
+    cached_object_t *obj;
+    char oid[64];
+
+    for (size_t i = start; i < end; i++) {
+        snprintf(oid, sizeof(oid), "check-object-%zu", i);
+        obj = add_cached_object(oid, store, 0, 0, NULL, 0, 0);
+        ASSERT_TRUE(obj != NULL) << "Could not add object to cached store: " << oid;
+        release_cached_object(store, obj);
+    }
+
+}
+
+static int cached_object_found(const char *oid, cached_store_t *store) {
+
+    cached_object_t *obj;
+
+    if (!(obj = find_cached_object(oid, store))) {
+        return 0;
+    }
+
+    release_cached_object(store, obj);
+
+    return 1;
+}
+
+static void empty_cached_store(cached_store_t *store, size_t start, size_t end) {
+
+    char oid[64];
+
+    for (size_t i = start; i < end; i++) {
+        snprintf(oid, sizeof(oid), "check-object-%zu", i);
+        remove_cached_object(oid, store);
+    }
+
+}
+
+static void *lookup_cached_objects(void *arg) {
+
+    lookup_thread_t *lt = (lookup_thread_t *)arg;
+    char oid[64];
+
+    for (size_t i = 0; i < lt->nlookups; i++) {
+        snprintf(oid, sizeof(oid), "check-object-%zu", (i * 2654435761U) % lt->nobjects);
+
+        if (!cached_object_found(oid, lt->store)) {
+            lt->misses++;
+        }
+
+    }
+
+    return NULL;
+}
+
+typedef struct {
+    cached_store_t *store;
+    int leader;
+    int found;
+    int finished;
+} flight_thread_t;
+
+// Miss an object that is already being looked up, wait for that lookup, and then check the cache for its outcome.
+static void *wait_cached_flight(void *arg) {
+
+    flight_thread_t *ft = (flight_thread_t *)arg;
+    cached_flight_t *flight;
+
+    ft->leader = _begin_cached_flight("check-flight", ft->store, 1, &flight);
+    ft->found = cached_object_found("check-flight", ft->store);
+    __atomic_store_n(&(ft->finished), 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static size_t refreshed_objects;
+
+static void refresh_cached_object(cached_object_t *obj) {
+
+    cached_store_t *store = &(cached_stores[cached_data_signet]);
+
+    refreshed_objects++;
+    release_cached_object(store, _replace_cached_object(obj->name, store, obj->ttl, 0, NULL, 0, 0));
+}
+
+TEST(DIME, check_cache_index)
+{
+    cached_store_t *store = &(cached_stores[cached_data_ocsp]);
+    cached_object_t *ptr;
+    char oid[64];
+    size_t count = 0;
+
+    fill_cached_store(store, 0, N_INDEX_TEST_OBJECTS);
+    ASSERT_EQ((size_t)N_INDEX_TEST_OBJECTS, _cached_store_count(store));
+
+    ptr = add_cached_object("check-object-1", store, 0, 0, NULL, 0, 0);
+    ASSERT_TRUE(ptr == NULL) << "Cached store accepted an object with a duplicate id.";
+
+    // Remove every other object, and make sure exactly the remaining ones are still found.
+    for (size_t i = 0; i < N_INDEX_TEST_OBJECTS; i += 2) {
+        snprintf(oid, sizeof(oid), "check-object-%zu", i);
+        ASSERT_EQ(1, remove_cached_object(oid, store)) << "Could not remove object from cached store: " << oid;
+    }
+
+    for (size_t i = 0; i < N_INDEX_TEST_OBJECTS; i++) {
+        snprintf(oid, sizeof(oid), "check-object-%zu", i);
+        ptr = find_cached_object(oid, store);
+
+        if (i % 2) {
+            ASSERT_TRUE(ptr != NULL) << "Could not find object in cached store: " << oid;
+        } else {
+            ASSERT_TRUE(ptr == NULL) << "Found removed object in cached store: " << oid;
+        }
+
+        release_cached_object(store, ptr);
+    }
+
+    // The linked list must still hold every live object, in reverse order of insertion.
+    for (ptr = store->head; ptr; ptr = ptr->next, count++) {
+
+        if (ptr->next) {
+            ASSERT_EQ(ptr, ptr->next->prev) << "Cached store linked list is corrupted.";
+        }
+
+    }
+
+    ASSERT_EQ((size_t)N_INDEX_TEST_OBJECTS / 2, count);
+    ASSERT_EQ(count, _cached_store_count(store));
+
+    empty_cached_store(store, 0, N_INDEX_TEST_OBJECTS);
+    ASSERT_TRUE(store->head == NULL);
+    ASSERT_EQ(0U, _cached_store_count(store));
+}
+
+TEST(DIME, check_cache_journal_replay)
+{
+    cached_store_t *store = &(cached_stores[cached_data_ocsp]);
+    cached_object_t *ptr;
+    char cfile[] = "/tmp/dime-check-cache-XXXXXX", *jfile, oid[64];
+    size_t mark;
+    int fd, res;
+
+    fd = mkstemp(cfile);
+    ASSERT_GE(fd, 0) << "Could not create temporary cache file.";
+    close(fd);
+
+    res = set_cache_location(cfile);
+    ASSERT_EQ(0, res) << "Could not set cache location.";
+
+    jfile = _get_cache_journal_location();
+    ASSERT_TRUE(jfile != NULL) << "Could not determine cache journal location.";
+
+    fill_cached_store(store, 0, 10);
+
+    // Journal the removal of the odd objects, and then make sure that replaying the journal removes them from the store.
+    for (size_t i = 1; i < 10; i += 2) {
+        snprintf(oid, sizeof(oid), "check-object-%zu", i);
+        ptr = find_cached_object(oid, store);
+        ASSERT_TRUE(ptr != NULL) << "Could not find object in cached store: " << oid;
+
+        res = _append_cache_journal(cache_journal_remove, cached_data_ocsp, ptr->id, sizeof(ptr->id));
+        ASSERT_EQ(0, res) << "Could not append removal record to cache journal.";
+    }
+
+    res = _replay_cache_journal();
+    ASSERT_EQ(5, res) << "Cache journal replay returned the wrong number of records.";
+
+    for (size_t i = 0; i < 10; i++) {
+        snprintf(oid, sizeof(oid), "check-object-%zu", i);
+        ASSERT_EQ((i % 2) ? 0 : 1, cached_object_found(oid, store)) << "Journal replay mismatch for object: " << oid;
+    }
+
+    // Records journaled while the base cache file was being written must survive the journal being folded into it.
+    mark = _get_cache_journal_size();
+    ptr = find_cached_object("check-object-0", store);
+    ASSERT_TRUE(ptr != NULL) << "Could not find object in cached store: check-object-0";
+
+    res = _append_cache_journal(cache_journal_remove, cached_data_ocsp, ptr->id, sizeof(ptr->id));
+    ASSERT_EQ(0, res) << "Could not append removal record to cache journal.";
+
+    res = _truncate_cache_journal(0, mark);
+    ASSERT_EQ(0, res) << "Could not truncate cache journal.";
+
+    res = _replay_cache_journal();
+    ASSERT_EQ(1, res) << "Cache journal did not keep the record appended after its mark.";
+    ASSERT_EQ(0, cached_object_found("check-object-0", store)) << "Kept journal record was not replayed.";
+
+    // Folding the whole journal into the base cache file should leave it empty.
+    res = _truncate_cache_journal(0, _get_cache_journal_size());
+    ASSERT_EQ(0, res) << "Could not truncate cache journal.";
+
+    res = _replay_cache_journal();
+    ASSERT_EQ(0, res) << "Truncated cache journal still contained records.";
+
+    empty_cached_store(store, 0, 10);
+    unlink(jfile);
+    unlink(cfile);
+    free(jfile);
+}
+
+TEST(DIME, check_cache_journal_no_save)
+{
+    cached_store_t *store = &(cached_stores[cached_data_ocsp]);
+    cached_object_t *ptr;
+    char cfile[] = "/tmp/dime-check-cache-XXXXXX", *jfile;
+    int fd, res;
+
+    fd = mkstemp(cfile);
+    ASSERT_GE(fd, 0) << "Could not create temporary cache file.";
+    close(fd);
+
+    res = set_cache_location(cfile);
+    ASSERT_EQ(0, res) << "Could not set cache location.";
+
+    jfile = _get_cache_journal_location();
+    ASSERT_TRUE(jfile != NULL) << "Could not determine cache journal location.";
+
+    // A cache that may not be saved leaves persistent changes out of the journal without raising any errors.
+    res = set_cache_permissions(CACHE_PERM_READ | CACHE_PERM_ADD | CACHE_PERM_DELETE);
+    ASSERT_EQ(0, res) << "Could not set cache permissions.";
+
+    ptr = add_cached_object("check-no-save", store, 0, 0, NULL, 1, 0);
+    ASSERT_TRUE(ptr != NULL) << "Could not add persistent object to cached store.";
+    ASSERT_TRUE(get_last_error() == NULL) << "Adding a persistent object to a cache that may not be saved raised an error.";
+
+    res = remove_cached_object("check-no-save", store);
+    ASSERT_EQ(1, res) << "Could not remove persistent object from cached store.";
+    ASSERT_TRUE(get_last_error() == NULL) << "Removing a persistent object from a cache that may not be saved raised an error.";
+    ASSERT_NE(0, access(jfile, F_OK)) << "Cache journal was written for a cache that may not be saved.";
+
+    res = set_cache_permissions(CACHE_PERM_DEFAULT);
+    ASSERT_EQ(0, res) << "Could not restore cache permissions.";
+
+    unlink(cfile);
+    free(jfile);
+}
+
+TEST(DIME, check_cache_mapped_load)
+{
+    cached_store_t *store = &(cached_stores[cached_data_signet]);
+    cached_object_t *ptr;
+    signet_t *signet;
+    const char *keysfile = ".out/keys_cache.keys";
+    char cfile[] = "/tmp/dime-check-cache-XXXXXX", *jfile, oid[64], magic[8];
+    size_t nmapped = 0;
+    FILE *fp;
+    int fd, res;
+
+    fd = mkstemp(cfile);
+    ASSERT_GE(fd, 0) << "Could not create temporary cache file.";
+    close(fd);
+
+    res = set_cache_location(cfile);
+    ASSERT_EQ(0, res) << "Could not set cache location.";
+
+    jfile = _get_cache_journal_location();
+    ASSERT_TRUE(jfile != NULL) << "Could not determine cache journal location.";
+
+    set_cache_journaling(0);
+
+    for (size_t i = 0; i < N_MAPPED_TEST_SIGNETS; i++) {
+        signet = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_USER, keysfile);
+        ASSERT_TRUE(signet != NULL) << "Failure to create user signet.";
+
+        snprintf(oid, sizeof(oid), "check-signet-%zu", i);
+        ptr = add_cached_object(oid, store, 0, 0, signet, 1, 0);
+        ASSERT_TRUE(ptr != NULL) << "Could not add signet to cached store: " << oid;
+        destroy_cache_entry(ptr);
+    }
+
+    res = save_cache_contents();
+    ASSERT_EQ(0, res) << "Could not save cache contents.";
+
+    fp = fopen(cfile, "r");
+    ASSERT_TRUE(fp != NULL) << "Could not open saved cache file.";
+    ASSERT_EQ(1U, fread(magic, sizeof(magic), 1, fp));
+    fclose(fp);
+    ASSERT_EQ(0, memcmp(magic, CACHE_FILE_MAGIC, sizeof(magic))) << "Saved cache file was not in the versioned format.";
+
+    for (size_t i = 0; i < N_MAPPED_TEST_SIGNETS; i++) {
+        snprintf(oid, sizeof(oid), "check-signet-%zu", i);
+        ASSERT_EQ(1, remove_cached_object(oid, store)) << "Could not remove signet from cached store: " << oid;
+    }
+
+    res = load_cache_contents();
+    ASSERT_EQ(1, res) << "Could not load cache contents.";
+
+    // Nothing should have been decoded yet.
+    for (ptr = store->head; ptr; ptr = ptr->next) {
+        ASSERT_TRUE(ptr->data == NULL) << "Signet was decoded while loading the cache.";
+        ASSERT_TRUE(ptr->mapped != NULL) << "Signet was not mapped while loading the cache.";
+        nmapped++;
+    }
+
+    ASSERT_EQ((size_t)N_MAPPED_TEST_SIGNETS, nmapped);
+
+    // Signets are decoded straight from the mapping the first time they are looked up.
+    for (size_t i = 0; i < N_MAPPED_TEST_SIGNETS; i++) {
+        snprintf(oid, sizeof(oid), "check-signet-%zu", i);
+        ptr = find_cached_object(oid, store);
+        ASSERT_TRUE(ptr != NULL) << "Could not find mapped signet in cached store: " << oid;
+        ASSERT_TRUE(ptr->data != NULL) << "Mapped signet could not be decoded: " << oid;
+        ASSERT_EQ(SIGNET_TYPE_USER, dime_sgnt_type_get((signet_t *)ptr->data)) << "Mapped signet was corrupted: " << oid;
+        destroy_cache_entry(ptr);
+    }
+
+    // After that, the decoded signets are shared with every caller.
+    for (ptr = store->head; ptr; ptr = ptr->next) {
+        ASSERT_TRUE(ptr->data != NULL) << "Cached signet was not decoded on lookup.";
+        ASSERT_TRUE(ptr->mapped == NULL) << "Decoded signet still refers to the mapping.";
+        ASSERT_EQ(0U, ((signet_t *)ptr->data)->refs) << "Released signet reference was leaked.";
+    }
+
+    // Saving again must carry the signets over unchanged.
+    res = save_cache_contents();
+    ASSERT_EQ(0, res) << "Could not re-save mapped cache contents.";
+
+    for (size_t i = 0; i < N_MAPPED_TEST_SIGNETS; i++) {
+        snprintf(oid, sizeof(oid), "check-signet-%zu", i);
+        remove_cached_object(oid, store);
+    }
+
+    res = load_cache_contents();
+    ASSERT_EQ(1, res) << "Could not reload cache contents.";
+    ASSERT_EQ((size_t)N_MAPPED_TEST_SIGNETS, _cached_store_count(store));
+
+    for (size_t i = 0; i < N_MAPPED_TEST_SIGNETS; i++) {
+        snprintf(oid, sizeof(oid), "check-signet-%zu", i);
+        remove_cached_object(oid, store);
+    }
+
+    set_cache_journaling(1);
+    unlink(jfile);
+    unlink(cfile);
+    free(jfile);
+}
+
+TEST(DIME, check_cache_shared_signets)
+{
+    cached_store_t *store = &(cached_stores[cached_data_signet]);
+    cached_object_t *ptr, *first, *second;
+    signet_t *signet;
+    int res;
+
+    signet = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_USER, ".out/keys_cache.keys");
+    ASSERT_TRUE(signet != NULL) << "Failure to create user signet.";
+
+    ptr = add_cached_object("check-shared-signet", store, 0, 0, signet, 0, 0);
+    ASSERT_TRUE(ptr != NULL) << "Could not add signet to cached store.";
+    destroy_cache_entry(ptr);
+
+    // Every hit should hand out a reference to the same signet rather than a copy of it.
+    first = find_cached_object("check-shared-signet", store);
+    ASSERT_TRUE(first != NULL) << "Could not find signet in cached store.";
+    second = find_cached_object("check-shared-signet", store);
+    ASSERT_TRUE(second != NULL) << "Could not find signet in cached store.";
+
+    ASSERT_EQ(signet, first->data) << "Cached signet was copied on lookup.";
+    ASSERT_EQ(signet, second->data) << "Cached signet was copied on lookup.";
+    ASSERT_EQ(2U, signet->refs);
+
+    // The signet has to outlive its removal from the cache for as long as there are references to it.
+    res = remove_cached_object("check-shared-signet", store);
+    ASSERT_EQ(1, res) << "Could not remove signet from cached store.";
+    ASSERT_EQ(1U, signet->refs);
+    ASSERT_EQ(SIGNET_TYPE_USER, dime_sgnt_type_get((signet_t *)first->data));
+
+    destroy_cache_entry(first);
+    ASSERT_EQ(0U, signet->refs);
+    destroy_cache_entry(second);
+}
+
+// Run with --gtest_also_run_disabled_tests --gtest_filter=*bench_cache_lookup_scaling to print lookup latency by store size.
+TEST(DIME, DISABLED_bench_cache_lookup_scaling)
+{
+    cached_store_t *store = &(cached_stores[cached_data_ocsp]);
+    cached_object_t *ptr;
+    struct timespec start, end;
+    char oid[64];
+    size_t total = 0, nlookups = 100000;
+    double elapsed;
+
+    for (size_t size = 1000; size <= 1000000; size *= 10) {
+        fill_cached_store(store, total, size);
+        total = size;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (size_t i = 0; i < nlookups; i++) {
+            snprintf(oid, sizeof(oid), "check-object-%zu", (i * 2654435761U) % size);
+            ASSERT_TRUE((ptr = find_cached_object(oid, store)) != NULL);
+            release_cached_object(store, ptr);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        elapsed = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        printf("%8zu cached objects: %.0f ns per lookup\n", size, elapsed / nlookups);
+    }
+
+    empty_cached_store(store, 0, total);
+}
+
+TEST(DIME, check_cache_budget)
+{
+    cached_store_t *store = &(cached_stores[cached_data_signet]);
+    cached_object_t *ptr;
+    signet_t *signet, *override;
+    const char *keysfile = ".out/keys_cache.keys";
+    char oid[64];
+    size_t base, budget, resident, evictions;
+    int res;
+
+    set_cache_journaling(0);
+
+    for (size_t i = 0; i < 4; i++) {
+        signet = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_USER, keysfile);
+        ASSERT_TRUE(signet != NULL) << "Failure to create user signet.";
+
+        snprintf(oid, sizeof(oid), "check-budget-persist-%zu", i);
+        ptr = add_cached_object(oid, store, 0, 0, signet, 1, 0);
+        ASSERT_TRUE(ptr != NULL) << "Could not add signet to cached store: " << oid;
+        destroy_cache_entry(ptr);
+    }
+
+    // An object that overrides another one can't be evicted without losing the override.
+    signet = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_USER, keysfile);
+    ASSERT_TRUE(signet != NULL) << "Failure to create user signet.";
+    ptr = add_cached_object("check-budget-override", store, 0, 0, signet, 0, 0);
+    ASSERT_TRUE(ptr != NULL) << "Could not add signet to cached store.";
+    destroy_cache_entry(ptr);
+
+    override = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_USER, keysfile);
+    ASSERT_TRUE(override != NULL) << "Failure to create user signet.";
+    ptr = add_cached_object_forced("check-budget-override", store, 0, 0, override, 0, 0);
+    ASSERT_TRUE(ptr != NULL) << "Could not override signet in cached store.";
+    destroy_cache_entry(ptr);
+
+    res = get_cache_usage(cached_data_signet, &base, &evictions);
+    ASSERT_EQ(0, res) << "Could not get cached store usage.";
+    ASSERT_GT(base, 0U) << "Cached signets were not charged to their store.";
+    ASSERT_EQ(0U, evictions);
+
+    res = set_cache_store_budget(cached_data_ocsp, base);
+    ASSERT_EQ(-1, res) << "Internal cached store accepted a memory budget.";
+
+    budget = base * 2;
+    res = set_cache_store_budget(cached_data_signet, budget);
+    ASSERT_EQ(0, res) << "Could not set cached store memory budget.";
+
+    for (size_t i = 0; i < N_BUDGET_TEST_SIGNETS; i++) {
+        signet = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_USER, keysfile);
+        ASSERT_TRUE(signet != NULL) << "Failure to create user signet.";
+
+        snprintf(oid, sizeof(oid), "check-budget-ephemeral-%zu", i);
+        ptr = add_cached_object(oid, store, 0, 0, signet, 0, 0);
+        ASSERT_TRUE(ptr != NULL) << "Could not add signet to cached store: " << oid;
+        destroy_cache_entry(ptr);
+
+        get_cache_usage(cached_data_signet, &resident, NULL);
+        ASSERT_LE(resident, budget) << "Cached store grew beyond its memory budget.";
+    }
+
+    get_cache_usage(cached_data_signet, NULL, &evictions);
+    ASSERT_GT(evictions, 0U) << "Nothing was evicted from the cached store.";
+
+    // The ephemeral signets should have been evicted in favor of the persistent ones and the override.
+    for (size_t i = 0; i < 4; i++) {
+        snprintf(oid, sizeof(oid), "check-budget-persist-%zu", i);
+        ptr = find_cached_object(oid, store);
+        ASSERT_TRUE(ptr != NULL) << "Persistent signet was evicted from the cached store: " << oid;
+        destroy_cache_entry(ptr);
+    }
+
+    ptr = find_cached_object("check-budget-override", store);
+    ASSERT_TRUE(ptr != NULL) << "Overriding signet was evicted from the cached store.";
+    ASSERT_EQ(override, ptr->data) << "Override was lost from the cached store.";
+    destroy_cache_entry(ptr);
+
+    res = set_cache_store_budget(cached_data_signet, 0);
+    ASSERT_EQ(0, res) << "Could not clear cached store memory budget.";
+
+    for (size_t i = 0; i < N_BUDGET_TEST_SIGNETS; i++) {
+        snprintf(oid, sizeof(oid), "check-budget-ephemeral-%zu", i);
+        remove_cached_object(oid, store);
+    }
+
+    for (size_t i = 0; i < 4; i++) {
+        snprintf(oid, sizeof(oid), "check-budget-persist-%zu", i);
+        remove_cached_object(oid, store);
+    }
+
+    remove_cached_object("check-budget-override", store);
+
+    get_cache_usage(cached_data_signet, &resident, NULL);
+    ASSERT_EQ(0U, resident) << "Removed signets were still charged to their store.";
+    set_cache_journaling(1);
+}
+
+TEST(DIME, check_cache_replace)
+{
+    cached_store_t *store = &(cached_stores[cached_data_signet]);
+    cached_object_t *ptr;
+    size_t base, resident;
+
+    set_cache_journaling(0);
+
+    ptr = _replace_cached_object("check-replace", store, 0, 0, NULL, 0, 0);
+    ASSERT_TRUE(ptr != NULL) << "Could not add object to cached store.";
+    destroy_cache_entry(ptr);
+    get_cache_usage(cached_data_signet, &base, NULL);
+
+    // Replacing an object over and over again mustn't keep the objects it replaced around as shadows.
+    for (size_t i = 0; i < N_THREADED_TEST_OBJECTS; i++) {
+        ptr = _replace_cached_object("check-replace", store, 0, 0, NULL, 0, 0);
+        ASSERT_TRUE(ptr != NULL) << "Could not replace object in cached store.";
+        destroy_cache_entry(ptr);
+    }
+
+    get_cache_usage(cached_data_signet, &resident, NULL);
+    ASSERT_EQ(base, resident) << "Replaced objects were still charged to their store.";
+
+    _lock_cache_store(store);
+    ASSERT_EQ(1U, _trim_cached_store(store, 0)) << "Replacement object could not be evicted from its store.";
+    _unlock_cache_store(store);
+
+    ASSERT_FALSE(cached_object_found("check-replace", store)) << "Evicted object was still found in the cached store.";
+    set_cache_journaling(1);
+}
+
+TEST(DIME, check_cache_sweep)
+{
+    cached_store_t *store = &(cached_stores[cached_data_signet]), *internal = &(cached_stores[cached_data_ocsp]);
+    cached_object_t *obj;
+    char oid[64];
+    size_t count;
+    time_t now;
+    int res;
+
+    now = time(NULL);
+
+    for (size_t i = 0; i < 10; i++) {
+        snprintf(oid, sizeof(oid), "check-sweep-%zu", i);
+        obj = add_cached_object(oid, store, (i % 2) ? 100 : 0, 0, NULL, 0, 0);
+        ASSERT_TRUE(obj != NULL) << "Could not add object to cached store: " << oid;
+        release_cached_object(store, obj);
+    }
+
+    res = sweep_cache(now + 50);
+    ASSERT_GE(res, 0) << "Cache sweep failed.";
+
+    for (size_t i = 0; i < 10; i++) {
+        snprintf(oid, sizeof(oid), "check-sweep-%zu", i);
+        ASSERT_EQ(1, cached_object_found(oid, store)) << "Cache sweep evicted object before its TTL ran out: " << oid;
+    }
+
+    res = sweep_cache(now + 101);
+    ASSERT_GE(res, 5) << "Cache sweep did not evict the objects whose TTL ran out.";
+
+    for (size_t i = 0; i < 10; i++) {
+        snprintf(oid, sizeof(oid), "check-sweep-%zu", i);
+        ASSERT_EQ((i % 2) ? 0 : 1, cached_object_found(oid, store)) << "Unexpected sweep result for object: " << oid;
+    }
+
+    // Only objects that are looked up should be refreshed ahead of their expiration.
+    refreshed_objects = 0;
+    res = set_cache_refresh_handler(cached_data_signet, refresh_cached_object);
+    ASSERT_EQ(0, res) << "Could not set cached store refresh handler.";
+
+    now = time(NULL);
+    obj = add_cached_object("check-sweep-hot", store, 100, 0, NULL, 0, 0);
+    ASSERT_TRUE(obj != NULL) << "Could not add hot object to cached store.";
+    release_cached_object(store, obj);
+    obj = add_cached_object("check-sweep-cold", store, 100, 0, NULL, 0, 0);
+    ASSERT_TRUE(obj != NULL) << "Could not add cold object to cached store.";
+    release_cached_object(store, obj);
+    ASSERT_EQ(1, cached_object_found("check-sweep-hot", store));
+
+    res = sweep_cache(now + 95);
+    ASSERT_GE(res, 0) << "Cache sweep failed.";
+    ASSERT_EQ(1U, refreshed_objects) << "Cache sweep did not refresh exactly one hot object.";
+
+    res = sweep_cache(now + 101);
+    ASSERT_GE(res, 1) << "Cache sweep did not evict the cold object.";
+    ASSERT_EQ(0, cached_object_found("check-sweep-cold", store));
+
+    res = set_cache_refresh_handler(cached_data_signet, NULL);
+    ASSERT_EQ(0, res) << "Could not clear cached store refresh handler.";
+
+    // Neither the background sweeper nor an explicit sweep may touch internal stores, since their objects are handed out without copies.
+    obj = add_cached_object("check-sweep-internal", internal, 1, 0, NULL, 0, 0);
+    ASSERT_TRUE(obj != NULL) << "Could not add internal object to cached store.";
+    count = internal->expiry_used;
+
+    res = start_cache_sweeper(1);
+    ASSERT_EQ(0, res) << "Could not start background cache sweeper.";
+    sleep(3);
+    stop_cache_sweeper();
+    ASSERT_EQ(count, internal->expiry_used) << "Background cache sweeper evicted an object from an internal store.";
+
+    res = sweep_cache(0);
+    ASSERT_GE(res, 0) << "Cache sweep failed.";
+    ASSERT_EQ(count, internal->expiry_used) << "Explicit cache sweep evicted an object from an internal store.";
+    ASSERT_EQ(0, cached_object_found("check-sweep-internal", internal)) << "Expired internal object was still handed out.";
+
+    for (size_t i = 0; i < 10; i++) {
+        snprintf(oid, sizeof(oid), "check-sweep-%zu", i);
+        remove_cached_object(oid, store);
+    }
+
+    remove_cached_object("check-sweep-hot", store);
+    remove_cached_object("check-sweep-internal", internal);
+}
+
+TEST(DIME, check_cache_stats)
+{
+    cached_store_t *store = &(cached_stores[cached_data_signet]);
+    cached_store_stats_t before, after, total;
+    cached_object_t *obj;
+    char oid[64];
+    size_t objects;
+    int res;
+
+    res = get_cache_stats(cached_data_signet, NULL);
+    ASSERT_EQ(-1, res) << "Cache statistics accepted a null output structure.";
+
+    res = get_cache_stats(cached_data_signet, &before);
+    ASSERT_EQ(0, res) << "Could not get cached store statistics.";
+
+    for (size_t i = 0; i < 10; i++) {
+        snprintf(oid, sizeof(oid), "check-stats-%zu", i);
+        obj = add_cached_object(oid, store, (i < 4) ? 100 : 0, 0, NULL, 0, 0);
+        ASSERT_TRUE(obj != NULL) << "Could not add object to cached store: " << oid;
+        release_cached_object(store, obj);
+    }
+
+    for (size_t i = 0; i < 20; i++) {
+        snprintf(oid, sizeof(oid), "check-stats-%zu", i);
+        cached_object_found(oid, store);
+    }
+
+    res = get_cache_stats(cached_data_signet, &after);
+    ASSERT_EQ(0, res) << "Could not get cached store statistics.";
+    ASSERT_EQ(before.inserts + 10, after.inserts);
+    ASSERT_EQ(before.hits + 10, after.hits);
+    ASSERT_EQ(before.misses + 10, after.misses);
+    ASSERT_GT(after.bytes, before.bytes) << "Cached objects were not counted in the store's byte total.";
+
+    res = get_cached_object_count(cached_data_signet, NULL);
+    ASSERT_EQ(-1, res) << "Cached object count accepted a null output variable.";
+    res = get_cached_object_count(cached_data_signet, &objects);
+    ASSERT_EQ(0, res) << "Could not count the objects in the cached store.";
+    ASSERT_EQ(_cached_store_count(store), objects);
+    ASSERT_GE(objects, 10U) << "Cached object count missed the objects that were added.";
+
+    res = sweep_cache(time(NULL) + 101);
+    ASSERT_GE(res, 4) << "Cache sweep did not evict the objects whose TTL ran out.";
+
+    res = get_cache_stats(cached_data_signet, &after);
+    ASSERT_EQ(0, res) << "Could not get cached store statistics.";
+    ASSERT_LE(before.expired + 4, after.expired);
+
+    res = get_cache_stats(cached_data_unknown, &total);
+    ASSERT_EQ(0, res) << "Could not get statistics for the whole cache.";
+    ASSERT_LE(after.hits, total.hits);
+    ASSERT_LE(after.bytes, total.bytes);
+
+    for (size_t i = 4; i < 10; i++) {
+        snprintf(oid, sizeof(oid), "check-stats-%zu", i);
+        remove_cached_object(oid, store);
+    }
+
+    res = get_cache_stats(cached_data_signet, &after);
+    ASSERT_EQ(0, res) << "Could not get cached store statistics.";
+    ASSERT_LE(after.bytes, before.bytes) << "Removed objects were still counted in the store's byte total.";
+}
+
+TEST(DIME, check_cache_concurrent_lookups)
+{
+    cached_store_t *store = &(cached_stores[cached_data_ocsp]);
+    pthread_t threads[N_THREADED_TEST_THREADS];
+    lookup_thread_t args[N_THREADED_TEST_THREADS];
+
+    fill_cached_store(store, 0, N_THREADED_TEST_OBJECTS);
+
+    for (size_t i = 0; i < N_THREADED_TEST_THREADS; i++) {
+        args[i].store = store;
+        args[i].nobjects = N_THREADED_TEST_OBJECTS;
+        args[i].nlookups = 10000;
+        args[i].misses = 0;
+        ASSERT_EQ(0, pthread_create(&(threads[i]), NULL, lookup_cached_objects, &(args[i])));
+    }
+
+    // Objects added and removed outside the looked up range must not disturb the concurrent readers.
+    fill_cached_store(store, N_THREADED_TEST_OBJECTS, N_THREADED_TEST_OBJECTS * 2);
+    empty_cached_store(store, N_THREADED_TEST_OBJECTS, N_THREADED_TEST_OBJECTS * 2);
+
+    for (size_t i = 0; i < N_THREADED_TEST_THREADS; i++) {
+        ASSERT_EQ(0, pthread_join(threads[i], NULL));
+        ASSERT_EQ(0U, args[i].misses) << "Concurrent lookup failed to find a cached object.";
+    }
+
+    ASSERT_EQ((size_t)N_THREADED_TEST_OBJECTS, _cached_store_count(store));
+    empty_cached_store(store, 0, N_THREADED_TEST_OBJECTS);
+    ASSERT_EQ(0U, _cached_store_count(store));
+}
+
+TEST(DIME, check_cache_flights)
+{
+    cached_store_t *store = &(cached_stores[cached_data_ocsp]);
+    pthread_t threads[N_THREADED_TEST_THREADS];
+    flight_thread_t args[N_THREADED_TEST_THREADS];
+    cached_store_stats_t before, after;
+    cached_flight_t *flight, *other;
+    cached_object_t *obj;
+
+    ASSERT_EQ(0, get_cache_stats(cached_data_ocsp, &before));
+    ASSERT_EQ(1, _begin_cached_flight("check-flight", store, 0, &flight)) << "First miss of an object was not told to look it up.";
+    ASSERT_TRUE(flight != NULL);
+
+    // Another miss of the same object is told that it's already being looked up, but other objects and stores are unaffected.
+    ASSERT_EQ(0, _begin_cached_flight("check-flight", store, 0, &other)) << "Concurrent miss of an object was told to look it up again.";
+    ASSERT_TRUE(other == NULL);
+    ASSERT_EQ(1, _begin_cached_flight("check-flight-other", store, 0, &other));
+    _end_cached_flight(other);
+    ASSERT_EQ(1, _begin_cached_flight("check-flight", &(cached_stores[cached_data_ds]), 0, &other));
+    _end_cached_flight(other);
+
+    for (size_t i = 0; i < N_THREADED_TEST_THREADS; i++) {
+        memset(&(args[i]), 0, sizeof(flight_thread_t));
+        args[i].store = store;
+        ASSERT_EQ(0, pthread_create(&(threads[i]), NULL, wait_cached_flight, &(args[i])));
+    }
+
+    // The waiters stay blocked until the lookup has finished, and then all of them find the object it cached.
+    usleep(50000);
+
+    for (size_t i = 0; i < N_THREADED_TEST_THREADS; i++) {
+        ASSERT_EQ(0, __atomic_load_n(&(args[i].finished), __ATOMIC_ACQUIRE)) << "Concurrent miss did not wait for the lookup in progress.";
+    }
+
+    obj = add_cached_object("check-flight", store, 0, 0, NULL, 0, 0);
+    ASSERT_TRUE(obj != NULL) << "Could not add object to cached store.";
+    _end_cached_flight(flight);
+
+    for (size_t i = 0; i < N_THREADED_TEST_THREADS; i++) {
+        ASSERT_EQ(0, pthread_join(threads[i], NULL));
+        ASSERT_EQ(0, args[i].leader) << "Waiting miss was told to look up the object again.";
+        ASSERT_EQ(1, args[i].found) << "Waiting miss did not find the object that the lookup cached.";
+    }
+
+    ASSERT_EQ(0, get_cache_stats(cached_data_ocsp, &after));
+    ASSERT_EQ(before.coalesced + N_THREADED_TEST_THREADS + 1, after.coalesced) << "Coalesced misses were not counted.";
+
+    // Once the lookup has finished, the next miss looks the object up again.
+    ASSERT_EQ(1, _begin_cached_flight("check-flight", store, 1, &flight)) << "Finished lookup was still in flight.";
+    _end_cached_flight(flight);
+    remove_cached_object("check-flight", store);
+}
+
+// Run with --gtest_also_run_disabled_tests --gtest_filter=*bench_cache_lookup_threads to print lookup throughput by thread count.
+TEST(DIME, DISABLED_bench_cache_lookup_threads)
+{
+    cached_store_t *store = &(cached_stores[cached_data_ocsp]);
+    pthread_t threads[64];
+    lookup_thread_t args[64];
+    struct timespec start, end;
+    size_t nobjects = 100000, nlookups = 200000;
+    double elapsed;
+
+    fill_cached_store(store, 0, nobjects);
+
+    for (size_t nthreads = 1; nthreads <= 64; nthreads *= 2) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (size_t i = 0; i < nthreads; i++) {
+            args[i].store = store;
+            args[i].nobjects = nobjects;
+            args[i].nlookups = nlookups;
+            args[i].misses = 0;
+            ASSERT_EQ(0, pthread_create(&(threads[i]), NULL, lookup_cached_objects, &(args[i])));
+        }
+
+        for (size_t i = 0; i < nthreads; i++) {
+            ASSERT_EQ(0, pthread_join(threads[i], NULL));
+            ASSERT_EQ(0U, args[i].misses);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%2zu threads: %.0f lookups per second\n", nthreads, (nthreads * nlookups) / elapsed);
+    }
+
+    empty_cached_store(store, 0, nobjects);
+}
@@ -0,0 +1,1144 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+extern "C" {
+#include "dime/common/misc.h"
+#include "dime/signet/keys.h"
+#include "dime/signet-resolver/cache.h"
+#include "dime/signet-resolver/dmtp.h"
+}
+#include "gtest/gtest.h"
+
+#define POOL_TEST_DOMAIN "pool.example.test"
+#define POOL_TEST_DX "dx.pool.example.test"
+#define BATCH_TEST_DOMAIN "batch.example.test"
+#define BATCH_TEST_DX "dx.batch.example.test"
+#define N_PIPELINE_QUERIES 1000
+#define N_COALESCE_THREADS 16
+#define N_READER_TEST_LINES 20000
+#define DATA_TEST_SIZE (5 * 1024 * 1024 + 123)
+
+/*
+ * A stub DX server on the other end of a socket pair. It answers NOOP with 250 and QUIT with 221, and counts the
+ * commands it receives. SGNT returns a signet made up from the requested name, unless the name begins with "missing"
+ * or "garbled". If real signets are supplied, org names get the org signet, names beginning with "mallory" get the
+ * rogue signet, and every other user gets the user signet. VRFY reports the fingerprint "current" as current, and
+ * anything else as superseded by "newprint". A delay can be set to simulate the round trip time to the server.
+ */
+typedef struct {
+    int fd;
+    pthread_t thread;
+    unsigned int noops;
+    unsigned int quits;
+    unsigned int queries;
+    useconds_t delay;
+    const char *org_signet;
+    const char *user_signet;
+    const char *rogue_signet;
+} stub_dx_server_t;
+
+static void reply_stub_dx_query(stub_dx_server_t *server, const char *cmd) {
+
+    char *reply, name[128] = "", fp[128] = "";
+    const char *ptr, *signet = NULL;
+    size_t len, rlen;
+
+    if ((ptr = strchr(cmd, '<')) && (len = strcspn(ptr + 1, ">")) < sizeof(name)) {
+        memcpy(name, ptr + 1, len);
+        name[len] = 0;
+    }
+
+    if ((ptr = strchr(cmd, '[')) && (len = strcspn(ptr + 1, "]")) < sizeof(fp)) {
+        memcpy(fp, ptr + 1, len);
+        fp[len] = 0;
+    }
+
+    if (!strchr(name, '@')) {
+        signet = server->org_signet;
+    } else if (!strncmp(name, "mallory", 7)) {
+        signet = server->rogue_signet;
+    } else {
+        signet = server->user_signet;
+    }
+
+    rlen = (signet ? strlen(signet) : 0) + sizeof(name) + 32;
+    reply = (char *)malloc(rlen);
+
+    if (!strncmp(name, "missing", 7)) {
+        snprintf(reply, rlen, "550 SIGNET NOT FOUND\r\n");
+    } else if (!strncmp(name, "garbled", 7)) {
+        snprintf(reply, rlen, "250 WHAT\r\n");
+    } else if (!strncmp(cmd, "SGNT", 4) && signet) {
+        snprintf(reply, rlen, "250 OK [%s]\r\n", signet);
+    } else if (!strncmp(cmd, "SGNT", 4)) {
+        snprintf(reply, rlen, "250 OK [signet:%s]\r\n", name);
+    } else if (!strcmp(fp, "current")) {
+        snprintf(reply, rlen, "250 CURRENT\r\n");
+    } else {
+        snprintf(reply, rlen, "250 UPDATE newprint\r\n");
+    }
+
+    __atomic_add_fetch(&(server->queries), 1, __ATOMIC_RELAXED);
+    send(server->fd, reply, strlen(reply), MSG_NOSIGNAL);
+    free(reply);
+}
+
+static void *run_stub_dx_server(void *arg) {
+
+    stub_dx_server_t *server = (stub_dx_server_t *)arg;
+    char buf[256];
+    size_t pos = 0;
+    ssize_t nread;
+    char *lbreak;
+
+    while ((nread = recv(server->fd, &(buf[pos]), sizeof(buf) - pos - 1, 0)) > 0) {
+        pos += nread;
+        buf[pos] = 0;
+
+        if (server->delay) {
+            usleep(server->delay);
+        }
+
+        while ((lbreak = strstr(buf, "\r\n"))) {
+            *lbreak = 0;
+
+            if (!strcmp(buf, "NOOP")) {
+                __atomic_add_fetch(&(server->noops), 1, __ATOMIC_RELAXED);
+                send(server->fd, "250 OK\r\n", 8, MSG_NOSIGNAL);
+            } else if (!strcmp(buf, "QUIT")) {
+                __atomic_add_fetch(&(server->quits), 1, __ATOMIC_RELAXED);
+                send(server->fd, "221 BYE\r\n", 9, MSG_NOSIGNAL);
+            } else if (!strncmp(buf, "SGNT ", 5) || !strncmp(buf, "VRFY ", 5)) {
+                reply_stub_dx_query(server, buf);
+            }
+
+            pos -= (lbreak + 2) - buf;
+            memmove(buf, lbreak + 2, pos + 1);
+        }
+
+    }
+
+    close(server->fd);
+
+    return NULL;
+}
+
+// Create a verified, plain text DMTP session that is connected to one end of a socket pair.
+static dmtp_session_t *create_pool_test_session(const char *dx, int *peer) {
+
+    dmtp_session_t *result;
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        return NULL;
+    }
+
+    result = (dmtp_session_t *)calloc(1, sizeof(dmtp_session_t));
+    result->domain = strdup(POOL_TEST_DOMAIN);
+    result->dx = strdup(dx);
+    result->mode = dmtp_mode_dual;
+    result->active = 1;
+    result->_fd = fds[0];
+    result->_established = time(NULL);
+    *peer = fds[1];
+
+    return result;
+}
+
+TEST(DIME, check_dmtp_session_pool)
+{
+    dmtp_session_t *session, *taken;
+    int peer, peers[DMTP_POOL_MAX_PER_HOST + 1];
+    size_t count;
+
+    // A released session is handed back out to the same domain, but not to another address family.
+    session = create_pool_test_session(POOL_TEST_DX, &peer);
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+    _sgnt_resolv_dmtp_pool_release(session, 1);
+
+    ASSERT_TRUE(_sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, AF_INET) == NULL) << "Pooled session was handed out for the wrong address family.";
+    taken = _sgnt_resolv_dmtp_pool_take("POOL.example.TEST", 0);
+    ASSERT_EQ(session, taken) << "Released session was not reused.";
+    ASSERT_TRUE(_sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0) == NULL) << "Pooled session was handed out twice.";
+
+    // A session that was closed by the server is discarded.
+    _sgnt_resolv_dmtp_pool_release(session, 1);
+    close(peer);
+    ASSERT_TRUE(_sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0) == NULL) << "Pooled session was reused after the server closed it.";
+
+    // So is a session with unsolicited input waiting, or one that wasn't verified or isn't reusable.
+    session = create_pool_test_session(POOL_TEST_DX, &peer);
+    ASSERT_EQ(9, send(peer, "421 BYE\r\n", 9, 0));
+    _sgnt_resolv_dmtp_pool_release(session, 1);
+    ASSERT_TRUE(_sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0) == NULL) << "Session with pending input was pooled.";
+    close(peer);
+
+    session = create_pool_test_session(POOL_TEST_DX, &peer);
+    session->_established = 0;
+    _sgnt_resolv_dmtp_pool_release(session, 1);
+    ASSERT_TRUE(_sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0) == NULL) << "Unverified session was pooled.";
+    close(peer);
+
+    session = create_pool_test_session(POOL_TEST_DX, &peer);
+    _sgnt_resolv_dmtp_pool_release(session, 0);
+    ASSERT_TRUE(_sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0) == NULL) << "Non-reusable session was pooled.";
+    close(peer);
+
+    // No more than the per-host limit of sessions are kept for a DX server.
+    for (size_t i = 0; i <= DMTP_POOL_MAX_PER_HOST; i++) {
+        session = create_pool_test_session(POOL_TEST_DX, &(peers[i]));
+        ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+        _sgnt_resolv_dmtp_pool_release(session, 1);
+    }
+
+    for (count = 0; (taken = _sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0)); count++) {
+        _sgnt_resolv_destroy_dmtp_session(taken);
+    }
+
+    ASSERT_EQ((size_t)DMTP_POOL_MAX_PER_HOST, count) << "Session pool did not enforce its per-host limit.";
+
+    for (size_t i = 0; i <= DMTP_POOL_MAX_PER_HOST; i++) {
+        close(peers[i]);
+    }
+
+    // Flushing the pool closes every idle session.
+    session = create_pool_test_session(POOL_TEST_DX, &peer);
+    _sgnt_resolv_dmtp_pool_release(session, 1);
+    _sgnt_resolv_dmtp_pool_flush();
+    ASSERT_TRUE(_sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0) == NULL) << "Session pool was not flushed.";
+    close(peer);
+}
+
+TEST(DIME, check_dmtp_session_pool_keepalive)
+{
+    stub_dx_server_t server;
+    dmtp_session_t *session, *taken;
+    time_t now;
+
+    memset(&server, 0, sizeof(server));
+    session = create_pool_test_session(POOL_TEST_DX, &(server.fd));
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+    ASSERT_EQ(0, pthread_create(&(server.thread), NULL, run_stub_dx_server, &server));
+
+    _sgnt_resolv_dmtp_pool_release(session, 1);
+    now = time(NULL);
+
+    // Fresh sessions are left alone, and those that have been idle for a while are kept alive with a NOOP.
+    ASSERT_EQ(0U, _sgnt_resolv_dmtp_pool_maintain(now));
+    ASSERT_EQ(0U, __atomic_load_n(&(server.noops), __ATOMIC_RELAXED)) << "Fresh pooled session was probed.";
+
+    ASSERT_EQ(0U, _sgnt_resolv_dmtp_pool_maintain(now + DMTP_POOL_PROBE_INTERVAL));
+    ASSERT_EQ(1U, __atomic_load_n(&(server.noops), __ATOMIC_RELAXED)) << "Idle pooled session was not kept alive.";
+
+    // A session that passed its keep-alive can be reused without another round trip.
+    taken = _sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0);
+    ASSERT_EQ(session, taken) << "Pooled session was not reused after its keep-alive.";
+    ASSERT_EQ(1U, __atomic_load_n(&(server.noops), __ATOMIC_RELAXED)) << "Recently probed session was probed again.";
+
+    // But keep-alives don't stop a session from timing out once it's gone unused for too long.
+    _sgnt_resolv_dmtp_pool_release(session, 1);
+    ASSERT_EQ(1U, _sgnt_resolv_dmtp_pool_maintain(time(NULL) + DMTP_POOL_IDLE_TIMEOUT)) << "Idle pooled session was not evicted.";
+    ASSERT_TRUE(_sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0) == NULL) << "Evicted session was still pooled.";
+
+    pthread_join(server.thread, NULL);
+    ASSERT_EQ(1U, server.quits) << "Evicted session was not closed with a QUIT.";
+}
+
+TEST(DIME, check_dmtp_query_signets)
+{
+    stub_dx_server_t server;
+    dmtp_session_t *session;
+    dmtp_signet_query_t queries[8], *bulk;
+    char name[64];
+
+    memset(&server, 0, sizeof(server));
+    session = create_pool_test_session(POOL_TEST_DX, &(server.fd));
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+    ASSERT_EQ(0, pthread_create(&(server.thread), NULL, run_stub_dx_server, &server));
+
+    // Every query gets its own result, and neither a refused nor a malformed query disturbs the ones after it.
+    memset(queries, 0, sizeof(queries));
+    queries[0] = { dmtp_query_sgnt, "alice@" POOL_TEST_DOMAIN, NULL, 0, 0, NULL };
+    queries[1] = { dmtp_query_sgnt, "missing@" POOL_TEST_DOMAIN, NULL, 0, 0, NULL };
+    queries[2] = { dmtp_query_sgnt, "mallory@" POOL_TEST_DOMAIN ">\r\nQUIT", NULL, 0, 0, NULL };
+    queries[3] = { dmtp_query_vrfy, "bob@" POOL_TEST_DOMAIN, "current", 0, 0, NULL };
+    queries[4] = { dmtp_query_vrfy, "carol@" POOL_TEST_DOMAIN, "stale", 0, 0, NULL };
+    queries[5] = { dmtp_query_vrfy, "dave@" POOL_TEST_DOMAIN, NULL, 0, 0, NULL };
+    queries[6] = { dmtp_query_sgnt, "garbled@" POOL_TEST_DOMAIN, NULL, 0, 0, NULL };
+    queries[7] = { dmtp_query_sgnt, POOL_TEST_DOMAIN, "orgprint", 0, 0, NULL };
+
+    ASSERT_EQ(4, _sgnt_resolv_dmtp_query_signets(session, queries, 8)) << "Pipelined signet queries returned the wrong number of successes.";
+
+    ASSERT_EQ(1, queries[0].status);
+    ASSERT_STREQ("signet:alice@" POOL_TEST_DOMAIN, queries[0].result);
+    ASSERT_EQ(-1, queries[1].status) << "Refused signet query was reported as successful.";
+    ASSERT_EQ(550, queries[1].rcode);
+    ASSERT_EQ(-1, queries[2].status) << "Signet query with an injected command was not rejected.";
+    ASSERT_EQ(0, queries[2].rcode) << "Signet query with an injected command was sent to the server.";
+    ASSERT_EQ(1, queries[3].status) << "Current signet fingerprint was not reported as current.";
+    ASSERT_EQ(0, queries[4].status) << "Out of date signet fingerprint was not reported as out of date.";
+    ASSERT_STREQ("newprint", queries[4].result);
+    ASSERT_EQ(-1, queries[5].status) << "Signet verification query without a fingerprint was not rejected.";
+    ASSERT_EQ(-1, queries[6].status) << "Malformed reply to signet query was accepted.";
+    ASSERT_EQ(250, queries[6].rcode);
+    ASSERT_EQ(1, queries[7].status);
+    ASSERT_STREQ("signet:" POOL_TEST_DOMAIN, queries[7].result);
+    ASSERT_EQ(0U, server.quits) << "Injected command reached the server.";
+
+    for (size_t i = 0; i < 8; i++) {
+        free(queries[i].result);
+    }
+
+    // A batch much larger than the pipeline window is answered in full, and in order.
+    bulk = (dmtp_signet_query_t *)calloc(N_PIPELINE_QUERIES, sizeof(dmtp_signet_query_t));
+
+    for (size_t i = 0; i < N_PIPELINE_QUERIES; i++) {
+        snprintf(name, sizeof(name), "user%zu@" POOL_TEST_DOMAIN, i);
+        bulk[i].type = dmtp_query_sgnt;
+        bulk[i].signame = strdup(name);
+    }
+
+    ASSERT_EQ(N_PIPELINE_QUERIES, _sgnt_resolv_dmtp_query_signets(session, bulk, N_PIPELINE_QUERIES));
+
+    for (size_t i = 0; i < N_PIPELINE_QUERIES; i++) {
+        snprintf(name, sizeof(name), "signet:user%zu@" POOL_TEST_DOMAIN, i);
+        ASSERT_STREQ(name, bulk[i].result) << "Pipelined signet reply was matched to the wrong query.";
+        free((char *)bulk[i].signame);
+        free(bulk[i].result);
+    }
+
+    free(bulk);
+
+    _sgnt_resolv_destroy_dmtp_session(session);
+    pthread_join(server.thread, NULL);
+}
+
+TEST(DIME, DISABLED_bench_dmtp_query_signets)
+{
+    stub_dx_server_t server;
+    dmtp_session_t *session;
+    dmtp_signet_query_t *bulk;
+    struct timespec start, end;
+    char name[64], *signet;
+    double elapsed;
+
+    memset(&server, 0, sizeof(server));
+    server.delay = 500;
+    session = create_pool_test_session(POOL_TEST_DX, &(server.fd));
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+    ASSERT_EQ(0, pthread_create(&(server.thread), NULL, run_stub_dx_server, &server));
+
+    bulk = (dmtp_signet_query_t *)calloc(N_PIPELINE_QUERIES, sizeof(dmtp_signet_query_t));
+
+    for (size_t i = 0; i < N_PIPELINE_QUERIES; i++) {
+        snprintf(name, sizeof(name), "user%zu@" POOL_TEST_DOMAIN, i);
+        bulk[i].type = dmtp_query_sgnt;
+        bulk[i].signame = strdup(name);
+    }
+
+    // The stub server waits before answering whatever it has read, so every round trip costs the simulated latency.
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; i < N_PIPELINE_QUERIES; i++) {
+        ASSERT_TRUE((signet = _sgnt_resolv_dmtp_get_signet(session, bulk[i].signame, NULL)) != NULL);
+        free(signet);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1000000000.0);
+    printf("%d signets one at a time with %u us round trips: %.3f s\n", N_PIPELINE_QUERIES, server.delay, elapsed);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_EQ(N_PIPELINE_QUERIES, _sgnt_resolv_dmtp_query_signets(session, bulk, N_PIPELINE_QUERIES));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1000000000.0);
+    printf("%d signets pipelined with %u us round trips: %.3f s\n", N_PIPELINE_QUERIES, server.delay, elapsed);
+
+    for (size_t i = 0; i < N_PIPELINE_QUERIES; i++) {
+        free((char *)bulk[i].signame);
+        free(bulk[i].result);
+    }
+
+    free(bulk);
+
+    _sgnt_resolv_destroy_dmtp_session(session);
+    pthread_join(server.thread, NULL);
+}
+
+// Create a fully signed org signet, and a user signet signed by it, and return them base64 encoded.
+static int create_batch_test_signets(const char *keysfile, const char *userkeysfile, char **org_b64, char **user_b64, unsigned char ***pok) {
+
+    ED25519_KEY *orgkey, *userkey, **signkeys;
+    signet_t *org_signet, *user_signet;
+    size_t nkeys = 0;
+
+    if (!(org_signet = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_ORG, keysfile)) || !(orgkey = dime_keys_signkey_fetch(keysfile))) {
+        return -1;
+    }
+
+    dime_sgnt_sig_crypto_sign(org_signet, orgkey);
+    dime_sgnt_sig_full_sign(org_signet, orgkey);
+
+    if (!(user_signet = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_SSR, userkeysfile)) || !(userkey = dime_keys_signkey_fetch(userkeysfile))) {
+        return -1;
+    }
+
+    dime_sgnt_sig_ssr_sign(user_signet, userkey);
+    dime_sgnt_sig_crypto_sign(user_signet, orgkey);
+    dime_sgnt_sig_full_sign(user_signet, orgkey);
+
+    // The org signet's signing keys stand in for the POKs that would be published in the DIME management record.
+    signkeys = dime_sgnt_signkeys_signet_fetch(org_signet);
+
+    while (signkeys[nkeys]) {
+        nkeys++;
+    }
+
+    *pok = (unsigned char **)calloc(nkeys + 1, sizeof(unsigned char *));
+
+    for (size_t i = 0; i < nkeys; i++) {
+        (*pok)[i] = (unsigned char *)malloc(ED25519_KEY_SIZE);
+        memcpy((*pok)[i], signkeys[i]->public_key, ED25519_KEY_SIZE);
+    }
+
+    *org_b64 = dime_sgnt_signet_b64_serialize(org_signet);
+    *user_b64 = dime_sgnt_signet_b64_serialize(user_signet);
+
+    _free_ed25519_key_chain(signkeys);
+    _free_ed25519_key(orgkey);
+    _free_ed25519_key(userkey);
+    dime_sgnt_signet_destroy(org_signet);
+    dime_sgnt_signet_destroy(user_signet);
+
+    return (*org_b64 && *user_b64) ? 0 : -1;
+}
+
+TEST(DIME, check_get_signets)
+{
+    const char *names[] = { POOL_TEST_DOMAIN, "alice@" POOL_TEST_DOMAIN, "bob@" BATCH_TEST_DOMAIN, "missing@" POOL_TEST_DOMAIN,
+                            "mallory@" BATCH_TEST_DOMAIN, "bad@address@" POOL_TEST_DOMAIN, NULL, "carol@" POOL_TEST_DOMAIN };
+    const size_t nnames = sizeof(names) / sizeof(names[0]);
+    stub_dx_server_t servers[2];
+    dmtp_session_t *sessions[2];
+    signet_lookup_t results[nnames];
+    unsigned char **pok, **rogue_pok;
+    char *org_b64, *user_b64, *rogue_org_b64, *rogue_b64;
+
+    _crypto_init();
+    ASSERT_EQ(0, create_batch_test_signets(".out/check_batch_org.keys", ".out/check_batch_user.keys", &org_b64, &user_b64, &pok));
+    ASSERT_EQ(0, create_batch_test_signets(".out/check_batch_rogue_org.keys", ".out/check_batch_rogue.keys", &rogue_org_b64, &rogue_b64, &rogue_pok));
+
+    // Each dark domain is served by a pooled session to its own stub DX server, and both domains are trusted with the same POK.
+    memset(servers, 0, sizeof(servers));
+
+    for (size_t i = 0; i < 2; i++) {
+        sessions[i] = create_pool_test_session(i ? BATCH_TEST_DX : POOL_TEST_DX, &(servers[i].fd));
+        ASSERT_TRUE(sessions[i] != NULL) << "Failed to create test DMTP session.";
+
+        if (i) {
+            free(sessions[i]->domain);
+            sessions[i]->domain = strdup(BATCH_TEST_DOMAIN);
+        }
+
+        sessions[i]->drec = (dime_record_t *)calloc(1, sizeof(dime_record_t));
+        sessions[i]->drec->pubkey = (unsigned char **)calloc(2, sizeof(unsigned char *));
+        sessions[i]->drec->pubkey[0] = (unsigned char *)malloc(ED25519_KEY_SIZE);
+        memcpy(sessions[i]->drec->pubkey[0], pok[0], ED25519_KEY_SIZE);
+
+        servers[i].org_signet = org_b64;
+        servers[i].user_signet = user_b64;
+        servers[i].rogue_signet = rogue_b64;
+        ASSERT_EQ(0, pthread_create(&(servers[i].thread), NULL, run_stub_dx_server, &(servers[i])));
+        _sgnt_resolv_dmtp_pool_release(sessions[i], 1);
+    }
+
+    // Every name gets its own result or error, and one bad name doesn't fail any of the others.
+    ASSERT_EQ(4U, _get_signets(names, NULL, nnames, 0, results)) << "Batch signet lookup resolved the wrong number of signets.";
+
+    ASSERT_TRUE(results[0].signet != NULL) << "Org signet was not resolved: " << results[0].error.auxmsg;
+    ASSERT_TRUE(results[1].signet != NULL) << "User signet was not resolved: " << results[1].error.auxmsg;
+    ASSERT_TRUE(results[2].signet != NULL) << "User signet in second domain was not resolved: " << results[2].error.auxmsg;
+    ASSERT_TRUE(results[7].signet != NULL) << "User signet was not resolved: " << results[7].error.auxmsg;
+    ASSERT_EQ(0U, results[0].error.errcode);
+
+    ASSERT_TRUE(results[3].signet == NULL) << "Missing signet was reported as resolved.";
+    ASSERT_NE(0U, results[3].error.errcode) << "Missing signet was not given an error.";
+    ASSERT_TRUE(results[4].signet == NULL) << "Signet that was not signed by its org was accepted.";
+    ASSERT_NE(0U, results[4].error.errcode);
+    ASSERT_EQ((unsigned int)ERR_BAD_PARAM, results[5].error.errcode) << "Malformed signet name was not rejected.";
+    ASSERT_EQ((unsigned int)ERR_BAD_PARAM, results[6].error.errcode) << "NULL signet name was not rejected.";
+
+    // The org signet of each domain is fetched only once, no matter how many of its users are looked up.
+    ASSERT_EQ(4U, servers[0].queries) << "Org signet was not shared by the users of its domain.";
+    ASSERT_EQ(3U, servers[1].queries) << "Org signet was not shared by the users of its domain.";
+
+    // And the sessions go back into the pool to be used again.
+    for (size_t i = 0; i < 2; i++) {
+        ASSERT_EQ(sessions[i], _sgnt_resolv_dmtp_pool_take(i ? BATCH_TEST_DOMAIN : POOL_TEST_DOMAIN, 0)) << "Batch lookup did not return its session to the pool.";
+        _sgnt_resolv_destroy_dmtp_session(sessions[i]);
+        pthread_join(servers[i].thread, NULL);
+    }
+
+    for (size_t i = 0; i < nnames; i++) {
+
+        if (results[i].signet) {
+            dime_sgnt_signet_destroy(results[i].signet);
+        }
+
+    }
+
+    _ptr_chain_free(pok);
+    _ptr_chain_free(rogue_pok);
+    free(org_b64);
+    free(user_b64);
+    free(rogue_org_b64);
+    free(rogue_b64);
+}
+
+typedef struct {
+    pthread_barrier_t *barrier;
+    const char *name;
+    signet_t *signet;
+} signet_thread_t;
+
+static void *get_signet_thread(void *arg) {
+
+    signet_thread_t *st = (signet_thread_t *)arg;
+
+    pthread_barrier_wait(st->barrier);
+
+    if (!(st->signet = _get_signet(st->name, NULL, 1))) {
+        dump_error_stack();
+    }
+
+    _clear_error_stack();
+
+    return NULL;
+}
+
+// Look up the same signet from many threads at once through the cache, and return how many of them got it.
+static size_t get_signet_concurrently(const char *name, size_t nthreads) {
+
+    pthread_barrier_t barrier;
+    pthread_t *threads;
+    signet_thread_t *args;
+    size_t result = 0;
+
+    threads = (pthread_t *)calloc(nthreads, sizeof(pthread_t));
+    args = (signet_thread_t *)calloc(nthreads, sizeof(signet_thread_t));
+    pthread_barrier_init(&barrier, NULL, nthreads);
+
+    for (size_t i = 0; i < nthreads; i++) {
+        args[i].barrier = &barrier;
+        args[i].name = name;
+        pthread_create(&(threads[i]), NULL, get_signet_thread, &(args[i]));
+    }
+
+    for (size_t i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+
+        if (args[i].signet) {
+            dime_sgnt_signet_destroy(args[i].signet);
+            result++;
+        }
+
+    }
+
+    pthread_barrier_destroy(&barrier);
+    free(threads);
+    free(args);
+
+    return result;
+}
+
+// Pool a single session to a stub DX server that serves real signets, so that any lookup which isn't coalesced has nowhere to go.
+static dmtp_session_t *pool_signet_test_session(stub_dx_server_t *server, char **org_b64, char **user_b64, unsigned char ***pok) {
+
+    dmtp_session_t *result;
+
+    if (create_batch_test_signets(".out/check_coalesce_org.keys", ".out/check_coalesce_user.keys", org_b64, user_b64, pok) < 0) {
+        return NULL;
+    }
+
+    memset(server, 0, sizeof(stub_dx_server_t));
+
+    if (!(result = create_pool_test_session(POOL_TEST_DX, &(server->fd)))) {
+        return NULL;
+    }
+
+    result->drec = (dime_record_t *)calloc(1, sizeof(dime_record_t));
+    result->drec->pubkey = (unsigned char **)calloc(2, sizeof(unsigned char *));
+    result->drec->pubkey[0] = (unsigned char *)malloc(ED25519_KEY_SIZE);
+    memcpy(result->drec->pubkey[0], (*pok)[0], ED25519_KEY_SIZE);
+
+    server->org_signet = *org_b64;
+    server->user_signet = *user_b64;
+
+    if (pthread_create(&(server->thread), NULL, run_stub_dx_server, server)) {
+        _sgnt_resolv_destroy_dmtp_session(result);
+        return NULL;
+    }
+
+    _sgnt_resolv_dmtp_pool_release(result, 1);
+
+    return result;
+}
+
+TEST(DIME, check_get_signet_coalescing)
+{
+    cached_store_t *store = &(cached_stores[cached_data_signet]);
+    cached_store_stats_t before, after;
+    stub_dx_server_t server;
+    dmtp_session_t *session;
+    unsigned char **pok;
+    char *org_b64, *user_b64;
+
+    _crypto_init();
+    remove_cached_object(POOL_TEST_DOMAIN, store);
+    remove_cached_object("alice@" POOL_TEST_DOMAIN, store);
+    _clear_error_stack();
+
+    session = pool_signet_test_session(&server, &org_b64, &user_b64, &pok);
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+    ASSERT_EQ(0, get_cache_stats(cached_data_signet, &before));
+
+    // Every thread misses the cache at once, but only the first one fetches the user signet and the org signet behind it.
+    server.delay = 20000;
+    ASSERT_EQ((size_t)N_COALESCE_THREADS, get_signet_concurrently("alice@" POOL_TEST_DOMAIN, N_COALESCE_THREADS)) << "Concurrent signet lookup failed.";
+    ASSERT_EQ(2U, server.queries) << "Concurrent misses of the same signet were not coalesced.";
+
+    ASSERT_EQ(0, get_cache_stats(cached_data_signet, &after));
+    ASSERT_LT(before.coalesced, after.coalesced) << "Coalesced signet lookups were not counted.";
+
+    // Once the signet is cached, further lookups don't go to the server at all.
+    ASSERT_EQ((size_t)N_COALESCE_THREADS, get_signet_concurrently("alice@" POOL_TEST_DOMAIN, N_COALESCE_THREADS));
+    ASSERT_EQ(2U, server.queries) << "Cached signet was fetched again.";
+
+    ASSERT_EQ(session, _sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0)) << "Signet lookup did not return its session to the pool.";
+    _sgnt_resolv_destroy_dmtp_session(session);
+    pthread_join(server.thread, NULL);
+
+    remove_cached_object(POOL_TEST_DOMAIN, store);
+    remove_cached_object("alice@" POOL_TEST_DOMAIN, store);
+    _ptr_chain_free(pok);
+    free(org_b64);
+    free(user_b64);
+}
+
+// Run with --gtest_also_run_disabled_tests --gtest_filter=*bench_get_signet_coalescing to print origin requests by thread count.
+TEST(DIME, DISABLED_bench_get_signet_coalescing)
+{
+    cached_store_t *store = &(cached_stores[cached_data_signet]);
+    size_t nthreads[] = { 1, 2, 4, 8, 16, 32, 64 };
+    struct timespec start, end;
+    stub_dx_server_t server;
+    dmtp_session_t *session;
+    unsigned char **pok;
+    char *org_b64, *user_b64;
+    unsigned int queries;
+    size_t resolved;
+    double elapsed;
+
+    _crypto_init();
+    session = pool_signet_test_session(&server, &org_b64, &user_b64, &pok);
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+    server.delay = 500;
+
+    // Each round starts from a flushed cache, as if the signets had just expired.
+    for (size_t i = 0; i < (sizeof(nthreads) / sizeof(nthreads[0])); i++) {
+        remove_cached_object(POOL_TEST_DOMAIN, store);
+        remove_cached_object("alice@" POOL_TEST_DOMAIN, store);
+        _clear_error_stack();
+        queries = server.queries;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        resolved = get_signet_concurrently("alice@" POOL_TEST_DOMAIN, nthreads[i]);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1000000000.0);
+
+        printf("%zu concurrent misses: %zu resolved with %u origin requests in %.3f ms\n", nthreads[i], resolved, server.queries - queries, elapsed * 1000);
+    }
+
+    ASSERT_EQ(session, _sgnt_resolv_dmtp_pool_take(POOL_TEST_DOMAIN, 0));
+    _sgnt_resolv_destroy_dmtp_session(session);
+    pthread_join(server.thread, NULL);
+
+    remove_cached_object(POOL_TEST_DOMAIN, store);
+    remove_cached_object("alice@" POOL_TEST_DOMAIN, store);
+    _ptr_chain_free(pok);
+    free(org_b64);
+    free(user_b64);
+}
+
+/*
+ * A stub DX server that writes a canned response to the client in chunks of a fixed size, regardless of where its
+ * lines end, and then hangs up.
+ */
+typedef struct {
+    int fd;
+    pthread_t thread;
+    const char *data;
+    size_t len;
+    size_t chunk;
+} stub_dx_writer_t;
+
+static void *run_stub_dx_writer(void *arg) {
+
+    stub_dx_writer_t *writer = (stub_dx_writer_t *)arg;
+    size_t off = 0, nbytes;
+    ssize_t nwritten;
+
+    while (off < writer->len) {
+        nbytes = (writer->len - off) < writer->chunk ? (writer->len - off) : writer->chunk;
+
+        if ((nwritten = send(writer->fd, writer->data + off, nbytes, MSG_NOSIGNAL)) <= 0) {
+            break;
+        }
+
+        off += nwritten;
+    }
+
+    close(writer->fd);
+
+    return NULL;
+}
+
+static dmtp_session_t *create_reader_test_session(stub_dx_writer_t *writer, const char *data, size_t len, size_t chunk) {
+
+    dmtp_session_t *result;
+
+    if (!(result = create_pool_test_session(POOL_TEST_DX, &(writer->fd)))) {
+        return NULL;
+    }
+
+    writer->data = data;
+    writer->len = len;
+    writer->chunk = chunk;
+
+    if (pthread_create(&(writer->thread), NULL, run_stub_dx_writer, writer)) {
+        _sgnt_resolv_destroy_dmtp_session(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+TEST(DIME, check_dmtp_read_lines)
+{
+    const char *trickle = "220 hello\r\n250-first\r\n250-second\r\n250 last\r\n550 split \rline\r\npartial";
+    stub_dx_writer_t writer;
+    dmtp_session_t *session;
+    std::string data, expected;
+    unsigned short rcode;
+    char *line;
+    int overflow;
+
+    // Lines that arrive a byte at a time are put back together, with a lone CR left in place.
+    session = create_reader_test_session(&writer, trickle, strlen(trickle), 1);
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+
+    line = _sgnt_resolv_read_dmtp_line(session, NULL, &rcode, NULL);
+    ASSERT_STREQ("hello", line);
+    ASSERT_EQ(220, rcode);
+    free(line);
+
+    line = _sgnt_resolv_read_dmtp_multiline(session, NULL, &rcode);
+    ASSERT_STREQ("first\nsecond\nlast", line);
+    ASSERT_EQ(250, rcode);
+    free(line);
+
+    line = _sgnt_resolv_read_dmtp_line(session, &overflow, NULL, NULL);
+    ASSERT_STREQ("550 split \rline", line);
+    free(line);
+
+    // Whatever is left when the server hangs up is returned as is, and after that there's nothing more to read.
+    line = _sgnt_resolv_read_dmtp_line(session, &overflow, NULL, NULL);
+    ASSERT_STREQ("partial", line);
+    ASSERT_EQ(0, overflow);
+    free(line);
+
+    ASSERT_TRUE(_sgnt_resolv_read_dmtp_line(session, NULL, NULL, NULL) == NULL) << "Read a line from a closed DMTP session.";
+    _clear_error_stack();
+    pthread_join(writer.thread, NULL);
+    _sgnt_resolv_destroy_dmtp_session(session);
+
+    // Lines of every length wrap around the input buffer, and lines far longer than its initial size make it grow.
+    for (size_t i = 0; i < 500; i++) {
+        data += "250 " + std::string((i * 37) % 5000, 'a' + (i % 26)) + "\r\n";
+    }
+
+    data += "250 OK [" + std::string(1024 * 1024, 'S') + "]\r\n";
+
+    for (size_t i = 0; i < N_READER_TEST_LINES; i++) {
+        data += "250-line " + std::to_string(i) + "\r\n";
+        expected += "line " + std::to_string(i) + "\n";
+    }
+
+    data += "250 end\r\n";
+    expected += "end";
+
+    session = create_reader_test_session(&writer, data.c_str(), data.size(), 7777);
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+
+    for (size_t i = 0; i < 500; i++) {
+        line = _sgnt_resolv_read_dmtp_line(session, &overflow, &rcode, NULL);
+        ASSERT_TRUE(line != NULL);
+        ASSERT_EQ(250, rcode);
+        ASSERT_EQ(0, overflow);
+        ASSERT_EQ(std::string((i * 37) % 5000, 'a' + (i % 26)), line) << "Line " << i << " was garbled.";
+        free(line);
+    }
+
+    line = _sgnt_resolv_read_dmtp_line(session, &overflow, &rcode, NULL);
+    ASSERT_TRUE(line != NULL);
+    ASSERT_EQ(0, overflow) << "Long DMTP line overflowed the input buffer.";
+    ASSERT_EQ((size_t)(1024 * 1024) + 5, strlen(line));
+    free(line);
+
+    line = _sgnt_resolv_read_dmtp_multiline(session, &overflow, &rcode);
+    ASSERT_TRUE(line != NULL);
+    ASSERT_EQ(250, rcode);
+    ASSERT_EQ(expected, line) << "Multiline DMTP response was garbled.";
+    free(line);
+
+    pthread_join(writer.thread, NULL);
+    _sgnt_resolv_destroy_dmtp_session(session);
+}
+
+// Run with --gtest_also_run_disabled_tests --gtest_filter=*bench_dmtp_read_lines to print response parsing throughput by size.
+TEST(DIME, DISABLED_bench_dmtp_read_lines)
+{
+    struct timespec start, end;
+    stub_dx_writer_t writer;
+    dmtp_session_t *session;
+    std::string data;
+    unsigned short rcode;
+    double elapsed;
+    char *line;
+
+    // Parsing time should grow in step with the size of the response, whether it's one long line or many short ones.
+    for (size_t mb = 1; mb <= 16; mb *= 2) {
+
+        for (int longline = 0; longline < 2; longline++) {
+
+            if (longline) {
+                data = "250 OK [" + std::string((mb * 1024 * 1024) - 1024, 'S') + "]\r\n";
+            } else {
+                data.clear();
+
+                while (data.size() < (mb * 1024 * 1024)) {
+                    data += "250-" + std::string(58, 'h') + "\r\n";
+                }
+
+                data += "250 end\r\n";
+            }
+
+            session = create_reader_test_session(&writer, data.c_str(), data.size(), 65536);
+            ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            line = longline ? _sgnt_resolv_read_dmtp_line(session, NULL, &rcode, NULL) : _sgnt_resolv_read_dmtp_multiline(session, NULL, &rcode);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            ASSERT_TRUE(line != NULL);
+            free(line);
+
+            elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1000000000.0);
+            printf("%2zu MB %s: %.3f ms (%.1f MB/s)\n", mb, longline ? "single line      " : "multiline response", elapsed * 1000, data.size() / (elapsed * 1024 * 1024));
+
+            pthread_join(writer.thread, NULL);
+            _sgnt_resolv_destroy_dmtp_session(session);
+        }
+
+    }
+
+}
+
+/*
+ * A stub DX server that accepts a single DATA command. It hashes the message it receives instead of keeping it, so that
+ * messages of any size can be sent, and it expects the message to be followed by a CR/LF pair.
+ */
+typedef struct {
+    int fd;
+    pthread_t thread;
+    size_t expected;
+    size_t received;
+    uint64_t hash;
+    int terminated;
+} stub_dx_receiver_t;
+
+static uint64_t hash_data_test_bytes(uint64_t hash, const unsigned char *buf, size_t len) {
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ buf[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static void *run_stub_dx_receiver(void *arg) {
+
+    stub_dx_receiver_t *receiver = (stub_dx_receiver_t *)arg;
+    unsigned char buf[65536], tail[2];
+    size_t pos = 0, nbytes;
+    ssize_t nread;
+
+    // Read the DATA command a byte at a time, so none of the message that follows it is consumed along with it.
+    while ((pos < sizeof(buf) - 1) && ((nread = recv(receiver->fd, &(buf[pos]), 1, 0)) > 0) && (buf[pos++] != '\n'));
+
+    if ((pos < 6) || strncmp((char *)buf, "DATA [", 6)) {
+        close(receiver->fd);
+        return NULL;
+    }
+
+    send(receiver->fd, "354 CONTINUE [commit]\r\n", 23, MSG_NOSIGNAL);
+
+    while (receiver->received < receiver->expected + 2) {
+        nbytes = (receiver->expected + 2) - receiver->received;
+
+        if ((nread = recv(receiver->fd, buf, nbytes < sizeof(buf) ? nbytes : sizeof(buf), 0)) <= 0) {
+            break;
+        }
+
+        for (ssize_t i = 0; i < nread; i++, receiver->received++) {
+
+            if (receiver->received < receiver->expected) {
+                receiver->hash = hash_data_test_bytes(receiver->hash, &(buf[i]), 1);
+            } else {
+                tail[receiver->received - receiver->expected] = buf[i];
+            }
+
+        }
+
+    }
+
+    if (receiver->received == receiver->expected + 2) {
+        receiver->received = receiver->expected;
+        receiver->terminated = !memcmp(tail, "\r\n", 2);
+        send(receiver->fd, "250 OK [txid-42]\r\n", 18, MSG_NOSIGNAL);
+    }
+
+    close(receiver->fd);
+
+    return NULL;
+}
+
+static dmtp_session_t *create_data_test_session(stub_dx_receiver_t *receiver, size_t expected) {
+
+    dmtp_session_t *result;
+
+    if (!(result = create_pool_test_session(POOL_TEST_DX, &(receiver->fd)))) {
+        return NULL;
+    }
+
+    receiver->expected = expected;
+    receiver->received = 0;
+    receiver->hash = 14695981039346656037ULL;
+    receiver->terminated = 0;
+
+    if (pthread_create(&(receiver->thread), NULL, run_stub_dx_receiver, receiver)) {
+        _sgnt_resolv_destroy_dmtp_session(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+// Produces a predictable message of a given length, in pieces of whatever size the caller asks for.
+typedef struct {
+    size_t offset;
+    size_t len;
+    size_t calls;
+} data_test_producer_t;
+
+static unsigned char data_test_byte(size_t offset) {
+    return (unsigned char)((offset * 31) + (offset >> 13));
+}
+
+static ssize_t produce_data_test_message(void *state, void *buf, size_t buflen) {
+
+    data_test_producer_t *producer = (data_test_producer_t *)state;
+    size_t nbytes;
+
+    nbytes = (producer->len - producer->offset) < buflen ? (producer->len - producer->offset) : buflen;
+
+    for (size_t i = 0; i < nbytes; i++) {
+        ((unsigned char *)buf)[i] = data_test_byte(producer->offset + i);
+    }
+
+    producer->offset += nbytes;
+    producer->calls++;
+
+    return nbytes;
+}
+
+static ssize_t fail_data_test_message(void *state, void *buf, size_t buflen) {
+
+    data_test_producer_t *producer = (data_test_producer_t *)state;
+
+    if (producer->offset >= producer->len / 2) {
+        return -1;
+    }
+
+    return produce_data_test_message(state, buf, buflen);
+}
+
+TEST(DIME, check_dmtp_data_stream)
+{
+    unsigned char *message;
+    stub_dx_receiver_t receiver;
+    data_test_producer_t producer;
+    dmtp_session_t *session;
+    struct iovec iov[6];
+    size_t lengths[6] = { 5, 0, 1024 * 1024, 1, 16383, 7 }, total = 0;
+    uint64_t hash;
+    char *txid;
+
+    // A message gathered from buffers of every size, including an empty one, arrives in one piece and in order.
+    for (size_t i = 0; i < 6; i++) {
+        total += lengths[i];
+    }
+
+    message = (unsigned char *)malloc(total);
+
+    for (size_t i = 0; i < total; i++) {
+        message[i] = data_test_byte(i);
+    }
+
+    for (size_t i = 0, at = 0; i < 6; at += lengths[i], i++) {
+        iov[i].iov_base = message + at;
+        iov[i].iov_len = lengths[i];
+    }
+
+    hash = hash_data_test_bytes(14695981039346656037ULL, message, total);
+
+    session = create_data_test_session(&receiver, total);
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+
+    txid = _sgnt_resolv_dmtp_datav(session, iov, 6);
+    ASSERT_TRUE(txid != NULL) << "DATA command with gathered buffers failed.";
+    ASSERT_STREQ("txid-42", txid);
+    free(txid);
+
+    pthread_join(receiver.thread, NULL);
+    ASSERT_EQ(total, receiver.received);
+    ASSERT_EQ(hash, receiver.hash) << "Message gathered from buffers was garbled.";
+    ASSERT_EQ(1, receiver.terminated) << "Message gathered from buffers was not followed by CR/LF.";
+    _sgnt_resolv_destroy_dmtp_session(session);
+
+    // A contiguous message is sent the same way.
+    session = create_data_test_session(&receiver, total);
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+
+    txid = _sgnt_resolv_dmtp_data(session, message, total);
+    ASSERT_TRUE(txid != NULL) << "DATA command with contiguous buffer failed.";
+    ASSERT_STREQ("txid-42", txid);
+    free(txid);
+
+    pthread_join(receiver.thread, NULL);
+    ASSERT_EQ(hash, receiver.hash) << "Contiguous message was garbled.";
+    ASSERT_EQ(1, receiver.terminated);
+    _sgnt_resolv_destroy_dmtp_session(session);
+    free(message);
+
+    // A message of several megabytes is streamed from the producer a chunk at a time.
+    memset(&producer, 0, sizeof(producer));
+    producer.len = DATA_TEST_SIZE;
+    hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < DATA_TEST_SIZE; i++) {
+        unsigned char byte = data_test_byte(i);
+        hash = hash_data_test_bytes(hash, &byte, 1);
+    }
+
+    session = create_data_test_session(&receiver, DATA_TEST_SIZE);
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+
+    txid = _sgnt_resolv_dmtp_data_stream(session, produce_data_test_message, &producer);
+    ASSERT_TRUE(txid != NULL) << "Streamed DATA command failed.";
+    ASSERT_STREQ("txid-42", txid);
+    free(txid);
+
+    pthread_join(receiver.thread, NULL);
+    ASSERT_EQ((size_t)DATA_TEST_SIZE, receiver.received);
+    ASSERT_EQ(hash, receiver.hash) << "Streamed message was garbled.";
+    ASSERT_EQ(1, receiver.terminated);
+    ASSERT_EQ((size_t)(DATA_TEST_SIZE / DMTP_DATA_CHUNK_SIZE) + 2, producer.calls) << "Message was not produced in full chunks.";
+    _sgnt_resolv_destroy_dmtp_session(session);
+
+    // If the producer fails partway through, so does the command, and the session is left unusable.
+    memset(&producer, 0, sizeof(producer));
+    producer.len = DATA_TEST_SIZE;
+
+    session = create_data_test_session(&receiver, DATA_TEST_SIZE);
+    ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+
+    ASSERT_TRUE(_sgnt_resolv_dmtp_data_stream(session, fail_data_test_message, &producer) == NULL) << "Streamed DATA command succeeded despite a failed producer.";
+    _clear_error_stack();
+    ASSERT_EQ(0U, session->active);
+
+    _sgnt_resolv_destroy_dmtp_session(session);
+    pthread_join(receiver.thread, NULL);
+}
+
+static long max_rss_kb(void) {
+
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_maxrss;
+}
+
+// Run with --gtest_also_run_disabled_tests --gtest_filter=*bench_dmtp_data_stream to print the memory used to send a large message.
+TEST(DIME, DISABLED_bench_dmtp_data_stream)
+{
+    struct timespec start, end;
+    stub_dx_receiver_t receiver;
+    data_test_producer_t producer;
+    dmtp_session_t *session;
+    unsigned char *message;
+    size_t len = 64 * 1024 * 1024;
+    double elapsed;
+    long rss;
+    char *txid;
+
+    // The peak resident set size only ever grows, so the streamed message is sent first.
+    for (int contiguous = 0; contiguous < 2; contiguous++) {
+        memset(&producer, 0, sizeof(producer));
+        producer.len = len;
+        rss = max_rss_kb();
+
+        session = create_data_test_session(&receiver, len);
+        ASSERT_TRUE(session != NULL) << "Failed to create test DMTP session.";
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if (contiguous) {
+            message = (unsigned char *)malloc(len);
+            ASSERT_EQ((ssize_t)len, produce_data_test_message(&producer, message, len));
+            txid = _sgnt_resolv_dmtp_data(session, message, len);
+            free(message);
+        } else {
+            txid = _sgnt_resolv_dmtp_data_stream(session, produce_data_test_message, &producer);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ASSERT_TRUE(txid != NULL);
+        free(txid);
+
+        pthread_join(receiver.thread, NULL);
+        _sgnt_resolv_destroy_dmtp_session(session);
+
+        elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1000000000.0);
+        printf("%zu MB %s: peak RSS grew by %ld KB, %.1f ms\n", len / (1024 * 1024), contiguous ? "contiguous" : "streamed  ", max_rss_kb() - rss,
+            elapsed * 1000);
+    }
+
+}
@@ -0,0 +1,688 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/ssl.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+extern "C" {
+#include "dime/signet-resolver/dmtp_async.h"
+}
+#include "gtest/gtest.h"
+
+#define ASYNC_TEST_DOMAIN "async.example.test"
+#define ASYNC_TEST_DX "dx.async.example.test"
+#define ASYNC_TEST_ORIGIN "origin.example.test"
+#define ASYNC_REFUSED_DOMAIN "refused.example.test"
+#define N_ASYNC_SESSIONS 64
+#define N_ASYNC_QUERIES 20
+#define N_BENCH_SESSIONS 256
+
+/*
+ * A stub DX server listening on a unix domain socket, which serves every connection from its own thread. A standard
+ * server negotiates TLS right away, and a dual mode one waits for STARTTLS. Deliveries to ASYNC_REFUSED_DOMAIN are
+ * refused at RCPT TO, and accepted messages are acknowledged with a hash of their contents as the transaction ID.
+ * SGNT returns a signet made up from the requested name, unless the name begins with "missing". A silent server
+ * never sends its banner, and a delay can be set to simulate the round trip time to the server.
+ */
+typedef struct {
+    SSL_CTX *ctx;
+    int fd;
+    int dual;
+    int silent;
+    unsigned int delay_ms;
+    char path[108];
+    pthread_t thread;
+    unsigned int connections;
+    unsigned int deliveries;
+    unsigned int queries;
+} stub_dmtp_server_t;
+
+typedef struct {
+    stub_dmtp_server_t *server;
+    int fd;
+    SSL *ssl;
+    char buf[4096];
+    size_t len;
+    size_t pos;
+} stub_dmtp_conn_t;
+
+static SSL_CTX *create_stub_tls_context(void) {
+
+    SSL_CTX *result;
+    EVP_PKEY *pkey;
+    X509 *cert;
+    RSA *rsa;
+    BIGNUM *e;
+
+    e = BN_new();
+    BN_set_word(e, RSA_F4);
+    rsa = RSA_new();
+    RSA_generate_key_ex(rsa, 2048, e, NULL);
+    BN_free(e);
+    pkey = EVP_PKEY_new();
+    EVP_PKEY_assign_RSA(pkey, rsa);
+
+    cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_get_notBefore(cert), 0);
+    X509_gmtime_adj(X509_get_notAfter(cert), 3600);
+    X509_set_pubkey(cert, pkey);
+    X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC, (const unsigned char *)ASYNC_TEST_DX, -1, -1, 0);
+    X509_set_issuer_name(cert, X509_get_subject_name(cert));
+    X509_sign(cert, pkey, EVP_sha256());
+
+    result = SSL_CTX_new(SSLv23_server_method());
+    SSL_CTX_use_certificate(result, cert);
+    SSL_CTX_use_PrivateKey(result, pkey);
+    (void)SSL_CTX_set_ecdh_auto(result, 1);
+    X509_free(cert);
+    EVP_PKEY_free(pkey);
+
+    return result;
+}
+
+static uint64_t hash_async_test_bytes(uint64_t hash, const unsigned char *buf, size_t len) {
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ buf[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static ssize_t stub_dmtp_read(stub_dmtp_conn_t *conn, void *buf, size_t len) {
+
+    if (conn->pos < conn->len) {
+        len = (len < (conn->len - conn->pos)) ? len : (conn->len - conn->pos);
+        memcpy(buf, &(conn->buf[conn->pos]), len);
+        conn->pos += len;
+        return len;
+    }
+
+    return conn->ssl ? SSL_read(conn->ssl, buf, len) : recv(conn->fd, buf, len, 0);
+}
+
+static int stub_dmtp_line(stub_dmtp_conn_t *conn, char *line, size_t size) {
+
+    size_t used = 0;
+    ssize_t nread;
+    char c;
+
+    while (used < (size - 1)) {
+
+        if (conn->pos == conn->len) {
+
+            if ((nread = stub_dmtp_read(conn, conn->buf, sizeof(conn->buf))) <= 0) {
+                return -1;
+            }
+
+            conn->pos = 0;
+            conn->len = nread;
+        }
+
+        if ((c = conn->buf[conn->pos++]) == '\n') {
+            break;
+        } else if (c != '\r') {
+            line[used++] = c;
+        }
+
+    }
+
+    line[used] = 0;
+
+    return 0;
+}
+
+static void stub_dmtp_reply(stub_dmtp_conn_t *conn, const char *reply) {
+
+    struct timespec ts;
+
+    if (conn->server->delay_ms) {
+        ts.tv_sec = conn->server->delay_ms / 1000;
+        ts.tv_nsec = (conn->server->delay_ms % 1000) * 1000000L;
+        nanosleep(&ts, NULL);
+    }
+
+    if (conn->ssl) {
+        SSL_write(conn->ssl, reply, strlen(reply));
+    } else {
+        send(conn->fd, reply, strlen(reply), MSG_NOSIGNAL);
+    }
+
+}
+
+static int stub_dmtp_accept_tls(stub_dmtp_conn_t *conn) {
+
+    conn->ssl = SSL_new(conn->server->ctx);
+    SSL_set_fd(conn->ssl, conn->fd);
+
+    return (SSL_accept(conn->ssl) == 1) ? 0 : -1;
+}
+
+static void *run_stub_dmtp_conn(void *arg) {
+
+    stub_dmtp_conn_t *conn = (stub_dmtp_conn_t *)arg;
+    unsigned char data[16384];
+    char line[512], reply[600];
+    const char *ptr;
+    size_t msgsize = 0, nleft, body;
+    uint64_t hash;
+    ssize_t nread;
+
+    if (conn->server->silent) {
+        while (recv(conn->fd, data, sizeof(data), 0) > 0);
+    } else if (conn->server->dual || !stub_dmtp_accept_tls(conn)) {
+        stub_dmtp_reply(conn, "220 " ASYNC_TEST_DX " DMTPv1 ESMTP\r\n");
+
+        while (!stub_dmtp_line(conn, line, sizeof(line))) {
+
+            if (!strncmp(line, "STARTTLS", 8)) {
+                stub_dmtp_reply(conn, "220 READY\r\n");
+
+                if (stub_dmtp_accept_tls(conn) < 0) {
+                    break;
+                }
+
+                stub_dmtp_reply(conn, "250 OK DMTPv1\r\n");
+            } else if (!strncmp(line, "EHLO", 4)) {
+                stub_dmtp_reply(conn, "250-" ASYNC_TEST_DX "\r\n250 SIZE\r\n");
+            } else if (!strncmp(line, "MAIL FROM", 9)) {
+                msgsize = ((ptr = strstr(line, "SIZE="))) ? strtoul(ptr + 5, NULL, 10) : 0;
+                stub_dmtp_reply(conn, "250 OK\r\n");
+            } else if (!strncmp(line, "RCPT TO", 7)) {
+                stub_dmtp_reply(conn, strstr(line, ASYNC_REFUSED_DOMAIN) ? "550 MAILBOX UNAVAILABLE\r\n" : "250 OK\r\n");
+            } else if (!strncmp(line, "DATA", 4)) {
+                stub_dmtp_reply(conn, "354 CONTINUE [commit]\r\n");
+                hash = 0xcbf29ce484222325ULL;
+
+                // The message is followed by a terminating CR/LF.
+                for (nleft = msgsize + 2; nleft; nleft -= nread) {
+
+                    if ((nread = stub_dmtp_read(conn, data, (nleft < sizeof(data)) ? nleft : sizeof(data))) <= 0) {
+                        break;
+                    }
+
+                    body = (nleft > 2) ? (nleft - 2) : 0;
+                    hash = hash_async_test_bytes(hash, data, ((size_t)nread < body) ? nread : body);
+                }
+
+                __atomic_add_fetch(&(conn->server->deliveries), 1, __ATOMIC_RELAXED);
+                snprintf(reply, sizeof(reply), "250 OK [%016llx]\r\n", (unsigned long long)hash);
+                stub_dmtp_reply(conn, reply);
+            } else if (!strncmp(line, "SGNT", 4)) {
+                __atomic_add_fetch(&(conn->server->queries), 1, __ATOMIC_RELAXED);
+
+                if (strstr(line, "<missing")) {
+                    stub_dmtp_reply(conn, "550 SIGNET NOT FOUND\r\n");
+                } else {
+                    line[strcspn(line, ">")] = 0;
+                    snprintf(reply, sizeof(reply), "250 OK [signet:%s]\r\n", strchr(line, '<') ? strchr(line, '<') + 1 : "");
+                    stub_dmtp_reply(conn, reply);
+                }
+
+            } else if (!strncmp(line, "QUIT", 4)) {
+                stub_dmtp_reply(conn, "221 BYE\r\n");
+                break;
+            } else {
+                stub_dmtp_reply(conn, "500 UNRECOGNIZED COMMAND\r\n");
+            }
+
+        }
+
+    }
+
+    if (conn->ssl) {
+        SSL_free(conn->ssl);
+    }
+
+    close(conn->fd);
+    __atomic_sub_fetch(&(conn->server->connections), 1, __ATOMIC_RELEASE);
+    free(conn);
+
+    return NULL;
+}
+
+static void *run_stub_dmtp_server(void *arg) {
+
+    stub_dmtp_server_t *server = (stub_dmtp_server_t *)arg;
+    stub_dmtp_conn_t *conn;
+    pthread_t thread;
+    int fd;
+
+    while ((fd = accept(server->fd, NULL, NULL)) >= 0) {
+        conn = (stub_dmtp_conn_t *)calloc(1, sizeof(stub_dmtp_conn_t));
+        conn->server = server;
+        conn->fd = fd;
+        __atomic_add_fetch(&(server->connections), 1, __ATOMIC_RELAXED);
+
+        if (pthread_create(&thread, NULL, run_stub_dmtp_conn, conn)) {
+            close(fd);
+            free(conn);
+            __atomic_sub_fetch(&(server->connections), 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+
+    return NULL;
+}
+
+static int start_stub_dmtp_server(stub_dmtp_server_t *server, SSL_CTX *ctx, int dual, int silent) {
+
+    struct sockaddr_un addr;
+
+    memset(server, 0, sizeof(stub_dmtp_server_t));
+    server->ctx = ctx;
+    server->dual = dual;
+    server->silent = silent;
+    snprintf(server->path, sizeof(server->path), "/tmp/check_dmtp_async.%d.%d%d", getpid(), dual, silent);
+    unlink(server->path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, server->path, sizeof(addr.sun_path) - 1);
+
+    if ((server->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    } else if (bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(server->fd, SOMAXCONN) ||
+        pthread_create(&(server->thread), NULL, run_stub_dmtp_server, server)) {
+        close(server->fd);
+        unlink(server->path);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Shutting down the listening socket wakes up the accept loop, and then every connection is waited on to finish.
+static void stop_stub_dmtp_server(stub_dmtp_server_t *server) {
+
+    shutdown(server->fd, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->fd);
+    unlink(server->path);
+
+    while (__atomic_load_n(&(server->connections), __ATOMIC_ACQUIRE)) {
+        usleep(1000);
+    }
+
+}
+
+/*
+ * A request submitted to the event loop, along with its own copy of the server address, and everything the completion
+ * callback recorded about it.
+ */
+typedef struct {
+    dmtp_async_request_t request;
+    struct sockaddr_un addr;
+    struct iovec msg[3];
+    dmtp_signet_query_t queries[N_ASYNC_QUERIES];
+    char names[N_ASYNC_QUERIES][64];
+    int status;
+    unsigned int calls;
+} async_test_op_t;
+
+static void record_async_test_op(dmtp_async_request_t *request, int status, void *arg) {
+
+    async_test_op_t *op = (async_test_op_t *)arg;
+
+    EXPECT_EQ(&(op->request), request);
+    op->status = status;
+    op->calls++;
+}
+
+static void init_async_test_op(async_test_op_t *op, stub_dmtp_server_t *server, dmtp_async_type_t type) {
+
+    memset(op, 0, sizeof(async_test_op_t));
+    op->addr.sun_family = AF_UNIX;
+    strncpy(op->addr.sun_path, server->path, sizeof(op->addr.sun_path) - 1);
+    op->status = -2;
+
+    op->request.type = type;
+    op->request.addr = (struct sockaddr *)&(op->addr);
+    op->request.addrlen = sizeof(op->addr);
+    op->request.dx = ASYNC_TEST_DX;
+    op->request.domain = ASYNC_TEST_DOMAIN;
+    op->request.mode = server->dual ? dmtp_mode_dual : dmtp_mode_dmtp;
+    op->request.helo = ASYNC_TEST_ORIGIN;
+    op->request.origin = ASYNC_TEST_ORIGIN;
+    op->request.rettype = return_type_default;
+    op->request.dtype = data_type_default;
+}
+
+// The message is split across three buffers, the middle one being large enough that it has to be sent in many pieces.
+static void init_async_test_message(async_test_op_t *op, unsigned char *msg, size_t msglen) {
+
+    op->msg[0].iov_base = msg;
+    op->msg[0].iov_len = 100;
+    op->msg[1].iov_base = msg + 100;
+    op->msg[1].iov_len = msglen - 200;
+    op->msg[2].iov_base = msg + msglen - 100;
+    op->msg[2].iov_len = 100;
+    op->request.msg = op->msg;
+    op->request.msgcnt = 3;
+}
+
+static void init_async_test_queries(async_test_op_t *op, size_t n, const char *prefix) {
+
+    for (size_t i = 0; i < N_ASYNC_QUERIES; i++) {
+        snprintf(op->names[i], sizeof(op->names[i]), "%s%zu-%zu@" ASYNC_TEST_DOMAIN, prefix, n, i);
+        op->queries[i].type = dmtp_query_sgnt;
+        op->queries[i].signame = op->names[i];
+    }
+
+    op->request.queries = op->queries;
+    op->request.nqueries = N_ASYNC_QUERIES;
+}
+
+static void free_async_test_op(async_test_op_t *op) {
+
+    free(op->request.txid);
+
+    for (size_t i = 0; i < op->request.nqueries; i++) {
+        free(op->queries[i].result);
+    }
+
+}
+
+static int run_async_test_loop(dmtp_async_loop_t *loop) {
+
+    int pending;
+
+    while ((pending = sgnt_resolv_dmtp_async_run(loop, -1)) > 0);
+
+    return pending;
+}
+
+TEST(DIME, check_dmtp_async)
+{
+    stub_dmtp_server_t standard, dual;
+    async_test_op_t *ops;
+    dmtp_async_loop_t *loop;
+    unsigned char *msg;
+    char txid[32], signet[128];
+    size_t msglen = 300000;
+    uint64_t hash;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    msg = (unsigned char *)malloc(msglen);
+    ops = (async_test_op_t *)malloc(N_ASYNC_SESSIONS * sizeof(async_test_op_t));
+    ASSERT_TRUE(msg != NULL && ops != NULL) << "Failed to allocate test buffers.";
+
+    for (size_t i = 0; i < msglen; i++) {
+        msg[i] = (unsigned char)((i * 7) ^ (i >> 8));
+    }
+
+    ASSERT_EQ(0, start_stub_dmtp_server(&standard, create_stub_tls_context(), 0, 0));
+    ASSERT_EQ(0, start_stub_dmtp_server(&dual, standard.ctx, 1, 0));
+    ASSERT_TRUE((loop = sgnt_resolv_dmtp_async_create(10)) != NULL) << "Failed to create DMTP event loop.";
+
+    // Deliveries and signet query batches run side by side, over both standard and dual mode connections.
+    for (size_t i = 0; i < N_ASYNC_SESSIONS; i++) {
+        init_async_test_op(&(ops[i]), (i % 4) < 2 ? &standard : &dual, (i % 2) ? dmtp_async_query : dmtp_async_deliver);
+
+        if (i % 2) {
+            init_async_test_queries(&(ops[i]), i, (i % 8) == 1 ? "missing" : "user");
+
+            if ((i % 8) == 1) {
+                ops[i].queries[0].signame = ops[i].names[0] + strlen("missing");
+            }
+
+        } else {
+            init_async_test_message(&(ops[i]), msg, msglen - (i * 1000));
+        }
+
+        ASSERT_EQ(0, sgnt_resolv_dmtp_async_submit(loop, &(ops[i].request), record_async_test_op, &(ops[i]))) << "Failed to submit request " << i << ".";
+    }
+
+    ASSERT_EQ(0, run_async_test_loop(loop)) << "DMTP event loop failed.";
+
+    for (size_t i = 0; i < N_ASYNC_SESSIONS; i++) {
+        ASSERT_EQ(1U, ops[i].calls) << "Completion callback of request " << i << " was not called exactly once.";
+        ASSERT_EQ(dmtp_async_done, ops[i].request.state) << "Request " << i << " did not finish.";
+
+        if (ops[i].request.type == dmtp_async_deliver) {
+            hash = 0xcbf29ce484222325ULL;
+
+            for (int j = 0; j < ops[i].request.msgcnt; j++) {
+                hash = hash_async_test_bytes(hash, (const unsigned char *)ops[i].msg[j].iov_base, ops[i].msg[j].iov_len);
+            }
+
+            snprintf(txid, sizeof(txid), "%016llx", (unsigned long long)hash);
+            ASSERT_EQ(0, ops[i].status) << "Delivery " << i << " failed.";
+            ASSERT_STREQ(txid, ops[i].request.txid) << "Server did not receive the message of delivery " << i << " intact.";
+            continue;
+        }
+
+        // Every query in a batch of missing signets fails except the first, whose name had its prefix skipped.
+        if ((i % 8) == 1) {
+            ASSERT_EQ(1, ops[i].status) << "Query batch " << i << " did not fail the queries for missing signets.";
+        } else {
+            ASSERT_EQ(N_ASYNC_QUERIES, ops[i].status) << "Query batch " << i << " did not succeed.";
+        }
+
+        for (size_t j = 0; j < N_ASYNC_QUERIES; j++) {
+
+            if (((i % 8) == 1) && j) {
+                ASSERT_EQ(-1, ops[i].queries[j].status);
+                ASSERT_EQ(550, ops[i].queries[j].rcode);
+                ASSERT_TRUE(ops[i].queries[j].result == NULL);
+                continue;
+            }
+
+            snprintf(signet, sizeof(signet), "signet:%s", ops[i].queries[j].signame);
+            ASSERT_EQ(1, ops[i].queries[j].status);
+            ASSERT_EQ(250, ops[i].queries[j].rcode);
+            ASSERT_STREQ(signet, ops[i].queries[j].result);
+        }
+
+    }
+
+    ASSERT_EQ((unsigned int)(N_ASYNC_SESSIONS / 2), standard.deliveries + dual.deliveries);
+    ASSERT_EQ((unsigned int)((N_ASYNC_SESSIONS / 2) * N_ASYNC_QUERIES), standard.queries + dual.queries);
+
+    for (size_t i = 0; i < N_ASYNC_SESSIONS; i++) {
+        free_async_test_op(&(ops[i]));
+    }
+
+    sgnt_resolv_dmtp_async_destroy(loop);
+    stop_stub_dmtp_server(&standard);
+    stop_stub_dmtp_server(&dual);
+    SSL_CTX_free(standard.ctx);
+    free(ops);
+    free(msg);
+}
+
+TEST(DIME, check_dmtp_async_failures)
+{
+    stub_dmtp_server_t server, silent;
+    async_test_op_t refused, waiting, missing;
+    dmtp_async_loop_t *loop;
+    unsigned char msg[1000];
+    time_t start;
+
+    signal(SIGPIPE, SIG_IGN);
+    memset(msg, 'x', sizeof(msg));
+
+    ASSERT_EQ(0, start_stub_dmtp_server(&server, create_stub_tls_context(), 0, 0));
+    ASSERT_EQ(0, start_stub_dmtp_server(&silent, NULL, 1, 1));
+    ASSERT_TRUE((loop = sgnt_resolv_dmtp_async_create(1)) != NULL) << "Failed to create DMTP event loop.";
+
+    // A server that isn't there fails the request right away, without invoking its callback.
+    init_async_test_op(&missing, &server, dmtp_async_deliver);
+    init_async_test_message(&missing, msg, sizeof(msg));
+    strncpy(missing.addr.sun_path, "/nonexistent/dmtp.sock", sizeof(missing.addr.sun_path) - 1);
+    ASSERT_EQ(-1, sgnt_resolv_dmtp_async_submit(loop, &(missing.request), record_async_test_op, &missing));
+    ASSERT_EQ(0U, missing.calls);
+
+    // A refused recipient fails the delivery in the state where it was refused.
+    init_async_test_op(&refused, &server, dmtp_async_deliver);
+    init_async_test_message(&refused, msg, sizeof(msg));
+    refused.request.domain = ASYNC_REFUSED_DOMAIN;
+    ASSERT_EQ(0, sgnt_resolv_dmtp_async_submit(loop, &(refused.request), record_async_test_op, &refused));
+
+    // A server that never sends its banner times out.
+    init_async_test_op(&waiting, &silent, dmtp_async_query);
+    init_async_test_queries(&waiting, 0, "user");
+    ASSERT_EQ(0, sgnt_resolv_dmtp_async_submit(loop, &(waiting.request), record_async_test_op, &waiting));
+
+    start = time(NULL);
+    ASSERT_EQ(0, run_async_test_loop(loop)) << "DMTP event loop failed.";
+    ASSERT_GE(time(NULL) - start, 1) << "Silent server was given up on before the timeout.";
+    ASSERT_LE(time(NULL) - start, 4) << "Silent server was not given up on soon after the timeout.";
+
+    ASSERT_EQ(1U, refused.calls);
+    ASSERT_EQ(-1, refused.status);
+    ASSERT_EQ(dmtp_async_rcpt_to, refused.request.state);
+    ASSERT_EQ(550, refused.request.rcode);
+    ASSERT_TRUE(refused.request.txid == NULL);
+
+    ASSERT_EQ(1U, waiting.calls);
+    ASSERT_EQ(-1, waiting.status);
+    ASSERT_EQ(dmtp_async_banner, waiting.request.state);
+
+    for (size_t i = 0; i < N_ASYNC_QUERIES; i++) {
+        ASSERT_EQ(-1, waiting.queries[i].status);
+        ASSERT_TRUE(waiting.queries[i].result == NULL);
+    }
+
+    // Destroying a loop fails whatever it was still running.
+    init_async_test_op(&waiting, &silent, dmtp_async_query);
+    init_async_test_queries(&waiting, 0, "user");
+    ASSERT_EQ(0, sgnt_resolv_dmtp_async_submit(loop, &(waiting.request), record_async_test_op, &waiting));
+    ASSERT_EQ(1, sgnt_resolv_dmtp_async_run(loop, 10));
+    sgnt_resolv_dmtp_async_destroy(loop);
+    ASSERT_EQ(1U, waiting.calls);
+    ASSERT_EQ(-1, waiting.status);
+
+    stop_stub_dmtp_server(&server);
+    stop_stub_dmtp_server(&silent);
+    SSL_CTX_free(server.ctx);
+}
+
+static uint64_t clock_ms(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+TEST(DIME, check_dmtp_connect_race)
+{
+    stub_dmtp_server_t standard, dual, silent;
+    async_test_op_t ops[4];
+    dmtp_async_request_t attempts[4];
+    dmtp_session_t *session;
+    uint64_t start;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    ASSERT_EQ(0, start_stub_dmtp_server(&standard, create_stub_tls_context(), 0, 0));
+    ASSERT_EQ(0, start_stub_dmtp_server(&dual, standard.ctx, 1, 0));
+    ASSERT_EQ(0, start_stub_dmtp_server(&silent, NULL, 1, 1));
+
+    // A server that isn't there is skipped right away, and one that never sends its banner only holds up the race for its head start.
+    init_async_test_op(&(ops[0]), &standard, dmtp_async_establish);
+    strncpy(ops[0].addr.sun_path, "/nonexistent/dmtp.sock", sizeof(ops[0].addr.sun_path) - 1);
+    init_async_test_op(&(ops[1]), &silent, dmtp_async_establish);
+    init_async_test_op(&(ops[2]), &standard, dmtp_async_establish);
+    init_async_test_op(&(ops[3]), &dual, dmtp_async_establish);
+    ops[0].request.dx = "missing." ASYNC_TEST_DX;
+    ops[1].request.dx = "silent." ASYNC_TEST_DX;
+    ops[3].request.dx = "dual." ASYNC_TEST_DX;
+
+    for (size_t i = 0; i < 4; i++) {
+        attempts[i] = ops[i].request;
+    }
+
+    start = clock_ms();
+    ASSERT_TRUE((session = _dx_connect_race(attempts, 4)) != NULL) << "No DX connection attempt succeeded.";
+    ASSERT_LT(clock_ms() - start, (uint64_t)(DMTP_CONNECT_ATTEMPT_DELAY * 4)) << "Unresponsive DX server held up the connection race.";
+    ASSERT_GE(clock_ms() - start, (uint64_t)DMTP_CONNECT_ATTEMPT_DELAY) << "Second connection attempt was started without waiting.";
+    ASSERT_STREQ(ASYNC_TEST_DX, session->dx);
+    ASSERT_EQ(dmtp_mode_dmtp, session->mode);
+
+    // The winning session is handed over in blocking mode, ready for its first command.
+    ASSERT_EQ(0, sgnt_resolv_dmtp_quit(session, 1)) << "Established session could not be used after the race.";
+    _sgnt_resolv_destroy_dmtp_session(session);
+
+    // A dual mode server wins once it's the only one left, after its STARTTLS has gone through.
+    attempts[0] = ops[1].request;
+    attempts[1] = ops[3].request;
+    ASSERT_TRUE((session = _dx_connect_race(attempts, 2)) != NULL) << "Dual mode DX connection attempt did not succeed.";
+    ASSERT_STREQ("dual." ASYNC_TEST_DX, session->dx);
+    ASSERT_EQ(dmtp_mode_dmtp, session->mode);
+    _sgnt_resolv_destroy_dmtp_session(session);
+
+    // If every attempt fails, so does the race.
+    attempts[0] = ops[0].request;
+    ASSERT_TRUE(_dx_connect_race(attempts, 1) == NULL) << "Connection race succeeded without any server to connect to.";
+
+    stop_stub_dmtp_server(&standard);
+    stop_stub_dmtp_server(&dual);
+    stop_stub_dmtp_server(&silent);
+    SSL_CTX_free(standard.ctx);
+}
+
+// Run with --gtest_also_run_disabled_tests --gtest_filter=*bench_dmtp_async to print how long deliveries take one at a time and multiplexed on one thread.
+TEST(DIME, DISABLED_bench_dmtp_async)
+{
+    stub_dmtp_server_t server;
+    async_test_op_t *ops;
+    dmtp_async_loop_t *loop;
+    unsigned char msg[65536];
+    size_t concurrency[2] = { 1, N_BENCH_SESSIONS }, failed;
+    uint64_t start;
+
+    signal(SIGPIPE, SIG_IGN);
+    memset(msg, 'x', sizeof(msg));
+    ops = (async_test_op_t *)malloc(N_BENCH_SESSIONS * sizeof(async_test_op_t));
+
+    // Every reply is delayed to simulate a 10 millisecond round trip.
+    ASSERT_EQ(0, start_stub_dmtp_server(&server, create_stub_tls_context(), 0, 0));
+    server.delay_ms = 10;
+    ASSERT_TRUE((loop = sgnt_resolv_dmtp_async_create(0)) != NULL) << "Failed to create DMTP event loop.";
+
+    for (size_t i = 0; i < (sizeof(concurrency) / sizeof(concurrency[0])); i++) {
+        start = clock_ms();
+        failed = 0;
+
+        for (size_t j = 0; j < N_BENCH_SESSIONS; j += concurrency[i]) {
+
+            for (size_t k = j; k < (j + concurrency[i]); k++) {
+                init_async_test_op(&(ops[k]), &server, dmtp_async_deliver);
+                init_async_test_message(&(ops[k]), msg, sizeof(msg));
+                ASSERT_EQ(0, sgnt_resolv_dmtp_async_submit(loop, &(ops[k].request), record_async_test_op, &(ops[k])));
+            }
+
+            ASSERT_EQ(0, run_async_test_loop(loop));
+
+            for (size_t k = j; k < (j + concurrency[i]); k++) {
+                failed += (ops[k].status != 0);
+                free_async_test_op(&(ops[k]));
+            }
+
+        }
+
+        printf("%d deliveries of %zu bytes, %zu at a time: %u ms elapsed, %zu failed\n", N_BENCH_SESSIONS, sizeof(msg), concurrency[i],
+            (unsigned int)(clock_ms() - start), failed);
+    }
+
+    sgnt_resolv_dmtp_async_destroy(loop);
+    stop_stub_dmtp_server(&server);
+    SSL_CTX_free(server.ctx);
+    free(ops);
+}
@@ -0,0 +1,893 @@
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <dlfcn.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+#include <openssl/sha.h>
+
+extern "C" {
+#include "dime/common/misc.h"
+#include "dime/signet-resolver/cache.h"
+#include "dime/signet-resolver/dns.h"
+#include "dime/signet-resolver/resolver.h"
+}
+#include "gtest/gtest.h"
+
+#define N_CONCURRENT_TEST_QUERIES 200
+#define N_LARGE_TXT_STRINGS 24
+#define N_DEFERRED_ANSWERS 64
+#define STUB_DNS_DELAY_MS 100
+#define N_STUB_ZONE_KEYS 32
+#define STUB_ZONE_KEY_BITS 1024
+
+/*
+ * A stub nameserver listening on UDP and TCP on the same loopback port. It answers TXT queries with the queried name,
+ * MX queries with a fixed set of exchanges, and has a few names with special behavior:
+ *  - big.example.test is truncated over UDP, and answered in full (larger than any UDP answer) over TCP.
+ *  - drop.example.test is never answered.
+ *  - drop-once.example.test is only answered on the second attempt.
+ *  - spoof.example.test gets an answer for the wrong question before the real one.
+ *  - names with a slow label, like a.slow.example.test, are answered after a delay, as if from a distant nameserver.
+ * Every name is also a signed zone, whose DNSKEY and DS queries are answered with the signed records described below.
+ */
+typedef struct {
+    unsigned char query[512];
+    size_t qlen;
+    struct sockaddr_storage from;
+    socklen_t fromlen;
+    uint64_t due;
+} deferred_answer_t;
+
+typedef struct {
+    int udp_fd;
+    int tcp_fd;
+    struct sockaddr_in addr;
+    pthread_t thread;
+    int stop;
+    unsigned int udp_queries;
+    unsigned int tcp_queries;
+    unsigned int drop_once_seen;
+    in_port_t drop_once_ports[2];
+    unsigned int dnskey_queries;
+    unsigned int ds_queries;
+    deferred_answer_t deferred[N_DEFERRED_ANSWERS];
+    size_t ndeferred;
+} stub_dns_server_t;
+
+static uint64_t stub_dns_clock(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static int is_slow_dns_name(const char *name) {
+
+    return (!strncmp(name, "slow.", 5) || strstr(name, ".slow."));
+}
+
+static size_t put_dns_name(unsigned char *buf, const char *name) {
+
+    const char *dot;
+    size_t len, result = 0;
+
+    while (*name) {
+        dot = strchr(name, '.');
+        len = dot ? (size_t)(dot - name) : strlen(name);
+        buf[result++] = len;
+        memcpy(buf + result, name, len);
+        result += len;
+        name += len + (dot ? 1 : 0);
+    }
+
+    buf[result++] = 0;
+
+    return result;
+}
+
+static size_t put_dns_rr_header(unsigned char *buf, uint16_t type, uint16_t rdlen) {
+
+    unsigned char *ptr = buf;
+
+    // Every answer's owner name is a pointer to the question name.
+    NS_PUT16(0xc00c, ptr);
+    NS_PUT16(type, ptr);
+    NS_PUT16(ns_c_in, ptr);
+    NS_PUT32(300, ptr);
+    NS_PUT16(rdlen, ptr);
+
+    return ptr - buf;
+}
+
+/*
+ * Each zone served by the stub nameserver, including the root, which is the empty name, is signed with its own RSA/SHA-256
+ * key, made up the first time the zone is asked for. A DNSKEY query is answered with the zone's key and a DS query with
+ * the digest of that key, while a TXT query for a name beginning with _dx. is answered with a TXT record as usual. Each of
+ * them comes with an RRSIG: the DNSKEY and TXT records are signed by the zone's own key, and the DS record by the key of
+ * the zone above, so that the chain of trust of any name leads up to the root key. The exception is a zone whose name
+ * begins with forged., whose signatures are made with the wrong key.
+ */
+typedef struct {
+    char zone[64];
+    RSA *rsa;
+    unsigned char rdata[4 + 4 + (STUB_ZONE_KEY_BITS / 8)];
+    size_t rdlen;
+    unsigned int keytag;
+} stub_zone_key_t;
+
+static stub_zone_key_t stub_zone_keys[N_STUB_ZONE_KEYS];
+static size_t n_stub_zone_keys = 0;
+static pthread_mutex_t stub_zone_keys_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const stub_zone_key_t *get_stub_zone_key(const char *zone) {
+
+    stub_zone_key_t *result = NULL;
+    unsigned char *ptr;
+    BIGNUM *e;
+
+    pthread_mutex_lock(&stub_zone_keys_lock);
+
+    for (size_t i = 0; (i < n_stub_zone_keys) && !result; i++) {
+
+        if (!strcasecmp(stub_zone_keys[i].zone, zone)) {
+            result = &(stub_zone_keys[i]);
+        }
+
+    }
+
+    if (!result && (n_stub_zone_keys < N_STUB_ZONE_KEYS)) {
+        result = &(stub_zone_keys[n_stub_zone_keys++]);
+        snprintf(result->zone, sizeof(result->zone), "%s", zone);
+
+        e = BN_new();
+        BN_set_word(e, RSA_F4);
+        result->rsa = RSA_new();
+        RSA_generate_key_ex(result->rsa, STUB_ZONE_KEY_BITS, e, NULL);
+        BN_free(e);
+
+        // The flags, protocol and algorithm are followed by the public key in the format of RFC 3110.
+        ptr = result->rdata;
+        NS_PUT16(DNSKEY_RR_FLAG_ZK | DNSKEY_RR_FLAG_SEP, ptr);
+        *ptr++ = DNSKEY_RR_PROTO;
+        *ptr++ = NS_ALG_RSASHA256;
+        *ptr++ = BN_num_bytes(result->rsa->e);
+        ptr += BN_bn2bin(result->rsa->e, ptr);
+        ptr += BN_bn2bin(result->rsa->n, ptr);
+        result->rdlen = ptr - result->rdata;
+        result->keytag = _get_keytag(result->rdata, result->rdlen);
+    }
+
+    pthread_mutex_unlock(&stub_zone_keys_lock);
+
+    return result;
+}
+
+static const char *get_stub_parent_zone(const char *zone) {
+
+    const char *dot = strchr(zone, '.');
+
+    return (dot ? dot + 1 : "");
+}
+
+static size_t put_stub_ds_rdata(unsigned char *buf, const char *zone) {
+
+    const stub_zone_key_t *key = get_stub_zone_key(zone);
+    unsigned char hashbuf[MAXCDNAME + sizeof(key->rdata)], *ptr = buf;
+    size_t hlen;
+
+    // The digest covers the owner name of the DNSKEY and its rdata.
+    hlen = put_dns_name(hashbuf, zone);
+    memcpy(hashbuf + hlen, key->rdata, key->rdlen);
+    hlen += key->rdlen;
+
+    NS_PUT16(key->keytag, ptr);
+    *ptr++ = NS_ALG_RSASHA256;
+    *ptr++ = DNSSEC_DIGEST_SHA256;
+    SHA256(hashbuf, hlen, ptr);
+
+    return (ptr - buf) + SHA256_DIGEST_LENGTH;
+}
+
+static size_t put_stub_signed_rr(unsigned char *buf, size_t bsize, const char *name, uint16_t type, const unsigned char *rdata, size_t rdlen, const char *signer) {
+
+    const stub_zone_key_t *key = get_stub_zone_key(signer), *signkey = strncmp(signer, "forged.", 7) ? key : get_stub_zone_key("forged");
+    unsigned char sigdata[1024], digest[SHA256_DIGEST_LENGTH], *rrsig, *ptr, *sptr;
+    unsigned int siglen, labels = 1;
+    time_t now = time(NULL);
+
+    if (bsize < (2 * 12) + rdlen + 18 + strlen(signer) + 2 + RSA_size(key->rsa)) {
+        return 0;
+    }
+
+    for (const char *dot = strchr(name, '.'); dot; dot = strchr(dot + 1, '.')) {
+        labels++;
+    }
+
+    ptr = buf + put_dns_rr_header(buf, type, rdlen);
+    memcpy(ptr, rdata, rdlen);
+    ptr += rdlen;
+
+    // The RRSIG rdata, without the signature, is what gets signed, followed by the covered RR in canonical form.
+    rrsig = ptr + 12;
+    ptr = rrsig;
+    NS_PUT16(type, ptr);
+    *ptr++ = NS_ALG_RSASHA256;
+    *ptr++ = labels;
+    NS_PUT32(300, ptr);
+    NS_PUT32(now + 3600, ptr);
+    NS_PUT32(now - 3600, ptr);
+    NS_PUT16(key->keytag, ptr);
+    ptr += put_dns_name(ptr, signer);
+
+    memcpy(sigdata, rrsig, ptr - rrsig);
+    sptr = sigdata + (ptr - rrsig);
+    sptr += put_dns_name(sptr, name);
+    NS_PUT16(type, sptr);
+    NS_PUT16(ns_c_in, sptr);
+    NS_PUT32(300, sptr);
+    NS_PUT16(rdlen, sptr);
+    memcpy(sptr, rdata, rdlen);
+    sptr += rdlen;
+
+    SHA256(sigdata, sptr - sigdata, digest);
+    RSA_sign(NID_sha256, digest, sizeof(digest), ptr, &siglen, signkey->rsa);
+    ptr += siglen;
+
+    put_dns_rr_header(rrsig - 12, ns_t_rrsig, ptr - rrsig);
+
+    return ptr - buf;
+}
+
+static size_t build_stub_dns_answer(const unsigned char *query, size_t qlen, int tcp, int spoof, unsigned char *buf, size_t bsize) {
+
+    ns_msg handle;
+    ns_rr rr;
+    HEADER *hdr = (HEADER *)buf;
+    const stub_zone_key_t *key;
+    unsigned char rdata[MAXCDNAME + 1], *ptr;
+    const char *name, *txt;
+    size_t qdlen, rdlen, result;
+    uint16_t nanswers = 0;
+
+    if ((ns_initparse(query, qlen, &handle) < 0) || (ns_parserr(&handle, ns_s_qd, 0, &rr) < 0)) {
+        return 0;
+    }
+
+    name = ns_rr_name(rr);
+
+    // Copy the header and the question section, which ends right after the question's type and class.
+    qdlen = HFIXEDSZ + put_dns_name(rdata, name) + QFIXEDSZ;
+    memcpy(buf, query, qdlen);
+
+    // The spoofed answer is for a different question, and carries a different TXT record.
+    if (spoof) {
+        buf[HFIXEDSZ + 1] = 'x';
+    }
+
+    result = qdlen;
+    hdr->qr = 1;
+    hdr->ra = 1;
+
+    if (!strcmp(name, "big.example.test") && !tcp) {
+        hdr->tc = 1;
+    } else if ((ns_rr_type(rr) == ns_t_txt) && !strncmp(name, "_dx.", 4)) {
+        rdata[0] = strlen(name);
+        memcpy(rdata + 1, name, rdata[0]);
+
+        if (!(rdlen = put_stub_signed_rr(buf + result, bsize - result, name, ns_t_txt, rdata, rdata[0] + 1, name))) {
+            return 0;
+        }
+
+        result += rdlen;
+        nanswers += 2;
+    } else if (ns_rr_type(rr) == ns_t_txt) {
+
+        for (size_t i = 0; i < (strcmp(name, "big.example.test") ? 1 : N_LARGE_TXT_STRINGS); i++) {
+            txt = spoof ? "spoofed" : name;
+            rdlen = 1 + strlen(txt);
+
+            if (result + 12 + rdlen > bsize) {
+                return 0;
+            }
+
+            result += put_dns_rr_header(buf + result, ns_t_txt, rdlen);
+            buf[result] = rdlen - 1;
+            memcpy(buf + result + 1, txt, rdlen - 1);
+            result += rdlen;
+            nanswers++;
+
+            // Pad the large answer out with 250 byte strings.
+            if (!strcmp(name, "big.example.test")) {
+                result += put_dns_rr_header(buf + result, ns_t_txt, 251);
+                buf[result] = 250;
+                memset(buf + result + 1, 'x', 250);
+                result += 251;
+                nanswers++;
+            }
+
+        }
+
+    } else if (ns_rr_type(rr) == ns_t_mx) {
+        const char *exchanges[] = { "mx3.example.test", "mx1.example.test", "mx2.example.test" };
+
+        for (size_t i = 0; i < sizeof(exchanges) / sizeof(exchanges[0]); i++) {
+            ptr = rdata;
+            NS_PUT16((i == 1) ? 10 : ((i == 2) ? 20 : 30), ptr);
+            rdlen = 2 + put_dns_name(ptr, exchanges[i]);
+            result += put_dns_rr_header(buf + result, ns_t_mx, rdlen);
+            memcpy(buf + result, rdata, rdlen);
+            result += rdlen;
+            nanswers++;
+        }
+
+    } else if (ns_rr_type(rr) == ns_t_dnskey) {
+        key = get_stub_zone_key(name);
+
+        if (!(rdlen = put_stub_signed_rr(buf + result, bsize - result, name, ns_t_dnskey, key->rdata, key->rdlen, name))) {
+            return 0;
+        }
+
+        result += rdlen;
+        nanswers += 2;
+    } else if (ns_rr_type(rr) == ns_t_ds) {
+        rdlen = put_stub_ds_rdata(rdata, name);
+
+        if (!(rdlen = put_stub_signed_rr(buf + result, bsize - result, name, ns_t_ds, rdata, rdlen, get_stub_parent_zone(name)))) {
+            return 0;
+        }
+
+        result += rdlen;
+        nanswers += 2;
+    }
+
+    hdr->ancount = htons(nanswers);
+    hdr->nscount = 0;
+    hdr->arcount = htons(1);
+
+    // The answer echoes the EDNS0 OPT RR, with the DO bit set.
+    ptr = buf + result;
+    *ptr++ = 0;
+    NS_PUT16(ns_t_opt, ptr);
+    NS_PUT16(DNS_EDNS_UDP_SIZE, ptr);
+    NS_PUT32(NS_OPT_DNSSEC_OK, ptr);
+    NS_PUT16(0, ptr);
+
+    return ptr - buf;
+}
+
+static void serve_stub_dns_udp(stub_dns_server_t *server) {
+
+    ns_msg handle;
+    ns_rr rr;
+    struct sockaddr_storage from;
+    socklen_t fromlen = sizeof(from);
+    unsigned char query[512], answer[512];
+    ssize_t qlen;
+    size_t alen;
+
+    if ((qlen = recvfrom(server->udp_fd, query, sizeof(query), 0, (struct sockaddr *)&from, &fromlen)) < HFIXEDSZ) {
+        return;
+    }
+
+    __atomic_add_fetch(&(server->udp_queries), 1, __ATOMIC_RELAXED);
+
+    if ((ns_initparse(query, qlen, &handle) < 0) || (ns_parserr(&handle, ns_s_qd, 0, &rr) < 0)) {
+        return;
+    }
+
+    if (ns_rr_type(rr) == ns_t_dnskey) {
+        __atomic_add_fetch(&(server->dnskey_queries), 1, __ATOMIC_RELAXED);
+    } else if (ns_rr_type(rr) == ns_t_ds) {
+        __atomic_add_fetch(&(server->ds_queries), 1, __ATOMIC_RELAXED);
+    }
+
+    if (is_slow_dns_name(ns_rr_name(rr)) && (server->ndeferred < N_DEFERRED_ANSWERS)) {
+        deferred_answer_t *deferred = &(server->deferred[server->ndeferred++]);
+
+        memcpy(deferred->query, query, qlen);
+        deferred->qlen = qlen;
+        memcpy(&(deferred->from), &from, fromlen);
+        deferred->fromlen = fromlen;
+        deferred->due = stub_dns_clock() + STUB_DNS_DELAY_MS;
+        return;
+    } else if (!strcmp(ns_rr_name(rr), "drop.example.test")) {
+        return;
+    }
+
+    // Each attempt at the query that is dropped once should come from a different source port.
+    if (!strcmp(ns_rr_name(rr), "drop-once.example.test") && (server->drop_once_seen < 2)) {
+        server->drop_once_ports[server->drop_once_seen] = ((struct sockaddr_in *)&from)->sin_port;
+    }
+
+    if (!strcmp(ns_rr_name(rr), "drop-once.example.test") && !__atomic_fetch_add(&(server->drop_once_seen), 1, __ATOMIC_RELAXED)) {
+        return;
+    } else if (!strcmp(ns_rr_name(rr), "spoof.example.test") && (alen = build_stub_dns_answer(query, qlen, 0, 1, answer, sizeof(answer)))) {
+        sendto(server->udp_fd, answer, alen, 0, (struct sockaddr *)&from, fromlen);
+    }
+
+    if ((alen = build_stub_dns_answer(query, qlen, 0, 0, answer, sizeof(answer)))) {
+        sendto(server->udp_fd, answer, alen, 0, (struct sockaddr *)&from, fromlen);
+    }
+
+}
+
+static void send_deferred_dns_answers(stub_dns_server_t *server) {
+
+    unsigned char answer[512];
+    uint64_t now = stub_dns_clock();
+    size_t alen;
+
+    for (size_t i = 0; i < server->ndeferred;) {
+
+        if (server->deferred[i].due > now) {
+            i++;
+            continue;
+        }
+
+        if ((alen = build_stub_dns_answer(server->deferred[i].query, server->deferred[i].qlen, 0, 0, answer, sizeof(answer)))) {
+            sendto(server->udp_fd, answer, alen, 0, (struct sockaddr *)&(server->deferred[i].from), server->deferred[i].fromlen);
+        }
+
+        server->deferred[i] = server->deferred[--server->ndeferred];
+    }
+
+}
+
+static void serve_stub_dns_tcp(stub_dns_server_t *server) {
+
+    unsigned char prefix[2], query[512], answer[16384];
+    size_t qlen, alen;
+    int fd;
+
+    if ((fd = accept(server->tcp_fd, NULL, NULL)) < 0) {
+        return;
+    }
+
+    __atomic_add_fetch(&(server->tcp_queries), 1, __ATOMIC_RELAXED);
+
+    if ((recv(fd, prefix, 2, MSG_WAITALL) == 2) && ((qlen = (prefix[0] << 8) | prefix[1]) <= sizeof(query)) &&
+        (recv(fd, query, qlen, MSG_WAITALL) == (ssize_t)qlen) && (alen = build_stub_dns_answer(query, qlen, 1, 0, answer + 2, sizeof(answer) - 2))) {
+        answer[0] = alen >> 8;
+        answer[1] = alen & 0xff;
+
+        // Dribble the answer out in two pieces to exercise partial reads.
+        send(fd, answer, alen / 2, MSG_NOSIGNAL);
+        usleep(10000);
+        send(fd, answer + alen / 2, alen + 2 - (alen / 2), MSG_NOSIGNAL);
+    }
+
+    close(fd);
+}
+
+static void *run_stub_dns_server(void *arg) {
+
+    stub_dns_server_t *server = (stub_dns_server_t *)arg;
+    struct pollfd fds[2];
+
+    fds[0].fd = server->udp_fd;
+    fds[1].fd = server->tcp_fd;
+    fds[0].events = fds[1].events = POLLIN;
+
+    while (!__atomic_load_n(&(server->stop), __ATOMIC_RELAXED)) {
+
+        send_deferred_dns_answers(server);
+
+        if (poll(fds, 2, 5) <= 0) {
+            continue;
+        }
+
+        if (fds[0].revents) {
+            serve_stub_dns_udp(server);
+        }
+
+        if (fds[1].revents) {
+            serve_stub_dns_tcp(server);
+        }
+
+    }
+
+    return NULL;
+}
+
+static void start_stub_dns_server(stub_dns_server_t *server) {
+
+    socklen_t alen = sizeof(server->addr);
+    int one = 1;
+
+    memset(server, 0, sizeof(stub_dns_server_t));
+    server->addr.sin_family = AF_INET;
+    server->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    ASSERT_GE((server->udp_fd = socket(AF_INET, SOCK_DGRAM, 0)), 0);
+    ASSERT_EQ(0, bind(server->udp_fd, (struct sockaddr *)&(server->addr), sizeof(server->addr)));
+    ASSERT_EQ(0, getsockname(server->udp_fd, (struct sockaddr *)&(server->addr), &alen));
+
+    ASSERT_GE((server->tcp_fd = socket(AF_INET, SOCK_STREAM, 0)), 0);
+    setsockopt(server->tcp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    ASSERT_EQ(0, bind(server->tcp_fd, (struct sockaddr *)&(server->addr), sizeof(server->addr)));
+    ASSERT_EQ(0, listen(server->tcp_fd, 16));
+
+    ASSERT_EQ(0, pthread_create(&(server->thread), NULL, run_stub_dns_server, server));
+}
+
+static void stop_stub_dns_server(stub_dns_server_t *server) {
+
+    __atomic_store_n(&(server->stop), 1, __ATOMIC_RELAXED);
+    pthread_join(server->thread, NULL);
+    close(server->udp_fd);
+    close(server->tcp_fd);
+}
+
+static dns_resolver_t *create_stub_dns_resolver(stub_dns_server_t *server, unsigned int timeout) {
+
+    dns_resolver_t *result;
+
+    if (!(result = create_dns_resolver())) {
+        return NULL;
+    }
+
+    if (set_dns_resolver_server(result, (struct sockaddr *)&(server->addr), sizeof(server->addr)) < 0) {
+        destroy_dns_resolver(result);
+        return NULL;
+    }
+
+    result->timeout = timeout;
+
+    return result;
+}
+
+/*
+ * The synchronous lookups take their nameservers from the system resolver, which can't be pointed at the stub nameserver
+ * from here. So res_init() is interposed, and while stub_res_nameserver is set, it replaces them with the stub nameserver.
+ */
+static struct sockaddr_in *stub_res_nameserver = NULL;
+
+extern "C" int res_init(void) __THROW {
+
+    static int (*system_res_init)(void) = NULL;
+    int result;
+
+    if (!system_res_init) {
+        system_res_init = (int (*)(void))dlsym(RTLD_NEXT, "__res_init");
+    }
+
+    if (((result = system_res_init()) < 0) || !stub_res_nameserver) {
+        return result;
+    }
+
+    memcpy(&(_res.nsaddr_list[0]), stub_res_nameserver, sizeof(struct sockaddr_in));
+    _res.nscount = 1;
+
+    return result;
+}
+
+/*
+ * Load the stub root key as the trust anchor, from a file in the same format as the root anchor in the DIME directory.
+ */
+static void load_stub_root_anchor(void) {
+
+    const stub_zone_key_t *root = get_stub_zone_key("");
+    char path[] = "/tmp/check_dns_anchor.XXXXXX", *b64;
+    FILE *fp;
+    int fd, status;
+
+    ASSERT_TRUE((b64 = _b64encode(root->rdata + 4, root->rdlen - 4)) != NULL);
+    ASSERT_GE((fd = mkstemp(path)), 0);
+    ASSERT_TRUE((fp = fdopen(fd, "w")) != NULL);
+    fprintf(fp, ". initial-key %u %u %u \"%s\";\n", DNSKEY_RR_FLAG_ZK | DNSKEY_RR_FLAG_SEP, DNSKEY_RR_PROTO, NS_ALG_RSASHA256, b64);
+    fclose(fp);
+    free(b64);
+
+    status = _load_dnskey_file(path);
+    unlink(path);
+    ASSERT_EQ(0, status) << "Could not load the stub root anchor.";
+}
+
+typedef struct {
+    char name[64];
+    int status;
+    int completed;
+    size_t alen;
+    size_t ntxt;
+    size_t txtlen;
+    char txt[64];
+} txt_query_t;
+
+static void record_txt_answer(int status, const unsigned char *answer, size_t alen, void *arg) {
+
+    txt_query_t *query = (txt_query_t *)arg;
+    ns_msg handle;
+    ns_rr rr;
+
+    query->status = status;
+    query->completed++;
+    query->alen = alen;
+
+    if (status || (ns_initparse(answer, alen, &handle) < 0)) {
+        return;
+    }
+
+    for (size_t i = 0; i < ns_msg_count(handle, ns_s_an); i++) {
+
+        if ((ns_parserr(&handle, ns_s_an, i, &rr) < 0) || (ns_rr_type(rr) != ns_t_txt)) {
+            continue;
+        }
+
+        if (!query->ntxt++) {
+            snprintf(query->txt, sizeof(query->txt), "%.*s", (int)ns_rr_rdata(rr)[0], (const char *)ns_rr_rdata(rr) + 1);
+        }
+
+        query->txtlen += ns_rr_rdata(rr)[0];
+    }
+
+}
+
+static void submit_txt_query(dns_resolver_t *resolver, txt_query_t *query, const char *name) {
+
+    memset(query, 0, sizeof(txt_query_t));
+    snprintf(query->name, sizeof(query->name), "%s", name);
+    ASSERT_EQ(0, submit_dns_query(resolver, query->name, ns_t_txt, record_txt_answer, query)) << "Could not submit DNS query for " << name;
+}
+
+
+TEST(DIME, check_dns_resolver_concurrent_queries)
+{
+    stub_dns_server_t server;
+    dns_resolver_t *resolver;
+    txt_query_t *queries;
+    char name[64];
+
+    start_stub_dns_server(&server);
+    ASSERT_TRUE((resolver = create_stub_dns_resolver(&server, 2000)) != NULL);
+    ASSERT_TRUE((queries = (txt_query_t *)malloc(N_CONCURRENT_TEST_QUERIES * sizeof(txt_query_t))) != NULL);
+
+    // Every query is outstanding at once, and the answers must find their way back to the right callbacks.
+    for (size_t i = 0; i < N_CONCURRENT_TEST_QUERIES; i++) {
+        snprintf(name, sizeof(name), "n%zu.example.test", i);
+        submit_txt_query(resolver, &(queries[i]), name);
+    }
+
+    ASSERT_EQ((size_t)N_CONCURRENT_TEST_QUERIES, resolver->pending);
+    ASSERT_EQ(0, run_dns_resolver(resolver));
+    ASSERT_EQ(0U, resolver->pending);
+    ASSERT_EQ((unsigned int)N_CONCURRENT_TEST_QUERIES, __atomic_load_n(&(server.udp_queries), __ATOMIC_RELAXED));
+
+    for (size_t i = 0; i < N_CONCURRENT_TEST_QUERIES; i++) {
+        ASSERT_EQ(1, queries[i].completed) << "Query completed more or less than once: " << queries[i].name;
+        ASSERT_EQ(0, queries[i].status) << "Query failed: " << queries[i].name;
+        ASSERT_STREQ(queries[i].name, queries[i].txt) << "Query received the wrong answer.";
+    }
+
+    free(queries);
+    destroy_dns_resolver(resolver);
+    stop_stub_dns_server(&server);
+}
+
+TEST(DIME, check_dns_resolver_tcp_fallback)
+{
+    stub_dns_server_t server;
+    dns_resolver_t *resolver;
+    txt_query_t query, small;
+
+    start_stub_dns_server(&server);
+    ASSERT_TRUE((resolver = create_stub_dns_resolver(&server, 2000)) != NULL);
+
+    submit_txt_query(resolver, &query, "big.example.test");
+    submit_txt_query(resolver, &small, "small.example.test");
+    ASSERT_EQ(0, run_dns_resolver(resolver));
+
+    // The truncated answer is retried over TCP, where it can be larger than any UDP answer.
+    ASSERT_EQ(1, query.completed);
+    ASSERT_EQ(0, query.status);
+    ASSERT_GT(query.alen, (size_t)DNS_EDNS_UDP_SIZE);
+    ASSERT_EQ((size_t)N_LARGE_TXT_STRINGS * 2, query.ntxt);
+    ASSERT_EQ(1U, __atomic_load_n(&(server.tcp_queries), __ATOMIC_RELAXED));
+
+    ASSERT_EQ(1, small.completed);
+    ASSERT_STREQ("small.example.test", small.txt);
+
+    destroy_dns_resolver(resolver);
+    stop_stub_dns_server(&server);
+}
+
+TEST(DIME, check_dns_resolver_timeouts)
+{
+    stub_dns_server_t server;
+    dns_resolver_t *resolver;
+    txt_query_t dropped, retried, spoofed;
+
+    start_stub_dns_server(&server);
+    ASSERT_TRUE((resolver = create_stub_dns_resolver(&server, 200)) != NULL);
+    resolver->retries = 2;
+
+    submit_txt_query(resolver, &dropped, "drop.example.test");
+    submit_txt_query(resolver, &retried, "drop-once.example.test");
+    submit_txt_query(resolver, &spoofed, "spoof.example.test");
+    ASSERT_EQ(0, run_dns_resolver(resolver));
+
+    // A query that is never answered fails once every attempt has timed out.
+    ASSERT_EQ(1, dropped.completed);
+    ASSERT_EQ(-1, dropped.status);
+
+    // A lost datagram is retransmitted.
+    ASSERT_EQ(1, retried.completed);
+    ASSERT_EQ(0, retried.status);
+    ASSERT_STREQ("drop-once.example.test", retried.txt);
+    ASSERT_EQ(2U, __atomic_load_n(&(server.drop_once_seen), __ATOMIC_RELAXED));
+    ASSERT_NE(server.drop_once_ports[0], server.drop_once_ports[1]) << "Retransmitted DNS query reused the source port of the first attempt.";
+
+    // An answer to a different question is ignored in favor of the real one.
+    ASSERT_EQ(1, spoofed.completed);
+    ASSERT_EQ(0, spoofed.status);
+    ASSERT_STREQ("spoof.example.test", spoofed.txt);
+
+    // Outstanding queries are failed when the resolver is destroyed.
+    submit_txt_query(resolver, &dropped, "drop.example.test");
+    destroy_dns_resolver(resolver);
+    ASSERT_EQ(1, dropped.completed);
+    ASSERT_EQ(-1, dropped.status);
+
+    stop_stub_dns_server(&server);
+}
+
+static void record_mx_records(const char *qstring, mx_record_t **mxs, void *arg) {
+
+    mx_record_t ***result = (mx_record_t ***)arg;
+
+    (void)qstring;
+    *result = mxs;
+}
+
+TEST(DIME, check_dns_async_mx_records)
+{
+    stub_dns_server_t server;
+    dns_resolver_t *resolver;
+    mx_record_t **mxs = NULL;
+
+    start_stub_dns_server(&server);
+    ASSERT_TRUE((resolver = create_stub_dns_resolver(&server, 2000)) != NULL);
+
+    ASSERT_EQ(0, _get_mx_records_async(resolver, "example.test", record_mx_records, &mxs));
+    ASSERT_EQ(0, run_dns_resolver(resolver));
+    ASSERT_TRUE(mxs != NULL) << "Asynchronous MX lookup failed.";
+
+    // The exchanges come back sorted by preference, just like from _get_mx_records().
+    ASSERT_TRUE(mxs[0] && mxs[1] && mxs[2] && !mxs[3]);
+    ASSERT_EQ(10, mxs[0]->pref);
+    ASSERT_STREQ("mx1.example.test", mxs[0]->name);
+    ASSERT_EQ(20, mxs[1]->pref);
+    ASSERT_STREQ("mx2.example.test", mxs[1]->name);
+    ASSERT_EQ(30, mxs[2]->pref);
+    ASSERT_STREQ("mx3.example.test", mxs[2]->name);
+
+    _free_mx_records(mxs);
+    destroy_dns_resolver(resolver);
+    stop_stub_dns_server(&server);
+}
+
+static void record_prefetch_status(const char *label, int status, void *arg) {
+
+    int *result = (int *)arg;
+
+    (void)label;
+    *result = status;
+}
+
+static dnskey_t *get_cached_stub_dnskey(const char *zone) {
+
+    return _get_dnskey_by_tag(get_stub_zone_key(zone)->keytag, *zone ? zone : ".", 0);
+}
+
+TEST(DIME, check_dns_prefetch_dnssec_chain)
+{
+    const char *zones[] = { "_dx.a.b.slow.example.test", "a.b.slow.example.test", "b.slow.example.test", "slow.example.test", "example.test", "test" };
+    stub_dns_server_t server;
+    dns_resolver_t *resolver;
+    dnskey_t *dnskey;
+    uint64_t start, elapsed;
+    int status = 1;
+
+    start_stub_dns_server(&server);
+    load_stub_root_anchor();
+    ASSERT_TRUE((resolver = create_stub_dns_resolver(&server, 2000)) != NULL);
+
+    // The chain has six zones, each of which takes a DNSKEY and a DS query with a delayed answer.
+    start = stub_dns_clock();
+    ASSERT_EQ(0, _prefetch_dnssec_chain_async(resolver, "_dx.a.b.slow.example.test.", record_prefetch_status, &status));
+    ASSERT_EQ(12U, resolver->pending);
+    ASSERT_EQ(0, run_dns_resolver(resolver));
+    elapsed = stub_dns_clock() - start;
+
+    ASSERT_EQ(0, status) << "DNSSEC chain prefetch failed.";
+    ASSERT_EQ(6U, __atomic_load_n(&(server.dnskey_queries), __ATOMIC_RELAXED));
+    ASSERT_EQ(6U, __atomic_load_n(&(server.ds_queries), __ATOMIC_RELAXED));
+
+    // Fetching the chain one zone at a time would take twelve delays; concurrently, it should take about one.
+    ASSERT_GE(elapsed, (uint64_t)STUB_DNS_DELAY_MS);
+    ASSERT_LT(elapsed, (uint64_t)STUB_DNS_DELAY_MS * 4) << "DNSSEC chain queries were not issued concurrently.";
+
+    // Every zone's DNSKEY is cached and signed by itself, and its DS record is cached and signed by the zone above.
+    for (size_t i = 0; i < sizeof(zones) / sizeof(zones[0]); i++) {
+        ASSERT_TRUE((dnskey = get_cached_stub_dnskey(zones[i])) != NULL) << "DNSKEY was not cached: " << zones[i];
+        ASSERT_TRUE(dnskey->signkeys && (dnskey->signkeys[0] == dnskey)) << "RRSIG over DNSKEY was not validated: " << zones[i];
+        ASSERT_TRUE(dnskey->dse && _get_ds_by_dnskey(dnskey)) << "DS record was not cached and linked to its DNSKEY: " << zones[i];
+        ASSERT_TRUE(dnskey->dse[0]->signkeys && (dnskey->dse[0]->signkeys[0] == get_cached_stub_dnskey(get_stub_parent_zone(zones[i]))))
+            << "RRSIG over DS record was not validated: " << zones[i];
+    }
+
+    ASSERT_EQ(1, _is_validated_key(get_cached_stub_dnskey(zones[0]))) << "Chain of trust did not lead up to the root anchor.";
+
+    // A name in a new zone under slow.example.test only takes queries for the two zones that aren't cached yet.
+    ASSERT_EQ(0, _prefetch_dnssec_chain_async(resolver, "_dx.c.slow.example.test", record_prefetch_status, &status));
+    ASSERT_EQ(4U, resolver->pending);
+    ASSERT_EQ(0, run_dns_resolver(resolver));
+    ASSERT_EQ(0, status) << "DNSSEC chain prefetch failed.";
+    ASSERT_EQ(8U, __atomic_load_n(&(server.dnskey_queries), __ATOMIC_RELAXED));
+    ASSERT_EQ(8U, __atomic_load_n(&(server.ds_queries), __ATOMIC_RELAXED));
+    ASSERT_EQ(1, _is_validated_key(get_cached_stub_dnskey("_dx.c.slow.example.test"))) << "Chain of trust did not lead up to the root anchor.";
+
+    // Once the whole chain is cached, there is nothing left to prefetch.
+    status = 1;
+    ASSERT_EQ(1, _prefetch_dnssec_chain_async(resolver, zones[0], record_prefetch_status, &status));
+    ASSERT_EQ(0U, resolver->pending);
+    ASSERT_EQ(1, status) << "Prefetch callback was invoked for a cached chain.";
+    ASSERT_EQ(8U, __atomic_load_n(&(server.dnskey_queries), __ATOMIC_RELAXED));
+    ASSERT_EQ(8U, __atomic_load_n(&(server.ds_queries), __ATOMIC_RELAXED));
+
+    // Records signed with the wrong key are still cached, but don't become part of the chain of trust.
+    ASSERT_EQ(0, _prefetch_dnssec_chain_async(resolver, "_dx.forged.slow.example.test", record_prefetch_status, &status));
+    ASSERT_EQ(0, run_dns_resolver(resolver));
+    ASSERT_EQ(0, status) << "DNSSEC chain prefetch failed.";
+    ASSERT_TRUE((dnskey = get_cached_stub_dnskey("forged.slow.example.test")) != NULL) << "DNSKEY was not cached: forged.slow.example.test";
+    ASSERT_TRUE(!dnskey->signkeys) << "RRSIG made with the wrong key was accepted.";
+    ASSERT_EQ(0, _is_validated_key(get_cached_stub_dnskey("_dx.forged.slow.example.test"))) << "Forged chain of trust was validated.";
+
+    destroy_dns_resolver(resolver);
+    stop_stub_dns_server(&server);
+}
+
+TEST(DIME, check_dns_txt_record_prefetched)
+{
+    stub_dns_server_t server;
+    unsigned long ttl = 0;
+    uint64_t start, elapsed;
+    char *txt;
+    int validated = 0;
+
+    start_stub_dns_server(&server);
+    load_stub_root_anchor();
+    stub_res_nameserver = &(server.addr);
+    _set_dnssec_prefetch(1);
+
+    // The DNSKEY and DS queries of the five zones above the name go out along with the TXT query, and its RRSIG is only
+    // validated once their answers have been cached, so that it takes no further lookups.
+    start = stub_dns_clock();
+    txt = _get_txt_record("_dx.mail.slow.example.net", &ttl, &validated);
+    elapsed = stub_dns_clock() - start;
+
+    _set_dnssec_prefetch(0);
+    stub_res_nameserver = NULL;
+
+    ASSERT_TRUE(txt != NULL) << "TXT lookup with DNSSEC prefetch failed.";
+    ASSERT_STREQ("_dx.mail.slow.example.net", txt);
+    ASSERT_EQ(300UL, ttl);
+    ASSERT_EQ(1, validated) << "TXT record was not validated against the prefetched chain of trust.";
+    ASSERT_EQ(5U, __atomic_load_n(&(server.dnskey_queries), __ATOMIC_RELAXED));
+    ASSERT_EQ(5U, __atomic_load_n(&(server.ds_queries), __ATOMIC_RELAXED));
+    ASSERT_EQ(11U, __atomic_load_n(&(server.udp_queries), __ATOMIC_RELAXED));
+    ASSERT_LT(elapsed, (uint64_t)STUB_DNS_DELAY_MS * 4) << "DNSSEC chain was not prefetched alongside the TXT query.";
+
+    free(txt);
+    stop_stub_dns_server(&server);
+}
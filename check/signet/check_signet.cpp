@@ -769,3 +769,132 @@ TEST(DIME, check_signet_signature_verification)
     res = dime_sgnt_msg_sig_verify(org_signet, signature, (const unsigned char *)fp, strlen(fp));
     ASSERT_EQ(1, res) << "Failed to verify signature using signet.";
 }
+
+TEST(DIME, check_signet_validate_many)
+{
+    const char *org_keys = ".out/check_org.keys", *user_keys = ".out/check_user.keys", *newuser_keys = ".out/check_newuser.keys";
+    ED25519_KEY *orgkey, *userkey, *newuserkey;
+    int res;
+    signet_state_t states[20];
+    signet_t *org_signet, *ssr, *crypto, *full, *user_signet, *newuser_signet, *forged;
+    const signet_t *signets[20], *previous[20], *orgsigs[20];
+    const unsigned char **dime_poks[20];
+    unsigned char *pok[2];
+
+    _crypto_init();
+
+    org_signet = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_ORG, org_keys);
+    ASSERT_TRUE(org_signet != NULL) << "Failure to create signet with keys file.";
+
+    orgkey = dime_keys_signkey_fetch(org_keys);
+    ASSERT_TRUE(orgkey != NULL) << "Failure to fetch private signing key from keys file.";
+
+    pok[0] = orgkey->public_key;
+    pok[1] = NULL;
+
+    dime_sgnt_sig_crypto_sign(org_signet, orgkey);
+    dime_sgnt_sig_full_sign(org_signet, orgkey);
+    dime_sgnt_id_set(org_signet, strlen("test_org_signet"), (const unsigned char *)"test_org_signet");
+    res = dime_sgnt_sig_id_sign(org_signet, orgkey);
+    ASSERT_EQ(0, res) << "Failure to create organizational identifiable signet signature field.";
+//build a user signet at every stage of its signing
+    user_signet = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_SSR, user_keys);
+    ASSERT_TRUE(user_signet != NULL) << "Failure to create ssr with keys file.";
+
+    userkey = dime_keys_signkey_fetch(user_keys);
+    ASSERT_TRUE(userkey != NULL) << "Failure to fetch user's private signing key from keys file.";
+
+    dime_sgnt_sig_ssr_sign(user_signet, userkey);
+    ssr = dime_sgnt_signet_dupe(user_signet);
+    dime_sgnt_sig_crypto_sign(user_signet, orgkey);
+    crypto = dime_sgnt_signet_dupe(user_signet);
+    dime_sgnt_sig_full_sign(user_signet, orgkey);
+    full = dime_sgnt_signet_dupe(user_signet);
+    dime_sgnt_id_set(user_signet, strlen("user@test.org"), (const unsigned char *)"user@test.org");
+    res = dime_sgnt_sig_id_sign(user_signet, orgkey);
+    ASSERT_EQ(0, res) << "Failure to sign user signet with the identifiable signet signature.";
+    ASSERT_TRUE(ssr != NULL && crypto != NULL && full != NULL) << "Failure to duplicate user signet.";
+//a signet with a chain of custody signature, and one that was signed by the wrong key
+    newuser_signet = dime_sgnt_signet_create_w_keys(SIGNET_TYPE_SSR, newuser_keys);
+    ASSERT_TRUE(newuser_signet != NULL) << "Failure to create ssr with keys file.";
+    dime_sgnt_sig_coc_sign(newuser_signet, userkey);
+
+    newuserkey = dime_keys_signkey_fetch(newuser_keys);
+    ASSERT_TRUE(newuserkey != NULL) << "Failure to retrieve user's new private signing key.";
+
+    dime_sgnt_sig_ssr_sign(newuser_signet, newuserkey);
+    forged = dime_sgnt_signet_dupe(newuser_signet);
+    dime_sgnt_sig_crypto_sign(newuser_signet, orgkey);
+    dime_sgnt_sig_full_sign(newuser_signet, orgkey);
+    dime_sgnt_id_set(newuser_signet, strlen("user@test.com"), (const unsigned char *)"user@test.com");
+    dime_sgnt_sig_id_sign(newuser_signet, orgkey);
+
+    ASSERT_TRUE(forged != NULL) << "Failure to duplicate user signet.";
+    dime_sgnt_sig_crypto_sign(forged, userkey);
+//more signets than fit in one batch, with each kind of signet in every position
+    for(size_t i = 0; i < 20; i++) {
+        previous[i] = NULL;
+        orgsigs[i] = org_signet;
+        dime_poks[i] = NULL;
+
+        switch(i % 7) {
+
+        case 0:
+            signets[i] = org_signet;
+            orgsigs[i] = NULL;
+            dime_poks[i] = (i % 2) ? NULL : (const unsigned char **)pok;
+            break;
+        case 1:
+            signets[i] = ssr;
+            break;
+        case 2:
+            signets[i] = crypto;
+            break;
+        case 3:
+            signets[i] = full;
+            break;
+        case 4:
+            signets[i] = user_signet;
+            break;
+        case 5:
+            signets[i] = newuser_signet;
+            previous[i] = (i % 2) ? user_signet : NULL;
+            break;
+        default:
+            signets[i] = forged;
+            break;
+
+        }
+
+    }
+
+    res = dime_sgnt_validate_many(signets, previous, orgsigs, dime_poks, 20, states);
+    ASSERT_EQ(0, res) << "Failure to validate many signets.";
+
+    for(size_t i = 0; i < 20; i++) {
+        ASSERT_EQ(dime_sgnt_validate_all(signets[i], previous[i], orgsigs[i], dime_poks[i]), states[i]) << "Signet #" << i << " was validated differently.";
+    }
+
+    ASSERT_EQ(SS_ID, states[0]) << "Failure to validate organizational identifiable signet.";
+    ASSERT_EQ(SS_SSR, states[1]) << "Failure to validate ssr.";
+    ASSERT_EQ(SS_CRYPTO, states[2]) << "Failure to validate user cryptographic signet.";
+    ASSERT_EQ(SS_FULL, states[3]) << "Failure to validate user full signet.";
+    ASSERT_EQ(SS_ID, states[4]) << "Failure to validate user identifiable signet.";
+    ASSERT_EQ(SS_ID, states[5]) << "Failure to validate an identifiable signet with a chain of custody signature.";
+    ASSERT_EQ(SS_INVALID, states[6]) << "Failure to invalidate signet signed by the wrong key.";
+    ASSERT_EQ(SS_BROKEN_COC, states[12]) << "Failure to invalidate signet with no parent signet to validate its chain of custody.";
+
+    res = dime_sgnt_validate_many(signets, NULL, NULL, NULL, 0, states);
+    ASSERT_EQ(-1, res) << "Validated an empty list of signets.";
+
+    _free_ed25519_key(orgkey);
+    _free_ed25519_key(userkey);
+    _free_ed25519_key(newuserkey);
+    dime_sgnt_signet_destroy(forged);
+    dime_sgnt_signet_destroy(newuser_signet);
+    dime_sgnt_signet_destroy(user_signet);
+    dime_sgnt_signet_destroy(full);
+    dime_sgnt_signet_destroy(crypto);
+    dime_sgnt_signet_destroy(ssr);
+    dime_sgnt_signet_destroy(org_signet);
+}
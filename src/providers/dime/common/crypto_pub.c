@@ -69,6 +69,10 @@ int ed25519_verify_sig(const unsigned char *data, size_t dlen, ED25519_KEY *key,
     PUBLIC_FUNC_IMPL(ed25519_verify_sig, data, dlen, key, sigbuf);
 }
 
+int ed25519_verify_sig_batch(const unsigned char **data, size_t *dlens, ED25519_KEY **keys, const unsigned char **sigs, size_t num, int *valid) {
+    PUBLIC_FUNC_IMPL(ed25519_verify_sig_batch, data, dlens, keys, sigs, num, valid);
+}
+
 void free_ed25519_key(ED25519_KEY *key) {
     PUBLIC_FUNC_IMPL_VOID(free_ed25519_key, key);
 }
@@ -2,6 +2,8 @@
 #include <sys/socket.h>
 
 #include <errno.h>
+#include <poll.h>
+#include <time.h>
 
 #include "dime/common/network.h"
 #include "dime/common/misc.h"
@@ -9,6 +11,26 @@
 //the timeout value for connection attempts, in seconds
 #define CONNECT_TIMEOUT 5
 
+//the head start each connection attempt gets before the next one is started alongside it, in milliseconds (RFC 8305)
+#define CONNECT_ATTEMPT_DELAY 250
+
+/**
+ * @brief
+ *  Get the current value of the monotonic clock in milliseconds, for
+ *  connection attempt deadlines.
+ * @return
+ *  the number of milliseconds elapsed since an arbitrary point in time.
+ */
+static uint64_t
+_connect_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
 /**
  * @brief
  *  Connect to a host/tcp port in an address-independent manner, and return a
@@ -31,6 +53,7 @@ _connect_host(
     int force_family)
 {
     struct addrinfo hints, *address;
+    struct addrinfo const *connected = NULL;
     char pstr[16];
     int result, fd = -1;
 
@@ -52,47 +75,244 @@ _connect_host(
             gai_strerror(result));
     }
 
-    for (struct addrinfo *aptr = address; aptr; aptr = aptr->ai_next) {
+    address = _interleave_addresses(address);
+    fd = _connect_addresses(address, force_family, &connected);
 
-        // Shouldn't happen, but paranoia never hurt anybody.
-        if (force_family && (aptr->ai_family != force_family)) {
-            continue;
+    if (fd >= 0) {
+        _dbgprint(
+            3,
+            "Established TCP connection (%s) to %s:%s.\n",
+            (connected->ai_family == AF_INET ? "IPV4" : "IPV6"),
+            hostname,
+            pstr);
+    }
+
+    freeaddrinfo(address);
+
+    if (fd < 0) {
+        RET_ERROR_INT(ERR_UNSPEC, NULL);
+    }
+
+    return fd;
+}
+
+/**
+ * @brief
+ *  Reorder a list of resolved addresses so that their address families
+ *  alternate, as recommended by RFC 8305.
+ * @note
+ *  The list starts with the family of its first (most preferred) address,
+ *  and addresses of the same family keep their relative order. This way a
+ *  host with a broken IPv6 (or IPv4) route still gets an early attempt over
+ *  the other family.
+ * @param address
+ *  the head of the linked list of addresses to be reordered.
+ * @return
+ *  the new head of the reordered list.
+ */
+struct addrinfo *
+_interleave_addresses(struct addrinfo *address)
+{
+    struct addrinfo *first = NULL, *other = NULL, **fnext = &first, **onext = &other;
+    struct addrinfo *result = NULL, **rnext = &result;
+
+    if (!address) {
+        return NULL;
+    }
+
+    // Split the list in two: the addresses of the preferred family, and everything else.
+    for (struct addrinfo *aptr = address, *next; aptr; aptr = next) {
+        next = aptr->ai_next;
+        aptr->ai_next = NULL;
+
+        if (aptr->ai_family == address->ai_family) {
+            *fnext = aptr;
+            fnext = &(aptr->ai_next);
+        } else {
+            *onext = aptr;
+            onext = &(aptr->ai_next);
+        }
+
+    }
+
+    // Then take one from each in turn.
+    while (first || other) {
+
+        if (first) {
+            *rnext = first;
+            rnext = &(first->ai_next);
+            first = first->ai_next;
+        }
+
+        if (other) {
+            *rnext = other;
+            rnext = &(other->ai_next);
+            other = other->ai_next;
         }
 
-        if ((fd = socket(
-                aptr->ai_family,
-                aptr->ai_socktype,
-                aptr->ai_protocol))
-            < 0)
-        {
+    }
+
+    *rnext = NULL;
+
+    return result;
+}
+
+/**
+ * @brief
+ *  Connect to the first responsive address in a list, by racing staggered
+ *  connection attempts against each other (RFC 8305 "happy eyeballs").
+ * @note
+ *  The attempts are started in list order. Each one gets a head start of
+ *  CONNECT_ATTEMPT_DELAY milliseconds, or until it fails, before the next
+ *  one is started alongside it. The first connection to be established
+ *  wins and all others are abandoned. Attempts time out CONNECT_TIMEOUT
+ *  seconds after the last one was started, so an unresponsive address only
+ *  delays the others by the head start it was given.
+ * @param address
+ *  the head of the linked list of addresses to be connected to.
+ * @param force_family
+ *  an optional address family to restrict the attempts to (AF_INET or
+ *  AF_INET6), or 0 to ignore.
+ * @param connected
+ *  an optional pointer to a variable that will receive the address that
+ *  the connection was established to.
+ * @return
+ *  -1 on general failure or the file descriptor of the (blocking) socket
+ *  connection on success.
+ */
+int
+_connect_addresses(
+    struct addrinfo const *address,
+    int force_family,
+    struct addrinfo const **connected)
+{
+    struct pollfd *pfds;
+    struct addrinfo const **pending = NULL;
+    struct addrinfo const *next = address, *aptr, *winner = NULL;
+    uint64_t now, next_start = 0, deadline = 0;
+    size_t count = 0, npending = 0;
+    socklen_t slen;
+    int fd, serr, oflags, wait, failed = 0, result = -1;
+
+    if (!address) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    for (struct addrinfo const *aptr = address; aptr; aptr = aptr->ai_next) {
+        count++;
+    }
+
+    if (!(pfds = malloc(count * sizeof(struct pollfd))) || !(pending = malloc(count * sizeof(struct addrinfo *)))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        free(pfds);
+        RET_ERROR_INT(ERR_NOMEM, "unable to allocate space for connection attempts");
+    }
+
+    while ((result < 0) && (next || npending)) {
+        now = _connect_clock();
+
+        // Start the next attempt once the last one has had its head start, or right away if one has failed in the meantime.
+        if (next && (!npending || failed || (now >= next_start))) {
+            aptr = next;
+            next = next->ai_next;
+
+            // Shouldn't happen, but paranoia never hurt anybody.
+            if (force_family && (aptr->ai_family != force_family)) {
+                continue;
+            }
+
+            if ((fd = socket(
+                    aptr->ai_family,
+                    aptr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    aptr->ai_protocol))
+                < 0)
+            {
+                failed = 1;
+                continue;
+            } else if (!connect(fd, aptr->ai_addr, aptr->ai_addrlen)) {
+                result = fd;
+                winner = aptr;
+                break;
+            } else if (errno != EINPROGRESS) {
+                close(fd);
+                failed = 1;
+                continue;
+            }
+
+            pfds[npending].fd = fd;
+            pfds[npending].events = POLLOUT;
+            pfds[npending].revents = 0;
+            pending[npending++] = aptr;
+            failed = 0;
+            next_start = now + CONNECT_ATTEMPT_DELAY;
+            deadline = now + (CONNECT_TIMEOUT * 1000);
             continue;
-        } else if (
-            _connect_timeout(
-                fd,
-                aptr->ai_addr,
-                aptr->ai_addrlen)
-            > 0)
-        {
-            _dbgprint(
-                3,
-                "Established TCP connection (%s) to %s:%s.\n",
-                (aptr->ai_family == AF_INET ? "IPV4" : "IPV6"),
-                hostname,
-                pstr);
+        } else if (now >= deadline) {
+            break;
+        }
+
+        wait = (int)(deadline - now);
+
+        if (next && ((next_start - now) < (uint64_t)wait)) {
+            wait = (int)(next_start - now);
+        }
+
+        if (poll(pfds, npending, wait) < 0) {
+
+            if (errno == EINTR) {
+                continue;
+            }
+
+            PUSH_ERROR_SYSCALL("poll");
             break;
         }
 
-        close(fd);
-        fd = -1;
+        // An attempt that has finished is removed from the set by moving the last one into its place.
+        for (size_t i = npending; i-- > 0;) {
+
+            if (!pfds[i].revents) {
+                continue;
+            }
+
+            slen = sizeof(serr);
+
+            if ((result < 0) && !getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &serr, &slen) && !serr) {
+                result = pfds[i].fd;
+                winner = pending[i];
+            } else {
+                close(pfds[i].fd);
+                failed = 1;
+            }
+
+            pfds[i] = pfds[--npending];
+            pending[i] = pending[npending];
+        }
+
     }
 
-    freeaddrinfo(address);
+    for (size_t i = 0; i < npending; i++) {
+        close(pfds[i].fd);
+    }
 
-    if (fd < 0) {
-        RET_ERROR_INT(ERR_UNSPEC, NULL);
+    free(pfds);
+    free(pending);
+
+    if (result < 0) {
+        RET_ERROR_INT(ERR_UNSPEC, "unable to establish connection to host");
     }
 
-    return fd;
+    // The winning connection is handed back in blocking mode, like any other socket.
+    if (((oflags = fcntl(result, F_GETFL, NULL)) < 0) || (fcntl(result, F_SETFL, oflags & ~O_NONBLOCK) < 0)) {
+        PUSH_ERROR_SYSCALL("fcntl");
+        close(result);
+        RET_ERROR_INT(ERR_UNSPEC, "unable to set blocking mode on socket");
+    }
+
+    if (connected) {
+        *connected = winner;
+    }
+
+    return result;
 }
 
 /**
@@ -17,5 +17,7 @@ PUBLIC_FUNC_DECL(int, connect_host, const char *hostname, unsigned short port, i
 
 // Private functions.
 int _connect_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen);
+int _connect_addresses(const struct addrinfo *address, int force_family, const struct addrinfo **connected);
+struct addrinfo *_interleave_addresses(struct addrinfo *address);
 
 #endif
@@ -1,11 +1,16 @@
 #ifndef DIME_DMSG_CRYPTO_H
 #define DIME_DMSG_CRYPTO_H
 
+#include <sys/uio.h>
+
 #include "dime/signet/signet.h"
 #include "dime/dmessage/common.h"
 
 #define TRACING_LENGTH_SIZE 2
 
+// The most threads that the chunks of a message are signed and encrypted on.
+#define DMIME_ENCRYPT_MAX_WORKERS 16
+
 // Actor type, used to encrypt and retrieve the correct keyslot, kek, maybe
 // more
 typedef enum {
@@ -178,6 +183,14 @@ dime_dmsg_message_binary_serialize(
     unsigned char tracing,
     size_t *outsize);
 
+struct iovec *
+dime_dmsg_message_binary_iovec(
+    dmime_message_t const *msg,
+    unsigned char sections,
+    unsigned char tracing,
+    size_t *iovcnt,
+    size_t *outsize);
+
 int
 dime_dmsg_message_decrypt_as_auth(
     dmime_object_t *obj,
@@ -209,6 +222,12 @@ dime_dmsg_message_encrypt(
     dmime_object_t *object,
     ED25519_KEY *signkey);
 
+dmime_message_t *
+dime_dmsg_message_encrypt_parallel(
+    dmime_object_t *object,
+    ED25519_KEY *signkey,
+    unsigned int nworkers);
+
 dmime_object_t *
 dime_dmsg_message_envelope_decrypt(
     dmime_message_t const *msg,
@@ -1,3 +1,5 @@
+#include <pthread.h>
+
 #include "dime/common/misc.h"
 #include "dime/dmessage/parse.h"
 #include "dime/dmessage/crypto.h"
@@ -30,6 +32,47 @@ typedef struct __attribute__((packed)) {
     unsigned char aes_key[AES_256_KEY_SIZE];
 } dmime_keyslot_t;
 
+// display and attachment chunks that are signed or encrypted by a group of
+// worker threads. each worker claims the next unprocessed chunk until there
+// are none left.
+typedef struct {
+    dmime_message_chunk_t **chunks;
+    size_t nchunks;
+    size_t next;                            // Index of the next chunk to be claimed.
+    ED25519_KEY *signkey;                   // If set, the chunks are signed.
+    dmime_kekset_t *keks;                   // If set, the chunks are encrypted.
+    int failed;
+    errinfo_t error;                        // The last error of the first chunk that failed.
+} dmsg_chunk_batch_t;
+
+// the most signatures that are held back to be verified together, and the most
+// signed data that they may keep in memory while they wait.
+#define DMSG_SIG_BATCH_MAX 64
+#define DMSG_SIG_BATCH_MAX_SIZE (4 * 1024 * 1024)
+
+// a signature collected while a message is decrypted, along with the data it
+// was taken over and whatever has to be released once it has been verified.
+typedef struct {
+    unsigned char const *data;
+    size_t data_size;
+    ed25519_signature sig;
+    ED25519_KEY *key;                       // Owned by the batch key cache.
+    signet_t const *signet;                 // If set, a signature that fails is retried with every message signing key of the signet.
+    char const *name;                       // Names the signature in errors.
+    dmime_message_chunk_t *chunk;           // If set, destroyed after verification.
+    unsigned char *buf;                     // If set, freed after verification.
+} dmsg_sig_t;
+
+// the signatures of a message that are waiting to be verified as a batch, and
+// the signing keys of the signets they are checked against.
+typedef struct {
+    dmsg_sig_t sigs[DMSG_SIG_BATCH_MAX];
+    size_t nsigs;
+    size_t pending_size;                    // Size of the data the pending signatures were taken over.
+    signet_t const *signets[4];
+    ED25519_KEY *keys[4];
+} dmsg_sig_batch_t;
+
 
 static void *
 mm_set(void *block, unsigned char set, size_t len);
@@ -42,6 +85,17 @@ static dmime_message_chunk_t **
 dmsg_attach_encode(
     dmime_object_t *object);
 
+static int
+dmsg_chunk_batch_run(
+    dmime_message_t *message,
+    ED25519_KEY *signkey,
+    dmime_kekset_t *keks,
+    unsigned int nworkers);
+
+static void *
+dmsg_chunk_batch_worker(
+    void *arg);
+
 static unsigned char *
 dmsg_chunk_data_get(
     dmime_message_chunk_t *chunk,
@@ -56,7 +110,8 @@ static int
 dmsg_chunk_destination_decrypt(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek);
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch);
 
 static dmime_message_chunk_t *
 dmsg_chunk_destination_encode(
@@ -87,7 +142,8 @@ static int
 dmsg_chunk_headers_common_decrypt(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek);
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch);
 
 static dmime_message_chunk_t *
 dmsg_chunk_headers_common_encode(
@@ -97,7 +153,8 @@ static int
 dmsg_chunk_headers_other_decrypt(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek);
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch);
 
 static dmime_message_chunk_t *
 dmsg_chunk_headers_other_encode(
@@ -116,7 +173,8 @@ static int
 dmsg_chunk_origin_decrypt(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek);
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch);
 
 static int
 dmsg_chunk_padlen_get(
@@ -140,9 +198,11 @@ dmsg_chunk_sig_plaintext_get(
     dmime_message_chunk_t *chunk);
 
 static int
-dmsg_chunk_sig_validate(
+dmsg_chunk_sig_queue(
+    dmsg_sig_batch_t *batch,
     dmime_message_chunk_t *chunk,
-    signet_t *signet);
+    signet_t const *signet,
+    char const *name);
 
 static int
 dmsg_chunk_sign(
@@ -157,12 +217,14 @@ static int
 dmsg_chunks_content_decrypt(
     dmime_object_t *object,
     const dmime_message_t *msg,
-    dmime_kek_t *kek);
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch);
 
 static int
 dmsg_chunks_message_encrypt(
     dmime_message_t *message,
-    dmime_kekset_t *keks);
+    dmime_kekset_t *keks,
+    unsigned int nworkers);
 
 static unsigned char *
 dmsg_chunks_serialize(
@@ -181,7 +243,8 @@ static int
 dmsg_chunks_sig_author_validate(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek);
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch);
 
 static int
 dmsg_chunks_sig_origin_sign(
@@ -194,7 +257,8 @@ static int
 dmsg_chunks_sig_origin_validate(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek);
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch);
 
 static size_t
 dmsg_chunks_size_get(
@@ -229,7 +293,8 @@ dmsg_message_chunks_encode(
 static int
 dmsg_message_chunks_sign(
     dmime_message_t *message,
-    ED25519_KEY *signkey);
+    ED25519_KEY *signkey,
+    unsigned int nworkers);
 
 static int
 dmsg_message_decrypt_as_auth(
@@ -274,7 +339,8 @@ dmsg_message_destroy(
 static dmime_message_t *
 dmsg_message_encrypt(
     dmime_object_t *object,
-    ED25519_KEY *signkey);
+    ED25519_KEY *signkey,
+    unsigned int nworkers);
 
 static dmime_object_t *
 dmsg_message_envelope_decrypt(
@@ -289,6 +355,14 @@ dmsg_message_serialize(
     unsigned char tracing,
     size_t *outsize);
 
+static struct iovec *
+dmsg_message_iovec_get(
+    dmime_message_t const *msg,
+    unsigned char sections,
+    unsigned char tracing,
+    size_t *iovcnt,
+    size_t *outsize);
+
 static dmime_message_state_t
 dmsg_message_state_get(
     dmime_message_t const *message);
@@ -362,11 +436,52 @@ dmsg_sections_serialize(
     unsigned char sections,
     size_t *outsize);
 
+static size_t
+dmsg_iovec_chunk_add(
+    struct iovec *iov,
+    size_t at,
+    dmime_message_chunk_t const *chunk);
+
+static size_t
+dmsg_sections_iovec_fill(
+    dmime_message_t const *msg,
+    unsigned char sections,
+    struct iovec *iov);
+
 static size_t
 dmsg_sections_size_get(
     dmime_message_t const *msg,
     unsigned char sections);
 
+static int
+dmsg_sig_batch_add(
+    dmsg_sig_batch_t *batch,
+    signet_t const *signet,
+    int any_msg_key,
+    unsigned char const *sig,
+    unsigned char const *data,
+    size_t data_size,
+    dmime_message_chunk_t *chunk,
+    unsigned char *buf,
+    char const *name);
+
+static void
+dmsg_sig_batch_clear(
+    dmsg_sig_batch_t *batch);
+
+static void
+dmsg_sig_batch_destroy(
+    dmsg_sig_batch_t *batch);
+
+static void
+dmsg_sig_batch_abort(
+    dmsg_sig_batch_t *batch,
+    dmime_object_t *object);
+
+static int
+dmsg_sig_batch_flush(
+    dmsg_sig_batch_t *batch);
+
 static size_t
 dmsg_tracing_load(
     dmime_message_t *msg,
@@ -999,12 +1114,16 @@ dmsg_chunk_sign(
  *  pointer to a dmime message, the chunks of which will be signed.
  * @param signkey
  *  a ed25519 private signing (supposedly the author's).
+ * @param nworkers
+ *  the number of threads the display and attachment chunks are divided
+ *  between, 1 to sign them on the calling thread.
  * @return  0 on success, -1 on failure.
 */
 static int
 dmsg_message_chunks_sign(
     dmime_message_t *message,
-    ED25519_KEY *signkey)
+    ED25519_KEY *signkey,
+    unsigned int nworkers)
 {
     if(!message || !signkey) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
@@ -1032,26 +1151,10 @@ dmsg_message_chunks_sign(
         RET_ERROR_INT(ERR_UNSPEC, "could not sign origin chunk");
     }
 
-    if(message->display) {
-        for (size_t i = 0; message->display[i]; i++) {
-
-            if(dmsg_chunk_sign(message->display[i], signkey)) {
-                RET_ERROR_INT(ERR_UNSPEC, "could not sign display chunk");
-            }
-
-        }
-
-    }
-
-    if(message->attach) {
-        for (size_t i = 0; message->attach[i]; i++) {
-
-            if(dmsg_chunk_sign(message->attach[i], signkey)) {
-                RET_ERROR_INT(ERR_UNSPEC, "could not sign attachment chunk");
-            }
-
-        }
-
+    if(dmsg_chunk_batch_run(message, signkey, NULL, nworkers)) {
+        RET_ERROR_INT(
+            ERR_UNSPEC,
+            "could not sign display and attachment chunks");
     }
 
     message->state = MESSAGE_STATE_CHUNKS_SIGNED;
@@ -1170,7 +1273,8 @@ dmsg_kek_out_derive_all(
 
 /**
  * @brief
- *  encrypts keyslot with the specified aes256 key and initialization vector.
+ *  encrypts keyslot in place with the specified aes256 key and initialization
+ *  vector.
  * @param keyslot
  *  pointer to the keyslot to be encrypted.
  * @param kek
@@ -1182,22 +1286,20 @@ dmsg_keyslot_encrypt(
     dmime_keyslot_t *keyslot,
     dmime_kek_t *kek)
 {
-    dmime_keyslot_t slot;
     int result;
 
     if (!keyslot || !kek) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
-    mm_set(&slot, 0, sizeof(slot));
-
     for(size_t i = 0; i < 16; ++i) {
         keyslot->iv[i] = keyslot->random[i] ^ keyslot->iv[i];
     }
 
+    // the keyslot is encrypted in place, overwriting the plaintext key.
     if ((result =
             _encrypt_aes_256(
-                (unsigned char *)&slot,
+                (unsigned char *)keyslot,
                 (unsigned char *)keyslot,
                 sizeof(dmime_keyslot_t),
                 kek->key,
@@ -1207,18 +1309,13 @@ dmsg_keyslot_encrypt(
         RET_ERROR_INT(
             ERR_UNSPEC,
             "error occurred while encrypting chunk data");
-    } else if (result != sizeof(slot)) {
-        mm_set(&slot, 0, sizeof(slot));
+    } else if (result != sizeof(dmime_keyslot_t)) {
         RET_ERROR_INT(
             ERR_UNSPEC,
             "chunk keyslot encryption operation did not return expected "
             "length");
     }
 
-    // copy the newly encrypted information over the keyslot and return.
-    memcpy(keyslot, &slot, sizeof(dmime_keyslot_t));
-    mm_set(&slot, 0, sizeof(slot));
-
     return 0;
 }
 
@@ -1248,7 +1345,6 @@ dmsg_chunk_encrypt(
     int slot_count = 0;
     size_t data_size;
     int res;
-    unsigned char *outbuf;
 
     if (!chunk || !keks) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
@@ -1299,14 +1395,13 @@ dmsg_chunk_encrypt(
         RET_ERROR_INT(ERR_UNSPEC, "could not generate random key");
     }
 
-    if (!(outbuf = malloc(data_size))) {
-        PUSH_ERROR_SYSCALL("malloc");
-        RET_ERROR_INT(ERR_NOMEM, "could not allocate buffer for encrypted data");
-    }
+    // the payload is encrypted in place. from here on the chunk data is no
+    // longer plaintext, so the state is changed before anything can fail.
+    chunk->state = MESSAGE_CHUNK_STATE_UNKNOWN;
 
     if ((res =
             _encrypt_aes_256(
-                outbuf,
+                &(chunk->data[0]),
                 &(chunk->data[0]),
                 data_size,
                 temp.aes_key,
@@ -1316,13 +1411,10 @@ dmsg_chunk_encrypt(
         _secure_wipe((unsigned char *)&temp, sizeof(temp));
         RET_ERROR_INT(ERR_UNSPEC, "error encrypting data");
     } else if ((size_t)res != data_size) {
+        _secure_wipe((unsigned char *)&temp, sizeof(temp));
         RET_ERROR_INT(ERR_UNSPEC, "encrypted an unexpected number of bytes");
     }
 
-    memcpy(&(chunk->data[0]), outbuf, data_size);
-    free(outbuf);
-    chunk->state = MESSAGE_CHUNK_STATE_UNKNOWN;
-
     if (key->auth_keyslot) {
         keyslot = dmsg_chunk_keyslot_get_by_num(chunk, ++slot_count);
 
@@ -1481,6 +1573,170 @@ dmsg_chunk_encrypt(
 }
 
 
+/**
+ * @brief
+ *  signs and/or encrypts the batch chunks claimed by the calling thread until
+ *  every chunk has been claimed or one of them has failed.
+ * @note
+ *  the error stack belongs to the thread that pushed onto it, so the first
+ *  failure is saved in the batch, to be reported by the thread running it.
+ * @param arg
+ *  pointer to the dmsg_chunk_batch_t shared by the workers.
+ * @return
+ *  NULL.
+*/
+static void *
+dmsg_chunk_batch_worker(void *arg)
+{
+    dmsg_chunk_batch_t *batch = (dmsg_chunk_batch_t *)arg;
+    dmime_message_chunk_t *chunk;
+    size_t next;
+
+    while (!__atomic_load_n(&(batch->failed), __ATOMIC_RELAXED)
+        && (next =
+            __atomic_fetch_add(&(batch->next), 1, __ATOMIC_RELAXED))
+        < batch->nchunks)
+    {
+        chunk = batch->chunks[next];
+
+        if ((batch->signkey && dmsg_chunk_sign(chunk, batch->signkey))
+            || (batch->keks && dmsg_chunk_encrypt(chunk, batch->keks)))
+        {
+            if (!__atomic_exchange_n(&(batch->failed), 1, __ATOMIC_RELAXED)
+                && get_last_error())
+            {
+                memcpy(&(batch->error), get_last_error(), sizeof(errinfo_t));
+            }
+
+            _clear_error_stack();
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief
+ *  signs and/or encrypts the display and attachment chunks of a message,
+ *  dividing them between up to nworkers threads. every chunk has its own
+ *  signature, aes256 key and initialization vector, so they can be processed
+ *  in any order. the calling thread works alongside the other workers.
+ * @note
+ *  openssl must be set up for use by multiple threads if nworkers is more
+ *  than 1.
+ * @param message
+ *  pointer to the dmime message, the chunks of which will be processed.
+ * @param signkey
+ *  the ed25519 private key the chunks are signed with, or NULL if they are not
+ *  signed.
+ * @param keks
+ *  pointer to the kekset the chunk keyslots are encrypted with, or NULL if the
+ *  chunks are not encrypted.
+ * @param nworkers
+ *  the maximum number of threads used, capped at DMIME_ENCRYPT_MAX_WORKERS.
+ * @return
+ *  0 on success, -1 on failure.
+*/
+static int
+dmsg_chunk_batch_run(
+    dmime_message_t *message,
+    ED25519_KEY *signkey,
+    dmime_kekset_t *keks,
+    unsigned int nworkers)
+{
+    dmsg_chunk_batch_t batch;
+    pthread_t workers[DMIME_ENCRYPT_MAX_WORKERS - 1];
+    size_t ndisplay = 0, nattach = 0, nstarted = 0;
+
+    if (!message || (!signkey && !keks)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    while (message->display && message->display[ndisplay]) {
+        ++ndisplay;
+    }
+
+    while (message->attach && message->attach[nattach]) {
+        ++nattach;
+    }
+
+    if (!(ndisplay + nattach)) {
+        return 0;
+    }
+
+    mm_set(&batch, 0, sizeof(batch));
+    batch.nchunks = ndisplay + nattach;
+    batch.signkey = signkey;
+    batch.keks = keks;
+
+    if (!(batch.chunks =
+            malloc(batch.nchunks * sizeof(dmime_message_chunk_t *))))
+    {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_INT(ERR_NOMEM, "could not allocate array for chunk pointers");
+    }
+
+    if (ndisplay) {
+        memcpy(
+            batch.chunks,
+            message->display,
+            ndisplay * sizeof(dmime_message_chunk_t *));
+    }
+
+    if (nattach) {
+        memcpy(
+            batch.chunks + ndisplay,
+            message->attach,
+            nattach * sizeof(dmime_message_chunk_t *));
+    }
+
+    // a chunk is never split between threads, so there is no point in
+    // starting more workers than there are chunks.
+    while ((nstarted + 1) < nworkers
+        && (nstarted + 1) < DMIME_ENCRYPT_MAX_WORKERS
+        && (nstarted + 1) < batch.nchunks)
+    {
+        if (pthread_create(
+                &(workers[nstarted]),
+                NULL,
+                dmsg_chunk_batch_worker,
+                &batch))
+        {
+            break;
+        }
+
+        ++nstarted;
+    }
+
+    dmsg_chunk_batch_worker(&batch);
+
+    for (size_t i = 0; i < nstarted; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(batch.chunks);
+
+    // whichever thread failed first, its error is handed on to our caller.
+    if (batch.failed) {
+
+        if (batch.error.errcode) {
+            _push_error_stack(
+                batch.error.filename,
+                batch.error.funcname,
+                batch.error.lineno,
+                batch.error.errcode,
+                batch.error.xerrno,
+                batch.error.auxmsg);
+        }
+
+        RET_ERROR_INT(ERR_UNSPEC, "could not process a message chunk");
+    }
+
+    return 0;
+}
+
+
 /**
  * @brief
  *  takes a dmime message with chunks that have already been signed and for
@@ -1491,13 +1747,17 @@ dmsg_chunk_encrypt(
  * @param keks
  *  pointer to the set of key-encryption-keys to be used for encrypting
  *  keyslots.
+ * @param nworkers
+ *  the number of threads the display and attachment chunks are divided
+ *  between, 1 to encrypt them on the calling thread.
  * @return
  *  0 on success, -1 on failure.
 */
 static int
 dmsg_chunks_message_encrypt(
     dmime_message_t *message,
-    dmime_kekset_t *keks)
+    dmime_kekset_t *keks,
+    unsigned int nworkers)
 {
     if (!message || !keks) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
@@ -1525,20 +1785,10 @@ dmsg_chunks_message_encrypt(
         RET_ERROR_INT(ERR_UNSPEC, "could not encrypt other headers chunk");
     }
 
-    if (message->display) {
-        for (size_t i = 0; message->display[i]; i++) {
-            if(dmsg_chunk_encrypt(message->display[i], keks)) {
-                RET_ERROR_INT(ERR_UNSPEC, "could not encrypt display chunks");
-            }
-        }
-    }
-
-    if(message->attach) {
-        for (size_t i = 0; message->attach[i]; i++) {
-            if(dmsg_chunk_encrypt(message->attach[i], keks)) {
-                RET_ERROR_INT(ERR_UNSPEC, "could not encrypt attachment chunks");
-            }
-        }
+    if (dmsg_chunk_batch_run(message, NULL, keks, nworkers)) {
+        RET_ERROR_INT(
+            ERR_UNSPEC,
+            "could not encrypt display and attachment chunks");
     }
 
     message->state = MESSAGE_STATE_ENCRYPTED;
@@ -2528,6 +2778,9 @@ dmsg_encode_origin_sig_chunks(
  *  destination and recipient.
  * @param signkey
  *  the author's private ed25519 signing key which will be used.
+ * @param nworkers
+ *  the number of threads the display and attachment chunks are signed and
+ *  encrypted on.
  * @return
  *  a pointer to a fully signed and encrypted dmime message.
  * @free_using{dmsg_destroy_message}
@@ -2535,7 +2788,8 @@ dmsg_encode_origin_sig_chunks(
 static dmime_message_t *
 dmsg_message_encrypt(
     dmime_object_t *object,
-    ED25519_KEY *signkey)
+    ED25519_KEY *signkey,
+    unsigned int nworkers)
 {
     EC_KEY *ephemeral;
     dmime_kekset_t kekset;
@@ -2564,7 +2818,7 @@ dmsg_message_encrypt(
         RET_ERROR_PTR(ERR_UNSPEC, "could not encode message chunks");
     }
 
-    if (dmsg_message_chunks_sign(result, signkey)) {
+    if (dmsg_message_chunks_sign(result, signkey, nworkers)) {
         dmsg_message_destroy(result);
         RET_ERROR_PTR(ERR_UNSPEC, "could not sign message chunks");
     }
@@ -2582,7 +2836,7 @@ dmsg_message_encrypt(
             "could not derive kekset from signets and ephemeral key");
     }
 
-    if (dmsg_chunks_message_encrypt(result, &kekset)) {
+    if (dmsg_chunks_message_encrypt(result, &kekset, nworkers)) {
         _secure_wipe(kekset, sizeof(dmime_kekset_t));
         dmsg_message_destroy(result);
         _free_ec_key(ephemeral);
@@ -2724,101 +2978,303 @@ dmsg_message_serialize(
 
 /**
  * @brief
- *  deserializes and adds a tracing object to the dmime message from the
- *  provided binary input.
- * @param msg
- *  dmime message object to which the tracing object will be attached.
- * @param in
- *  points to the first length byte of the array containing the binary tracing
- *  (points to the first character after the dime magic number for tracing
- *  objects).
- * @param insize
- *  maximum size of the input array.
- * @return  number of characters read as the tracing, 0 on error.
- */
+ *  points an iovec entry at the serialized form of a message chunk.
+ * @param iov
+ *  the iovec array, or NULL if entries are only being counted.
+ * @param at
+ *  the index of the entry to fill in.
+ * @param chunk
+ *  the chunk to point to, which may be NULL if it is absent.
+ * @return
+ *  the number of entries used, 1 if the chunk is present and 0 otherwise.
+*/
 static size_t
-dmsg_tracing_load(
-    dmime_message_t *msg,
-    unsigned char const *in,
-    size_t insize)
+dmsg_iovec_chunk_add(
+    struct iovec *iov,
+    size_t at,
+    dmime_message_chunk_t const *chunk)
 {
-    size_t trc_size;
-
-    if (!msg || !in || !insize) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
-    }
-
-    trc_size = ((size_t)_int_no_get_2b(in) + TRACING_LENGTH_SIZE);
-    if (trc_size > insize
-        || trc_size <= TRACING_LENGTH_SIZE)
-    {
-        RET_ERROR_UINT(ERR_UNSPEC, "invalid message tracing length");
+    if (!chunk) {
+        return 0;
     }
 
-    if(!(msg->tracing = malloc(trc_size))) {
-        PUSH_ERROR_SYSCALL("malloc");
-        RET_ERROR_UINT(
-            ERR_NOMEM,
-            "could not allocate memory for tracing object");
+    if (iov) {
+        iov[at].iov_base = (void *)&(chunk->type);
+        iov[at].iov_len = chunk->serial_size;
     }
 
-    memset(msg->tracing, 0, trc_size);
-    memcpy(msg->tracing, in, trc_size);
-
-    return trc_size;
+    return 1;
 }
 
 
 /**
  * @brief
- *  Deserializes binary message input into an array of chunks of a specified
- *  section, regardless of chunk order.  This should only be used for display
- *  and attachment sections, because all other chunks need to maintain the
- *  correct sequence.
- * @param in
- *  pointer to the binary data.
- * @param insize
- *  size of the input array.
- * @param section
- *  the specified section from which the chunks should be deserialized.
- * @param read
- *  number of bytes read for all the chunks.
+ *  points consecutive entries of an iovec array at the serialized chunks of
+ *  the specified sections of a dmime message, in the order in which
+ *  dmsg_sections_serialize() would lay them out.
+ * @param msg
+ *  dmime message whose chunks are described.
+ * @param sections
+ *  the bitmask of sections to describe. see ::dmime_chunk_section_t.
+ * @param iov
+ *  the array to be filled in, or NULL to only count the entries it needs.
  * @return
- *  a pointer to a NULL-pointer terminated array of display chunk pointers.
- * @free_using{dmsg_destroy_message_chunk_chain}
+ *  the number of iovec entries describing the sections.
 */
-static dmime_message_chunk_t **
-dmsg_section_deserialize(
-    unsigned char const *in,
-    size_t insize,
-    dmime_chunk_section_t section,
-    size_t *read)
+static size_t
+dmsg_sections_iovec_fill(
+    dmime_message_t const *msg,
+    unsigned char sections,
+    struct iovec *iov)
 {
-    dmime_chunk_key_t *key;
-    dmime_message_chunk_t **result;
-    int num_keyslots, atchunk = 0;
-    size_t num_chunks = 0, at = 0, serial_size, payload_size;
+    dmime_message_chunk_t *chunks[5];
+    dmime_message_chunk_t **lists[2] = { NULL, NULL };
+    size_t count = 0, nchunks;
 
-    if (!in || !insize || !read) {
-        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    nchunks = 0;
+
+    if (CHUNK_SECTION_ENVELOPE & sections) {
+        chunks[nchunks++] = msg->ephemeral;
+        chunks[nchunks++] = msg->origin;
+        chunks[nchunks++] = msg->destination;
     }
 
-    while (
-        at + CHUNK_HEADER_SIZE < insize
-        && (key = dmsg_chunk_type_key_get(in[at]))->section
-            == section)
-    {
+    if (CHUNK_SECTION_METADATA & sections) {
+        chunks[nchunks++] = msg->common_headers;
+        chunks[nchunks++] = msg->other_headers;
+    }
 
-        num_keyslots =
-            key->auth_keyslot + key->orig_keyslot
-            + key->dest_keyslot + key->recp_keyslot;
-        payload_size = _int_no_get_3b(in + 1);
-        serial_size =
-            CHUNK_HEADER_SIZE + payload_size
-            + num_keyslots * sizeof(dmime_keyslot_t);
-        at += serial_size;
+    if (CHUNK_SECTION_DISPLAY & sections) {
+        lists[0] = msg->display;
+    }
 
-        if(at > insize) {
+    if (CHUNK_SECTION_ATTACH & sections) {
+        lists[1] = msg->attach;
+    }
+
+    // envelope and metadata chunks, then display and attachment chunks.
+    for (size_t i = 0; i < nchunks; i++) {
+        count += dmsg_iovec_chunk_add(iov, count, chunks[i]);
+    }
+
+    for (size_t i = 0; i < 2; i++) {
+        for (size_t j = 0; lists[i] && lists[i][j]; j++) {
+            count += dmsg_iovec_chunk_add(iov, count, lists[i][j]);
+        }
+    }
+
+    if (CHUNK_SECTION_SIG & sections) {
+        count += dmsg_iovec_chunk_add(iov, count, msg->author_tree_sig);
+        count += dmsg_iovec_chunk_add(iov, count, msg->author_full_sig);
+        count += dmsg_iovec_chunk_add(
+            iov,
+            count,
+            msg->origin_meta_bounce_sig);
+        count += dmsg_iovec_chunk_add(
+            iov,
+            count,
+            msg->origin_display_bounce_sig);
+        count += dmsg_iovec_chunk_add(iov, count, msg->origin_full_sig);
+    }
+
+    return count;
+}
+
+
+/**
+ * @brief
+ *  describes the complete binary form of the specified sections of a dmime
+ *  message as an iovec array, without serializing it. the entries point
+ *  directly into the chunks of the message, so the array is only valid for as
+ *  long as the message is, and concatenating them gives the same output as
+ *  dmsg_message_serialize(). the message must be at least signed by author.
+ * @param msg
+ *  dmime message to be described.
+ * @param sections
+ *  sections to be included.
+ * @param tracing
+ *  if set, include tracing, if clear don't include tracing.
+ * @param iovcnt
+ *  stores the number of entries in the returned array.
+ * @param outsize
+ *  stores the total size of the binary the entries describe.
+ * @return
+ *  pointer to the iovec array, which also holds the storage for the message
+ *  headers it refers to.
+ * @free_using{free}
+*/
+static struct iovec *
+dmsg_message_iovec_get(
+    dmime_message_t const *msg,
+    unsigned char sections,
+    unsigned char tracing,
+    size_t *iovcnt,
+    size_t *outsize)
+{
+    size_t trc_size = 0, msg_size, count, at = 0;
+    unsigned char *headers;
+    struct iovec *result;
+
+    if (!msg || !iovcnt || !outsize) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (dmsg_message_state_get(msg) < MESSAGE_STATE_AUTHOR_SIGNED) {
+        RET_ERROR_PTR(
+            ERR_UNSPEC,
+            "the message must be at least signed by author in order "
+            "to be converted to complete binary form");
+    }
+
+    if (!(msg_size = dmsg_sections_size_get(msg, sections))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "the total sections size is 0");
+    }
+
+    // one entry for the message header, plus two for the tracing.
+    count = 1 + dmsg_sections_iovec_fill(msg, sections, NULL);
+
+    if (tracing && msg->tracing) {
+        trc_size = _int_no_get_2b(&(msg->tracing->size[0]));
+        count += 2;
+    }
+
+    if (!(result = malloc(
+        (count * sizeof(struct iovec))
+        + TRACING_HEADER_SIZE - TRACING_LENGTH_SIZE
+        + MESSAGE_HEADER_SIZE)))
+    {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_PTR(
+            ERR_NOMEM,
+            "could not allocate memory for binary message iovec");
+    }
+
+    headers = (unsigned char *)(result + count);
+    *iovcnt = count;
+    *outsize = MESSAGE_HEADER_SIZE + msg_size;
+    count = 0;
+
+    if (tracing && msg->tracing) {
+        _int_no_put_2b(headers, (uint16_t)DIME_MSG_TRACING);
+        result[count].iov_base = headers;
+        result[count].iov_len = TRACING_HEADER_SIZE - TRACING_LENGTH_SIZE;
+        count++;
+        result[count].iov_base = (void *)msg->tracing;
+        result[count].iov_len = trc_size + TRACING_LENGTH_SIZE;
+        count++;
+        at += TRACING_HEADER_SIZE - TRACING_LENGTH_SIZE;
+        *outsize += TRACING_HEADER_SIZE + trc_size;
+    }
+
+    _int_no_put_2b(headers + at, (uint16_t)DIME_ENCRYPTED_MSG);
+    _int_no_put_4b(headers + at + 2, (uint32_t)msg_size);
+    result[count].iov_base = headers + at;
+    result[count].iov_len = MESSAGE_HEADER_SIZE;
+    count++;
+
+    dmsg_sections_iovec_fill(msg, sections, result + count);
+
+    return result;
+}
+
+
+/**
+ * @brief
+ *  deserializes and adds a tracing object to the dmime message from the
+ *  provided binary input.
+ * @param msg
+ *  dmime message object to which the tracing object will be attached.
+ * @param in
+ *  points to the first length byte of the array containing the binary tracing
+ *  (points to the first character after the dime magic number for tracing
+ *  objects).
+ * @param insize
+ *  maximum size of the input array.
+ * @return  number of characters read as the tracing, 0 on error.
+ */
+static size_t
+dmsg_tracing_load(
+    dmime_message_t *msg,
+    unsigned char const *in,
+    size_t insize)
+{
+    size_t trc_size;
+
+    if (!msg || !in || !insize) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    trc_size = ((size_t)_int_no_get_2b(in) + TRACING_LENGTH_SIZE);
+    if (trc_size > insize
+        || trc_size <= TRACING_LENGTH_SIZE)
+    {
+        RET_ERROR_UINT(ERR_UNSPEC, "invalid message tracing length");
+    }
+
+    if(!(msg->tracing = malloc(trc_size))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_UINT(
+            ERR_NOMEM,
+            "could not allocate memory for tracing object");
+    }
+
+    memset(msg->tracing, 0, trc_size);
+    memcpy(msg->tracing, in, trc_size);
+
+    return trc_size;
+}
+
+
+/**
+ * @brief
+ *  Deserializes binary message input into an array of chunks of a specified
+ *  section, regardless of chunk order.  This should only be used for display
+ *  and attachment sections, because all other chunks need to maintain the
+ *  correct sequence.
+ * @param in
+ *  pointer to the binary data.
+ * @param insize
+ *  size of the input array.
+ * @param section
+ *  the specified section from which the chunks should be deserialized.
+ * @param read
+ *  number of bytes read for all the chunks.
+ * @return
+ *  a pointer to a NULL-pointer terminated array of display chunk pointers.
+ * @free_using{dmsg_destroy_message_chunk_chain}
+*/
+static dmime_message_chunk_t **
+dmsg_section_deserialize(
+    unsigned char const *in,
+    size_t insize,
+    dmime_chunk_section_t section,
+    size_t *read)
+{
+    dmime_chunk_key_t *key;
+    dmime_message_chunk_t **result;
+    int num_keyslots, atchunk = 0;
+    size_t num_chunks = 0, at = 0, serial_size, payload_size;
+
+    if (!in || !insize || !read) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    while (
+        at + CHUNK_HEADER_SIZE < insize
+        && (key = dmsg_chunk_type_key_get(in[at]))->section
+            == section)
+    {
+
+        num_keyslots =
+            key->auth_keyslot + key->orig_keyslot
+            + key->dest_keyslot + key->recp_keyslot;
+        payload_size = _int_no_get_3b(in + 1);
+        serial_size =
+            CHUNK_HEADER_SIZE + payload_size
+            + num_keyslots * sizeof(dmime_keyslot_t);
+        at += serial_size;
+
+        if(at > insize) {
             RET_ERROR_PTR(ERR_UNSPEC, "invalid chunk size");
         }
 
@@ -3267,7 +3723,6 @@ dmsg_chunk_decrypt(
     int keyslot_num;
     size_t payload_size;
     int res;
-    unsigned char *data;
 
     if (!chunk || !kek) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
@@ -3352,47 +3807,39 @@ dmsg_chunk_decrypt(
         RET_ERROR_PTR(ERR_UNSPEC, "could not decrypt keyslot");
     }
 
-    if(!(data = malloc(payload_size))) {
-        PUSH_ERROR_SYSCALL("malloc");
+    // the encrypted payload is copied straight into the new chunk and
+    // decrypted in place there, so the source chunk is left untouched.
+    if(!(result =
+            dmsg_chunk_payload_wrap(
+                chunk->type,
+                payload,
+                payload_size)))
+    {
         _secure_wipe(&keyslot_dec, sizeof(dmime_keyslot_t));
-        RET_ERROR_PTR(
-            ERR_NOMEM,
-            "could not allocate memory for decrypted data");
+        RET_ERROR_PTR(ERR_UNSPEC, "could not load data into message chunk");
     }
 
-    memset(data, 0, payload_size);
-
     if ((res =
             _decrypt_aes_256(
-                data,
-                payload,
+                &(result->data[0]),
+                &(result->data[0]),
                 payload_size,
                 keyslot_dec.aes_key,
                 keyslot_dec.iv))
         < 0)
     {
         _secure_wipe(&keyslot_dec, sizeof(dmime_keyslot_t));
-        free(data);
+        dmsg_message_chunk_destroy(result);
         RET_ERROR_PTR(
             ERR_UNSPEC,
             "an error occurred while decrypting a chunk payload");
     } else if ((size_t)res != payload_size) {
         _secure_wipe(&keyslot_dec, sizeof(dmime_keyslot_t));
-        free(data);
+        dmsg_message_chunk_destroy(result);
         RET_ERROR_PTR(ERR_UNSPEC, "decrypted an unexpected number of bytes");
     }
 
     _secure_wipe(&keyslot_dec, sizeof(dmime_keyslot_t));
-    result =
-        dmsg_chunk_payload_wrap(
-            chunk->type,
-            data,
-            payload_size);
-    free(data);
-
-    if(!result) {
-        RET_ERROR_PTR(ERR_UNSPEC, "could not load data into message chunk");
-    }
 
     return result;
 }
@@ -3575,62 +4022,341 @@ dmsg_message_envelope_decrypt(
         dime_prsr_envelope_destroy(parsed);
     }
 
-    result->state = DMIME_OBJECT_STATE_LOADED_ENVELOPE;
+    result->state = DMIME_OBJECT_STATE_LOADED_ENVELOPE;
+
+    return result;
+}
+
+
+/**
+ * @brief
+ *  adds the plaintext signature of a decrypted chunk to a batch of signatures
+ *  that are verified with the author's signet.
+ * @param batch
+ *  batch of signatures the chunk signature is added to.
+ * @param chunk
+ *  pointer to a decrypted dmime message chunk, the plaintext signature of which
+ *  will be verified. the batch takes ownership of the chunk, and destroys it
+ *  once the signature was verified or if it could not be added.
+ * @param signet
+ *  author's signet used to verify signature.
+ * @param name
+ *  description of the signature used in error messages.
+ * @return
+ *  0 on success, -1 on failure.
+*/
+static int
+dmsg_chunk_sig_queue(
+    dmsg_sig_batch_t *batch,
+    dmime_message_chunk_t *chunk,
+    signet_t const *signet,
+    char const *name)
+{
+    size_t data_size;
+    unsigned char *data, *sig;
+
+    if(!batch || !chunk || !signet || !name) {
+        dmsg_message_chunk_destroy(chunk);
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if(chunk->state == MESSAGE_CHUNK_STATE_ENCRYPTED) {
+        dmsg_message_chunk_destroy(chunk);
+        RET_ERROR_INT(
+            ERR_UNSPEC,
+            "can not verify plaintext signature of an encrypted chunk");
+    }
+
+    if(!(sig = dmsg_chunk_sig_plaintext_get(chunk))) {
+        dmsg_message_chunk_destroy(chunk);
+        RET_ERROR_INT(
+            ERR_UNSPEC,
+            "could not retrieve plaintext signature from chunk");
+    }
+
+    if(!(data = dmsg_chunk_data_padded_get(chunk, &data_size))) {
+        dmsg_message_chunk_destroy(chunk);
+        RET_ERROR_INT(ERR_UNSPEC, "could not retrieve chunk padded data");
+    }
+
+    if(dmsg_sig_batch_add(batch, signet, 1, sig, data, data_size, chunk, NULL, name)) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not add chunk signature to batch");
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief
+ *  adds a signature to a batch of signatures that are verified together once
+ *  the batch is full, once the signed data it holds grows too large or once it
+ *  is flushed.
+ * @param batch
+ *  batch the signature is added to.
+ * @param signet
+ *  signet of the signer, the primary signing key of which is used to verify
+ *  the signature.
+ * @param any_msg_key
+ *  if set, the signature is also accepted if it was made with any of the
+ *  message signing keys of the signet, the way dime_sgnt_msg_sig_verify()
+ *  accepts it.
+ * @param sig
+ *  the ed25519 signature, which is copied into the batch.
+ * @param data
+ *  the signed data, which must stay valid until the signature was verified.
+ * @param data_size
+ *  size of the signed data.
+ * @param chunk
+ *  if set, a chunk that is destroyed once the signature was verified.
+ * @param buf
+ *  if set, a buffer that is freed once the signature was verified.
+ * @param name
+ *  description of the signature used in error messages.
+ * @return
+ *  0 on success, -1 on failure. chunk and buf are released on failure as well.
+ * @note
+ *  adding a signature can verify the signatures already in the batch, so a
+ *  failure may also mean one of them was invalid.
+*/
+static int
+dmsg_sig_batch_add(
+    dmsg_sig_batch_t *batch,
+    signet_t const *signet,
+    int any_msg_key,
+    unsigned char const *sig,
+    unsigned char const *data,
+    size_t data_size,
+    dmime_message_chunk_t *chunk,
+    unsigned char *buf,
+    char const *name)
+{
+    ED25519_KEY *key = NULL;
+    dmsg_sig_t *entry;
+    signet_type_t type;
+    size_t i;
+
+    if(!batch || !signet || !sig || !data || !data_size || !name) {
+        dmsg_message_chunk_destroy(chunk);
+        free(buf);
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if(any_msg_key) {
+
+        if((type = dime_sgnt_type_get(signet)) == SIGNET_TYPE_SSR) {
+            dmsg_message_chunk_destroy(chunk);
+            free(buf);
+            RET_ERROR_INT(
+                ERR_UNSPEC,
+                "SSR cannot be used for user message signature verification");
+        } else if(type != SIGNET_TYPE_USER && type != SIGNET_TYPE_ORG) {
+            dmsg_message_chunk_destroy(chunk);
+            free(buf);
+            RET_ERROR_INT(ERR_UNSPEC, "invalid signet type");
+        }
+
+    }
+
+    for(i = 0; i < (sizeof(batch->signets) / sizeof(batch->signets[0])) && batch->signets[i]; i++) {
+
+        if(batch->signets[i] == signet) {
+            key = batch->keys[i];
+            break;
+        }
+
+    }
+
+    if(!key && i == (sizeof(batch->signets) / sizeof(batch->signets[0]))) {
+        dmsg_message_chunk_destroy(chunk);
+        free(buf);
+        RET_ERROR_INT(ERR_UNSPEC, "too many signets for one signature batch");
+    } else if(!key) {
+
+        if(!(key = dime_sgnt_signkey_fetch(signet))) {
+            dmsg_message_chunk_destroy(chunk);
+            free(buf);
+            RET_ERROR_INT(ERR_UNSPEC, "could not retrieve signing key from signet");
+        }
+
+        batch->signets[i] = signet;
+        batch->keys[i] = key;
+    }
+
+    entry = &(batch->sigs[batch->nsigs++]);
+    entry->data = data;
+    entry->data_size = data_size;
+    memcpy(entry->sig, sig, ED25519_SIG_SIZE);
+    entry->key = key;
+    entry->signet = any_msg_key ? signet : NULL;
+    entry->name = name;
+    entry->chunk = chunk;
+    entry->buf = buf;
+    batch->pending_size += data_size;
+
+    if((batch->nsigs == DMSG_SIG_BATCH_MAX || batch->pending_size >= DMSG_SIG_BATCH_MAX_SIZE)
+        && dmsg_sig_batch_flush(batch))
+    {
+        RET_ERROR_INT(ERR_UNSPEC, "could not verify batch of signatures");
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief
+ *  verifies all the signatures waiting in a batch at once. if the batch does not
+ *  verify, each of its signatures is checked on its own to find the one that
+ *  failed.
+ * @param batch
+ *  batch of signatures to be verified. it is empty afterwards whether or not
+ *  the signatures were valid.
+ * @return
+ *  0 if all the signatures were valid, -1 if any of them was invalid or on
+ *  failure.
+*/
+static int
+dmsg_sig_batch_flush(dmsg_sig_batch_t *batch)
+{
+    ED25519_KEY *keys[DMSG_SIG_BATCH_MAX];
+    dmsg_sig_t *entry;
+    int res, result = 0, valid[DMSG_SIG_BATCH_MAX];
+    size_t sizes[DMSG_SIG_BATCH_MAX];
+    unsigned char const *data[DMSG_SIG_BATCH_MAX], *sigs[DMSG_SIG_BATCH_MAX];
+
+    if(!batch) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if(!batch->nsigs) {
+        return 0;
+    }
+
+    for(size_t i = 0; i < batch->nsigs; i++) {
+        data[i] = batch->sigs[i].data;
+        sizes[i] = batch->sigs[i].data_size;
+        keys[i] = batch->sigs[i].key;
+        sigs[i] = batch->sigs[i].sig;
+    }
+
+    if((res = _ed25519_verify_sig_batch(data, sizes, keys, sigs, batch->nsigs, valid)) < 0) {
+        PUSH_ERROR(ERR_UNSPEC, "error during batch verification of signatures");
+        result = -1;
+    } else if(!res) {
+
+        for(size_t i = 0; !result && i < batch->nsigs; i++) {
+            entry = &(batch->sigs[i]);
+
+            if(valid[i]) {
+                continue;
+            }
+
+            // The batch was only checked against the primary signing key of each signet.
+            res = entry->signet ? dime_sgnt_msg_sig_verify(entry->signet, entry->sig, entry->data, entry->data_size) : 0;
+
+            if(res < 0) {
+                PUSH_ERROR_FMT(ERR_UNSPEC, "error during validation of %s", entry->name);
+                result = -1;
+            } else if(!res) {
+                PUSH_ERROR_FMT(ERR_UNSPEC, "%s is invalid", entry->name);
+                result = -1;
+            }
+
+        }
+
+    }
+
+    dmsg_sig_batch_clear(batch);
+
+    if(result) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not verify message signatures");
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief
+ *  releases the signatures waiting in a batch without verifying them.
+ * @param batch
+ *  batch of signatures to be emptied.
+*/
+static void
+dmsg_sig_batch_clear(dmsg_sig_batch_t *batch)
+{
+    if(!batch) {
+        return;
+    }
+
+    for(size_t i = 0; i < batch->nsigs; i++) {
+        dmsg_message_chunk_destroy(batch->sigs[i].chunk);
+        free(batch->sigs[i].buf);
+    }
 
-    return result;
+    memset(batch->sigs, 0, batch->nsigs * sizeof(dmsg_sig_t));
+    batch->nsigs = 0;
+    batch->pending_size = 0;
 }
 
 
 /**
  * @brief
- *  verify chunk plaintext signature using the author's signet.
- * @param chunk
- *  pointer to a dmime message chunk, the plaintext signature of which will be
- *  verified.
- * @param signet
- *  author's signet used to verify signature.
- * @return
- *  1 if signature is valid, 0 if invalid, -1 if validation failed as a result
- *  of an error.
+ *  releases the signatures waiting in a batch without verifying them, along
+ *  with the signing keys the batch retrieved.
+ * @param batch
+ *  batch of signatures to be destroyed.
 */
-static int
-dmsg_chunk_sig_validate(
-    dmime_message_chunk_t *chunk,
-    signet_t *signet)
+static void
+dmsg_sig_batch_destroy(dmsg_sig_batch_t *batch)
 {
-    int result;
-    size_t data_size;
-    unsigned char *data, *sig;
-
-    if(!chunk || !signet) {
-        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    if(!batch) {
+        return;
     }
 
-    if(chunk->state == MESSAGE_CHUNK_STATE_ENCRYPTED) {
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "can not verify plaintext signature of an encrypted chunk");
-    }
+    dmsg_sig_batch_clear(batch);
 
-    if(!(sig = dmsg_chunk_sig_plaintext_get(chunk))) {
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "could not retrieve plaintext signature from chunk");
-    }
+    for(size_t i = 0; i < (sizeof(batch->keys) / sizeof(batch->keys[0])); i++) {
+
+        if(batch->keys[i]) {
+            _free_ed25519_key(batch->keys[i]);
+        }
 
-    if(!(data = dmsg_chunk_data_padded_get(chunk, &data_size))) {
-        RET_ERROR_INT(ERR_UNSPEC, "could not retrieve chunk padded data");
     }
 
-    result = dime_sgnt_msg_sig_verify(signet, sig, data, data_size);
+    memset(batch->signets, 0, sizeof(batch->signets));
+    memset(batch->keys, 0, sizeof(batch->keys));
+}
+
 
-    if(result < 0) {
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "an error occurred while verifying plaintext signature");
+/**
+ * @brief
+ *  destroys a batch of signatures that could not all be verified, along with
+ *  the headers and content chunks that were loaded into the dmime object while
+ *  their signatures were waiting in it.
+ * @param batch
+ *  batch of signatures to be destroyed.
+ * @param object
+ *  dmime object that the unverified data is removed from.
+*/
+static void
+dmsg_sig_batch_abort(dmsg_sig_batch_t *batch, dmime_object_t *object)
+{
+    dmsg_sig_batch_destroy(batch);
+
+    if(!object) {
+        return;
     }
 
-    return result;
+    dime_prsr_headers_destroy(object->common_headers);
+    object->common_headers = NULL;
+    sdsfree(object->other_headers);
+    object->other_headers = NULL;
+    dmsg_object_chunklist_destroy(object->display);
+    object->display = NULL;
+    dmsg_object_chunklist_destroy(object->attach);
+    object->attach = NULL;
 }
 
 
@@ -3644,6 +4370,8 @@ dmsg_chunk_sig_validate(
  *  pointer to the dmime message containing the origin chunk.
  * @param kek
  *  the actor's key encryption key.
+ * @param batch
+ *  batch that the chunk signature is added to.
  * @return
  *  0 on success, -1 on failure.
 */
@@ -3651,15 +4379,15 @@ static int
 dmsg_chunk_origin_decrypt(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek)
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch)
 {
     // TODO pull out reusuable code for dmsg_decrypt_destination ???
 
     dmime_actor_t actor;
     dmime_message_chunk_t *decrypted;
-    int res;
 
-    if(!object || !msg || !kek) {
+    if(!object || !msg || !kek || !batch) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
@@ -3680,20 +4408,17 @@ dmsg_chunk_origin_decrypt(
         RET_ERROR_INT(ERR_UNSPEC, "could not decrypt origin chunk");
     }
 
-    if((res = dmsg_chunk_sig_validate(decrypted, object->signet_author)) < 0) {
-        dmsg_message_chunk_destroy(decrypted);
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "error during validation of origin chunk signature");
-    } else if (!res) {
-        dmsg_message_chunk_destroy(decrypted);
+    if(dmsg_chunk_sig_queue(
+            batch,
+            decrypted,
+            object->signet_author,
+            "origin chunk plaintext signature"))
+    {
         RET_ERROR_INT(
             ERR_UNSPEC,
-            "origin chunk plaintext signature is invalid");
+            "could not verify origin chunk signature");
     }
 
-    dmsg_message_chunk_destroy(decrypted);
-
     return 0;
 }
 
@@ -3708,6 +4433,8 @@ dmsg_chunk_origin_decrypt(
  *  pointer to the dmime message containing the destination chunk.
  * @param kek
  *  the actor's key encryption key.
+ * @param batch
+ *  batch that the chunk signature is added to.
  * @return
  *  0 on success, -1 on failure.
 */
@@ -3715,13 +4442,13 @@ static int
 dmsg_chunk_destination_decrypt(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek)
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch)
 {
     dmime_actor_t actor;
     dmime_message_chunk_t *decrypted;
-    int res;
 
-    if(!object || !msg || !kek) {
+    if(!object || !msg || !kek || !batch) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
@@ -3746,20 +4473,17 @@ dmsg_chunk_destination_decrypt(
         RET_ERROR_INT(ERR_UNSPEC, "could not decrypt destination chunk");
     }
 
-    if((res = dmsg_chunk_sig_validate(decrypted, object->signet_author)) < 0) {
-        dmsg_message_chunk_destroy(decrypted);
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "error during validation of destination chunk signature");
-    } else if(!res) {
-        dmsg_message_chunk_destroy(decrypted);
+    if(dmsg_chunk_sig_queue(
+            batch,
+            decrypted,
+            object->signet_author,
+            "destination chunk plaintext signature"))
+    {
         RET_ERROR_INT(
             ERR_UNSPEC,
-            "destination chunk plaintext signature is invalid");
+            "could not verify destination chunk signature");
     }
 
-    dmsg_message_chunk_destroy(decrypted);
-
     return 0;
 }
 
@@ -3774,6 +4498,8 @@ dmsg_chunk_destination_decrypt(
  *  dmime message containing the signature chunks to be verified.
  * @param kek
  *  the current actor's key encryption key.
+ * @param batch
+ *  batch that the signatures are added to.
  * @return
  *  0 on success, -1 on failure.
  */
@@ -3781,7 +4507,8 @@ static int
 dmsg_chunks_sig_author_validate(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek)
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch)
 {
     dmime_actor_t actor;
     dmime_message_chunk_t *decrypted;
@@ -3789,7 +4516,7 @@ dmsg_chunks_sig_author_validate(
     size_t data_size, sig_size;
     unsigned char *data, *signature;
 
-    if(!object || !msg || !kek) {
+    if(!object || !msg || !kek || !batch) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
@@ -3830,18 +4557,20 @@ dmsg_chunks_sig_author_validate(
     }
 
     result =
-        dime_sgnt_msg_sig_verify(
+        dmsg_sig_batch_add(
+            batch,
             object->signet_author,
+            1,
             signature,
             data,
-            data_size);
+            data_size,
+            NULL,
+            data,
+            "author tree signature");
     dmsg_message_chunk_destroy(decrypted);
-    free(data);
 
-    if (result < 0) {
-        RET_ERROR_INT(ERR_UNSPEC, "error verifying author tree signature");
-    } else if(!result) {
-        RET_ERROR_INT(ERR_UNSPEC, "author tree signature is invalid");
+    if (result) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not verify author tree signature");
     }
 
     if (!(data =
@@ -3877,18 +4606,20 @@ dmsg_chunks_sig_author_validate(
     }
 
     result =
-        dime_sgnt_msg_sig_verify(
+        dmsg_sig_batch_add(
+            batch,
             object->signet_author,
+            1,
             signature,
             data,
-            data_size);
+            data_size,
+            NULL,
+            data,
+            "author full signature");
     dmsg_message_chunk_destroy(decrypted);
-    free(data);
 
-    if(result < 0) {
-        RET_ERROR_INT(ERR_UNSPEC, "error verifying author full signature");
-    } else if(!result) {
-        RET_ERROR_INT(ERR_UNSPEC, "author full signature is invalid");
+    if(result) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not verify author full signature");
     }
 
     return 0;
@@ -3906,6 +4637,8 @@ dmsg_chunks_sig_author_validate(
  *  verified.
  * @param kek
  *  the key encryption key for the current actor.
+ * @param batch
+ *  batch that the chunk signature is added to.
  * @return
  *  0 on success, -1 on failure.
  */
@@ -3913,15 +4646,15 @@ static int
 dmsg_chunk_headers_common_decrypt(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek)
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch)
 {
     dmime_actor_t actor;
     dmime_message_chunk_t *decrypted;
-    int res;
     size_t data_size;
     unsigned char *data;
 
-    if(!object || !msg || !kek) {
+    if(!object || !msg || !kek || !batch) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
@@ -3942,20 +4675,6 @@ dmsg_chunk_headers_common_decrypt(
         RET_ERROR_INT(ERR_UNSPEC, "could not decrypt common headers chunk");
     }
 
-    res = dmsg_chunk_sig_validate(decrypted, object->signet_author);
-
-    if(res < 0) {
-        dmsg_message_chunk_destroy(decrypted);
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "error during validation of common headers chunk signature");
-    } else if(!res) {
-        dmsg_message_chunk_destroy(decrypted);
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "common headers chunk plaintext signature is invalid");
-    }
-
     if(!(data = dmsg_chunk_data_get(decrypted, &data_size))) {
         dmsg_message_chunk_destroy(decrypted);
         RET_ERROR_INT(ERR_UNSPEC, "could not retrieve chunk data");
@@ -3966,7 +4685,16 @@ dmsg_chunk_headers_common_decrypt(
         RET_ERROR_INT(ERR_UNSPEC, "could not parse common headers chunk data");
     }
 
-    dmsg_message_chunk_destroy(decrypted);
+    if(dmsg_chunk_sig_queue(
+            batch,
+            decrypted,
+            object->signet_author,
+            "common headers chunk plaintext signature"))
+    {
+        RET_ERROR_INT(
+            ERR_UNSPEC,
+            "could not verify common headers chunk signature");
+    }
 
     return 0;
 }
@@ -3984,6 +4712,8 @@ dmsg_chunk_headers_common_decrypt(
  *  verified.
  * @param kek
  *  the key encryption key for the current actor.
+ * @param batch
+ *  batch that the chunk signature is added to.
  * @return
  *  0 on success, -1 on failure.
  */
@@ -3991,15 +4721,15 @@ static int
 dmsg_chunk_headers_other_decrypt(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek)
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch)
 {
     dmime_actor_t actor;
     dmime_message_chunk_t *decrypted;
-    int res;
     size_t data_size;
     unsigned char *data;
 
-    if(!object || !msg || !kek) {
+    if(!object || !msg || !kek || !batch) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
@@ -4020,27 +4750,23 @@ dmsg_chunk_headers_other_decrypt(
         RET_ERROR_INT(ERR_UNSPEC, "could not decrypt common headers chunk");
     }
 
-    res = dmsg_chunk_sig_validate(decrypted, object->signet_author);
-
-    if(res < 0) {
-        dmsg_message_chunk_destroy(decrypted);
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "error during validation of other headers chunk signature");
-    } else if(!res) {
-        dmsg_message_chunk_destroy(decrypted);
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "other headers chunk plaintext signature is invalid");
-    }
-
     if(!(data = dmsg_chunk_data_get(decrypted, &data_size))) {
         dmsg_message_chunk_destroy(decrypted);
         RET_ERROR_INT(ERR_UNSPEC, "could not retrieve chunk data");
     }
 
     object->other_headers = sdsnewlen(data, data_size);
-    dmsg_message_chunk_destroy(decrypted);
+
+    if(dmsg_chunk_sig_queue(
+            batch,
+            decrypted,
+            object->signet_author,
+            "other headers chunk plaintext signature"))
+    {
+        RET_ERROR_INT(
+            ERR_UNSPEC,
+            "could not verify other headers chunk signature");
+    }
 
     return 0;
 }
@@ -4108,22 +4834,24 @@ dmsg_object_chunk_create(
  *  an encrypted dmime message from which display and attachment data is taken.
  * @param kek
  *  the key encryption key for the current actor.
+ * @param batch
+ *  batch that the chunk signatures are added to.
  * @return  0 on success, -1 on failure.
 */
 static int
 dmsg_chunks_content_decrypt(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek)
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch)
 {
     dmime_actor_t actor;
     dmime_message_chunk_t *decrypted;
     dmime_object_chunk_t *chunk, *last = NULL;
-    int res;
     unsigned char *data;
     size_t data_size;
 
-    if(!object || !msg || !kek) {
+    if(!object || !msg || !kek || !batch) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
@@ -4157,30 +4885,13 @@ dmsg_chunks_content_decrypt(
                         kek)))
             {
                 dmsg_object_chunklist_destroy(object->display);
+                object->display = NULL;
                 RET_ERROR_INT(ERR_UNSPEC, "could not decrypt display chunk");
             }
 
-            res =
-                dmsg_chunk_sig_validate(
-                    decrypted,
-                    object->signet_author);
-
-            if (res < 0) {
-                dmsg_object_chunklist_destroy(object->display);
-                dmsg_message_chunk_destroy(decrypted);
-                RET_ERROR_INT(
-                    ERR_UNSPEC,
-                    "error during validation of display chunk signature");
-            } else if(!res) {
-                dmsg_object_chunklist_destroy(object->display);
-                dmsg_message_chunk_destroy(decrypted);
-                RET_ERROR_INT(
-                    ERR_UNSPEC,
-                    "display chunk plaintext signature is invalid");
-            }
-
             if (!(data = dmsg_chunk_data_get(decrypted, &data_size))) {
                 dmsg_object_chunklist_destroy(object->display);
+                object->display = NULL;
                 dmsg_message_chunk_destroy(decrypted);
                 RET_ERROR_INT(
                     ERR_UNSPEC,
@@ -4195,6 +4906,7 @@ dmsg_chunks_content_decrypt(
                         dmsg_chunk_flags_get(decrypted))))
             {
                 dmsg_object_chunklist_destroy(object->display);
+                object->display = NULL;
                 dmsg_message_chunk_destroy(decrypted);
                 RET_ERROR_INT(
                     ERR_UNSPEC,
@@ -4202,8 +4914,6 @@ dmsg_chunks_content_decrypt(
                     "the message chunk");
             }
 
-            dmsg_message_chunk_destroy(decrypted);
-
             if (!i) {
                 object->display = chunk;
                 last = object->display;
@@ -4211,6 +4921,19 @@ dmsg_chunks_content_decrypt(
                 last->next = chunk;
                 last = chunk;
             }
+
+            if (dmsg_chunk_sig_queue(
+                    batch,
+                    decrypted,
+                    object->signet_author,
+                    "display chunk plaintext signature"))
+            {
+                dmsg_object_chunklist_destroy(object->display);
+                object->display = NULL;
+                RET_ERROR_INT(
+                    ERR_UNSPEC,
+                    "could not verify display chunk signature");
+            }
         }
 
     }
@@ -4221,27 +4944,13 @@ dmsg_chunks_content_decrypt(
 
             if (!(decrypted = dmsg_chunk_decrypt(msg->attach[i], actor, kek))) {
                 dmsg_object_chunklist_destroy(object->attach);
+                object->attach = NULL;
                 RET_ERROR_INT(ERR_UNSPEC, "could not decrypt display chunk");
             }
 
-            res = dmsg_chunk_sig_validate(decrypted, object->signet_author);
-
-            if (res < 0) {
-                dmsg_object_chunklist_destroy(object->attach);
-                dmsg_message_chunk_destroy(decrypted);
-                RET_ERROR_INT(
-                    ERR_UNSPEC,
-                    "error during validation of attachment chunk signature");
-            } else if (!res) {
-                dmsg_object_chunklist_destroy(object->attach);
-                dmsg_message_chunk_destroy(decrypted);
-                RET_ERROR_INT(
-                    ERR_UNSPEC,
-                    "attachment chunk plaintext signature is invalid");
-            }
-
             if (!(data = dmsg_chunk_data_get(decrypted, &data_size))) {
                 dmsg_object_chunklist_destroy(object->attach);
+                object->attach = NULL;
                 dmsg_message_chunk_destroy(decrypted);
                 RET_ERROR_INT(
                     ERR_UNSPEC,
@@ -4256,6 +4965,7 @@ dmsg_chunks_content_decrypt(
                         dmsg_chunk_flags_get(decrypted))))
             {
                 dmsg_object_chunklist_destroy(object->attach);
+                object->attach = NULL;
                 dmsg_message_chunk_destroy(decrypted);
                 RET_ERROR_INT(
                     ERR_UNSPEC,
@@ -4263,8 +4973,6 @@ dmsg_chunks_content_decrypt(
                     "from the message chunk");
             }
 
-            dmsg_message_chunk_destroy(decrypted);
-
             if(!i) {
                 object->attach = chunk;
                 last = object->attach;
@@ -4272,6 +4980,19 @@ dmsg_chunks_content_decrypt(
                 last->next = chunk;
                 last = chunk;
             }
+
+            if (dmsg_chunk_sig_queue(
+                    batch,
+                    decrypted,
+                    object->signet_author,
+                    "attachment chunk plaintext signature"))
+            {
+                dmsg_object_chunklist_destroy(object->attach);
+                object->attach = NULL;
+                RET_ERROR_INT(
+                    ERR_UNSPEC,
+                    "could not verify attachment chunk signature");
+            }
         }
     }
 
@@ -4298,6 +5019,8 @@ dmsg_message_decrypt_as_auth(
     dmime_message_t const *msg,
     dmime_kek_t *kek)
 {
+    dmsg_sig_batch_t batch;
+
     if (!obj || !msg || !kek) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
@@ -4326,12 +5049,15 @@ dmsg_message_decrypt_as_auth(
     }
 
     obj->state = DMIME_OBJECT_STATE_LOADED_SIGNETS;
+    memset(&batch, 0, sizeof(batch));
 
-    if (dmsg_chunk_origin_decrypt(obj, msg, kek)) {
+    if (dmsg_chunk_origin_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not load origin chunk contents");
     }
 
-    if (dmsg_chunk_destination_decrypt(obj, msg, kek)) {
+    if (dmsg_chunk_destination_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not load destination chunk contents");
     }
 
@@ -4341,7 +5067,8 @@ dmsg_message_decrypt_as_auth(
     // but the full author signature can't always be verified.
     // TODO technically author/recipients should only have to verify the tree
     // signature.
-    if (dmsg_chunks_sig_author_validate(obj, msg, kek)) {
+    if (dmsg_chunks_sig_author_validate(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not verify author signature chunks");
     }
 
@@ -4353,22 +5080,34 @@ dmsg_message_decrypt_as_auth(
     //    RET_ERROR_INT(ERR_UNSPEC, "could not verify author signature chunks");
     //}
 
-    if(dmsg_chunk_headers_common_decrypt(obj, msg, kek)) {
+    if(dmsg_chunk_headers_common_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(
             ERR_UNSPEC,
             "could not load common headers chunk contents");
     }
 
-    if(dmsg_chunk_headers_other_decrypt(obj, msg, kek)) {
+    if(dmsg_chunk_headers_other_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(
             ERR_UNSPEC,
             "could not load common headers chunk contents");
     }
 
-    if(dmsg_chunks_content_decrypt(obj, msg, kek)) {
+    if(dmsg_chunks_content_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not load mesage content");
     }
 
+    // Whatever signatures are still waiting in the batch are verified last.
+    // Until then, none of the data loaded into the object can be trusted.
+    if (dmsg_sig_batch_flush(&batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
+        RET_ERROR_INT(ERR_UNSPEC, "could not verify message signatures");
+    }
+
+    dmsg_sig_batch_destroy(&batch);
+
     obj->state = DMIME_OBJECT_STATE_COMPLETE;
 
     return 0;
@@ -4395,6 +5134,9 @@ dmsg_message_decrypt_as_orig(
     dmime_message_t const *msg,
     dmime_kek_t *kek)
 {
+    dmsg_sig_batch_t batch;
+    int result;
+
     if (!obj || !msg || !kek) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
@@ -4422,8 +5164,10 @@ dmsg_message_decrypt_as_orig(
     }
 
     obj->state = DMIME_OBJECT_STATE_LOADED_SIGNETS;
+    memset(&batch, 0, sizeof(batch));
 
-    if (dmsg_chunk_origin_decrypt(obj, msg, kek)) {
+    if (dmsg_chunk_origin_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_destroy(&batch);
         RET_ERROR_INT(ERR_UNSPEC, "could not load origin chunk contents");
     }
 
@@ -4433,10 +5177,19 @@ dmsg_message_decrypt_as_orig(
     // but the full author signature can't always be verified.
     // TODO technically author/recipients should only have to verify the tree
     // signature.
-    if (dmsg_chunks_sig_author_validate(obj, msg, kek)) {
+    if (dmsg_chunks_sig_author_validate(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_destroy(&batch);
         RET_ERROR_INT(ERR_UNSPEC, "could not verify author signature chunks");
     }
 
+    // Whatever signatures are still waiting in the batch are verified last.
+    result = dmsg_sig_batch_flush(&batch);
+    dmsg_sig_batch_destroy(&batch);
+
+    if (result) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not verify message signatures");
+    }
+
     obj->state = DMIME_OBJECT_STATE_COMPLETE;
 
     return 0;
@@ -4744,6 +5497,8 @@ dmsg_chunks_sig_origin_sign(
  *  dmime message containing the signature chunks to be verified.
  * @param kek
  *  the current actor's key encryption key.
+ * @param batch
+ *  batch that the signatures are added to.
  * @return
  *  0 on success, -1 on failure.
  */
@@ -4753,16 +5508,16 @@ static int
 dmsg_chunks_sig_origin_validate(
     dmime_object_t *object,
     dmime_message_t const *msg,
-    dmime_kek_t *kek)
+    dmime_kek_t *kek,
+    dmsg_sig_batch_t *batch)
 {
-    ED25519_KEY *signkey;
     dmime_actor_t actor;
     dmime_message_chunk_t *decrypted;
     int result;
     size_t data_size, sig_size;
     unsigned char *data, *signature;
 
-    if (!object || !msg || !kek) {
+    if (!object || !msg || !kek || !batch) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
@@ -4775,10 +5530,6 @@ dmsg_chunks_sig_origin_validate(
 
     actor = object->actor;
 
-    if (!(signkey = dime_sgnt_signkey_fetch(object->signet_origin))) {
-        RET_ERROR_INT(ERR_UNSPEC, "could not retrieve author signing key");
-    }
-
     if (msg->origin_meta_bounce_sig) {
 
         if (!(data =
@@ -4788,7 +5539,6 @@ dmsg_chunks_sig_origin_validate(
                         | CHUNK_SECTION_METADATA),
                     &data_size)))
         {
-            _free_ed25519_key(signkey);
             RET_ERROR_INT(
                 ERR_UNSPEC,
                 "could not serialize envelope and metadata message chunks");
@@ -4801,7 +5551,6 @@ dmsg_chunks_sig_origin_validate(
                     kek)))
         {
             free(data);
-            _free_ed25519_key(signkey);
             RET_ERROR_INT(
                 ERR_UNSPEC,
                 "could not decrypt origin meta bounce chunk");
@@ -4815,26 +5564,28 @@ dmsg_chunks_sig_origin_validate(
         {
             dmsg_message_chunk_destroy(decrypted);
             free(data);
-            _free_ed25519_key(signkey);
             RET_ERROR_INT(
                 ERR_UNSPEC,
                 "could not retrieve meta bounce chunk data");
         }
 
-        result = _ed25519_verify_sig(data, data_size, signkey, signature);
+        result =
+            dmsg_sig_batch_add(
+                batch,
+                object->signet_origin,
+                0,
+                signature,
+                data,
+                data_size,
+                NULL,
+                data,
+                "meta bounce origin signature");
         dmsg_message_chunk_destroy(decrypted);
-        free(data);
 
-        if (result < 0) {
-            _free_ed25519_key(signkey);
-            RET_ERROR_INT(
-                ERR_UNSPEC,
-                "error during validation of meta bounce origin signature");
-        } else if(!result) {
-            _free_ed25519_key(signkey);
+        if (result) {
             RET_ERROR_INT(
                 ERR_UNSPEC,
-                "meta bounce origin signature is invalid");
+                "could not verify meta bounce origin signature");
         }
 
     }
@@ -4849,7 +5600,6 @@ dmsg_chunks_sig_origin_validate(
                         | CHUNK_SECTION_DISPLAY),
                     &data_size)))
         {
-            free_ed25519_key(signkey);
             RET_ERROR_INT(
                 ERR_UNSPEC,
                 "could not serialize envelope metadata and display "
@@ -4863,7 +5613,6 @@ dmsg_chunks_sig_origin_validate(
                     kek)))
         {
             free(data);
-            _free_ed25519_key(signkey);
             RET_ERROR_INT(
                 ERR_UNSPEC,
                 "could not decrypt origin display bounce chunk");
@@ -4875,26 +5624,28 @@ dmsg_chunks_sig_origin_validate(
         {
             dmsg_message_chunk_destroy(decrypted);
             free(data);
-            _free_ed25519_key(signkey);
             RET_ERROR_INT(
                 ERR_UNSPEC,
                 "could not retrieve dispaly bounce chunk data");
         }
 
-        result = _ed25519_verify_sig(data, data_size, signkey, signature);
+        result =
+            dmsg_sig_batch_add(
+                batch,
+                object->signet_origin,
+                0,
+                signature,
+                data,
+                data_size,
+                NULL,
+                data,
+                "origin display bounce signature");
         dmsg_message_chunk_destroy(decrypted);
-        free(data);
 
-        if (result < 0) {
-            _free_ed25519_key(signkey);
-            RET_ERROR_INT(
-                ERR_UNSPEC,
-                "error during validation of origin display bounce signaure");
-        } else if (!result) {
-            _free_ed25519_key(signkey);
+        if (result) {
             RET_ERROR_INT(
                 ERR_UNSPEC,
-                "origin display bounce signature is invalid");
+                "could not verify origin display bounce signature");
         }
 
     }
@@ -4906,7 +5657,6 @@ dmsg_chunks_sig_origin_validate(
                 CHUNK_TYPE_SIG_ORIGIN_DISPLAY_BOUNCE,
                 &data_size)))
     {
-        _free_ed25519_key(signkey);
         RET_ERROR_INT(ERR_UNSPEC, "could not serialize the dmime message");
     }
 
@@ -4917,7 +5667,6 @@ dmsg_chunks_sig_origin_validate(
                 kek)))
     {
         free(data);
-        _free_ed25519_key(signkey);
         RET_ERROR_INT(ERR_UNSPEC, "could not decrypt chunk");
     }
 
@@ -4927,25 +5676,26 @@ dmsg_chunks_sig_origin_validate(
     {
         dmsg_message_chunk_destroy(decrypted);
         free(data);
-        _free_ed25519_key(signkey);
         RET_ERROR_INT(
             ERR_UNSPEC,
             "could not retrieve origin full sig chunk data");
     }
 
-    result = _ed25519_verify_sig(data, data_size, signkey, signature);
+    result =
+        dmsg_sig_batch_add(
+            batch,
+            object->signet_origin,
+            0,
+            signature,
+            data,
+            data_size,
+            NULL,
+            data,
+            "origin full signature");
     dmsg_message_chunk_destroy(decrypted);
-    free(data);
-    _free_ed25519_key(signkey);
 
-    if(result < 0) {
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "error during validation of display bounce origin signature");
-    } else if(!result) {
-        RET_ERROR_INT(
-            ERR_UNSPEC,
-            "display bounce origin signature is invalid");
+    if(result) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not verify origin full signature");
     }
 
     return 0;
@@ -4972,6 +5722,9 @@ dmsg_message_decrypt_as_dest(
     dmime_message_t const *msg,
     dmime_kek_t *kek)
 {
+    dmsg_sig_batch_t batch;
+    int result;
+
     if (!obj || !msg || !kek) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
@@ -4999,17 +5752,28 @@ dmsg_message_decrypt_as_dest(
     }
 
     obj->state = DMIME_OBJECT_STATE_LOADED_SIGNETS;
+    memset(&batch, 0, sizeof(batch));
 
-    if(dmsg_chunk_destination_decrypt(obj, msg, kek)) {
+    if(dmsg_chunk_destination_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_destroy(&batch);
         RET_ERROR_INT(
             ERR_UNSPEC, "could not load destination chunk contents");
     }
 
     // TODO Handle cases where the message is a bounce.
-    if(dmsg_chunks_sig_origin_validate(obj, msg, kek)) {
+    if(dmsg_chunks_sig_origin_validate(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_destroy(&batch);
         RET_ERROR_INT(ERR_UNSPEC, "could not verify origin signature chunks");
     }
 
+    // Whatever signatures are still waiting in the batch are verified last.
+    result = dmsg_sig_batch_flush(&batch);
+    dmsg_sig_batch_destroy(&batch);
+
+    if (result) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not verify message signatures");
+    }
+
     obj->state = DMIME_OBJECT_STATE_COMPLETE;
 
     return 0;
@@ -5036,6 +5800,8 @@ dmsg_message_decrypt_as_recp(
     dmime_message_t const *msg,
     dmime_kek_t *kek)
 {
+    dmsg_sig_batch_t batch;
+
     if (!obj || !msg || !kek) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
@@ -5064,12 +5830,15 @@ dmsg_message_decrypt_as_recp(
     }
 
     obj->state = DMIME_OBJECT_STATE_LOADED_SIGNETS;
+    memset(&batch, 0, sizeof(batch));
 
-    if(dmsg_chunk_origin_decrypt(obj, msg, kek)) {
+    if(dmsg_chunk_origin_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not load origin chunk contents");
     }
 
-    if(dmsg_chunk_destination_decrypt(obj, msg, kek)) {
+    if(dmsg_chunk_destination_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not load destination chunk contents");
     }
 
@@ -5079,26 +5848,40 @@ dmsg_message_decrypt_as_recp(
     // but the full author signature can't always be verified.
     // TODO technically author/recipients should only have to verify the tree
     // signature.
-    if (dmsg_chunks_sig_author_validate(obj, msg, kek)) {
+    if (dmsg_chunks_sig_author_validate(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not verify author signature chunks");
     }
 
-    if(dmsg_chunks_sig_origin_validate(obj, msg, kek)) {
+    if(dmsg_chunks_sig_origin_validate(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not verify recipient signature chunks");
     }
 
-    if(dmsg_chunk_headers_common_decrypt(obj, msg, kek)) {
+    if(dmsg_chunk_headers_common_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not load common headers chunk contents");
     }
 
-    if(dmsg_chunk_headers_other_decrypt(obj, msg, kek)) {
+    if(dmsg_chunk_headers_other_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not load common headers chunk contents");
     }
 
-    if(dmsg_chunks_content_decrypt(obj, msg, kek)) {
+    if(dmsg_chunks_content_decrypt(obj, msg, kek, &batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
         RET_ERROR_INT(ERR_UNSPEC, "could not load mesage content");
     }
 
+    // Whatever signatures are still waiting in the batch are verified last.
+    // Until then, none of the data loaded into the object can be trusted.
+    if (dmsg_sig_batch_flush(&batch)) {
+        dmsg_sig_batch_abort(&batch, obj);
+        RET_ERROR_INT(ERR_UNSPEC, "could not verify message signatures");
+    }
+
+    dmsg_sig_batch_destroy(&batch);
+
     obj->state = DMIME_OBJECT_STATE_COMPLETE;
 
     return 0;
@@ -6199,6 +6982,41 @@ dime_dmsg_message_binary_serialize(
         outsize);
 }
 
+/**
+ * @brief
+ *  describes the complete binary form of the specified sections of a dmime
+ *  message as an iovec array pointing into the message, so that it can be
+ *  written out without first being serialized into one buffer. the message
+ *  must be at least signed by author, and must outlive the array.
+ * @param msg
+ *  dmime message to be described.
+ * @param sections
+ *  sections to be included.
+ * @param tracing
+ *  if set, include tracing, if clear don't include tracing.
+ * @param iovcnt
+ *  stores the number of entries in the returned array.
+ * @param outsize
+ *  stores the total size of the binary the entries describe.
+ * @free_using{free}
+*/
+struct iovec *
+dime_dmsg_message_binary_iovec(
+    dmime_message_t const *msg,
+    unsigned char sections,
+    unsigned char tracing,
+    size_t *iovcnt,
+    size_t *outsize)
+{
+    PUBLIC_FUNCTION_IMPLEMENT(
+        dmsg_message_iovec_get,
+        msg,
+        sections,
+        tracing,
+        iovcnt,
+        outsize);
+}
+
 /**
  * @brief
  *  decrypts, verifies and extracts all the information available to the author
@@ -6326,7 +7144,36 @@ dime_dmsg_message_encrypt(
     dmime_object_t *object,
     ED25519_KEY *signkey)
 {
-    PUBLIC_FUNCTION_IMPLEMENT(dmsg_message_encrypt, object, signkey);
+    PUBLIC_FUNCTION_IMPLEMENT(dmsg_message_encrypt, object, signkey, 1);
+}
+
+/**
+ * @brief
+ *  converts a dmime object to a dmime message as an author, like
+ *  dime_dmsg_message_encrypt(), but signs and encrypts the display and
+ *  attachment chunks on several threads at once.
+ * @note
+ *  openssl must be set up for use by multiple threads.
+ * @param object
+ *  dmime object which contains all the envelope, metadata, display and
+ *  attachment information.  as well as pointers to signets of author, origin,
+ *  destination and recipient.
+ * @param signkey
+ *  the author's private ed25519 signing key which will be used.
+ * @param nworkers
+ *  the maximum number of threads, including the calling thread, the chunks
+ *  are divided between. it is capped at DMIME_ENCRYPT_MAX_WORKERS.
+ * @return
+ *  a pointer to a fully signed and encrypted dmime message.
+ * @free_using{dime_dmsg_destroy_message}
+*/
+dmime_message_t *
+dime_dmsg_message_encrypt_parallel(
+    dmime_object_t *object,
+    ED25519_KEY *signkey,
+    unsigned int nworkers)
+{
+    PUBLIC_FUNCTION_IMPLEMENT(dmsg_message_encrypt, object, signkey, nworkers);
 }
 
 /**
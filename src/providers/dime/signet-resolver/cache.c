@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <pthread.h>
 
@@ -22,19 +23,59 @@ static char *_cachefile = NULL;
 static char *_dime_dir = NULL;
 static uid_t _last_uid = 0;
 
+// Marks a hash index slot whose cached object has been removed, so that it doesn't break existing probe sequences.
+static cached_object_t _index_tombstone;
+#define CACHE_INDEX_TOMBSTONE (&_index_tombstone)
+
+// The state of the object cache journal, which holds all persisted changes made since the base cache file was last written.
+static int _cache_journaling = 1;
+static int _journal_fd = -1;
+static size_t _journal_size = 0;
+static size_t _cache_base_size = 0;
+static pthread_mutex_t _journal_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Memory mappings of cache files. Objects that haven't been decoded yet point into them, so they are kept for the life of the process.
+typedef struct cache_mapping {
+    void *addr;
+    size_t len;
+    struct cache_mapping *next;
+} cache_mapping_t;
+
+static cache_mapping_t *_cache_mappings = NULL;
+static pthread_mutex_t _mapping_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The global memory budget of the cache, and the approximate number of bytes held across all of its stores.
+static size_t _cache_max_bytes = 0;
+static size_t _cache_resident_bytes = 0;
+static pthread_mutex_t _budget_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The optional background thread that periodically sweeps expired objects out of the cache.
+static pthread_t _sweeper_thread;
+static int _sweeper_running = 0;
+static unsigned int _sweeper_interval = 0;
+static pthread_mutex_t _sweeper_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _sweeper_cond = PTHREAD_COND_INITIALIZER;
+
+// The lookups of objects missing from the cache that are currently in progress.
+static cached_flight_t *_cache_flights = NULL;
+static pthread_mutex_t _flight_lock = PTHREAD_MUTEX_INITIALIZER;
+
 // This is the global table that stores all the cache management functions for the different types of data supported by the object cache.
-cached_store_t cached_stores[cached_data_signet + 1] = {
-    { cached_data_unknown, "unknown", 0, NULL, PTHREAD_MUTEX_INITIALIZER, NULL, NULL, NULL, NULL, NULL },
-    { cached_data_drec, "DIME management records", 0, NULL, PTHREAD_MUTEX_INITIALIZER, &_destroy_dime_record_cb,
-      &_serialize_dime_record_cb, &_deserialize_dime_record_cb, &_dump_dime_record_cb, NULL },
-    { cached_data_dnskey, "DNSKEY records", 1, NULL, PTHREAD_MUTEX_INITIALIZER, &_destroy_dnskey_record_cb,
-      &_serialize_dnskey_record_cb, &_deserialize_dnskey_record_cb, &_dump_dnskey_record_cb, &_clone_dnskey_record_cb },
-    { cached_data_ds, "DS records", 1, NULL, PTHREAD_MUTEX_INITIALIZER, &_destroy_ds_record_cb,
-      &_serialize_ds_record_cb, &_deserialize_ds_record_cb, &_dump_ds_record_cb, NULL },
-    { cached_data_ocsp, "OCSP", 1, NULL, PTHREAD_MUTEX_INITIALIZER, &_destroy_ocsp_response_cb,
-      &_serialize_ocsp_response_cb, &_deserialize_ocsp_response_cb, &_dump_ocsp_response_cb, NULL },
-    { cached_data_signet, "signets", 0, NULL, PTHREAD_MUTEX_INITIALIZER, &_destroy_signet_cb,
-      &_serialize_signet_cb, &_deserialize_signet_cb, &_dump_signet_cb, NULL }
+cached_store_t cached_stores[cached_data_tls_session + 1] = {
+    { cached_data_unknown, "unknown", 0, NULL, PTHREAD_RWLOCK_INITIALIZER, NULL, NULL, NULL, NULL, NULL, NULL, CACHE_SHARDS_INITIALIZER, 0, CACHE_STATS_INITIALIZER, NULL, NULL, NULL, 0, 0 },
+    { cached_data_drec, "DIME management records", 0, NULL, PTHREAD_RWLOCK_INITIALIZER, &_destroy_dime_record_cb,
+      &_serialize_dime_record_cb, &_deserialize_dime_record_cb, &_dump_dime_record_cb, NULL, NULL, CACHE_SHARDS_INITIALIZER, 0, CACHE_STATS_INITIALIZER, NULL,
+      &_refresh_dime_record_cb, NULL, 0, 0 },
+    { cached_data_dnskey, "DNSKEY records", 1, NULL, PTHREAD_RWLOCK_INITIALIZER, &_destroy_dnskey_record_cb,
+      &_serialize_dnskey_record_cb, &_deserialize_dnskey_record_cb, &_dump_dnskey_record_cb, &_clone_dnskey_record_cb, NULL, CACHE_SHARDS_INITIALIZER, 0, CACHE_STATS_INITIALIZER, NULL, NULL, NULL, 0, 0 },
+    { cached_data_ds, "DS records", 1, NULL, PTHREAD_RWLOCK_INITIALIZER, &_destroy_ds_record_cb,
+      &_serialize_ds_record_cb, &_deserialize_ds_record_cb, &_dump_ds_record_cb, NULL, NULL, CACHE_SHARDS_INITIALIZER, 0, CACHE_STATS_INITIALIZER, NULL, NULL, NULL, 0, 0 },
+    { cached_data_ocsp, "OCSP", 1, NULL, PTHREAD_RWLOCK_INITIALIZER, &_destroy_ocsp_response_cb,
+      &_serialize_ocsp_response_cb, &_deserialize_ocsp_response_cb, &_dump_ocsp_response_cb, NULL, NULL, CACHE_SHARDS_INITIALIZER, 0, CACHE_STATS_INITIALIZER, NULL, NULL, NULL, 0, 0 },
+    { cached_data_signet, "signets", 0, NULL, PTHREAD_RWLOCK_INITIALIZER, &_destroy_signet_cb,
+      &_serialize_signet_cb, &_deserialize_signet_cb, &_dump_signet_cb, NULL, &_share_signet_cb, CACHE_SHARDS_INITIALIZER, 0, CACHE_STATS_INITIALIZER, NULL, NULL, NULL, 0, 0 },
+    { cached_data_tls_session, "TLS sessions", 0, NULL, PTHREAD_RWLOCK_INITIALIZER, &_destroy_tls_session_cb,
+      &_serialize_tls_session_cb, &_deserialize_tls_session_cb, &_dump_tls_session_cb, NULL, NULL, CACHE_SHARDS_INITIALIZER, 0, CACHE_STATS_INITIALIZER, NULL, NULL, NULL, 0, 0 }
 };
 
 
@@ -301,7 +342,7 @@ void *_get_cache_obj_data(cached_object_t *object) {
         return result;
     }
 
-    // If it's not internal, we are dealing with a deep copy of the cached data and it's OK to release it.
+    // If it's not internal, we are dealing with a deep copy or a shared reference of the cached data and it's OK to release it.
     object->data = NULL;
     _destroy_cache_entry(object);
 
@@ -340,6 +381,7 @@ void _destroy_cache_entry(cached_object_t *entry) {
 
     // TODO: What should we do if there is a cached object being shadowed by this one?
 
+    free(entry->name);
     memset(entry, 0, sizeof(cached_object_t));
     free(entry);
 
@@ -354,6 +396,22 @@ void _destroy_cache_entry(cached_object_t *entry) {
  */
 cached_object_t *_find_cached_object(const char *oid, cached_store_t *store) {
 
+    return _lookup_cached_object(oid, store, 0);
+}
+
+
+/**
+ * @brief   Find a cached object in a cached store, optionally as a copy that is independent of the cache.
+ * @note    Objects in internal stores are normally handed out directly. Callers that can't rule out the object being
+ *              replaced or evicted by another thread while they use it should ask for a copy instead.
+ * @param   oid a null-terminated string containing the unique name or identifier of the cached object.
+ * @param   store   a pointer to the cached store to be searched for the target object.
+ * @param   copy    if set, return a copy of the object even if it belongs to an internal store.
+ * @return  a pointer to the specified cached object, if found, or NULL on failure.
+ */
+cached_object_t *_lookup_cached_object(const char *oid, cached_store_t *store, int copy) {
+
+    cache_shard_t *shard;
     cached_object_t *ptr;
     unsigned char hashid[SHA_256_SIZE];
 
@@ -370,33 +428,52 @@ cached_object_t *_find_cached_object(const char *oid, cached_store_t *store) {
         RET_ERROR_PTR(ERR_UNSPEC, "could not compute SHA hash of cached object name");
     }
 
-    _lock_cache_store(store);
-    ptr = store->head;
+    // Lookups only need to share the lock of the shard holding the id. A stale match is left for the sweeper, and treated as if it had never been found.
+    shard = _get_cache_shard(store, hashid);
+    _rdlock_cache_shard(shard);
 
-    while (ptr) {
+    if (!(ptr = _index_find_object(store, hashid)) || _is_object_stale(ptr)) {
+        _unlock_cache_shard(shard);
+        __atomic_add_fetch(&(store->stats.misses), 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
 
-        // As we go along, evict any stale items.
-        if (_evict_if_stale(&ptr)) {
-            continue;
-        }
+    // Let the eviction hand and the sweeper know that the object is still in use.
+    __atomic_store_n(&(ptr->referenced), 1, __ATOMIC_RELAXED);
 
-        if (!memcmp(ptr->id, hashid, SHA_256_SIZE)) {
-            ptr = _clone_cached_object(ptr);
-            _unlock_cache_store(store);
+    if (!__atomic_load_n(&(ptr->hot), __ATOMIC_RELAXED)) {
+        __atomic_store_n(&(ptr->hot), 1, __ATOMIC_RELAXED);
+    }
 
-            if (!ptr) {
-                RET_ERROR_PTR(ERR_UNSPEC, "unable to create deep copy of cloned object");
-            }
+    // If data that will be handed out directly still has to be decoded, the lookup is repeated under the store lock, which every decoder must hold.
+    if (copy) {
+        ptr = _copy_cached_object(ptr);
+        _unlock_cache_shard(shard);
+    } else if (ptr->mapped && (store->internal || store->share)) {
+        _unlock_cache_shard(shard);
+        _rdlock_cache_store(store);
 
-            return ptr;
+        if (!(ptr = _index_find_object(store, hashid)) || _is_object_stale(ptr)) {
+            _unlock_cache_store(store);
+            __atomic_add_fetch(&(store->stats.misses), 1, __ATOMIC_RELAXED);
+            return NULL;
         }
 
-        ptr = ptr->next;
+        _materialize_cached_object(ptr);
+        ptr = _clone_cached_object(ptr);
+        _unlock_cache_store(store);
+    } else {
+        ptr = _clone_cached_object(ptr);
+        _unlock_cache_shard(shard);
     }
 
-    _unlock_cache_store(store);
+    if (!ptr) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to create deep copy of cloned object");
+    }
 
-    return NULL;
+    __atomic_add_fetch(&(store->stats.hits), 1, __ATOMIC_RELAXED);
+
+    return ptr;
 }
 
 
@@ -421,17 +498,20 @@ cached_object_t *_find_cached_object_cmp(const void *key, cached_store_t *store,
         RET_ERROR_PTR(ERR_PERM, NULL);
     }
 
-    _lock_cache_store(store);
+    _rdlock_cache_store(store);
     ptr = store->head;
 
     while (ptr) {
 
-        // As we go along, evict any stale items.
-        if (_evict_if_stale(&ptr)) {
+        // Stale items are skipped over, and left for the sweeper to evict.
+        if (_is_object_stale(ptr)) {
+            ptr = ptr->next;
             continue;
         }
 
-        if (!cmpfn(ptr->data, key)) {
+        if (!cmpfn(_materialize_cached_object(ptr), key)) {
+            __atomic_store_n(&(ptr->referenced), 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&(ptr->hot), 1, __ATOMIC_RELAXED);
             ptr = _clone_cached_object(ptr);
             _unlock_cache_store(store);
 
@@ -439,6 +519,8 @@ cached_object_t *_find_cached_object_cmp(const void *key, cached_store_t *store,
                 RET_ERROR_PTR(ERR_UNSPEC, "unable to create deep copy of cloned object");
             }
 
+            __atomic_add_fetch(&(store->stats.hits), 1, __ATOMIC_RELAXED);
+
             return ptr;
         }
 
@@ -446,6 +528,7 @@ cached_object_t *_find_cached_object_cmp(const void *key, cached_store_t *store,
     }
 
     _unlock_cache_store(store);
+    __atomic_add_fetch(&(store->stats.misses), 1, __ATOMIC_RELAXED);
 
     return NULL;
 }
@@ -459,6 +542,7 @@ cached_object_t *_find_cached_object_cmp(const void *key, cached_store_t *store,
  */
 int _cached_object_exists(const unsigned char *hashid, cached_store_t *store) {
 
+    cache_shard_t *shard;
     cached_object_t *ptr;
 
     if (!store || !hashid) {
@@ -469,28 +553,17 @@ int _cached_object_exists(const unsigned char *hashid, cached_store_t *store) {
         RET_ERROR_INT(ERR_UNSPEC, "no permission to read cache contents");
     }
 
-    _lock_cache_store(store);
-    ptr = store->head;
-
-    // If the store is empty, don't worry; if not, see that we don't already exist.
-    while (ptr) {
-
-        // As we go along, evict any stale items.
-        if (_evict_if_stale(&ptr)) {
-            continue;
-        }
-
-        if (!memcmp(ptr->id, hashid, SHA_256_SIZE)) {
-            _unlock_cache_store(store);
-            return 1;
-        }
+    shard = _get_cache_shard(store, hashid);
+    _rdlock_cache_shard(shard);
 
-        ptr = ptr->next;
+    if (!(ptr = _index_find_object(store, hashid)) || _is_object_stale(ptr)) {
+        _unlock_cache_shard(shard);
+        return 0;
     }
 
-    _unlock_cache_store(store);
+    _unlock_cache_shard(shard);
 
-    return 0;
+    return 1;
 }
 
 
@@ -515,18 +588,19 @@ int _cached_object_exists_cmp(const void *key, cached_store_t *store, cached_sto
         RET_ERROR_INT(ERR_UNSPEC, "no permission to read cache contents");
     }
 
-    _lock_cache_store(store);
+    _rdlock_cache_store(store);
     ptr = store->head;
 
     // If the store is empty, don't worry; if not, see that we don't already exist.
     while (ptr) {
 
-        // As we go along, evict any stale items.
-        if (_evict_if_stale(&ptr)) {
+        // Stale items are skipped over, and left for the sweeper to evict.
+        if (_is_object_stale(ptr)) {
+            ptr = ptr->next;
             continue;
         }
 
-        if (!cmpfn(ptr->data, key)) {
+        if (!cmpfn(_materialize_cached_object(ptr), key)) {
             _unlock_cache_store(store);
             return 1;
         }
@@ -555,8 +629,7 @@ int _cached_object_exists_cmp(const void *key, cached_store_t *store, cached_sto
  */
 cached_object_t *_add_cached_object(const char *id, cached_store_t *store, unsigned long ttl, time_t expiration, void *data, int persists, int relaxed) {
 
-    cached_object_t *ptr, *entry, *optr, *result;
-    void *odata;
+    cached_object_t *ptr, *entry, *result;
     unsigned char hashid[SHA_256_SIZE];
 
     if (!id || !store) {
@@ -571,74 +644,94 @@ cached_object_t *_add_cached_object(const char *id, cached_store_t *store, unsig
         RET_ERROR_PTR(ERR_UNSPEC, "could not compute SHA hash of new cache entry");
     }
 
-    _lock_cache_store(store);
-    ptr = store->head;
-
-    // If the store is empty, don't worry; if not, see that we don't already exist.
-    while (ptr) {
-
-        // As we go along, evict any stale items.
-        if (_evict_if_stale(&ptr)) {
-            continue;
-        }
+    // The new object is created and sized before taking the store lock, since sizing it may mean serializing its data.
+    if (!(entry = _create_cached_object(store->dtype, ttl, expiration, data, persists, relaxed))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to create new cached object");
+    }
 
-        if (!memcmp(ptr->id, hashid, SHA_256_SIZE)) {
-            _unlock_cache_store(store);
-            RET_ERROR_PTR_FMT(ERR_UNSPEC, "could not add cached object to store because object id already exists: %s", id);
-        }
+    memcpy(entry->id, hashid, SHA_256_SIZE);
+    _size_cached_object(entry);
+    _lock_cache_store(store);
 
-        ptr = ptr->next;
+    // Make sure we don't already exist. A stale entry with the same id is evicted to make room for the new one.
+    if ((ptr = _index_find_object(store, hashid)) && !_evict_if_stale(&ptr)) {
+        _unlock_cache_store(store);
+        free(entry);
+        RET_ERROR_PTR_FMT(ERR_UNSPEC, "could not add cached object to store because object id already exists: %s", id);
     }
 
-    // TODO: Can't we use _create_cached_object() here?
-    if (!(entry = malloc(sizeof(cached_object_t)))) {
-        PUSH_ERROR_SYSCALL("malloc");
+    if (!(result = _publish_cached_object(store, entry, NULL, 0, id))) {
+        free(entry);
         _unlock_cache_store(store);
-        RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for new cached object");
+        RET_ERROR_PTR(ERR_UNSPEC, "could not add new cached object to store");
     }
 
-    // Initialize the new object.
-    memset(entry, 0, sizeof(cached_object_t));
+    _unlock_cache_store(store);
+    _enforce_cache_budget(store);
 
-    if (time(&(entry->timestamp)) == (time_t)-1) {
-        PUSH_ERROR_SYSCALL("time");
-        free(entry);
-        _unlock_cache_store(store);
-        RET_ERROR_PTR(ERR_UNSPEC, "could not calculate timestamp for new cached object");
+    return result;
+}
+
+
+/**
+ * @brief   Create and add an object to the cache, overriding any existing object with a clashing id.
+ * @note    This is the shared implementation of _add_cached_object_forced() and _replace_cached_object().
+ * @param   shadow  if set, the overridden object is kept as the shadow of the new one; otherwise it is destroyed.
+ * @return  a pointer to the newly allocated cached object for the specified data on success, or NULL on failure.
+ */
+static cached_object_t *_override_cached_object(const char *id, cached_store_t *store, unsigned long ttl, time_t expiration, void *data, int persists, int relaxed, int shadow) {
+
+    cached_object_t *found, *newobj, *result;
+    unsigned char hashid[SHA_256_SIZE];
+
+    if (!id || !store) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
-    memcpy(entry->id, hashid, SHA_256_SIZE);
-    entry->dtype = store->dtype;
-    entry->ttl = ttl;
-    entry->expiration = expiration;
-    entry->data = data;
-    entry->persists = persists;
-    entry->relaxed = relaxed;
+    if (!(_cache_flags & CACHE_PERM_ADD)) {
+        RET_ERROR_PTR(ERR_PERM, NULL);
+    }
 
-    // Prepend it to the beginning of the linked list.
-    optr = store->head;
-    store->head = entry;
-    entry->next = optr;
+    if (_compute_sha_hash(256, (unsigned char *)id, strlen(id), hashid) < 0) {
+        RET_ERROR_PTR(ERR_UNSPEC, "could not compute SHA hash of new cache entry");
+    }
 
-    if (optr) {
-        optr->prev = entry;
+    // The new object is created and sized before taking the store lock, since sizing it may mean serializing its data.
+    if (!(newobj = _create_cached_object(store->dtype, ttl, expiration, data, persists, relaxed))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to create new cached object");
     }
 
-    result = _clone_cached_object(entry);
+    memcpy(newobj->id, hashid, SHA_256_SIZE);
+    _size_cached_object(newobj);
+    _lock_cache_store(store);
 
-    // Protect against misbehaving callers who don't check this function return value, and continue to reference the original data address, instead of the returned value.
-    if (result && (result->data != entry->data)) {
-        odata = entry->data;
-        entry->data = result->data;
-        result->data = odata;
+    // If we find a clashing object, it is overridden by the new one. A stale clashing object is simply evicted.
+    if ((found = _index_find_object(store, hashid)) && _evict_if_stale(&found)) {
+        found = NULL;
     }
 
-    _unlock_cache_store(store);
+    if (found && (_verbose >= 1)) {
+        _dbgprint(1, "Forcibly overriding existing conflicting entry in cache: ");
+
+        _dump_cache_data(stderr, found, 1);
+        fprintf(stderr, "\n");
+
+        if (_verbose >= 2) {
+            _dump_cache_data(stderr, found, 0);
+        }
 
-    if (!result) {
-        RET_ERROR_PTR(ERR_UNSPEC, NULL);
     }
 
+    // The old cache object (if any) either becomes our shadow or is destroyed.
+    if (!(result = _publish_cached_object(store, newobj, found, shadow, id))) {
+        free(newobj);
+        _unlock_cache_store(store);
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to add or replace entry in cache");
+    }
+
+    _unlock_cache_store(store);
+    _enforce_cache_budget(store);
+
     return result;
 }
 
@@ -661,64 +754,28 @@ cached_object_t *_add_cached_object(const char *id, cached_store_t *store, unsig
  */
 cached_object_t *_add_cached_object_forced(const char *id, cached_store_t *store, unsigned long ttl, time_t expiration, void *data, int persists, int relaxed) {
 
-    cached_object_t *found, *newobj, *result;
-    void *odata;
-
-    if (!id || !store) {
-        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
-    }
-
-    if (!(_cache_flags & CACHE_PERM_ADD)) {
-        RET_ERROR_PTR(ERR_PERM, NULL);
-    }
-
-    // TODO: thread-safe code needs to be added here.
-    // If we find a clashing object, remove it.
-    if ((found = _find_cached_object(id, store))) {
-
-        if (_verbose >= 1) {
-            _dbgprint(1, "Forcibly overriding existing conflicting entry in cache: ");
-
-            _dump_cache_data(stderr, found, 1);
-            fprintf(stderr, "\n");
-
-            if (_verbose >= 2) {
-                _dump_cache_data(stderr, found, 0);
-            }
-
-        }
-
-        // We create the new object to replace the old one.
-        if (!(newobj = _create_cached_object(store->dtype, ttl, expiration, data, persists, relaxed))) {
-            _destroy_cache_entry(found);
-            RET_ERROR_PTR(ERR_UNSPEC, "unable to create new cached object");
-        }
-
-        // Call replace and make the old cache object our shadow.
-        if (!_replace_object(found, newobj, 1)) {
-            _destroy_cache_entry(newobj);
-            RET_ERROR_PTR(ERR_UNSPEC, "unable to replace entry in cache");
-        }
-
-        result = _clone_cached_object(newobj);
-
-        // Protect against misbehaving callers who don't check this function return value, and continue to reference the original data address, instead of the returned value.
-        if (result && (result->data != newobj->data)) {
-            odata = newobj->data;
-            newobj->data = result->data;
-            result->data = odata;
-        }
+    return _override_cached_object(id, store, ttl, expiration, data, persists, relaxed, 1);
+}
 
-    } else {
-        // Otherwise we still have to add it normally.
-        result = _add_cached_object(id, store, ttl, expiration, data, persists, relaxed);
-    }
 
-    if (!result) {
-        RET_ERROR_PTR(ERR_UNSPEC, NULL);
-    }
+/**
+ * @brief   Create and add an object to the cache, replacing and destroying any existing object with a clashing id.
+ * @note    Unlike _add_cached_object_forced(), the replaced object is not kept as a shadow, so this is the function to use
+ *              for data that is superseded over and over again, like TLS sessions and OCSP responses.
+ * @param   id      a unique identifier to be associated with the cached object in the store.
+ * @param   store       a pointer to the cached store that will hold the new cached object.
+ * @param   ttl     an optional time-to-live value for the cached object, in seconds.
+ * @param   expiration  an optional expiration date for the cached object, as a UTC time.
+ * @param   data        a pointer to the object-specific data to be associated with the cache entry.
+ * @param   persists    if set, the cached object will be persisted to disk when the cache is saved.
+ * @param   relaxed     if set, use a relaxed cache policy; this ensures that even if the entry's TTL has
+ *              expired, if its absolute (UTC) expiration has not been reached, it will not be
+ *              evicted from the cache, but will delivery a refresh notification to the caller.
+ * @return  a pointer to the newly allocated cached object for the specified data on success, or NULL on failure.
+ */
+cached_object_t *_replace_cached_object(const char *id, cached_store_t *store, unsigned long ttl, time_t expiration, void *data, int persists, int relaxed) {
 
-    return result;
+    return _override_cached_object(id, store, ttl, expiration, data, persists, relaxed, 0);
 }
 
 
@@ -740,8 +797,7 @@ cached_object_t *_add_cached_object_forced(const char *id, cached_store_t *store
  */
 cached_object_t *_add_cached_object_cmp(const char *id, const void *key, cached_store_t *store, unsigned long ttl, time_t expiration, void *data, int persists, int relaxed, cached_store_comparator_t cmpfn) {
 
-    cached_object_t *ptr, *entry, *optr, *result;
-    void *odata;
+    cached_object_t *ptr, *entry, *result;
     unsigned char hashid[SHA_256_SIZE];
 
     if (!id || !store || !cmpfn) {
@@ -756,6 +812,14 @@ cached_object_t *_add_cached_object_cmp(const char *id, const void *key, cached_
         RET_ERROR_PTR(ERR_UNSPEC, "could not compute SHA hash of new cache entry");
     }
 
+    // The new object is created and sized before taking the store lock, since sizing it may mean serializing its data.
+    if (!(entry = _create_cached_object(store->dtype, ttl, expiration, data, persists, relaxed))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to create new cached object");
+    }
+
+    // The only additional field that needs to be set for the cached object is the hashed id.
+    memcpy(entry->id, hashid, SHA_256_SIZE);
+    _size_cached_object(entry);
     _lock_cache_store(store);
     ptr = store->head;
 
@@ -770,46 +834,25 @@ cached_object_t *_add_cached_object_cmp(const char *id, const void *key, cached_
         // We don't want to have an entry that clashes in ID or that fails the comparator test.
         if (!memcmp(ptr->id, hashid, SHA_256_SIZE)) {
             _unlock_cache_store(store);
+            free(entry);
             RET_ERROR_PTR(ERR_UNSPEC, "could not add cached object to store because object ID already exists");
-        } else if (!cmpfn(ptr->data, key)) {
+        } else if (!cmpfn(_materialize_cached_object(ptr), key)) {
             _unlock_cache_store(store);
+            free(entry);
             RET_ERROR_PTR(ERR_UNSPEC, "could not add cached object to store because a similar object already exists");
         }
 
         ptr = ptr->next;
     }
 
-    if (!(entry = _create_cached_object(store->dtype, ttl, expiration, data, persists, relaxed))) {
+    if (!(result = _publish_cached_object(store, entry, NULL, 0, id))) {
+        free(entry);
         _unlock_cache_store(store);
-        RET_ERROR_PTR(ERR_UNSPEC, "unable to create new cached object");
-    }
-
-    // The only additional field that needs to be set for the cached object is the hashed id.
-    memcpy(entry->id, hashid, SHA_256_SIZE);
-
-    // Prepend it to the beginning of the linked list.
-    optr = store->head;
-    store->head = entry;
-    entry->next = optr;
-
-    if (optr) {
-        optr->prev = entry;
-    }
-
-    result = _clone_cached_object(entry);
-
-    // Protect against misbehaving callers who don't check this function return value, and continue to reference the original data address, instead of the returned value.
-    if (result && (result->data != entry->data)) {
-        odata = entry->data;
-        entry->data = result->data;
-        result->data = odata;
+        RET_ERROR_PTR(ERR_UNSPEC, "could not add new cached object to store");
     }
 
     _unlock_cache_store(store);
-
-    if (!result) {
-        RET_ERROR_PTR(ERR_UNSPEC, NULL);
-    }
+    _enforce_cache_budget(store);
 
     return result;
 }
@@ -835,9 +878,9 @@ cached_object_t *_add_cached_object_cmp(const char *id, const void *key, cached_
 cached_object_t *_add_cached_object_cmp_forced(const char *id, const void *key, cached_store_t *store, unsigned long ttl, time_t expiration, void *data, int persists, int relaxed, cached_store_comparator_t cmpfn) {
 
     cached_object_t *found, *newobj, *result;
-    void *odata;
+    unsigned char hashid[SHA_256_SIZE];
 
-    if (!id || !store) {
+    if (!id || !store || !cmpfn) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
@@ -845,101 +888,183 @@ cached_object_t *_add_cached_object_cmp_forced(const char *id, const void *key,
         RET_ERROR_PTR(ERR_PERM, NULL);
     }
 
-    // TODO: Needs to be made thread-safe.
-    // If we find a clashing object, remove it.
-    if ((found = _find_cached_object_cmp(key, store, cmpfn)) || (found = _find_cached_object(id, store))) {
+    if (_compute_sha_hash(256, (unsigned char *)id, strlen(id), hashid) < 0) {
+        RET_ERROR_PTR(ERR_UNSPEC, "could not compute SHA hash of new cache entry");
+    }
+
+    // The new object is created and sized before taking the store lock, since sizing it may mean serializing its data.
+    if (!(newobj = _create_cached_object(store->dtype, ttl, expiration, data, persists, relaxed))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to create new cached object");
+    }
 
-        if (_verbose >= 1) {
-            _dbgprint(1, "Forcibly overriding existing conflicting entry in cache: ");
-            _dump_cache_data(stderr, found, 1);
+    memcpy(newobj->id, hashid, SHA_256_SIZE);
+    _size_cached_object(newobj);
+    _lock_cache_store(store);
+    found = store->head;
 
-            if (_verbose >= 2) {
-                _dump_cache_data(stderr, found, 0);
-            }
+    // If we find a clashing object, by comparator or by id, it is overridden by the new one. As we go along, evict any stale items.
+    while (found) {
 
+        if (_evict_if_stale(&found)) {
+            continue;
         }
 
-        // We create the new object to replace the old one.
-        if (!(newobj = _create_cached_object(store->dtype, ttl, expiration, data, persists, relaxed))) {
-            _destroy_cache_entry(found);
-            RET_ERROR_PTR(ERR_UNSPEC, "unable to create new cached object");
+        if (!cmpfn(_materialize_cached_object(found), key)) {
+            break;
         }
 
-        // Call replace and make the old cache object our shadow.
-        if (!_replace_object(found, newobj, 1)) {
-            _destroy_cache_entry(newobj);
-            RET_ERROR_PTR(ERR_UNSPEC, "unable to replace entry in cache");
-        }
+        found = found->next;
+    }
+
+    if (!found && (found = _index_find_object(store, hashid)) && _evict_if_stale(&found)) {
+        found = NULL;
+    }
 
-        result = _clone_cached_object(newobj);
+    if (found && (_verbose >= 1)) {
+        _dbgprint(1, "Forcibly overriding existing conflicting entry in cache: ");
+        _dump_cache_data(stderr, found, 1);
 
-        // Protect against misbehaving callers who don't check this function return value,
-        // and continue to reference the original data address, instead of the returned value.
-        if (result && (result->data != newobj->data)) {
-            odata = newobj->data;
-            newobj->data = result->data;
-            result->data = odata;
+        if (_verbose >= 2) {
+            _dump_cache_data(stderr, found, 0);
         }
 
-    } else {
-        result = _add_cached_object_cmp(id, key, store, ttl, expiration, data, persists, relaxed, cmpfn);
     }
 
-    if (!result) {
-        RET_ERROR_PTR(ERR_UNSPEC, NULL);
+    // The old cache object (if any) becomes our shadow.
+    if (!(result = _publish_cached_object(store, newobj, found, 1, id))) {
+        free(newobj);
+        _unlock_cache_store(store);
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to add or replace entry in cache");
     }
 
+    _unlock_cache_store(store);
+    _enforce_cache_budget(store);
+
     return result;
 }
 
 
 /**
- * @brief   Remove an object from a cached store by name.
- * @note    The caller is still responsible for freeing the cached object and its underlying data.
- * @param   oid the unique identifier of the cached object to be removed.
- * @param   store   a pointer to the cached store from which the specified object will be removed.
- * @return  1 if the object was successfully removed or 0 if it couldn't be found; -1 on general error.
+ * @brief   Make a newly created cached object visible in its cached store, and get a copy of it for the caller.
+ * @note    The caller must hold the cached store lock exclusively. The copy is taken before the object is published,
+ *              since lookups by id only take a shard lock and could otherwise see its data being swapped out.
+ * @param   store       a pointer to the cached store that will hold the new cached object.
+ * @param   entry       a pointer to the new cached object, with its hashed id already set.
+ * @param   replaced    if not NULL, the live cached object in the store to be replaced by the new one.
+ * @param   shadow      if set, the replaced object is kept as the shadow of the new one; otherwise it is destroyed.
+ * @param   name        the unhashed id of the new cached object, which is remembered if its store refreshes objects.
+ * @return  NULL on failure, or a pointer to a copy of the new cached object for the caller on success.
+ *              On failure the entry is left unpublished, holding its original data, for the caller to dispose of.
  */
-int _remove_cached_object(const char *oid, cached_store_t *store) {
+cached_object_t *_publish_cached_object(cached_store_t *store, cached_object_t *entry, cached_object_t *replaced, int shadow, const char *name) {
 
-    cached_object_t *ptr;
-    unsigned char hashid[SHA_256_SIZE];
+    cached_object_t *result;
+    void *odata;
+    int swapped = 0;
 
-    if (!oid || !store) {
-        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    if (!store || !entry) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
-    if (!(_cache_flags & CACHE_PERM_DELETE)) {
-        RET_ERROR_INT(ERR_PERM, NULL);
+    // Refreshing an object means looking it up again, which can only be done by its original id.
+    if (name && store->refresh && !entry->name && !(entry->name = strdup(name))) {
+        PUSH_ERROR_SYSCALL("strdup");
+        fprintf(stderr, "Error: could not remember id of new cached object; it won't be refreshed.\n");
+        dump_error_stack();
+        _clear_error_stack();
     }
 
-    if (_compute_sha_hash(256, (unsigned char *)oid, strlen(oid), hashid) < 0) {
-        RET_ERROR_INT(ERR_UNSPEC, "could not compute SHA hash of removed cache entry");
+    if (!(result = _clone_cached_object(entry))) {
+        free(entry->name);
+        entry->name = NULL;
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to create copy of new cached object");
     }
 
-    _lock_cache_store(store);
-    ptr = store->head;
+    // Protect against misbehaving callers who don't check this function return value, and continue to reference the original data address, instead of the returned value.
+    if (result != entry && result->data != entry->data) {
+        odata = entry->data;
+        entry->data = result->data;
+        result->data = odata;
+        swapped = 1;
+    }
 
-    // If we find the cached object, cut it from the store's linked list.
-    while (ptr) {
+    if ((replaced && !_replace_object(replaced, entry, shadow)) || (!replaced && _link_object(store, entry) < 0)) {
 
-        // As we go along, evict any stale items.
-        if (_evict_if_stale(&ptr)) {
-            continue;
+        if (swapped) {
+            odata = result->data;
+            result->data = entry->data;
+            entry->data = odata;
         }
 
-        if (!memcmp(ptr->id, hashid, SHA_256_SIZE)) {
-            _unlink_object(ptr, 1, 0);
-            _unlock_cache_store(store);
-            return 1;
+        if (result != entry) {
+            _destroy_cache_entry(result);
         }
 
-        ptr = ptr->next;
+        free(entry->name);
+        entry->name = NULL;
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to publish new cached object in store");
+    }
+
+    __atomic_add_fetch(&(store->stats.inserts), 1, __ATOMIC_RELAXED);
+
+    // A replacement inherits the id of the object it replaced.
+    if (replaced) {
+        memcpy(result->id, entry->id, sizeof(result->id));
+    }
+
+    // Failing to journal the change only costs us its persistence, so it isn't fatal.
+    if (_journal_cached_object(entry) < 0) {
+        fprintf(stderr, "Error: could not record cached object in cache journal.\n");
+        dump_error_stack();
+        _clear_error_stack();
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief   Remove an object from a cached store by name.
+ * @note    The caller is still responsible for freeing the cached object and its underlying data.
+ * @param   oid the unique identifier of the cached object to be removed.
+ * @param   store   a pointer to the cached store from which the specified object will be removed.
+ * @return  1 if the object was successfully removed or 0 if it couldn't be found; -1 on general error.
+ */
+int _remove_cached_object(const char *oid, cached_store_t *store) {
+
+    cached_object_t *ptr;
+    unsigned char hashid[SHA_256_SIZE];
+
+    if (!oid || !store) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(_cache_flags & CACHE_PERM_DELETE)) {
+        RET_ERROR_INT(ERR_PERM, NULL);
+    }
+
+    if (_compute_sha_hash(256, (unsigned char *)oid, strlen(oid), hashid) < 0) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not compute SHA hash of removed cache entry");
+    }
+
+    _lock_cache_store(store);
+
+    // If we find the cached object, cut it from the store's linked list. A stale entry is evicted but doesn't count as found.
+    if (!(ptr = _index_find_object(store, hashid)) || _evict_if_stale(&ptr)) {
+        _unlock_cache_store(store);
+        return 0;
     }
 
+    if (_journal_removed_object(ptr) < 0) {
+        fprintf(stderr, "Error: could not record cached object removal in cache journal.\n");
+        dump_error_stack();
+        _clear_error_stack();
+    }
+
+    _unlink_object(ptr, 1, 0);
     _unlock_cache_store(store);
 
-    return 0;
+    return 1;
 }
 /**
  * @brief   Remove an object from a cached store using a custom comparator function.
@@ -973,7 +1098,13 @@ int _remove_cached_object_cmp(const void *key, cached_store_t *store, cached_sto
             continue;
         }
 
-        if (!cmpfn(ptr->data, key)) {
+        if (!cmpfn(_materialize_cached_object(ptr), key)) {
+            if (_journal_removed_object(ptr) < 0) {
+                fprintf(stderr, "Error: could not record cached object removal in cache journal.\n");
+                dump_error_stack();
+                _clear_error_stack();
+            }
+
             _unlink_object(ptr, 1, 0);
             _unlock_cache_store(store);
             return 1;
@@ -990,13 +1121,11 @@ int _remove_cached_object_cmp(const void *key, cached_store_t *store, cached_sto
 
 /**
  * @brief   Clone a deep copy of a cached object for user-safe retrieval.
+ * @note    Stores with a share routine return a new reference to their immutable data instead of a deep copy of it.
  */
 cached_object_t *_clone_cached_object(const cached_object_t *obj) {
 
     cached_store_t *store;
-    cached_object_t *result;
-    void *data;
-    size_t dsize;
 
     if (!obj) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
@@ -1004,8 +1133,6 @@ cached_object_t *_clone_cached_object(const cached_object_t *obj) {
 
     if (!(store = _get_cached_store_by_type(obj->dtype))) {
         RET_ERROR_PTR(ERR_UNSPEC, "attempted to clone cached data of unrecognized type");
-    } else if (!store->clone && !(store->serialize && store->deserialize)) {
-        RET_ERROR_PTR(ERR_UNSPEC, "cached data store lacks proper serialization handler(s)");
     }
 
     // Internal stores know what they're doing. It's not necessary for data to be cloned.
@@ -1013,6 +1140,34 @@ cached_object_t *_clone_cached_object(const cached_object_t *obj) {
         return ((cached_object_t *)obj);
     }
 
+    return _copy_cached_object(obj);
+}
+
+
+/**
+ * @brief   Make a copy of a cached object that is independent of the cache, even if it belongs to an internal store.
+ * @note    Stores with a share routine return a new reference to their immutable data instead of a deep copy of it.
+ * @param   obj     a pointer to the cached object to be copied.
+ * @return  NULL on failure, or a pointer to a newly allocated copy of the cached object on success.
+ * @free_using{_destroy_cache_entry}
+ */
+cached_object_t *_copy_cached_object(const cached_object_t *obj) {
+
+    cached_store_t *store;
+    cached_object_t *result;
+    void *data;
+    size_t dsize;
+
+    if (!obj) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(store = _get_cached_store_by_type(obj->dtype))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "attempted to clone cached data of unrecognized type");
+    } else if (!store->clone && !(store->serialize && store->deserialize)) {
+        RET_ERROR_PTR(ERR_UNSPEC, "cached data store lacks proper serialization handler(s)");
+    }
+
     if (!(result = malloc(sizeof(cached_object_t)))) {
         PUSH_ERROR_SYSCALL("malloc");
         RET_ERROR_PTR(ERR_NOMEM, NULL);
@@ -1029,16 +1184,32 @@ cached_object_t *_clone_cached_object(const cached_object_t *obj) {
     result->relaxed = obj->relaxed;
     result->persists = obj->persists;
 
-    // If the object has a clone routine, then use it. Otherwise, simulate it with serialize/deserialize.
-    if (obj->data && store->clone) {
+    // Stores with immutable data just hand out another reference to it, once it's been decoded for everyone.
+    if (store->share && obj->data) {
+
+        if (!(result->data = store->share(obj->data))) {
+            free(result);
+            RET_ERROR_PTR(ERR_UNSPEC, "failed to share object data");
+        }
+
+    // If the object has yet to be decoded, the copy can be deserialized straight out of the cache file mapping.
+    } else if (!obj->data && obj->mapped) {
+
+        if (!(result->data = store->deserialize((void *)obj->mapped, obj->mapped_len))) {
+            free(result);
+            RET_ERROR_PTR(ERR_UNSPEC, "mapped object deserialization failed");
+        }
+
+    // If the object has a clone routine, then use it.
+    } else if (obj->data && store->clone) {
 
         if (!(result->data = store->clone(obj->data))) {
             free(result);
             RET_ERROR_PTR(ERR_UNSPEC, "failed to clone object data");
         }
 
-
-    } else {
+    // Otherwise simulate cloning with serialize/deserialize, unless there is no data to be copied at all.
+    } else if (obj->data) {
 
         if (!(data = store->serialize(obj->data, &dsize))) {
             free(result);
@@ -1121,7 +1292,7 @@ void _dump_cache(cached_data_type_t dtype, int do_data, int ephemeral) {
 
             expstr = ptr->expiration ? _get_chr_date(ptr->expiration, 1) : strdup("[none]");
             fprintf(stderr, "] ttl = %s, expiration = %s, data = %s, timestamp = %s, persist = %s",
-                    ttlstr, (expstr ? expstr : "[error]"), (ptr->data ? "yes" : "no"), (tstr ? tstr : "[unknown timestamp]"), (ptr->persists ? "yes" : "no"));
+                    ttlstr, (expstr ? expstr : "[error]"), ((ptr->data || ptr->mapped) ? "yes" : "no"), (tstr ? tstr : "[unknown timestamp]"), (ptr->persists ? "yes" : "no"));
 
             if (ptr->relaxed) {
                 fprintf(stderr, " [RELAXED]");
@@ -1177,7 +1348,7 @@ void _dump_cache_data(FILE *fp, const cached_object_t *obj, int brief) {
         return;
     }
 
-    store->dump(fp, obj->data, brief);
+    store->dump(fp, _materialize_cached_object((cached_object_t *)obj), brief);
 
     // Preemptive cleanup in case there was an error.
     if (get_last_error()) {
@@ -1190,1123 +1361,3442 @@ void _dump_cache_data(FILE *fp, const cached_object_t *obj, int brief) {
 
 
 /**
- * @brief   Persist the entire contents of the cache to local storage.
- * @return  1 if the cache was loaded successfully, 0 if it was created, or -1 on general failure.
+ * @brief   Serialize a cached object into the format used to persist it to local storage.
+ * @note    The persisted format is the cached object header, followed by the store-specific serialized object data.
+ * @param   obj     a pointer to the cached object to be serialized.
+ * @param   outlen  a pointer to a variable that will receive the length of the serialized cached object on success.
+ * @return  NULL on failure, or a pointer to a newly allocated buffer holding the serialized cached object on success.
+ * @free_using{free}
  */
-int _load_cache_contents(void) {
+unsigned char *_serialize_cached_object(const cached_object_t *obj, size_t *outlen) {
 
     cached_store_t *store;
-    cached_object_t *obj;
-    void *cdata = NULL, *udata, *reall_res = NULL;
-    char *cfile;
-    char ttlstr[64], *tstr, *expstr;
-    unsigned char *uptr;
-    time_t now;
-    size_t clen = 0, chdr_size = 0;
-    ssize_t nread;
-    int cfd, res;
-    uint32_t objlen;
+    unsigned char *result;
+    void *cdata;
+    size_t clen;
 
-    if (!(_cache_flags & CACHE_PERM_LOAD)) {
-        RET_ERROR_INT(ERR_PERM, NULL);
+    if (!obj || !outlen) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
-    // Get the name of the cache file to be opened for writing. It should be reset to empty, or created if it does not yet exist.
-    if (!(cfile = _get_cache_location())) {
-        RET_ERROR_INT(ERR_UNSPEC, "unable to open object cache file for reading");
+    if (!(store = _get_cached_store_by_type(obj->dtype))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "attempted to serialize cached data of unrecognized type");
+    } else if (!store->serialize) {
+        RET_ERROR_PTR(ERR_UNSPEC, "cached data store lacks a serialization handler");
     }
 
-    // TODO: Make this thread-safe using file locking.
-    if ((cfd = open(cfile, O_RDONLY)) < 0) {
-
-        _dbgprint(4, "Cache file was not found... creating.\n");
+    // Objects that were never decoded from the cache file mapping are still in serialized form.
+    if (!obj->data && obj->mapped) {
 
-        if ((cfd = creat(cfile, S_IRWXU)) < 0) {
-            PUSH_ERROR_SYSCALL("creat");
-            free(cfile);
-            RET_ERROR_INT(ERR_UNSPEC, "unable to create cache file");
+        if (!(result = malloc(CACHE_HEADER_SIZE + obj->mapped_len))) {
+            PUSH_ERROR_SYSCALL("malloc");
+            RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for serialized cached object");
         }
 
-        close(cfd);
-        free(cfile);
-        return 0;
+        memcpy(result, obj, CACHE_HEADER_SIZE);
+        memcpy(result + CACHE_HEADER_SIZE, obj->mapped, obj->mapped_len);
+        *outlen = CACHE_HEADER_SIZE + obj->mapped_len;
+
+        return result;
     }
-    free(cfile);
 
-    // The file consists of a sequence of object chunk lengths and data.
-    while (1) {
+    if (!(cdata = store->serialize(obj->data, &clen))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "error serializing cached data for storage");
+    }
 
-        if ((nread = read(cfd, &objlen, sizeof(objlen))) != sizeof(objlen)) {
-            close(cfd);
+    if (!(result = malloc(CACHE_HEADER_SIZE + clen))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        free(cdata);
+        RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for serialized cached object");
+    }
 
-            if (cdata) {
-                free(cdata);
-            }
+    memcpy(result, obj, CACHE_HEADER_SIZE);
+    memcpy(result + CACHE_HEADER_SIZE, cdata, clen);
+    free(cdata);
 
-            if (nread) {
+    *outlen = CACHE_HEADER_SIZE + clen;
 
-                if (nread < 0) {
-                    PUSH_ERROR_SYSCALL("read");
-                }
+    return result;
+}
 
-                RET_ERROR_INT(ERR_UNSPEC, "reached unexpected end of cache data file");
-            }
 
-            // We can only reach this by reading in 0 bytes (EOF).
-            return 1;
-        }
+/**
+ * @brief   Deserialize a cached object that was read in from local storage.
+ * @param   buf     a pointer to the buffer holding the cached object header, followed by the store-specific serialized data.
+ * @param   len     the length, in bytes, of the serialized cached object.
+ * @return  NULL on failure, or a pointer to a newly allocated cached object on success.
+ */
+cached_object_t *_deserialize_cached_object(const unsigned char *buf, size_t len) {
 
-        // If the objlen we read is 0, we skip forward to read the next length. This helps avoid the NULL pointer dereferencing,
-        // which occurrs if cdata has not yet been allocated. Perhaps we should throw an error. TODO
-        if(!objlen) {
-            continue;
-        }
+    cached_store_t *store;
+    cached_object_t *result;
+    void *udata;
 
-        if (objlen > clen) {
-            clen = objlen;
+    if (!buf) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
 
-            if (!(reall_res = realloc(cdata, clen))) {
-                PUSH_ERROR_SYSCALL("realloc");
+    // We must have read in at least the size of a cached object header.
+    if (len < CACHE_HEADER_SIZE) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unexpected small cached object entry size");
+    }
 
-                if(cdata) {
-                    free(cdata);
-                }
+    if (!(result = malloc(sizeof(cached_object_t)))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for deserialized cached object");
+    }
 
-                close(cfd);
-                RET_ERROR_INT(ERR_NOMEM, NULL);
-            }
+    memset(result, 0, sizeof(cached_object_t));
+    memcpy(result, buf, CACHE_HEADER_SIZE);
 
-            cdata = reall_res;
-            reall_res = NULL;
-        }
+    // Make sure we're even able to handle this data type.
+    if (!(store = _get_cached_store_by_type(result->dtype))) {
+        free(result);
+        RET_ERROR_PTR(ERR_UNSPEC, "read cached data of unrecognized type");
+    } else if (!store->deserialize) {
+        free(result);
+        RET_ERROR_PTR(ERR_UNSPEC, "cached object did not have a deserialization handler");
+    }
 
-        memset(cdata, 0, objlen);
+    // Everything that was loaded from the cache is automatically persisted again.
+    result->persists = 1;
 
-        if (read(cfd, cdata, objlen) != objlen) {
-            free(cdata);
-            close(cfd);
-            RET_ERROR_INT(ERR_UNSPEC, "unable to read contents of object cache");
-        }
+    // Finally, attach the store-specific data to the cached object.
+    if (!(udata = store->deserialize((void *)(buf + CACHE_HEADER_SIZE), (len - CACHE_HEADER_SIZE)))) {
+        free(result);
+        RET_ERROR_PTR(ERR_UNSPEC, "cached object could not be deserialized");
+    }
 
-        obj = (cached_object_t *)cdata;
+    result->data = udata;
 
-        // Make sure we're even able to handle this data type.
-        if (!(store = _get_cached_store_by_type(obj->dtype))) {
-            fprintf(stderr, "Error: read cached data of unrecognized type. Continuing...\n");
-            continue;
-        } else if (!store->deserialize) {
-            fprintf(stderr, "Error: cached object did not have a deserialization handler. Continuing...\n");
-            continue;
-        }
+    return result;
+}
 
-        // The cached header on disk is equivalent to the cached object structure minus the last 3 fields (data and linked list pointers).
-        if (!chdr_size) {
-            chdr_size = (size_t)&(obj->data) - (size_t)obj;
-        }
 
-        // We must have read in at least the size of a cached object structure.
-        if (objlen < chdr_size) {
-            fprintf(stderr, "Error reading in cached object data; unexpected small entry size.\n");
-            continue;
-        }
+/**
+ * @brief   Create a cached object for a record inside a memory-mapped cache file, without decoding its data.
+ * @note    The object's data is left NULL and will be deserialized from the mapping on first access.
+ * @param   header  a pointer to the mapped cached object header.
+ * @param   data    a pointer to the mapped store-specific serialized data of the cached object.
+ * @param   len     the length, in bytes, of the mapped serialized data.
+ * @return  NULL on failure, or a pointer to a newly allocated cached object on success.
+ */
+cached_object_t *_map_cached_object(const unsigned char *header, const unsigned char *data, size_t len) {
 
-        // Create a new cached object and copy the header information in from the file.
-        if (!(obj = malloc(sizeof(cached_object_t)))) {
-            PUSH_ERROR_SYSCALL("malloc");
-            free(cdata);
-            close(cfd);
-            RET_ERROR_INT(ERR_NOMEM, NULL);
-        }
+    cached_store_t *store;
+    cached_object_t *result;
 
-        memset(obj, 0, sizeof(cached_object_t));
-        memcpy(obj, cdata, chdr_size);
+    if (!header || !data || !len) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
 
-        // Everything that was loaded from the cache is automatically persisted again.
-        obj->persists = 1;
+    if (!(result = malloc(sizeof(cached_object_t)))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for mapped cached object");
+    }
 
-        // Finally, attach the store-specific data to the cached object.
-        if (objlen >= chdr_size) {
-            uptr = (unsigned char *)cdata;
-            uptr += chdr_size;
+    memset(result, 0, sizeof(cached_object_t));
+    memcpy(result, header, CACHE_HEADER_SIZE);
 
-            if (!(udata = store->deserialize(uptr, (objlen - chdr_size)))) {
-                fprintf(stderr, "Error: cached object could not be deserialized (continuing)...\n");
-                dump_error_stack();
-                _clear_error_stack();
-                free(obj);
-                continue;
-            }
+    if (!(store = _get_cached_store_by_type(result->dtype))) {
+        free(result);
+        RET_ERROR_PTR(ERR_UNSPEC, "mapped cached data of unrecognized type");
+    } else if (!store->deserialize) {
+        free(result);
+        RET_ERROR_PTR(ERR_UNSPEC, "cached object did not have a deserialization handler");
+    }
 
-            obj->data = udata;
-        }
+    // Everything that was loaded from the cache is automatically persisted again.
+    result->persists = 1;
+    result->mapped = data;
+    result->mapped_len = len;
 
-        // TODO: This should leverage _dump_cache() functionality.
-        tstr = _get_chr_date(obj->timestamp, 1);
-        memset(ttlstr, 0, sizeof(ttlstr));
+    return result;
+}
 
-        if (time(&now) == (time_t)-1) {
-            perror("time");
-            fprintf(stderr, "Error: Could not get current time for TTL calculation.\n");
-            snprintf(ttlstr, sizeof(ttlstr), "error [original = %lu]", (unsigned long)obj->ttl);
-        } else {
 
-            if ((time_t)(obj->timestamp + obj->ttl) > now) {
-                snprintf(ttlstr, sizeof(ttlstr), "%lu seconds", (unsigned long)(obj->timestamp + obj->ttl - now));
-            } else {
-                snprintf(ttlstr, sizeof(ttlstr), "expired %lu seconds ago", (unsigned long)(now - (obj->timestamp + obj->ttl)));
-            }
+/**
+ * @brief   Decode the data of a cached object from the memory-mapped cache file, if it hasn't been accessed yet.
+ * @note    The caller must hold the object's cached store lock, in either mode, along with the write lock of its index shard.
+ *              A record that fails to decode is reported and left without any data.
+ * @param   obj     a pointer to the cached object to have its data decoded.
+ * @return  NULL if the object has no data, or a pointer to the object's data on success.
+ */
+void *_decode_mapped_object(cached_object_t *obj) {
 
-        }
+    cached_store_t *store;
 
-        if (_verbose >= 5) {
-            expstr = obj->expiration ? _get_chr_date(obj->expiration, 1) : strdup("[none]");
-            fprintf(stderr, "+++ type = %u, ttl = %s, expiration = %s, data = %s, timestamp = %s\n",
-                    (unsigned int)obj->dtype, ttlstr, (expstr ? expstr : "[error]"), (obj->data ? "yes" : "no"), (tstr ? tstr : "[unknown timestamp]"));
-            _dump_cache_data(stderr, obj, 0);
+    if (!obj) {
+        return NULL;
+    }
 
-            if (expstr) {
-                free(expstr);
-            }
+    if (obj->data || !obj->mapped) {
+        return obj->data;
+    }
 
-        }
+    if (!(store = _get_cached_store_by_type(obj->dtype)) || !store->deserialize) {
+        fprintf(stderr, "Error: could not find deserialization handler for mapped cached object.\n");
+    } else if (!(obj->data = store->deserialize((void *)obj->mapped, obj->mapped_len))) {
+        fprintf(stderr, "Error: mapped cached object could not be deserialized:\n");
+        dump_error_stack();
+        _clear_error_stack();
+    }
 
-        if (tstr) {
-            free(tstr);
-        }
+    // Whether or not it succeeded, there's no point in trying to decode the record a second time.
+    obj->mapped = NULL;
+    obj->mapped_len = 0;
 
-        // Finally store the object in the cache if it doesn't already exist.
-        if ((res = _cached_object_exists(obj->id, store))) {
-            fprintf(stderr, "Error: deserialized cached object was a duplicate:\n");
-            _dump_cache_data(stderr, obj, 0);
-            _destroy_cache_entry(obj);
-            continue;
-        } else if (res < 0) {
-            fprintf(stderr, "Error: could not look up object in cache.\n");
-            dump_error_stack();
-            _clear_error_stack();
-            _destroy_cache_entry(obj);
-            continue;
-        }
+    return obj->data;
+}
 
-        // TODO: The locking block of code needs to be expanded to include the existence check.
-        _lock_cache_store(store);
 
-        // Insert into the head of the list.
-        obj->next = store->head;
-        store->head = obj;
+/**
+ * @brief   Get the data of a cached object, decoding it from the memory-mapped cache file if it hasn't been accessed yet.
+ * @note    The caller must hold the lock of the object's cached store, in either mode, but none of its shard locks.
+ *          Other holders of the store read lock may be decoding the same object, so its data and mapping are only
+ *              ever read or changed here under its shard lock. Once this returns, they stay put until the store lock is released.
+ * @param   obj     a pointer to the cached object to have its data returned.
+ * @return  NULL if the object has no data, or a pointer to the object's data on success.
+ */
+void *_materialize_cached_object(cached_object_t *obj) {
 
-        _unlock_cache_store(store);
-    }
+    cached_store_t *store;
+    cache_shard_t *shard;
+    void *result;
 
-    if (cdata) {
-        free(cdata);
+    if (!obj) {
+        return NULL;
     }
 
-    close(cfd);
-
-    return 1;
-}
-
-/**
- * @brief   Persist the entire contents of the cache to local storage.
- * @return  0 on success or -1 on failure.
- */
-int _save_cache_contents(void) {
-
-    cached_object_t *ptr, *towrite;
-    void *cdata;
-    char *cfile;
-    size_t clen, chdr_size = 0;
-    int cfd;
-    uint32_t objlen;
-
-    if (!(_cache_flags & CACHE_PERM_LOAD)) {
-        RET_ERROR_INT(ERR_PERM, NULL);
+    if (!(store = _get_cached_store_by_type(obj->dtype)) || !(shard = _get_cache_shard(store, obj->id))) {
+        fprintf(stderr, "Error: could not find cached store for cached object.\n");
+        return NULL;
     }
 
-    // Get the name of the cache file to be opened for writing. It should be reset to empty, or created if it does not yet exist.
-    if (!(cfile = _get_cache_location())) {
-        RET_ERROR_INT(ERR_UNSPEC, "unable to determine cache file location");
-    }
+    _rdlock_cache_shard(shard);
 
-    if ((cfd = open(cfile, (O_CREAT | O_TRUNC | O_WRONLY), (S_IRWXU))) < 0) {
-        PUSH_ERROR_SYSCALL("open");
-        PUSH_ERROR_FMT(ERR_UNSPEC, "unable to open object cache file for writing: %s", cfile);
-        free(cfile);
-        return -1;
+    if (!obj->mapped) {
+        result = obj->data;
+        _unlock_cache_shard(shard);
+        return result;
     }
-    free(cfile);
 
-    for(size_t i = 1; i < sizeof(cached_stores) / sizeof(cached_store_t); i++) {
-        _dbgprint(4, "Persisting cache of type: %s ...\n", cached_stores[i].description);
+    _unlock_cache_shard(shard);
 
-        _lock_cache_store(&(cached_stores[i]));
+    // Whoever gets the write lock first decodes the object, and everyone after that just picks up its data.
+    _lock_cache_shard(shard);
+    result = _decode_mapped_object(obj);
+    _unlock_cache_shard(shard);
 
-        ptr = cached_stores[i].head;
+    return result;
+}
 
-        while (ptr) {
-            // If we're shadowing a cached object, then the shadowed entry is the one that needs to be persisted.
-            towrite = ptr->shadow ? ptr->shadow : ptr;
 
-            // Only bother with the entries that need to be saved.
-            if (!towrite->persists) {
-                ptr = ptr->next;
-                continue;
-            }
+/**
+ * @brief   Insert a cached object that was read in from local storage into its cached store.
+ * @param   store   a pointer to the cached store that will hold the cached object.
+ * @param   obj     a pointer to the cached object to be inserted.
+ * @param   replace if set, an object with a clashing id will be destroyed and replaced; otherwise the insertion fails.
+ * @return  1 if the object was inserted, 0 if it was a duplicate that wasn't replaced, or -1 on general failure.
+ */
+int _insert_loaded_object(cached_store_t *store, cached_object_t *obj, int replace) {
 
-            // The cached header on disk is equivalent to the cached object structure minus the last 3 fields (data and linked list pointers).
-            if (!chdr_size) {
-                chdr_size = (size_t)&(ptr->data) - (size_t)ptr;
-            }
+    cached_object_t *found;
 
-            if (cached_stores[i].serialize) {
+    if (!store || !obj) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
 
-                if (!(cdata = cached_stores[i].serialize(towrite->data, &clen))) {
-                    fprintf(stderr, "Error serializing cached data for storage:\n");
-                    dump_error_stack();
-                    _clear_error_stack();
-                } else {
-                    objlen = chdr_size + clen;
-
-                    if ((size_t)write(cfd, &objlen, sizeof(objlen)) != sizeof(objlen)
-                        || (size_t)write(cfd, towrite, chdr_size) != chdr_size
-                        || (size_t)write(cfd, cdata, clen) != clen) {
-                        PUSH_ERROR_SYSCALL("write");
-                        _unlock_cache_store(&(cached_stores[i]));
-                        free(cdata);
-                        close(cfd);
-                        RET_ERROR_INT(ERR_UNSPEC, "error serializing cached data to file");
-                    }
+    _lock_cache_store(store);
 
-                    free(cdata);
-                }
+    if ((found = _index_find_object(store, obj->id))) {
 
-            }
+        if (!replace) {
+            _unlock_cache_store(store);
+            return 0;
+        }
 
-            ptr = ptr->next;
+        if (!_replace_object(found, obj, 0)) {
+            _unlock_cache_store(store);
+            RET_ERROR_INT(ERR_UNSPEC, "could not replace cached object in store");
         }
 
-        _unlock_cache_store(&(cached_stores[i]));
+        _unlock_cache_store(store);
+        return 1;
     }
 
-    close(cfd);
+    if (_link_object(store, obj) < 0) {
+        _unlock_cache_store(store);
+        RET_ERROR_INT(ERR_UNSPEC, "could not index cached object");
+    }
 
-    return 0;
+    _unlock_cache_store(store);
+
+    return 1;
 }
 
 
 /**
- * @brief   Set the permissions flags for the object cache.
- * @param   flags
- * @return  -1 on error or 0 if the permissions were set successfully.
+ * @brief   Print the details of a cached object that was loaded from local storage, if running verbosely enough.
+ * @param   obj     a pointer to the loaded cached object.
  */
-int _set_cache_permissions(unsigned long flags) {
+void _dump_loaded_object(const cached_object_t *obj) {
 
-    if (flags & ~(CACHE_PERM_ALL_FLAGS)) {
-        RET_ERROR_INT(ERR_BAD_PARAM, "invalid cache permision mask");
-    }
-
-    _cache_flags = flags;
+    char ttlstr[64], *tstr, *expstr;
+    time_t now;
 
-    return 0;
-}
+    if (!obj || (_verbose < 5)) {
+        return;
+    }
 
+    // TODO: This should leverage _dump_cache() functionality.
+    tstr = _get_chr_date(obj->timestamp, 1);
+    memset(ttlstr, 0, sizeof(ttlstr));
 
-/**
- * @brief       Append a variable-length chunk of data to a dynamically allocated buffer for serialization.
- * @param   buf a pointer to the address of the output buffer that will be resized to hold the result, or NULL to allocate one.
- * @param   blen    a pointer to a variable that holds the buffer's current size and will receive the
- *                      size of the newly resized output buffer.
- * @param   data    a pointer to a buffer holding the data that will be appended to the end of the output buffer.
- * @param   dlen    the size, in bytes, of the data buffer to be appended to the output buffer.
- * @return  the new size of the (re)allocated output buffer, or 0 on failure.
- */
-size_t _mem_append_serialized(unsigned char **buf, size_t *blen, const unsigned char *data, size_t dlen) {
+    if (time(&now) == (time_t)-1) {
+        perror("time");
+        fprintf(stderr, "Error: Could not get current time for TTL calculation.\n");
+        snprintf(ttlstr, sizeof(ttlstr), "error [original = %lu]", (unsigned long)obj->ttl);
+    } else {
 
-    int res;
+        if ((time_t)(obj->timestamp + obj->ttl) > now) {
+            snprintf(ttlstr, sizeof(ttlstr), "%lu seconds", (unsigned long)(obj->timestamp + obj->ttl - now));
+        } else {
+            snprintf(ttlstr, sizeof(ttlstr), "expired %lu seconds ago", (unsigned long)(now - (obj->timestamp + obj->ttl)));
+        }
 
-    if (!buf || !blen) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
     }
 
-    if (!_mem_append(buf, blen, (unsigned char *)&dlen, sizeof(dlen))) {
-        RET_ERROR_UINT(ERR_NOMEM, NULL);
+    expstr = obj->expiration ? _get_chr_date(obj->expiration, 1) : strdup("[none]");
+    fprintf(stderr, "+++ type = %u, ttl = %s, expiration = %s, data = %s, timestamp = %s\n",
+            (unsigned int)obj->dtype, ttlstr, (expstr ? expstr : "[error]"), ((obj->data || obj->mapped) ? "yes" : "no"), (tstr ? tstr : "[unknown timestamp]"));
+    _dump_cache_data(stderr, obj, 0);
+
+    if (expstr) {
+        free(expstr);
     }
 
-    if (!(res = _mem_append(buf, blen, data, dlen))) {
-        RET_ERROR_UINT(ERR_NOMEM, NULL);
+    if (tstr) {
+        free(tstr);
     }
 
-    return res;
 }
 
 
 /**
- * @brief   Apped a null-terminated string to a dynamically allocated buffer for serialization.
- * @param   buf a pointer to the address of the output buffer that will be resized to hold the result, or NULL to allocate one.
- * @param   blen    a pointer to a variable that holds the buffer's current size and will receive the
- *                      size of the newly resized output buffer.
- * @param   string  a null-terminated string that will be appended to the end of the output buffer.
- * @return  the new size of the (re)allocated output buffer, or 0 on failure.
+ * @brief   Load the contents of a versioned cache file by mapping it into memory.
+ * @note    Only the index at the end of the file is read in; each object's data is decoded lazily, straight out of the mapping.
+ * @param   cfd     a descriptor for the cache file, opened for reading.
+ * @param   fsize   the size of the cache file, in bytes.
+ * @return  0 on success or -1 on failure.
  */
-size_t _mem_append_serialized_string(unsigned char **buf, size_t *blen, const char *string) {
+int _load_mapped_cache(int cfd, size_t fsize) {
 
-    unsigned char null = 0;
+    cache_mapping_t *mapping;
+    cached_store_t *store;
+    cache_shard_t *shard;
+    const cache_file_hdr_t *hdr;
+    const cache_file_entry_t *entries;
+    cached_object_t *obj;
+    const unsigned char *hashid;
+    unsigned char *map;
+    cached_data_type_t dtype;
+    size_t counts[sizeof(cached_stores) / sizeof(cached_store_t)][CACHE_STORE_SHARDS], nslots;
     int res;
 
-    if (!buf || !blen) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    if (fsize < sizeof(cache_file_hdr_t)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
-    if (!string) {
-        res = _mem_append(buf, blen, &null, sizeof(null));
-    } else {
-        res = _mem_append(buf, blen, (unsigned char *)string, strlen(string) + 1);
+    if ((map = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, cfd, 0)) == MAP_FAILED) {
+        PUSH_ERROR_SYSCALL("mmap");
+        RET_ERROR_INT(ERR_UNSPEC, "unable to map object cache file into memory");
     }
 
-    if (!res) {
-        RET_ERROR_UINT(ERR_NOMEM, NULL);
+    hdr = (const cache_file_hdr_t *)map;
+
+    if (hdr->version != CACHE_FILE_VERSION) {
+        munmap(map, fsize);
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "unsupported object cache file version: %u", hdr->version);
     }
 
-    return res;
-}
+    if ((hdr->index_offset < sizeof(cache_file_hdr_t)) || (hdr->index_offset > fsize) ||
+        (hdr->count > ((fsize - hdr->index_offset) / sizeof(cache_file_entry_t)))) {
+        munmap(map, fsize);
+        RET_ERROR_INT(ERR_UNSPEC, "object cache file index is corrupted");
+    }
 
+    if (!(mapping = malloc(sizeof(cache_mapping_t)))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        munmap(map, fsize);
+        RET_ERROR_INT(ERR_NOMEM, "could not allocate space for object cache file mapping");
+    }
 
-/**
- * @brief   Append an array of fixed-size objects to a dynamically allocated buffer for serialization.
- * @param   buf     a pointer to the address of the output buffer that will be resized to hold the result, or NULL to allocate one.
- * @param   blen        a pointer to a variable that holds the buffer's current size and will receive the
- *                              size of the newly resized output buffer.
- * @param   array       an array of pointers to fixed-size objects (ending with a NULL pointer) to be
- *                              appended to the end of the output buffer.
- * @param   itemsize    the size, in bytes, of the array elements to be deserialized.
- * @return  the new size of the (re)allocated output buffer, or 0 on failure.
- */
-size_t _mem_append_serialized_array(unsigned char **buf, size_t *blen, const unsigned char **array, size_t itemsize) {
+    mapping->addr = map;
+    mapping->len = fsize;
 
-    unsigned char *dataholder = NULL;
-    const unsigned char **arptr = array;
-    size_t holdlen = 0, result;
+    pthread_mutex_lock(&_mapping_lock);
+    mapping->next = _cache_mappings;
+    _cache_mappings = mapping;
+    pthread_mutex_unlock(&_mapping_lock);
 
-    if (!buf || !blen) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
-    }
+    entries = (const cache_file_entry_t *)(map + hdr->index_offset);
 
-    // If there's no data, then just write a null size.
-    if (!array) {
+    // Size each store's index shards up front for all of their objects, rather than growing them repeatedly as they are inserted.
+    memset(counts, 0, sizeof(counts));
 
-        if (!(result = _mem_append(buf, blen, (unsigned char *)&holdlen, sizeof(holdlen)))) {
-            RET_ERROR_UINT(ERR_NOMEM, NULL);
+    // Objects are counted by the type in their own header, since that's the store they will be inserted into.
+    for(uint32_t i = 0; i < hdr->count; i++) {
+        memcpy(&dtype, entries[i].header + offsetof(cached_object_t, dtype), sizeof(dtype));
+
+        if ((size_t)dtype < (sizeof(counts) / sizeof(counts[0]))) {
+            hashid = entries[i].header + offsetof(cached_object_t, id);
+            counts[dtype][hashid[SHA_256_SIZE - 1] & (CACHE_STORE_SHARDS - 1)]++;
         }
 
-        return result;
     }
 
-    // First construct a buffer to hold all the data in the array together in one contiguous space.
-    while (*arptr) {
+    for(size_t i = 1; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        store = &(cached_stores[i]);
+        _lock_cache_store(store);
 
-        if (!_mem_append(&dataholder, &holdlen, *arptr, itemsize)) {
+        for(size_t j = 0; j < CACHE_STORE_SHARDS; j++) {
+            shard = &(store->shards[j]);
+            _lock_cache_shard(shard);
+            nslots = shard->index_slots ? shard->index_slots : CACHE_INDEX_MIN_SLOTS;
 
-            if (dataholder) {
-                free(dataholder);
+            while (((shard->index_used + counts[i][j]) * 100) >= (nslots * CACHE_INDEX_MAX_LOAD)) {
+                nslots *= 2;
             }
 
-            RET_ERROR_UINT(ERR_NOMEM, "unable to allocate space for serialized data array");
+            if ((nslots > shard->index_slots) && (_index_resize(shard, nslots) < 0)) {
+                fprintf(stderr, "Error: unable to presize cached store index (continuing)...\n");
+                dump_error_stack();
+                _clear_error_stack();
+            }
+
+            _unlock_cache_shard(shard);
         }
 
-        arptr++;
+        _unlock_cache_store(store);
     }
 
-    result = _mem_append_serialized(buf, blen, dataholder, holdlen);
-    free(dataholder);
+    for(uint32_t i = 0; i < hdr->count; i++) {
+
+        if ((entries[i].offset % CACHE_FILE_ALIGN) || (entries[i].offset > hdr->index_offset) ||
+            (entries[i].len > (hdr->index_offset - entries[i].offset))) {
+            fprintf(stderr, "Error: object cache file index entry #%u is out of bounds (continuing)...\n", i);
+            continue;
+        }
+
+        if (!(obj = _map_cached_object(entries[i].header, map + entries[i].offset, entries[i].len))) {
+            fprintf(stderr, "Error: cached object could not be mapped (continuing)...\n");
+            dump_error_stack();
+            _clear_error_stack();
+            continue;
+        }
+
+        _dump_loaded_object(obj);
+
+        // Finally store the object in the cache if it doesn't already exist.
+        if (!(res = _insert_loaded_object(_get_cached_store_by_type(obj->dtype), obj, 0))) {
+            fprintf(stderr, "Error: mapped cached object was a duplicate (skipping).\n");
+            _destroy_cache_entry(obj);
+            continue;
+        } else if (res < 0) {
+            fprintf(stderr, "Error: could not insert object into cache.\n");
+            dump_error_stack();
+            _clear_error_stack();
+            _destroy_cache_entry(obj);
+            continue;
+        }
 
-    if (!result) {
-        RET_ERROR_UINT(ERR_NOMEM, NULL);
     }
 
-    return result;
+    return 0;
 }
 
 
 /**
- * @brief   Append an array of null-terminated strings to a dynamically allocated buffer for serialization.
- * @param   buf a pointer to the address of the output buffer that will be resized to hold the result, or NULL to allocate one.
- * @param   blen    a pointer to a variable that holds the buffer's current size and will receive the
- *                      size of the newly resized output buffer.
- * @param   array   an array of pointers to null-terminated strings (ending with a NULL pointer) to be
- *                      appended to the end of the output buffer.
- * @return  the new size of the (re)allocated output buffer, or 0 on failure.
+ * @brief   Load the contents of an unversioned cache file, which is a sequence of object lengths and serialized objects.
+ * @param   cfd         a descriptor for the cache file, opened for reading.
+ * @param   base_size   a pointer to a variable that will receive the number of bytes read from the cache file.
+ * @return  0 on success or -1 on failure.
  */
-size_t _mem_append_serialized_str_array(unsigned char **buf, size_t *blen, const char **array) {
+int _load_legacy_cache(int cfd, size_t *base_size) {
 
-    unsigned char *strholder = NULL;
-    const char **arptr = array;
-    size_t holdlen = 0, result;
+    cached_object_t *obj;
+    void *cdata = NULL, *reall_res = NULL;
+    size_t clen = 0;
+    ssize_t nread;
+    int res;
+    uint32_t objlen;
 
-    if (!buf || !blen) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    if (!base_size) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
-    // If there's no data, then just write a null size.
-    if (!array) {
+    *base_size = 0;
 
-        if (!(result = _mem_append(buf, blen, (unsigned char *)&holdlen, sizeof(holdlen)))) {
-            RET_ERROR_UINT(ERR_NOMEM, NULL);
-        }
+    // The file consists of a sequence of object chunk lengths and data.
+    while (1) {
 
-        return result;
-    }
+        if ((nread = read(cfd, &objlen, sizeof(objlen))) != sizeof(objlen)) {
 
-    // First construct a buffer to hold all the string data in the array together in one contiguous space.
-    // This will consist of all strings end-to-end (along with their terminating null bytes).
-    while (*arptr) {
+            if (cdata) {
+                free(cdata);
+            }
 
-        if (!_mem_append(&strholder, &holdlen, (unsigned char *)*arptr, strlen(*arptr) + 1)) {
+            if (nread) {
 
-            if (strholder) {
-                free(strholder);
+                if (nread < 0) {
+                    PUSH_ERROR_SYSCALL("read");
+                }
+
+                RET_ERROR_INT(ERR_UNSPEC, "reached unexpected end of cache data file");
             }
 
-            RET_ERROR_UINT(ERR_NOMEM, "unable to allocate space for serialized string array");
+            // We can only reach this by reading in 0 bytes (EOF).
+            break;
         }
 
-        arptr++;
-    }
-
-    result = _mem_append_serialized(buf, blen, strholder, holdlen);
-    free(strholder);
+        *base_size += sizeof(objlen);
 
-    if (!result) {
-        RET_ERROR_UINT(ERR_NOMEM, NULL);
-    }
+        // If the objlen we read is 0, we skip forward to read the next length. This helps avoid the NULL pointer dereferencing,
+        // which occurrs if cdata has not yet been allocated. Perhaps we should throw an error. TODO
+        if(!objlen) {
+            continue;
+        }
 
-    return result;
-}
+        if (objlen > clen) {
+            clen = objlen;
+
+            if (!(reall_res = realloc(cdata, clen))) {
+                PUSH_ERROR_SYSCALL("realloc");
+
+                if(cdata) {
+                    free(cdata);
+                }
+
+                RET_ERROR_INT(ERR_NOMEM, NULL);
+            }
+
+            cdata = reall_res;
+            reall_res = NULL;
+        }
+
+        memset(cdata, 0, objlen);
+
+        if (read(cfd, cdata, objlen) != objlen) {
+            free(cdata);
+            RET_ERROR_INT(ERR_UNSPEC, "unable to read contents of object cache");
+        }
+
+        *base_size += objlen;
+
+        if (!(obj = _deserialize_cached_object(cdata, objlen))) {
+            fprintf(stderr, "Error: cached object could not be deserialized (continuing)...\n");
+            dump_error_stack();
+            _clear_error_stack();
+            continue;
+        }
+
+        _dump_loaded_object(obj);
+
+        // Finally store the object in the cache if it doesn't already exist.
+        if (!(res = _insert_loaded_object(_get_cached_store_by_type(obj->dtype), obj, 0))) {
+            fprintf(stderr, "Error: deserialized cached object was a duplicate:\n");
+            _dump_cache_data(stderr, obj, 0);
+            _destroy_cache_entry(obj);
+            continue;
+        } else if (res < 0) {
+            fprintf(stderr, "Error: could not insert object into cache.\n");
+            dump_error_stack();
+            _clear_error_stack();
+            _destroy_cache_entry(obj);
+            continue;
+        }
+
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Load the entire contents of the cache from local storage, and then replay the cache journal on top of it.
+ * @note    Versioned cache files are mapped into memory and decoded lazily; older unversioned cache files are read in full.
+ * @return  1 if the cache was loaded successfully, 0 if it was created, or -1 on general failure.
+ */
+int _load_cache_contents(void) {
+
+    struct stat sb;
+    char *cfile, magic[sizeof(((cache_file_hdr_t *)0)->magic)];
+    size_t base_size = 0;
+    int cfd, res;
+
+    if (!(_cache_flags & CACHE_PERM_LOAD)) {
+        RET_ERROR_INT(ERR_PERM, NULL);
+    }
+
+    // Get the name of the cache file to be opened for writing. It should be reset to empty, or created if it does not yet exist.
+    if (!(cfile = _get_cache_location())) {
+        RET_ERROR_INT(ERR_UNSPEC, "unable to open object cache file for reading");
+    }
+
+    // TODO: Make this thread-safe using file locking.
+    if ((cfd = open(cfile, O_RDONLY)) < 0) {
+
+        _dbgprint(4, "Cache file was not found... creating.\n");
+
+        if ((cfd = creat(cfile, S_IRWXU)) < 0) {
+            PUSH_ERROR_SYSCALL("creat");
+            free(cfile);
+            RET_ERROR_INT(ERR_UNSPEC, "unable to create cache file");
+        }
+
+        close(cfd);
+        free(cfile);
+
+        // Even without a base cache file there may still be a journal of changes to replay.
+        if (_replay_cache_journal() < 0) {
+            RET_ERROR_INT(ERR_UNSPEC, "unable to replay object cache journal");
+        }
+
+        return 0;
+    }
+    free(cfile);
+
+    if (fstat(cfd, &sb) < 0) {
+        PUSH_ERROR_SYSCALL("fstat");
+        close(cfd);
+        RET_ERROR_INT(ERR_UNSPEC, "unable to determine size of object cache file");
+    }
+
+    // Versioned cache files can be identified by their leading signature.
+    if (((size_t)sb.st_size >= sizeof(cache_file_hdr_t)) && (pread(cfd, magic, sizeof(magic), 0) == sizeof(magic)) &&
+        !memcmp(magic, CACHE_FILE_MAGIC, sizeof(magic))) {
+        base_size = sb.st_size;
+        res = _load_mapped_cache(cfd, base_size);
+    } else {
+        res = _load_legacy_cache(cfd, &base_size);
+    }
+
+    close(cfd);
+
+    if (res < 0) {
+        RET_ERROR_INT(ERR_UNSPEC, "unable to load contents of object cache file");
+    }
+
+    pthread_mutex_lock(&_journal_lock);
+    _cache_base_size = base_size;
+    pthread_mutex_unlock(&_journal_lock);
+
+    // Any changes made since the base cache file was last written are applied on top of it.
+    if (_replay_cache_journal() < 0) {
+        RET_ERROR_INT(ERR_UNSPEC, "unable to replay object cache journal");
+    }
+
+    _enforce_cache_budget(NULL);
+
+    return 1;
+}
+
+/**
+ * @brief   Write all persistent cached objects to a file in the versioned, memory-mappable cache format.
+ * @param   cfd     a descriptor for the empty cache file, opened for writing.
+ * @param   fsize   a pointer to a variable that will receive the total size of the cache file written on success.
+ * @return  0 on success or -1 on failure.
+ */
+int _write_cache_file(int cfd, size_t *fsize) {
+
+    cached_object_t *ptr, *towrite;
+    cache_file_hdr_t hdr;
+    cache_file_entry_t *entries = NULL, *reall_res;
+    unsigned char *cdata, padding[CACHE_FILE_ALIGN];
+    size_t clen, padlen, offset, nentries = 0, maxentries = 0;
+
+    if (!fsize) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memset(padding, 0, sizeof(padding));
+    offset = sizeof(hdr);
+
+    // The header is rewritten with the final object count and index location once everything else is in place.
+    if (write(cfd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        PUSH_ERROR_SYSCALL("write");
+        RET_ERROR_INT(ERR_UNSPEC, "error writing object cache file header");
+    }
+
+    for(size_t i = 1; i < sizeof(cached_stores) / sizeof(cached_store_t); i++) {
+        _dbgprint(4, "Persisting cache of type: %s ...\n", cached_stores[i].description);
+
+        // Stale objects aren't worth persisting, so take the chance to evict them. Internal stores hand out their live objects,
+        // which other threads may still be using, so their stale objects are only skipped below.
+        if (!cached_stores[i].internal && (_sweep_cached_store(&(cached_stores[i]), time(NULL), 0) < 0)) {
+            fprintf(stderr, "Error: unable to sweep stale objects from cached store (continuing)...\n");
+            dump_error_stack();
+            _clear_error_stack();
+        }
+
+        _lock_cache_store(&(cached_stores[i]));
+
+        ptr = cached_stores[i].head;
+
+        while (ptr) {
+            // If we're shadowing a cached object, then the shadowed entry is the one that needs to be persisted.
+            towrite = ptr->shadow ? ptr->shadow : ptr;
+
+            // Only bother with the entries that need to be saved.
+            if (!towrite->persists || !cached_stores[i].serialize || (cached_stores[i].internal && _is_object_stale(ptr))) {
+                ptr = ptr->next;
+                continue;
+            }
+
+            if (!(cdata = _serialize_cached_object(towrite, &clen))) {
+                fprintf(stderr, "Error serializing cached data for storage:\n");
+                dump_error_stack();
+                _clear_error_stack();
+                ptr = ptr->next;
+                continue;
+            }
+
+            if (nentries == maxentries) {
+                maxentries = maxentries ? (maxentries * 2) : 64;
+
+                if (!(reall_res = realloc(entries, maxentries * sizeof(cache_file_entry_t)))) {
+                    PUSH_ERROR_SYSCALL("realloc");
+                    _unlock_cache_store(&(cached_stores[i]));
+                    free(entries);
+                    free(cdata);
+                    RET_ERROR_INT(ERR_NOMEM, "could not allocate space for object cache file index");
+                }
+
+                entries = reall_res;
+            }
+
+            // The header goes into the index; the serialized data is padded out so that the next record starts on an aligned boundary.
+            memcpy(entries[nentries].header, cdata, CACHE_HEADER_SIZE);
+            clen -= CACHE_HEADER_SIZE;
+            padlen = (CACHE_FILE_ALIGN - (clen % CACHE_FILE_ALIGN)) % CACHE_FILE_ALIGN;
+
+            if (((size_t)write(cfd, cdata + CACHE_HEADER_SIZE, clen) != clen) || ((size_t)write(cfd, padding, padlen) != padlen)) {
+                PUSH_ERROR_SYSCALL("write");
+                _unlock_cache_store(&(cached_stores[i]));
+                free(entries);
+                free(cdata);
+                RET_ERROR_INT(ERR_UNSPEC, "error serializing cached data to file");
+            }
+
+            free(cdata);
+
+            entries[nentries].offset = offset;
+            entries[nentries].len = clen;
+            entries[nentries].dtype = towrite->dtype;
+            nentries++;
+            offset += clen + padlen;
+
+            ptr = ptr->next;
+        }
+
+        _unlock_cache_store(&(cached_stores[i]));
+    }
+
+    memcpy(hdr.magic, CACHE_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = CACHE_FILE_VERSION;
+    hdr.count = nentries;
+    hdr.index_offset = offset;
+
+    if (nentries && ((size_t)write(cfd, entries, nentries * sizeof(cache_file_entry_t)) != (nentries * sizeof(cache_file_entry_t)))) {
+        PUSH_ERROR_SYSCALL("write");
+        free(entries);
+        RET_ERROR_INT(ERR_UNSPEC, "error writing object cache file index");
+    }
+
+    free(entries);
+
+    if (pwrite(cfd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+        PUSH_ERROR_SYSCALL("pwrite");
+        RET_ERROR_INT(ERR_UNSPEC, "error writing object cache file header");
+    }
+
+    *fsize = offset + (nentries * sizeof(cache_file_entry_t));
+
+    return 0;
+}
+
+
+/**
+ * @brief   Persist the entire contents of the cache to local storage.
+ * @note    The cache is written to a temporary file that then replaces the old cache file, so that any existing
+ *              mapping of the old file remains intact.
+ *          Since the rewritten cache file captures the changes journaled before it was written, those are dropped
+ *              from the cache journal afterwards.
+ * @return  0 on success or -1 on failure.
+ */
+int _save_cache_contents(void) {
+
+    char *cfile, *tfile = NULL;
+    size_t base_size = 0, folded;
+    int cfd;
+
+    if (!(_cache_flags & CACHE_PERM_LOAD)) {
+        RET_ERROR_INT(ERR_PERM, NULL);
+    }
+
+    // Get the name of the cache file to be replaced. The new contents are first written to a temporary file beside it.
+    if (!(cfile = _get_cache_location())) {
+        RET_ERROR_INT(ERR_UNSPEC, "unable to determine cache file location");
+    }
+
+    if (!str_printf(&tfile, "%s%s", cfile, CACHE_TEMP_SUFFIX)) {
+        free(cfile);
+        RET_ERROR_INT(ERR_NOMEM, "could not allocate space for temporary cache filename");
+    }
+
+    if ((cfd = open(tfile, (O_CREAT | O_TRUNC | O_WRONLY), (S_IRWXU))) < 0) {
+        PUSH_ERROR_SYSCALL("open");
+        PUSH_ERROR_FMT(ERR_UNSPEC, "unable to open object cache file for writing: %s", tfile);
+        free(cfile);
+        free(tfile);
+        return -1;
+    }
+
+    // Every record journaled up to this point is captured by the snapshot below. Later ones may not be, so they're kept.
+    folded = _get_cache_journal_size();
+
+    if (_write_cache_file(cfd, &base_size) < 0) {
+        close(cfd);
+        unlink(tfile);
+        free(cfile);
+        free(tfile);
+        RET_ERROR_INT(ERR_UNSPEC, "unable to write contents of object cache");
+    }
+
+    close(cfd);
+
+    if (rename(tfile, cfile) < 0) {
+        PUSH_ERROR_SYSCALL("rename");
+        unlink(tfile);
+        free(cfile);
+        free(tfile);
+        RET_ERROR_INT(ERR_UNSPEC, "unable to replace object cache file");
+    }
+
+    free(cfile);
+    free(tfile);
+
+    // Everything journaled before the snapshot was taken has now been folded into the base cache file.
+    if (_truncate_cache_journal(base_size, folded) < 0) {
+        RET_ERROR_INT(ERR_UNSPEC, "unable to reset object cache journal");
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Commit any pending changes to the object cache to local storage.
+ * @note    In journal mode, changes are appended to the journal as they happen, so this only compacts the journal
+ *              into the base cache file once it has outgrown it. Otherwise, the entire cache is saved.
+ * @return  0 on success or -1 on failure.
+ */
+int _commit_cache_contents(void) {
+
+    size_t journal_size, base_size;
+    int journaling;
+
+    pthread_mutex_lock(&_journal_lock);
+    journaling = _cache_journaling;
+    journal_size = _journal_size;
+    base_size = _cache_base_size;
+    pthread_mutex_unlock(&_journal_lock);
+
+    // The whole cache is rewritten only after the journal has grown larger than the base file, so the cost of each change stays constant.
+    if (journaling && ((journal_size < CACHE_JOURNAL_MIN_COMPACT) || (journal_size < base_size))) {
+        return 0;
+    }
+
+    if (journaling) {
+        _dbgprint(3, "Compacting object cache journal of %zu bytes into base cache file...\n", journal_size);
+    }
+
+    if (_save_cache_contents() < 0) {
+        RET_ERROR_INT(ERR_UNSPEC, "unable to save contents of object cache");
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Enable or disable journal mode for the persistent object cache.
+ * @note    In journal mode, each persisted change to the cache is appended to a journal file next to the cache file,
+ *              instead of requiring the entire cache to be rewritten.
+ * @param   enabled     if set, turn journal mode on; otherwise turn it off.
+ * @return  0 on success or -1 on failure.
+ */
+int _set_cache_journaling(int enabled) {
+
+    pthread_mutex_lock(&_journal_lock);
+    _cache_journaling = enabled ? 1 : 0;
+    pthread_mutex_unlock(&_journal_lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Get the full pathname of the DIME cache journal file.
+ * @note    The journal always lives alongside the cache file, with a ".journal" suffix appended to its name.
+ * @return  NULL on failure, or a null-terminated string containing the filename of the object cache journal on success.
+ * @free_using{free}
+ */
+char *_get_cache_journal_location(void) {
+
+    char *cfile, *result = NULL;
+
+    if (!(cfile = _get_cache_location())) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to determine cache file location");
+    }
+
+    if (!str_printf(&result, "%s%s", cfile, CACHE_JOURNAL_SUFFIX)) {
+        free(cfile);
+        RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for cache journal filename");
+    }
+
+    free(cfile);
+
+    return result;
+}
+
+
+/**
+ * @brief   Append a single record to the object cache journal.
+ * @param   op      the journal operation being recorded.
+ * @param   dtype   the type of the cached store affected by the operation.
+ * @param   payload a pointer to the operation-specific record payload.
+ * @param   plen    the length, in bytes, of the record payload.
+ * @return  0 on success or -1 on failure.
+ */
+int _append_cache_journal(cache_journal_op_t op, cached_data_type_t dtype, const unsigned char *payload, size_t plen) {
+
+    cache_journal_hdr_t hdr;
+    unsigned char *record;
+    char *jfile;
+    size_t rlen;
+
+    if (!payload || !plen || (plen > UINT32_MAX)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(_cache_flags & CACHE_PERM_SAVE)) {
+        RET_ERROR_INT(ERR_PERM, NULL);
+    }
+
+    hdr.op = op;
+    hdr.dtype = dtype;
+    hdr.len = plen;
+    rlen = sizeof(hdr) + plen;
+
+    // Each record goes out in a single write so that a crash can at worst leave a truncated record at the end of the journal.
+    if (!(record = malloc(rlen))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_INT(ERR_NOMEM, "could not allocate space for cache journal record");
+    }
+
+    memcpy(record, &hdr, sizeof(hdr));
+    memcpy(record + sizeof(hdr), payload, plen);
+
+    pthread_mutex_lock(&_journal_lock);
+
+    if (_journal_fd < 0) {
+
+        if (!(jfile = _get_cache_journal_location())) {
+            pthread_mutex_unlock(&_journal_lock);
+            free(record);
+            RET_ERROR_INT(ERR_UNSPEC, "unable to determine cache journal location");
+        }
+
+        if ((_journal_fd = open(jfile, (O_CREAT | O_APPEND | O_WRONLY), (S_IRWXU))) < 0) {
+            PUSH_ERROR_SYSCALL("open");
+            PUSH_ERROR_FMT(ERR_UNSPEC, "unable to open object cache journal for writing: %s", jfile);
+            pthread_mutex_unlock(&_journal_lock);
+            free(jfile);
+            free(record);
+            return -1;
+        }
+
+        free(jfile);
+    }
+
+    if ((size_t)write(_journal_fd, record, rlen) != rlen) {
+        PUSH_ERROR_SYSCALL("write");
+        pthread_mutex_unlock(&_journal_lock);
+        free(record);
+        RET_ERROR_INT(ERR_UNSPEC, "error writing record to object cache journal");
+    }
+
+    _journal_size += rlen;
+    pthread_mutex_unlock(&_journal_lock);
+    free(record);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Record the addition or replacement of a persistent cached object in the object cache journal.
+ * @note    Nothing is recorded unless journal mode is enabled, the cache may be saved, and the object is marked as persistent.
+ * @param   obj     a pointer to the cached object that was added to the cache.
+ * @return  0 on success or -1 on failure.
+ */
+int _journal_cached_object(const cached_object_t *obj) {
+
+    unsigned char *payload;
+    size_t plen;
+    int res;
+
+    if (!obj) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    // A cache that may not be saved, such as one in no-cache mode, has nothing to journal.
+    if (!_cache_journaling || !(_cache_flags & CACHE_PERM_SAVE) || !obj->persists) {
+        return 0;
+    }
+
+    if (!(payload = _serialize_cached_object(obj, &plen))) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not serialize cached object for journal");
+    }
+
+    res = _append_cache_journal(cache_journal_add, obj->dtype, payload, plen);
+    free(payload);
+
+    return res;
+}
+
+
+/**
+ * @brief   Record the removal of a persistent cached object in the object cache journal.
+ * @note    Nothing is recorded unless journal mode is enabled, the cache may be saved, and the object (or the object it shadows) was persistent.
+ * @param   obj     a pointer to the cached object that was removed from the cache.
+ * @return  0 on success or -1 on failure.
+ */
+int _journal_removed_object(const cached_object_t *obj) {
+
+    if (!obj) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!_cache_journaling || !(_cache_flags & CACHE_PERM_SAVE) || !(obj->persists || (obj->shadow && obj->shadow->persists))) {
+        return 0;
+    }
+
+    return _append_cache_journal(cache_journal_remove, obj->dtype, obj->id, sizeof(obj->id));
+}
+
+
+/**
+ * @brief   Replay the object cache journal on top of the objects that were loaded from the base cache file.
+ * @note    A truncated record at the end of the journal is the result of an interrupted write, and is ignored.
+ * @return  the number of journal records replayed on success, or -1 on failure.
+ */
+int _replay_cache_journal(void) {
+
+    cache_journal_hdr_t hdr;
+    cached_store_t *store;
+    cached_object_t *obj;
+    unsigned char *payload = NULL;
+    char *jfile;
+    void *reall_res;
+    size_t plen = 0, jsize = 0;
+    int jfd, result = 0;
+
+    if (!(jfile = _get_cache_journal_location())) {
+        RET_ERROR_INT(ERR_UNSPEC, "unable to determine cache journal location");
+    }
+
+    if ((jfd = open(jfile, O_RDONLY)) < 0) {
+        free(jfile);
+
+        if (errno == ENOENT) {
+            return 0;
+        }
+
+        PUSH_ERROR_SYSCALL("open");
+        RET_ERROR_INT(ERR_UNSPEC, "unable to open object cache journal for reading");
+    }
+
+    free(jfile);
+
+    while (read(jfd, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+
+        if (hdr.len > plen) {
+
+            if (!(reall_res = realloc(payload, hdr.len))) {
+                PUSH_ERROR_SYSCALL("realloc");
+                free(payload);
+                close(jfd);
+                RET_ERROR_INT(ERR_NOMEM, NULL);
+            }
+
+            payload = reall_res;
+            plen = hdr.len;
+        }
+
+        if (read(jfd, payload, hdr.len) != (ssize_t)hdr.len) {
+            _dbgprint(1, "Ignoring truncated record at end of object cache journal.\n");
+            break;
+        }
+
+        jsize += sizeof(hdr) + hdr.len;
+        result++;
+
+        if (!(store = _get_cached_store_by_type(hdr.dtype))) {
+            fprintf(stderr, "Error: read cache journal record of unrecognized type. Continuing...\n");
+            continue;
+        }
+
+        if (hdr.op == cache_journal_remove) {
+
+            if (hdr.len != SHA_256_SIZE) {
+                fprintf(stderr, "Error: cache journal removal record had bad length. Continuing...\n");
+                continue;
+            }
+
+            _lock_cache_store(store);
+
+            if ((obj = _index_find_object(store, payload))) {
+                _unlink_object(obj, 1, 0);
+            }
+
+            _unlock_cache_store(store);
+        } else if (hdr.op == cache_journal_add) {
+
+            if (!(obj = _deserialize_cached_object(payload, hdr.len))) {
+                fprintf(stderr, "Error: journaled cached object could not be deserialized (continuing)...\n");
+                dump_error_stack();
+                _clear_error_stack();
+                continue;
+            }
+
+            if (_insert_loaded_object(store, obj, 1) < 0) {
+                fprintf(stderr, "Error: could not insert journaled object into cache.\n");
+                dump_error_stack();
+                _clear_error_stack();
+                _destroy_cache_entry(obj);
+            }
+
+        } else {
+            fprintf(stderr, "Error: read cache journal record with unrecognized operation. Continuing...\n");
+        }
+
+    }
+
+    free(payload);
+    close(jfd);
+
+    pthread_mutex_lock(&_journal_lock);
+    _journal_size = jsize;
+    pthread_mutex_unlock(&_journal_lock);
+
+    _dbgprint(4, "Replayed %d records from object cache journal.\n", result);
+
+    return result;
+}
+
+
+/**
+ * @brief   Get the size of the object cache journal, as a mark of the records that a new base cache file will contain.
+ * @return  the number of bytes of journal records appended since the journal was last emptied.
+ */
+size_t _get_cache_journal_size(void) {
+
+    size_t result;
+
+    pthread_mutex_lock(&_journal_lock);
+    result = _journal_size;
+    pthread_mutex_unlock(&_journal_lock);
+
+    return result;
+}
+
+
+/**
+ * @brief   Drop the records that have been folded into the base cache file from the object cache journal.
+ * @note    Records appended while the base cache file was being written may have missed the snapshot of their store, so
+ *              they are kept. Replaying a record whose change the base file already holds is harmless. The remaining
+ *              records are written to a new journal that replaces the old one, so that a crash can't lose them.
+ * @param   base_size   the size, in bytes, of the newly written base cache file.
+ * @param   folded      the size of the journal, as returned by _get_cache_journal_size(), when the base cache file
+ *                          started being written.
+ * @return  0 on success or -1 on failure.
+ */
+int _truncate_cache_journal(size_t base_size, size_t folded) {
+
+    struct stat sb;
+    unsigned char *tail = NULL;
+    char *jfile, *tfile = NULL;
+    size_t tlen;
+    int jfd, tfd;
+
+    pthread_mutex_lock(&_journal_lock);
+
+    if (_journal_fd >= 0) {
+        close(_journal_fd);
+        _journal_fd = -1;
+    }
+
+    if (!(jfile = _get_cache_journal_location())) {
+        pthread_mutex_unlock(&_journal_lock);
+        RET_ERROR_INT(ERR_UNSPEC, "unable to determine cache journal location");
+    }
+
+    tlen = (_journal_size > folded) ? (_journal_size - folded) : 0;
+
+    if (!tlen) {
+
+        if ((truncate(jfile, 0) < 0) && (errno != ENOENT)) {
+            PUSH_ERROR_SYSCALL("truncate");
+            pthread_mutex_unlock(&_journal_lock);
+            free(jfile);
+            RET_ERROR_INT(ERR_UNSPEC, "unable to truncate object cache journal");
+        }
+
+        free(jfile);
+        _journal_size = 0;
+        _cache_base_size = base_size;
+        pthread_mutex_unlock(&_journal_lock);
+
+        return 0;
+    }
+
+    // The records to be kept are the last ones that were appended, so they're read from the end of the journal.
+    if (!(tail = malloc(tlen)) || !str_printf(&tfile, "%s%s", jfile, CACHE_TEMP_SUFFIX)) {
+        PUSH_ERROR_SYSCALL("malloc");
+        pthread_mutex_unlock(&_journal_lock);
+        free(jfile);
+        free(tail);
+        RET_ERROR_INT(ERR_NOMEM, "could not allocate space for remaining cache journal records");
+    }
+
+    if ((jfd = open(jfile, O_RDONLY)) < 0 || fstat(jfd, &sb) < 0 || ((size_t)sb.st_size < tlen) ||
+        (pread(jfd, tail, tlen, sb.st_size - tlen) != (ssize_t)tlen)) {
+        PUSH_ERROR_SYSCALL("pread");
+
+        if (jfd >= 0) {
+            close(jfd);
+        }
+
+        pthread_mutex_unlock(&_journal_lock);
+        free(jfile);
+        free(tfile);
+        free(tail);
+        RET_ERROR_INT(ERR_UNSPEC, "unable to read remaining records from object cache journal");
+    }
+
+    close(jfd);
+
+    if ((tfd = open(tfile, (O_CREAT | O_TRUNC | O_WRONLY), (S_IRWXU))) < 0 || (write(tfd, tail, tlen) != (ssize_t)tlen) ||
+        (close(tfd) < 0) || (rename(tfile, jfile) < 0)) {
+        PUSH_ERROR_SYSCALL("write");
+
+        if (tfd >= 0) {
+            close(tfd);
+        }
+
+        unlink(tfile);
+        pthread_mutex_unlock(&_journal_lock);
+        free(jfile);
+        free(tfile);
+        free(tail);
+        RET_ERROR_INT(ERR_UNSPEC, "unable to rewrite object cache journal");
+    }
+
+    free(jfile);
+    free(tfile);
+    free(tail);
+    _journal_size = tlen;
+    _cache_base_size = base_size;
+    pthread_mutex_unlock(&_journal_lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Set the permissions flags for the object cache.
+ * @param   flags
+ * @return  -1 on error or 0 if the permissions were set successfully.
+ */
+int _set_cache_permissions(unsigned long flags) {
+
+    if (flags & ~(CACHE_PERM_ALL_FLAGS)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, "invalid cache permision mask");
+    }
+
+    _cache_flags = flags;
+
+    return 0;
+}
+
+
+/**
+ * @brief   Set the global memory budget of the object cache, evicting objects right away if it's already exceeded.
+ * @note    Objects in internal cached stores, and persistent objects while the cache may be saved, count against the budget
+ *              but are never evicted.
+ * @param   max_bytes   the approximate number of bytes the cache may hold, or 0 for no limit.
+ * @return  0 on success or -1 on failure.
+ */
+int _set_cache_budget(size_t max_bytes) {
+
+    pthread_mutex_lock(&_budget_lock);
+    _cache_max_bytes = max_bytes;
+    pthread_mutex_unlock(&_budget_lock);
+
+    _enforce_cache_budget(NULL);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Set the memory budget of a cached store, evicting objects from it right away if it's already exceeded.
+ * @param   dtype       the type of the cached store to be bounded.
+ * @param   max_bytes   the approximate number of bytes the store may hold, or 0 for no limit.
+ * @return  0 on success or -1 on failure.
+ */
+int _set_cache_store_budget(cached_data_type_t dtype, size_t max_bytes) {
+
+    cached_store_t *store;
+
+    if (!(store = _get_cached_store_by_type(dtype))) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    } else if (store->internal && max_bytes) {
+        RET_ERROR_INT(ERR_UNSPEC, "objects in internal cached stores cannot be evicted");
+    }
+
+    _lock_cache_store(store);
+    store->max_bytes = max_bytes;
+    _unlock_cache_store(store);
+
+    _enforce_cache_budget(store);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Get the memory usage and eviction counters of a cached store, or of the whole object cache.
+ * @param   dtype       the type of the cached store to be queried, or cached_data_unknown for the total of all stores.
+ * @param   resident    an optional pointer to a variable that will receive the approximate number of bytes held.
+ * @param   evictions   an optional pointer to a variable that will receive the number of objects evicted to stay within budget.
+ * @return  0 on success or -1 on failure.
+ */
+int _get_cache_usage(cached_data_type_t dtype, size_t *resident, size_t *evictions) {
+
+    cached_store_t *store;
+    size_t total_resident = 0, total_evictions = 0;
+
+    if (!resident && !evictions) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    } else if ((dtype != cached_data_unknown) && !_get_cached_store_by_type(dtype)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    for(size_t i = 1; i < sizeof(cached_stores) / sizeof(cached_store_t); i++) {
+        store = &(cached_stores[i]);
+
+        if ((dtype != cached_data_unknown) && (store->dtype != dtype)) {
+            continue;
+        }
+
+        total_resident += __atomic_load_n(&(store->stats.bytes), __ATOMIC_RELAXED);
+        total_evictions += __atomic_load_n(&(store->stats.evictions), __ATOMIC_RELAXED);
+    }
+
+    if (resident) {
+        *resident = total_resident;
+    }
+
+    if (evictions) {
+        *evictions = total_evictions;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Get a snapshot of the usage counters of a cached store, or the totals across the whole object cache.
+ * @note    The counters are read without locking, so they are only consistent with one another to within a few operations.
+ * @param   dtype   the type of the cached store to be queried, or cached_data_unknown for the total of all stores.
+ * @param   stats   a pointer to a cached store statistics structure that will receive the counters.
+ * @return  0 on success or -1 on failure.
+ */
+int _get_cache_stats(cached_data_type_t dtype, cached_store_stats_t *stats) {
+
+    cached_store_t *store;
+
+    if (!stats) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    } else if ((dtype != cached_data_unknown) && !_get_cached_store_by_type(dtype)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    memset(stats, 0, sizeof(cached_store_stats_t));
+
+    for(size_t i = 1; i < sizeof(cached_stores) / sizeof(cached_store_t); i++) {
+        store = &(cached_stores[i]);
+
+        if ((dtype != cached_data_unknown) && (store->dtype != dtype)) {
+            continue;
+        }
+
+        stats->hits += __atomic_load_n(&(store->stats.hits), __ATOMIC_RELAXED);
+        stats->misses += __atomic_load_n(&(store->stats.misses), __ATOMIC_RELAXED);
+        stats->coalesced += __atomic_load_n(&(store->stats.coalesced), __ATOMIC_RELAXED);
+        stats->inserts += __atomic_load_n(&(store->stats.inserts), __ATOMIC_RELAXED);
+        stats->evictions += __atomic_load_n(&(store->stats.evictions), __ATOMIC_RELAXED);
+        stats->expired += __atomic_load_n(&(store->stats.expired), __ATOMIC_RELAXED);
+        stats->bytes += __atomic_load_n(&(store->stats.bytes), __ATOMIC_RELAXED);
+        stats->lock_wait_ns += __atomic_load_n(&(store->stats.lock_wait_ns), __ATOMIC_RELAXED);
+
+        // Time spent waiting for the shard locks is charged to the store as well.
+        for (size_t j = 0; j < CACHE_STORE_SHARDS; j++) {
+            stats->lock_wait_ns += __atomic_load_n(&(store->shards[j].lock_wait_ns), __ATOMIC_RELAXED);
+        }
+
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Get the number of objects held by a cached store, or by the whole object cache.
+ * @param   dtype   the type of the cached store to be counted, or cached_data_unknown for the total of all stores.
+ * @param   objects a pointer to a variable that will receive the number of cached objects.
+ * @return  0 on success or -1 on failure.
+ */
+int _get_cached_object_count(cached_data_type_t dtype, size_t *objects) {
+
+    if (!objects) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    } else if ((dtype != cached_data_unknown) && !_get_cached_store_by_type(dtype)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    *objects = 0;
+
+    for(size_t i = 1; i < sizeof(cached_stores) / sizeof(cached_store_t); i++) {
+
+        if ((dtype == cached_data_unknown) || (cached_stores[i].dtype == dtype)) {
+            *objects += _cached_store_count(&(cached_stores[i]));
+        }
+
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief       Append a variable-length chunk of data to a dynamically allocated buffer for serialization.
+ * @param   buf a pointer to the address of the output buffer that will be resized to hold the result, or NULL to allocate one.
+ * @param   blen    a pointer to a variable that holds the buffer's current size and will receive the
+ *                      size of the newly resized output buffer.
+ * @param   data    a pointer to a buffer holding the data that will be appended to the end of the output buffer.
+ * @param   dlen    the size, in bytes, of the data buffer to be appended to the output buffer.
+ * @return  the new size of the (re)allocated output buffer, or 0 on failure.
+ */
+size_t _mem_append_serialized(unsigned char **buf, size_t *blen, const unsigned char *data, size_t dlen) {
+
+    int res;
+
+    if (!buf || !blen) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!_mem_append(buf, blen, (unsigned char *)&dlen, sizeof(dlen))) {
+        RET_ERROR_UINT(ERR_NOMEM, NULL);
+    }
+
+    if (!(res = _mem_append(buf, blen, data, dlen))) {
+        RET_ERROR_UINT(ERR_NOMEM, NULL);
+    }
+
+    return res;
+}
+
+
+/**
+ * @brief   Apped a null-terminated string to a dynamically allocated buffer for serialization.
+ * @param   buf a pointer to the address of the output buffer that will be resized to hold the result, or NULL to allocate one.
+ * @param   blen    a pointer to a variable that holds the buffer's current size and will receive the
+ *                      size of the newly resized output buffer.
+ * @param   string  a null-terminated string that will be appended to the end of the output buffer.
+ * @return  the new size of the (re)allocated output buffer, or 0 on failure.
+ */
+size_t _mem_append_serialized_string(unsigned char **buf, size_t *blen, const char *string) {
+
+    unsigned char null = 0;
+    int res;
+
+    if (!buf || !blen) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!string) {
+        res = _mem_append(buf, blen, &null, sizeof(null));
+    } else {
+        res = _mem_append(buf, blen, (unsigned char *)string, strlen(string) + 1);
+    }
+
+    if (!res) {
+        RET_ERROR_UINT(ERR_NOMEM, NULL);
+    }
+
+    return res;
+}
+
+
+/**
+ * @brief   Append an array of fixed-size objects to a dynamically allocated buffer for serialization.
+ * @param   buf     a pointer to the address of the output buffer that will be resized to hold the result, or NULL to allocate one.
+ * @param   blen        a pointer to a variable that holds the buffer's current size and will receive the
+ *                              size of the newly resized output buffer.
+ * @param   array       an array of pointers to fixed-size objects (ending with a NULL pointer) to be
+ *                              appended to the end of the output buffer.
+ * @param   itemsize    the size, in bytes, of the array elements to be deserialized.
+ * @return  the new size of the (re)allocated output buffer, or 0 on failure.
+ */
+size_t _mem_append_serialized_array(unsigned char **buf, size_t *blen, const unsigned char **array, size_t itemsize) {
+
+    unsigned char *dataholder = NULL;
+    const unsigned char **arptr = array;
+    size_t holdlen = 0, result;
+
+    if (!buf || !blen) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    // If there's no data, then just write a null size.
+    if (!array) {
+
+        if (!(result = _mem_append(buf, blen, (unsigned char *)&holdlen, sizeof(holdlen)))) {
+            RET_ERROR_UINT(ERR_NOMEM, NULL);
+        }
+
+        return result;
+    }
+
+    // First construct a buffer to hold all the data in the array together in one contiguous space.
+    while (*arptr) {
+
+        if (!_mem_append(&dataholder, &holdlen, *arptr, itemsize)) {
+
+            if (dataholder) {
+                free(dataholder);
+            }
+
+            RET_ERROR_UINT(ERR_NOMEM, "unable to allocate space for serialized data array");
+        }
+
+        arptr++;
+    }
+
+    result = _mem_append_serialized(buf, blen, dataholder, holdlen);
+    free(dataholder);
+
+    if (!result) {
+        RET_ERROR_UINT(ERR_NOMEM, NULL);
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief   Append an array of null-terminated strings to a dynamically allocated buffer for serialization.
+ * @param   buf a pointer to the address of the output buffer that will be resized to hold the result, or NULL to allocate one.
+ * @param   blen    a pointer to a variable that holds the buffer's current size and will receive the
+ *                      size of the newly resized output buffer.
+ * @param   array   an array of pointers to null-terminated strings (ending with a NULL pointer) to be
+ *                      appended to the end of the output buffer.
+ * @return  the new size of the (re)allocated output buffer, or 0 on failure.
+ */
+size_t _mem_append_serialized_str_array(unsigned char **buf, size_t *blen, const char **array) {
+
+    unsigned char *strholder = NULL;
+    const char **arptr = array;
+    size_t holdlen = 0, result;
+
+    if (!buf || !blen) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    // If there's no data, then just write a null size.
+    if (!array) {
+
+        if (!(result = _mem_append(buf, blen, (unsigned char *)&holdlen, sizeof(holdlen)))) {
+            RET_ERROR_UINT(ERR_NOMEM, NULL);
+        }
+
+        return result;
+    }
+
+    // First construct a buffer to hold all the string data in the array together in one contiguous space.
+    // This will consist of all strings end-to-end (along with their terminating null bytes).
+    while (*arptr) {
+
+        if (!_mem_append(&strholder, &holdlen, (unsigned char *)*arptr, strlen(*arptr) + 1)) {
+
+            if (strholder) {
+                free(strholder);
+            }
+
+            RET_ERROR_UINT(ERR_NOMEM, "unable to allocate space for serialized string array");
+        }
+
+        arptr++;
+    }
+
+    result = _mem_append_serialized(buf, blen, strholder, holdlen);
+    free(strholder);
+
+    if (!result) {
+        RET_ERROR_UINT(ERR_NOMEM, NULL);
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief   Append an array of custom-formatted data to a dynamically allocated buffer for serialization.
+ * @note    This function uses a custom serialization function in order to output the user data properly.
+ * @param   buf a pointer to the address of the output buffer that will be resized to hold the result, or NULL to allocate one.
+ * @param   blen    a pointer to a variable that holds the buffer's current size and will receive the
+ *                      size of the newly resized output buffer.
+ * @param   array   an array of pointers to custom-formatted data buffers (ending with a NULL pointer) to be
+ *                      appended to the end of the output buffer using a custom serialization function.
+ * @param   sfn a custom serialization function that will be used to serialize the user data into the output buffer.
+ * @return  the new size of the (re)allocated output buffer, or 0 on failure.
+ */
+size_t _mem_append_serialized_array_cb(unsigned char **buf, size_t *blen, const char **array, custom_serializer_t sfn) {
+
+    unsigned char *dataholder = NULL;
+    const char **arptr = array;
+    size_t holdlen = 0, result;
+
+    if (!buf || !blen || !sfn) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    // If there's no data, then just write a null size.
+    if (!array) {
+
+        if (!(result = _mem_append(buf, blen, (unsigned char *)&holdlen, sizeof(holdlen)))) {
+            RET_ERROR_UINT(ERR_NOMEM, NULL);
+        }
+
+        return result;
+    }
+
+    // First construct a buffer to hold all the data in the array together in one contiguous space.
+    while (*arptr) {
+
+        if (!sfn(&dataholder, &holdlen, *arptr)) {
+
+            if (dataholder) {
+                free(dataholder);
+            }
+
+            RET_ERROR_UINT(ERR_NOMEM, "unable to allocate space to add serialized data array to object cache");
+        }
+
+        arptr++;
+    }
+
+    result = _mem_append_serialized(buf, blen, dataholder, holdlen);
+    free(dataholder);
+
+    if (!result) {
+        RET_ERROR_UINT(ERR_NOMEM, NULL);
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief   Deserialize a fixed-sized chunk of data from an input buffer.
+ * @note    This is the inverse function of _mem_append();
+ *              dst must be at least len bytes long.
+ * @param   dst     a pointer to the output buffer that will receive the deserialized data.
+ * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
+ *                              which will be updated after the operation to point to the next available data.
+ * @param   bufend      a pointer to the end of the input buffer for validation purposes.
+ * @param   len     the size of the data chunk to be deserialized from the input buffer.
+ * @return  1 on success or 0 on failure.
+ */
+unsigned int _deserialize_data(unsigned char *dst, unsigned char **bufptr, const unsigned char *bufend, size_t len) {
+
+    size_t left;
+
+    if (!dst || !bufptr || !bufend) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    left = bufend - *bufptr;
+    if (len > left) {
+        RET_ERROR_UINT_FMT(ERR_UNSPEC, "could not deserialize data due to buffer underflow (%zu of %zu bytes)", len, left);
+    }
+
+    memcpy(dst, *bufptr, len);
+    *bufptr += len;
+
+    return 1;
+}
+
+
+/**
+ * @brief   Deserialize a variable-length chunk of data from an input buffer.
+ * @note    This is the inverse function of _mem_append_serialized.
+ * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
+ *                              which will be updated after the operation to point to the next available data.
+ * @param   bufend      a pointer to the end of the input buffer for validation purposes.
+ * @param   olen        an optional pointer to receive the size of the deserialized data on success.
+ * @return  a pointer to a newly allocated buffer containing the deserialized data on success, or NULL on failure.
+ */
+unsigned char *_deserialize_vardata(unsigned char **bufptr, const unsigned char *bufend, size_t *olen) {
+
+    unsigned char *result;
+    size_t dlen;
+
+    if (!bufptr || !bufend) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    // First read in the data length.
+    if (!_deserialize_data((unsigned char *)&dlen, bufptr, bufend, sizeof(dlen))) {
+        RET_ERROR_UINT(ERR_UNSPEC, "could not read serialized data length");
+    }
+
+    if (!(result = malloc(dlen))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for deserialized data");
+    }
+
+    if (!_deserialize_data(result, bufptr, bufend, dlen)) {
+        free(result);
+        RET_ERROR_PTR(ERR_UNSPEC, "variable data deserialization failed");
+    }
+
+    if (olen) {
+        *olen = dlen;
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief   Deserialize a null-terminated string from an input buffer.
+ * @note    This is the inverse function of _mem_append_serialized_string().
+ * @param   dst     a pointer to the address of a string that will receive a copy of the deserialized
+ *                              data as a null-terminated string on success.
+ * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
+ *                              which will be updated after the operation to point to the next available data.
+ * @param   bufend      a pointer to the end of the input buffer for validation purposes.
+ * @return  1 on success or 0 on failure.
+ */
+unsigned int _deserialize_string(char **dst, unsigned char **bufptr, const unsigned char *bufend) {
+
+    unsigned char *bptr;
+    size_t rsize;
+
+    if (!dst || !bufptr || !*bufptr || !bufend) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    // Empty string succeeds but returns a NULL pointer, not an empty string.
+    if (!**bufptr) {
+        *dst = NULL;
+        *bufptr = *bufptr + 1;
+        return 1;
+    }
+
+    bptr = *bufptr;
+    while (*bptr && bptr < bufend) {
+        bptr++;
+    }
+
+    if (bptr == bufend) {
+        RET_ERROR_UINT(ERR_UNSPEC, "string deserialization failed due to buffer underflow");
+    }
+
+    rsize = bptr - *bufptr + 1;
+
+    if (!(*dst = malloc(rsize))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_UINT(ERR_UNSPEC, "could not deserialize string data due to memory allocation error");
+    }
+
+    memcpy(*dst, *bufptr, rsize);
+    *bufptr = *bufptr + rsize;
+
+    return 1;
+}
+
+
+/**
+ * @brief   Deserialize an array of fixed-size objects from an input buffer.
+ * @note    This is the inverse function of _mem_append_serialized_array().
+ * @param   dst     a pointer to the address of an array of objects that will receive a copy of the deserialized
+ *                              data as an array of (NULL pointer terminated) fixed-size objects on success.
+ * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
+ *                              which will be updated after the operation to point to the next available data.
+ * @param   bufend      a pointer to the end of the input buffer for validation purposes.
+ * @param   itemsize    the size, in bytes, of the fixed-sized objects to be deserialized.
+ * @return  1 on success or 0 on failure.
+ */
+unsigned int _deserialize_array(unsigned char ***dst, unsigned char **bufptr, const unsigned char *bufend, size_t itemsize) {
+
+    unsigned char *nbufend, *objptr, **chain = NULL;
+    size_t dlen;
+
+    if (!dst || !bufptr || !bufend) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    // First read in the data length.
+    if (!_deserialize_data((unsigned char *)&dlen, bufptr, bufend, sizeof(dlen))) {
+        RET_ERROR_UINT(ERR_UNSPEC, "could not read serialized data length");
+    }
+
+    // If it's a null size, then the record is empty.
+    if (!dlen) {
+        *dst = NULL;
+        return 1;
+    }
+
+    // For the purpose of this function, we need to create a new bufend.
+    nbufend = *bufptr + dlen;
+
+    // Make sure it doesn't point too far into the distance.
+    if (nbufend > bufend) {
+        RET_ERROR_UINT(ERR_UNSPEC, "deserialization error: record stretched out of bounds");
+    }
+
+    // As long as we haven't reached the end of the buffer, keep trying to read more objects.
+    while (*bufptr < nbufend) {
+
+        if (!(objptr = malloc(itemsize))) {
+            PUSH_ERROR_SYSCALL("malloc");
+
+            if (chain) {
+                _ptr_chain_free(chain);
+            }
+
+            RET_ERROR_UINT(ERR_NOMEM, "unable to allocate space for deserialized object");
+        }
+
+        if (!_deserialize_data(objptr, bufptr, nbufend, itemsize)) {
+            free(objptr);
+
+            if (chain) {
+                _ptr_chain_free(chain);
+            }
+
+            RET_ERROR_UINT(ERR_UNSPEC, "data deserialization failed");
+        }
+
+        if (!(chain = _ptr_chain_add(chain, objptr))) {
+            RET_ERROR_UINT(ERR_UNSPEC, "could not add deserialized data to chain");
+        }
+
+
+    }
+
+    if (*bufptr != nbufend) {
+        _ptr_chain_free(chain);
+        RET_ERROR_UINT(ERR_UNSPEC, "reached unexpected end of data buffer");
+    }
+
+    *dst = chain;
+
+    return 1;
+}
+
+
+/**
+ * @brief   Deserialize an array of null-terminated string from an input buffer.
+ * @note    This is the inverse function of _mem_append_serialized_str_array().
+ * @param   dst     a pointer to the address of an array of strings that will receive a copy of the deserialized
+ *                              data as an array of (NULL pointer terminated) null-terminated strings on success.
+ * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
+ *                              which will be updated after the operation to point to the next available data.
+ * @param   bufend      a pointer to the end of the input buffer for validation purposes.
+ * @return  1 on success or 0 on failure.
+ */
+unsigned int _deserialize_str_array(char ***dst, unsigned char **bufptr, const unsigned char *bufend) {
+
+    unsigned char *nbufend;
+    char **chain = NULL, *strptr;
+    size_t dlen;
+
+    if (!dst || !bufptr || !bufend) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    // First read in the data length.
+    if (!_deserialize_data((unsigned char *)&dlen, bufptr, bufend, sizeof(dlen))) {
+        RET_ERROR_UINT(ERR_UNSPEC, "could not read serialized data length");
+    }
+
+    // If it's a null size, then the record is empty.
+    if (!dlen) {
+        *dst = NULL;
+        return 1;
+    }
+
+    // For the purpose of this function, we need to create a new bufend.
+    nbufend = *bufptr + dlen;
+
+    // Make sure it doesn't point too far into the distance.
+    if (nbufend > bufend) {
+        RET_ERROR_UINT(ERR_UNSPEC, "deserialization error: record stretched out of bounds");
+    }
+
+    // As long as we haven't reached the end of the buffer, keep trying to read more strings.
+    while (*bufptr < nbufend) {
+
+        if (!_deserialize_string(&strptr, bufptr, nbufend)) {
+
+            if (chain) {
+                _ptr_chain_free(chain);
+            }
+
+            RET_ERROR_UINT(ERR_UNSPEC, "string deserialization failed");
+        }
+
+        if (!(chain = _ptr_chain_add(chain, strptr))) {
+            RET_ERROR_UINT(ERR_UNSPEC, "could not add deserialized string to chain");
+        }
+
+
+    }
+
+    if (*bufptr != nbufend) {
+        _ptr_chain_free(chain);
+        RET_ERROR_UINT(ERR_UNSPEC, "reached unexpected end of data buffer");
+    }
+
+    *dst = chain;
+
+    return 1;
+}
+
+
+/**
+ * @brief   Deserialize an array of custom-formatted data objects from an input buffer using a deserialization function.
+ * @note    This is the inverse function of _mem_append_serialized_array_cb().
+ * @param   dst     a pointer to the address of an array of data buffers that will receive a copy of the deserialized
+ *                              data as an array of (NULL pointer terminated) data buffers on success.
+ * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
+ *                              which will be updated after the operation to point to the next available data.
+ * @param   bufend      a pointer to the end of the input buffer for validation purposes.
+ * @param   dfn     a custom deserialization function that will be used to deserialize the user data from the input buffer.
+ * @return  1 on success or 0 on failure.
+ */
+unsigned int _deserialize_array_cb(unsigned char ***dst, unsigned char **bufptr, const unsigned char *bufend, custom_deserializer_t dfn) {
+
+    unsigned char *nbufend, *dptr, **chain = NULL;
+    size_t dlen;
+
+    if (!dst || !bufptr || !bufend || !dfn) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    // First read in the data length.
+    if (!_deserialize_data((unsigned char *)&dlen, bufptr, bufend, sizeof(dlen))) {
+        RET_ERROR_UINT(ERR_UNSPEC, "could not read serialized data length");
+    }
+
+    // If it's a null size, then the record is empty.
+    if (!dlen) {
+        *dst = NULL;
+        return 1;
+    }
+
+    // For the purpose of this function, we need to create a new bufend.
+    nbufend = *bufptr + dlen;
+
+    // Make sure it doesn't point too far into the distance.
+    if (nbufend > bufend) {
+        RET_ERROR_UINT(ERR_UNSPEC, "deserialization error: record stretched out of bounds");
+    }
+
+    // As long as we haven't reached the end of the buffer, keep trying to read more strings.
+    while (*bufptr < nbufend) {
+
+        if (!dfn(&dptr, bufptr, nbufend)) {
+
+            if (chain) {
+                _ptr_chain_free(chain);
+            }
+
+            RET_ERROR_UINT(ERR_UNSPEC, "deserialization handler failed");
+        }
+
+        if (!(chain = _ptr_chain_add(chain, dptr))) {
+            RET_ERROR_UINT(ERR_UNSPEC, "could not add deserialized data to chain");
+        }
+
+
+    }
+
+    if (*bufptr != nbufend) {
+        _ptr_chain_free(chain);
+        RET_ERROR_UINT(ERR_UNSPEC, "reached unexpected end of data buffer");
+    }
+
+    *dst = chain;
+
+    return 1;
+}
+
+
+/**
+ * @brief   Check to see if a cached object needs to be evicted for exceeding its TTL or expiration.
+ * @note    An object has "expired" and needs to be evicted from the cache if it has a non-zero TTL from its cache
+ *              date that has been reached, or a non-zero absolute expiration date that has been exceeded. If the object's
+ *               cache policy is relaxed, a TTL expiration advises a "refresh" if no absolute expiration has occurred.
+ * @param   obj     a pointer to the cached object to have its age examined.
+ * @param   refresh     an optional pointer to a value that, if the cached object has a relaxed expiration
+ *                              policy, will be set to 1 if it needs to be refreshed or 0 if it does not.
+ * @return  1 if the object has expired or 0 if it has not; -1 if a general error has occurred.
+ */
+int _is_object_expired(cached_object_t *obj, int *refresh) {
+
+    time_t now;
+
+    // This should never happen.
+    if (!obj || !obj->timestamp) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (refresh) {
+        *refresh = 0;
+    }
+
+    if (time(&now) == (time_t)-1) {
+        PUSH_ERROR_SYSCALL("time");
+        RET_ERROR_INT(ERR_UNSPEC, NULL);
+    }
+
+    if (obj->expiration && obj->expiration < now) {
+        return 1;
+    }
+
+    // If our cache eviction is relaxed, that means that a TTL expiration is ignored if and only if
+    // an expiration time for the object is set, and that time has not yet been reached.
+    if (obj->ttl && (time_t)(obj->timestamp + obj->ttl) <= now) {
+
+        if (!obj->relaxed || !obj->expiration) {
+            return 1;
+        }
+
+        if (refresh) {
+            *refresh = 1;
+        }
+
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Link a cached object into the head of its cached store's doubly linked list, and index it by its hashed id.
+ * @note    The caller must hold the cached store lock exclusively.
+ * @param   store   a pointer to the cached store that will hold the cached object.
+ * @param   object  a pointer to the cached object to be linked into the store.
+ * @return  0 on success or -1 on failure.
+ */
+int _link_object(cached_store_t *store, cached_object_t *object) {
+
+    if (!store || !object) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    // New objects get one pass of the eviction hand before they can be evicted. This is set before lookups can see them.
+    object->referenced = 1;
+    _size_cached_object(object);
+    _schedule_cached_object(store, object);
+
+    if (_expiry_add_object(store, object) < 0) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not add cached object to store expiry index");
+    }
+
+    if (_index_add_object(store, object) < 0) {
+        _expiry_remove_object(store, object);
+        RET_ERROR_INT(ERR_UNSPEC, "could not add cached object to store index");
+    }
+
+    object->prev = NULL;
+    object->next = store->head;
+
+    if (store->head) {
+        store->head->prev = object;
+    }
+
+    store->head = object;
+    _charge_cached_store(store, _charged_object_size(object), 0);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Unlink a cached object from its doubly linked list.
+ * @note    The caller must hold the cached store lock exclusively.
+ * @param   object      a pointer to the cached object to be delinked.
+ * @param   destroy     if set, deallocate the specified cached object after unlinking.
+ * @param   stale       if set, the cache removal was performed because of a stale entry.
+ * @return  a pointer to the next cached object in the store, or NULL if at the end of the store.
+ */
+cached_object_t *_unlink_object(cached_object_t *object, int destroy, int stale) {
+
+    cached_store_t *store;
+    cached_object_t *next = NULL;
+
+    if (!object) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(store = _get_cached_store_by_type(object->dtype))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "could not look up cached object store by type");
+    }
+
+    // If we're the only object in the store then reposition the head.
+    if (store && (store->head == object)) {
+        store->head = object->next;
+    }
+
+    if (object->prev) {
+        object->prev->next = object->next;
+    }
+
+    if (object->next) {
+        object->next->prev = object->prev;
+        next = object->next;
+    }
+
+    _index_remove_object(store, object);
+    _expiry_remove_object(store, object);
+    _charge_cached_store(store, _charged_object_size(object), 1);
+
+    // Don't leave the eviction hand pointing at an object that is no longer in the store.
+    if (store->hand == object) {
+        store->hand = object->next;
+    }
+
+    if (stale && (_verbose >= 4) && store) {
+
+        if (store->dump) {
+            _dbgprint(4, "Evicting stale data from cache: ");
+            _dump_cache_data(stderr, object, 0);
+        } else {
+            _dbgprint(4, "Evicting stale data from cache...\n");
+        }
+
+    }
+
+    if (destroy) {
+
+        if (store->destructor && object->data) {
+            store->destructor(object->data);
+
+            if (get_last_error()) {
+                fprintf(stderr, "Cache destructor generated error(s):\n");
+                dump_error_stack();
+                _clear_error_stack();
+            }
+
+        }
+
+        // Any object that was being shadowed goes along with its override.
+        if (object->shadow) {
+            _destroy_cache_entry(object->shadow);
+        }
+
+        free(object->name);
+        free(object);
+    }
+
+    return next;
+}
+
+
+/**
+ * @brief   Replace one object in the cache with another.
+ * @note    If shadow is not set, then the old cached object will be automatically destroyed.
+ *              Otherwise this function also makes the old cached object the new cached object's "shadow" data.
+ *              The caller must hold the cached store lock exclusively, and oobj must be the live object in the store.
+ * @param   oobj    a pointer to the old cached object to be replaced in its cached store with the new object.
+ * @param   nobj    a pointer to the new cached object that will replace the old object in the cached store.
+ * @param   shadow  if set, preserve the old object as the "shadow" value of the new object.
+ * @return  NULL on failure, or a pointer to the new cached object on success.
+ */
+cached_object_t *_replace_object(cached_object_t *oobj, cached_object_t *nobj, int shadow) {
+
+    cached_store_t *store;
+
+    if (!oobj || !nobj) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (oobj->dtype != nobj->dtype) {
+        RET_ERROR_PTR(ERR_UNSPEC, "cached object replacement cannot be performed on different object types");
+    }
+
+    if (!(store = _get_cached_store_by_type(oobj->dtype))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "could not look up cached object store by type");
+    }
+
+    // If we're the only object in the store then reposition the head.
+    if (store && (store->head == oobj)) {
+        store->head = nobj;
+    }
+
+    nobj->prev = oobj->prev;
+    nobj->next = oobj->next;
+
+    if (oobj->prev) {
+        oobj->prev->next = nobj;
+    }
+
+    if (oobj->next) {
+        oobj->next->prev = nobj;
+    }
+
+    // Finally, the two must have matching ids.
+    memcpy(nobj->id, oobj->id, SHA_256_SIZE);
+    nobj->referenced = 1;
+    _size_cached_object(nobj);
+
+    if (_index_replace_object(store, oobj, nobj) < 0) {
+        RET_ERROR_PTR(ERR_UNSPEC, "could not update store index with replacement object");
+    }
+
+    oobj->prev = oobj->next = NULL;
+    _charge_cached_store(store, _charged_object_size(oobj), 1);
+
+    // A shadowed object never expires on its own, so only the new object is left to be swept.
+    _expiry_remove_object(store, oobj);
+    _schedule_cached_object(store, nobj);
+
+    if (_expiry_add_object(store, nobj) < 0) {
+        fprintf(stderr, "Error: could not add replacement object to store expiry index; it will only expire on lookup.\n");
+        dump_error_stack();
+        _clear_error_stack();
+    }
+
+    if (store->hand == oobj) {
+        store->hand = nobj;
+    }
+
+    if (shadow) {
+        nobj->shadow = oobj;
+    } else {
+        nobj->shadow = NULL;
+        _destroy_cache_entry(oobj);
+    }
+
+    _charge_cached_store(store, _charged_object_size(nobj), 0);
+
+    return nobj;
+}
+
+
+/**
+ * @brief   Get the starting hash index slot for a hashed cached object id.
+ * @note    Object ids are already SHA-256 hashes, so their leading bytes are uniformly distributed.
+ * @param   hashid  the hashed id of the cached object.
+ * @param   nslots  the number of slots in the hash index (must be a power of two).
+ * @return  the slot at which probing should begin for the specified id.
+ */
+static size_t _index_slot(const unsigned char *hashid, size_t nslots) {
+
+    uint64_t hval;
+
+    memcpy(&hval, hashid, sizeof(hval));
+
+    return (size_t)(hval & (nslots - 1));
+}
+
+
+/**
+ * @brief   Get the shard of a cached store that indexes objects with a given hashed id.
+ * @note    The shard is picked with the trailing byte of the id, which is independent of the bits used to pick an index slot.
+ * @param   store   a pointer to the cached store.
+ * @param   hashid  the hashed id of the cached object.
+ * @return  a pointer to the cached store shard responsible for the id.
+ */
+cache_shard_t *_get_cache_shard(cached_store_t *store, const unsigned char *hashid) {
+
+    return &(store->shards[hashid[SHA_256_SIZE - 1] & (CACHE_STORE_SHARDS - 1)]);
+}
+
+
+/**
+ * @brief   Look up a cached object in a cached store by its hashed id using the store's hash index.
+ * @note    The caller must hold either the cached store lock, or the lock of the shard responsible for the id.
+ * @param   store   a pointer to the cached store to be searched.
+ * @param   hashid  the hashed id of the cached object to be found.
+ * @return  a pointer to the indexed cached object if it was found, or NULL if it was not.
+ */
+cached_object_t *_index_find_object(cached_store_t *store, const unsigned char *hashid) {
+
+    cache_shard_t *shard;
+    cached_object_t *ptr;
+    size_t slot;
+
+    if (!store || !hashid) {
+        return NULL;
+    }
+
+    if (!(shard = _get_cache_shard(store, hashid))->index) {
+        return NULL;
+    }
+
+    slot = _index_slot(hashid, shard->index_slots);
+
+    while ((ptr = shard->index[slot])) {
+
+        if ((ptr != CACHE_INDEX_TOMBSTONE) && !memcmp(ptr->id, hashid, SHA_256_SIZE)) {
+            return ptr;
+        }
+
+        slot = (slot + 1) & (shard->index_slots - 1);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief   Add a cached object to the hash index of a cached store.
+ * @note    The caller must hold the cached store lock, and is responsible for making sure the object's id is not already indexed.
+ *              The object becomes visible to lookups as soon as this function returns.
+ * @param   store   a pointer to the cached store that is indexing the object.
+ * @param   object  a pointer to the cached object to be indexed by its hashed id.
+ * @return  0 on success or -1 on failure.
+ */
+int _index_add_object(cached_store_t *store, cached_object_t *object) {
+
+    cache_shard_t *shard;
+    size_t slot, nslots;
+
+    if (!store || !object) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    shard = _get_cache_shard(store, object->id);
+    _lock_cache_shard(shard);
+
+    // Grow the index once it gets too crowded; if most of the crowding is tombstones, rebuilding it at the same size is enough.
+    if (!shard->index || ((shard->index_used + shard->index_deleted + 1) * 100 > shard->index_slots * CACHE_INDEX_MAX_LOAD)) {
+        nslots = shard->index_slots ? shard->index_slots : CACHE_INDEX_MIN_SLOTS;
+
+        while ((shard->index_used + 1) * 100 > (nslots * CACHE_INDEX_MAX_LOAD) / 2) {
+            nslots *= 2;
+        }
+
+        if (_index_resize(shard, nslots) < 0) {
+            _unlock_cache_shard(shard);
+            RET_ERROR_INT(ERR_UNSPEC, "could not resize cached store index");
+        }
+
+    }
+
+    slot = _index_slot(object->id, shard->index_slots);
+
+    while (shard->index[slot] && (shard->index[slot] != CACHE_INDEX_TOMBSTONE)) {
+        slot = (slot + 1) & (shard->index_slots - 1);
+    }
+
+    if (shard->index[slot] == CACHE_INDEX_TOMBSTONE) {
+        shard->index_deleted--;
+    }
+
+    shard->index[slot] = object;
+    shard->index_used++;
+
+    _unlock_cache_shard(shard);
+
+    return 0;
+}
 
 
 /**
- * @brief   Append an array of custom-formatted data to a dynamically allocated buffer for serialization.
- * @note    This function uses a custom serialization function in order to output the user data properly.
- * @param   buf a pointer to the address of the output buffer that will be resized to hold the result, or NULL to allocate one.
- * @param   blen    a pointer to a variable that holds the buffer's current size and will receive the
- *                      size of the newly resized output buffer.
- * @param   array   an array of pointers to custom-formatted data buffers (ending with a NULL pointer) to be
- *                      appended to the end of the output buffer using a custom serialization function.
- * @param   sfn a custom serialization function that will be used to serialize the user data into the output buffer.
- * @return  the new size of the (re)allocated output buffer, or 0 on failure.
+ * @brief   Remove a cached object from the hash index of a cached store.
+ * @note    The caller must hold the cached store lock. Once this function returns, no lookup can still be using the object.
+ * @param   store   a pointer to the cached store that is indexing the object.
+ * @param   object  a pointer to the cached object to be removed from the index.
+ * @return  1 if the object was removed from the index, 0 if it wasn't indexed, or -1 on general failure.
  */
-size_t _mem_append_serialized_array_cb(unsigned char **buf, size_t *blen, const char **array, custom_serializer_t sfn) {
+int _index_remove_object(cached_store_t *store, const cached_object_t *object) {
 
-    unsigned char *dataholder = NULL;
-    const char **arptr = array;
-    size_t holdlen = 0, result;
+    cache_shard_t *shard;
+    size_t slot;
 
-    if (!buf || !blen || !sfn) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    if (!store || !object) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
-    // If there's no data, then just write a null size.
-    if (!array) {
+    shard = _get_cache_shard(store, object->id);
+    _lock_cache_shard(shard);
 
-        if (!(result = _mem_append(buf, blen, (unsigned char *)&holdlen, sizeof(holdlen)))) {
-            RET_ERROR_UINT(ERR_NOMEM, NULL);
+    if (!shard->index) {
+        _unlock_cache_shard(shard);
+        return 0;
+    }
+
+    slot = _index_slot(object->id, shard->index_slots);
+
+    while (shard->index[slot]) {
+
+        // Leave a tombstone behind so that probe sequences running through this slot aren't broken.
+        if (shard->index[slot] == object) {
+            shard->index[slot] = CACHE_INDEX_TOMBSTONE;
+            shard->index_used--;
+            shard->index_deleted++;
+            _unlock_cache_shard(shard);
+            return 1;
+        }
+
+        slot = (slot + 1) & (shard->index_slots - 1);
+    }
+
+    _unlock_cache_shard(shard);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Replace a cached object in the hash index of a cached store with another object having the same id.
+ * @note    The caller must hold the cached store lock. Once this function returns, no lookup can still be using the old object.
+ * @param   store   a pointer to the cached store that is indexing the object.
+ * @param   oobj    a pointer to the old cached object to be replaced in the index.
+ * @param   nobj    a pointer to the new cached object that will take over the old object's slot.
+ * @return  1 if the object was replaced in the index, 0 if the old object wasn't indexed, or -1 on general failure.
+ */
+int _index_replace_object(cached_store_t *store, const cached_object_t *oobj, cached_object_t *nobj) {
+
+    cache_shard_t *shard;
+    size_t slot;
+
+    if (!store || !oobj || !nobj) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (memcmp(oobj->id, nobj->id, SHA_256_SIZE)) {
+        RET_ERROR_INT(ERR_UNSPEC, "replacement object in store index must have a matching id");
+    }
+
+    shard = _get_cache_shard(store, oobj->id);
+    _lock_cache_shard(shard);
+
+    if (!shard->index) {
+        _unlock_cache_shard(shard);
+        return 0;
+    }
+
+    slot = _index_slot(oobj->id, shard->index_slots);
+
+    while (shard->index[slot]) {
+
+        if (shard->index[slot] == oobj) {
+            shard->index[slot] = nobj;
+            _unlock_cache_shard(shard);
+            return 1;
+        }
+
+        slot = (slot + 1) & (shard->index_slots - 1);
+    }
+
+    _unlock_cache_shard(shard);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Rebuild the hash index of a cached store shard with a new number of slots, discarding any tombstones.
+ * @note    The caller must hold the shard lock exclusively.
+ * @param   shard   a pointer to the cached store shard whose index will be rebuilt.
+ * @param   nslots  the new number of slots in the index; this must be a power of two.
+ * @return  0 on success or -1 on failure.
+ */
+int _index_resize(cache_shard_t *shard, size_t nslots) {
+
+    cached_object_t **nindex, *ptr;
+    size_t slot;
+
+    if (!shard || !nslots || (nslots & (nslots - 1)) || (nslots <= shard->index_used)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(nindex = calloc(nslots, sizeof(cached_object_t *)))) {
+        PUSH_ERROR_SYSCALL("calloc");
+        RET_ERROR_INT(ERR_NOMEM, "could not allocate space for cached store index");
+    }
+
+    for (size_t i = 0; i < shard->index_slots; i++) {
+
+        if (!(ptr = shard->index[i]) || (ptr == CACHE_INDEX_TOMBSTONE)) {
+            continue;
+        }
+
+        slot = _index_slot(ptr->id, nslots);
+
+        while (nindex[slot]) {
+            slot = (slot + 1) & (nslots - 1);
+        }
+
+        nindex[slot] = ptr;
+    }
+
+    free(shard->index);
+    shard->index = nindex;
+    shard->index_slots = nslots;
+    shard->index_deleted = 0;
+
+    return 0;
+}
+
+
+/**
+ * @brief   Get the time at which a cached object becomes stale.
+ * @note    This mirrors _is_object_expired(): relaxed objects with an absolute expiration outlive their TTL.
+ * @param   obj     a pointer to the cached object.
+ * @return  the first time at which the object is considered stale, or 0 if it never expires.
+ */
+time_t _get_object_deadline(const cached_object_t *obj) {
+
+    time_t result = 0, ttl_deadline;
+
+    if (!obj) {
+        return 0;
+    }
+
+    if (obj->expiration) {
+        result = obj->expiration + 1;
+    }
+
+    if (obj->ttl && (!obj->relaxed || !obj->expiration)) {
+        ttl_deadline = obj->timestamp + obj->ttl;
+
+        if (!result || (ttl_deadline < result)) {
+            result = ttl_deadline;
+        }
+
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief   Work out when a cached object is next due to be visited by the sweeper, and why.
+ * @note    Objects in stores with a refresh handler are due for refreshing shortly before their TTL runs out.
+ * @param   store   a pointer to the cached store holding the object.
+ * @param   obj     a pointer to the cached object to be scheduled.
+ */
+void _schedule_cached_object(const cached_store_t *store, cached_object_t *obj) {
+
+    time_t ahead;
+
+    if (!store || !obj) {
+        return;
+    }
+
+    obj->due = _get_object_deadline(obj);
+    obj->refresh_due = 0;
+
+    if (store->refresh && obj->name && obj->ttl) {
+        ahead = obj->timestamp + obj->ttl - ((obj->ttl * CACHE_REFRESH_AHEAD_PERCENT) / 100);
+
+        if (!obj->due || (ahead < obj->due)) {
+            obj->due = ahead;
+            obj->refresh_due = 1;
+        }
+
+    }
+
+}
+
+
+/**
+ * @brief   Swap two entries in a cached store's expiry heap, keeping the objects' heap positions up to date.
+ * @param   store   a pointer to the cached store.
+ * @param   a       the index of the first heap entry.
+ * @param   b       the index of the second heap entry.
+ */
+static void _expiry_swap(cached_store_t *store, size_t a, size_t b) {
+
+    cached_object_t *tmp;
+
+    tmp = store->expiry[a];
+    store->expiry[a] = store->expiry[b];
+    store->expiry[b] = tmp;
+    store->expiry[a]->expiry_pos = a + 1;
+    store->expiry[b]->expiry_pos = b + 1;
+
+}
+
+
+/**
+ * @brief   Restore the heap ordering of a cached store's expiry heap around an entry whose due time has changed.
+ * @param   store   a pointer to the cached store.
+ * @param   pos     the index of the heap entry to be sifted up or down into place.
+ */
+static void _expiry_sift(cached_store_t *store, size_t pos) {
+
+    size_t child;
+
+    while (pos && (store->expiry[pos]->due < store->expiry[(pos - 1) / 2]->due)) {
+        _expiry_swap(store, pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+
+    while ((child = (2 * pos) + 1) < store->expiry_used) {
+
+        if (((child + 1) < store->expiry_used) && (store->expiry[child + 1]->due < store->expiry[child]->due)) {
+            child++;
+        }
+
+        if (store->expiry[pos]->due <= store->expiry[child]->due) {
+            break;
+        }
+
+        _expiry_swap(store, pos, child);
+        pos = child;
+    }
+
+}
+
+
+/**
+ * @brief   Add a cached object to its store's expiry heap, according to its due time.
+ * @note    The caller must hold the cached store lock exclusively. Objects that are never due are left out of the heap.
+ * @param   store   a pointer to the cached store holding the object.
+ * @param   obj     a pointer to the cached object to be added.
+ * @return  0 on success or -1 on failure.
+ */
+int _expiry_add_object(cached_store_t *store, cached_object_t *obj) {
+
+    cached_object_t **reall_res;
+    size_t nslots;
+
+    if (!store || !obj) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!obj->due || obj->expiry_pos) {
+        return 0;
+    }
+
+    if (store->expiry_used == store->expiry_slots) {
+        nslots = store->expiry_slots ? (store->expiry_slots * 2) : CACHE_EXPIRY_MIN_SLOTS;
+
+        if (!(reall_res = realloc(store->expiry, nslots * sizeof(cached_object_t *)))) {
+            PUSH_ERROR_SYSCALL("realloc");
+            RET_ERROR_INT(ERR_NOMEM, "could not grow cached store expiry heap");
         }
 
-        return result;
+        store->expiry = reall_res;
+        store->expiry_slots = nslots;
+    }
+
+    store->expiry[store->expiry_used++] = obj;
+    obj->expiry_pos = store->expiry_used;
+    _expiry_sift(store, store->expiry_used - 1);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Remove a cached object from its store's expiry heap, if it's in it.
+ * @note    The caller must hold the cached store lock exclusively.
+ * @param   store   a pointer to the cached store holding the object.
+ * @param   obj     a pointer to the cached object to be removed.
+ */
+void _expiry_remove_object(cached_store_t *store, cached_object_t *obj) {
+
+    size_t pos;
+
+    if (!store || !obj || !obj->expiry_pos) {
+        return;
+    }
+
+    pos = obj->expiry_pos - 1;
+    obj->expiry_pos = 0;
+    store->expiry_used--;
+
+    // The last entry in the heap takes the removed object's place, and is then moved to where it belongs.
+    if (pos != store->expiry_used) {
+        store->expiry[pos] = store->expiry[store->expiry_used];
+        store->expiry[pos]->expiry_pos = pos + 1;
+        _expiry_sift(store, pos);
+    }
+
+}
+
+
+/**
+ * @brief   Get the number of objects held by a cached store.
+ * @param   store   a pointer to the cached store to be counted.
+ * @return  the number of cached objects indexed by the store.
+ */
+size_t _cached_store_count(cached_store_t *store) {
+
+    size_t result = 0;
+
+    if (!store) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < CACHE_STORE_SHARDS; i++) {
+        _rdlock_cache_shard(&(store->shards[i]));
+        result += store->shards[i].index_used;
+        _unlock_cache_shard(&(store->shards[i]));
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief   Acquire a reader-writer lock of the object cache, adding any time spent blocked on it to a statistics counter.
+ * @note    The lock is tried first, so that uncontended acquisitions don't have to read the clock.
+ * @param   lock        a pointer to the reader-writer lock to be acquired.
+ * @param   exclusive   if set, acquire the lock for writing; otherwise acquire it for reading.
+ * @param   waited      a pointer to the counter of nanoseconds spent waiting for the lock.
+ */
+static void _acquire_cache_lock(pthread_rwlock_t *lock, int exclusive, uint64_t *waited) {
+
+    struct timespec start, end;
+
+    if (!(exclusive ? pthread_rwlock_trywrlock(lock) : pthread_rwlock_tryrdlock(lock))) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (exclusive && pthread_rwlock_wrlock(lock)) {
+        perror("pthread_rwlock_wrlock");
+    } else if (!exclusive && pthread_rwlock_rdlock(lock)) {
+        perror("pthread_rwlock_rdlock");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    __atomic_add_fetch(waited, ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000) + end.tv_nsec - start.tv_nsec, __ATOMIC_RELAXED);
+
+}
+
+
+/**
+ * @brief   Lock a cached store exclusively for thread-safe processing.
+ * @note    Only lookups by id can proceed while the store is locked, and they are kept out of any shard being modified.
+ * @param   store   a pointer to the cached store to be locked.
+ */
+void _lock_cache_store(cached_store_t *store) {
+
+    _acquire_cache_lock(&(store->lock), 1, &(store->stats.lock_wait_ns));
+
+}
+
+
+/**
+ * @brief   Lock a cached store for reading, so that its objects can be walked alongside other readers.
+ * @param   store   a pointer to the cached store to be locked.
+ */
+void _rdlock_cache_store(cached_store_t *store) {
+
+    _acquire_cache_lock(&(store->lock), 0, &(store->stats.lock_wait_ns));
+
+}
+
+
+/**
+ * @brief   Unlock a cached storea for use by other callers.
+ * @param   store   a pointer to the cached store to be unlocked.
+ */
+void _unlock_cache_store(cached_store_t *store) {
+
+    if (pthread_rwlock_unlock(&(store->lock))) {
+        perror("pthread_rwlock_unlock");
+    }
+
+}
+
+
+/**
+ * @brief   Lock a cached store shard exclusively, in order to modify its index or the objects in it.
+ * @note    If the store lock is also needed, it must be taken first.
+ * @param   shard   a pointer to the cached store shard to be locked.
+ */
+void _lock_cache_shard(cache_shard_t *shard) {
+
+    _acquire_cache_lock(&(shard->lock), 1, &(shard->lock_wait_ns));
+
+}
+
+
+/**
+ * @brief   Lock a cached store shard for reading, so that objects can be looked up in it alongside other readers.
+ * @param   shard   a pointer to the cached store shard to be locked.
+ */
+void _rdlock_cache_shard(cache_shard_t *shard) {
+
+    _acquire_cache_lock(&(shard->lock), 0, &(shard->lock_wait_ns));
+
+}
+
+
+/**
+ * @brief   Unlock a cached store shard for use by other callers.
+ * @param   shard   a pointer to the cached store shard to be unlocked.
+ */
+void _unlock_cache_shard(cache_shard_t *shard) {
+
+    if (pthread_rwlock_unlock(&(shard->lock))) {
+        perror("pthread_rwlock_unlock");
+    }
+
+}
+
+
+/**
+ * @brief   Claim the lookup of an object that is missing from a cached store, unless another thread is already looking it up.
+ * @note    The thread that claims a lookup must cache its outcome before calling _end_cached_flight(). Any other thread that
+ *              misses the same object in the meantime can then wait for it to finish, and find the object in the cache.
+ *              If the lookup can't be tracked for lack of memory, the caller is still told to go ahead with it, uncoalesced.
+ * @param   name    a null-terminated string containing the unique name or identifier of the missing object.
+ * @param   store   a pointer to the cached store that the object is missing from.
+ * @param   wait    if set, and the object is already being looked up, block until that lookup has finished.
+ * @param   flight  a pointer to a variable that will receive the claimed lookup, to be passed to _end_cached_flight().
+ * @return  1 if the caller should look up the object itself, 0 if another thread was already looking it up, or -1 on failure.
+ */
+int _begin_cached_flight(const char *name, cached_store_t *store, int wait, cached_flight_t **flight) {
+
+    cached_flight_t *ptr;
+
+    if (!name || !store || !flight) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
-    // First construct a buffer to hold all the data in the array together in one contiguous space.
-    while (*arptr) {
-
-        if (!sfn(&dataholder, &holdlen, *arptr)) {
+    *flight = NULL;
+    pthread_mutex_lock(&_flight_lock);
 
-            if (dataholder) {
-                free(dataholder);
-            }
+    for (ptr = _cache_flights; ptr; ptr = ptr->next) {
 
-            RET_ERROR_UINT(ERR_NOMEM, "unable to allocate space to add serialized data array to object cache");
+        if ((ptr->store == store) && !strcmp(ptr->name, name)) {
+            break;
         }
 
-        arptr++;
     }
 
-    result = _mem_append_serialized(buf, blen, dataholder, holdlen);
-    free(dataholder);
+    if (ptr) {
+        __atomic_add_fetch(&(store->stats.coalesced), 1, __ATOMIC_RELAXED);
 
-    if (!result) {
-        RET_ERROR_UINT(ERR_NOMEM, NULL);
-    }
+        if (wait) {
+            ptr->waiters++;
 
-    return result;
-}
+            while (!ptr->done) {
+                pthread_cond_wait(&(ptr->cond), &_flight_lock);
+            }
 
+            // The lookup has already been unlinked, so whoever is the last to stop waiting on it frees it.
+            if (!--ptr->waiters) {
+                pthread_cond_destroy(&(ptr->cond));
+                free(ptr->name);
+                free(ptr);
+            }
 
-/**
- * @brief   Deserialize a fixed-sized chunk of data from an input buffer.
- * @note    This is the inverse function of _mem_append();
- *              dst must be at least len bytes long.
- * @param   dst     a pointer to the output buffer that will receive the deserialized data.
- * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
- *                              which will be updated after the operation to point to the next available data.
- * @param   bufend      a pointer to the end of the input buffer for validation purposes.
- * @param   len     the size of the data chunk to be deserialized from the input buffer.
- * @return  1 on success or 0 on failure.
- */
-unsigned int _deserialize_data(unsigned char *dst, unsigned char **bufptr, const unsigned char *bufend, size_t len) {
+        }
 
-    size_t left;
+        pthread_mutex_unlock(&_flight_lock);
+        return 0;
+    }
 
-    if (!dst || !bufptr || !bufend) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    if (!(ptr = malloc(sizeof(cached_flight_t)))) {
+        pthread_mutex_unlock(&_flight_lock);
+        return 1;
     }
 
-    left = bufend - *bufptr;
-    if (len > left) {
-        RET_ERROR_UINT_FMT(ERR_UNSPEC, "could not deserialize data due to buffer underflow (%zu of %zu bytes)", len, left);
+    memset(ptr, 0, sizeof(cached_flight_t));
+
+    if (!(ptr->name = strdup(name)) || pthread_cond_init(&(ptr->cond), NULL)) {
+        pthread_mutex_unlock(&_flight_lock);
+        free(ptr->name);
+        free(ptr);
+        return 1;
     }
 
-    memcpy(dst, *bufptr, len);
-    *bufptr += len;
+    ptr->store = store;
+    ptr->next = _cache_flights;
+    _cache_flights = ptr;
+    pthread_mutex_unlock(&_flight_lock);
+    *flight = ptr;
 
     return 1;
 }
 
 
 /**
- * @brief   Deserialize a variable-length chunk of data from an input buffer.
- * @note    This is the inverse function of _mem_append_serialized.
- * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
- *                              which will be updated after the operation to point to the next available data.
- * @param   bufend      a pointer to the end of the input buffer for validation purposes.
- * @param   olen        an optional pointer to receive the size of the deserialized data on success.
- * @return  a pointer to a newly allocated buffer containing the deserialized data on success, or NULL on failure.
+ * @brief   Finish a lookup claimed with _begin_cached_flight(), and wake up every thread that was waiting on it.
+ * @param   flight  a pointer to the lookup that has finished (may be NULL).
  */
-unsigned char *_deserialize_vardata(unsigned char **bufptr, const unsigned char *bufend, size_t *olen) {
+void _end_cached_flight(cached_flight_t *flight) {
 
-    unsigned char *result;
-    size_t dlen;
+    cached_flight_t **ptr;
 
-    if (!bufptr || !bufend) {
-        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    if (!flight) {
+        return;
     }
 
-    // First read in the data length.
-    if (!_deserialize_data((unsigned char *)&dlen, bufptr, bufend, sizeof(dlen))) {
-        RET_ERROR_UINT(ERR_UNSPEC, "could not read serialized data length");
-    }
+    pthread_mutex_lock(&_flight_lock);
 
-    if (!(result = malloc(dlen))) {
-        PUSH_ERROR_SYSCALL("malloc");
-        RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for deserialized data");
-    }
+    for (ptr = &_cache_flights; *ptr && (*ptr != flight); ptr = &((*ptr)->next));
 
-    if (!_deserialize_data(result, bufptr, bufend, dlen)) {
-        free(result);
-        RET_ERROR_PTR(ERR_UNSPEC, "variable data deserialization failed");
+    if (*ptr) {
+        *ptr = flight->next;
     }
 
-    if (olen) {
-        *olen = dlen;
+    flight->done = 1;
+
+    if (flight->waiters) {
+        pthread_cond_broadcast(&(flight->cond));
+    } else {
+        pthread_cond_destroy(&(flight->cond));
+        free(flight->name);
+        free(flight);
     }
 
-    return result;
+    pthread_mutex_unlock(&_flight_lock);
 }
 
 
 /**
- * @brief   Deserialize a null-terminated string from an input buffer.
- * @note    This is the inverse function of _mem_append_serialized_string().
- * @param   dst     a pointer to the address of a string that will receive a copy of the deserialized
- *                              data as a null-terminated string on success.
- * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
- *                              which will be updated after the operation to point to the next available data.
- * @param   bufend      a pointer to the end of the input buffer for validation purposes.
- * @return  1 on success or 0 on failure.
+ * @brief  Evict an item from the object cache if it is stale (has expired).
+ * @return 1 if the object was evicted for being stale or 0 if it was not.
  */
-unsigned int _deserialize_string(char **dst, unsigned char **bufptr, const unsigned char *bufend) {
+unsigned int _evict_if_stale(cached_object_t **objptr) {
 
-    unsigned char *bptr;
-    size_t rsize;
+    cached_store_t *store;
+    int res;
 
-    if (!dst || !bufptr || !*bufptr || !bufend) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    if (!objptr || !*objptr) {
+        return 0;
     }
 
-    // Empty string succeeds but returns a NULL pointer, not an empty string.
-    if (!**bufptr) {
-        *dst = NULL;
-        *bufptr = *bufptr + 1;
-        return 1;
-    }
+    if ((res = _is_object_expired(*objptr, NULL)) > 0) {
 
-    bptr = *bufptr;
-    while (*bptr && bptr < bufend) {
-        bptr++;
-    }
+        if ((store = _get_cached_store_by_type((*objptr)->dtype))) {
+            __atomic_add_fetch(&(store->stats.expired), 1, __ATOMIC_RELAXED);
+        }
 
-    if (bptr == bufend) {
-        RET_ERROR_UINT(ERR_UNSPEC, "string deserialization failed due to buffer underflow");
-    }
+        *objptr = _unlink_object(*objptr, 1, 1);
 
-    rsize = bptr - *bufptr + 1;
+        if (get_last_error()) {
+            fprintf(stderr, "Error: could not unlink expired item from cache:");
+            dump_error_stack();
+            _clear_error_stack();
+        }
 
-    if (!(*dst = malloc(rsize))) {
-        PUSH_ERROR_SYSCALL("malloc");
-        RET_ERROR_UINT(ERR_UNSPEC, "could not deserialize string data due to memory allocation error");
+        return 1;
+    } else if (res < 0) {
+        _clear_error_stack();
     }
 
-    memcpy(*dst, *bufptr, rsize);
-    *bufptr = *bufptr + rsize;
-
-    return 1;
+    return 0;
 }
 
-
 /**
- * @brief   Deserialize an array of fixed-size objects from an input buffer.
- * @note    This is the inverse function of _mem_append_serialized_array().
- * @param   dst     a pointer to the address of an array of objects that will receive a copy of the deserialized
- *                              data as an array of (NULL pointer terminated) fixed-size objects on success.
- * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
- *                              which will be updated after the operation to point to the next available data.
- * @param   bufend      a pointer to the end of the input buffer for validation purposes.
- * @param   itemsize    the size, in bytes, of the fixed-sized objects to be deserialized.
- * @return  1 on success or 0 on failure.
+ * @brief   Check whether a cached object is stale (has expired), without evicting it.
+ * @note    Lookups only take read locks, so they leave stale objects in place for _sweep_cached_store() to evict.
+ * @param   obj     a pointer to the cached object to be checked.
+ * @return  1 if the object is stale or 0 if it is not.
  */
-unsigned int _deserialize_array(unsigned char ***dst, unsigned char **bufptr, const unsigned char *bufend, size_t itemsize) {
+unsigned int _is_object_stale(cached_object_t *obj) {
 
-    unsigned char *nbufend, *objptr, **chain = NULL;
-    size_t dlen;
+    int res;
 
-    if (!dst || !bufptr || !bufend) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    if ((res = _is_object_expired(obj, NULL)) < 0) {
+        _clear_error_stack();
     }
 
-    // First read in the data length.
-    if (!_deserialize_data((unsigned char *)&dlen, bufptr, bufend, sizeof(dlen))) {
-        RET_ERROR_UINT(ERR_UNSPEC, "could not read serialized data length");
-    }
+    return (res > 0) ? 1 : 0;
+}
 
-    // If it's a null size, then the record is empty.
-    if (!dlen) {
-        *dst = NULL;
-        return 1;
-    }
 
-    // For the purpose of this function, we need to create a new bufend.
-    nbufend = *bufptr + dlen;
+/**
+ * @brief   Evict the objects in a cached store that have expired, and refresh its hot objects that are about to.
+ * @note    Only the objects at the top of the store's expiry heap are visited, so the cost of a sweep doesn't depend on
+ *              the size of the store. Refresh handlers usually go out to the network, so they are run on copies of the
+ *              objects after the store lock has been released.
+ * @param   store   a pointer to the cached store to be swept.
+ * @param   now     the current time, against which objects are considered to have expired.
+ * @param   refresh if set, run the store's refresh handler on hot objects that are due to be refreshed.
+ * @return  the number of stale objects that were evicted, or -1 on failure.
+ */
+int _sweep_cached_store(cached_store_t *store, time_t now, int refresh) {
 
-    // Make sure it doesn't point too far into the distance.
-    if (nbufend > bufend) {
-        RET_ERROR_UINT(ERR_UNSPEC, "deserialization error: record stretched out of bounds");
-    }
+    cached_store_refresher_t handler;
+    cached_object_t *ptr, *copy, *refreshes = NULL;
+    int result = 0;
 
-    // As long as we haven't reached the end of the buffer, keep trying to read more objects.
-    while (*bufptr < nbufend) {
+    if (!store) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
 
-        if (!(objptr = malloc(itemsize))) {
-            PUSH_ERROR_SYSCALL("malloc");
+    _lock_cache_store(store);
+    handler = store->refresh;
 
-            if (chain) {
-                _ptr_chain_free(chain);
-            }
+    while (store->expiry_used && ((ptr = store->expiry[0])->due <= now)) {
 
-            RET_ERROR_UINT(ERR_NOMEM, "unable to allocate space for deserialized object");
+        if (!ptr->refresh_due) {
+            _unlink_object(ptr, 1, 1);
+            __atomic_add_fetch(&(store->stats.expired), 1, __ATOMIC_RELAXED);
+            result++;
+            continue;
         }
 
-        if (!_deserialize_data(objptr, bufptr, nbufend, itemsize)) {
-            free(objptr);
-
-            if (chain) {
-                _ptr_chain_free(chain);
-            }
+        // Whether or not it's refreshed, the object is left to expire at its real deadline.
+        _expiry_remove_object(store, ptr);
+        ptr->refresh_due = 0;
+        ptr->due = _get_object_deadline(ptr);
 
-            RET_ERROR_UINT(ERR_UNSPEC, "data deserialization failed");
+        if (_expiry_add_object(store, ptr) < 0) {
+            fprintf(stderr, "Error: could not reschedule cached object for expiry (continuing)...\n");
+            dump_error_stack();
+            _clear_error_stack();
         }
 
-        if (!(chain = _ptr_chain_add(chain, objptr))) {
-            RET_ERROR_UINT(ERR_UNSPEC, "could not add deserialized data to chain");
+        // Objects that nobody has looked up aren't worth renewing.
+        if (!refresh || !handler || !ptr->name || !__atomic_load_n(&(ptr->hot), __ATOMIC_RELAXED)) {
+            continue;
         }
 
+        if (!(copy = _copy_cached_object(ptr)) || !(copy->name = strdup(ptr->name))) {
+            fprintf(stderr, "Error: could not copy cached object to be refreshed (continuing)...\n");
+            dump_error_stack();
+            _clear_error_stack();
+            _destroy_cache_entry(copy);
+            continue;
+        }
 
+        copy->next = refreshes;
+        refreshes = copy;
     }
 
-    if (*bufptr != nbufend) {
-        _ptr_chain_free(chain);
-        RET_ERROR_UINT(ERR_UNSPEC, "reached unexpected end of data buffer");
-    }
+    _unlock_cache_store(store);
 
-    *dst = chain;
+    while ((copy = refreshes)) {
+        refreshes = copy->next;
+        copy->next = NULL;
+        _dbgprint(2, "Refreshing cached object ahead of its expiration: %s\n", copy->name);
+        handler(copy);
 
-    return 1;
+        if (get_last_error()) {
+            fprintf(stderr, "Error: cached object refresh handler generated error(s):\n");
+            dump_error_stack();
+            _clear_error_stack();
+        }
+
+        _destroy_cache_entry(copy);
+    }
+
+    return result;
 }
 
 
 /**
- * @brief   Deserialize an array of null-terminated string from an input buffer.
- * @note    This is the inverse function of _mem_append_serialized_str_array().
- * @param   dst     a pointer to the address of an array of strings that will receive a copy of the deserialized
- *                              data as an array of (NULL pointer terminated) null-terminated strings on success.
- * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
- *                              which will be updated after the operation to point to the next available data.
- * @param   bufend      a pointer to the end of the input buffer for validation purposes.
- * @return  1 on success or 0 on failure.
+ * @brief   Evict every expired object from the cache, and refresh hot objects that are about to expire.
+ * @note    Internal stores are skipped, since their lookups hand out the cached objects themselves, which other threads
+ *              may still be using. Their stale objects are evicted when an object with the same id is added.
+ * @param   now     the time against which objects are considered to have expired, or 0 for the current time.
+ * @return  the number of stale objects that were evicted, or -1 on failure.
  */
-unsigned int _deserialize_str_array(char ***dst, unsigned char **bufptr, const unsigned char *bufend) {
+int _sweep_cache(time_t now) {
 
-    unsigned char *nbufend;
-    char **chain = NULL, *strptr;
-    size_t dlen;
+    int res, result = 0;
 
-    if (!dst || !bufptr || !bufend) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    if (!now && (time(&now) == (time_t)-1)) {
+        PUSH_ERROR_SYSCALL("time");
+        RET_ERROR_INT(ERR_UNSPEC, "could not get current time for cache sweep");
     }
 
-    // First read in the data length.
-    if (!_deserialize_data((unsigned char *)&dlen, bufptr, bufend, sizeof(dlen))) {
-        RET_ERROR_UINT(ERR_UNSPEC, "could not read serialized data length");
-    }
+    for(size_t i = 1; i < sizeof(cached_stores) / sizeof(cached_store_t); i++) {
 
-    // If it's a null size, then the record is empty.
-    if (!dlen) {
-        *dst = NULL;
-        return 1;
-    }
+        if (cached_stores[i].internal) {
+            continue;
+        }
 
-    // For the purpose of this function, we need to create a new bufend.
-    nbufend = *bufptr + dlen;
+        if ((res = _sweep_cached_store(&(cached_stores[i]), now, 1)) < 0) {
+            RET_ERROR_INT_FMT(ERR_UNSPEC, "unable to sweep cached store: %s", cached_stores[i].description);
+        }
 
-    // Make sure it doesn't point too far into the distance.
-    if (nbufend > bufend) {
-        RET_ERROR_UINT(ERR_UNSPEC, "deserialization error: record stretched out of bounds");
+        result += res;
     }
 
-    // As long as we haven't reached the end of the buffer, keep trying to read more strings.
-    while (*bufptr < nbufend) {
+    return result;
+}
 
-        if (!_deserialize_string(&strptr, bufptr, nbufend)) {
 
-            if (chain) {
-                _ptr_chain_free(chain);
-            }
+/**
+ * @brief   The main loop of the background cache sweeper thread.
+ * @param   arg     ignored.
+ * @return  always NULL.
+ */
+void *_cache_sweeper_thread(void *arg) {
+
+    struct timespec deadline;
+    time_t now;
+    int res;
+
+    (void)arg;
+
+    pthread_mutex_lock(&_sweeper_lock);
+
+    while (_sweeper_running) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += _sweeper_interval;
+
+        // Sleep for the interval, unless the sweeper is stopped in the meantime.
+        do {
+            res = pthread_cond_timedwait(&_sweeper_cond, &_sweeper_lock, &deadline);
+        } while (_sweeper_running && (res != ETIMEDOUT));
 
-            RET_ERROR_UINT(ERR_UNSPEC, "string deserialization failed");
+        if (!_sweeper_running) {
+            break;
         }
 
-        if (!(chain = _ptr_chain_add(chain, strptr))) {
-            RET_ERROR_UINT(ERR_UNSPEC, "could not add deserialized string to chain");
-        }
+        pthread_mutex_unlock(&_sweeper_lock);
+        now = time(NULL);
 
+        // Lookups in internal stores hand out the cached objects themselves, which other threads may still be using.
+        // Those are left for the threads that own them to evict, when they add an object with the same id.
+        for(size_t i = 1; i < sizeof(cached_stores) / sizeof(cached_store_t); i++) {
 
-    }
+            if (!cached_stores[i].internal && (_sweep_cached_store(&(cached_stores[i]), now, 1) < 0)) {
+                fprintf(stderr, "Error: background sweep of cached store failed: %s\n", cached_stores[i].description);
+                dump_error_stack();
+                _clear_error_stack();
+            }
 
-    if (*bufptr != nbufend) {
-        _ptr_chain_free(chain);
-        RET_ERROR_UINT(ERR_UNSPEC, "reached unexpected end of data buffer");
+        }
+
+        pthread_mutex_lock(&_sweeper_lock);
     }
 
-    *dst = chain;
+    pthread_mutex_unlock(&_sweeper_lock);
 
-    return 1;
+    return NULL;
 }
 
 
 /**
- * @brief   Deserialize an array of custom-formatted data objects from an input buffer using a deserialization function.
- * @note    This is the inverse function of _mem_append_serialized_array_cb().
- * @param   dst     a pointer to the address of an array of data buffers that will receive a copy of the deserialized
- *                              data as an array of (NULL pointer terminated) data buffers on success.
- * @param   bufptr      a pointer to the address of the input buffer holding the data to be deserialized,
- *                              which will be updated after the operation to point to the next available data.
- * @param   bufend      a pointer to the end of the input buffer for validation purposes.
- * @param   dfn     a custom deserialization function that will be used to deserialize the user data from the input buffer.
- * @return  1 on success or 0 on failure.
+ * @brief   Start a background thread that periodically sweeps expired objects out of the cache.
+ * @note    Internal stores are skipped by the background thread, since their objects are not copied on lookup.
+ * @param   interval    the number of seconds between sweeps.
+ * @return  0 on success or -1 on failure.
  */
-unsigned int _deserialize_array_cb(unsigned char ***dst, unsigned char **bufptr, const unsigned char *bufend, custom_deserializer_t dfn) {
+int _start_cache_sweeper(unsigned int interval) {
 
-    unsigned char *nbufend, *dptr, **chain = NULL;
-    size_t dlen;
+    int res;
 
-    if (!dst || !bufptr || !bufend || !dfn) {
-        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    if (!interval) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
-    // First read in the data length.
-    if (!_deserialize_data((unsigned char *)&dlen, bufptr, bufend, sizeof(dlen))) {
-        RET_ERROR_UINT(ERR_UNSPEC, "could not read serialized data length");
-    }
+    pthread_mutex_lock(&_sweeper_lock);
 
-    // If it's a null size, then the record is empty.
-    if (!dlen) {
-        *dst = NULL;
-        return 1;
+    if (_sweeper_running) {
+        pthread_mutex_unlock(&_sweeper_lock);
+        RET_ERROR_INT(ERR_UNSPEC, "cache sweeper is already running");
     }
 
-    // For the purpose of this function, we need to create a new bufend.
-    nbufend = *bufptr + dlen;
+    _sweeper_interval = interval;
+    _sweeper_running = 1;
 
-    // Make sure it doesn't point too far into the distance.
-    if (nbufend > bufend) {
-        RET_ERROR_UINT(ERR_UNSPEC, "deserialization error: record stretched out of bounds");
+    if ((res = pthread_create(&_sweeper_thread, NULL, _cache_sweeper_thread, NULL))) {
+        _sweeper_running = 0;
+        pthread_mutex_unlock(&_sweeper_lock);
+        errno = res;
+        PUSH_ERROR_SYSCALL("pthread_create");
+        RET_ERROR_INT(ERR_UNSPEC, "unable to start cache sweeper thread");
     }
 
-    // As long as we haven't reached the end of the buffer, keep trying to read more strings.
-    while (*bufptr < nbufend) {
-
-        if (!dfn(&dptr, bufptr, nbufend)) {
+    pthread_mutex_unlock(&_sweeper_lock);
 
-            if (chain) {
-                _ptr_chain_free(chain);
-            }
+    return 0;
+}
 
-            RET_ERROR_UINT(ERR_UNSPEC, "deserialization handler failed");
-        }
 
-        if (!(chain = _ptr_chain_add(chain, dptr))) {
-            RET_ERROR_UINT(ERR_UNSPEC, "could not add deserialized data to chain");
-        }
+/**
+ * @brief   Stop the background cache sweeper thread, if it is running, and wait for it to exit.
+ */
+void _stop_cache_sweeper(void) {
 
+    pthread_mutex_lock(&_sweeper_lock);
 
+    if (!_sweeper_running) {
+        pthread_mutex_unlock(&_sweeper_lock);
+        return;
     }
 
-    if (*bufptr != nbufend) {
-        _ptr_chain_free(chain);
-        RET_ERROR_UINT(ERR_UNSPEC, "reached unexpected end of data buffer");
-    }
+    _sweeper_running = 0;
+    pthread_cond_signal(&_sweeper_cond);
+    pthread_mutex_unlock(&_sweeper_lock);
 
-    *dst = chain;
+    pthread_join(_sweeper_thread, NULL);
 
-    return 1;
 }
 
 
 /**
- * @brief   Check to see if a cached object needs to be evicted for exceeding its TTL or expiration.
- * @note    An object has "expired" and needs to be evicted from the cache if it has a non-zero TTL from its cache
- *              date that has been reached, or a non-zero absolute expiration date that has been exceeded. If the object's
- *               cache policy is relaxed, a TTL expiration advises a "refresh" if no absolute expiration has occurred.
- * @param   obj     a pointer to the cached object to have its age examined.
- * @param   refresh     an optional pointer to a value that, if the cached object has a relaxed expiration
- *                              policy, will be set to 1 if it needs to be refreshed or 0 if it does not.
- * @return  1 if the object has expired or 0 if it has not; -1 if a general error has occurred.
+ * @brief   Set the routine used to refresh hot objects in a cached store before they expire.
+ * @note    The handler is passed a copy of the cached object, with its unhashed id in the name field, and is expected to
+ *              look it up again and add it back to the cache. Only objects added after a handler is set have their ids
+ *              remembered, so objects loaded from the persistent cache aren't refreshed until they are re-added.
+ * @param   dtype   the type of the cached store to be configured.
+ * @param   handler a pointer to the refresh handler, or NULL to disable refreshing for the store.
+ * @return  0 on success or -1 on failure.
  */
-int _is_object_expired(cached_object_t *obj, int *refresh) {
+int _set_cache_refresh_handler(cached_data_type_t dtype, cached_store_refresher_t handler) {
 
-    time_t now;
+    cached_store_t *store;
+    cached_object_t *ptr;
 
-    // This should never happen.
-    if (!obj || !obj->timestamp) {
+    if (!(store = _get_cached_store_by_type(dtype))) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
     }
 
-    if (refresh) {
-        *refresh = 0;
-    }
-
-    if (time(&now) == (time_t)-1) {
-        PUSH_ERROR_SYSCALL("time");
-        RET_ERROR_INT(ERR_UNSPEC, NULL);
-    }
-
-    if (obj->expiration && obj->expiration < now) {
-        return 1;
-    }
-
-    // If our cache eviction is relaxed, that means that a TTL expiration is ignored if and only if
-    // an expiration time for the object is set, and that time has not yet been reached.
-    if (obj->ttl && (time_t)(obj->timestamp + obj->ttl) <= now) {
+    _lock_cache_store(store);
+    store->refresh = handler;
 
-        if (!obj->relaxed || !obj->expiration) {
-            return 1;
-        }
+    // Existing objects need to be rescheduled, since their due times depend on whether they'll be refreshed.
+    for (ptr = store->head; ptr; ptr = ptr->next) {
+        _expiry_remove_object(store, ptr);
+        _schedule_cached_object(store, ptr);
 
-        if (refresh) {
-            *refresh = 1;
+        if (_expiry_add_object(store, ptr) < 0) {
+            _unlock_cache_store(store);
+            RET_ERROR_INT(ERR_UNSPEC, "unable to reschedule cached objects for new refresh handler");
         }
 
     }
 
+    _unlock_cache_store(store);
+
     return 0;
 }
 
 
 /**
- * @brief   Unlink a cached object from its doubly linked list.
- * @param   object      a pointer to the cached object to be delinked.
- * @param   destroy     if set, deallocate the specified cached object after unlinking.
- * @param   stale       if set, the cache removal was performed because of a stale entry.
- * @return  a pointer to the next cached object in the store, or NULL if at the end of the store.
+ * @brief   Get the approximate number of bytes of memory held by a cached object, computing it the first time around.
+ * @note    Objects are sized by their serialized representation, which is a reasonable proxy for their decoded size.
+ * @param   obj     a pointer to the cached object to be sized.
+ * @return  the approximate size of the cached object, in bytes.
  */
-cached_object_t *_unlink_object(cached_object_t *object, int destroy, int stale) {
+size_t _size_cached_object(cached_object_t *obj) {
 
     cached_store_t *store;
-    cached_object_t *next = NULL;
-
-    // TODO: check the callers of this function and make sure they're operating in a thread-safe fashion.
-    if (!object) {
-        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
-    }
+    unsigned char *sdata;
+    size_t slen;
 
-    if (!(store = _get_cached_store_by_type(object->dtype))) {
-        RET_ERROR_PTR(ERR_UNSPEC, "could not look up cached object store by type");
-    }
-
-    // If we're the only object in the store then reposition the head.
-    if (store && (store->head == object)) {
-        store->head = object->next;
+    if (!obj) {
+        return 0;
     }
 
-    if (object->prev) {
-        object->prev->next = object->next;
+    if (obj->size) {
+        return obj->size;
     }
 
-    if (object->next) {
-        object->next->prev = object->prev;
-        next = object->next;
-    }
+    obj->size = sizeof(cached_object_t);
 
-    if (stale && (_verbose >= 4) && store) {
+    if (obj->mapped) {
+        obj->size += obj->mapped_len;
+    } else if (obj->data && (store = _get_cached_store_by_type(obj->dtype)) && store->serialize) {
 
-        if (store->dump) {
-            _dbgprint(4, "Evicting stale data from cache: ");
-            _dump_cache_data(stderr, object, 0);
+        if ((sdata = store->serialize(obj->data, &slen))) {
+            obj->size += slen;
+            free(sdata);
         } else {
-            _dbgprint(4, "Evicting stale data from cache...\n");
+            _clear_error_stack();
         }
 
     }
 
-    if (destroy) {
+    return obj->size;
+}
 
-        if (store->destructor) {
-            store->destructor(object->data);
 
-            if (get_last_error()) {
-                fprintf(stderr, "Cache destructor generated error(s):\n");
-                dump_error_stack();
-                _clear_error_stack();
-            }
+/**
+ * @brief   Get the number of bytes charged to a cached object, including any cached objects it is shadowing.
+ * @param   obj     a pointer to the cached object.
+ * @return  the total number of bytes charged to the object.
+ */
+size_t _charged_object_size(const cached_object_t *obj) {
 
-        }
+    size_t result = 0;
 
-        free(object);
+    for (; obj; obj = obj->shadow) {
+        result += obj->size;
     }
 
-    return next;
+    return result;
 }
 
 
 /**
- * @brief   Replace one object in the cache with another.
- * @note    If shadow is not set, then the old cached object will be automatically destroyed.
- *              Otherwise this function also makes the old cached object the new cached object's "shadow" data.
- * @param   oobj    a pointer to the old cached object to be replaced in its cached store with the new object.
- * @param   nobj    a pointer to the new cached object that will replace the old object in the cached store.
- * @param   shadow  if set, preserve the old object as the "shadow" value of the new object.
- * @return  NULL on failure, or a pointer to the new cached object on success.
+ * @brief   Add to or release from the resident byte counts of a cached store and the cache as a whole.
+ * @note    The caller must hold the cached store lock exclusively.
+ * @param   store   a pointer to the cached store to be charged.
+ * @param   nbytes  the number of bytes to be charged or released.
+ * @param   release if set, release the bytes from the store instead of charging them.
  */
-cached_object_t *_replace_object(cached_object_t *oobj, cached_object_t *nobj, int shadow) {
-
-    cached_store_t *store;
+void _charge_cached_store(cached_store_t *store, size_t nbytes, int release) {
 
-    // TODO: check the callers of this function and make sure they're operating in a thread-safe fashion.
-    if (!oobj || !nobj) {
-        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    if (!store || !nbytes) {
+        return;
     }
 
-    if (oobj->dtype != nobj->dtype) {
-        RET_ERROR_PTR(ERR_UNSPEC, "cached object replacement cannot be performed on different object types");
+    // Only the holder of the store lock changes the byte count, but it may be read at any time by the statistics code.
+    if (release) {
+        nbytes = (nbytes > store->stats.bytes) ? store->stats.bytes : nbytes;
+        __atomic_sub_fetch(&(store->stats.bytes), nbytes, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&(store->stats.bytes), nbytes, __ATOMIC_RELAXED);
     }
 
-    if (!(store = _get_cached_store_by_type(oobj->dtype))) {
-        RET_ERROR_PTR(ERR_UNSPEC, "could not look up cached object store by type");
-    }
+    pthread_mutex_lock(&_budget_lock);
 
-    // If we're the only object in the store then reposition the head.
-    if (store && (store->head == oobj)) {
-        store->head = nobj;
+    if (!release) {
+        _cache_resident_bytes += nbytes;
+    } else if (nbytes > _cache_resident_bytes) {
+        _cache_resident_bytes = 0;
+    } else {
+        _cache_resident_bytes -= nbytes;
     }
 
-    nobj->prev = oobj->prev;
-    nobj->next = oobj->next;
-
-    if (oobj->prev) {
-        oobj->prev->next = nobj;
-    }
+    pthread_mutex_unlock(&_budget_lock);
+}
 
-    if (oobj->next) {
-        oobj->next->prev = nobj;
-    }
 
-    // Finally, the two must have matching ids.
-    memcpy(nobj->id, oobj->id, SHA_256_SIZE);
+/**
+ * @brief   Evict objects from a cached store with the CLOCK algorithm until the store fits within a number of bytes.
+ * @note    The caller must hold the cached store lock exclusively. The hand sweeps the store, giving every object that
+ *              was looked up since its last pass a second chance. Persistent objects are left alone while the cache may be
+ *              saved, since one dropped from memory would also be dropped from the next save, and objects shadowing another
+ *              would lose the override. Internal stores hand out their live objects, so nothing in them is ever evicted.
+ *              A store holding mostly persistent objects may therefore stay above its budget.
+ * @param   store       a pointer to the cached store to be trimmed.
+ * @param   max_bytes   the number of bytes the store should be trimmed down to.
+ * @return  the number of objects that were evicted from the store.
+ */
+size_t _trim_cached_store(cached_store_t *store, size_t max_bytes) {
 
-    oobj->prev = oobj->next = NULL;
+    cached_object_t *ptr;
+    size_t steps, result = 0;
 
-    if (shadow) {
-        nobj->shadow = oobj;
-    } else {
-        nobj->shadow = NULL;
-        _destroy_cache_entry(oobj);
+    if (!store || store->internal) {
+        return 0;
     }
 
-    return nobj;
-}
+    // Two full turns of the hand are enough for it to clear every reference bit and then come back for the object.
+    for (steps = 2 * _cached_store_count(store); steps && store->head && (store->stats.bytes > max_bytes); steps--) {
 
+        if (!store->hand) {
+            store->hand = store->head;
+        }
 
-/**
- * @brief   Lock a cached store for thread-safe processing.
- * @param   store   a pointer to the cached store to be locked.
- */
-void _lock_cache_store(cached_store_t *store) {
+        ptr = store->hand;
+
+        if (ptr->shadow || (ptr->persists && (_cache_flags & CACHE_PERM_SAVE)) || __atomic_exchange_n(&(ptr->referenced), 0, __ATOMIC_RELAXED)) {
+            store->hand = ptr->next;
+            continue;
+        }
 
-    if (pthread_mutex_lock(&(store->lock))) {
-        perror("pthread_mutex_lock");
+        _dbgprint(4, "Evicting cached object to stay within memory budget of %zu bytes.\n", max_bytes);
+        _unlink_object(ptr, 1, 0);
+        __atomic_add_fetch(&(store->stats.evictions), 1, __ATOMIC_RELAXED);
+        result++;
     }
 
+    return result;
 }
 
 
 /**
- * @brief   Unlock a cached storea for use by other callers.
- * @param   store   a pointer to the cached store to be unlocked.
+ * @brief   Evict cached objects as needed to bring the cache back within its per-store and global memory budgets.
+ * @note    The caller must not hold any cached store locks, since stores are locked one at a time to be trimmed.
+ * @param   store   a pointer to the cached store that just grew, or NULL to check the budgets of every store.
  */
-void _unlock_cache_store(cached_store_t *store) {
+void _enforce_cache_budget(cached_store_t *store) {
 
-    if (pthread_mutex_unlock(&(store->lock))) {
-        perror("pthread_mutex_unlock");
-    }
+    cached_store_t *ptr;
+    size_t max_bytes, resident, excess;
 
-}
+    for(size_t i = 1; i < sizeof(cached_stores) / sizeof(cached_store_t); i++) {
+        ptr = &(cached_stores[i]);
 
+        if ((store && (ptr != store)) || ptr->internal) {
+            continue;
+        }
 
-/**
- * @brief  Evict an item from the object cache if it is stale (has expired).
- * @return 1 if the object was evicted for being stale or 0 if it was not.
- */
-unsigned int _evict_if_stale(cached_object_t **objptr) {
+        _lock_cache_store(ptr);
 
-    int res;
+        if (ptr->max_bytes && (ptr->stats.bytes > ptr->max_bytes)) {
+            _trim_cached_store(ptr, ptr->max_bytes);
+        }
 
-    if (!objptr || !*objptr) {
-        return 0;
+        _unlock_cache_store(ptr);
     }
 
-    if ((res = _is_object_expired(*objptr, NULL)) > 0) {
-        *objptr = _unlink_object(*objptr, 1, 1);
+    // If the cache as a whole is still over budget, the excess is taken out of each store in turn.
+    for(size_t i = 1; i < sizeof(cached_stores) / sizeof(cached_store_t); i++) {
+        ptr = &(cached_stores[i]);
 
-        if (get_last_error()) {
-            fprintf(stderr, "Error: could not unlink expired item from cache:");
-            dump_error_stack();
-            _clear_error_stack();
+        pthread_mutex_lock(&_budget_lock);
+        max_bytes = _cache_max_bytes;
+        resident = _cache_resident_bytes;
+        pthread_mutex_unlock(&_budget_lock);
+
+        if (!max_bytes || (resident <= max_bytes)) {
+            break;
+        } else if (ptr->internal) {
+            continue;
         }
 
-        return 1;
-    } else if (res < 0) {
-        _clear_error_stack();
+        excess = resident - max_bytes;
+        _lock_cache_store(ptr);
+        _trim_cached_store(ptr, (ptr->stats.bytes > excess) ? (ptr->stats.bytes - excess) : 0);
+        _unlock_cache_store(ptr);
     }
 
-    return 0;
 }
 
 
@@ -2334,6 +4824,27 @@ void *_deserialize_signet_cb(void *data, size_t len) {
 }
 
 
+/**
+ * @brief   Takes another reference to a cached signet instead of copying it.
+ * @param   record  Void pointer to the signet_t structure to be shared.
+ * @return  Void pointer to the same signet_t structure.
+*/
+void *_share_signet_cb(void *record) {
+
+    signet_t *result;
+
+    if(!record) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if(!(result = dime_sgnt_signet_share((signet_t *)record))) {
+        RET_ERROR_PTR(ERR_UNSPEC, NULL);
+    }
+
+    return result;
+}
+
+
 /**
  * @brief   Serializes a signet_t structure into a binary string.
  * @param   record  Void pointer to a signet_t structure to be serialized.
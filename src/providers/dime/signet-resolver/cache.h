@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
@@ -15,12 +17,28 @@
 #define CACHE_PERM_SAVE   0x2
 #define CACHE_PERM_READ   0x4
 #define CACHE_PERM_ADD    0x8
-#define CACHE_PERM_DELETE 0x16
+#define CACHE_PERM_DELETE 0x10
 
 #define CACHE_PERM_NONE      0
 #define CACHE_PERM_ALL_FLAGS (CACHE_PERM_LOAD | CACHE_PERM_SAVE | CACHE_PERM_READ | CACHE_PERM_ADD | CACHE_PERM_DELETE)
 #define CACHE_PERM_DEFAULT   CACHE_PERM_ALL_FLAGS
 
+#define CACHE_JOURNAL_SUFFIX      ".journal"         ///< Appended to the cache filename to get the name of the cache journal.
+#define CACHE_JOURNAL_MIN_COMPACT (1024 * 1024)      ///< The journal is never compacted into the base cache file before it reaches this size.
+
+#define CACHE_FILE_MAGIC   "DIMECACH"   ///< The signature at the start of a memory-mappable cache file.
+#define CACHE_FILE_VERSION 2            ///< The version of the memory-mappable cache file format.
+#define CACHE_FILE_ALIGN   8            ///< Each cached object record in the cache file starts on a boundary of this many bytes.
+#define CACHE_TEMP_SUFFIX  ".tmp"       ///< Appended to the cache filename to get the name of the file a new cache is written to.
+
+#define CACHE_INDEX_MIN_SLOTS 64    ///< The initial number of slots allocated to a cached store's hash index.
+#define CACHE_INDEX_MAX_LOAD  70    ///< The percentage of occupied (live or deleted) slots that will trigger an index resize.
+
+#define CACHE_STORE_SHARDS    16    ///< The number of independently locked shards each cached store's index is split into (a power of two).
+
+#define CACHE_REFRESH_AHEAD_PERCENT 10   ///< Hot objects are refreshed once this much of their TTL remains.
+#define CACHE_EXPIRY_MIN_SLOTS      64   ///< The initial number of slots allocated to a cached store's expiry heap.
+
 
 typedef enum {
     cached_data_unknown = 0,
@@ -28,7 +46,8 @@ typedef enum {
     cached_data_dnskey = 2,
     cached_data_ds = 3,
     cached_data_ocsp = 4,
-    cached_data_signet = 5
+    cached_data_signet = 5,
+    cached_data_tls_session = 6
 } cached_data_type_t;
 
 typedef struct cached_object {
@@ -44,8 +63,50 @@ typedef struct cached_object {
     unsigned char persists;                 ///< Not everything in the cache should be persisted.
     struct cached_object *shadow;           ///< A saved copy of the "real" cache entry to be saved, if this cached
                                             ///< object is merely temporarily overriding it.
+    const unsigned char *mapped;            ///< If set, the object's serialized data within the memory-mapped cache file, which
+                                            ///< has not yet been decoded into the data field.
+    size_t mapped_len;                      ///< The length of the serialized data pointed to by mapped.
+    size_t size;                            ///< The approximate number of bytes of memory charged to the cached object.
+    unsigned char referenced;               ///< Set by lookups, and cleared as the eviction hand passes over the object.
+    unsigned char hot;                      ///< Set by lookups, so that the sweeper knows the object is worth refreshing.
+    char *name;                             ///< The unhashed id of the object, only kept in memory for stores that refresh their objects.
+    time_t due;                             ///< The time at which the object is next due to be refreshed or evicted by the sweeper.
+    unsigned char refresh_due;              ///< Set if the due time is for refreshing the object, rather than for evicting it.
+    size_t expiry_pos;                      ///< The object's position in its store's expiry heap, plus one, or 0 if it isn't in it.
 } cached_object_t;
 
+typedef void (*cached_store_refresher_t)(cached_object_t *);
+
+
+typedef struct {
+    pthread_rwlock_t lock;                  ///< Held shared by lookups in this shard, and exclusively while its index or objects change.
+    cached_object_t **index;                ///< An open-addressing hash table of the shard's objects, keyed by their hashed ids.
+    size_t index_slots;                     ///< The number of slots allocated for the hash index (always a power of two).
+    size_t index_used;                      ///< The number of index slots occupied by live cached objects.
+    size_t index_deleted;                   ///< The number of index slots occupied by tombstones of removed objects.
+    uint64_t lock_wait_ns;                  ///< The total time spent blocked on the shard lock, in nanoseconds.
+} cache_shard_t;
+
+#define CACHE_SHARD_INITIALIZER    { PTHREAD_RWLOCK_INITIALIZER, NULL, 0, 0, 0, 0 }
+#define CACHE_SHARD_INITIALIZER_4  CACHE_SHARD_INITIALIZER, CACHE_SHARD_INITIALIZER, CACHE_SHARD_INITIALIZER, CACHE_SHARD_INITIALIZER
+// This must hold exactly CACHE_STORE_SHARDS shard initializers.
+#define CACHE_SHARDS_INITIALIZER   { CACHE_SHARD_INITIALIZER_4, CACHE_SHARD_INITIALIZER_4, CACHE_SHARD_INITIALIZER_4, CACHE_SHARD_INITIALIZER_4 }
+
+
+// All of these counters are updated atomically, so that they can be read without locking the store.
+typedef struct {
+    uint64_t hits;                          ///< The number of lookups that found a live object.
+    uint64_t misses;                        ///< The number of lookups that found nothing, or only a stale object.
+    uint64_t coalesced;                     ///< The number of misses that were left to another thread's lookup of the same object.
+    uint64_t inserts;                       ///< The number of objects added to the store, including replacements.
+    uint64_t evictions;                     ///< The number of objects evicted from the store to stay within budget.
+    uint64_t expired;                       ///< The number of stale objects removed from the store.
+    uint64_t bytes;                         ///< The approximate number of bytes held by the objects in the store.
+    uint64_t lock_wait_ns;                  ///< The total time spent blocked on the store lock, in nanoseconds.
+} cached_store_stats_t;
+
+#define CACHE_STATS_INITIALIZER    { 0, 0, 0, 0, 0, 0, 0, 0 }
+
 
 typedef struct {
     cached_data_type_t dtype;               ///< The type of data that will be stored within.
@@ -53,7 +114,7 @@ typedef struct {
     unsigned char internal;                 ///< Determines whether the cached store is for internal use only.
                                             ///< If it is, objects will not be cloned before being returned to the caller.
     cached_object_t *head;                  ///< A pointer to the head of the cached object list.
-    pthread_mutex_t lock;                   ///< For multi-threaded safe code.
+    pthread_rwlock_t lock;                  ///< Guards the linked list of objects; lookups by id only need the lock of their shard.
     void (*destructor)(void *);             ///< A function pointer to a destructor used to free cached object data.
     void * (*serialize)(void *, size_t *);  ///< A function pointer to a routine used to serialize cached data.
     void * (*deserialize)(void *, size_t);  ///< A function pointer to a routine used to deserialize cached data.
@@ -61,9 +122,62 @@ typedef struct {
     void * (*clone)(void *);                ///< An optional pointer to a routine that can be used to clone data.
                                             ///<    If not specified, the serialize and deserialize routine will be used
                                             ///<    together to recreate the functionality of this function.
+    void * (*share)(void *);                ///< An optional pointer to a routine that returns a new reference to immutable data.
+                                            ///<    If specified, lookups share the cached data with the caller instead of cloning it,
+                                            ///<    and the destructor releases each reference.
+    cache_shard_t shards[CACHE_STORE_SHARDS];   ///< The store's hash index, striped by object id across separately locked shards.
+    size_t max_bytes;                       ///< If non-zero, the memory budget of the store, beyond which objects are evicted.
+    cached_store_stats_t stats;             ///< The store's usage counters, including the bytes held by its objects.
+    cached_object_t *hand;                  ///< The CLOCK hand, pointing at the next object to be considered for eviction.
+    cached_store_refresher_t refresh;       ///< An optional routine that renews a hot object before it expires, given a copy of it.
+    cached_object_t **expiry;               ///< A min-heap of the store's objects that can expire, ordered by their due times.
+    size_t expiry_used;                     ///< The number of objects in the expiry heap.
+    size_t expiry_slots;                    ///< The number of slots allocated for the expiry heap.
 } cached_store_t;
 
 
+// A lookup of an object missing from a cached store that is in progress, which concurrent misses for the same object wait on.
+typedef struct cached_flight {
+    cached_store_t *store;                  ///< The cached store that the object is being looked up for.
+    char *name;                             ///< The unique name or identifier of the object.
+    pthread_cond_t cond;                    ///< Broadcast once the lookup has finished.
+    int done;                               ///< Set once the lookup has finished.
+    unsigned int waiters;                   ///< The number of threads still waiting on the lookup; the last one out frees it.
+    struct cached_flight *next;             ///< A pointer to the next lookup in flight.
+} cached_flight_t;
+
+
+// The cached object header on disk is equivalent to the cached object structure minus its trailing fields (data, linked list pointers, etc).
+#define CACHE_HEADER_SIZE (offsetof(cached_object_t, data))
+
+
+typedef struct {
+    char magic[8];                          ///< Always CACHE_FILE_MAGIC (without a null terminator).
+    uint32_t version;                       ///< The cache file format version (CACHE_FILE_VERSION).
+    uint32_t count;                         ///< The number of cached object records in the file.
+    uint64_t index_offset;                  ///< The file offset of the table of count record index entries.
+} cache_file_hdr_t;
+
+typedef struct {
+    uint64_t offset;                        ///< The file offset of the object's serialized data (aligned to CACHE_FILE_ALIGN).
+    uint32_t len;                           ///< The length of the object's serialized data.
+    uint32_t dtype;                         ///< The type of the cached store the object belongs to.
+    unsigned char header[CACHE_HEADER_SIZE];    ///< The cached object header, kept in the index so that loading never touches the data.
+} cache_file_entry_t;
+
+
+typedef enum {
+    cache_journal_add = 1,                  ///< A persistent cached object was added, or replaced an object with the same id.
+    cache_journal_remove = 2                ///< A persistent cached object was removed; the payload is its hashed id.
+} cache_journal_op_t;
+
+typedef struct {
+    uint32_t op;                            ///< The journaled operation (a cache_journal_op_t value).
+    uint32_t dtype;                         ///< The type of the cached store affected by the operation.
+    uint32_t len;                           ///< The length of the record payload that follows this header.
+} cache_journal_hdr_t;
+
+
 typedef int (*cached_store_comparator_t)(const void *, const void *);
 typedef unsigned int (*custom_deserializer_t)(unsigned char **, unsigned char **, const unsigned char *);
 typedef size_t (*custom_serializer_t)(unsigned char **, size_t *, const void *);
@@ -79,11 +193,28 @@ extern cached_store_t cached_stores[];
 // Cache loading and saving.
 PUBLIC_FUNC_DECL(int,               load_cache_contents,          void);
 PUBLIC_FUNC_DECL(int,               save_cache_contents,          void);
+PUBLIC_FUNC_DECL(int,               commit_cache_contents,        void);
+PUBLIC_FUNC_DECL(int,               set_cache_journaling,         int enabled);
 PUBLIC_FUNC_DECL(char *,            get_dime_dir_location,        const char *suffix);
 PUBLIC_FUNC_DECL(char *,            get_cache_location,           void);
 PUBLIC_FUNC_DECL(int,               set_cache_location,           const char *path);
 PUBLIC_FUNC_DECL(int,               set_cache_permissions,        unsigned long flags);
 
+// Bounding the memory used by the cache.
+PUBLIC_FUNC_DECL(int,               set_cache_budget,             size_t max_bytes);
+PUBLIC_FUNC_DECL(int,               set_cache_store_budget,       cached_data_type_t dtype, size_t max_bytes);
+PUBLIC_FUNC_DECL(int,               get_cache_usage,              cached_data_type_t dtype, size_t *resident, size_t *evictions);
+
+// Cache statistics.
+PUBLIC_FUNC_DECL(int,               get_cache_stats,              cached_data_type_t dtype, cached_store_stats_t *stats);
+PUBLIC_FUNC_DECL(int,               get_cached_object_count,      cached_data_type_t dtype, size_t *objects);
+
+// Sweeping expired objects out of the cache, and refreshing hot ones ahead of time.
+PUBLIC_FUNC_DECL(int,               sweep_cache,                  time_t now);
+PUBLIC_FUNC_DECL(int,               start_cache_sweeper,          unsigned int interval);
+PUBLIC_FUNC_DECL(void,              stop_cache_sweeper,           void);
+PUBLIC_FUNC_DECL(int,               set_cache_refresh_handler,    cached_data_type_t dtype, cached_store_refresher_t handler);
+
 // Searching for objects in the cache.
 PUBLIC_FUNC_DECL(cached_object_t *, find_cached_object,           const char *oid, cached_store_t *store);
 PUBLIC_FUNC_DECL(cached_object_t *, find_cached_object_cmp,       const void *key, cached_store_t *store, cached_store_comparator_t cmpfn);
@@ -113,6 +244,31 @@ cached_store_t *  _get_cached_store_by_type(cached_data_type_t dtype);
 void              _dump_cache(cached_data_type_t dtype, int do_data, int ephemeral);
 void              _dump_cache_data(FILE *fp, const cached_object_t *obj, int brief);
 cached_object_t * _clone_cached_object(const cached_object_t *obj);
+cached_object_t * _copy_cached_object(const cached_object_t *obj);
+cached_object_t * _lookup_cached_object(const char *oid, cached_store_t *store, int copy);
+cached_object_t * _publish_cached_object(cached_store_t *store, cached_object_t *entry, cached_object_t *replaced, int shadow, const char *name);
+cached_object_t * _replace_cached_object(const char *id, cached_store_t *store, unsigned long ttl, time_t expiration, void *data, int persists, int relaxed);
+
+// Serialization of cached objects to and from the persistent cache.
+unsigned char *   _serialize_cached_object(const cached_object_t *obj, size_t *outlen);
+cached_object_t * _deserialize_cached_object(const unsigned char *buf, size_t len);
+cached_object_t * _map_cached_object(const unsigned char *header, const unsigned char *data, size_t len);
+void *            _decode_mapped_object(cached_object_t *obj);
+void *            _materialize_cached_object(cached_object_t *obj);
+int               _insert_loaded_object(cached_store_t *store, cached_object_t *obj, int replace);
+int               _load_mapped_cache(int cfd, size_t fsize);
+int               _load_legacy_cache(int cfd, size_t *base_size);
+int               _write_cache_file(int cfd, size_t *fsize);
+void              _dump_loaded_object(const cached_object_t *obj);
+
+// The persistent cache journal.
+char *            _get_cache_journal_location(void);
+int               _append_cache_journal(cache_journal_op_t op, cached_data_type_t dtype, const unsigned char *payload, size_t plen);
+int               _journal_cached_object(const cached_object_t *obj);
+int               _journal_removed_object(const cached_object_t *obj);
+int               _replay_cache_journal(void);
+size_t            _get_cache_journal_size(void);
+int               _truncate_cache_journal(size_t base_size, size_t folded);
 
 // Helper functions for writing object data to the persistent cache.
 size_t            _mem_append_serialized(unsigned char **buf, size_t *blen, const unsigned char *data, size_t dlen);
@@ -134,15 +290,50 @@ int               _is_object_expired(cached_object_t *obj, int *refresh);
 cached_object_t * _unlink_object(cached_object_t *object, int destroy, int stale);
 cached_object_t * _replace_object(cached_object_t *oobj, cached_object_t *nobj, int shadow);
 unsigned int      _evict_if_stale(cached_object_t **objptr);
+unsigned int      _is_object_stale(cached_object_t *obj);
+int               _sweep_cached_store(cached_store_t *store, time_t now, int refresh);
+void *            _cache_sweeper_thread(void *arg);
+
+// Indexing of cached objects by the time they are due to be refreshed or evicted.
+time_t            _get_object_deadline(const cached_object_t *obj);
+void              _schedule_cached_object(const cached_store_t *store, cached_object_t *obj);
+int               _expiry_add_object(cached_store_t *store, cached_object_t *obj);
+void              _expiry_remove_object(cached_store_t *store, cached_object_t *obj);
+
+// Accounting for and evicting cached objects to keep within the memory budget.
+int               _link_object(cached_store_t *store, cached_object_t *object);
+size_t            _size_cached_object(cached_object_t *obj);
+size_t            _charged_object_size(const cached_object_t *obj);
+void              _charge_cached_store(cached_store_t *store, size_t nbytes, int release);
+size_t            _trim_cached_store(cached_store_t *store, size_t max_bytes);
+void              _enforce_cache_budget(cached_store_t *store);
+
+// Hash indexing of cached objects by their hashed ids.
+cache_shard_t *   _get_cache_shard(cached_store_t *store, const unsigned char *hashid);
+cached_object_t * _index_find_object(cached_store_t *store, const unsigned char *hashid);
+int               _index_add_object(cached_store_t *store, cached_object_t *object);
+int               _index_remove_object(cached_store_t *store, const cached_object_t *object);
+int               _index_replace_object(cached_store_t *store, const cached_object_t *oobj, cached_object_t *nobj);
+int               _index_resize(cache_shard_t *shard, size_t nslots);
+size_t            _cached_store_count(cached_store_t *store);
+
+// Coalescing concurrent lookups of objects that are missing from the cache.
+int               _begin_cached_flight(const char *name, cached_store_t *store, int wait, cached_flight_t **flight);
+void              _end_cached_flight(cached_flight_t *flight);
 
 // Synchronization of the cache stores.
 void              _lock_cache_store(cached_store_t *store);
+void              _rdlock_cache_store(cached_store_t *store);
 void              _unlock_cache_store(cached_store_t *store);
+void              _lock_cache_shard(cache_shard_t *shard);
+void              _rdlock_cache_shard(cache_shard_t *shard);
+void              _unlock_cache_shard(cache_shard_t *shard);
 
 
 /* signet callbacks*/
 void *                  _deserialize_signet_cb(void *data, size_t len);
 void *                  _serialize_signet_cb(void *record, size_t *outlen);
+void *                  _share_signet_cb(void *record);
 void                    _destroy_signet_cb(void *record);
 void                    _dump_signet_cb(FILE *fp, void *record, int brief);
 
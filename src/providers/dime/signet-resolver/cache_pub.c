@@ -57,6 +57,14 @@ int save_cache_contents(void) {
     PUBLIC_FUNC_IMPL(save_cache_contents, );
 }
 
+int commit_cache_contents(void) {
+    PUBLIC_FUNC_IMPL(commit_cache_contents, );
+}
+
+int set_cache_journaling(int enabled) {
+    PUBLIC_FUNC_IMPL(set_cache_journaling, enabled);
+}
+
 char *get_dime_dir_location(const char *suffix) {
     PUBLIC_FUNC_IMPL(get_dime_dir_location, suffix);
 }
@@ -72,3 +80,39 @@ int set_cache_location(const char *path) {
 int set_cache_permissions(unsigned long flags) {
     PUBLIC_FUNC_IMPL(set_cache_permissions, flags);
 }
+
+int set_cache_budget(size_t max_bytes) {
+    PUBLIC_FUNC_IMPL(set_cache_budget, max_bytes);
+}
+
+int set_cache_store_budget(cached_data_type_t dtype, size_t max_bytes) {
+    PUBLIC_FUNC_IMPL(set_cache_store_budget, dtype, max_bytes);
+}
+
+int get_cache_usage(cached_data_type_t dtype, size_t *resident, size_t *evictions) {
+    PUBLIC_FUNC_IMPL(get_cache_usage, dtype, resident, evictions);
+}
+
+int get_cache_stats(cached_data_type_t dtype, cached_store_stats_t *stats) {
+    PUBLIC_FUNC_IMPL(get_cache_stats, dtype, stats);
+}
+
+int get_cached_object_count(cached_data_type_t dtype, size_t *objects) {
+    PUBLIC_FUNC_IMPL(get_cached_object_count, dtype, objects);
+}
+
+int sweep_cache(time_t now) {
+    PUBLIC_FUNC_IMPL(sweep_cache, now);
+}
+
+int start_cache_sweeper(unsigned int interval) {
+    PUBLIC_FUNC_IMPL(start_cache_sweeper, interval);
+}
+
+void stop_cache_sweeper(void) {
+    PUBLIC_FUNC_IMPL_VOID(stop_cache_sweeper);
+}
+
+int set_cache_refresh_handler(cached_data_type_t dtype, cached_store_refresher_t handler) {
+    PUBLIC_FUNC_IMPL(set_cache_refresh_handler, dtype, handler);
+}
@@ -1,6 +1,9 @@
+#include <poll.h>
+#include <pthread.h>
 #include <openssl/x509v3.h>
 
 #include "dime/signet-resolver/dmtp.h"
+#include "dime/signet-resolver/dmtp_async.h"
 #include "dime/signet-resolver/cache.h"
 #include "dime/signet-resolver/dns.h"
 #include "dime/signet-resolver/mrec.h"
@@ -12,62 +15,79 @@
 #include "providers/symbols.h"
 
 
-signet_t *_get_signet(const char *name, const char *fingerprint, int use_cache) {
+// The connection attempts to the candidate DX servers of a dark domain, and the addresses they connect to.
+typedef struct {
+    dmtp_async_request_t *requests;
+    struct sockaddr_storage *addrs;
+    size_t count;
+} dx_attempts_t;
 
-    dmtp_session_t *session;
-    signet_t *result, *org_signet = NULL;
-    cached_object_t *cached;
-    const char *org;
-    char *line;
-    int res, is_org = 0;
 
-    if (!name) {
-        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
-    }
+// The pool of idle, verified DMTP sessions that are kept alive for reuse, ordered from the most to the least recently released.
+static dmtp_session_t *_dmtp_pool = NULL;
+static size_t _dmtp_pool_size = 0;
+static pthread_mutex_t _dmtp_pool_lock = PTHREAD_MUTEX_INITIALIZER;
 
-    if (!(org = strchr(name, '@'))) {
-        org = name;
-        is_org = 1;
-    } else {
-        org++;
 
-        // The org address cannot also contain a '@' ...
-        if (strchr(org, '@')) {
-            RET_ERROR_PTR(ERR_BAD_PARAM, "invalid organizational signet address");
-        }
+// A name in a batch signet lookup, paired with the dark domain it belongs to.
+typedef struct {
+    const char *org;
+    size_t index;
+} signet_batch_name_t;
 
-    }
+// A dark domain in a batch signet lookup, and the names that belong to it.
+typedef struct {
+    const char *org;
+    signet_batch_name_t *names;
+    size_t nnames;
+} signet_batch_domain_t;
 
-    // TODO: Need to check fingerprint of cached object, if it is found.
-    // If we're told to use the cache, first check to see if the signet is already in it.
-    if (use_cache && ((cached = _find_cached_object(name, &(cached_stores[cached_data_signet]))))) {
-        result = ((signet_t *)_get_cache_obj_data(cached));
-        return result;
-        // In case this returned an error.
-    } else if (use_cache) {
+typedef struct {
+    const char **names;
+    const char **fingerprints;
+    int use_cache;
+    signet_lookup_t *results;
+    signet_batch_domain_t *domains;
+    size_t ndomains;
+    size_t next;                    ///< The index of the next domain to be claimed by a worker.
+} signet_batch_t;
 
-        if (get_last_error()) {
-            dump_error_stack();
-        }
 
-        _clear_error_stack();
-    }
+/**
+ * @brief   Retrieve a signet from its DX server over DMTP, validate it, and optionally store it in the object cache.
+ * @param   name        a null-terminated string containing the name of the org (domain) or user (address) signet.
+ * @param   org         a null-terminated string containing the name of the org that the signet belongs to, which is
+ *                          the same pointer as name if an org signet was requested.
+ * @param   fingerprint an optional fingerprint of the requested signet.
+ * @param   use_cache   if set, store the signet in the object cache, and look up the org signet of a user signet through it.
+ * @return  NULL on failure, or a pointer to the requested signet on success.
+ * @free_using{dime_sgnt_signet_destroy}
+ */
+static signet_t *_fetch_signet(const char *name, const char *org, const char *fingerprint, int use_cache) {
 
-    // If not, we have to do a lookup via DMTP.
-    if (!(session = _sgnt_resolv_dmtp_connect(org, 0))) {
-        RET_ERROR_PTR(ERR_UNSPEC, "unable to connect to DX server");
+    dmtp_session_t *session;
+    signet_t *result, *org_signet = NULL;
+    cached_object_t *cached;
+    char *line;
+    int is_org = (name == org);
+
+    // The org signet that user signets are verified against is shared through the cache, so that it is only fetched once.
+    if (!is_org && use_cache && !(org_signet = _get_signet(org, NULL, 1))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "org signet retrieval for user signet verification failed");
     }
 
-    if ((res = _verify_dx_certificate(session)) < 0) {
-        _sgnt_resolv_destroy_dmtp_session(session);
-        RET_ERROR_PTR(ERR_UNSPEC, "error encoutered during the DX certificate verification process");
-    } else if (!res) {
-        _sgnt_resolv_destroy_dmtp_session(session);
-        RET_ERROR_PTR(ERR_UNSPEC, "DX certificate verification failed");
+    // We have to do a lookup via DMTP, over a pooled session to the DX server if one is available.
+    if (!(session = _sgnt_resolv_dmtp_pool_acquire(org, 0))) {
+
+        if (org_signet) {
+            dime_sgnt_signet_destroy(org_signet);
+        }
+
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to establish verified DMTP session with DX server");
     }
 
     // If we're requesting a user signet, then we need to fetch the org signet first and verify against it.
-    if (!is_org) {
+    if (!is_org && !org_signet) {
 
         if (!(line = _sgnt_resolv_dmtp_get_signet(session, org, NULL))) {
             _sgnt_resolv_destroy_dmtp_session(session);
@@ -84,6 +104,7 @@ signet_t *_get_signet(const char *name, const char *fingerprint, int use_cache)
 
         if (dime_sgnt_validate_all(org_signet, NULL, NULL, (const unsigned char **)session->drec->pubkey) != SS_FULL) {
             _sgnt_resolv_destroy_dmtp_session(session);
+            dime_sgnt_signet_destroy(org_signet);
             RET_ERROR_PTR(ERR_UNSPEC, "org signet could not be verified against DIME management record POK");
         }
 
@@ -92,12 +113,22 @@ signet_t *_get_signet(const char *name, const char *fingerprint, int use_cache)
 
     if (!(line = _sgnt_resolv_dmtp_get_signet(session, name, fingerprint))) {
         _sgnt_resolv_destroy_dmtp_session(session);
+
+        if (org_signet) {
+            dime_sgnt_signet_destroy(org_signet);
+        }
+
         RET_ERROR_PTR(ERR_UNSPEC, "signet retrieval failed");
     }
 
     if (!(result = dime_sgnt_signet_b64_deserialize(line))) {
         free(line);
         _sgnt_resolv_destroy_dmtp_session(session);
+
+        if (org_signet) {
+            dime_sgnt_signet_destroy(org_signet);
+        }
+
         RET_ERROR_PTR(ERR_UNSPEC, "unable to decode signet received from server");
     }
 
@@ -119,7 +150,7 @@ signet_t *_get_signet(const char *name, const char *fingerprint, int use_cache)
         _dbgprint(1, "User signet validation succeeded for: %s\n", name);
     }
 
-    _sgnt_resolv_destroy_dmtp_session(session);
+    _sgnt_resolv_dmtp_pool_release(session, 1);
 
     if (org_signet) {
         dime_sgnt_signet_destroy(org_signet);
@@ -134,7 +165,8 @@ signet_t *_get_signet(const char *name, const char *fingerprint, int use_cache)
             return result;
         }
 
-        if (_save_cache_contents() < 0) {
+        // Only the new signet is written out, rather than the entire cache.
+        if (_commit_cache_contents() < 0) {
             fprintf(stderr, "Error: could not save cache contents.\n");
             dump_error_stack();
             _clear_error_stack();
@@ -143,13 +175,598 @@ signet_t *_get_signet(const char *name, const char *fingerprint, int use_cache)
         result = _get_cache_obj_data(cached);
     }
 
-    return result;
+    return result;
+}
+
+/**
+ * @brief   Retrieve a signet by name, from the object cache if possible, or else from its DX server over DMTP.
+ * @note    Signets that were cached are shared with the object cache rather than copied, so they must not be modified.
+ *              Use dime_sgnt_signet_dupe() to get a private copy that can be.
+ * @note    When the cache is used, concurrent misses for the same signet are coalesced: the first thread fetches it, and the
+ *              rest wait for it to finish and share the signet it cached, or fail along with it.
+ * @param   name        a null-terminated string containing the name of the org (domain) or user (address) signet.
+ * @param   fingerprint an optional fingerprint of the requested signet.
+ * @param   use_cache   if set, look up and store the signet in the object cache.
+ * @return  NULL on failure, or a pointer to the requested signet on success.
+ * @free_using{dime_sgnt_signet_destroy}
+ */
+signet_t *_get_signet(const char *name, const char *fingerprint, int use_cache) {
+
+    cached_store_t *store = &(cached_stores[cached_data_signet]);
+    cached_flight_t *flight;
+    cached_object_t *cached;
+    signet_t *result;
+    const char *org;
+    int leader;
+
+    if (!name) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(org = strchr(name, '@'))) {
+        org = name;
+    } else {
+        org++;
+
+        // The org address cannot also contain a '@' ...
+        if (strchr(org, '@')) {
+            RET_ERROR_PTR(ERR_BAD_PARAM, "invalid organizational signet address");
+        }
+
+    }
+
+    if (!use_cache) {
+        return _fetch_signet(name, org, fingerprint, 0);
+    }
+
+    // TODO: Need to check fingerprint of cached object, if it is found.
+    // If we're told to use the cache, first check to see if the signet is already in it.
+    if ((cached = _find_cached_object(name, store))) {
+        result = ((signet_t *)_get_cache_obj_data(cached));
+        return result;
+        // In case this returned an error.
+    } else if (get_last_error()) {
+        dump_error_stack();
+    }
+
+    _clear_error_stack();
+
+    // Only one thread fetches a missing signet at a time. The cache is checked again afterwards, since this thread either
+    // waited for another one to fetch the signet, or may have just missed a fetch that finished ahead of it.
+    leader = _begin_cached_flight(name, store, 1, &flight);
+
+    if ((cached = _find_cached_object(name, store))) {
+        _end_cached_flight(flight);
+        result = ((signet_t *)_get_cache_obj_data(cached));
+        return result;
+    }
+
+    _clear_error_stack();
+
+    if (!leader) {
+        RET_ERROR_PTR(ERR_UNSPEC, "concurrent retrieval of the same signet failed");
+    }
+
+    result = _fetch_signet(name, org, fingerprint, 1);
+    _end_cached_flight(flight);
+
+    return result;
+}
+
+/**
+ * @brief   Save the most recent error on the current thread's error stack, and then clear the stack.
+ * @param   error   a pointer to the error record that will receive a copy of the last error.
+ */
+static void _save_signet_batch_error(errinfo_t *error) {
+
+    const errinfo_t *last;
+
+    if ((last = get_last_error())) {
+        memcpy(error, last, sizeof(errinfo_t));
+    } else {
+        memset(error, 0, sizeof(errinfo_t));
+        error->errcode = ERR_UNSPEC;
+    }
+
+    _clear_error_stack();
+}
+
+static int _cmp_signet_batch_names(const void *a, const void *b) {
+
+    const signet_batch_name_t *n1 = a, *n2 = b;
+    int result;
+
+    if ((result = strcasecmp(n1->org, n2->org))) {
+        return result;
+    }
+
+    return (n1->index < n2->index) ? -1 : (n1->index > n2->index);
+}
+
+/**
+ * @brief   Look up a signet in the object cache, sharing it with the cache if it's there.
+ * @param   name    a null-terminated string containing the name of the org (domain) or user (address) signet.
+ * @return  NULL if the signet isn't cached, or a pointer to the cached signet.
+ */
+static signet_t *_find_batch_cached_signet(const char *name) {
+
+    cached_object_t *cached;
+
+    if (!(cached = _find_cached_object(name, &(cached_stores[cached_data_signet])))) {
+        _clear_error_stack();
+        return NULL;
+    }
+
+    return (signet_t *)_get_cache_obj_data(cached);
+}
+
+/**
+ * @brief   Resolve all the requested signets of one dark domain in a batch lookup.
+ * @note    The org signet is fetched and validated only once for the whole domain, unless it's already cached, and all
+ *              the signets are retrieved in a single pipelined exchange over a pooled DMTP session.
+ * @note    When the cache is used, fetches are coalesced with the other threads looking up the same signets, the same way
+ *              _get_signet() does. If the org signet is already being fetched, this thread waits for it. A name that is
+ *              already being fetched is left out of the exchange, and only waited for once this domain's own fetches are
+ *              finished, so that two batches can never end up waiting on each other.
+ * @param   batch   a pointer to the batch signet lookup.
+ * @param   domain  a pointer to the dark domain whose signets are to be resolved.
+ */
+static void _resolve_signet_batch_domain(signet_batch_t *batch, signet_batch_domain_t *domain) {
+
+    cached_store_t *store = &(cached_stores[cached_data_signet]);
+    dmtp_signet_query_t *queries, *query;
+    dmtp_session_t *session = NULL;
+    cached_flight_t *org_flight = NULL, **flights = NULL, *flight;
+    signet_lookup_t *lookup;
+    signet_t *org_signet = NULL, *signet;
+    cached_object_t *cached;
+    errinfo_t domain_error;
+    const char *name, *fingerprint;
+    unsigned char *deferred = NULL;
+    size_t nqueries = 0;
+    int org_queried = 0, reusable = 0, dirty = 0;
+
+    memset(&domain_error, 0, sizeof(domain_error));
+
+    if (!(queries = calloc(domain->nnames + 1, sizeof(dmtp_signet_query_t))) || !(flights = calloc(domain->nnames, sizeof(cached_flight_t *))) ||
+        !(deferred = calloc(domain->nnames, sizeof(unsigned char)))) {
+        PUSH_ERROR_SYSCALL("calloc");
+        PUSH_ERROR(ERR_NOMEM, "could not resolve signets because of memory allocation problem");
+        _save_signet_batch_error(&domain_error);
+
+        for (size_t i = 0; i < domain->nnames; i++) {
+            memcpy(&(batch->results[domain->names[i].index].error), &domain_error, sizeof(errinfo_t));
+        }
+
+        free(queries);
+        free(flights);
+        return;
+    }
+
+    // Every user signet is validated against the org signet, so it only needs to be retrieved once. The cache is checked
+    // again after claiming the fetch, since this thread may have waited for another one to cache the org signet.
+    if (batch->use_cache && !(org_signet = _find_batch_cached_signet(domain->org)) &&
+        !_begin_cached_flight(domain->org, store, 1, &org_flight) && !(org_signet = _find_batch_cached_signet(domain->org))) {
+        PUSH_ERROR(ERR_UNSPEC, "concurrent retrieval of the org signet failed");
+        _save_signet_batch_error(&domain_error);
+    } else if (org_flight && (org_signet = _find_batch_cached_signet(domain->org))) {
+        _end_cached_flight(org_flight);
+        org_flight = NULL;
+    } else if (!org_signet) {
+        _clear_error_stack();
+        queries[nqueries].type = dmtp_query_sgnt;
+        queries[nqueries++].signame = domain->org;
+        org_queried = 1;
+    }
+
+    // An org signet that was requested without a fingerprint is answered by the same query.
+    for (size_t i = 0; i < domain->nnames; i++) {
+        name = batch->names[domain->names[i].index];
+        fingerprint = batch->fingerprints ? batch->fingerprints[domain->names[i].index] : NULL;
+
+        if (!fingerprint && !strcasecmp(name, domain->org)) {
+            continue;
+        }
+
+        // A signet that another thread is already fetching is picked up from the cache afterwards.
+        if (batch->use_cache && !domain_error.errcode && !_begin_cached_flight(name, store, 0, &(flights[i]))) {
+            deferred[i] = 1;
+            continue;
+        }
+
+        queries[nqueries].type = dmtp_query_sgnt;
+        queries[nqueries].signame = name;
+        queries[nqueries++].fingerprint = fingerprint;
+    }
+
+    if (nqueries && !domain_error.errcode) {
+
+        if (!(session = _sgnt_resolv_dmtp_pool_acquire(domain->org, 0))) {
+            PUSH_ERROR(ERR_UNSPEC, "unable to establish verified DMTP session with DX server");
+            _save_signet_batch_error(&domain_error);
+        } else {
+            reusable = (_sgnt_resolv_dmtp_query_signets(session, queries, nqueries) >= 0);
+            _clear_error_stack();
+        }
+
+    }
+
+    if (org_queried && session) {
+
+        if ((queries[0].status < 0) && queries[0].rcode) {
+            PUSH_ERROR_FMT(ERR_UNSPEC, "org signet retrieval failed with response code %u", queries[0].rcode);
+        } else if (queries[0].status < 0) {
+            PUSH_ERROR(ERR_UNSPEC, "org signet retrieval failed");
+        } else if (!(org_signet = dime_sgnt_signet_b64_deserialize(queries[0].result))) {
+            PUSH_ERROR(ERR_UNSPEC, "org signet deserialization failed");
+        } else if (dime_sgnt_validate_all(org_signet, NULL, NULL, (const unsigned char **)session->drec->pubkey) != SS_FULL) {
+            dime_sgnt_signet_destroy(org_signet);
+            org_signet = NULL;
+            PUSH_ERROR(ERR_UNSPEC, "org signet could not be verified against DIME management record POK");
+        } else if (batch->use_cache && (cached = _add_cached_object(domain->org, store, 0, 0, org_signet, 1, 0))) {
+            org_signet = _get_cache_obj_data(cached);
+            dirty = 1;
+        }
+
+    }
+
+    // Anyone waiting on the org signet can now find it in the cache, or learn that it couldn't be retrieved.
+    _end_cached_flight(org_flight);
+
+    // Without the org signet or a session, none of the signets that depend on them can be resolved.
+    if (!org_signet && !domain_error.errcode) {
+        _save_signet_batch_error(&domain_error);
+    } else if (org_signet) {
+        _clear_error_stack();
+        _dbgprint(1, "Org signet validation succeeded for: %s\n", domain->org);
+    }
+
+    // Each remaining query lines up with the next name that wasn't answered by the org signet query.
+    query = &(queries[org_queried]);
+
+    for (size_t i = 0; i < domain->nnames; i++) {
+        lookup = &(batch->results[domain->names[i].index]);
+        name = batch->names[domain->names[i].index];
+        fingerprint = batch->fingerprints ? batch->fingerprints[domain->names[i].index] : NULL;
+        signet = NULL;
+
+        if (!fingerprint && !strcasecmp(name, domain->org)) {
+
+            if (!org_signet) {
+                memcpy(&(lookup->error), &domain_error, sizeof(errinfo_t));
+            } else if (!(lookup->signet = dime_sgnt_signet_dupe(org_signet))) {
+                PUSH_ERROR(ERR_UNSPEC, "unable to copy org signet");
+                _save_signet_batch_error(&(lookup->error));
+            }
+
+            continue;
+        } else if (deferred[i]) {
+            continue;
+        }
+
+        if (!org_signet || !session) {
+            memcpy(&(lookup->error), &domain_error, sizeof(errinfo_t));
+        } else if ((query->status < 0) && query->rcode) {
+            PUSH_ERROR_FMT(ERR_UNSPEC, "signet retrieval failed with response code %u", query->rcode);
+        } else if (query->status < 0) {
+            PUSH_ERROR(ERR_UNSPEC, "signet retrieval failed");
+        } else if (!(signet = dime_sgnt_signet_b64_deserialize(query->result))) {
+            PUSH_ERROR(ERR_UNSPEC, "unable to decode signet received from server");
+        } else if (!strcasecmp(name, domain->org) && (dime_sgnt_validate_all(signet, NULL, NULL, (const unsigned char **)session->drec->pubkey) != SS_FULL)) {
+            PUSH_ERROR(ERR_UNSPEC, "org signet could not be verified against DIME management record POK");
+        } else if (strcasecmp(name, domain->org) && (dime_sgnt_validate_all(signet, NULL, org_signet, NULL) != SS_FULL)) {
+            PUSH_ERROR(ERR_UNSPEC, "user signet could not be verified against org signet");
+        } else {
+            _dbgprint(1, "Signet validation succeeded for: %s\n", name);
+            lookup->signet = signet;
+            signet = NULL;
+        }
+
+        query++;
+
+        if (signet) {
+            dime_sgnt_signet_destroy(signet);
+        }
+
+        if (!lookup->signet) {
+
+            if (!lookup->error.errcode) {
+                _save_signet_batch_error(&(lookup->error));
+            }
+
+            continue;
+        }
+
+        if (batch->use_cache) {
+
+            if (!(cached = _add_cached_object(name, store, 0, 0, lookup->signet, 1, 0))) {
+                fprintf(stderr, "Error adding signet to object cache: %s\n", name);
+                dump_error_stack();
+                _clear_error_stack();
+            } else {
+                lookup->signet = _get_cache_obj_data(cached);
+                dirty = 1;
+            }
+
+        }
+
+    }
+
+    // Every fetch this thread claimed is finished before it waits on anyone else's.
+    for (size_t i = 0; i < domain->nnames; i++) {
+        _end_cached_flight(flights[i]);
+    }
+
+    if (session) {
+        _sgnt_resolv_dmtp_pool_release(session, reusable);
+    }
+
+    if (org_signet) {
+        dime_sgnt_signet_destroy(org_signet);
+    }
+
+    // The signets fetched by other threads are waited for last, after the session has gone back to the pool.
+    for (size_t i = 0; i < domain->nnames; i++) {
+
+        if (!deferred[i]) {
+            continue;
+        }
+
+        lookup = &(batch->results[domain->names[i].index]);
+        name = batch->names[domain->names[i].index];
+
+        if (_begin_cached_flight(name, store, 1, &flight)) {
+            _end_cached_flight(flight);
+        }
+
+        if (!(lookup->signet = _find_batch_cached_signet(name))) {
+            PUSH_ERROR(ERR_UNSPEC, "concurrent retrieval of the same signet failed");
+            _save_signet_batch_error(&(lookup->error));
+        }
+
+    }
+
+    for (size_t i = 0; i < nqueries; i++) {
+        free(queries[i].result);
+    }
+
+    free(queries);
+    free(flights);
+    free(deferred);
+
+    // The cache is committed once for the whole domain, rather than once for every signet.
+    if (dirty && (_commit_cache_contents() < 0)) {
+        fprintf(stderr, "Error: could not save cache contents.\n");
+        dump_error_stack();
+        _clear_error_stack();
+    }
+
+}
+
+static void *_signet_batch_worker(void *arg) {
+
+    signet_batch_t *batch = (signet_batch_t *)arg;
+    size_t next;
+
+    while ((next = __atomic_fetch_add(&(batch->next), 1, __ATOMIC_RELAXED)) < batch->ndomains) {
+        _resolve_signet_batch_domain(batch, &(batch->domains[next]));
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief   Retrieve a batch of signets by name, resolving the signets of different dark domains concurrently.
+ * @note    Names are grouped by dark domain, so that the org signet of each domain is retrieved and validated only once
+ *              and all of its signets are fetched over a single pooled DMTP session. Up to DMTP_BATCH_MAX_WORKERS domains
+ *              are resolved at the same time. Signets that were cached are shared with the object cache, and must not
+ *              be modified.
+ * @param   names           an array of null-terminated strings containing the names of the org (domain) or user (address) signets.
+ * @param   fingerprints    an optional array of fingerprints for the requested signets, any of which may be NULL.
+ * @param   nnames          the number of signet names in the array.
+ * @param   use_cache       if set, look up and store the signets in the object cache.
+ * @param   results         an array of nnames lookup results that will receive each signet, or the error that kept it from being resolved.
+ *                                  Each resolved signet must be freed by the caller with dime_sgnt_signet_destroy().
+ * @return  the number of signets that were successfully resolved.
+ */
+size_t _get_signets(const char **names, const char **fingerprints, size_t nnames, int use_cache, signet_lookup_t *results) {
+
+    signet_batch_t batch;
+    signet_batch_name_t *pending;
+    pthread_t workers[DMTP_BATCH_MAX_WORKERS - 1];
+    cached_object_t *cached;
+    const char *org;
+    size_t npending = 0, nworkers = 0, result = 0;
+
+    if (!names || !nnames || !results) {
+        RET_ERROR_UINT(ERR_BAD_PARAM, NULL);
+    }
+
+    memset(results, 0, nnames * sizeof(signet_lookup_t));
+    memset(&batch, 0, sizeof(batch));
+    batch.names = names;
+    batch.fingerprints = fingerprints;
+    batch.use_cache = use_cache;
+    batch.results = results;
+
+    if (!(pending = calloc(nnames, sizeof(signet_batch_name_t))) || !(batch.domains = calloc(nnames, sizeof(signet_batch_domain_t)))) {
+        PUSH_ERROR_SYSCALL("calloc");
+        free(pending);
+        RET_ERROR_UINT(ERR_NOMEM, "could not resolve signets because of memory allocation problem");
+    }
+
+    // Signets that are already cached are resolved right away, and the rest are set aside to be fetched.
+    for (size_t i = 0; i < nnames; i++) {
+
+        if (!names[i]) {
+            PUSH_ERROR(ERR_BAD_PARAM, NULL);
+            _save_signet_batch_error(&(results[i].error));
+            continue;
+        } else if (!(org = strchr(names[i], '@'))) {
+            org = names[i];
+        } else if (strchr(++org, '@')) {
+            PUSH_ERROR(ERR_BAD_PARAM, "invalid organizational signet address");
+            _save_signet_batch_error(&(results[i].error));
+            continue;
+        }
+
+        if (use_cache && ((cached = _find_cached_object(names[i], &(cached_stores[cached_data_signet]))))) {
+            results[i].signet = (signet_t *)_get_cache_obj_data(cached);
+            result++;
+            continue;
+        } else if (use_cache) {
+
+            if (get_last_error()) {
+                dump_error_stack();
+            }
+
+            _clear_error_stack();
+        }
+
+        pending[npending].org = org;
+        pending[npending++].index = i;
+    }
+
+    qsort(pending, npending, sizeof(signet_batch_name_t), _cmp_signet_batch_names);
+
+    for (size_t i = 0; i < npending; i++) {
+
+        if (!batch.ndomains || strcasecmp(pending[i].org, batch.domains[batch.ndomains - 1].org)) {
+            batch.domains[batch.ndomains].org = pending[i].org;
+            batch.domains[batch.ndomains++].names = &(pending[i]);
+        }
+
+        batch.domains[batch.ndomains - 1].nnames++;
+    }
+
+    if (batch.ndomains) {
+
+        // The SSL client context is created on first use without any locking, so it needs to exist before the workers race to create it.
+        if (!_ssl_get_client_context()) {
+            fprintf(stderr, "Error: could not initialize SSL client context.\n");
+            dump_error_stack();
+            _clear_error_stack();
+        }
+
+        // This thread works through the domains alongside the workers, so a single domain never needs a thread of its own.
+        while ((nworkers < (DMTP_BATCH_MAX_WORKERS - 1)) && (nworkers < (batch.ndomains - 1))) {
+
+            if (pthread_create(&(workers[nworkers]), NULL, _signet_batch_worker, &batch)) {
+                _dbgprint(1, "Unable to start signet batch worker; continuing with %zu workers.\n", nworkers + 1);
+                break;
+            }
+
+            nworkers++;
+        }
+
+        _signet_batch_worker(&batch);
+
+        for (size_t i = 0; i < nworkers; i++) {
+            pthread_join(workers[i], NULL);
+        }
+
+        for (size_t i = 0; i < npending; i++) {
+
+            if (results[pending[i].index].signet) {
+                result++;
+            }
+
+        }
+
+    }
+
+    free(batch.domains);
+    free(pending);
+
+    return result;
+}
+
+/**
+ * @brief   Resolve the addresses of a candidate DX server, and add a connection attempt to each of them to a list.
+ * @note    The addresses are interleaved by family, so that a broken IPv6 (or IPv4) route only delays the attempts by one step.
+ * @param   attempts    a pointer to the list of connection attempts that will be extended.
+ * @param   host        the hostname of the candidate DX server.
+ * @param   port        the port the DX server is to be connected to.
+ * @param   mode        dmtp_mode_dmtp to negotiate TLS right away, or dmtp_mode_dual to issue STARTTLS first.
+ * @param   domain      the dark domain which the DX server is servicing.
+ * @param   force_family    an optional address family (AF_INET or AF_INET6) to restrict the attempts to.
+ * @param   drec        the DIME management record that the DX certificate will be verified against.
+ * @return  -1 on failure or 0 on success.
+ */
+static int _dx_add_attempts(dx_attempts_t *attempts, const char *host, unsigned short port, dmtp_mode_t mode, const char *domain, int force_family,
+    dime_record_t *drec) {
+
+    struct addrinfo hints, *address;
+    dmtp_async_request_t *reall_requests;
+    struct sockaddr_storage *reall_addrs;
+    char pstr[16];
+    size_t count = 0;
+    int res;
+
+    memset(pstr, 0, sizeof(pstr));
+    snprintf(pstr, sizeof(pstr), "%u", port);
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = force_family ? force_family : AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if ((res = getaddrinfo(host, pstr, &hints, &address))) {
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "failed to resolve DX server address of %s: %s", host, gai_strerror(res));
+    }
+
+    address = _interleave_addresses(address);
+
+    for (struct addrinfo *aptr = address; aptr; aptr = aptr->ai_next) {
+        count++;
+    }
+
+    if (!(reall_requests = realloc(attempts->requests, (attempts->count + count) * sizeof(dmtp_async_request_t)))) {
+        PUSH_ERROR_SYSCALL("realloc");
+        freeaddrinfo(address);
+        RET_ERROR_INT(ERR_NOMEM, "could not add DX connection attempts because of memory allocation problem");
+    }
+
+    attempts->requests = reall_requests;
+
+    if (!(reall_addrs = realloc(attempts->addrs, (attempts->count + count) * sizeof(struct sockaddr_storage)))) {
+        PUSH_ERROR_SYSCALL("realloc");
+        freeaddrinfo(address);
+        RET_ERROR_INT(ERR_NOMEM, "could not add DX connection attempts because of memory allocation problem");
+    }
+
+    attempts->addrs = reall_addrs;
+
+    // The addresses of the requests are only pointed at their copies once the list stops being reallocated.
+    for (struct addrinfo *aptr = address; aptr; aptr = aptr->ai_next) {
+
+        if (aptr->ai_addrlen > sizeof(struct sockaddr_storage)) {
+            continue;
+        }
+
+        memset(&(attempts->requests[attempts->count]), 0, sizeof(dmtp_async_request_t));
+        memset(&(attempts->addrs[attempts->count]), 0, sizeof(struct sockaddr_storage));
+        memcpy(&(attempts->addrs[attempts->count]), aptr->ai_addr, aptr->ai_addrlen);
+        attempts->requests[attempts->count].addrlen = aptr->ai_addrlen;
+        attempts->requests[attempts->count].dx = host;
+        attempts->requests[attempts->count].domain = domain;
+        attempts->requests[attempts->count].mode = mode;
+        attempts->requests[attempts->count].drec = drec;
+        attempts->count++;
+    }
+
+    freeaddrinfo(address);
+
+    return 0;
 }
 
 /**
  * @brief   Establish a DMTP connection to the DX server of a provided dark domain.
  * @note    This function automatically queries the DIME management record of the domain to determine
  *              the appropriate way to establish a connection to the domain's DX server.
+ *              Connection attempts to every address of every candidate DX server are raced against each other, each one
+ *              getting a head start of DMTP_CONNECT_ATTEMPT_DELAY milliseconds in order of preference, so that an
+ *              unresponsive server doesn't hold up delivery for a whole timeout period.
+ *              The DX certificate of the returned session has already been verified against the domain's DIME record.
  *              This is the function that should be used by all general callers.
  * @param   domain  a null-terminated string containing the specified dark domain.
  * @param   force_family an optional address family (AF_INET or AF_INET6) to force the TCP connection to take.
@@ -159,7 +776,8 @@ dmtp_session_t *_sgnt_resolv_dmtp_connect(const char *domain, int force_family)
 
     dmtp_session_t *result = NULL;
     dime_record_t *drec;
-    mx_record_t **mxs, **mxptr;
+    dx_attempts_t attempts;
+    mx_record_t **mxs = NULL, **mxptr;
     unsigned long ttl;
     char **dxptr;
 
@@ -178,26 +796,25 @@ dmtp_session_t *_sgnt_resolv_dmtp_connect(const char *domain, int force_family)
         RET_ERROR_PTR(ERR_UNSPEC, "could not establish DMTP connection to host: DIME management record DNSSEC signature was invalid");
     }
 
+    memset(&attempts, 0, sizeof(attempts));
+
     // There are 3 possible ways this will turn out.
     // 1. The DIME management record has a dx field and we will connect to this server on the standard DMTP port.
     // 2. There is no dx field but the domain has an MX record. We will attempt to connect to this host first
     //    over standard DMTP, and then fall back to dual mode on the SMTP port if unsuccessful.
     // 3. There is no DX field or MX record for the domain. We make an attempt to connect to the standard DMTP port.
+    // The attempts are queued up in that order of preference, and then raced against each other.
 
     // Case 1: Our record has a DX field.
     if (drec->dx) {
-        size_t i = 1;
-        dxptr = drec->dx;
 
-        /* We must try each possible DX server in order. */
-        while (*dxptr) {
-            _dbgprint(1, "Attempting DMTP connection to DIME record-supplied DX server #%u at %s:%u ...\n", i, *dxptr, DMTP_PORT);
+        for (dxptr = drec->dx; *dxptr; dxptr++) {
 
-            if ((result = _dx_connect_standard(*dxptr, domain, force_family, drec))) {
-                break;
+            if (_dx_add_attempts(&attempts, *dxptr, DMTP_PORT, dmtp_mode_dmtp, domain, force_family, drec) < 0) {
+                _dbgprint(1, "Skipping DIME record-supplied DX server %s, which could not be resolved.\n", *dxptr);
+                _clear_error_stack();
             }
 
-            dxptr++, i++;
         }
 
         // Case 2: There are MX record(s) for our domain.
@@ -205,37 +822,54 @@ dmtp_session_t *_sgnt_resolv_dmtp_connect(const char *domain, int force_family)
 
         if ((mxptr = mxs = _get_mx_records(domain))) {
 
-            // Try a maximum of the first 3 MX records.
+            // Try a maximum of the first 3 MX records, each over standard DMTP, and then dual mode on port 25 or 587.
             for (int i = 0; (i < DMTP_MAX_MX_RETRIES) && *mxptr; i++, mxptr++) {
-                _dbgprint(1, "Attempting DMTP connection to MX hostname at %s:%u [pref %u] ...\n", (*mxptr)->name, DMTP_PORT, (*mxptr)->pref);
 
-                if (!(result = _dx_connect_standard((*mxptr)->name, domain, force_family, drec))) {
-                    _dbgprint(1, "Re-attempting dual-mode DMTP connection to MX hostname at %s:%u ...\n", (*mxptr)->name, DMTP_PORT_DUAL);
-                    result = _dx_connect_dual((*mxptr)->name, domain, force_family, drec, 1);
-                }
-
-                if (result) {
-                    break;
+                if ((_dx_add_attempts(&attempts, (*mxptr)->name, DMTP_PORT, dmtp_mode_dmtp, domain, force_family, drec) < 0) ||
+                    (_dx_add_attempts(&attempts, (*mxptr)->name, DMTP_PORT_DUAL, dmtp_mode_dual, domain, force_family, drec) < 0) ||
+                    (_dx_add_attempts(&attempts, (*mxptr)->name, 587, dmtp_mode_dual, domain, force_family, drec) < 0)) {
+                    _dbgprint(1, "Skipping MX hostname %s [pref %u], which could not be resolved.\n", (*mxptr)->name, (*mxptr)->pref);
+                    _clear_error_stack();
                 }
 
             }
 
-            free(mxs);
         }
 
         // Case 3 (final): There is no DX field or MX record for this domain. We try a standard DMTP connection.
-        // This is actually executed as failover from Case #2 if it completes unsuccessfully.
-        if (!result) {
-            _dbgprint(1, "Attempting DMTP connection to assumed DX server at %s:%u ...\n", domain, DMTP_PORT);
-            result = _dx_connect_standard(domain, domain, force_family, drec);
+        // This is actually the last resort of Case #2, if none of the MX hosts can be reached.
+        if (_dx_add_attempts(&attempts, domain, DMTP_PORT, dmtp_mode_dmtp, domain, force_family, drec) < 0) {
+            _dbgprint(1, "Skipping assumed DX server %s, which could not be resolved.\n", domain);
+            _clear_error_stack();
         }
 
     }
 
+    for (size_t i = 0; i < attempts.count; i++) {
+        attempts.requests[i].addr = (struct sockaddr *)&(attempts.addrs[i]);
+    }
+
+    if (attempts.count) {
+        result = _dx_connect_race(attempts.requests, attempts.count);
+    }
+
+    free(attempts.requests);
+    free(attempts.addrs);
+
+    // The winning session holds its own copy of the DX name, which may have come from one of the MX records.
+    if (mxs) {
+        free(mxs);
+    }
+
     if (!result) {
+        _destroy_dime_record(drec);
         RET_ERROR_PTR(ERR_UNSPEC, "connection to DX server failed");
     }
 
+    result->drec = drec;
+    result->_family = force_family;
+    result->_established = time(NULL);
+
     return result;
 }
 
@@ -271,12 +905,323 @@ void _sgnt_resolv_destroy_dmtp_session(dmtp_session_t *session) {
         _destroy_dime_record(session->drec);
     }
 
-    memset(session->_inbuf, 0, sizeof(session->_inbuf));
+    if (session->_inbuf) {
+        memset(session->_inbuf, 0, session->_insize + 1);
+        free(session->_inbuf);
+    }
 
     free(session);
 
 }
 
+/**
+ * @brief   Determine whether a DMTP session is still connected and sitting idle between commands.
+ * @note    A session that is readable while no command is outstanding has either been closed by the server,
+ *              or has received data it didn't ask for. In both cases it can't be reused.
+ * @param   session     a pointer to the DMTP session to be checked.
+ * @return  -1 on error, 0 if the session is disconnected or has unread input pending, or 1 if it is idle.
+ */
+int _sgnt_resolv_dmtp_session_idle(dmtp_session_t *session) {
+
+    struct pollfd pfd;
+    int fd, res;
+
+    if (!session) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    fd = session->con ? SSL_get_fd_d(session->con) : session->_fd;
+
+    if ((fd < 0) || session->_inlen || (session->con && (SSL_pending_d(session->con) > 0))) {
+        return 0;
+    }
+
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (((res = poll(&pfd, 1, 0)) < 0) && (errno == EINTR));
+
+    if (res < 0) {
+        PUSH_ERROR_SYSCALL("poll");
+        RET_ERROR_INT(ERR_UNSPEC, "unable to check state of DMTP session");
+    }
+
+    return (res ? 0 : 1);
+}
+
+/**
+ * @brief   Close an idle pooled session, telling the server that we're leaving.
+ * @note    The reply to the QUIT command isn't waited for, so that a stalled server can't hold up the caller.
+ * @param   session     a pointer to the DMTP session to be closed and destroyed.
+ */
+static void _sgnt_resolv_dmtp_pool_close(dmtp_session_t *session) {
+
+    if (_sgnt_resolv_dmtp_issue_command(session, "QUIT\r\n") < 0) {
+        _clear_error_stack();
+    }
+
+    _sgnt_resolv_destroy_dmtp_session(session);
+
+}
+
+/**
+ * @brief   Add an idle session to the session pool, enforcing the per-host and overall limits on its size.
+ * @note    If the DX server already has its share of idle sessions, the session is closed instead. If the pool
+ *              as a whole is full, its least recently released session is closed to make room.
+ * @param   session     a pointer to the DMTP session to be pooled.
+ */
+static void _sgnt_resolv_dmtp_pool_put(dmtp_session_t *session) {
+
+    dmtp_session_t *victim = NULL, *iter, **prev;
+    size_t per_host = 0;
+
+    pthread_mutex_lock(&_dmtp_pool_lock);
+
+    for (iter = _dmtp_pool; iter; iter = iter->_next) {
+
+        if (!strcasecmp(iter->dx, session->dx)) {
+            per_host++;
+        }
+
+    }
+
+    if (per_host >= DMTP_POOL_MAX_PER_HOST) {
+        victim = session;
+    } else {
+
+        if (_dmtp_pool_size >= DMTP_POOL_MAX_SESSIONS) {
+
+            for (prev = &_dmtp_pool; (*prev)->_next; prev = &((*prev)->_next));
+
+            victim = *prev;
+            *prev = NULL;
+            _dmtp_pool_size--;
+        }
+
+        session->_next = _dmtp_pool;
+        _dmtp_pool = session;
+        _dmtp_pool_size++;
+    }
+
+    pthread_mutex_unlock(&_dmtp_pool_lock);
+
+    if (victim) {
+        _dbgprint(2, "Closing DMTP session to %s that exceeds the session pool limits ...\n", victim->dx);
+        _sgnt_resolv_dmtp_pool_close(victim);
+    }
+
+}
+
+/**
+ * @brief   Take a live, idle DMTP session to the DX server of a dark domain out of the session pool.
+ * @note    Expired sessions and sessions that were closed by the server are destroyed along the way.
+ *              Sessions that have sat idle for DMTP_POOL_PROBE_INTERVAL seconds must pass a NOOP check first.
+ * @param   domain          a null-terminated string containing the dark domain of the requested session.
+ * @param   force_family    the address family that the session must have been requested with.
+ * @return  NULL if the pool holds no usable session for the domain, or a pointer to the pooled session on success.
+ */
+dmtp_session_t *_sgnt_resolv_dmtp_pool_take(const char *domain, int force_family) {
+
+    dmtp_session_t *session, **prev;
+    time_t now;
+
+    if (!domain) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    now = time(NULL);
+
+    while (1) {
+        pthread_mutex_lock(&_dmtp_pool_lock);
+
+        for (prev = &_dmtp_pool; (session = *prev); prev = &(session->_next)) {
+
+            if ((session->_family == force_family) && !strcasecmp(session->domain, domain)) {
+                *prev = session->_next;
+                session->_next = NULL;
+                _dmtp_pool_size--;
+                break;
+            }
+
+        }
+
+        pthread_mutex_unlock(&_dmtp_pool_lock);
+
+        if (!session) {
+            return NULL;
+        }
+
+        // The session is checked once it's out of the pool, so the NOOP round trip doesn't hold up other threads.
+        if (((now - session->_established) >= DMTP_POOL_MAX_AGE) || ((now - session->_idle_since) >= DMTP_POOL_IDLE_TIMEOUT)) {
+            _dbgprint(2, "Discarding expired pooled DMTP session to %s ...\n", session->dx);
+        } else if (_sgnt_resolv_dmtp_session_idle(session) <= 0) {
+            _dbgprint(2, "Discarding pooled DMTP session that was closed by %s ...\n", session->dx);
+        } else if (((now - session->_checked) >= DMTP_POOL_PROBE_INTERVAL) && (_sgnt_resolv_dmtp_noop(session) < 0)) {
+            _dbgprint(2, "Discarding pooled DMTP session to %s that failed its NOOP check ...\n", session->dx);
+        } else {
+            return session;
+        }
+
+        // A dead pooled session isn't an error for the caller, who will simply get another one.
+        _clear_error_stack();
+        _sgnt_resolv_destroy_dmtp_session(session);
+    }
+
+}
+
+/**
+ * @brief   Get a verified DMTP session to the DX server of a dark domain, reusing a pooled session if possible.
+ * @note    Sessions that are newly established have their DX certificate verified before they are returned.
+ *              When the caller is finished with the session, it should be handed back with _sgnt_resolv_dmtp_pool_release().
+ * @param   domain          a null-terminated string containing the specified dark domain.
+ * @param   force_family    an optional address family (AF_INET or AF_INET6) to force the TCP connection to take.
+ * @return  NULL on failure, or a pointer to a verified DMTP session on success.
+ */
+dmtp_session_t *_sgnt_resolv_dmtp_pool_acquire(const char *domain, int force_family) {
+
+    dmtp_session_t *result;
+    int res;
+
+    if (!domain) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if ((result = _sgnt_resolv_dmtp_pool_take(domain, force_family))) {
+        _dbgprint(1, "Reusing pooled DMTP session to %s for %s ...\n", result->dx, domain);
+        return result;
+    }
+
+    if (!(result = _sgnt_resolv_dmtp_connect(domain, force_family))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to connect to DX server");
+    }
+
+    // Sessions that were verified as they were established don't need to be checked again.
+    if (result->_established) {
+        return result;
+    } else if ((res = _verify_dx_certificate(result)) < 0) {
+        _sgnt_resolv_destroy_dmtp_session(result);
+        RET_ERROR_PTR(ERR_UNSPEC, "error encoutered during the DX certificate verification process");
+    } else if (!res) {
+        _sgnt_resolv_destroy_dmtp_session(result);
+        RET_ERROR_PTR(ERR_UNSPEC, "DX certificate verification failed");
+    }
+
+    result->_family = force_family;
+    result->_established = time(NULL);
+
+    return result;
+}
+
+/**
+ * @brief   Hand a DMTP session back to the session pool, so that it can be reused by later requests to the same dark domain.
+ * @note    Only sessions that were handed out by _sgnt_resolv_dmtp_pool_acquire() and are sitting idle between commands
+ *              are kept. Any other session is destroyed.
+ * @param   session     a pointer to the DMTP session to be released.
+ * @param   reusable    if not set, the session is destroyed rather than pooled, e.g. because its DX server misbehaved.
+ */
+void _sgnt_resolv_dmtp_pool_release(dmtp_session_t *session, int reusable) {
+
+    if (!session) {
+        return;
+    }
+
+    if (!reusable || !session->_established || !session->domain || !session->dx || (_sgnt_resolv_dmtp_session_idle(session) <= 0)) {
+        _sgnt_resolv_destroy_dmtp_session(session);
+        return;
+    }
+
+    session->_idle_since = session->_checked = time(NULL);
+    _sgnt_resolv_dmtp_pool_put(session);
+
+}
+
+/**
+ * @brief   Keep the sessions in the session pool alive, and close the ones that have expired.
+ * @note    This function may be called periodically by long-running callers. Sessions that have been idle for
+ *              DMTP_POOL_PROBE_INTERVAL seconds are kept alive with a NOOP command, and sessions that have been
+ *              idle for DMTP_POOL_IDLE_TIMEOUT seconds, or are older than DMTP_POOL_MAX_AGE seconds, are closed.
+ * @param   now     the current time, or 0 to use the system clock.
+ * @return  the number of sessions that were evicted from the pool.
+ */
+size_t _sgnt_resolv_dmtp_pool_maintain(time_t now) {
+
+    dmtp_session_t *session, **prev, *expired = NULL, *probe = NULL;
+    size_t result = 0;
+
+    if (!now) {
+        now = time(NULL);
+    }
+
+    pthread_mutex_lock(&_dmtp_pool_lock);
+
+    for (prev = &_dmtp_pool; (session = *prev);) {
+
+        if (((now - session->_established) >= DMTP_POOL_MAX_AGE) || ((now - session->_idle_since) >= DMTP_POOL_IDLE_TIMEOUT)) {
+            *prev = session->_next;
+            session->_next = expired;
+            expired = session;
+            _dmtp_pool_size--;
+        } else if ((now - session->_checked) >= DMTP_POOL_PROBE_INTERVAL) {
+            *prev = session->_next;
+            session->_next = probe;
+            probe = session;
+            _dmtp_pool_size--;
+        } else {
+            prev = &(session->_next);
+        }
+
+    }
+
+    pthread_mutex_unlock(&_dmtp_pool_lock);
+
+    while ((session = expired)) {
+        expired = session->_next;
+        _dbgprint(2, "Closing idle pooled DMTP session to %s ...\n", session->dx);
+        _sgnt_resolv_dmtp_pool_close(session);
+        result++;
+    }
+
+    // The probed sessions keep the time they were last used, so keep-alives don't stop them from timing out.
+    while ((session = probe)) {
+        probe = session->_next;
+        session->_next = NULL;
+
+        if ((_sgnt_resolv_dmtp_session_idle(session) <= 0) || (_sgnt_resolv_dmtp_noop(session) < 0)) {
+            _dbgprint(2, "Discarding pooled DMTP session to %s that failed its NOOP check ...\n", session->dx);
+            _clear_error_stack();
+            _sgnt_resolv_destroy_dmtp_session(session);
+            result++;
+            continue;
+        }
+
+        session->_checked = now;
+        _sgnt_resolv_dmtp_pool_put(session);
+    }
+
+    return result;
+}
+
+/**
+ * @brief   Gracefully close all the idle sessions in the session pool.
+ */
+void _sgnt_resolv_dmtp_pool_flush(void) {
+
+    dmtp_session_t *session, *list;
+
+    pthread_mutex_lock(&_dmtp_pool_lock);
+    list = _dmtp_pool;
+    _dmtp_pool = NULL;
+    _dmtp_pool_size = 0;
+    pthread_mutex_unlock(&_dmtp_pool_lock);
+
+    while ((session = list)) {
+        list = session->_next;
+        _sgnt_resolv_dmtp_pool_close(session);
+    }
+
+}
+
 /**
  * @brief   Establish (force) a DMTP connection to a specified DX server on tcp port 26/ssl.
  * @note    This function should only be called externally with care.
@@ -522,23 +1467,137 @@ int _verify_dx_certificate(dmtp_session_t *session) {
         return 1;
     }
 
-    // The following remaining cases undergo OCSP validation: x509 chain validation succeeded, but DIME record had no tlssig field.
-    switch(_do_ocsp_validation(session->con, NULL)) {
-
-    case 0:
-        _dbgprint(1, "DX TLS certificate failed OCSP validation.\n");
-        return 0;
-        break;
-    case 1:
-        // do nothing.
-        break;
-    default:
-        RET_ERROR_INT(ERR_UNSPEC, "error encountered during OCSP validation");
-        break;
+    // The following remaining cases undergo OCSP validation: x509 chain validation succeeded, but DIME record had no tlssig field.
+    switch(_do_ocsp_validation(session->con, NULL)) {
+
+    case 0:
+        _dbgprint(1, "DX TLS certificate failed OCSP validation.\n");
+        return 0;
+        break;
+    case 1:
+        // do nothing.
+        break;
+    default:
+        RET_ERROR_INT(ERR_UNSPEC, "error encountered during OCSP validation");
+        break;
+
+    }
+
+    return 1;
+}
+
+/**
+ * @brief   Format a SGNT or VRFY command for a named signet.
+ * @note    Names and fingerprints that could escape their delimiters or cut the command short are rejected, since when
+ *              commands are pipelined, they would leave every reply that follows out of step with its query.
+ * @param   type        the type of signet query to be formatted: dmtp_query_sgnt or dmtp_query_vrfy.
+ * @param   signame     the name of the requested organizational or user signet.
+ * @param   fingerprint an optional fingerprint for a SGNT command, or the fingerprint to be verified by a VRFY command.
+ * @return  NULL on failure, or a pointer to a null-terminated string containing the CRLF-terminated command on success.
+ * @free_using{free}
+ */
+char *_sgnt_resolv_dmtp_format_query(dmtp_query_type_t type, const char *signame, const char *fingerprint) {
+
+    char *result;
+    size_t reqlen;
+
+    if (!signame || ((type != dmtp_query_sgnt) && (type != dmtp_query_vrfy)) || ((type == dmtp_query_vrfy) && !fingerprint)) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (strpbrk(signame, "<>\r\n") || (fingerprint && strpbrk(fingerprint, "[]\r\n"))) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, "signet name or fingerprint contained illegal characters");
+    }
+
+    reqlen = strlen(signame) + 32 + (fingerprint ? strlen(fingerprint) : 0);
+
+    if (!(result = malloc(reqlen))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_PTR(ERR_NOMEM, "could not format signet query because of memory allocation error");
+    }
+
+    memset(result, 0, reqlen);
+
+    if (fingerprint) {
+        snprintf(result, reqlen, "%s <%s> [%s]\r\n", ((type == dmtp_query_sgnt) ? "SGNT" : "VRFY"), signame, fingerprint);
+    } else {
+        snprintf(result, reqlen, "SGNT <%s>\r\n", signame);
+    }
+
+    return result;
+}
+
+/**
+ * @brief   Extract the signet data from a successful reply to a SGNT command.
+ * @param   response    the text of the server's reply following its response code, which will be modified.
+ * @return  NULL on failure, or a pointer to a null-terminated string containing the signet data on success.
+ * @free_using{free}
+ */
+char *_sgnt_resolv_dmtp_parse_sgnt_reply(char *response) {
+
+    char *rptr = response, *result;
+
+    while (chr_isspace(*rptr)) {
+        rptr++;
+    }
+
+    if (!*rptr || (*rptr != 'O') || !*(rptr + 1) || (*(rptr + 1) != 'K')) {
+        RET_ERROR_PTR(ERR_UNSPEC, "received malformed signet response from server");
+    }
+
+    rptr += 2;
+
+    while (chr_isspace(*rptr)) {
+        rptr++;
+    }
+
+    if ((*rptr++ != '[') || (rptr[strlen(rptr) - 1] != ']')) {
+        RET_ERROR_PTR(ERR_UNSPEC, "received malformed signet response from server");
+    }
+
+    rptr[strlen(rptr) - 1] = 0;
+
+    if (!(result = strdup(rptr))) {
+        PUSH_ERROR_SYSCALL("strdup");
+        RET_ERROR_PTR(ERR_NOMEM, NULL);
+    }
+
+    return result;
+}
+
+/**
+ * @brief   Interpret a successful reply to a VRFY command.
+ * @param   response    the text of the server's reply following its response code, which will be modified.
+ * @param   newprint    an optional pointer to a string which will be updated to point to the latest
+ *                              fingerprint of the signet, if it is out of date.
+ * @return  -1 on failure, 0 if the signet fingerprint was out of date, or 1 if it is the most current one.
+ */
+int _sgnt_resolv_dmtp_parse_vrfy_reply(char *response, char **newprint) {
+
+    char *status, *tokens, *nfp;
+
+    // The first VRFY response parameter must be either "CURRENT" or "UPDATE"
+    if ((!(status = strtok_r(response, " \t", &tokens)))) {
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "VRFY reply was in unexpected format: %s", response);
+        // If the specified signet is current then there's really nothing much else to do.
+    } else if (!strcasecmp(status, "CURRENT")) {
+        return 1;
+    } else if (strcasecmp(status, "UPDATE")) {
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "VRFY reply was in unexpected format: %s", response);
+    }
+
+    // If we're here it's because the named signet needs to be updated. This is the next parameter of the reply.
+    if (!(nfp = strtok_r(NULL, " \t", &tokens))) {
+        RET_ERROR_INT(ERR_UNSPEC, "VRFY reply returned UPDATE without the corresponding fingerprint");
+    }
 
+    if (newprint && (!(*newprint = strdup(nfp)))) {
+        PUSH_ERROR_SYSCALL("strdup");
+        RET_ERROR_INT(ERR_UNSPEC, "signet verification failed due to memory allocation problem");
     }
 
-    return 1;
+    // Return code for signet that needs updating.
+    return 0;
 }
 
 /**
@@ -551,27 +1610,15 @@ int _verify_dx_certificate(dmtp_session_t *session) {
  */
 char *_sgnt_resolv_dmtp_get_signet(dmtp_session_t *session, const char *signame, const char *fingerprint) {
 
-    char *response, *request, *rptr, *result;
-    size_t reqlen;
+    char *response, *request, *result;
     unsigned short rcode;
 
     if (!session || !signame) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
-    reqlen = strlen(signame) + 32 + (fingerprint ? strlen(fingerprint) : 0);
-
-    if (!(request = malloc(reqlen))) {
-        PUSH_ERROR_SYSCALL("malloc");
-        RET_ERROR_PTR(ERR_NOMEM, "could not retrieve signet because of memory allocation error");
-    }
-
-    memset(request, 0, reqlen);
-
-    if (fingerprint) {
-        snprintf(request, reqlen, "SGNT <%s> [%s]\r\n", signame, fingerprint);
-    } else {
-        snprintf(request, reqlen, "SGNT <%s>\r\n", signame);
+    if (!(request = _sgnt_resolv_dmtp_format_query(dmtp_query_sgnt, signame, fingerprint))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "could not retrieve signet because of malformed request");
     }
 
     response = _sgnt_resolv_dmtp_send_and_read(session, request, &rcode);
@@ -586,36 +1633,7 @@ char *_sgnt_resolv_dmtp_get_signet(dmtp_session_t *session, const char *signame,
         return NULL;
     }
 
-    rptr = response;
-
-    while (chr_isspace(*rptr)) {
-        rptr++;
-    }
-
-    if (!*rptr || (*rptr != 'O') || !*(rptr + 1) || (*(rptr + 1) != 'K')) {
-        free(response);
-        RET_ERROR_PTR(ERR_UNSPEC, "received malformed signet response from server");
-    }
-
-    rptr += 2;
-
-    while (chr_isspace(*rptr)) {
-        rptr++;
-    }
-
-    if ((*rptr++ != '[') || (rptr[strlen(rptr) - 1] != ']')) {
-        free(response);
-        RET_ERROR_PTR(ERR_UNSPEC, "received malformed signet response from server");
-    }
-
-    rptr[strlen(rptr) - 1] = 0;
-
-    if (!(result = strdup(rptr))) {
-        PUSH_ERROR_SYSCALL("strdup");
-        free(response);
-        RET_ERROR_PTR(ERR_NOMEM, NULL);
-    }
-
+    result = _sgnt_resolv_dmtp_parse_sgnt_reply(response);
     free(response);
 
     return result;
@@ -663,17 +1681,21 @@ int _sgnt_resolv_dmtp_ehlo(dmtp_session_t *session, const char *domain) {
 }
 
 /**
- * @brief   Issue a MAIL FROM command to the remote DMTP server.
+ * @brief   Format a MAIL FROM command.
+ * @param   origin      the name of the origin domain of the message.
+ * @param   msgsize     the size, in bytes, of the message that will follow.
+ * @param   rettype     the portion of the message to be returned if it bounces.
+ * @param   dtype       the type of the message data.
+ * @return  NULL on failure, or a pointer to a null-terminated string containing the CRLF-terminated command on success.
+ * @free_using{free}
  */
-int _sgnt_resolv_dmtp_mail_from(dmtp_session_t *session, const char *origin, size_t msgsize, dmtp_mail_rettype_t rettype, dmtp_mail_datatype_t dtype) {
+char *_sgnt_resolv_dmtp_format_mail_from(const char *origin, size_t msgsize, dmtp_mail_rettype_t rettype, dmtp_mail_datatype_t dtype) {
 
     char *cmd = NULL;
     const char *retstr, *datastr;
-    char *response;
-    unsigned short rcode;
 
-    if (!session || !origin || !msgsize) {
-        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    if (!origin || !msgsize) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
     switch(rettype) {
@@ -691,7 +1713,7 @@ int _sgnt_resolv_dmtp_mail_from(dmtp_session_t *session, const char *origin, siz
         retstr = " RETURN=HEADER";
         break;
     default:
-        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
         break;
     }
 
@@ -707,12 +1729,32 @@ int _sgnt_resolv_dmtp_mail_from(dmtp_session_t *session, const char *origin, siz
         datastr = " DATA=8BIT";
         break;
     default:
-        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
         break;
     }
 
     if (!_str_printf(&cmd, "MAIL FROM: <%s> [%s] SIZE=%lu%s%s\r\n", origin, "fingerprint", msgsize, retstr, datastr)) {
-        RET_ERROR_INT(ERR_NOMEM, "unable to construct MAIL FROM request");
+        RET_ERROR_PTR(ERR_NOMEM, "unable to construct MAIL FROM request");
+    }
+
+    return cmd;
+}
+
+/**
+ * @brief   Issue a MAIL FROM command to the remote DMTP server.
+ */
+int _sgnt_resolv_dmtp_mail_from(dmtp_session_t *session, const char *origin, size_t msgsize, dmtp_mail_rettype_t rettype, dmtp_mail_datatype_t dtype) {
+
+    char *cmd;
+    char *response;
+    unsigned short rcode;
+
+    if (!session || !origin || !msgsize) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(cmd = _sgnt_resolv_dmtp_format_mail_from(origin, msgsize, rettype, dtype))) {
+        RET_ERROR_INT(ERR_UNSPEC, "unable to construct MAIL FROM request");
     }
 
     response = _sgnt_resolv_dmtp_send_and_read(session, cmd, &rcode);
@@ -768,18 +1810,53 @@ int _sgnt_resolv_dmtp_rcpt_to(dmtp_session_t *session, const char *domain) {
 }
 
 /**
- * @brief   Issue an DATA command to the remote DMTP server.
+ * @brief   Extract the bracketed value from one of the two replies to a DATA command.
+ * @note    The server first replies "CONTINUE [commit hash]" when it's ready to receive the message, and then
+ *              "OK [transaction ID]" once it has accepted it.
+ * @param   response    the text of the server's reply following its response code, which will be modified.
+ * @param   status      the status word the reply is expected to begin with: "CONTINUE" or "OK".
+ * @return  NULL on failure, or a pointer to a null-terminated string containing the bracketed value on success.
+ * @free_using{free}
  */
-char *_sgnt_resolv_dmtp_data(dmtp_session_t *session, void *msg, size_t msglen) {
+char *_sgnt_resolv_dmtp_parse_data_reply(char *response, const char *status) {
 
-    char cmd[128];
-    char *response, *token, *tokens, *commit_hash, *result;
-    unsigned short rcode;
+    char *token, *tokens, *result;
 
-    if (!session || !msg || !msglen) {
+    if (!response || !status) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
+    if ((!(token = strtok_r(response, " \t", &tokens))) || (strcasecmp(token, status))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "server DATA response was in unexpected format");
+    }
+
+    // The only following mandatory piece of data is the hash or transaction ID.
+    if ((!(token = strtok_r(NULL, " \t", &tokens))) || (*token != '[') || (token[strlen(token) - 1] != ']')) {
+        RET_ERROR_PTR(ERR_UNSPEC, "server DATA response was in unexpected format");
+    }
+
+    token[strlen(token) - 1] = 0;
+
+    if (!(result = strdup(token + 1))) {
+        PUSH_ERROR_SYSCALL("strdup");
+        RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for value returned by DATA command");
+    }
+
+    return result;
+}
+
+/**
+ * @brief   Issue a DATA command to the remote DMTP server, and wait for it to be ready to receive the message.
+ * @param   session     a pointer to the DMTP session across which the DATA command will be issued.
+ * @return  NULL on failure, or a pointer to a string containing the commit hash returned by the server on success.
+ * @free_using{free}
+ */
+static char *_sgnt_resolv_dmtp_data_begin(dmtp_session_t *session) {
+
+    char cmd[128];
+    char *response, *commit_hash;
+    unsigned short rcode;
+
     memset(cmd, 0, sizeof(cmd));
     snprintf(cmd, sizeof(cmd), "DATA [%s]\r\n", "fingerprint");
 
@@ -792,68 +1869,142 @@ char *_sgnt_resolv_dmtp_data(dmtp_session_t *session, void *msg, size_t msglen)
         return NULL;
     }
 
-    // The first response token should be "CONTINUE".
-    if ((!(token = strtok_r(response, " \t", &tokens))) || (strcasecmp(token, "CONTINUE"))) {
-        free(response);
-        RET_ERROR_PTR(ERR_UNSPEC, "server DATA response was in unexpected format");
-    }
-
-    // The only following mandatory piece of data is the hash.
-    if ((!(token = strtok_r(NULL, " \t", &tokens))) || (*token != '[') || (token[strlen(token) - 1] != ']')) {
-        free(response);
-        RET_ERROR_PTR(ERR_UNSPEC, "server DATA response was in unexpected format");
-    }
+    // The response should be "CONTINUE", followed by the commit hash.
+    commit_hash = _sgnt_resolv_dmtp_parse_data_reply(response, "CONTINUE");
+    free(response);
 
-    token[strlen(token) - 1] = 0;
+    return commit_hash;
+}
 
-    if (!(commit_hash = strdup(token + 1))) {
-        PUSH_ERROR_SYSCALL("strdup");
-        free(response);
-        RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for commit hash of DATA command");
-    }
+/**
+ * @brief   Terminate the message sent after a DATA command, and read the final response of the remote DMTP server.
+ * @param   session     a pointer to the DMTP session across which the message was sent.
+ * @return  NULL on failure, or a pointer to a string containing the transaction ID returned by the server on success.
+ * @free_using{free}
+ */
+static char *_sgnt_resolv_dmtp_data_end(dmtp_session_t *session) {
 
-    free(response);
+    char *response, *result;
+    unsigned short rcode;
 
-    // Write the raw data in our message.
-    if ((_sgnt_resolv_dmtp_write_data(session, msg, msglen) < 0) || (_sgnt_resolv_dmtp_write_data(session, "\r\n", 2) < 0)) {
-        free(commit_hash);
+    if (_sgnt_resolv_dmtp_write_data(session, "\r\n", 2) < 0) {
         RET_ERROR_PTR(ERR_UNSPEC, "unable to write DATA buffer to remote server");
     }
 
     // Now we get the final server response, which is hopefully an "OK" accompanied by a transaction ID.
     if (!(response = _sgnt_resolv_read_dmtp_line(session, NULL, &rcode, 0))) {
-        free(commit_hash);
         RET_ERROR_PTR(ERR_UNSPEC, "DATA command failed on remote server");
     } else if ((rcode < 200) || (rcode >= 300)) {
         PUSH_ERROR_FMT(ERR_UNSPEC, "DATA command returned error: %u: %s", rcode, response);
-        free(commit_hash);
         free(response);
         return NULL;
     }
 
-    // The first response token should be "CONTINUE".
-    if ((!(token = strtok_r(response, " \t", &tokens))) || (strcasecmp(token, "OK"))) {
-        free(commit_hash);
-        free(response);
-        RET_ERROR_PTR(ERR_UNSPEC, "server DATA response continuation was in unexpected format");
+    // The response should be "OK", followed by the transaction ID.
+    result = _sgnt_resolv_dmtp_parse_data_reply(response, "OK");
+    free(response);
+
+    return result;
+}
+
+/**
+ * @brief   Issue an DATA command to the remote DMTP server.
+ * @param   session     a pointer to the DMTP session across which the DATA command will be issued.
+ * @param   msg         a pointer to a buffer holding the entire message to be sent.
+ * @param   msglen      the length, in bytes, of the message to be sent.
+ * @return  NULL on failure, or a pointer to a string containing the transaction ID returned by the server on success.
+ * @free_using{free}
+ */
+char *_sgnt_resolv_dmtp_data(dmtp_session_t *session, void *msg, size_t msglen) {
+
+    struct iovec iov;
+
+    if (!session || !msg || !msglen) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
-    // The only following mandatory piece of data is the hash.
-    if ((!(token = strtok_r(NULL, " \t", &tokens))) || (*token != '[') || (token[strlen(token) - 1] != ']')) {
+    iov.iov_base = msg;
+    iov.iov_len = msglen;
+
+    return _sgnt_resolv_dmtp_datav(session, &iov, 1);
+}
+
+/**
+ * @brief   Issue a DATA command to the remote DMTP server, and send it a message gathered from a list of separate buffers.
+ * @note    This lets a message be sent straight from the buffers that hold its parts, such as the chunks of a DIME message
+ *              described by dime_dmsg_message_binary_iovec(), without first serializing the whole message into one.
+ * @param   session     a pointer to the DMTP session across which the DATA command will be issued.
+ * @param   iov         an array of buffers holding the consecutive parts of the message.
+ * @param   iovcnt      the number of buffers in the iov array.
+ * @return  NULL on failure, or a pointer to a string containing the transaction ID returned by the server on success.
+ * @free_using{free}
+ */
+char *_sgnt_resolv_dmtp_datav(dmtp_session_t *session, const struct iovec *iov, int iovcnt) {
+
+    char *commit_hash, *result;
+
+    if (!session || !iov || (iovcnt <= 0)) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(commit_hash = _sgnt_resolv_dmtp_data_begin(session))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "remote server was not ready to receive message data");
+    }
+
+    // Write the raw data in our message.
+    if (_sgnt_resolv_dmtp_write_datav(session, iov, iovcnt) < 0) {
         free(commit_hash);
-        free(response);
-        RET_ERROR_PTR(ERR_UNSPEC, "server DATA response continuation was in unexpected format");
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to write DATA buffer to remote server");
     }
 
-    token[strlen(token) - 1] = 0;
+    result = _sgnt_resolv_dmtp_data_end(session);
+    free(commit_hash);
 
-    if (!(result = strdup(token + 1))) {
-        PUSH_ERROR_SYSCALL("strdup");
+    return result;
+}
+
+/**
+ * @brief   Issue a DATA command to the remote DMTP server, and stream it a message that is produced piece by piece.
+ * @note    Only DMTP_DATA_CHUNK_SIZE bytes of the message are held in memory at a time, however large it is.
+ *              If the producer fails, the message will have been left unfinished, and the session can't be used again.
+ * @param   session     a pointer to the DMTP session across which the DATA command will be issued.
+ * @param   producer    a callback that fills the buffer it is passed with the next part of the message, and returns the
+ *                          number of bytes it wrote, 0 once the message is complete, or -1 on failure.
+ * @param   state       an opaque pointer that is passed through to the producer.
+ * @return  NULL on failure, or a pointer to a string containing the transaction ID returned by the server on success.
+ * @free_using{free}
+ */
+char *_sgnt_resolv_dmtp_data_stream(dmtp_session_t *session, dmtp_data_producer_t producer, void *state) {
+
+    unsigned char buf[DMTP_DATA_CHUNK_SIZE];
+    char *commit_hash, *result;
+    ssize_t nread;
+
+    if (!session || !producer) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(commit_hash = _sgnt_resolv_dmtp_data_begin(session))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "remote server was not ready to receive message data");
+    }
+
+    while ((nread = producer(state, buf, sizeof(buf))) > 0) {
+
+        if (((size_t)nread > sizeof(buf)) || (_sgnt_resolv_dmtp_write_data(session, buf, nread) < 0)) {
+            session->active = 0;
+            free(commit_hash);
+            RET_ERROR_PTR(ERR_UNSPEC, "unable to write DATA buffer to remote server");
+        }
+
+    }
+
+    if (nread < 0) {
+        session->active = 0;
         free(commit_hash);
-        free(response);
-        RET_ERROR_PTR(ERR_NOMEM, "could not allocate space for transaction ID returned by DATA command");
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to produce message data for DATA command");
     }
 
+    result = _sgnt_resolv_dmtp_data_end(session);
     free(commit_hash);
 
     return result;
@@ -870,65 +2021,167 @@ char *_sgnt_resolv_dmtp_data(dmtp_session_t *session, void *msg, size_t msglen)
  */
 int _sgnt_resolv_dmtp_verify_signet(dmtp_session_t *session, const char *signame, const char *fingerprint, char **newprint) {
 
-    char *response, *request, *status, *tokens, *nfp;
-    size_t reqlen;
-    unsigned short rcode;
+    char *response, *request;
+    unsigned short rcode;
+    int result;
+
+    if (!session || !signame || !fingerprint) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(request = _sgnt_resolv_dmtp_format_query(dmtp_query_vrfy, signame, fingerprint))) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not verify signet because of malformed request");
+    }
+
+    response = _sgnt_resolv_dmtp_send_and_read(session, request, &rcode);
+    free(request);
+
+    // We can get two sorts of failures: a lower-level networking failure, or a response code from the DMTP server that indicates failure.
+    if (!response) {
+        RET_ERROR_INT(ERR_UNSPEC, "signet verification on remote host failed");
+    } else if ((rcode < 200) || (rcode >= 300)) {
+        PUSH_ERROR_FMT(ERR_UNSPEC, "signet verification failed: %s", response);
+        free(response);
+        return -1;
+    }
+
+    result = _sgnt_resolv_dmtp_parse_vrfy_reply(response, newprint);
+    free(response);
+
+    return result;
+}
+
+/**
+ * @brief   Issue a batch of SGNT and VRFY signet queries across a DMTP session, pipelining the commands instead of
+ *              waiting for the reply to each one before sending the next.
+ * @note    Every query has its own status, response code, and result filled in, so the failure of one query doesn't
+ *              affect the others. Malformed queries are never sent. No more than DMTP_PIPELINE_WINDOW queries are left
+ *              awaiting a reply at once, so the server can't end up blocked writing replies that we aren't reading
+ *              while we're blocked writing commands that it isn't.
+ * @param   session     a pointer to the DMTP session across which the queries will be issued.
+ * @param   queries     an array of signet queries to be issued in order. Any results must be freed by the caller.
+ * @param   nqueries    the number of signet queries in the array.
+ * @return  -1 if the session failed before every query was answered, or the number of successful queries otherwise.
+ */
+int _sgnt_resolv_dmtp_query_signets(dmtp_session_t *session, dmtp_signet_query_t *queries, size_t nqueries) {
+
+    dmtp_signet_query_t *query;
+    char *request, *response, *cmds = NULL, *reall_cmds;
+    size_t nsent = 0, nread = 0, pending = 0, cmdlen, cmdsize = 0, reqlen;
+    int overflow, result = 0;
+
+    if (!session || !queries || !nqueries) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    // A query remains marked as failed until a successful reply to it is read.
+    for (size_t i = 0; i < nqueries; i++) {
+        queries[i].status = -1;
+        queries[i].rcode = 0;
+        queries[i].result = NULL;
+    }
+
+    while (nread < nqueries) {
+
+        // Each time half the window has been answered, queue up enough commands to fill it again and write them all at once.
+        if ((nsent < nqueries) && (pending <= (DMTP_PIPELINE_WINDOW / 2))) {
+            cmdlen = 0;
+
+            while ((nsent < nqueries) && (pending < DMTP_PIPELINE_WINDOW)) {
+                query = &(queries[nsent++]);
+
+                if (!(request = _sgnt_resolv_dmtp_format_query(query->type, query->signame, query->fingerprint))) {
+                    fprintf(stderr, "Error: could not issue query for signet: %s\n", (query->signame ? query->signame : "(null)"));
+                    dump_error_stack();
+                    _clear_error_stack();
+                    continue;
+                }
+
+                reqlen = strlen(request);
+
+                if ((cmdlen + reqlen + 1) > cmdsize) {
+
+                    if (!(reall_cmds = realloc(cmds, (cmdlen + reqlen + 1) * 2))) {
+                        PUSH_ERROR_SYSCALL("realloc");
+                        free(request);
+                        free(cmds);
+                        RET_ERROR_INT(ERR_NOMEM, "could not queue signet queries because of memory allocation problem");
+                    }
+
+                    cmds = reall_cmds;
+                    cmdsize = (cmdlen + reqlen + 1) * 2;
+                }
+
+                _dbgprint(5, "DMTP > %s", request);
+                memcpy(&(cmds[cmdlen]), request, reqlen + 1);
+                cmdlen += reqlen;
+                free(request);
+
+                // Queries that are awaiting a reply are the only ones which aren't marked as failed.
+                query->status = 0;
+                pending++;
+            }
+
+            if (cmdlen && (_sgnt_resolv_dmtp_write_data(session, cmds, cmdlen) < 0)) {
+                free(cmds);
+                RET_ERROR_INT(ERR_UNSPEC, "unable to issue pipelined signet queries");
+            }
+
+        }
+
+        // Skip past any queries that were never sent, since there won't be any replies to them.
+        while ((nread < nsent) && (queries[nread].status < 0)) {
+            nread++;
+        }
+
+        if (nread == nsent) {
+            continue;
+        }
+
+        query = &(queries[nread++]);
+        query->status = -1;
+        pending--;
 
-    if (!session || !signame || !fingerprint) {
-        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
-    }
+        // If the session failed, or a reply was too long to be read in full, any replies to follow can't be trusted to line up with their queries.
+        if (!(response = _sgnt_resolv_read_dmtp_line(session, &overflow, &(query->rcode), NULL)) || overflow) {
+            free(response);
+            free(cmds);
 
-    reqlen = strlen(signame) + strlen(fingerprint) + 32;
+            for (size_t i = nread; i < nsent; i++) {
+                queries[i].status = -1;
+            }
 
-    if (!(request = malloc(reqlen))) {
-        PUSH_ERROR_SYSCALL("malloc");
-        RET_ERROR_INT(ERR_UNSPEC, "could not verify signet because of memory allocation error");
-    }
+            RET_ERROR_INT(ERR_UNSPEC, "DMTP session failed while awaiting replies to pipelined signet queries");
+        }
 
-    memset(request, 0, reqlen);
-    snprintf(request, reqlen, "VRFY <%s> [%s]\r\n", signame, fingerprint);
+        // A refusal by the server only fails the query it was in reply to.
+        if ((query->rcode < 200) || (query->rcode >= 300)) {
+            _dbgprint(2, "Signet query for %s was refused: %u %s\n", query->signame, query->rcode, response);
+            free(response);
+            continue;
+        }
 
-    response = _sgnt_resolv_dmtp_send_and_read(session, request, &rcode);
-    free(request);
+        if (query->type == dmtp_query_sgnt) {
+            query->status = (query->result = _sgnt_resolv_dmtp_parse_sgnt_reply(response)) ? 1 : -1;
+        } else {
+            query->status = _sgnt_resolv_dmtp_parse_vrfy_reply(response, &(query->result));
+        }
 
-    // We can get two sorts of failures: a lower-level networking failure, or a response code from the DMTP server that indicates failure.
-    if (!response) {
-        RET_ERROR_INT(ERR_UNSPEC, "signet verification on remote host failed");
-    } else if ((rcode < 200) || (rcode >= 300)) {
-        PUSH_ERROR_FMT(ERR_UNSPEC, "signet verification failed: %s", response);
         free(response);
-        return -1;
-    }
 
-    // The first VRFY response parameter must be either "CURRENT" or "UPDATE"
-    if ((!(status = strtok_r(response, " \t", &tokens)))) {
-        PUSH_ERROR_FMT(ERR_UNSPEC, "VRFY reply was in unexpected format: %s", response);
-        free(response);
-        return -1;
-        // If the specified signet is current then there's really nothing much else to do.
-    } else if (!strcasecmp(status, "CURRENT")) {
-        free(response);
-        return 1;
-    } else if (strcasecmp(status, "UPDATE")) {
-        PUSH_ERROR_FMT(ERR_UNSPEC, "VRFY reply was in unexpected format: %s", response);
-        free(response);
-        return -1;
-    }
+        if (query->status < 0) {
+            fprintf(stderr, "Error: could not process reply to query for signet: %s\n", query->signame);
+            dump_error_stack();
+            _clear_error_stack();
+        } else {
+            result++;
+        }
 
-    // If we're here it's because the named signet needs to be updated. This is the next parameter of the reply.
-    if (!(nfp = strtok_r(NULL, " \t", &tokens))) {
-        free(response);
-        RET_ERROR_INT(ERR_UNSPEC, "VRFY reply returned UPDATE without the corresponding fingerprint");
     }
 
-    if (newprint && (!(*newprint = strdup(nfp)))) {
-        PUSH_ERROR_SYSCALL("strdup");
-        free(response);
-        RET_ERROR_INT(ERR_UNSPEC, "signet verification failed due to memory allocation problem");
-    }
+    free(cmds);
 
-    // Return code for signet that needs updating.
-    return 0;
+    return result;
 }
 
 /**
@@ -1279,47 +2532,160 @@ int _sgnt_resolv_dmtp_quit(dmtp_session_t *session, int do_close) {
 }
 
 /**
- * @brief   Read a CR/LF-terminated line of input from an active DMTP session.
- * @param   session     a pointer to the DMTP session from which the response line will be read.
- * @param   overflow    an optional pointer to a variable that will be set if the read operation
- *                              exceeds the size of the internal line buffer.
- * @param   rcode       an optional pointer to a variable that will receive the numeric response
- *                              code of the DMTP reply that was just received.
- * @param   multiline   an optional parameter that if set will permit multiline DMTP responses. If
- *                              this was the final line of a multiline response, the value will be set to 1
- *                              when the function returns, or 0 if there is more content to follow.
- * @return  NULL on failure or a pointer to a string containing the next line(s) of output from the DMTP server.
+ * @brief   Move the unconsumed input of a DMTP session into a new buffer, so that it starts at the beginning of the buffer.
+ * @param   session     a pointer to the DMTP session whose input buffer is to be replaced.
+ * @param   size        the capacity of the new input buffer, which must be a power of two no smaller than the unconsumed input.
+ * @return  -1 on failure, or 0 on success.
  */
-char *_sgnt_resolv_read_dmtp_line(dmtp_session_t *session, int *overflow, unsigned short *rcode, int *multiline) {
+static int _sgnt_resolv_dmtp_resize_inbuf(dmtp_session_t *session, size_t size) {
 
-    char *result = NULL, *lbreak = NULL, *line;
-    size_t nleft;
-    int nread;
+    unsigned char *buf;
+    size_t first;
 
-    if (!session) {
-        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    // The extra byte lets a line that runs up to the very end of the buffer be null-terminated in place.
+    if (!(buf = malloc(size + 1))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_INT(ERR_NOMEM, "unable to allocate DMTP input buffer");
     }
 
-    // TODO: This needs to be removed or corrected.
-/*  if (!session->active) {
-                RET_ERROR_PTR(ERR_UNSPEC, "cannot read network line from inactive DMTP session");
-        } */
+    // The unconsumed input may wrap around the end of the old buffer.
+    if (session->_inlen) {
+        first = session->_insize - session->_inhead;
+        first = (first < session->_inlen) ? first : session->_inlen;
+        memcpy(buf, &(session->_inbuf[session->_inhead]), first);
+        memcpy(&(buf[first]), session->_inbuf, session->_inlen - first);
+    }
+
+    if (session->_inbuf) {
+        memset(session->_inbuf, 0, session->_insize + 1);
+        free(session->_inbuf);
+    }
+
+    session->_inbuf = buf;
+    session->_insize = size;
+    session->_inhead = 0;
+
+    return 0;
+}
+
+/**
+ * @brief   Read the next CR/LF-terminated line of input from a DMTP session, without copying it out of the input buffer.
+ * @note    Input is only scanned for a line break once, no matter how many reads it takes for the rest of the line to arrive.
+ *              The input buffer doubles in size as needed for long lines, up to DMTP_LINE_MAX_SIZE.
+ *              If the session's socket is non-blocking and a whole line hasn't arrived yet, NULL is returned with _wait
+ *              set to the poll event (POLLIN or POLLOUT) that the session must wait for before the read is retried.
+ * @param   session     a pointer to the DMTP session from which the line will be read.
+ * @param   len         a pointer to a variable that will receive the length of the line, without its CR/LF.
+ * @param   overflow    an optional pointer to a variable that will be set if the line exceeded DMTP_LINE_MAX_SIZE, in
+ *                          which case as much of it as fits in the input buffer is returned instead.
+ * @return  NULL on failure or once the server has closed the session, or a pointer to the null-terminated line inside the
+ *              session's input buffer, which is only valid until the next time input is read from the session.
+ */
+char *_sgnt_resolv_dmtp_next_line(dmtp_session_t *session, size_t *len, int *overflow) {
+
+    unsigned char *lbreak = NULL;
+    size_t mask, pos, tail, room;
+    int nread, err;
+
+    if (overflow) {
+        *overflow = 0;
+    }
+
+    session->_wait = 0;
+
+    if (!session->_inbuf && (_sgnt_resolv_dmtp_resize_inbuf(session, DMTP_LINE_BUF_SIZE) < 0)) {
+        RET_ERROR_PTR(ERR_NOMEM, "unable to read DMTP line without an input buffer");
+    }
+
+    while (1) {
+        mask = session->_insize - 1;
+
+        // Only the input that arrived since the last search needs to be scanned, in at most two contiguous pieces.
+        while (!lbreak && (session->_inscan < session->_inlen)) {
+            pos = (session->_inhead + session->_inscan) & mask;
+            room = session->_inlen - session->_inscan;
+            room = (room < (session->_insize - pos)) ? room : (session->_insize - pos);
+
+            if ((lbreak = memchr(&(session->_inbuf[pos]), '\n', room))) {
+                session->_inscan += (lbreak - &(session->_inbuf[pos]));
+
+                // A bare LF doesn't end the line.
+                if (!session->_inscan || (session->_inbuf[(session->_inhead + session->_inscan - 1) & mask] != '\r')) {
+                    lbreak = NULL;
+                }
+
+                session->_inscan++;
+            } else {
+                session->_inscan += room;
+            }
+
+        }
 
-    // Try to read some more into the buffer until we get enough or an error occurs.
-    nleft = sizeof(session->_inbuf) - session->_inpos - 1;
+        if (lbreak) {
+            *len = session->_inscan - 2;
 
-    // As long as we can read more data and we still don't have a CRLF...
-    while (nleft && (!(lbreak = strstr((char *)session->_inbuf, "\r\n")))) {
+            // A line that wraps around the end of the buffer has to be moved back to the start of it, which can only happen once per lap.
+            if (((session->_inhead + *len) > session->_insize) && (_sgnt_resolv_dmtp_resize_inbuf(session, session->_insize) < 0)) {
+                RET_ERROR_PTR(ERR_NOMEM, "unable to read DMTP line that wrapped around input buffer");
+            }
+
+            lbreak = &(session->_inbuf[session->_inhead]);
+            lbreak[*len] = 0;
+
+            // The line is consumed right away, but its bytes won't be overwritten until more input is read.
+            session->_inhead = (session->_inhead + session->_inscan) & mask;
+            session->_inlen -= session->_inscan;
+            session->_inscan = 0;
+
+            if (!session->_inlen) {
+                session->_inhead = 0;
+            }
+
+            return (char *)lbreak;
+        }
+
+        // If the buffer is full without a line break, double its size, unless the line is already as long as we'll allow.
+        if ((session->_inlen == session->_insize) && (session->_insize < DMTP_LINE_MAX_SIZE)) {
+
+            if (_sgnt_resolv_dmtp_resize_inbuf(session, session->_insize * 2) < 0) {
+                RET_ERROR_PTR(ERR_NOMEM, "unable to grow DMTP input buffer");
+            }
+
+            continue;
+        } else if (session->_inlen == session->_insize) {
+
+            if (overflow) {
+                *overflow = 1;
+            }
+
+            break;
+        }
+
+        // Read into the free space that follows the unconsumed input, up to the end of the buffer.
+        tail = (session->_inhead + session->_inlen) & mask;
+        room = (tail >= session->_inhead) ? (session->_insize - tail) : (session->_inhead - tail);
 
         // Determine whether we're reading from a vanilla socket or an SSL connection.
         if (session->con) {
-            nread = SSL_read_d(session->con, &(session->_inbuf[session->_inpos]), nleft);
+            nread = SSL_read_d(session->con, &(session->_inbuf[tail]), room);
         } else {
-            nread = recv(session->_fd, &(session->_inbuf[session->_inpos]), nleft, 0);
+            nread = recv(session->_fd, &(session->_inbuf[tail]), room, 0);
         }
 
         if (nread <= 0) {
 
+            // A non-blocking session that simply has nothing more to read yet is left open, so the read can be retried.
+            if (session->con) {
+                err = SSL_get_error_d(session->con, nread);
+                session->_wait = (err == SSL_ERROR_WANT_READ) ? POLLIN : ((err == SSL_ERROR_WANT_WRITE) ? POLLOUT : 0);
+            } else if ((nread < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+                session->_wait = POLLIN;
+            }
+
+            if (session->_wait) {
+                return NULL;
+            }
+
             if (session->mode == dmtp_mode_dmtp) {
 
                 if (nread < 0) {
@@ -1342,87 +2708,71 @@ char *_sgnt_resolv_read_dmtp_line(dmtp_session_t *session, int *overflow, unsign
             session->active = 0;
 
             // If there's something in the buffer, return it.
-            if (session->_inpos) {
-
-                if (!(result = strdup((char *)session->_inbuf))) {
-                    perror("strdup");
-                }
-
-            } else {
-                result = NULL;
-            }
-
-            memset(session->_inbuf, 0, sizeof(session->_inbuf));
-            session->_inpos = 0;
-
-            if (overflow) {
-                *overflow = 0;
+            if (!session->_inlen) {
+                return NULL;
             }
 
             break;
         }
 
-        // We did get some data. But is it enough for a full line?
-        //
         // This should never happen but you can never be too safe.
-        if ((size_t)nread > nleft) {
+        if ((size_t)nread > room) {
             RET_ERROR_PTR(ERR_UNSPEC, "unexpected error occurred in SSL line read operation");
         }
 
-        session->_inpos += nread;
-        nleft -= nread;
+        session->_inlen += nread;
     }
 
-    // There's a good chance that we're here before we got our CRLF
-    // If we got what we were looking for:
-    if (lbreak) {
-        *lbreak++ = 0;
-        *lbreak++ = 0;
-        result = strdup((char *)session->_inbuf);
+    // Otherwise, we can only return what we have.
+    if (session->_inhead && (_sgnt_resolv_dmtp_resize_inbuf(session, session->_insize) < 0)) {
+        RET_ERROR_PTR(ERR_NOMEM, "unable to read partial DMTP line");
+    }
 
-        // Move the remainder of the buffer to the front of the buffer.
-        nleft = (unsigned long)&(session->_inbuf[sizeof(session->_inbuf)]) - (unsigned long)lbreak;
-        memmove(session->_inbuf, lbreak, nleft);
-        // Zero out the trailing buffer.
-        memset(&(session->_inbuf[nleft]), 0, sizeof(session->_inbuf) - nleft);
-        // Reset the buffer pointer.
-        session->_inpos -= (unsigned long)lbreak - (unsigned long)session->_inbuf;
+    *len = session->_inlen;
+    session->_inbuf[*len] = 0;
+    session->_inlen = session->_inscan = 0;
 
-        if (overflow) {
-            *overflow = 0;
-        }
+    return (char *)session->_inbuf;
+}
 
-        // Otherwise, we can only return what we have.
-    } else if (session->_inpos) {
-        // Simple strdup() because our buffer has an extra character that is always = \x00.
-        result = strdup((char *)session->_inbuf);
-        memset(session->_inbuf, 0, sizeof(session->_inbuf));
-        session->_inpos = 0;
+/**
+ * @brief   Read a CR/LF-terminated line of input from an active DMTP session.
+ * @param   session     a pointer to the DMTP session from which the response line will be read.
+ * @param   overflow    an optional pointer to a variable that will be set if the read operation
+ *                              exceeds the maximum size of the internal line buffer.
+ * @param   rcode       an optional pointer to a variable that will receive the numeric response
+ *                              code of the DMTP reply that was just received.
+ * @param   multiline   an optional parameter that if set will permit multiline DMTP responses. If
+ *                              this was the final line of a multiline response, the value will be set to 1
+ *                              when the function returns, or 0 if there is more content to follow.
+ * @return  NULL on failure or a pointer to a string containing the next line(s) of output from the DMTP server.
+ */
+char *_sgnt_resolv_read_dmtp_line(dmtp_session_t *session, int *overflow, unsigned short *rcode, int *multiline) {
 
-        if (overflow) {
-            *overflow = 1;
-        }
+    char *result, *line;
+    size_t len;
 
+    if (!session) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
-    if (!result && (lbreak || session->_inpos)) {
-        PUSH_ERROR_SYSCALL("strdup");
-        // If the caller requested line code parsing, perform this operation and free the original result.
-    } else if (rcode) {
+    // TODO: This needs to be removed or corrected.
+/*  if (!session->active) {
+                RET_ERROR_PTR(ERR_UNSPEC, "cannot read network line from inactive DMTP session");
+        } */
 
-        if (!(line = _sgnt_resolv_parse_line_code(result, rcode, multiline))) {
-            free(result);
-            RET_ERROR_PTR(ERR_UNSPEC, "could not parse DMTP line response code");
-        }
+    if (!(line = _sgnt_resolv_dmtp_next_line(session, &len, overflow))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to read line from DMTP server");
+    }
 
-        if (!(line = strdup(line))) {
-            PUSH_ERROR_SYSCALL("strdup");
-            free(result);
-            RET_ERROR_PTR(ERR_NOMEM, "unable to allocate temporary buffer for response");
-        }
+    // If the caller requested line code parsing, only the text that follows the code is copied out of the input buffer.
+    if (rcode && !(line = _sgnt_resolv_parse_line_code(line, rcode, multiline))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "could not parse DMTP line response code");
+    }
 
-        free(result);
-        result = line;
+    if (!(result = strdup(line))) {
+        PUSH_ERROR_SYSCALL("strdup");
+        RET_ERROR_PTR(ERR_NOMEM, "unable to allocate temporary buffer for response");
     }
 
     _dbgprint(5, "DMTP < %s\n", result);
@@ -1436,69 +2786,65 @@ char *_sgnt_resolv_read_dmtp_line(dmtp_session_t *session, int *overflow, unsign
  *              respones text. A regular response, or the final line of a multiline response will instead have a space.
  * @param   session     a pointer to the DMTP session from which the response line(s) will be read.
  * @param   overflow    an optional pointer to a variable that will be set if the read operation
- *                              exceeds the size of the internal line buffer.
+ *                              exceeds the maximum size of the internal line buffer.
  * @param   rcode       an optional pointer to a variable that will receive the numeric response
  *                              code of the DMTP reply that was just received.
  * @return  NULL on failure or a pointer to a string containing the next response from the DMTP server on success.
  */
 char *_sgnt_resolv_read_dmtp_multiline(dmtp_session_t *session, int *overflow, unsigned short *rcode) {
 
-    char *line, *result = NULL, *reall_res = NULL;
-    unsigned short rc, firstrc = 0;
-    int of, ml, first = 1;
-    size_t rsize = 1;
+    char *line, *text, *result = NULL, *reall_res = NULL;
+    unsigned short rc = 0, firstrc = 0;
+    int of = 0, ml = 0, first = 1;
+    size_t len, rlen = 0, rsize = 0;
 
     if (!session) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
-    while ((line = _sgnt_resolv_read_dmtp_line(session, &of, &rc, &ml))) {
+    // Each line is parsed where it sits in the input buffer, and appended to the result without rescanning what came before it.
+    while (!ml && (line = _sgnt_resolv_dmtp_next_line(session, &len, &of))) {
+
+        if (!(text = _sgnt_resolv_parse_line_code(line, &rc, &ml))) {
+            free(result);
+            RET_ERROR_PTR(ERR_UNSPEC, "could not parse DMTP line response code");
+        }
+
+        _dbgprint(5, "DMTP < %s\n", text);
 
         // This shouldn't happen, but we need to make sure that all the response codes were of the same sequence.
         if (!first && (firstrc != rc)) {
-            free(line);
             free(result);
             RET_ERROR_PTR(ERR_BAD_PARAM, "multiline DMTP response returned unexpected response code");
         }
 
-        // The result needs to have the new line followed by \n appended to it (if it is not the last line).
-        rsize += strlen(line) + 1;
+        first = 0;
+        firstrc = rc;
+        len -= (text - line);
 
-        if (!(reall_res = realloc(result, rsize))) {
-            PUSH_ERROR_SYSCALL("realloc");
+        // The result needs room for the new line followed by \n (if it is not the last line), and a terminating null.
+        if ((rlen + len + 2) > rsize) {
+            rsize = (rlen + len + 2) * 2;
 
-            if(result) {
+            if (!(reall_res = realloc(result, rsize))) {
+                PUSH_ERROR_SYSCALL("realloc");
                 free(result);
+                RET_ERROR_PTR(ERR_NOMEM, "could not read multiline DMTP response because of memory allocation problem");
             }
 
-            free(line);
-            RET_ERROR_PTR(ERR_NOMEM, "could not read multiline DMTP response because of memory allocation problem");
-        }
-
-        result = reall_res;
-        reall_res = NULL;
-
-        // We need to make sure our result buffer is null-terminated at least the first time it's allocated.
-        if (first) {
-            memset(result, 0, rsize);
-            first = 0;
-            firstrc = rc;
+            result = reall_res;
+            reall_res = NULL;
         }
 
-        strcat(result, line);
+        memcpy(&(result[rlen]), text, len);
+        rlen += len;
 
         // No new-line terminator if it's the last line.
         if (!ml) {
-            strcat(result, "\n");
-        }
-
-        free(line);
-
-        // If the multiline variable was set to non-zero, then this is the last line of the series.
-        if (ml) {
-            break;
+            result[rlen++] = '\n';
         }
 
+        result[rlen] = 0;
     }
 
     // These value should be set for the caller.
@@ -1617,7 +2963,7 @@ dmtp_mode_t _sgnt_resolv_dmtp_initiate_starttls(dmtp_session_t *session, const c
 
     free(response);
 
-    if (!(session->con = _ssl_starttls(session->_fd))) {
+    if (!(session->con = _ssl_starttls(session->_fd, dxname))) {
         RET_ERROR_CUST(dmtp_mode_unknown, ERR_UNSPEC, "TLS negotiation in DMTP session failed");
     }
 
@@ -1667,9 +3013,9 @@ dmtp_mode_t _sgnt_resolv_dmtp_initiate_starttls(dmtp_session_t *session, const c
  */
 int _sgnt_resolv_dmtp_expect_banner(dmtp_session_t *session) {
 
-    char *banner, *token, *tokens;
+    char *banner;
     unsigned short bcode;
-    int result = -1;
+    int result;
 
     if (!session) {
         RET_ERROR_INT(ERR_BAD_PARAM, NULL);
@@ -1686,9 +3032,27 @@ int _sgnt_resolv_dmtp_expect_banner(dmtp_session_t *session) {
         RET_ERROR_INT(ERR_UNSPEC, "DMTP banner had bad status code");
     }
 
+    result = _sgnt_resolv_dmtp_parse_banner(banner);
+    free(banner);
+
+    return result;
+}
+
+/**
+ * @brief   Check whether the text of a DMTP server banner advertises DMTPv1 compatibility.
+ * @param   banner      the text of the banner following its response code, which will be modified.
+ * @return  -1 on failure or 0 if the banner advertised DMTPv1 compatibility.
+ */
+int _sgnt_resolv_dmtp_parse_banner(char *banner) {
+
+    char *token, *tokens;
+
+    if (!banner) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
     // Skip the first token, which sould be the server hostname.
     if (!(token = strtok_r(banner, " \t", &tokens))) {
-        free(banner);
         RET_ERROR_INT(ERR_UNSPEC, "DMTP banner contained unexpected format");
     }
 
@@ -1696,15 +3060,12 @@ int _sgnt_resolv_dmtp_expect_banner(dmtp_session_t *session) {
     while ((token = strtok_r(NULL, " \t", &tokens))) {
 
         if (!strcmp(token, "DMTPv1")) {
-            result = 0;
-            break;
+            return 0;
         }
 
     }
 
-    free(banner);
-
-    return result;
+    return -1;
 }
 
 /**
@@ -1817,6 +3178,7 @@ int _sgnt_resolv_dmtp_write_data(dmtp_session_t *session, const void *buf, size_
             RET_ERROR_INT(ERR_UNSPEC, "could not write data; session was ain a bad state");
         }
 
+        dataptr += nwritten;
         buflen -= nwritten;
     }
 
@@ -1824,3 +3186,132 @@ int _sgnt_resolv_dmtp_write_data(dmtp_session_t *session, const void *buf, size_
 
     return 0;
 }
+
+/**
+ * @brief   Write a list of raw data buffers, in order, to the remote end of a DMTP session.
+ * @note    Over a plain connection the buffers are handed to the kernel together, with as few system calls as possible.
+ *              Over TLS, buffers smaller than DMTP_DATA_CHUNK_SIZE are gathered into full-sized writes, so that they are not
+ *              each sent in a TLS record of their own.
+ * @param   session     a pointer to the DMTP session to which the data will be written.
+ * @param   iov     an array of buffers holding the raw data to be written. Empty buffers are skipped.
+ * @param   iovcnt      the number of buffers in the iov array.
+ * @return  0 if all requested bytes were written successfully to the connection, or -1 on failure.
+ */
+int _sgnt_resolv_dmtp_write_datav(dmtp_session_t *session, const struct iovec *iov, int iovcnt) {
+
+    unsigned char gather[DMTP_DATA_CHUNK_SIZE];
+    struct iovec *pending;
+    struct msghdr msg;
+    size_t gathered = 0, total = 0;
+    ssize_t nwritten;
+    int first = 0;
+
+    if (!session || !iov || (iovcnt <= 0)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    for (int i = 0; i < iovcnt; i++) {
+
+        if (iov[i].iov_len && !iov[i].iov_base) {
+            RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+        }
+
+        total += iov[i].iov_len;
+    }
+
+    _dbgprint(5, "Attempting to write %zu bytes of data in %d buffers to server...\n", total, iovcnt);
+
+    if (session->con) {
+
+        for (int i = 0; i < iovcnt; i++) {
+
+            // Large buffers are written as they are, after whatever has been gathered in front of them.
+            if (iov[i].iov_len >= sizeof(gather)) {
+
+                if ((gathered && (_sgnt_resolv_dmtp_write_data(session, gather, gathered) < 0)) ||
+                    (_sgnt_resolv_dmtp_write_data(session, iov[i].iov_base, iov[i].iov_len) < 0)) {
+                    RET_ERROR_INT(ERR_UNSPEC, "could not write all data in buffers to remote server");
+                }
+
+                gathered = 0;
+                continue;
+            }
+
+            if ((gathered + iov[i].iov_len) > sizeof(gather)) {
+
+                if (_sgnt_resolv_dmtp_write_data(session, gather, gathered) < 0) {
+                    RET_ERROR_INT(ERR_UNSPEC, "could not write all data in buffers to remote server");
+                }
+
+                gathered = 0;
+            }
+
+            if (iov[i].iov_len) {
+                memcpy(gather + gathered, iov[i].iov_base, iov[i].iov_len);
+                gathered += iov[i].iov_len;
+            }
+
+        }
+
+        if (gathered && (_sgnt_resolv_dmtp_write_data(session, gather, gathered) < 0)) {
+            RET_ERROR_INT(ERR_UNSPEC, "could not write all data in buffers to remote server");
+        }
+
+    } else if (session->_fd >= 0) {
+
+        // The buffer list is copied so that we can advance through it as the kernel accepts partial writes.
+        if (!(pending = malloc(iovcnt * sizeof(*pending)))) {
+            PUSH_ERROR_SYSCALL("malloc");
+            RET_ERROR_INT(ERR_NOMEM, "could not allocate space for data buffer list");
+        }
+
+        memcpy(pending, iov, iovcnt * sizeof(*pending));
+
+        while (total) {
+
+            while (!pending[first].iov_len) {
+                first++;
+            }
+
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &(pending[first]);
+            msg.msg_iovlen = ((iovcnt - first) > DMTP_DATA_MAX_IOV) ? DMTP_DATA_MAX_IOV : (iovcnt - first);
+
+            if ((nwritten = sendmsg(session->_fd, &msg, 0)) <= 0) {
+
+                if (nwritten < 0) {
+                    PUSH_ERROR_SYSCALL("sendmsg");
+                }
+
+                free(pending);
+                RET_ERROR_INT(ERR_UNSPEC, "could not write all data in buffers to remote server");
+            }
+
+            total -= nwritten;
+
+            // Skip past every buffer that was written out completely, and into the one that was written in part.
+            while (nwritten) {
+
+                if ((size_t)nwritten >= pending[first].iov_len) {
+                    nwritten -= pending[first].iov_len;
+                    pending[first].iov_len = 0;
+                    first++;
+                } else {
+                    pending[first].iov_base = (unsigned char *)pending[first].iov_base + nwritten;
+                    pending[first].iov_len -= nwritten;
+                    nwritten = 0;
+                }
+
+            }
+
+        }
+
+        free(pending);
+    } else {
+        RET_ERROR_INT(ERR_UNSPEC, "could not write data; session was in a bad state");
+    }
+
+    _dbgprint(5, "Finished writing data to server.\n");
+
+    return 0;
+}
@@ -1,6 +1,10 @@
 #ifndef DMTP_H
 #define DMTP_H
 
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+
 #include "dime/signet/signet.h"
 #include "dime/signet-resolver/mrec.h"
 #include "dime/common/error.h"
@@ -14,7 +18,21 @@
 
 #define DMTP_MAX_MX_RETRIES 3
 
-#define DMTP_LINE_BUF_SIZE 4096
+#define DMTP_LINE_BUF_SIZE 4096                 ///< The initial size of a session's input buffer, which doubles as longer lines arrive.
+#define DMTP_LINE_MAX_SIZE (16 * 1024 * 1024)   ///< The size the input buffer never grows past, so no single line can be longer.
+
+#define DMTP_POOL_MAX_PER_HOST   4      ///< The maximum number of idle sessions kept in the session pool for any one DX server.
+#define DMTP_POOL_MAX_SESSIONS   64     ///< The maximum number of idle sessions kept in the session pool overall.
+#define DMTP_POOL_IDLE_TIMEOUT   120    ///< The number of seconds an idle pooled session is kept before it is closed.
+#define DMTP_POOL_PROBE_INTERVAL 15     ///< The number of seconds a pooled session may sit idle before it must pass a NOOP check to be reused.
+#define DMTP_POOL_MAX_AGE        600    ///< The number of seconds after which a session is no longer reused, bounding the age of its DIME record.
+
+#define DMTP_PIPELINE_WINDOW     64     ///< The maximum number of pipelined signet queries that may be awaiting a reply at once.
+
+#define DMTP_BATCH_MAX_WORKERS   8      ///< The maximum number of dark domains whose signets are resolved concurrently in a batch lookup.
+
+#define DMTP_DATA_CHUNK_SIZE     16384  ///< The size of the pieces a streamed DATA message is produced and written in, and the most of it held in memory at once.
+#define DMTP_DATA_MAX_IOV        1024   ///< The maximum number of buffers handed to the kernel in one write of a gathered DATA message (the Linux IOV_MAX).
 
 
 typedef enum {
@@ -26,7 +44,14 @@ typedef enum {
 } dmtp_mode_t;
 
 
-typedef struct {
+/**
+ * A callback supplying the next part of a message streamed with sgnt_resolv_dmtp_data_stream(), by writing up to buflen bytes
+ * into buf. It returns the number of bytes written, 0 once the whole message has been produced, or -1 on failure.
+ */
+typedef ssize_t (*dmtp_data_producer_t)(void *state, void *buf, size_t buflen);
+
+
+typedef struct dmtp_session {
     char *domain;           ///< The name of the dark domain underlying the DMTP connection.
     char *dx;               ///< The canonical name of the DX that we're connected to.
     SSL *con;               ///< The handle to this DMTP session's underlying SSL connection.
@@ -35,8 +60,18 @@ typedef struct {
     unsigned int active;    ///< Boolean flag: whether or not this session is active.
 
     int _fd;
-    unsigned char _inbuf[DMTP_LINE_BUF_SIZE + 1];
-    size_t _inpos;
+    unsigned char *_inbuf;          ///< A ring buffer of input that has been received but not consumed, with room for a trailing null.
+    size_t _insize;                 ///< The capacity of the input buffer (always a power of two).
+    size_t _inhead;                 ///< The offset of the first unconsumed byte in the input buffer.
+    size_t _inlen;                  ///< The number of unconsumed bytes in the input buffer.
+    size_t _inscan;                 ///< The number of unconsumed bytes that have already been searched for a line break.
+    int _wait;                      ///< The poll event a non-blocking session must wait for before its last unfinished read is retried, or 0.
+
+    int _family;                    ///< The address family the session was requested with, which pooled sessions are matched on.
+    time_t _established;            ///< The time the DX certificate of the session was verified, or 0 if it never was.
+    time_t _idle_since;             ///< The time the session was last returned to the session pool.
+    time_t _checked;                ///< The time the session last passed a NOOP check, or was returned to the session pool.
+    struct dmtp_session *_next;     ///< The next idle session in the session pool.
 } dmtp_session_t;
 
 
@@ -53,9 +88,32 @@ typedef enum {
     data_type_8bit = 2
 } dmtp_mail_datatype_t;
 
+typedef enum {
+    dmtp_query_sgnt = 1,
+    dmtp_query_vrfy = 2
+} dmtp_query_type_t;
+
+
+typedef struct {
+    dmtp_query_type_t type;     ///< The command to be issued: SGNT to retrieve a signet, or VRFY to check whether a fingerprint is current.
+    const char *signame;        ///< The name of the user or organizational signet being queried.
+    const char *fingerprint;    ///< The signet fingerprint to be matched (optional for SGNT) or verified (mandatory for VRFY).
+
+    int status;                 ///< -1 if the query failed; otherwise 1 for a retrieved or current signet, or 0 for an out of date one.
+    unsigned short rcode;       ///< The response code of the server's reply to the query, or 0 if it was never answered.
+    char *result;               ///< The retrieved signet for SGNT, or the latest fingerprint of an out of date signet for VRFY.
+} dmtp_signet_query_t;
+
+
+typedef struct {
+    signet_t *signet;           ///< The resolved signet, or NULL if it could not be resolved.
+    errinfo_t error;            ///< The error that caused the signet resolution to fail, which has an error code of 0 on success.
+} signet_lookup_t;
+
 
 // High-level interfaces built on DMTP.
 PUBLIC_FUNC_DECL(signet_t *,       get_signet,            const char *name, const char *fingerprint, int use_cache);
+PUBLIC_FUNC_DECL(size_t,           get_signets,           const char **names, const char **fingerprints, size_t nnames, int use_cache, signet_lookup_t *results);
 
 // General session control routines.
 PUBLIC_FUNC_DECL(dmtp_session_t *, sgnt_resolv_dmtp_connect,          const char *domain, int force_family);
@@ -64,15 +122,24 @@ PUBLIC_FUNC_DECL(dmtp_session_t *, dx_connect_standard,   const char *host, cons
 PUBLIC_FUNC_DECL(dmtp_session_t *, dx_connect_dual,       const char *host, const char *domain, int force_family, dime_record_t *dimerec, int failover);
 PUBLIC_FUNC_DECL(int,              verify_dx_certificate, dmtp_session_t *session);
 
+// Session pool.
+PUBLIC_FUNC_DECL(dmtp_session_t *, sgnt_resolv_dmtp_pool_acquire,     const char *domain, int force_family);
+PUBLIC_FUNC_DECL(void,             sgnt_resolv_dmtp_pool_release,     dmtp_session_t *session, int reusable);
+PUBLIC_FUNC_DECL(size_t,           sgnt_resolv_dmtp_pool_maintain,    time_t now);
+PUBLIC_FUNC_DECL(void,             sgnt_resolv_dmtp_pool_flush,       void);
+
 // Message flow.
 PUBLIC_FUNC_DECL(int,              sgnt_resolv_dmtp_ehlo,             dmtp_session_t *session, const char *domain);
 PUBLIC_FUNC_DECL(int,              sgnt_resolv_dmtp_mail_from,        dmtp_session_t *session, const char *origin, size_t msgsize, dmtp_mail_rettype_t rettype, dmtp_mail_datatype_t dtype);
 PUBLIC_FUNC_DECL(int,              sgnt_resolv_dmtp_rcpt_to,          dmtp_session_t *session, const char *domain);
 PUBLIC_FUNC_DECL(char *,           sgnt_resolv_dmtp_data,             dmtp_session_t *session, void *msg, size_t msglen);
+PUBLIC_FUNC_DECL(char *,           sgnt_resolv_dmtp_datav,            dmtp_session_t *session, const struct iovec *iov, int iovcnt);
+PUBLIC_FUNC_DECL(char *,           sgnt_resolv_dmtp_data_stream,      dmtp_session_t *session, dmtp_data_producer_t producer, void *state);
 
 // DMTP-protocol specific client commands.
 PUBLIC_FUNC_DECL(char *,           sgnt_resolv_dmtp_get_signet,       dmtp_session_t *session, const char *signame, const char *fingerprint);
 PUBLIC_FUNC_DECL(int,              sgnt_resolv_dmtp_verify_signet,    dmtp_session_t *session, const char *signame, const char *fingerprint, char **newprint);
+PUBLIC_FUNC_DECL(int,              sgnt_resolv_dmtp_query_signets,    dmtp_session_t *session, dmtp_signet_query_t *queries, size_t nqueries);
 PUBLIC_FUNC_DECL(char *,           sgnt_resolv_dmtp_history,          dmtp_session_t *session, const char *signame, const char *startfp, const char *endfp);
 PUBLIC_FUNC_DECL(char *,           sgnt_resolv_dmtp_stats,            dmtp_session_t *session, const unsigned char *secret);
 
@@ -86,14 +153,24 @@ PUBLIC_FUNC_DECL(int,              sgnt_resolv_dmtp_quit,             dmtp_sessi
 
 
 // Internal network and parsing functions.
+char *      _sgnt_resolv_dmtp_next_line(dmtp_session_t *session, size_t *len, int *overflow);
 char *      _sgnt_resolv_read_dmtp_line(dmtp_session_t *session, int *overflow, unsigned short *rcode, int *multiline);
 char *      _sgnt_resolv_read_dmtp_multiline(dmtp_session_t *session, int *overflow, unsigned short *rcode);
 char *      _sgnt_resolv_parse_line_code(const char *line, unsigned short *rcode, int *multiline);
 dmtp_mode_t _sgnt_resolv_dmtp_str_to_mode(const char *modestr);
 dmtp_mode_t _sgnt_resolv_dmtp_initiate_starttls(dmtp_session_t *session, const char *dxname);
 int         _sgnt_resolv_dmtp_expect_banner(dmtp_session_t *session);
+int         _sgnt_resolv_dmtp_parse_banner(char *banner);
 int         _sgnt_resolv_dmtp_issue_command(dmtp_session_t *session, const char *cmd);
 char *      _sgnt_resolv_dmtp_send_and_read(dmtp_session_t *session, const char *cmd, unsigned short *rcode);
 int         _sgnt_resolv_dmtp_write_data(dmtp_session_t *session, const void *buf, size_t buflen);
+int         _sgnt_resolv_dmtp_write_datav(dmtp_session_t *session, const struct iovec *iov, int iovcnt);
+char *      _sgnt_resolv_dmtp_format_query(dmtp_query_type_t type, const char *signame, const char *fingerprint);
+char *      _sgnt_resolv_dmtp_parse_sgnt_reply(char *response);
+int         _sgnt_resolv_dmtp_parse_vrfy_reply(char *response, char **newprint);
+char *      _sgnt_resolv_dmtp_format_mail_from(const char *origin, size_t msgsize, dmtp_mail_rettype_t rettype, dmtp_mail_datatype_t dtype);
+char *      _sgnt_resolv_dmtp_parse_data_reply(char *response, const char *status);
+dmtp_session_t *_sgnt_resolv_dmtp_pool_take(const char *domain, int force_family);
+int         _sgnt_resolv_dmtp_session_idle(dmtp_session_t *session);
 
 #endif
@@ -0,0 +1,1094 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+
+#include "dime/signet-resolver/dmtp_async.h"
+#include "dime/signet-resolver/cache.h"
+
+#include "dime/common/misc.h"
+#include "dime/common/error.h"
+
+#include "providers/symbols.h"
+
+
+/**
+ * An asynchronous DMTP session, carrying out a single request. The session's input is read through an ordinary DMTP
+ * session structure, so that replies are buffered and parsed exactly as they are for blocking sessions.
+ */
+typedef struct dmtp_async {
+    dmtp_async_request_t *request;  ///< The request being carried out.
+    dmtp_async_cb_t callback;       ///< The callback to be invoked once the request has finished.
+    void *arg;                      ///< The opaque argument to be passed to the callback.
+    dmtp_session_t *session;        ///< The underlying DMTP session, which owns the socket and any TLS connection over it.
+    int fd;                         ///< The socket of the session, which stays registered with epoll even once TLS takes it over.
+    short events;                   ///< The poll events the socket is currently registered for.
+    short want;                     ///< The poll events the session has to wait for before it can make any more progress.
+    int resumed;                    ///< Whether a cached TLS session was offered to the server.
+    int status;                     ///< The status to be passed to the callback if the request succeeds.
+
+    char *out;                      ///< Output that has been queued for the server.
+    size_t outsize;                 ///< The capacity of the output buffer.
+    size_t outlen;                  ///< The number of bytes of queued output.
+    size_t outpos;                  ///< The number of bytes of queued output that have already been written.
+
+    int msgidx;                     ///< The index of the message buffer from which the message is to be queued next.
+    size_t msgoff;                  ///< The offset into that message buffer.
+    int msgdone;                    ///< Whether the whole message and its CR/LF terminator have been queued.
+    size_t nreplied;                ///< The number of signet queries that have been answered or skipped.
+
+    time_t deadline;                ///< The time after which the session has waited on its server for too long.
+    struct dmtp_async *prev;        ///< The previous pending session, which times out no later than this one.
+    struct dmtp_async *next;        ///< The next pending session, which times out no earlier than this one.
+} dmtp_async_t;
+
+struct dmtp_async_loop {
+    int epfd;                       ///< The epoll instance that the sockets of the pending sessions are registered with.
+    unsigned int timeout;           ///< The number of seconds a session may wait on its server before it fails.
+    size_t pending;                 ///< The number of sessions that haven't finished yet.
+    dmtp_async_t *head;             ///< The pending session that will time out first.
+    dmtp_async_t *tail;             ///< The pending session that will time out last.
+};
+
+
+static const char *_dmtp_async_state_name(dmtp_async_state_t state) {
+
+    switch (state) {
+
+    case dmtp_async_connect:
+        return "connecting";
+    case dmtp_async_handshake:
+        return "negotiating TLS";
+    case dmtp_async_banner:
+        return "awaiting banner";
+    case dmtp_async_starttls:
+    case dmtp_async_starttls_mode:
+        return "issuing STARTTLS";
+    case dmtp_async_ehlo:
+        return "issuing EHLO";
+    case dmtp_async_mail_from:
+        return "issuing MAIL FROM";
+    case dmtp_async_rcpt_to:
+        return "issuing RCPT TO";
+    case dmtp_async_data:
+        return "issuing DATA";
+    case dmtp_async_message:
+        return "sending message";
+    case dmtp_async_queries:
+        return "issuing signet queries";
+    case dmtp_async_quit:
+        return "issuing QUIT";
+    case dmtp_async_done:
+        return "done";
+    default:
+        break;
+
+    }
+
+    return "in unknown state";
+}
+
+/**
+ * @brief   Unlink a session from the list of pending sessions of an event loop.
+ * @param   loop    a pointer to the event loop running the session.
+ * @param   async   a pointer to the session to be unlinked.
+ */
+static void _dmtp_async_unlink(dmtp_async_loop_t *loop, dmtp_async_t *async) {
+
+    if (async->prev) {
+        async->prev->next = async->next;
+    } else {
+        loop->head = async->next;
+    }
+
+    if (async->next) {
+        async->next->prev = async->prev;
+    } else {
+        loop->tail = async->prev;
+    }
+
+    async->prev = async->next = NULL;
+}
+
+/**
+ * @brief   Restart the timeout of a session that has heard from its server, and move it to the end of the pending list.
+ * @note    Since every session waits for the same length of time, this keeps the pending list ordered by deadline.
+ * @param   loop    a pointer to the event loop running the session.
+ * @param   async   a pointer to the session to have its timeout restarted.
+ * @param   linked  whether the session is already in the pending list.
+ */
+static void _dmtp_async_touch(dmtp_async_loop_t *loop, dmtp_async_t *async, int linked) {
+
+    async->deadline = time(NULL) + loop->timeout;
+
+    if (linked) {
+
+        if (loop->tail == async) {
+            return;
+        }
+
+        _dmtp_async_unlink(loop, async);
+    }
+
+    async->prev = loop->tail;
+
+    if (loop->tail) {
+        loop->tail->next = async;
+    } else {
+        loop->head = async;
+    }
+
+    loop->tail = async;
+}
+
+/**
+ * @brief   Free a session, along with its connection to the server.
+ * @param   async   a pointer to the session to be freed.
+ */
+static void _dmtp_async_free(dmtp_async_t *async) {
+
+    if (async->session) {
+        _sgnt_resolv_destroy_dmtp_session(async->session);
+    }
+
+    free(async->out);
+    free(async);
+
+}
+
+/**
+ * @brief   Queue output to be written to the server of a session.
+ * @param   async   a pointer to the session that will write the output.
+ * @param   data    a pointer to the data to be queued.
+ * @param   len     the number of bytes of data to be queued.
+ * @return  -1 on failure or 0 on success.
+ */
+static int _dmtp_async_queue(dmtp_async_t *async, const void *data, size_t len) {
+
+    char *reall_out;
+
+    // Once everything queued has been written, the buffer is reused from the start.
+    if (async->outpos == async->outlen) {
+        async->outpos = async->outlen = 0;
+    }
+
+    if ((async->outlen + len) > async->outsize) {
+
+        if (!(reall_out = realloc(async->out, (async->outlen + len) * 2))) {
+            PUSH_ERROR_SYSCALL("realloc");
+            RET_ERROR_INT(ERR_NOMEM, "could not queue DMTP output because of memory allocation problem");
+        }
+
+        async->out = reall_out;
+        async->outsize = (async->outlen + len) * 2;
+    }
+
+    if (len) {
+        memcpy(&(async->out[async->outlen]), data, len);
+        async->outlen += len;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Queue a command to be issued to the server of a session, and move the session into the state it awaits the reply in.
+ * @param   async   a pointer to the session that will issue the command.
+ * @param   cmd     a pointer to a null-terminated string containing the CRLF-terminated command, which will be freed.
+ * @param   state   the state of the session while the reply to the command is awaited.
+ * @return  -1 on failure or 0 on success.
+ */
+static int _dmtp_async_command(dmtp_async_t *async, char *cmd, dmtp_async_state_t state) {
+
+    int result;
+
+    if (!cmd) {
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "unable to construct DMTP command while %s", _dmtp_async_state_name(state));
+    }
+
+    _dbgprint(5, "DMTP > %s", cmd);
+
+    result = _dmtp_async_queue(async, cmd, strlen(cmd));
+    free(cmd);
+    async->request->state = state;
+
+    return result;
+}
+
+/**
+ * @brief   Write as much queued output as possible to the server of a session, without blocking.
+ * @param   async   a pointer to the session whose output will be written.
+ * @return  -1 on failure, 0 if the session has to wait for its socket to be ready before it can write the rest, or 1
+ *              once all queued output has been written.
+ */
+static int _dmtp_async_flush(dmtp_async_t *async) {
+
+    ssize_t nwritten;
+    int err;
+
+    while (async->outpos < async->outlen) {
+
+        if (async->session->con) {
+
+            if ((nwritten = SSL_write_d(async->session->con, &(async->out[async->outpos]), async->outlen - async->outpos)) <= 0) {
+                err = SSL_get_error_d(async->session->con, nwritten);
+
+                if ((err == SSL_ERROR_WANT_WRITE) || (err == SSL_ERROR_WANT_READ)) {
+                    async->want |= (err == SSL_ERROR_WANT_WRITE) ? POLLOUT : POLLIN;
+                    return 0;
+                }
+
+                PUSH_ERROR_OPENSSL();
+                RET_ERROR_INT(ERR_UNSPEC, "could not write to DMTP server");
+            }
+
+        } else if ((nwritten = send(async->fd, &(async->out[async->outpos]), async->outlen - async->outpos, MSG_NOSIGNAL)) < 0) {
+
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                async->want |= POLLOUT;
+                return 0;
+            }
+
+            PUSH_ERROR_SYSCALL("send");
+            RET_ERROR_INT(ERR_UNSPEC, "could not write to DMTP server");
+        }
+
+        async->outpos += nwritten;
+    }
+
+    async->outpos = async->outlen = 0;
+
+    return 1;
+}
+
+/**
+ * @brief   Queue the next piece of a message being delivered, of around DMTP_DATA_CHUNK_SIZE bytes.
+ * @note    Once the whole message has been queued, it is followed by the CR/LF that terminates it.
+ * @param   async   a pointer to the session delivering the message.
+ * @return  -1 on failure or 0 on success.
+ */
+static int _dmtp_async_queue_message(dmtp_async_t *async) {
+
+    dmtp_async_request_t *request = async->request;
+    const struct iovec *iov;
+    size_t nbytes;
+
+    while ((async->outlen < DMTP_DATA_CHUNK_SIZE) && (async->msgidx < request->msgcnt)) {
+        iov = &(request->msg[async->msgidx]);
+        nbytes = iov->iov_len - async->msgoff;
+        nbytes = (nbytes < (DMTP_DATA_CHUNK_SIZE - async->outlen)) ? nbytes : (DMTP_DATA_CHUNK_SIZE - async->outlen);
+
+        if (_dmtp_async_queue(async, (unsigned char *)iov->iov_base + async->msgoff, nbytes) < 0) {
+            RET_ERROR_INT(ERR_UNSPEC, "unable to queue message for delivery");
+        }
+
+        if ((async->msgoff += nbytes) == iov->iov_len) {
+            async->msgidx++;
+            async->msgoff = 0;
+        }
+
+    }
+
+    if (async->msgidx == request->msgcnt) {
+
+        if (_dmtp_async_queue(async, "\r\n", 2) < 0) {
+            RET_ERROR_INT(ERR_UNSPEC, "unable to queue message for delivery");
+        }
+
+        async->msgdone = 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Set up TLS over the socket of a session, to be negotiated as the socket becomes ready.
+ * @param   async   a pointer to the session that will negotiate TLS.
+ * @return  -1 on failure or 0 on success.
+ */
+static int _dmtp_async_start_tls(dmtp_async_t *async) {
+
+    SSL *con;
+
+    if (!(con = _ssl_client_new(async->fd, async->request->dx, &(async->resumed)))) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not set up TLS session with DX server");
+    }
+
+    // A write that has to be retried might be retried from a reallocated output buffer.
+    SSL_ctrl_d(con, SSL_CTRL_MODE, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER, NULL);
+
+    // From here on, network operations only occur via SSL, and the socket belongs to the TLS session.
+    async->session->con = con;
+    async->session->_fd = -1;
+    async->session->mode = dmtp_mode_dmtp;
+    async->request->state = dmtp_async_handshake;
+
+    return 0;
+}
+
+/**
+ * @brief   Continue the TLS handshake of a session, and verify the DX certificate against the DIME record once it completes.
+ * @note    The certificate verification itself may block, if it has to make an OCSP request.
+ * @param   async   a pointer to the session negotiating TLS.
+ * @return  -1 on failure, 0 if the session has to wait for its socket to be ready, or 1 once TLS has been negotiated.
+ */
+static int _dmtp_async_handshake(dmtp_async_t *async) {
+
+    dmtp_async_request_t *request = async->request;
+    int res, err;
+
+    if ((res = SSL_connect_d(async->session->con)) <= 0) {
+        err = SSL_get_error_d(async->session->con, res);
+
+        if ((err == SSL_ERROR_WANT_WRITE) || (err == SSL_ERROR_WANT_READ)) {
+            async->want |= (err == SSL_ERROR_WANT_WRITE) ? POLLOUT : POLLIN;
+            return 0;
+        }
+
+        PUSH_ERROR_OPENSSL();
+
+        // A cached session that the server chokes on isn't offered again.
+        if (async->resumed) {
+            _remove_cached_object(request->dx, &(cached_stores[cached_data_tls_session]));
+        }
+
+        RET_ERROR_INT(ERR_UNSPEC, "could not establish TLS session with DX server");
+    }
+
+    _dbgprint(3, "Established asynchronous TLS session with %s.\n", request->dx);
+
+    // The session only borrows the caller's DIME record, so it isn't destroyed along with the session.
+    if (request->drec) {
+        async->session->drec = request->drec;
+        res = _verify_dx_certificate(async->session);
+        async->session->drec = NULL;
+
+        if (res <= 0) {
+            RET_ERROR_INT(ERR_UNSPEC, "DX server TLS certificate failed verification");
+        }
+
+    }
+
+    return 1;
+}
+
+/**
+ * @brief   Queue the commands that carry out the request of a session, once its connection has been established.
+ * @param   async   a pointer to the session whose request will be carried out.
+ * @return  -1 on failure, 0 on success, or 1 if the request only asked for the session to be established.
+ */
+static int _dmtp_async_begin(dmtp_async_t *async) {
+
+    dmtp_async_request_t *request = async->request;
+    dmtp_signet_query_t *query;
+    char *cmd = NULL;
+    size_t nsent = 0;
+
+    if (request->type == dmtp_async_deliver) {
+        return _dmtp_async_command(async, _str_printf(&cmd, "EHLO <%s>\r\n", request->helo) ? cmd : NULL, dmtp_async_ehlo);
+    } else if (request->type == dmtp_async_establish) {
+        request->state = dmtp_async_done;
+        return 1;
+    }
+
+    // Signet queries are all pipelined at once, since replies are read as the rest of the queries are being written.
+    for (size_t i = 0; i < request->nqueries; i++) {
+        query = &(request->queries[i]);
+
+        if (!(cmd = _sgnt_resolv_dmtp_format_query(query->type, query->signame, query->fingerprint))) {
+            fprintf(stderr, "Error: could not issue query for signet: %s\n", (query->signame ? query->signame : "(null)"));
+            dump_error_stack();
+            _clear_error_stack();
+            continue;
+        }
+
+        // Queries that are awaiting a reply are the only ones which aren't marked as failed.
+        if (_dmtp_async_command(async, cmd, dmtp_async_queries) < 0) {
+            RET_ERROR_INT(ERR_UNSPEC, "unable to issue pipelined signet queries");
+        }
+
+        query->status = 0;
+        nsent++;
+    }
+
+    if (!nsent) {
+        return _dmtp_async_command(async, strdup("QUIT\r\n"), dmtp_async_quit);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Match a reply from the server to the signet query it answers.
+ * @param   async   a pointer to the session issuing the signet queries.
+ * @param   rcode   the response code of the reply.
+ * @param   text    the text of the reply following its response code, which will be modified.
+ * @return  -1 on failure or 0 on success.
+ */
+static int _dmtp_async_query_reply(dmtp_async_t *async, unsigned short rcode, char *text) {
+
+    dmtp_async_request_t *request = async->request;
+    dmtp_signet_query_t *query;
+
+    // Skip past any queries that were never sent, since there won't be any replies to them.
+    while ((async->nreplied < request->nqueries) && (request->queries[async->nreplied].status < 0)) {
+        async->nreplied++;
+    }
+
+    if (async->nreplied == request->nqueries) {
+        RET_ERROR_INT(ERR_UNSPEC, "received unexpected reply to pipelined signet queries");
+    }
+
+    query = &(request->queries[async->nreplied++]);
+    query->rcode = rcode;
+    query->status = -1;
+
+    // A refusal by the server only fails the query it was in reply to.
+    if ((rcode < 200) || (rcode >= 300)) {
+        _dbgprint(2, "Signet query for %s was refused: %u %s\n", query->signame, rcode, text);
+    } else {
+
+        if (query->type == dmtp_query_sgnt) {
+            query->status = (query->result = _sgnt_resolv_dmtp_parse_sgnt_reply(text)) ? 1 : -1;
+        } else {
+            query->status = _sgnt_resolv_dmtp_parse_vrfy_reply(text, &(query->result));
+        }
+
+        if (query->status < 0) {
+            fprintf(stderr, "Error: could not process reply to query for signet: %s\n", query->signame);
+            dump_error_stack();
+            _clear_error_stack();
+        } else {
+            async->status++;
+        }
+
+    }
+
+    while ((async->nreplied < request->nqueries) && (request->queries[async->nreplied].status < 0)) {
+        async->nreplied++;
+    }
+
+    if (async->nreplied == request->nqueries) {
+        return _dmtp_async_command(async, strdup("QUIT\r\n"), dmtp_async_quit);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief   Act on a reply from the server of a session, according to the state the session was awaiting it in.
+ * @param   async   a pointer to the session that received the reply.
+ * @param   rcode   the response code of the reply.
+ * @param   text    the text of the reply following its response code, which will be modified.
+ * @return  -1 on failure, 0 if the session continues, or 1 once it has finished.
+ */
+static int _dmtp_async_reply(dmtp_async_t *async, unsigned short rcode, char *text) {
+
+    dmtp_async_request_t *request = async->request;
+    char *cmd = NULL, *hash, *rptr;
+    size_t msgsize = 0;
+
+    switch (request->state) {
+
+    case dmtp_async_queries:
+        return _dmtp_async_query_reply(async, rcode, text);
+    case dmtp_async_quit:
+        request->state = dmtp_async_done;
+        return 1;
+    case dmtp_async_data:
+
+        // The DATA command is special because the first response is expected to be in the 3xx numeric code range.
+        if ((rcode < 300) || (rcode >= 400)) {
+            RET_ERROR_INT_FMT(ERR_UNSPEC, "DATA command returned error: %u: %s", rcode, text);
+        }
+
+        break;
+    default:
+
+        if ((rcode < 200) || (rcode >= 300)) {
+            RET_ERROR_INT_FMT(ERR_UNSPEC, "DMTP server returned error while %s: %u: %s", _dmtp_async_state_name(request->state), rcode, text);
+        }
+
+        break;
+
+    }
+
+    switch (request->state) {
+
+    case dmtp_async_banner:
+
+        if ((rcode != 220) || (_sgnt_resolv_dmtp_parse_banner(text) < 0)) {
+            RET_ERROR_INT(ERR_UNSPEC, "received incompatible DMTP banner from server");
+        }
+
+        if (request->mode == dmtp_mode_dual) {
+            return _dmtp_async_command(async, _str_printf(&cmd, "STARTTLS <%s> MODE=DMTPv1\r\n", request->dx) ? cmd : NULL, dmtp_async_starttls);
+        }
+
+        return _dmtp_async_begin(async);
+    case dmtp_async_starttls:
+
+        // Anything the server sent after accepting STARTTLS would have been sent in the clear.
+        if (async->session->_inlen) {
+            RET_ERROR_INT(ERR_UNSPEC, "DMTP server sent unexpected data before TLS negotiation");
+        }
+
+        return _dmtp_async_start_tls(async);
+    case dmtp_async_starttls_mode:
+
+        // The response is "OK" followed by the mode.
+        if (strncmp(text, "OK", 2)) {
+            RET_ERROR_INT_FMT(ERR_UNSPEC, "STARTTLS server response was of unrecognized format: %s", text);
+        }
+
+        for (rptr = text + 2; chr_isspace(*rptr); rptr++);
+
+        if (_sgnt_resolv_dmtp_str_to_mode(rptr) != dmtp_mode_dmtp) {
+            RET_ERROR_INT_FMT(ERR_UNSPEC, "failed to initiate TLS session over dual mode server: %s", text);
+        }
+
+        return _dmtp_async_begin(async);
+    case dmtp_async_ehlo:
+
+        for (int i = 0; i < request->msgcnt; i++) {
+            msgsize += request->msg[i].iov_len;
+        }
+
+        return _dmtp_async_command(async, _sgnt_resolv_dmtp_format_mail_from(request->origin, msgsize, request->rettype, request->dtype),
+            dmtp_async_mail_from);
+    case dmtp_async_mail_from:
+        return _dmtp_async_command(async, _str_printf(&cmd, "RCPT TO: <%s> [%s]\r\n", request->domain, "fingerprint") ? cmd : NULL,
+            dmtp_async_rcpt_to);
+    case dmtp_async_rcpt_to:
+        return _dmtp_async_command(async, _str_printf(&cmd, "DATA [%s]\r\n", "fingerprint") ? cmd : NULL, dmtp_async_data);
+    case dmtp_async_data:
+
+        // The response should be "CONTINUE", followed by the commit hash.
+        if (!(hash = _sgnt_resolv_dmtp_parse_data_reply(text, "CONTINUE"))) {
+            RET_ERROR_INT(ERR_UNSPEC, "remote server was not ready to receive message data");
+        }
+
+        free(hash);
+        request->state = dmtp_async_message;
+
+        return 0;
+    case dmtp_async_message:
+
+        // The response should be "OK", followed by the transaction ID.
+        if (!(request->txid = _sgnt_resolv_dmtp_parse_data_reply(text, "OK"))) {
+            RET_ERROR_INT(ERR_UNSPEC, "message was not accepted by remote server");
+        }
+
+        return _dmtp_async_command(async, strdup("QUIT\r\n"), dmtp_async_quit);
+    default:
+        break;
+
+    }
+
+    RET_ERROR_INT_FMT(ERR_UNSPEC, "received unexpected DMTP reply while %s", _dmtp_async_state_name(request->state));
+}
+
+/**
+ * @brief   Read the next complete reply from the server of a session, without blocking.
+ * @note    Only the final line of a multiline reply is returned, since none of the replies a session acts on span several lines.
+ * @param   async   a pointer to the session reading the reply.
+ * @param   rcode   a pointer to a variable that will receive the response code of the reply.
+ * @return  NULL on failure, or if the session has to wait for more input, in which case the session's _wait is set;
+ *              otherwise, a pointer to the text of the reply inside the session's input buffer.
+ */
+static char *_dmtp_async_read_reply(dmtp_async_t *async, unsigned short *rcode) {
+
+    char *line, *text = NULL;
+    size_t len;
+    int overflow, multiline = 0;
+
+    while (!multiline) {
+
+        if (!(line = _sgnt_resolv_dmtp_next_line(async->session, &len, &overflow))) {
+            return NULL;
+        } else if (overflow) {
+            RET_ERROR_PTR(ERR_UNSPEC, "DMTP reply was too long to be read");
+        }
+
+        _dbgprint(5, "DMTP < %s\n", line);
+
+        if (!(text = _sgnt_resolv_parse_line_code(line, rcode, &multiline))) {
+            RET_ERROR_PTR(ERR_UNSPEC, "could not parse DMTP line response code");
+        }
+
+    }
+
+    async->request->rcode = *rcode;
+
+    return text;
+}
+
+/**
+ * @brief   Advance a session as far as it can go without blocking.
+ * @param   async   a pointer to the session to be advanced.
+ * @return  -1 if the session failed, 0 if it has to wait for the poll events in its want field, or 1 once it has finished.
+ */
+static int _dmtp_async_step(dmtp_async_t *async) {
+
+    dmtp_async_request_t *request = async->request;
+    unsigned short rcode;
+    socklen_t slen;
+    char *text;
+    int res, serr;
+
+    while (1) {
+        async->want = 0;
+
+        if (request->state == dmtp_async_connect) {
+            slen = sizeof(serr);
+
+            if (getsockopt(async->fd, SOL_SOCKET, SO_ERROR, &serr, &slen) < 0) {
+                PUSH_ERROR_SYSCALL("getsockopt");
+                RET_ERROR_INT(ERR_UNSPEC, "attempt to get socket error flag failed");
+            } else if (serr) {
+                errno = serr;
+                PUSH_ERROR_SYSCALL("connect");
+                RET_ERROR_INT_FMT(ERR_UNSPEC, "unable to establish connection to DX server %s", request->dx);
+            }
+
+            _dbgprint(3, "Established asynchronous connection to DX server %s.\n", request->dx);
+
+            if (request->mode != dmtp_mode_dmtp) {
+                request->state = dmtp_async_banner;
+            } else if (_dmtp_async_start_tls(async) < 0) {
+                return -1;
+            }
+
+            continue;
+        } else if (request->state == dmtp_async_handshake) {
+
+            if ((res = _dmtp_async_handshake(async)) <= 0) {
+                return res;
+            }
+
+            // A dual mode session still has to read the final reply to its STARTTLS command, over TLS.
+            request->state = (request->mode == dmtp_mode_dual) ? dmtp_async_starttls_mode : dmtp_async_banner;
+            continue;
+        }
+
+        // Replies to pipelined queries are read even while more of them wait to be written, so that neither end stalls.
+        if ((async->outpos < async->outlen) && (((res = _dmtp_async_flush(async)) < 0) || (!res && (request->state != dmtp_async_queries)))) {
+            return res;
+        }
+
+        if ((request->state == dmtp_async_message) && !async->msgdone) {
+
+            if (_dmtp_async_queue_message(async) < 0) {
+                return -1;
+            }
+
+            continue;
+        }
+
+        if (!(text = _dmtp_async_read_reply(async, &rcode))) {
+
+            if (async->session->_wait) {
+                async->want |= async->session->_wait;
+                return 0;
+            }
+
+            // A server that hangs up on QUIT without a proper reply has still done everything that was asked of it.
+            if (request->state == dmtp_async_quit) {
+                _clear_error_stack();
+                request->state = dmtp_async_done;
+                return 1;
+            }
+
+            RET_ERROR_INT_FMT(ERR_UNSPEC, "DMTP session failed while %s", _dmtp_async_state_name(request->state));
+        }
+
+        if ((res = _dmtp_async_reply(async, rcode, text))) {
+            return res;
+        }
+
+    }
+
+}
+
+/**
+ * @brief   Remove a finished session from its event loop, free it, and invoke the completion callback of its request.
+ * @param   loop    a pointer to the event loop running the session.
+ * @param   async   a pointer to the session that has finished.
+ * @param   failed  whether the session failed.
+ */
+static void _dmtp_async_finish(dmtp_async_loop_t *loop, dmtp_async_t *async, int failed) {
+
+    dmtp_async_request_t *request = async->request;
+    dmtp_async_cb_t callback = async->callback;
+    void *arg = async->arg;
+    int status = failed ? -1 : async->status, flags;
+
+    // Any queries still awaiting a reply have failed along with the session.
+    if (failed && (request->type == dmtp_async_query)) {
+
+        for (size_t i = async->nreplied; i < request->nqueries; i++) {
+            request->queries[i].status = -1;
+        }
+
+    }
+
+    // If the server hung up, the socket has already been closed, which took it out of the epoll set. Any other failure is
+    // left on the error stack for the callback, alongside whatever made the request fail, rather than cleared here.
+    if ((epoll_ctl(loop->epfd, EPOLL_CTL_DEL, async->fd, NULL) < 0) && (errno != EBADF) && (errno != ENOENT)) {
+        PUSH_ERROR_SYSCALL("epoll_ctl");
+    }
+
+    // An established session is handed over to the caller, and goes back to blocking mode like any other DMTP session.
+    if (!failed && (request->type == dmtp_async_establish)) {
+
+        if (((flags = fcntl(async->fd, F_GETFL, NULL)) < 0) || (fcntl(async->fd, F_SETFL, flags & ~O_NONBLOCK) < 0)) {
+            PUSH_ERROR_SYSCALL("fcntl");
+            PUSH_ERROR(ERR_UNSPEC, "unable to set blocking mode on DMTP session socket");
+            status = -1;
+        } else {
+            request->session = async->session;
+            async->session = NULL;
+        }
+
+    }
+
+    _dmtp_async_unlink(loop, async);
+    loop->pending--;
+    _dmtp_async_free(async);
+
+    callback(request, status, arg);
+    _clear_error_stack();
+
+}
+
+/**
+ * @brief   Create an event loop that drives many non-blocking DMTP sessions from a single thread.
+ * @param   timeout     the number of seconds a session may wait on its server before it fails, or 0 for DMTP_ASYNC_TIMEOUT.
+ * @return  NULL on failure, or a pointer to the new event loop on success.
+ * @free_using{sgnt_resolv_dmtp_async_destroy}
+ */
+dmtp_async_loop_t *_sgnt_resolv_dmtp_async_create(unsigned int timeout) {
+
+    dmtp_async_loop_t *result;
+
+    if (!(result = malloc(sizeof(dmtp_async_loop_t)))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_PTR(ERR_NOMEM, "could not create DMTP event loop because of memory allocation problem");
+    }
+
+    memset(result, 0, sizeof(dmtp_async_loop_t));
+    result->timeout = timeout ? timeout : DMTP_ASYNC_TIMEOUT;
+
+    if ((result->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        PUSH_ERROR_SYSCALL("epoll_create1");
+        free(result);
+        RET_ERROR_PTR(ERR_UNSPEC, "could not create DMTP event loop");
+    }
+
+    return result;
+}
+
+/**
+ * @brief   Destroy a DMTP event loop, failing any of its sessions that haven't finished yet.
+ * @note    The completion callbacks of the unfinished sessions are invoked with a status of -1.
+ * @param   loop    a pointer to the event loop to be destroyed.
+ */
+void _sgnt_resolv_dmtp_async_destroy(dmtp_async_loop_t *loop) {
+
+    if (!loop) {
+        return;
+    }
+
+    while (loop->head) {
+        PUSH_ERROR(ERR_UNSPEC, "DMTP event loop was destroyed before session finished");
+        _dmtp_async_finish(loop, loop->head, 1);
+    }
+
+    close(loop->epfd);
+    free(loop);
+
+}
+
+/**
+ * @brief   Start carrying out a DMTP request in a new non-blocking session, driven by an event loop.
+ * @note    The connection is only initiated here, and the rest of the request is carried out as the event loop runs.
+ *              The request, and everything it points to, must be kept intact until its completion callback is invoked.
+ *              Since writes to a server that has hung up could raise SIGPIPE over TLS, callers should ignore that signal.
+ * @param   loop        a pointer to the event loop that will drive the session.
+ * @param   request     a pointer to the request to be carried out. Its results are filled in as the session progresses.
+ * @param   callback    the function to be called once the request has finished, successfully or not.
+ * @param   arg         an opaque pointer to be passed to the callback.
+ * @return  -1 if the request could not be started, in which case the callback will never be invoked, or 0 on success.
+ */
+int _sgnt_resolv_dmtp_async_submit(dmtp_async_loop_t *loop, dmtp_async_request_t *request, dmtp_async_cb_t callback, void *arg) {
+
+    struct epoll_event event;
+    dmtp_async_t *async;
+
+    if (!loop || !request || !callback || !request->addr || !request->addrlen || !request->dx || !request->domain) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    } else if ((request->mode != dmtp_mode_dmtp) && (request->mode != dmtp_mode_dual)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, "asynchronous DMTP sessions must be either standard or dual mode");
+    } else if ((request->type == dmtp_async_deliver) && (!request->helo || !request->origin || !request->msg || (request->msgcnt <= 0))) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    } else if ((request->type == dmtp_async_query) && (!request->queries || !request->nqueries)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    } else if ((request->type != dmtp_async_deliver) && (request->type != dmtp_async_query) && (request->type != dmtp_async_establish)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    request->state = dmtp_async_connect;
+    request->rcode = 0;
+    request->txid = NULL;
+    request->session = NULL;
+
+    // A query remains marked as failed until a successful reply to it is read.
+    for (size_t i = 0; (request->type == dmtp_async_query) && (i < request->nqueries); i++) {
+        request->queries[i].status = -1;
+        request->queries[i].rcode = 0;
+        request->queries[i].result = NULL;
+    }
+
+    if (!(async = calloc(1, sizeof(dmtp_async_t))) || !(async->session = calloc(1, sizeof(dmtp_session_t)))) {
+        PUSH_ERROR_SYSCALL("calloc");
+        free(async);
+        RET_ERROR_INT(ERR_NOMEM, "could not start DMTP session because of memory allocation problem");
+    }
+
+    async->session->_fd = -1;
+    async->session->mode = request->mode;
+    async->session->active = 1;
+    async->request = request;
+    async->callback = callback;
+    async->arg = arg;
+
+    if ((!(async->session->domain = strdup(request->domain))) || (!(async->session->dx = strdup(request->dx)))) {
+        PUSH_ERROR_SYSCALL("strdup");
+        _dmtp_async_free(async);
+        RET_ERROR_INT(ERR_NOMEM, "could not start DMTP session because of memory allocation problem");
+    }
+
+    if ((async->fd = socket(request->addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        PUSH_ERROR_SYSCALL("socket");
+        _dmtp_async_free(async);
+        RET_ERROR_INT(ERR_UNSPEC, "could not create socket for DMTP session");
+    }
+
+    async->session->_fd = async->fd;
+
+    if ((connect(async->fd, request->addr, request->addrlen) < 0) && (errno != EINPROGRESS)) {
+        PUSH_ERROR_SYSCALL("connect");
+        _dmtp_async_free(async);
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "unable to establish connection to DX server %s", request->dx);
+    }
+
+    // The socket becomes writable once the connection has been established, or has failed.
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLOUT;
+    event.data.ptr = async;
+    async->events = POLLOUT;
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, async->fd, &event) < 0) {
+        PUSH_ERROR_SYSCALL("epoll_ctl");
+        _dmtp_async_free(async);
+        RET_ERROR_INT(ERR_UNSPEC, "could not add DMTP session to event loop");
+    }
+
+    _dmtp_async_touch(loop, async, 0);
+    loop->pending++;
+
+    return 0;
+}
+
+/**
+ * @brief   Run one pass of a DMTP event loop, advancing every session that is ready and failing those that have timed out.
+ * @note    Completion callbacks are invoked from within this function, and may submit new requests to the same loop.
+ * @param   loop        a pointer to the event loop to be run.
+ * @param   timeout     the maximum number of milliseconds to wait for a session to become ready, or -1 to wait indefinitely.
+ * @return  -1 on failure, or the number of sessions that still haven't finished.
+ */
+int _sgnt_resolv_dmtp_async_run(dmtp_async_loop_t *loop, int timeout) {
+
+    struct epoll_event events[DMTP_ASYNC_MAX_EVENTS], event;
+    dmtp_async_t *async;
+    time_t now;
+    int nevents, res, wait;
+
+    if (!loop) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    } else if (!loop->pending) {
+        return 0;
+    }
+
+    // Never sleep past the moment that the next session would time out.
+    now = time(NULL);
+    wait = (loop->head->deadline >= now) ? (int)(loop->head->deadline - now + 1) * 1000 : 0;
+
+    if ((timeout < 0) || (wait < timeout)) {
+        timeout = wait;
+    }
+
+    if ((nevents = epoll_wait(loop->epfd, events, DMTP_ASYNC_MAX_EVENTS, timeout)) < 0) {
+
+        if (errno != EINTR) {
+            PUSH_ERROR_SYSCALL("epoll_wait");
+            RET_ERROR_INT(ERR_UNSPEC, "unable to wait for DMTP session events");
+        }
+
+        nevents = 0;
+    }
+
+    for (int i = 0; i < nevents; i++) {
+        async = (dmtp_async_t *)events[i].data.ptr;
+        _dmtp_async_touch(loop, async, 1);
+
+        if ((res = _dmtp_async_step(async))) {
+            _dmtp_async_finish(loop, async, (res < 0));
+            continue;
+        }
+
+        // The socket only needs to be registered again if the session is waiting on something different than before.
+        if (async->want != async->events) {
+            memset(&event, 0, sizeof(event));
+            event.events = ((async->want & POLLIN) ? EPOLLIN : 0) | ((async->want & POLLOUT) ? EPOLLOUT : 0);
+            event.data.ptr = async;
+
+            if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, async->fd, &event) < 0) {
+                PUSH_ERROR_SYSCALL("epoll_ctl");
+                PUSH_ERROR(ERR_UNSPEC, "could not update DMTP session in event loop");
+                _dmtp_async_finish(loop, async, 1);
+                continue;
+            }
+
+            async->events = async->want;
+        }
+
+    }
+
+    // Sessions that have waited on their servers for too long are failed, starting with the one that has waited longest.
+    now = time(NULL);
+
+    while (loop->head && (loop->head->deadline < now)) {
+        PUSH_ERROR_FMT(ERR_UNSPEC, "DMTP session with %s timed out while %s", loop->head->request->dx, _dmtp_async_state_name(loop->head->request->state));
+        _dmtp_async_finish(loop, loop->head, 1);
+    }
+
+    return loop->pending;
+}
+
+/**
+ * The state of a race between connection attempts to the DX servers of a dark domain.
+ */
+typedef struct {
+    dmtp_session_t *winner;         ///< The first session to be established, or NULL if none has been yet.
+    size_t running;                 ///< The number of attempts that haven't finished yet.
+    int failed;                     ///< Whether an attempt has failed since the last one was started.
+} dx_race_t;
+
+/**
+ * @brief   Get the current value of the monotonic clock in milliseconds, for staggering connection attempts.
+ * @return  the number of milliseconds elapsed since an arbitrary point in time.
+ */
+static uint64_t _dx_race_clock(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/**
+ * @brief   Record the outcome of a racing connection attempt.
+ * @note    Several attempts can finish in the same pass of the event loop, in which case only the first is kept.
+ * @param   request     a pointer to the establish request of the attempt.
+ * @param   status      0 if the session was established, or -1 if the attempt failed.
+ * @param   arg         a pointer to the state of the race.
+ */
+static void _dx_race_finished(dmtp_async_request_t *request, int status, void *arg) {
+
+    dx_race_t *race = (dx_race_t *)arg;
+
+    race->running--;
+
+    if (status < 0) {
+        _dbgprint(1, "DMTP connection attempt to %s failed.\n", request->dx);
+        race->failed = 1;
+    } else if (!race->winner) {
+        race->winner = request->session;
+    } else {
+        _sgnt_resolv_destroy_dmtp_session(request->session);
+    }
+
+    request->session = NULL;
+
+}
+
+/**
+ * @brief   Race staggered connection attempts to one or more DX servers, and keep the first session to be established.
+ * @note    As recommended by RFC 8305, each attempt is given DMTP_CONNECT_ATTEMPT_DELAY milliseconds, or until it fails,
+ *              before the next one is started alongside it. Attempts are started in the order they are supplied, so they
+ *              should already be sorted by preference, with address families interleaved. The first session to be set up
+ *              (and have its DX certificate verified, for attempts that carry a DIME record) wins, and the rest are cancelled.
+ * @param   attempts    an array of establish requests, one for each address of each candidate DX server.
+ * @param   nattempts   the number of connection attempts in the array.
+ * @return  NULL if no session could be established, or a pointer to the winning DMTP session, in blocking mode, on success.
+ */
+dmtp_session_t *_dx_connect_race(dmtp_async_request_t *attempts, size_t nattempts) {
+
+    dmtp_async_loop_t *loop;
+    dmtp_async_request_t *attempt;
+    dx_race_t race;
+    uint64_t now, next_start = 0;
+    size_t next = 0;
+
+    if (!attempts || !nattempts) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(loop = _sgnt_resolv_dmtp_async_create(DMTP_CONNECT_TIMEOUT))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "could not create event loop for DX connection attempts");
+    }
+
+    memset(&race, 0, sizeof(race));
+
+    while (!race.winner && ((next < nattempts) || race.running)) {
+        now = _dx_race_clock();
+
+        // The next attempt starts once the last one has had its head start, or right away if one has failed in the meantime.
+        if ((next < nattempts) && (!race.running || race.failed || (now >= next_start))) {
+            attempt = &(attempts[next++]);
+            attempt->type = dmtp_async_establish;
+            race.failed = 0;
+
+            _dbgprint(1, "Attempting %s DMTP connection to %s ...\n", (attempt->mode == dmtp_mode_dual ? "dual mode" : "standard"),
+                attempt->dx);
+
+            if (_sgnt_resolv_dmtp_async_submit(loop, attempt, _dx_race_finished, &race) < 0) {
+                _dbgprint(1, "DMTP connection attempt to %s could not be started.\n", attempt->dx);
+                _clear_error_stack();
+                race.failed = 1;
+                continue;
+            }
+
+            race.running++;
+            next_start = now + DMTP_CONNECT_ATTEMPT_DELAY;
+            continue;
+        }
+
+        if (_sgnt_resolv_dmtp_async_run(loop, ((next < nattempts) ? (int)(next_start - now) : -1)) < 0) {
+            _sgnt_resolv_dmtp_async_destroy(loop);
+            RET_ERROR_PTR(ERR_UNSPEC, "DX connection attempts failed");
+        }
+
+    }
+
+    // Destroying the loop cancels any attempts that are still in progress.
+    _sgnt_resolv_dmtp_async_destroy(loop);
+
+    if (!race.winner) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to establish connection to any DX server");
+    }
+
+    return race.winner;
+}
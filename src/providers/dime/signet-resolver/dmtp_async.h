@@ -0,0 +1,88 @@
+#ifndef DMTP_ASYNC_H
+#define DMTP_ASYNC_H
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "dime/signet-resolver/dmtp.h"
+
+
+#define DMTP_ASYNC_MAX_EVENTS    256    ///< The maximum number of ready sessions handled in one pass of the event loop.
+#define DMTP_ASYNC_TIMEOUT       60     ///< The default number of seconds an asynchronous session may wait on its server before it fails.
+
+#define DMTP_CONNECT_ATTEMPT_DELAY  250 ///< The milliseconds a DX connection attempt is given before the next one is started alongside it (RFC 8305).
+#define DMTP_CONNECT_TIMEOUT        10  ///< The number of seconds a racing DX connection attempt may wait on its server before it fails.
+
+
+typedef enum {
+    dmtp_async_deliver = 1,         ///< Deliver a message with EHLO, MAIL FROM, RCPT TO and DATA.
+    dmtp_async_query = 2,           ///< Issue a batch of SGNT and VRFY signet queries.
+    dmtp_async_establish = 3        ///< Establish a session, and hand it over to the caller once it is ready for its first command.
+} dmtp_async_type_t;
+
+typedef enum {
+    dmtp_async_connect = 0,         ///< Waiting for the TCP connection to be established.
+    dmtp_async_handshake = 1,       ///< Negotiating TLS with the server.
+    dmtp_async_banner = 2,          ///< Waiting for the server's banner.
+    dmtp_async_starttls = 3,        ///< Waiting for the server to accept the STARTTLS command of a dual mode session.
+    dmtp_async_starttls_mode = 4,   ///< Waiting for the final reply to the STARTTLS command, once TLS has been negotiated.
+    dmtp_async_ehlo = 5,            ///< Waiting for the reply to the EHLO command.
+    dmtp_async_mail_from = 6,       ///< Waiting for the reply to the MAIL FROM command.
+    dmtp_async_rcpt_to = 7,         ///< Waiting for the reply to the RCPT TO command.
+    dmtp_async_data = 8,            ///< Waiting for the server to accept the DATA command.
+    dmtp_async_message = 9,         ///< Sending the message, and waiting for the server to accept it.
+    dmtp_async_queries = 10,        ///< Waiting for the replies to signet queries.
+    dmtp_async_quit = 11,           ///< Waiting for the reply to the QUIT command.
+    dmtp_async_done = 12            ///< Finished successfully.
+} dmtp_async_state_t;
+
+
+/**
+ * A request to be carried out by an asynchronous DMTP session. The caller fills in the request, and the fields it points
+ * to, and must keep all of them intact until the request's completion callback has been called.
+ */
+typedef struct {
+    dmtp_async_type_t type;         ///< Whether the request delivers a message, issues signet queries, or only establishes a session.
+    const struct sockaddr *addr;    ///< The already resolved address of the DX server, since looking it up would block.
+    socklen_t addrlen;              ///< The size of the DX server address.
+    const char *dx;                 ///< The name of the DX server, requested through STARTTLS and SNI.
+    const char *domain;             ///< The dark domain serviced by the DX server, and the recipient of a delivery.
+    dmtp_mode_t mode;               ///< dmtp_mode_dmtp to negotiate TLS right away (port 26), or dmtp_mode_dual to use STARTTLS (port 25).
+    dime_record_t *drec;            ///< An optional DIME management record of the domain, which the DX certificate must be verified against.
+
+    const char *helo;               ///< For deliveries, the name of the sending domain to be given in the EHLO command.
+    const char *origin;             ///< For deliveries, the origin domain of the message, given in the MAIL FROM command.
+    dmtp_mail_rettype_t rettype;    ///< For deliveries, the portion of the message to be returned if it bounces.
+    dmtp_mail_datatype_t dtype;     ///< For deliveries, the type of the message data.
+    const struct iovec *msg;        ///< For deliveries, the buffers holding the consecutive parts of the message.
+    int msgcnt;                     ///< For deliveries, the number of buffers holding the message.
+
+    dmtp_signet_query_t *queries;   ///< For signet queries, the queries to be issued, which are filled in as their replies arrive.
+    size_t nqueries;                ///< For signet queries, the number of queries to be issued.
+
+    dmtp_async_state_t state;       ///< The state the session was in when it finished, which is dmtp_async_done on success.
+    unsigned short rcode;           ///< The response code of the last reply received from the server, or 0 if there was none.
+    char *txid;                     ///< For deliveries, the transaction ID assigned to the message by the server, which the caller must free.
+    dmtp_session_t *session;        ///< For established sessions, the new session in blocking mode, which the caller must destroy.
+} dmtp_async_request_t;
+
+/**
+ * A callback invoked when an asynchronous request finishes. For deliveries and established sessions, status is 0 on success, and for signet queries
+ * it is the number of successful queries, as with sgnt_resolv_dmtp_query_signets(). It is -1 if the session failed, in
+ * which case the error stack describes the failure for the duration of the callback.
+ */
+typedef void (*dmtp_async_cb_t)(dmtp_async_request_t *request, int status, void *arg);
+
+typedef struct dmtp_async_loop dmtp_async_loop_t;
+
+
+// Event loop driven DMTP sessions.
+PUBLIC_FUNC_DECL(dmtp_async_loop_t *, sgnt_resolv_dmtp_async_create,   unsigned int timeout);
+PUBLIC_FUNC_DECL(void,                sgnt_resolv_dmtp_async_destroy,  dmtp_async_loop_t *loop);
+PUBLIC_FUNC_DECL(int,                 sgnt_resolv_dmtp_async_submit,   dmtp_async_loop_t *loop, dmtp_async_request_t *request, dmtp_async_cb_t callback, void *arg);
+PUBLIC_FUNC_DECL(int,                 sgnt_resolv_dmtp_async_run,      dmtp_async_loop_t *loop, int timeout);
+
+// Internal functions.
+dmtp_session_t *_dx_connect_race(dmtp_async_request_t *attempts, size_t nattempts);
+
+#endif
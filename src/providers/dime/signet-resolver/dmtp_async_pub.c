@@ -0,0 +1,18 @@
+#include "dime/signet-resolver/dmtp_async.h"
+
+
+dmtp_async_loop_t *sgnt_resolv_dmtp_async_create(unsigned int timeout) {
+    PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_async_create, timeout);
+}
+
+void sgnt_resolv_dmtp_async_destroy(dmtp_async_loop_t *loop) {
+    PUBLIC_FUNC_IMPL_VOID(sgnt_resolv_dmtp_async_destroy, loop);
+}
+
+int sgnt_resolv_dmtp_async_submit(dmtp_async_loop_t *loop, dmtp_async_request_t *request, dmtp_async_cb_t callback, void *arg) {
+    PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_async_submit, loop, request, callback, arg);
+}
+
+int sgnt_resolv_dmtp_async_run(dmtp_async_loop_t *loop, int timeout) {
+    PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_async_run, loop, timeout);
+}
@@ -5,6 +5,10 @@ signet_t *get_signet(const char *name, const char *fingerprint, int use_cache) {
     PUBLIC_FUNC_IMPL(get_signet, name, fingerprint, use_cache);
 }
 
+size_t get_signets(const char **names, const char **fingerprints, size_t nnames, int use_cache, signet_lookup_t *results) {
+    PUBLIC_FUNC_IMPL(get_signets, names, fingerprints, nnames, use_cache, results);
+}
+
 dmtp_session_t *sgnt_resolv_dmtp_connect(const char *domain, int force_family) {
     PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_connect, domain, force_family);
 }
@@ -25,6 +29,22 @@ int verify_dx_certificate(dmtp_session_t *session) {
     PUBLIC_FUNC_IMPL(verify_dx_certificate, session);
 }
 
+dmtp_session_t *sgnt_resolv_dmtp_pool_acquire(const char *domain, int force_family) {
+    PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_pool_acquire, domain, force_family);
+}
+
+void sgnt_resolv_dmtp_pool_release(dmtp_session_t *session, int reusable) {
+    PUBLIC_FUNC_IMPL_VOID(sgnt_resolv_dmtp_pool_release, session, reusable);
+}
+
+size_t sgnt_resolv_dmtp_pool_maintain(time_t now) {
+    PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_pool_maintain, now);
+}
+
+void sgnt_resolv_dmtp_pool_flush(void) {
+    PUBLIC_FUNC_IMPL_VOID(sgnt_resolv_dmtp_pool_flush, );
+}
+
 char * sgnt_resolv_dmtp_get_signet(dmtp_session_t *session, const char *signame, const char *fingerprint) {
     PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_get_signet, session, signame, fingerprint);
 }
@@ -45,10 +65,22 @@ char * sgnt_resolv_dmtp_data(dmtp_session_t *session, void *msg, size_t msglen)
     PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_data, session, msg, msglen);
 }
 
+char * sgnt_resolv_dmtp_datav(dmtp_session_t *session, const struct iovec *iov, int iovcnt) {
+    PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_datav, session, iov, iovcnt);
+}
+
+char * sgnt_resolv_dmtp_data_stream(dmtp_session_t *session, dmtp_data_producer_t producer, void *state) {
+    PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_data_stream, session, producer, state);
+}
+
 int sgnt_resolv_dmtp_verify_signet(dmtp_session_t *session, const char *signame, const char *fingerprint, char **newprint) {
     PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_verify_signet, session, signame, fingerprint, newprint);
 }
 
+int sgnt_resolv_dmtp_query_signets(dmtp_session_t *session, dmtp_signet_query_t *queries, size_t nqueries) {
+    PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_query_signets, session, queries, nqueries);
+}
+
 char * sgnt_resolv_dmtp_history(dmtp_session_t *session, const char *signame, const char *startfp, const char *endfp) {
     PUBLIC_FUNC_IMPL(sgnt_resolv_dmtp_history, session, signame, startfp, endfp);
 }
@@ -9,6 +9,58 @@
 #define INITIALIZE_DNS() { if (!_dns_initialized && (_initialize_resolver() < 0)) { RET_ERROR_PTR(ERR_UNSPEC, "failed to initialize DNS resolver"); } }
 
 static int _dns_initialized = 0;
+static int _dnssec_prefetch = 0;
+
+/** The state carried through the resolver by an asynchronous lookup, so that its answer can be handed to the right callback. */
+typedef struct {
+    char *name;                     ///< The name being looked up.
+    dns_lookup_cb_t lookup_cb;      ///< The callback of a DNSKEY or DS lookup.
+    dns_txt_cb_t txt_cb;            ///< The callback of a TXT lookup.
+    dns_mx_cb_t mx_cb;              ///< The callback of an MX lookup.
+    void *arg;                      ///< The opaque argument to be passed to the callback.
+    unsigned int pending;           ///< The number of operations (the query itself, and any DNSSEC chain prefetch) still outstanding.
+    int status;                     ///< The status of the query, if it was answered before the DNSSEC chain prefetch completed.
+    unsigned char *answer;          ///< A copy of the answer, if it was received before the DNSSEC chain prefetch completed.
+    size_t alen;                    ///< The length of the copied answer.
+} dns_async_ctx_t;
+
+typedef enum {
+    dnssec_prefetch_done = 0,       ///< The record is cached, or its query has been processed or has failed.
+    dnssec_prefetch_pending = 1,    ///< The query is waiting for an answer.
+    dnssec_prefetch_answered = 2    ///< The answer is waiting for the records it depends upon to be processed.
+} dnssec_prefetch_state_t;
+
+typedef struct dnssec_prefetch dnssec_prefetch_t;
+
+/** One of the DNSKEY or DS queries issued by a DNSSEC chain prefetch. */
+typedef struct {
+    dnssec_prefetch_t *prefetch;    ///< The prefetch that issued the query.
+    const char *zone;               ///< The zone being queried.
+    dnssec_prefetch_state_t state;  ///< The state of the query.
+    unsigned char *answer;          ///< A copy of the answer, held until it can be processed.
+    size_t alen;                    ///< The length of the copied answer.
+} dnssec_prefetch_query_t;
+
+/** The DNSKEY and DS queries for every zone above a name, from the name itself up to its top level domain. */
+struct dnssec_prefetch {
+    char *name;                                                 ///< The name whose chain of trust is being prefetched.
+    size_t nzones;                                              ///< The number of zones in the chain, which are all suffixes of name.
+    dnssec_prefetch_query_t dnskeys[DNSSEC_PREFETCH_MAX_ZONES]; ///< The DNSKEY query of each zone.
+    dnssec_prefetch_query_t ds[DNSSEC_PREFETCH_MAX_ZONES];      ///< The DS query of each zone.
+    size_t outstanding;                                         ///< The number of queries still waiting for an answer.
+    size_t failures;                                            ///< The number of queries that failed or couldn't be processed.
+    dns_lookup_cb_t callback;                                   ///< The routine to be called once every query has been processed.
+    void *arg;                                                  ///< The opaque argument to be passed to the callback.
+};
+
+/** The result of a TXT lookup made on behalf of the synchronous _get_txt_record(). */
+typedef struct {
+    char *txt;
+    unsigned long ttl;
+    int validated;
+} dns_txt_result_t;
+
+static char *_get_txt_record_prefetched(const char *qstring, unsigned long *ttl, int *validated);
 
 
 /**
@@ -1309,21 +1361,46 @@ void _dump_dns_header(ns_msg *handle) {
 // TODO: needs lots of cleanup. Needs to return values, for one.
 void *_lookup_dnskey(const char *label) {
 
-    ns_msg handle;
-    ns_rr rr;
-    dnskey_t *dnskey, *skey, **dptr, **allkeys = NULL;
     unsigned char resbuf[4096];
     int nread;
-    uint16_t nanswers, rrtype;
 
     if ((nread = res_query(label, ns_c_in, T_DNSKEY, resbuf, sizeof(resbuf))) < 0) {
         PUSH_ERROR_RESOLVER("res_query");
         RET_ERROR_PTR(ERR_UNSPEC, "error occurred in sending DNSKEY record query");
     }
 
-    if (ns_initparse(resbuf, nread, &handle) < 0) {
+    if (_process_dnskey_answer(resbuf, nread) < 0) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to process DNSKEY record answer");
+    }
+
+    // TODO: this needs to be changed
+    return NULL;
+}
+
+
+/**
+ * @brief   Add the DNSKEY records in the answer to a DNSKEY query to the cache, and validate them against their RRSIGs.
+ * @param   answer  a pointer to the raw DNS answer to a DNSKEY query.
+ * @param   alen    the length of the answer in bytes.
+ * @return  0 on success or -1 on failure.
+ */
+int _process_dnskey_answer(const unsigned char *answer, size_t alen) {
+
+    ns_msg handle;
+    ns_rr rr;
+    dnskey_t *dnskey, *skey, **dptr, **allkeys = NULL;
+    uint16_t nanswers, rrtype;
+    int vval;
+
+    if (!answer) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (ns_initparse(answer, alen, &handle) < 0) {
         PUSH_ERROR_RESOLVER("ns_initparse");
-        RET_ERROR_PTR(ERR_UNSPEC, "error in parsing DNSKEY request answer");
+        RET_ERROR_INT(ERR_UNSPEC, "error in parsing DNSKEY request answer");
+    } else if (ns_msg_getflag(handle, ns_f_rcode)) {
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "DNS response rcode indicates an error: %u", ns_msg_getflag(handle, ns_f_rcode));
     }
 
     nanswers = ns_msg_count(handle, ns_s_an);
@@ -1334,7 +1411,7 @@ void *_lookup_dnskey(const char *label) {
 
         if (ns_parserr(&handle, ns_s_an, i, &rr) < 0) {
             PUSH_ERROR_RESOLVER("ns_parserr");
-            RET_ERROR_PTR(ERR_UNSPEC, "error in parsing DNSKEY request answers [1]");
+            RET_ERROR_INT(ERR_UNSPEC, "error in parsing DNSKEY request answers [1]");
         }
 
         if (ns_rr_class(rr) != ns_c_in) {
@@ -1358,7 +1435,7 @@ void *_lookup_dnskey(const char *label) {
         if ((dnskey = _add_dnskey_entry(ns_rr_name(rr), ns_rr_rdata(rr), ns_rr_rdlen(rr), ns_rr_ttl(rr)))) {
 
             if (!(allkeys = _ptr_chain_add(allkeys, dnskey))) {
-                RET_ERROR_PTR(ERR_UNSPEC, "could not add DNSKEY RR to chain");
+                RET_ERROR_INT(ERR_UNSPEC, "could not add DNSKEY RR to chain");
             }
         } else {
             fprintf(stderr, "Error adding DNSKEY entry for RRSIG verification.\n");
@@ -1376,7 +1453,7 @@ void *_lookup_dnskey(const char *label) {
                 free(allkeys);
             }
 
-            RET_ERROR_PTR(ERR_UNSPEC, "error in parsing DNSKEY request answers [2]");
+            RET_ERROR_INT(ERR_UNSPEC, "error in parsing DNSKEY request answers [2]");
         }
 
         if ((ns_rr_class(rr) != ns_c_in) || (ns_rr_type(rr) != T_RRSIG)) {
@@ -1386,12 +1463,17 @@ void *_lookup_dnskey(const char *label) {
 
         if (allkeys) {
             // The validation process works over the entire set of records.
-            if (_validate_rrsig_rr(ns_rr_name(rr), &handle, T_DNSKEY, ns_rr_rdata(rr), ns_rr_rdlen(rr), &skey) < 0) {
+            if ((vval = _validate_rrsig_rr(ns_rr_name(rr), &handle, T_DNSKEY, ns_rr_rdata(rr), ns_rr_rdlen(rr), &skey)) < 0) {
                 fprintf(stderr, "Error: could not validate RRSIG over DNSKEY record:\n");
                 dump_error_stack();
                 _clear_error_stack();
             }
 
+            // Only a key whose signature checked out may vouch for the records.
+            if (vval != 1) {
+                continue;
+            }
+
             // So once we get the first one it's just a matter of copying it over to the rest.
             for (dptr = allkeys; *dptr; dptr++) {
                 // We ignore this potential error. Should we?
@@ -1411,8 +1493,7 @@ void *_lookup_dnskey(const char *label) {
         free(allkeys);
     }
 
-    // TODO: this needs to be changed
-    return NULL;
+    return 0;
 }
 
 
@@ -1422,15 +1503,8 @@ void *_lookup_dnskey(const char *label) {
  */
 void *_lookup_ds(const char *label) {
 
-    ns_msg handle;
-    ns_rr rr;
-    ds_rr_t *dsr;
-    dnskey_t *dnskey, *skey;
-    ds_t *ds, **dsptr, **allds = NULL;
-    unsigned char resbuf[4096], hashbuf[64];
+    unsigned char resbuf[4096];
     int nread;
-    uint16_t nanswers, rrtype;
-    size_t hsize;
 
     if (!label) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
@@ -1443,9 +1517,42 @@ void *_lookup_ds(const char *label) {
         RET_ERROR_PTR(ERR_UNSPEC, "error occurred in sending DS record query");
     }
 
-    if (ns_initparse(resbuf, nread, &handle) < 0) {
+    if (_process_ds_answer(resbuf, nread) < 0) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to process DS record answer");
+    }
+
+    // TODO: This needs to change.
+    return NULL;
+}
+
+
+/**
+ * @brief   Add the DS records in the answer to a DS query to the cache, link them to the DNSKEYs they cover, and validate them against their RRSIGs.
+ * @param   answer  a pointer to the raw DNS answer to a DS query.
+ * @param   alen    the length of the answer in bytes.
+ * @return  0 on success or -1 on failure.
+ */
+int _process_ds_answer(const unsigned char *answer, size_t alen) {
+
+    ns_msg handle;
+    ns_rr rr;
+    ds_rr_t *dsr;
+    dnskey_t *dnskey, *skey;
+    ds_t *ds, **dsptr, **allds = NULL;
+    unsigned char hashbuf[64];
+    uint16_t nanswers, rrtype;
+    size_t hsize;
+    int vval;
+
+    if (!answer) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (ns_initparse(answer, alen, &handle) < 0) {
         PUSH_ERROR_RESOLVER("ns_initparse");
-        RET_ERROR_PTR(ERR_UNSPEC, "error in parsing DS request answer");
+        RET_ERROR_INT(ERR_UNSPEC, "error in parsing DS request answer");
+    } else if (ns_msg_getflag(handle, ns_f_rcode)) {
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "DNS response rcode indicates an error: %u", ns_msg_getflag(handle, ns_f_rcode));
     }
 
     nanswers = ns_msg_count(handle, ns_s_an);
@@ -1456,7 +1563,7 @@ void *_lookup_ds(const char *label) {
 
         if (ns_parserr(&handle, ns_s_an, i, &rr) < 0) {
             PUSH_ERROR_RESOLVER("ns_parserr");
-            RET_ERROR_PTR(ERR_UNSPEC, "error in parsing DS request answers [1]");
+            RET_ERROR_INT(ERR_UNSPEC, "error in parsing DS request answers [1]");
         }
 
         if (ns_rr_class(rr) != ns_c_in) {
@@ -1515,7 +1622,7 @@ void *_lookup_ds(const char *label) {
         }
 
         if (!(allds = _ptr_chain_add(allds, ds))) {
-            RET_ERROR_PTR(ERR_UNSPEC, "could not add DS RR to chain");
+            RET_ERROR_INT(ERR_UNSPEC, "could not add DS RR to chain");
         }
 
         // See if there is a DNSKEY entry that this DS record validates.
@@ -1550,7 +1657,7 @@ void *_lookup_ds(const char *label) {
                 free(allds);
             }
 
-            RET_ERROR_PTR(ERR_UNSPEC, "error in parsing DS request answers [2]");
+            RET_ERROR_INT(ERR_UNSPEC, "error in parsing DS request answers [2]");
         }
 
         if ((ns_rr_class(rr) != ns_c_in) || (ns_rr_type(rr) != T_RRSIG)) {
@@ -1560,12 +1667,17 @@ void *_lookup_ds(const char *label) {
 
         if (allds) {
             // The validation process works over the entire set of records.
-            if (_validate_rrsig_rr(ns_rr_name(rr), &handle, T_DS, ns_rr_rdata(rr), ns_rr_rdlen(rr), &skey) < 0) {
+            if ((vval = _validate_rrsig_rr(ns_rr_name(rr), &handle, T_DS, ns_rr_rdata(rr), ns_rr_rdlen(rr), &skey)) < 0) {
                 fprintf(stderr, "Error: could not validate RRSIG over DS record:\n");
                 dump_error_stack();
                 _clear_error_stack();
             }
 
+            // Only a key whose signature checked out may vouch for the records.
+            if (vval != 1) {
+                continue;
+            }
+
             // So once we get the first one it's just a matter of copying it over to the rest.
             for (dsptr = allds; *dsptr; dsptr++) {
                 // We ignore this error. Should we?
@@ -1585,8 +1697,7 @@ void *_lookup_ds(const char *label) {
         free(allds);
     }
 
-    // TODO: This needs to change.
-    return NULL;
+    return 0;
 }
 
 
@@ -1598,17 +1709,9 @@ void *_lookup_ds(const char *label) {
  */
 char *_get_txt_record(const char *qstring, unsigned long *ttl, int *validated) {
 
-    ns_msg handle;
-    ns_rr rr;
-    dnskey_t *signing_key;
-    const unsigned char *strptr;
     unsigned char resbuf[4096];
-    const char *lname;
-    char *result = NULL;
-    int nread, vval, dnssec_rrs = 0;
-    size_t nanswers, nadditional, strsize, rdleft, rsize = 0;
-    uint16_t rrtype, z;
-    uint8_t ercode, version;
+    char *result;
+    int nread, vstate = 0;
 
     if (!qstring) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
@@ -1621,12 +1724,52 @@ char *_get_txt_record(const char *qstring, unsigned long *ttl, int *validated) {
         *validated = 0;
     }
 
-    if ((nread = res_query(qstring, ns_c_in, ns_t_txt, resbuf, sizeof(resbuf))) < 0) {
+    if (__atomic_load_n(&_dnssec_prefetch, __ATOMIC_RELAXED)) {
+        result = _get_txt_record_prefetched(qstring, ttl, &vstate);
+    } else if ((nread = res_query(qstring, ns_c_in, ns_t_txt, resbuf, sizeof(resbuf))) < 0) {
         PUSH_ERROR_RESOLVER("res_query");
         RET_ERROR_PTR(ERR_UNSPEC, "unable to send TXT record query");
+    } else {
+        result = _parse_txt_answer(resbuf, nread, ttl, &vstate);
+    }
+
+    if (validated) {
+        *validated = vstate;
     }
 
-    if (ns_initparse(resbuf, nread, &handle) < 0) {
+    return result;
+}
+
+
+/**
+ * @brief   Extract the TXT record from the answer to a TXT query, and validate it against its RRSIG.
+ * @param   answer      a pointer to the raw DNS answer to a TXT query.
+ * @param   alen        the length of the answer in bytes.
+ * @param   ttl         if not NULL, an optional pointer to a value that will store the TTL of the retrieved record on success.
+ * @param   validated   a pointer to a value that will be set to 1 if the record was validated by DNSSEC, -1 if DNSSEC
+ *                          validation failed, or 0 if the record was unsigned.
+ * @return  NULL on failure, or a pointer to a newly allocated null-terminated string containing the TXT record on success.
+ */
+char *_parse_txt_answer(const unsigned char *answer, size_t alen, unsigned long *ttl, int *validated) {
+
+    ns_msg handle;
+    ns_rr rr;
+    dnskey_t *signing_key;
+    const unsigned char *strptr;
+    const char *lname;
+    char *result = NULL;
+    int vval, dnssec_rrs = 0;
+    size_t nanswers, nadditional, strsize, rdleft, rsize = 0;
+    uint16_t rrtype, z;
+    uint8_t ercode, version;
+
+    if (!answer || !validated) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    *validated = 0;
+
+    if (ns_initparse(answer, alen, &handle) < 0) {
         PUSH_ERROR_RESOLVER("ns_initparse");
         RET_ERROR_PTR(ERR_UNSPEC, "unable to parse TXT record answer");
     }
@@ -1816,10 +1959,7 @@ char *_get_txt_record(const char *qstring, unsigned long *ttl, int *validated) {
     // If we get an RRSIG answer but the packet isn't marked as +dnssec, then we should discard the validation.
     if (!dnssec_rrs) {
         _dbgprint(1, "Error: Received RRSIG response but no DNSSEC flag in response. Discarding DNSSEC validation.\n");
-
-        if (validated) {
-            *validated = 0;
-        }
+        *validated = 0;
 
     }
 
@@ -1857,14 +1997,8 @@ void _free_mx_records(mx_record_t **mxs) {
  */
 mx_record_t **_get_mx_records(const char *qstring) {
 
-    ns_msg handle;
-    ns_rr rr;
-    mx_record_t **result = NULL, **rptr, *rentry, *oentry;
     unsigned char resbuf[4096];
-    char nbuf[MAXDNAME], *strptr;
     int nread;
-    size_t nanswers, rsize = 0;
-    uint16_t rrtype, pref;
 
     if (!qstring) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
@@ -1877,7 +2011,30 @@ mx_record_t **_get_mx_records(const char *qstring) {
         RET_ERROR_PTR(ERR_UNSPEC, "error occurred in sending MX record query");
     }
 
-    if (ns_initparse(resbuf, nread, &handle) < 0) {
+    return _parse_mx_answer(resbuf, nread);
+}
+
+
+/**
+ * @brief   Extract the MX records from the answer to an MX query.
+ * @param   answer  a pointer to the raw DNS answer to an MX query.
+ * @param   alen    the length of the answer in bytes.
+ * @return  NULL on failure, or a pointer to a null-entry terminated array of mx_record pointers, sorted by preference, on success.
+ */
+mx_record_t **_parse_mx_answer(const unsigned char *answer, size_t alen) {
+
+    ns_msg handle;
+    ns_rr rr;
+    mx_record_t **result = NULL, **rptr, *rentry, *oentry;
+    char nbuf[MAXDNAME], *strptr;
+    size_t nanswers, rsize = 0;
+    uint16_t rrtype, pref;
+
+    if (!answer) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (ns_initparse(answer, alen, &handle) < 0) {
         PUSH_ERROR_RESOLVER("ns_initparse");
         RET_ERROR_PTR(ERR_UNSPEC, "error in parsing MX request answer");
     }
@@ -1988,6 +2145,632 @@ mx_record_t **_get_mx_records(const char *qstring) {
 }
 
 
+/**
+ * @brief   Allocate the context that carries the callback of an asynchronous DNS lookup through the resolver.
+ * @param   name    a null-terminated string containing the name being looked up.
+ * @param   arg     the opaque argument to be passed to the lookup callback.
+ * @return  NULL on failure, or a pointer to the newly allocated context on success.
+ */
+static dns_async_ctx_t *_create_dns_async_ctx(const char *name, void *arg) {
+
+    dns_async_ctx_t *result;
+
+    if (!(result = malloc(sizeof(dns_async_ctx_t)))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_PTR(ERR_NOMEM, NULL);
+    }
+
+    memset(result, 0, sizeof(dns_async_ctx_t));
+    result->arg = arg;
+
+    if (!(result->name = strdup(name))) {
+        PUSH_ERROR_SYSCALL("strdup");
+        free(result);
+        RET_ERROR_PTR(ERR_NOMEM, NULL);
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief   Free the context of an asynchronous DNS lookup.
+ * @param   ctx     a pointer to the context to be destroyed.
+ */
+static void _destroy_dns_async_ctx(dns_async_ctx_t *ctx) {
+
+    free(ctx->name);
+    free(ctx->answer);
+    free(ctx);
+
+}
+
+
+/**
+ * @brief   Submit an asynchronous DNS query on behalf of one of the lookup routines below.
+ * @note    The lookup context is freed if the query could not be submitted.
+ * @return  0 on success or -1 on failure.
+ */
+static int _submit_dns_async_query(dns_resolver_t *resolver, dns_async_ctx_t *ctx, uint16_t type, dns_answer_cb_t handler) {
+
+    if (_submit_dns_query(resolver, ctx->name, type, handler, ctx) < 0) {
+        _destroy_dns_async_ctx(ctx);
+        RET_ERROR_INT(ERR_UNSPEC, "unable to submit asynchronous DNS query");
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   The resolver callback that processes the answer to an asynchronous DNSKEY or DS query.
+ */
+static void _dnskey_ds_answer_cb(int status, const unsigned char *answer, size_t alen, void *arg, int (*process)(const unsigned char *, size_t)) {
+
+    dns_async_ctx_t *ctx = (dns_async_ctx_t *)arg;
+
+    if (!status && (process(answer, alen) < 0)) {
+        status = -1;
+    }
+
+    ctx->lookup_cb(ctx->name, status, ctx->arg);
+
+    if (status < 0) {
+        _clear_error_stack();
+    }
+
+    _destroy_dns_async_ctx(ctx);
+
+}
+
+
+static void _dnskey_answer_cb(int status, const unsigned char *answer, size_t alen, void *arg) {
+
+    _dnskey_ds_answer_cb(status, answer, alen, arg, _process_dnskey_answer);
+
+}
+
+
+static void _ds_answer_cb(int status, const unsigned char *answer, size_t alen, void *arg) {
+
+    _dnskey_ds_answer_cb(status, answer, alen, arg, _process_ds_answer);
+
+}
+
+
+/**
+ * @brief   Parse the answer to an asynchronous TXT query, and hand the TXT record to the lookup callback.
+ */
+static void _deliver_txt_answer(dns_async_ctx_t *ctx, int status, const unsigned char *answer, size_t alen) {
+
+    unsigned long ttl = 0;
+    char *txt = NULL;
+    int validated = 0;
+
+    if (!status) {
+        txt = _parse_txt_answer(answer, alen, &ttl, &validated);
+    }
+
+    ctx->txt_cb(ctx->name, txt, ttl, validated, ctx->arg);
+
+    if (!txt) {
+        _clear_error_stack();
+    }
+
+    _destroy_dns_async_ctx(ctx);
+
+}
+
+
+/**
+ * @brief   The resolver callback that processes the answer to an asynchronous TXT query.
+ * @note    If the DNSSEC chain of the name is still being prefetched, the answer is held until the prefetch completes,
+ *              so that validating its RRSIG doesn't fall back to synchronous DNSKEY and DS lookups.
+ */
+static void _txt_answer_cb(int status, const unsigned char *answer, size_t alen, void *arg) {
+
+    dns_async_ctx_t *ctx = (dns_async_ctx_t *)arg;
+
+    if (!--ctx->pending) {
+        _deliver_txt_answer(ctx, status, answer, alen);
+        return;
+    }
+
+    ctx->status = status;
+
+    if (!status) {
+
+        if (!(ctx->answer = malloc(alen))) {
+            PUSH_ERROR_SYSCALL("malloc");
+            ctx->status = -1;
+        } else {
+            memcpy(ctx->answer, answer, alen);
+            ctx->alen = alen;
+        }
+
+    }
+
+}
+
+
+/**
+ * @brief   The completion callback of the DNSSEC chain prefetch started alongside an asynchronous TXT query.
+ */
+static void _txt_prefetch_cb(const char *label, int status, void *arg) {
+
+    dns_async_ctx_t *ctx = (dns_async_ctx_t *)arg;
+
+    // The TXT answer is validated regardless of whether the prefetch succeeded; any keys still missing will be looked up then.
+    (void)label;
+    (void)status;
+
+    if (!--ctx->pending) {
+        _deliver_txt_answer(ctx, ctx->status, ctx->answer, ctx->alen);
+    }
+
+}
+
+
+/**
+ * @brief   Submit an asynchronous TXT query, and prefetch the DNSSEC chain of the name alongside it if enabled.
+ * @return  0 on success or -1 on failure.
+ */
+static int _start_txt_lookup(dns_resolver_t *resolver, const char *qstring, dns_txt_cb_t callback, void *arg) {
+
+    dns_async_ctx_t *ctx;
+    int result;
+
+    if (!(ctx = _create_dns_async_ctx(qstring, arg))) {
+        RET_ERROR_INT(ERR_NOMEM, "unable to allocate TXT lookup context");
+    }
+
+    ctx->txt_cb = callback;
+    ctx->pending = 1;
+
+    if (_submit_dns_async_query(resolver, ctx, ns_t_txt, _txt_answer_cb) < 0) {
+        return -1;
+    }
+
+    // Neither callback can run until the resolver is polled, so the prefetch can still be added to the pending count.
+    if (__atomic_load_n(&_dnssec_prefetch, __ATOMIC_RELAXED)) {
+
+        if (!(result = _prefetch_dnssec_chain_async(resolver, qstring, _txt_prefetch_cb, ctx))) {
+            ctx->pending++;
+        } else if (result < 0) {
+            fprintf(stderr, "Error: could not prefetch DNSSEC chain for TXT record (continuing)...\n");
+            dump_error_stack();
+            _clear_error_stack();
+        }
+
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   The resolver callback that processes the answer to an asynchronous MX query.
+ */
+static void _mx_answer_cb(int status, const unsigned char *answer, size_t alen, void *arg) {
+
+    dns_async_ctx_t *ctx = (dns_async_ctx_t *)arg;
+    mx_record_t **mxs = NULL;
+
+    if (!status) {
+        mxs = _parse_mx_answer(answer, alen);
+    }
+
+    ctx->mx_cb(ctx->name, mxs, ctx->arg);
+
+    if (!mxs) {
+        _clear_error_stack();
+    }
+
+    _destroy_dns_async_ctx(ctx);
+
+}
+
+
+/**
+ * @brief   Look up the DNSKEY records of a domain asynchronously, adding them to the cache just like _lookup_dnskey().
+ * @param   resolver    a pointer to the resolver that will handle the query.
+ * @param   label       a null-terminated string containing the name of the domain to have its DNSKEY records queried.
+ * @param   callback    the routine to be called once the DNSKEY records have been processed, or the lookup has failed.
+ * @param   arg         an opaque argument to be passed to the callback.
+ * @return  0 if the lookup was started, or -1 on failure, in which case the callback will never be called.
+ */
+int _lookup_dnskey_async(dns_resolver_t *resolver, const char *label, dns_lookup_cb_t callback, void *arg) {
+
+    dns_async_ctx_t *ctx;
+
+    if (!resolver || !label || !callback) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(ctx = _create_dns_async_ctx(label, arg))) {
+        RET_ERROR_INT(ERR_NOMEM, "unable to allocate DNSKEY lookup context");
+    }
+
+    ctx->lookup_cb = callback;
+
+    return _submit_dns_async_query(resolver, ctx, T_DNSKEY, _dnskey_answer_cb);
+}
+
+
+/**
+ * @brief   Look up the DS records of a domain asynchronously, adding them to the cache just like _lookup_ds().
+ * @param   resolver    a pointer to the resolver that will handle the query.
+ * @param   label       a null-terminated string containing the name of the domain to have its DS records queried.
+ * @param   callback    the routine to be called once the DS records have been processed, or the lookup has failed.
+ * @param   arg         an opaque argument to be passed to the callback.
+ * @return  0 if the lookup was started, or -1 on failure, in which case the callback will never be called.
+ */
+int _lookup_ds_async(dns_resolver_t *resolver, const char *label, dns_lookup_cb_t callback, void *arg) {
+
+    dns_async_ctx_t *ctx;
+
+    if (!resolver || !label || !callback) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    _dbgprint(1, "Looking up DS record for [%s]\n", label);
+
+    if (!(ctx = _create_dns_async_ctx(label, arg))) {
+        RET_ERROR_INT(ERR_NOMEM, "unable to allocate DS lookup context");
+    }
+
+    ctx->lookup_cb = callback;
+
+    return _submit_dns_async_query(resolver, ctx, T_DS, _ds_answer_cb);
+}
+
+
+/**
+ * @brief   Get the answer to a DNS TXT record query asynchronously.
+ * @note    The TXT record passed to the callback belongs to the caller, and must be freed.
+ * @note    If DNSSEC prefetching has been enabled with _set_dnssec_prefetch(), the chain of trust of the name is prefetched
+ *              alongside the query, and the callback is only invoked once both have completed.
+ * @param   resolver    a pointer to the resolver that will handle the query.
+ * @param   qstring     a pointer to a null-terminated string containing the DNS query string.
+ * @param   callback    the routine to be called with the TXT record, or NULL if the query failed.
+ * @param   arg         an opaque argument to be passed to the callback.
+ * @return  0 if the query was started, or -1 on failure, in which case the callback will never be called.
+ */
+int _get_txt_record_async(dns_resolver_t *resolver, const char *qstring, dns_txt_cb_t callback, void *arg) {
+
+    if (!resolver || !qstring || !callback) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    // The root anchor is needed to validate the RRSIG over the answer.
+    if (!_dns_initialized && (_initialize_resolver() < 0)) {
+        RET_ERROR_INT(ERR_UNSPEC, "failed to initialize DNS resolver");
+    }
+
+    return _start_txt_lookup(resolver, qstring, callback, arg);
+}
+
+
+/**
+ * @brief   Retrieve the collection of MX records for a given domain asynchronously.
+ * @note    The MX records passed to the callback belong to the caller, and must be freed with _free_mx_records().
+ * @param   resolver    a pointer to the resolver that will handle the query.
+ * @param   qstring     a null-terminated string containing the domain name to be queried via DNS.
+ * @param   callback    the routine to be called with the MX records, or NULL if the query failed.
+ * @param   arg         an opaque argument to be passed to the callback.
+ * @return  0 if the query was started, or -1 on failure, in which case the callback will never be called.
+ */
+int _get_mx_records_async(dns_resolver_t *resolver, const char *qstring, dns_mx_cb_t callback, void *arg) {
+
+    dns_async_ctx_t *ctx;
+
+    if (!resolver || !qstring || !callback) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(ctx = _create_dns_async_ctx(qstring, arg))) {
+        RET_ERROR_INT(ERR_NOMEM, "unable to allocate MX lookup context");
+    }
+
+    ctx->mx_cb = callback;
+
+    return _submit_dns_async_query(resolver, ctx, ns_t_mx, _mx_answer_cb);
+}
+
+
+/**
+ * @brief   Check whether any DNSKEY records of a zone are already in the object cache.
+ * @param   zone    a null-terminated string containing the name of the zone.
+ * @return  1 if the zone has cached DNSKEY records, or 0 if it does not.
+ */
+static int _is_dnskey_cached(const char *zone) {
+
+    dnskey_t cmp;
+
+    memset(&cmp, 0, sizeof(cmp));
+    cmp.label = (char *)zone; /* won't be deallocated */
+
+    if (_find_cached_object_cmp(&cmp, &(cached_stores[cached_data_dnskey]), &_dnskey_domain_comparator)) {
+        return 1;
+    }
+
+    _clear_error_stack();
+
+    return 0;
+}
+
+
+/**
+ * @brief   Free a DNSSEC chain prefetch.
+ * @param   prefetch    a pointer to the prefetch to be destroyed.
+ */
+static void _destroy_dnssec_prefetch(dnssec_prefetch_t *prefetch) {
+
+    for (size_t i = 0; i < prefetch->nzones; i++) {
+        free(prefetch->dnskeys[i].answer);
+        free(prefetch->ds[i].answer);
+    }
+
+    free(prefetch->name);
+    free(prefetch);
+
+}
+
+
+/**
+ * @brief   Process the held answer to one of the queries of a DNSSEC chain prefetch.
+ * @param   query       a pointer to the prefetch query that was answered.
+ * @param   process     the routine that adds the records in the answer to the object cache.
+ */
+static void _process_dnssec_prefetch_query(dnssec_prefetch_query_t *query, int (*process)(const unsigned char *, size_t)) {
+
+    if (query->state != dnssec_prefetch_answered) {
+        return;
+    }
+
+    // Only a failure to process a real answer is worth counting; the intermediate names that aren't zones will just come back empty.
+    if (process(query->answer, query->alen) < 0) {
+        _dbgprint(1, "Could not process prefetched DNSSEC records for [%s].\n", query->zone);
+        _clear_error_stack();
+        query->prefetch->failures++;
+    }
+
+    free(query->answer);
+    query->answer = NULL;
+    query->state = dnssec_prefetch_done;
+
+}
+
+
+/**
+ * @brief   Process every answer of a DNSSEC chain prefetch whose dependencies are now in the object cache.
+ * @note    The RRSIG over a zone's DNSKEY RRset is made by one of the zone's own keys, so DNSKEY answers can be processed as soon as
+ *              they arrive. A DS RRset is linked to its zone's DNSKEYs and signed by a key from a zone further up, so it has to wait
+ *              until the DNSKEY queries of its own zone and of every zone above it have been processed.
+ * @param   prefetch    a pointer to the prefetch to be processed.
+ */
+static void _process_dnssec_prefetch(dnssec_prefetch_t *prefetch) {
+
+    for (size_t i = 0; i < prefetch->nzones; i++) {
+        _process_dnssec_prefetch_query(&(prefetch->dnskeys[i]), _process_dnskey_answer);
+    }
+
+    for (size_t i = prefetch->nzones; i > 0; i--) {
+
+        if (prefetch->dnskeys[i - 1].state != dnssec_prefetch_done) {
+            break;
+        }
+
+        _process_dnssec_prefetch_query(&(prefetch->ds[i - 1]), _process_ds_answer);
+    }
+
+}
+
+
+/**
+ * @brief   The resolver callback that receives the answer to one of the queries of a DNSSEC chain prefetch.
+ */
+static void _dnssec_prefetch_answer_cb(int status, const unsigned char *answer, size_t alen, void *arg) {
+
+    dnssec_prefetch_query_t *query = (dnssec_prefetch_query_t *)arg;
+    dnssec_prefetch_t *prefetch = query->prefetch;
+
+    query->state = dnssec_prefetch_done;
+
+    if (status < 0) {
+        _dbgprint(1, "Prefetch of DNSSEC records for [%s] failed.\n", query->zone);
+        prefetch->failures++;
+    } else if (!(query->answer = malloc(alen))) {
+        _dbgprint(1, "Could not allocate space for prefetched DNSSEC records for [%s].\n", query->zone);
+        prefetch->failures++;
+    } else {
+        memcpy(query->answer, answer, alen);
+        query->alen = alen;
+        query->state = dnssec_prefetch_answered;
+    }
+
+    _process_dnssec_prefetch(prefetch);
+
+    if (--prefetch->outstanding) {
+        return;
+    }
+
+    if (prefetch->failures) {
+        PUSH_ERROR_FMT(ERR_UNSPEC, "could not prefetch %zu DNSSEC record set(s) {name = %s}", prefetch->failures, prefetch->name);
+    }
+
+    prefetch->callback(prefetch->name, prefetch->failures ? -1 : 0, prefetch->arg);
+    _clear_error_stack();
+    _destroy_dnssec_prefetch(prefetch);
+
+}
+
+
+/**
+ * @brief   Prefetch the DNSSEC chain of trust for a name by querying the DNSKEY and DS records of every zone above it concurrently.
+ * @note    The answers are processed into the object cache as soon as the records they depend upon are there, so that by the time
+ *              the callback is invoked, validating an RRSIG over the name takes no further DNS lookups. This turns the cold
+ *              validation of a chain from one DNSKEY and DS round trip after another into about a single round trip.
+ *              Zones whose DNSKEYs are already cached are skipped, since their DS records were looked up along with them.
+ * @param   resolver    a pointer to the resolver that will handle the queries.
+ * @param   qname       a null-terminated string containing the name whose chain of trust is to be prefetched.
+ * @param   callback    the routine to be called once every query has been processed; its status is -1 if any of them failed.
+ * @param   arg         an opaque argument to be passed to the callback.
+ * @return  0 if the prefetch was started, 1 if the whole chain was already cached, in which case the callback will not be called,
+ *              or -1 on failure.
+ */
+int _prefetch_dnssec_chain_async(dns_resolver_t *resolver, const char *qname, dns_lookup_cb_t callback, void *arg) {
+
+    dnssec_prefetch_t *prefetch;
+    dnssec_prefetch_query_t *queries[2];
+    uint16_t types[2] = { T_DNSKEY, T_DS };
+    size_t nlen, nqueries = 0;
+    char *zone;
+
+    if (!resolver || !qname || !callback) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(prefetch = malloc(sizeof(dnssec_prefetch_t)))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_INT(ERR_NOMEM, "unable to allocate DNSSEC chain prefetch");
+    }
+
+    memset(prefetch, 0, sizeof(dnssec_prefetch_t));
+    prefetch->callback = callback;
+    prefetch->arg = arg;
+
+    if (!(prefetch->name = strdup(qname))) {
+        PUSH_ERROR_SYSCALL("strdup");
+        free(prefetch);
+        RET_ERROR_INT(ERR_NOMEM, "unable to allocate DNSSEC chain prefetch");
+    }
+
+    if ((nlen = strlen(prefetch->name)) && (prefetch->name[nlen - 1] == '.')) {
+        prefetch->name[nlen - 1] = 0;
+    }
+
+    // Every suffix of the name might be a zone cut. The root is left out, since its keys come from the trust anchor.
+    for (zone = prefetch->name; *zone && (prefetch->nzones < DNSSEC_PREFETCH_MAX_ZONES); zone++) {
+
+        if (*zone != '.') {
+            prefetch->dnskeys[prefetch->nzones].zone = prefetch->ds[prefetch->nzones].zone = zone;
+            prefetch->dnskeys[prefetch->nzones].prefetch = prefetch->ds[prefetch->nzones].prefetch = prefetch;
+            prefetch->nzones++;
+        }
+
+        if (!(zone = strchr(zone, '.'))) {
+            break;
+        }
+
+    }
+
+    for (size_t i = 0; i < prefetch->nzones; i++) {
+
+        if (_is_dnskey_cached(prefetch->dnskeys[i].zone)) {
+            _dbgprint(2, "Skipped prefetch of DNSSEC records for [%s]; DNSKEY is already cached.\n", prefetch->dnskeys[i].zone);
+            continue;
+        }
+
+        queries[0] = &(prefetch->dnskeys[i]);
+        queries[1] = &(prefetch->ds[i]);
+
+        for (size_t j = 0; j < 2; j++) {
+            nqueries++;
+
+            if (_submit_dns_query(resolver, queries[j]->zone, types[j], _dnssec_prefetch_answer_cb, queries[j]) < 0) {
+                _dbgprint(1, "Could not submit DNSSEC prefetch query for [%s].\n", queries[j]->zone);
+                _clear_error_stack();
+                continue;
+            }
+
+            queries[j]->state = dnssec_prefetch_pending;
+            prefetch->outstanding++;
+        }
+
+    }
+
+    if (!prefetch->outstanding) {
+        _destroy_dnssec_prefetch(prefetch);
+
+        if (nqueries) {
+            RET_ERROR_INT_FMT(ERR_UNSPEC, "unable to submit any DNSSEC prefetch queries for %s", qname);
+        }
+
+        return 1;
+    }
+
+    _dbgprint(1, "Prefetching DNSSEC chain for [%s] with %zu concurrent queries.\n", prefetch->name, prefetch->outstanding);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Enable or disable prefetching of the DNSSEC chain of trust by TXT record lookups.
+ * @note    When enabled, the DNSKEY and DS records of every zone above the queried name are requested concurrently with
+ *              the TXT record itself, so cold validation of the answer takes about one round trip instead of two per zone.
+ * @param   enabled     if non-zero, enables prefetching; otherwise, the chain is looked up one zone at a time during validation.
+ */
+void _set_dnssec_prefetch(int enabled) {
+
+    __atomic_store_n(&_dnssec_prefetch, enabled ? 1 : 0, __ATOMIC_RELAXED);
+
+}
+
+
+/**
+ * @brief   A TXT lookup callback that stores the result for _get_txt_record_prefetched().
+ */
+static void _store_txt_record_cb(const char *qstring, char *txt, unsigned long ttl, int validated, void *arg) {
+
+    dns_txt_result_t *result = (dns_txt_result_t *)arg;
+
+    (void)qstring;
+    result->txt = txt;
+    result->ttl = ttl;
+    result->validated = validated;
+
+}
+
+
+/**
+ * @brief   Get the answer to a DNS TXT record query, while prefetching the DNSSEC chain of trust of the name concurrently.
+ * @see     _get_txt_record()
+ */
+static char *_get_txt_record_prefetched(const char *qstring, unsigned long *ttl, int *validated) {
+
+    dns_resolver_t *resolver;
+    dns_txt_result_t result;
+
+    memset(&result, 0, sizeof(result));
+
+    if (!(resolver = _create_dns_resolver())) {
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to create DNS resolver");
+    }
+
+    if ((_start_txt_lookup(resolver, qstring, _store_txt_record_cb, &result) < 0) || (_run_dns_resolver(resolver) < 0)) {
+        _destroy_dns_resolver(resolver);
+        free(result.txt);
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to send TXT record query");
+    }
+
+    _destroy_dns_resolver(resolver);
+
+    if (!result.txt) {
+        RET_ERROR_PTR_FMT(ERR_UNSPEC, "unable to retrieve TXT record for %s", qstring);
+    }
+
+    if (ttl) {
+        *ttl = result.ttl;
+    }
+
+    *validated = result.validated;
+
+    return result.txt;
+}
+
+
 /**
  * @brief   Initialize the DNS resolver subsystem.
  * @return  -1 on failure or 0 on success.
@@ -1996,18 +2779,23 @@ int _initialize_resolver(void) {
 
     char *root_key_path;
 
-    if (!(root_key_path = _get_dime_dir_location(ROOT_KEY_FILE))) {
-        RET_ERROR_INT(ERR_UNSPEC, "unable to get location of root anchor file");
-    }
+    // The root anchor only has to be read once. One that is already cached, whether by an earlier call or from another file
+    // loaded with _load_dnskey_file(), is used as is.
+    if (!_is_dnskey_cached(".")) {
+
+        if (!(root_key_path = _get_dime_dir_location(ROOT_KEY_FILE))) {
+            RET_ERROR_INT(ERR_UNSPEC, "unable to get location of root anchor file");
+        }
+
+        if (_load_dnskey_file(root_key_path) < 0) {
+            PUSH_ERROR_FMT(ERR_UNSPEC, "could not load root public key from config file: %s", root_key_path);
+            free(root_key_path);
+            return -1;
+        }
 
-    if (_load_dnskey_file(root_key_path) < 0) {
-        PUSH_ERROR_FMT(ERR_UNSPEC, "could not load root public key from config file: %s", root_key_path);
         free(root_key_path);
-        return -1;
     }
 
-    free(root_key_path);
-
     if (res_init() < 0) {
         RET_ERROR_INT(ERR_UNSPEC, "unexpected error occurred in res_init()");
     }
@@ -2478,7 +3266,7 @@ void _fixup_dnskey_validation(void) {
     ptr = store->head;
 
     while (ptr) {
-        key = (dnskey_t *)ptr->data;
+        key = (dnskey_t *)_materialize_cached_object(ptr);
 
         if (key && (!key->validated)) {
 
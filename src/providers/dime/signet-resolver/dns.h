@@ -16,6 +16,7 @@
 #include <openssl/rsa.h>
 #include <openssl/err.h>
 #include "dime/common/error.h"
+#include "dime/signet-resolver/resolver.h"
 
 // TODO: Does DNSKEY RR have "key revoked" bit?
 //       SEP bit indicates KSK vs. 0=ZSK?
@@ -26,6 +27,8 @@
 
 #define IS_ROOT_LABEL(lname) (!lname || !strlen(lname) || *lname == '.')
 
+#define DNSSEC_PREFETCH_MAX_ZONES 16    ///< The maximum number of zones whose DNSSEC records are prefetched for a single name.
+
 
 
 #ifndef T_DNSKEY
@@ -124,6 +127,33 @@ typedef struct {
 } mx_record_t;
 
 
+/**
+ * @brief   The completion callback of an asynchronous DNSKEY or DS lookup.
+ * @param   label   the name of the domain that was looked up.
+ * @param   status  0 if the records were processed and added to the cache, or -1 on failure.
+ * @param   arg     the opaque argument that was passed when the lookup was started.
+ */
+typedef void (*dns_lookup_cb_t)(const char *label, int status, void *arg);
+
+/**
+ * @brief   The completion callback of an asynchronous TXT record lookup.
+ * @param   qstring     the DNS query string that was looked up.
+ * @param   txt         the TXT record, which must be freed by the callback, or NULL on failure.
+ * @param   ttl         the TTL of the TXT record.
+ * @param   validated   1 if the record was validated by DNSSEC, -1 if DNSSEC validation failed, or 0 if it was unsigned.
+ * @param   arg         the opaque argument that was passed when the lookup was started.
+ */
+typedef void (*dns_txt_cb_t)(const char *qstring, char *txt, unsigned long ttl, int validated, void *arg);
+
+/**
+ * @brief   The completion callback of an asynchronous MX record lookup.
+ * @param   qstring     the domain name that was looked up.
+ * @param   mxs         the MX records sorted by preference, which must be freed by the callback with _free_mx_records(), or NULL on failure.
+ * @param   arg         the opaque argument that was passed when the lookup was started.
+ */
+typedef void (*dns_mx_cb_t)(const char *qstring, mx_record_t **mxs, void *arg);
+
+
 
 // Public DNS interface.
 PUBLIC_FUNC_DECL(int,            load_dnskey_file,        const char *filename);
@@ -145,10 +175,22 @@ PUBLIC_FUNC_DECL(char *,         get_txt_record,          const char *qstring, u
 PUBLIC_FUNC_DECL(mx_record_t **, get_mx_records,          const char *qstring);
 PUBLIC_FUNC_DECL(void,           free_mx_records,         mx_record_t **mxs);
 
+PUBLIC_FUNC_DECL(int,            lookup_dnskey_async,     dns_resolver_t *resolver, const char *label, dns_lookup_cb_t callback, void *arg);
+PUBLIC_FUNC_DECL(int,            lookup_ds_async,         dns_resolver_t *resolver, const char *label, dns_lookup_cb_t callback, void *arg);
+PUBLIC_FUNC_DECL(int,            get_txt_record_async,    dns_resolver_t *resolver, const char *qstring, dns_txt_cb_t callback, void *arg);
+PUBLIC_FUNC_DECL(int,            get_mx_records_async,    dns_resolver_t *resolver, const char *qstring, dns_mx_cb_t callback, void *arg);
+PUBLIC_FUNC_DECL(int,            prefetch_dnssec_chain_async, dns_resolver_t *resolver, const char *qname, dns_lookup_cb_t callback, void *arg);
+PUBLIC_FUNC_DECL(void,           set_dnssec_prefetch,     int enabled);
+
 
 // Internal routines
 int        _initialize_resolver(void);
 
+int           _process_dnskey_answer(const unsigned char *answer, size_t alen);
+int           _process_ds_answer(const unsigned char *answer, size_t alen);
+char *        _parse_txt_answer(const unsigned char *answer, size_t alen, unsigned long *ttl, int *validated);
+mx_record_t **_parse_mx_answer(const unsigned char *answer, size_t alen);
+
 dnskey_t *_add_dnskey_entry(const char *label, const unsigned char *buf, size_t len, unsigned long ttl);
 dnskey_t *_add_dnskey_entry_rsa(const char *label, uint16_t flags, unsigned char algorithm, RSA *pubkey, unsigned int keytag, const unsigned char *rdata,
                                 size_t rdlen, unsigned long ttl, unsigned int do_cache, int forced);
@@ -480,75 +480,111 @@ dime_record_t *_parse_dime_record(const char *txt, size_t len) {
 }
 
 /**
- * @brief   Retrieve a DIME management record for a given dark domain via DNS.
- * @param   domain      a null-terminated string containing the name of the dark domain to be queried.
- * @param   ttl     an optional pointer to a variable that will receive the current TTL value of the DIME record's TXT RR.
- * @param   use_cache   if set, use the cache as the first-line resolver; if 0, only perform live network lookups.
- * @return  NULL on failure, or a pointer to a populated dime_record_t structure on success.
+ * @brief   Fetch a DIME management record again, and replace its cached entry with the new record.
+ * @note    The refreshed record retains the original expiration of the cached entry, for security purposes.
+ * @param   domain  a null-terminated string containing the name of the dark domain whose record is to be refreshed.
+ * @param   cached  a pointer to a copy of the cached object holding the DIME record to be refreshed.
+ * @param   ttl     an optional pointer to a variable that will receive the TTL value of the refreshed record's TXT RR.
+ * @return  NULL on failure, or a pointer to a copy of the refreshed DIME record on success.
+ * @free_using{_destroy_dime_record}
  */
-dime_record_t *_get_dime_record(const char *domain, unsigned long *ttl, int use_cache) {
+dime_record_t *_refresh_cached_dime_record(const char *domain, const cached_object_t *cached, unsigned long *ttl) {
 
-    cached_object_t *cached, *newobj, *cloned;
+    cached_store_t *store = &(cached_stores[cached_data_drec]);
+    cached_object_t *newobj, *live, *copy;
     dime_record_t *result;
-    char *qstr, *txtans;
-    size_t qlen;
-    int validated, refresh = 0;
+    unsigned long rttl = 0;
 
-    if (!domain) {
+    if (!domain || !cached) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
-// TODO: This needs cleanup. We should not be using any internal functions, if possible.
-    if (use_cache && (cached = _find_cached_object(domain, &(cached_stores[cached_data_drec])))) {
+    if (!(result = _get_dime_record(domain, &rttl, 0))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "could not fetch DIME record again");
+    }
 
-        // In this case, we have a DIME management record with an expired TTL, but that has not yet reached
-        // its absolute expiration date. The desired behavior is to fetch the requested record again,
-        // returning all supplied data, except preserving the original expiration timestamp for security purposes.
-        if (!_is_object_expired(cached, &refresh) && refresh) {
-            _dbgprint(1, "Attempting to refresh DIME record that exceeded TTL.\n");
+    if (ttl) {
+        *ttl = rttl;
+    }
 
-            if ((result = _get_dime_record(domain, ttl, 0))) {
-                // Attach the old expiration to the new record.
-                result->expiry = cached->expiration;
+    // Attach the old expiration to the new record.
+    result->expiry = cached->expiration;
 
-                // If for some reason we get a cache error, report it but return the old (original value).
-                if (!(newobj = _create_cached_object(cached_data_drec, (ttl ? *ttl : 0), cached->expiration, result, 1, 1))) {
-                    fprintf(stderr, "Error: unable to refresh cached DIME management record entry.\n");
-                    _destroy_dime_record(result);
-                    return ((dime_record_t *)_get_cache_obj_data(cached));
-                }
+    if (!(newobj = _create_cached_object(cached_data_drec, rttl, cached->expiration, result, 1, 1))) {
+        _destroy_dime_record(result);
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to refresh cached DIME management record entry");
+    }
 
-                if (!_replace_object(cached, newobj, 0)) {
-                    fprintf(stderr, "Error: unable to update cached DIME management record entry.\n");
-                    _destroy_cache_entry(newobj);
-                    return ((dime_record_t *)_get_cache_obj_data(cached));
-                }
+    // Remember the domain, so that the record can be refreshed again ahead of its next expiration.
+    if (!(newobj->name = strdup(domain))) {
+        _destroy_cache_entry(newobj);
+        PUSH_ERROR_SYSCALL("strdup");
+        RET_ERROR_PTR(ERR_NOMEM, NULL);
+    }
 
-                _dbgprint(1, "Successfully refreshed DIME record; retaining old expiry.\n");
-                // TODO: does this need to be wrapped?
-                return ((dime_record_t *)newobj->data);
-            } else {
+    // We only hold a copy of the cached object, so it's the live cached object that needs to be replaced. It is published, and
+    // journaled, while the store is still locked, since the new object may be evicted or replaced again as soon as it's unlocked.
+    _lock_cache_store(store);
 
-                if (get_last_error()) {
-                    fprintf(stderr, "Error: could not refresh DIME record.\n");
-                    dump_error_stack();
-                    _clear_error_stack();
-                } else {
-                    fprintf(stderr, "Error: unable to refresh DIME record that exceeded TTL.\n");
-                }
+    if (!(live = _index_find_object(store, cached->id)) || !(copy = _publish_cached_object(store, newobj, live, 0, NULL))) {
+        _unlock_cache_store(store);
+        _destroy_cache_entry(newobj);
+        RET_ERROR_PTR(ERR_UNSPEC, "unable to update cached DIME management record entry");
+    }
 
-            }
+    _unlock_cache_store(store);
+    _enforce_cache_budget(store);
 
-        }
+    // The caller gets its own copy of the record, just like on any other cache lookup.
+    return ((dime_record_t *)_get_cache_obj_data(copy));
+}
 
-        _dbgprint(2, "Returning cached DIME record.\n");
-        return ((dime_record_t *)_get_cache_obj_data(cached));
-    } else if (use_cache && get_last_error()) {
-        fprintf(stderr, "Error: could not lookup DIME record in cache.\n");
+
+/**
+ * @brief   Refresh a hot DIME management record in the object cache before it expires.
+ * @param   obj     a pointer to a copy of the cached object holding the DIME record, with the domain in its name field.
+ */
+void _refresh_dime_record_cb(cached_object_t *obj) {
+
+    cached_flight_t *flight;
+    dime_record_t *record;
+
+    if (!obj || !obj->name) {
+        return;
+    }
+
+    // There's nothing to do if a lookup of the record is already in progress.
+    if (!_begin_cached_flight(obj->name, &(cached_stores[cached_data_drec]), 0, &flight)) {
+        return;
+    }
+
+    if (!(record = _refresh_cached_dime_record(obj->name, obj, NULL))) {
+        fprintf(stderr, "Error: could not refresh DIME record ahead of its expiration: %s\n", obj->name);
         dump_error_stack();
         _clear_error_stack();
+    } else {
+        _destroy_dime_record(record);
     }
 
+    _end_cached_flight(flight);
+}
+
+
+/**
+ * @brief   Look up a DIME management record for a given dark domain via DNS, and optionally store it in the object cache.
+ * @param   domain      a null-terminated string containing the name of the dark domain to be queried.
+ * @param   ttl         an optional pointer to a variable that will receive the current TTL value of the DIME record's TXT RR.
+ * @param   use_cache   if set, store the DIME record in the object cache.
+ * @return  NULL on failure, or a pointer to a populated dime_record_t structure on success.
+ */
+static dime_record_t *_fetch_dime_record(const char *domain, unsigned long *ttl, int use_cache) {
+
+    cached_object_t *cloned;
+    dime_record_t *result;
+    char *qstr, *txtans;
+    size_t qlen;
+    int validated;
+
     // 2 extra bytes for the "." label separator and for the terminating null.
     qlen = strlen(domain) + strlen(DIME_RECORD_DNS_PREFIX) + 2;
 
@@ -587,6 +623,88 @@ dime_record_t *_get_dime_record(const char *domain, unsigned long *ttl, int use_
 }
 
 
+/**
+ * @brief   Retrieve a DIME management record for a given dark domain via DNS.
+ * @note    When the cache is used, concurrent misses for the same record are coalesced: the first thread looks it up, and the
+ *              rest wait for it to finish and share the record it cached, or fail along with it. Likewise, only one thread
+ *              at a time refreshes a record whose TTL has expired, while the others carry on returning the cached record.
+ * @param   domain      a null-terminated string containing the name of the dark domain to be queried.
+ * @param   ttl     an optional pointer to a variable that will receive the current TTL value of the DIME record's TXT RR.
+ * @param   use_cache   if set, use the cache as the first-line resolver; if 0, only perform live network lookups.
+ * @return  NULL on failure, or a pointer to a populated dime_record_t structure on success.
+ */
+dime_record_t *_get_dime_record(const char *domain, unsigned long *ttl, int use_cache) {
+
+    cached_store_t *store = &(cached_stores[cached_data_drec]);
+    cached_flight_t *flight;
+    cached_object_t *cached;
+    dime_record_t *result;
+    int leader, refresh = 0;
+
+    if (!domain) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!use_cache) {
+        return _fetch_dime_record(domain, ttl, 0);
+    }
+
+// TODO: This needs cleanup. We should not be using any internal functions, if possible.
+    if ((cached = _find_cached_object(domain, store))) {
+
+        // In this case, we have a DIME management record with an expired TTL, but that has not yet reached
+        // its absolute expiration date. The desired behavior is to fetch the requested record again,
+        // returning all supplied data, except preserving the original expiration timestamp for security purposes.
+        // If another thread is already refreshing the record, we just return the cached copy in the meantime.
+        if (!_is_object_expired(cached, &refresh) && refresh && _begin_cached_flight(domain, store, 0, &flight)) {
+            _dbgprint(1, "Attempting to refresh DIME record that exceeded TTL.\n");
+            result = _refresh_cached_dime_record(domain, cached, ttl);
+            _end_cached_flight(flight);
+
+            if (result) {
+                _destroy_cache_entry(cached);
+                _dbgprint(1, "Successfully refreshed DIME record; retaining old expiry.\n");
+                // TODO: does this need to be wrapped?
+                return result;
+            }
+
+            // If for some reason we get a cache error, report it but return the old (original value).
+            fprintf(stderr, "Error: unable to refresh DIME record that exceeded TTL.\n");
+            dump_error_stack();
+            _clear_error_stack();
+        }
+
+        _dbgprint(2, "Returning cached DIME record.\n");
+        return ((dime_record_t *)_get_cache_obj_data(cached));
+    } else if (get_last_error()) {
+        fprintf(stderr, "Error: could not lookup DIME record in cache.\n");
+        dump_error_stack();
+        _clear_error_stack();
+    }
+
+    // Only one thread looks up a missing record at a time. The cache is checked again afterwards, since this thread either
+    // waited for another one to look up the record, or may have just missed a lookup that finished ahead of it.
+    leader = _begin_cached_flight(domain, store, 1, &flight);
+
+    if ((cached = _find_cached_object(domain, store))) {
+        _end_cached_flight(flight);
+        _dbgprint(2, "Returning cached DIME record.\n");
+        return ((dime_record_t *)_get_cache_obj_data(cached));
+    }
+
+    _clear_error_stack();
+
+    if (!leader) {
+        RET_ERROR_PTR(ERR_UNSPEC, "concurrent lookup of the same DIME record failed");
+    }
+
+    result = _fetch_dime_record(domain, ttl, 1);
+    _end_cached_flight(flight);
+
+    return result;
+}
+
+
 /**
  * @brief   Validate the syntax of a DIME record for correctness.
  * @param   record  a pointer to the DIME management record to be validated.
@@ -10,6 +10,7 @@
 #include <openssl/rsa.h>
 #include "dime/common/dcrypto.h"
 #include "dime/common/error.h"
+#include "dime/signet-resolver/cache.h"
 
 
 #define DIME_VERSION_NO        1
@@ -55,5 +56,8 @@ void  _destroy_dime_record_cb(void *record);
 void  _dump_dime_record_cb(FILE *, void *record, int brief);
 void *_deserialize_dime_record_cb(void *data, size_t len);
 void *_serialize_dime_record_cb(void *record, size_t *outlen);
+void  _refresh_dime_record_cb(cached_object_t *obj);
+
+dime_record_t *_refresh_cached_dime_record(const char *domain, const cached_object_t *cached, unsigned long *ttl);
 
 #endif
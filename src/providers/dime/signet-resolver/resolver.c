@@ -0,0 +1,770 @@
+#include <errno.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <arpa/nameser_compat.h>
+#include <resolv.h>
+#include <strings.h>
+
+#include "dime/signet-resolver/resolver.h"
+#include "dime/common/dcrypto.h"
+#include "dime/common/misc.h"
+#include "dime/common/error.h"
+
+// The EDNS0 OPT pseudo-RR appended to every query: a root owner name, then type, UDP payload size, TTL (with the DO bit) and rdlen.
+#define DNS_OPT_RR_SIZE 11
+
+
+/**
+ * @brief   Get the current value of the monotonic clock in milliseconds, for query deadlines.
+ * @return  the number of milliseconds elapsed since an arbitrary point in time.
+ */
+static uint64_t _dns_clock(void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+
+/**
+ * @brief   Check whether a datagram came from the address of a particular nameserver.
+ * @param   from        a pointer to the source address of the datagram.
+ * @param   server      a pointer to the address of the nameserver.
+ * @return  1 if the two addresses (and ports) match, or 0 if they do not.
+ */
+static int _is_dns_server_address(const struct sockaddr_storage *from, const struct sockaddr_storage *server) {
+
+    const struct sockaddr_in *a4 = (const struct sockaddr_in *)from, *b4 = (const struct sockaddr_in *)server;
+    const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)from, *b6 = (const struct sockaddr_in6 *)server;
+
+    if (from->ss_family != server->ss_family) {
+        return 0;
+    } else if (from->ss_family == AF_INET) {
+        return ((a4->sin_port == b4->sin_port) && (a4->sin_addr.s_addr == b4->sin_addr.s_addr));
+    } else if (from->ss_family == AF_INET6) {
+        return ((a6->sin6_port == b6->sin6_port) && !memcmp(&(a6->sin6_addr), &(b6->sin6_addr), sizeof(a6->sin6_addr)));
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Remove a query from the list of a resolver's outstanding queries.
+ * @param   resolver    a pointer to the resolver that the query was submitted to.
+ * @param   query       a pointer to the query to be removed.
+ */
+static void _unlink_dns_query(dns_resolver_t *resolver, dns_query_t *query) {
+
+    dns_query_t **ptr;
+
+    for (ptr = &(resolver->queries); *ptr; ptr = &((*ptr)->next)) {
+
+        if (*ptr == query) {
+            *ptr = query->next;
+            query->next = NULL;
+            resolver->pending--;
+            break;
+        }
+
+    }
+
+}
+
+
+/**
+ * @brief   Create an asynchronous DNS resolver, which can have many queries outstanding at once.
+ * @note    The resolver uses the nameservers, timeout and retry count of the system resolver. A resolver must only be
+ *              used by one thread at a time, and its queries only make progress while it is being polled.
+ * @return  NULL on failure, or a pointer to the newly allocated resolver on success.
+ * @free_using{_destroy_dns_resolver}
+ */
+dns_resolver_t *_create_dns_resolver(void) {
+
+    dns_resolver_t *result;
+    struct sockaddr_in *sin;
+
+    if (!(result = malloc(sizeof(dns_resolver_t)))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_PTR(ERR_NOMEM, NULL);
+    }
+
+    memset(result, 0, sizeof(dns_resolver_t));
+    result->timeout = DNS_DEFAULT_TIMEOUT;
+    result->retries = DNS_DEFAULT_RETRIES;
+
+    if (res_init() < 0) {
+        _dbgprint(1, "Could not initialize system resolver; falling back to local nameserver.\n");
+    } else {
+
+        if (_res.retrans > 0) {
+            result->timeout = _res.retrans * 1000;
+        }
+
+        if (_res.retry > 0) {
+            result->retries = _res.retry;
+        }
+
+        for (int i = 0; (i < _res.nscount) && (result->nservers < DNS_RESOLVER_MAX_SERVERS); i++) {
+
+            if (_res.nsaddr_list[i].sin_family == AF_INET) {
+                memcpy(&(result->servers[result->nservers]), &(_res.nsaddr_list[i]), sizeof(struct sockaddr_in));
+                result->server_lens[result->nservers++] = sizeof(struct sockaddr_in);
+            }
+#ifdef __GLIBC__
+            // IPv6 nameservers are kept in an extension of the resolver state.
+            else if (_res._u._ext.nsaddrs[i] && (_res._u._ext.nsaddrs[i]->sin6_family == AF_INET6)) {
+                memcpy(&(result->servers[result->nservers]), _res._u._ext.nsaddrs[i], sizeof(struct sockaddr_in6));
+                result->server_lens[result->nservers++] = sizeof(struct sockaddr_in6);
+            }
+#endif
+
+        }
+
+    }
+
+    // Just like the system resolver, fall back to a nameserver on the local host.
+    if (!result->nservers) {
+        sin = (struct sockaddr_in *)&(result->servers[0]);
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(NS_DEFAULTPORT);
+        sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        result->server_lens[0] = sizeof(struct sockaddr_in);
+        result->nservers = 1;
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief   Destroy an asynchronous DNS resolver.
+ * @note    Any queries that are still outstanding are failed, so that their callbacks get a chance to clean up after them.
+ * @param   resolver    a pointer to the resolver to be destroyed.
+ */
+void _destroy_dns_resolver(dns_resolver_t *resolver) {
+
+    if (!resolver) {
+        return;
+    }
+
+    while (resolver->queries) {
+        _fail_dns_query(resolver, resolver->queries, "DNS resolver was destroyed");
+    }
+
+    free(resolver);
+
+}
+
+
+/**
+ * @brief   Direct all of a resolver's queries to a single nameserver, instead of those of the system resolver.
+ * @param   resolver    a pointer to the resolver to be configured.
+ * @param   addr        a pointer to the IPv4 or IPv6 socket address (including the port) of the nameserver.
+ * @param   addrlen     the length of the nameserver address.
+ * @return  0 on success or -1 on failure.
+ */
+int _set_dns_resolver_server(dns_resolver_t *resolver, const struct sockaddr *addr, socklen_t addrlen) {
+
+    if (!resolver || !addr || !addrlen || (addrlen > sizeof(struct sockaddr_storage))) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    } else if ((addr->sa_family != AF_INET) && (addr->sa_family != AF_INET6)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, "nameserver must have an IPv4 or IPv6 address");
+    } else if (resolver->pending) {
+        RET_ERROR_INT(ERR_UNSPEC, "cannot change nameserver while DNS queries are outstanding");
+    }
+
+    memset(resolver->servers, 0, sizeof(resolver->servers));
+    memset(resolver->server_lens, 0, sizeof(resolver->server_lens));
+    memcpy(&(resolver->servers[0]), addr, addrlen);
+    resolver->server_lens[0] = addrlen;
+    resolver->nservers = 1;
+
+    return 0;
+}
+
+
+/**
+ * @brief   Submit an asynchronous DNS query to a resolver.
+ * @note    The query is sent straight away, but its callback is only invoked from _poll_dns_resolver() or
+ *              _run_dns_resolver(). Like the system resolver, queries request DNSSEC records with an EDNS0 OPT RR.
+ * @param   resolver    a pointer to the resolver that will handle the query.
+ * @param   name        a null-terminated string containing the domain name to be queried.
+ * @param   type        the type of RR being queried (e.g. ns_t_txt).
+ * @param   callback    the routine to be called with the answer once the query completes or fails.
+ * @param   arg         an opaque argument to be passed to the callback.
+ * @return  0 if the query was submitted, or -1 on failure, in which case the callback will never be called.
+ */
+int _submit_dns_query(dns_resolver_t *resolver, const char *name, uint16_t type, dns_answer_cb_t callback, void *arg) {
+
+    dns_query_t *query;
+    HEADER *hdr;
+    unsigned char qbuf[HFIXEDSZ + MAXCDNAME + QFIXEDSZ + DNS_OPT_RR_SIZE], *optr;
+    uint16_t id;
+    int qlen;
+
+    if (!resolver || !name || !callback) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if ((qlen = res_mkquery(ns_o_query, name, ns_c_in, type, NULL, 0, NULL, qbuf, sizeof(qbuf) - DNS_OPT_RR_SIZE)) < 0) {
+        PUSH_ERROR_RESOLVER("res_mkquery");
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "unable to build DNS query for %s", name);
+    }
+
+    optr = qbuf + qlen;
+    *optr++ = 0;
+    NS_PUT16(ns_t_opt, optr);
+    NS_PUT16(DNS_EDNS_UDP_SIZE, optr);
+    NS_PUT32(NS_OPT_DNSSEC_OK, optr);
+    NS_PUT16(0, optr);
+    qlen += DNS_OPT_RR_SIZE;
+
+    hdr = (HEADER *)qbuf;
+    hdr->arcount = htons(ntohs(hdr->arcount) + 1);
+
+    // Answers are matched to their queries by message id, so ids must be unpredictable and unique among outstanding queries.
+    do {
+
+        if (_get_random_bytes(&id, sizeof(id)) < 0) {
+            RET_ERROR_INT(ERR_UNSPEC, "unable to generate DNS query id");
+        }
+
+    } while (_find_dns_query(resolver, id));
+
+    hdr->id = id;
+
+    if (!(query = malloc(sizeof(dns_query_t)))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_INT(ERR_NOMEM, NULL);
+    }
+
+    memset(query, 0, sizeof(dns_query_t));
+    query->udp_fd = query->tcp_fd = -1;
+    query->id = id;
+    query->type = type;
+    query->plen = qlen;
+    query->callback = callback;
+    query->arg = arg;
+
+    if (!(query->name = strdup(name)) || !(query->packet = malloc(qlen + 2))) {
+        PUSH_ERROR_SYSCALL(query->name ? "malloc" : "strdup");
+        _destroy_dns_query(query);
+        RET_ERROR_INT(ERR_NOMEM, NULL);
+    }
+
+    query->packet[0] = (qlen >> 8) & 0xff;
+    query->packet[1] = qlen & 0xff;
+    memcpy(query->packet + 2, qbuf, qlen);
+
+    query->next = resolver->queries;
+    resolver->queries = query;
+    resolver->pending++;
+
+    if (_send_dns_query(resolver, query) < 0) {
+        _unlink_dns_query(resolver, query);
+        _destroy_dns_query(query);
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "unable to send DNS query for %s", name);
+    }
+
+    _dbgprint(3, "Submitted DNS query for [%s], type %u, id %.4x.\n", name, type, ntohs(id));
+
+    return 0;
+}
+
+
+/**
+ * @brief   Send (or resend) a query over UDP to the next nameserver in the resolver's rotation.
+ * @note    Every attempt goes out over a fresh socket, so that the kernel picks a new random source port for it, and
+ *              an off-path attacker has to guess the port as well as the message id to spoof an answer. The socket is
+ *              connected to the nameserver, so datagrams from anywhere else never reach it.
+ *          A datagram that couldn't be sent is treated as if it had been lost, and left for the retransmission timer.
+ * @param   resolver    a pointer to the resolver handling the query.
+ * @param   query       a pointer to the query to be sent.
+ * @return  0 on success or -1 if no UDP socket could be opened.
+ */
+int _send_dns_query(dns_resolver_t *resolver, dns_query_t *query) {
+
+    struct sockaddr *addr;
+
+    if (!resolver || !query) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (query->udp_fd >= 0) {
+        close(query->udp_fd);
+    }
+
+    query->server = query->attempts % resolver->nservers;
+    addr = (struct sockaddr *)&(resolver->servers[query->server]);
+
+    if ((query->udp_fd = socket(addr->sa_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        PUSH_ERROR_SYSCALL("socket");
+        RET_ERROR_INT(ERR_UNSPEC, "unable to open UDP socket for DNS query");
+    }
+
+    query->state = dns_query_udp;
+    query->attempts++;
+    query->deadline = _dns_clock() + resolver->timeout;
+
+    if ((connect(query->udp_fd, addr, resolver->server_lens[query->server]) < 0) || (send(query->udp_fd, query->packet + 2, query->plen, 0) < 0)) {
+        _dbgprint(2, "Could not send DNS query for [%s]: %s\n", query->name, strerror(errno));
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Find one of a resolver's outstanding queries by its message id.
+ * @param   resolver    a pointer to the resolver to be searched.
+ * @param   id          the message id of the query, in network byte order.
+ * @return  a pointer to the matching query, or NULL if there is no outstanding query with that id.
+ */
+dns_query_t *_find_dns_query(dns_resolver_t *resolver, uint16_t id) {
+
+    dns_query_t *ptr;
+
+    if (!resolver) {
+        return NULL;
+    }
+
+    for (ptr = resolver->queries; ptr; ptr = ptr->next) {
+
+        if (ptr->id == id) {
+            return ptr;
+        }
+
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief   Check that a DNS answer is a response to the exact question asked by a query.
+ * @param   query   a pointer to the query that the answer claims to respond to.
+ * @param   answer  a pointer to the raw DNS answer.
+ * @param   alen    the length of the answer in bytes.
+ * @return  1 if the answer responds to the query's question, or 0 if it does not.
+ */
+int _check_dns_answer(const dns_query_t *query, const unsigned char *answer, size_t alen) {
+
+    ns_msg handle;
+    ns_rr rr;
+    size_t qlen, alabel;
+
+    if (!query || !answer) {
+        return 0;
+    }
+
+    if ((ns_initparse(answer, alen, &handle) < 0) || !ns_msg_getflag(handle, ns_f_qr) || (ns_msg_count(handle, ns_s_qd) != 1) ||
+        (ns_parserr(&handle, ns_s_qd, 0, &rr) < 0)) {
+        return 0;
+    }
+
+    // Names are compared case-insensitively, and without any trailing dot.
+    qlen = strlen(query->name);
+    alabel = strlen(ns_rr_name(rr));
+
+    if (qlen && (query->name[qlen - 1] == '.')) {
+        qlen--;
+    }
+
+    if (alabel && (ns_rr_name(rr)[alabel - 1] == '.')) {
+        alabel--;
+    }
+
+    if ((ns_rr_type(rr) != query->type) || (ns_rr_class(rr) != ns_c_in) || (qlen != alabel) || strncasecmp(ns_rr_name(rr), query->name, qlen)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief   Read the pending datagrams on a query's UDP socket, until one of them answers the query.
+ * @note    Answers that don't come from the nameserver the query was sent to, or don't match its question, are ignored.
+ *              A truncated answer causes the query to be retried over TCP. Errors reading the socket, such as an ICMP
+ *              unreachable message from the nameserver, are treated like a lost datagram and left for the retransmission timer.
+ * @param   resolver    a pointer to the resolver handling the query.
+ * @param   query       a pointer to the query whose UDP socket is readable.
+ * @return  1 if the query was completed, failed or moved to TCP, or 0 if it is still waiting for an answer over UDP.
+ */
+int _read_dns_answer(dns_resolver_t *resolver, dns_query_t *query) {
+
+    struct sockaddr_storage from;
+    socklen_t fromlen;
+    unsigned char buf[DNS_EDNS_UDP_SIZE];
+    ssize_t nread;
+
+    while (1) {
+        fromlen = sizeof(from);
+
+        if ((nread = recvfrom(query->udp_fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen)) < 0) {
+
+            if (errno == EINTR) {
+                continue;
+            } else if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                _dbgprint(2, "Could not read DNS answer for [%s]: %s\n", query->name, strerror(errno));
+            }
+
+            return 0;
+        }
+
+        if (((size_t)nread < HFIXEDSZ) || (((HEADER *)buf)->id != query->id) || !_is_dns_server_address(&from, &(resolver->servers[query->server])) ||
+            !_check_dns_answer(query, buf, nread)) {
+            _dbgprint(3, "Discarded unexpected DNS answer.\n");
+            continue;
+        }
+
+        if (((HEADER *)buf)->tc) {
+            _dbgprint(2, "DNS answer for [%s] was truncated; retrying over TCP.\n", query->name);
+
+            if (_start_dns_query_tcp(resolver, query) < 0) {
+                _fail_dns_query(resolver, query, "unable to retry truncated DNS query over TCP");
+            }
+
+            return 1;
+        }
+
+        _complete_dns_query(resolver, query, buf, nread);
+
+        return 1;
+    }
+
+}
+
+
+/**
+ * @brief   Start retrying a query over TCP, after its answer over UDP was truncated.
+ * @param   resolver    a pointer to the resolver handling the query.
+ * @param   query       a pointer to the query to be retried.
+ * @return  0 if a TCP connection is being established, or -1 on failure.
+ */
+int _start_dns_query_tcp(dns_resolver_t *resolver, dns_query_t *query) {
+
+    struct sockaddr *addr;
+
+    if (!resolver || !query) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    addr = (struct sockaddr *)&(resolver->servers[query->server]);
+
+    // The answer will be read over TCP, so nothing more is expected on the UDP socket.
+    if (query->udp_fd >= 0) {
+        close(query->udp_fd);
+        query->udp_fd = -1;
+    }
+
+    if ((query->tcp_fd = socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        PUSH_ERROR_SYSCALL("socket");
+        RET_ERROR_INT(ERR_UNSPEC, "unable to open TCP socket for DNS query");
+    }
+
+    query->state = dns_query_tcp_connect;
+    query->tcp_done = 0;
+    query->deadline = _dns_clock() + resolver->timeout;
+
+    if (connect(query->tcp_fd, addr, resolver->server_lens[query->server]) == 0) {
+        query->state = dns_query_tcp_send;
+    } else if (errno != EINPROGRESS) {
+        PUSH_ERROR_SYSCALL("connect");
+        close(query->tcp_fd);
+        query->tcp_fd = -1;
+        RET_ERROR_INT(ERR_UNSPEC, "unable to connect to nameserver over TCP");
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Make as much progress as possible on a query being retried over TCP, without blocking.
+ * @note    The query goes out with a 2 byte length prefix, and the answer comes back the same way.
+ * @param   resolver    a pointer to the resolver handling the query.
+ * @param   query       a pointer to the query whose TCP connection is ready.
+ * @return  1 if the query was completed or failed, or 0 if it is still waiting on the connection.
+ */
+int _process_dns_query_tcp(dns_resolver_t *resolver, dns_query_t *query) {
+
+    ssize_t nbytes;
+    socklen_t elen = sizeof(int);
+    int err = 0;
+
+    if (query->state == dns_query_tcp_connect) {
+
+        if ((getsockopt(query->tcp_fd, SOL_SOCKET, SO_ERROR, &err, &elen) < 0) || err) {
+            errno = err ? err : errno;
+            PUSH_ERROR_SYSCALL("connect");
+            _fail_dns_query(resolver, query, "unable to connect to nameserver over TCP");
+            return 1;
+        }
+
+        query->state = dns_query_tcp_send;
+    }
+
+    if (query->state == dns_query_tcp_send) {
+
+        if ((nbytes = send(query->tcp_fd, query->packet + query->tcp_done, query->plen + 2 - query->tcp_done, MSG_NOSIGNAL)) < 0) {
+
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                return 0;
+            }
+
+            PUSH_ERROR_SYSCALL("send");
+            _fail_dns_query(resolver, query, "unable to send DNS query over TCP");
+            return 1;
+        }
+
+        if ((query->tcp_done += nbytes) < (query->plen + 2)) {
+            return 0;
+        }
+
+        query->state = dns_query_tcp_recv;
+        query->tcp_done = query->tcp_len = 0;
+    }
+
+    while (!query->tcp_len || (query->tcp_done < query->tcp_len)) {
+
+        if (!query->tcp_len) {
+            nbytes = recv(query->tcp_fd, query->tcp_prefix + query->tcp_done, sizeof(query->tcp_prefix) - query->tcp_done, 0);
+        } else {
+            nbytes = recv(query->tcp_fd, query->tcp_buf + query->tcp_done, query->tcp_len - query->tcp_done, 0);
+        }
+
+        if (nbytes < 0) {
+
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                return 0;
+            }
+
+            PUSH_ERROR_SYSCALL("recv");
+            _fail_dns_query(resolver, query, "unable to read DNS answer over TCP");
+            return 1;
+        } else if (!nbytes) {
+            _fail_dns_query(resolver, query, "nameserver closed TCP connection before sending complete answer");
+            return 1;
+        }
+
+        query->tcp_done += nbytes;
+
+        // Once the length prefix is in, the buffer for the answer itself can be allocated.
+        if (!query->tcp_len && (query->tcp_done == sizeof(query->tcp_prefix))) {
+            query->tcp_len = (query->tcp_prefix[0] << 8) | query->tcp_prefix[1];
+            query->tcp_done = 0;
+
+            if (query->tcp_len < HFIXEDSZ) {
+                _fail_dns_query(resolver, query, "nameserver sent invalid DNS answer length over TCP");
+                return 1;
+            } else if (!(query->tcp_buf = malloc(query->tcp_len))) {
+                PUSH_ERROR_SYSCALL("malloc");
+                _fail_dns_query(resolver, query, "unable to allocate buffer for DNS answer");
+                return 1;
+            }
+
+        }
+
+    }
+
+    if ((((HEADER *)query->tcp_buf)->id != query->id) || !_check_dns_answer(query, query->tcp_buf, query->tcp_len)) {
+        _fail_dns_query(resolver, query, "nameserver sent mismatched DNS answer over TCP");
+        return 1;
+    }
+
+    _complete_dns_query(resolver, query, query->tcp_buf, query->tcp_len);
+
+    return 1;
+}
+
+
+/**
+ * @brief   Remove a query from its resolver, and hand its answer to the query's callback.
+ * @param   resolver    a pointer to the resolver handling the query.
+ * @param   query       a pointer to the query that was answered, which is destroyed after the callback returns.
+ * @param   answer      a pointer to the raw DNS answer.
+ * @param   alen        the length of the answer in bytes.
+ */
+void _complete_dns_query(dns_resolver_t *resolver, dns_query_t *query, const unsigned char *answer, size_t alen) {
+
+    _unlink_dns_query(resolver, query);
+    _dbgprint(3, "Received DNS answer for [%s], type %u (%zu bytes).\n", query->name, query->type, alen);
+    query->callback(0, answer, alen, query->arg);
+    _destroy_dns_query(query);
+
+}
+
+
+/**
+ * @brief   Remove a query from its resolver, and let its callback know that it failed.
+ * @note    The reason for the failure is pushed onto the error stack, which is left to the callback to deal with.
+ * @param   resolver    a pointer to the resolver handling the query.
+ * @param   query       a pointer to the failed query, which is destroyed after the callback returns.
+ * @param   reason      a null-terminated string describing the reason for the failure.
+ */
+void _fail_dns_query(dns_resolver_t *resolver, dns_query_t *query, const char *reason) {
+
+    _unlink_dns_query(resolver, query);
+    PUSH_ERROR_FMT(ERR_UNSPEC, "%s {name = %s, type = %u}", reason, query->name, query->type);
+    query->callback(-1, NULL, 0, query->arg);
+    _destroy_dns_query(query);
+
+}
+
+
+/**
+ * @brief   Free a DNS query and close its sockets.
+ * @param   query   a pointer to the query to be destroyed.
+ */
+void _destroy_dns_query(dns_query_t *query) {
+
+    if (!query) {
+        return;
+    }
+
+    if (query->udp_fd >= 0) {
+        close(query->udp_fd);
+    }
+
+    if (query->tcp_fd >= 0) {
+        close(query->tcp_fd);
+    }
+
+    free(query->name);
+    free(query->packet);
+    free(query->tcp_buf);
+    free(query);
+
+}
+
+
+/**
+ * @brief   Wait for activity on a resolver's sockets, then process any answers and retransmit or fail timed out queries.
+ * @param   resolver    a pointer to the resolver to be polled.
+ * @param   timeout     the maximum number of milliseconds to wait for activity, or -1 to wait until something happens.
+ * @return  the number of queries still outstanding, or -1 on failure.
+ */
+int _poll_dns_resolver(dns_resolver_t *resolver, int timeout) {
+
+    dns_query_t *query, *next;
+    struct pollfd *fds;
+    uint64_t now, wait;
+    size_t nfds = 0;
+
+    if (!resolver) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    } else if (!resolver->pending) {
+        return 0;
+    }
+
+    // Never sleep past the earliest deadline, since that query will have to be retransmitted.
+    now = _dns_clock();
+
+    for (query = resolver->queries; query; query = query->next) {
+        wait = (query->deadline > now) ? (query->deadline - now) : 0;
+
+        if ((timeout < 0) || (wait < (uint64_t)timeout)) {
+            timeout = wait;
+        }
+
+    }
+
+    // Each query is waiting on exactly one socket, over either UDP or TCP.
+    if (!(fds = malloc(resolver->pending * sizeof(struct pollfd)))) {
+        PUSH_ERROR_SYSCALL("malloc");
+        RET_ERROR_INT(ERR_NOMEM, NULL);
+    }
+
+    for (query = resolver->queries; query; query = query->next) {
+
+        if (query->tcp_fd >= 0) {
+            fds[nfds].fd = query->tcp_fd;
+            fds[nfds++].events = (query->state == dns_query_tcp_recv) ? POLLIN : POLLOUT;
+        } else if (query->udp_fd >= 0) {
+            fds[nfds].fd = query->udp_fd;
+            fds[nfds++].events = POLLIN;
+        }
+
+    }
+
+    if ((poll(fds, nfds, timeout) < 0) && (errno != EINTR)) {
+        PUSH_ERROR_SYSCALL("poll");
+        free(fds);
+        RET_ERROR_INT(ERR_UNSPEC, "unable to poll DNS resolver sockets");
+    }
+
+    for (size_t i = 0; i < nfds; i++) {
+
+        if (!fds[i].revents) {
+            continue;
+        }
+
+        // A callback may have completed other queries in the meantime, so the query is looked up again by its socket.
+        for (query = resolver->queries; query && (query->udp_fd != fds[i].fd) && (query->tcp_fd != fds[i].fd); query = query->next);
+
+        if (query && (query->tcp_fd == fds[i].fd)) {
+            _process_dns_query_tcp(resolver, query);
+        } else if (query) {
+            _read_dns_answer(resolver, query);
+        }
+
+    }
+
+    free(fds);
+
+    // Anything still outstanding past its deadline is retransmitted, or failed once every attempt has been used up.
+    now = _dns_clock();
+
+    for (query = resolver->queries; query; query = next) {
+        next = query->next;
+
+        if (query->deadline > now) {
+            continue;
+        }
+
+        if ((query->tcp_fd >= 0) || (query->attempts >= (resolver->retries * resolver->nservers))) {
+            _fail_dns_query(resolver, query, "DNS query timed out");
+        } else {
+            _dbgprint(2, "Retransmitting DNS query for [%s] (attempt %u).\n", query->name, query->attempts + 1);
+
+            if (_send_dns_query(resolver, query) < 0) {
+                _fail_dns_query(resolver, query, "unable to retransmit DNS query");
+            }
+
+        }
+
+    }
+
+    return resolver->pending;
+}
+
+
+/**
+ * @brief   Poll a resolver until all of its outstanding queries have completed or failed.
+ * @param   resolver    a pointer to the resolver to be run.
+ * @return  0 on success or -1 on failure.
+ */
+int _run_dns_resolver(dns_resolver_t *resolver) {
+
+    if (!resolver) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    while (resolver->pending) {
+
+        if (_poll_dns_resolver(resolver, -1) < 0) {
+            RET_ERROR_INT(ERR_UNSPEC, "unable to poll DNS resolver");
+        }
+
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "dime/common/error.h"
+
+
+#define DNS_RESOLVER_MAX_SERVERS   3        ///< The maximum number of nameservers a resolver will rotate its queries through.
+#define DNS_EDNS_UDP_SIZE          4096     ///< The UDP payload size advertised in queries, and the size of the UDP receive buffer.
+#define DNS_DEFAULT_TIMEOUT        5000     ///< The per-attempt query timeout in milliseconds, if the system resolver doesn't specify one.
+#define DNS_DEFAULT_RETRIES        2        ///< The number of attempts per nameserver, if the system resolver doesn't specify one.
+
+
+/**
+ * @brief   The completion callback of an asynchronous DNS query.
+ * @note    On failure the reason is pushed onto the error stack, which the callback may clear once it has dealt with it.
+ * @param   status  0 if an answer was received, or -1 if the query failed or timed out.
+ * @param   answer  a pointer to the raw DNS answer, which is only valid for the duration of the callback, or NULL on failure.
+ * @param   alen    the length of the answer in bytes.
+ * @param   arg     the opaque argument that was passed when the query was submitted.
+ */
+typedef void (*dns_answer_cb_t)(int status, const unsigned char *answer, size_t alen, void *arg);
+
+typedef enum {
+    dns_query_udp = 0,                      ///< The query is waiting for an answer over UDP.
+    dns_query_tcp_connect = 1,              ///< The UDP answer was truncated, and a TCP connection is being established.
+    dns_query_tcp_send = 2,                 ///< The query is being written to the TCP connection.
+    dns_query_tcp_recv = 3                  ///< The answer is being read from the TCP connection.
+} dns_query_state_t;
+
+typedef struct dns_query {
+    uint16_t id;                            ///< The DNS message id of the query, which is unique among outstanding queries.
+    uint16_t type;                          ///< The RR type being queried.
+    char *name;                             ///< The domain name being queried.
+    unsigned char *packet;                  ///< The wire format of the query, preceded by its 2 byte length for use over TCP.
+    size_t plen;                            ///< The length of the query packet, not including the length prefix.
+    dns_query_state_t state;                ///< The transport state of the query.
+    size_t server;                          ///< The index of the nameserver that the query was last sent to.
+    unsigned int attempts;                  ///< The number of times the query has been sent.
+    uint64_t deadline;                      ///< The monotonic time in milliseconds at which the current attempt times out.
+    int udp_fd;                             ///< The UDP socket of the current attempt, or -1.
+    int tcp_fd;                             ///< The TCP connection used for a truncated answer, or -1.
+    unsigned char *tcp_buf;                 ///< The buffer receiving the answer over TCP.
+    size_t tcp_len;                         ///< The expected length of the answer over TCP, once its length prefix has been read.
+    size_t tcp_done;                        ///< The number of bytes sent or received so far in the current TCP state.
+    unsigned char tcp_prefix[2];            ///< The length prefix of the answer over TCP.
+    dns_answer_cb_t callback;               ///< The routine to be called when the query completes or fails.
+    void *arg;                              ///< The opaque argument passed to the callback.
+    struct dns_query *next;                 ///< A pointer to the next outstanding query.
+} dns_query_t;
+
+typedef struct {
+    struct sockaddr_storage servers[DNS_RESOLVER_MAX_SERVERS];  ///< The addresses of the nameservers to be queried.
+    socklen_t server_lens[DNS_RESOLVER_MAX_SERVERS];            ///< The lengths of the nameserver addresses.
+    size_t nservers;                        ///< The number of configured nameservers.
+    dns_query_t *queries;                   ///< The list of outstanding queries.
+    size_t pending;                         ///< The number of outstanding queries.
+    unsigned int timeout;                   ///< The per-attempt query timeout in milliseconds.
+    unsigned int retries;                   ///< The number of attempts made against each nameserver before a query fails.
+} dns_resolver_t;
+
+
+// Public interface.
+PUBLIC_FUNC_DECL(dns_resolver_t *, create_dns_resolver,     void);
+PUBLIC_FUNC_DECL(void,             destroy_dns_resolver,    dns_resolver_t *resolver);
+PUBLIC_FUNC_DECL(int,              set_dns_resolver_server, dns_resolver_t *resolver, const struct sockaddr *addr, socklen_t addrlen);
+PUBLIC_FUNC_DECL(int,              submit_dns_query,        dns_resolver_t *resolver, const char *name, uint16_t type, dns_answer_cb_t callback, void *arg);
+PUBLIC_FUNC_DECL(int,              poll_dns_resolver,       dns_resolver_t *resolver, int timeout);
+PUBLIC_FUNC_DECL(int,              run_dns_resolver,        dns_resolver_t *resolver);
+
+
+// Internal functions.
+dns_query_t *_find_dns_query(dns_resolver_t *resolver, uint16_t id);
+void         _complete_dns_query(dns_resolver_t *resolver, dns_query_t *query, const unsigned char *answer, size_t alen);
+void         _fail_dns_query(dns_resolver_t *resolver, dns_query_t *query, const char *reason);
+void         _destroy_dns_query(dns_query_t *query);
+int          _send_dns_query(dns_resolver_t *resolver, dns_query_t *query);
+int          _start_dns_query_tcp(dns_resolver_t *resolver, dns_query_t *query);
+int          _process_dns_query_tcp(dns_resolver_t *resolver, dns_query_t *query);
+int          _read_dns_answer(dns_resolver_t *resolver, dns_query_t *query);
+int          _check_dns_answer(const dns_query_t *query, const unsigned char *answer, size_t alen);
+
+#endif
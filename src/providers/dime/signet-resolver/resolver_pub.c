@@ -0,0 +1,26 @@
+#include "dime/signet-resolver/resolver.h"
+
+
+dns_resolver_t *create_dns_resolver(void) {
+    PUBLIC_FUNC_IMPL(create_dns_resolver, );
+}
+
+void destroy_dns_resolver(dns_resolver_t *resolver) {
+    PUBLIC_FUNC_IMPL_VOID(destroy_dns_resolver, resolver);
+}
+
+int set_dns_resolver_server(dns_resolver_t *resolver, const struct sockaddr *addr, socklen_t addrlen) {
+    PUBLIC_FUNC_IMPL(set_dns_resolver_server, resolver, addr, addrlen);
+}
+
+int submit_dns_query(dns_resolver_t *resolver, const char *name, uint16_t type, dns_answer_cb_t callback, void *arg) {
+    PUBLIC_FUNC_IMPL(submit_dns_query, resolver, name, type, callback, arg);
+}
+
+int poll_dns_resolver(dns_resolver_t *resolver, int timeout) {
+    PUBLIC_FUNC_IMPL(poll_dns_resolver, resolver, timeout);
+}
+
+int run_dns_resolver(dns_resolver_t *resolver) {
+    PUBLIC_FUNC_IMPL(run_dns_resolver, resolver);
+}
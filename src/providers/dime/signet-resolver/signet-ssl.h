@@ -16,6 +16,13 @@
 #define CRL_FILE "crl.pem"
 
 
+typedef enum {
+    ssl_session_cache_off = 0,              ///< Every connection makes a full TLS handshake.
+    ssl_session_cache_memory = 1,           ///< Sessions are kept in the object cache, for the lifetime of the process.
+    ssl_session_cache_persistent = 2        ///< Sessions are also saved with the object cache, so that they survive restarts.
+} ssl_session_cache_t;
+
+
 // The public interface.
 
 // Initialization and finalization routines.
@@ -26,7 +33,8 @@ PUBLIC_FUNC_DECL(void,      ssl_shutdown,             void);
 PUBLIC_FUNC_DECL(SSL *,     ssl_connect_host,         const char *hostname, unsigned short port, int force_family);
 PUBLIC_FUNC_DECL(void,      ssl_disconnect,           SSL *handle);
 PUBLIC_FUNC_DECL(SSL_CTX *, ssl_get_client_context,   void);
-PUBLIC_FUNC_DECL(SSL *,     ssl_starttls,             int fd);
+PUBLIC_FUNC_DECL(SSL *,     ssl_starttls,             int fd, const char *hostname);
+PUBLIC_FUNC_DECL(int,       ssl_set_session_cache,    ssl_session_cache_t mode);
 
 // Public certificate validation functions.
 PUBLIC_FUNC_DECL(int,       do_x509_validation,       X509 *cert, STACK_OF(X509) * chain);
@@ -35,8 +43,17 @@ PUBLIC_FUNC_DECL(int,       do_ocsp_validation,       SSL *connection, int *fall
 PUBLIC_FUNC_DECL(char *,    get_cert_subject_cn,      X509 *cert);
 
 // Internal routines.
+SSL *        _ssl_client_new(int fd, const char *hostname, int *resumed);
 void         _ssl_fd_loop(SSL *connection);
 
+// TLS session resumption routines.
+int          _ssl_resume_session(SSL *connection, const char *hostname);
+int          _ssl_new_session_callback(SSL *connection, SSL_SESSION *session);
+void         _destroy_tls_session_cb(void *record);
+void *       _serialize_tls_session_cb(void *record, size_t *outlen);
+void *       _deserialize_tls_session_cb(void *data, size_t len);
+void         _dump_tls_session_cb(FILE *fp, void *record, int brief);
+
 // Internal certificate validation functions.
 int          _verify_certificate_callback(int ok, X509_STORE_CTX *ctx);
 int          _validate_self_signed(X509 *cert);
@@ -44,6 +61,10 @@ X509_STORE * _get_cert_store(void);
 int          _domain_wildcard_check(const char *pattern, const char *domain);
 
 // OCSP check routines.
+OCSP_CERTID *_get_ocsp_cert_id(SSL *connection, STACK_OF(X509) **chain, char *idbuf, size_t idlen);
+int          _check_ocsp_response(OCSP_RESPONSE *response, OCSP_CERTID *cid, STACK_OF(X509) *chain, time_t *expiration);
+int          _get_cached_ocsp_verdict(const char *cidstr, OCSP_CERTID *cid);
+void         _cache_ocsp_response(const char *cidstr, OCSP_RESPONSE *response, time_t expiration);
 void         _destroy_ocsp_response_cb(void *record);
 int          _ocsp_response_callback(SSL *s, void *arg);
 char *       _get_cache_ocsp_id(X509 *cert, OCSP_CERTID *cid, char *buf, size_t blen);
@@ -18,6 +18,7 @@ static SSL_CTX *_dmtp_ssl_client_ctx = NULL;
 static int _ssl_initialized = 0;
 static char *_ca_file = NULL;
 static char *_crl_file = NULL;
+static ssl_session_cache_t _ssl_session_cache = ssl_session_cache_memory;
 
 
 /**
@@ -109,21 +110,142 @@ SSL_CTX *_ssl_get_client_context(void) {
     // Set the callback verification that will be set if there's a self-signed certificate, etc.
     SSL_CTX_set_verify_d(_dmtp_ssl_client_ctx, SSL_VERIFY_NONE, _verify_certificate_callback);
 
+    // New client sessions and tickets are handed to us as they're established, so they can be kept in the object cache.
+    SSL_CTX_ctrl_d(_dmtp_ssl_client_ctx, SSL_CTRL_SET_SESS_CACHE_MODE, (SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE), NULL);
+    SSL_CTX_sess_set_new_cb_d(_dmtp_ssl_client_ctx, _ssl_new_session_callback);
+
+    // OCSP responses stapled to the handshakes of connections that ask for them are checked as they arrive.
+    SSL_CTX_callback_ctrl_d(_dmtp_ssl_client_ctx, SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB, (void (*)(void))_ocsp_response_callback);
+    SSL_CTX_ctrl_d(_dmtp_ssl_client_ctx, SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB_ARG, 0, NULL);
+
     return _dmtp_ssl_client_ctx;
 }
 
 
 /**
- * @brief   Negotiate a TLS session over an existing network socket connection.
- * @note    This function is called immediately after server confirmation of a STARTTLS command receipt.
+ * @brief   Set whether TLS sessions with remote hosts are cached, so that reconnections can skip the full handshake.
+ * @note    Sessions are cached in memory by default. Persistent caching writes session keys to the cache file,
+ *              so it should only be enabled if the cache file is adequately protected.
+ * @param   mode    the TLS session caching mode: ssl_session_cache_off, ssl_session_cache_memory, or ssl_session_cache_persistent.
+ * @return  0 on success or -1 on failure.
+ */
+int _ssl_set_session_cache(ssl_session_cache_t mode) {
+
+    if ((mode != ssl_session_cache_off) && (mode != ssl_session_cache_memory) && (mode != ssl_session_cache_persistent)) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    __atomic_store_n(&_ssl_session_cache, mode, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+
+/**
+ * @brief   Offer a cached TLS session with a remote host on a new connection, so that it can be resumed.
+ * @note    This function must be called before the TLS handshake is initiated. If the host doesn't accept
+ *              the session, the handshake falls back to a full one.
+ * @param   connection  the SSL descriptor of the connection that is about to be established.
+ * @param   hostname    the name of the remote host, which cached sessions are keyed by.
+ * @return  -1 on failure, 0 if there was no cached session for the host, or 1 if a cached session was offered.
+ */
+int _ssl_resume_session(SSL *connection, const char *hostname) {
+
+    cached_object_t *cached;
+    SSL_SESSION *session;
+    int res;
+
+    if (!connection || !hostname) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (__atomic_load_n(&_ssl_session_cache, __ATOMIC_RELAXED) == ssl_session_cache_off) {
+        return 0;
+    }
+
+    if (!(cached = _find_cached_object(hostname, &(cached_stores[cached_data_tls_session])))) {
+
+        if (get_last_error()) {
+            RET_ERROR_INT(ERR_UNSPEC, "unable to look up cached TLS session");
+        }
+
+        return 0;
+    }
+
+    if (!(session = _get_cache_obj_data(cached))) {
+        RET_ERROR_INT(ERR_UNSPEC, "unable to retrieve cached TLS session");
+    }
+
+    // The connection takes its own reference to our private copy of the session.
+    res = SSL_set_session_d(connection, session);
+    SSL_SESSION_free_d(session);
+
+    if (res != 1) {
+        PUSH_ERROR_OPENSSL();
+        RET_ERROR_INT(ERR_UNSPEC, "unable to set cached TLS session on connection");
+    }
+
+    _dbgprint(3, "Offering cached TLS session to %s.\n", hostname);
+
+    return 1;
+}
+
+
+/**
+ * @brief   Store a newly established client TLS session in the object cache, keyed by the name of the remote host.
+ * @note    This is the new session callback of the DMTP SSL client context. It is called by openssl after each full
+ *              handshake, and whenever the server issues a new session ticket. In persistent mode the session is
+ *              saved through the cache journal, instead of rewriting the entire cache for every handshake.
+ * @param   connection  the SSL descriptor of the connection the session was established on.
+ * @param   session     a pointer to the newly established TLS session.
+ * @return  1 if the object cache took over the reference to the session, or 0 if it is to be released by openssl.
+ */
+int _ssl_new_session_callback(SSL *connection, SSL_SESSION *session) {
+
+    cached_store_t *store = &(cached_stores[cached_data_tls_session]);
+    cached_object_t *cached;
+    ssl_session_cache_t mode;
+    const char *hostname;
+    time_t expiration;
+
+    mode = __atomic_load_n(&_ssl_session_cache, __ATOMIC_RELAXED);
+
+    // Connections made without a server name can't be matched up with a later connection to the same host.
+    if ((mode == ssl_session_cache_off) || !(hostname = SSL_get_servername_d(connection, TLSEXT_NAMETYPE_host_name))) {
+        return 0;
+    }
+
+    expiration = SSL_SESSION_get_time_d(session) + SSL_SESSION_get_timeout_d(session);
+
+    // The new session supersedes whichever one we had cached for the host, in a single step so that concurrent handshakes with the same host can't collide.
+    if (!(cached = _replace_cached_object(hostname, store, 0, expiration, session, (mode == ssl_session_cache_persistent), 0))) {
+        fprintf(stderr, "Error: unable to add TLS session for %s to object cache.\n", hostname);
+        dump_error_stack();
+        _clear_error_stack();
+        return 0;
+    }
+
+    // We were handed a copy of the cached session, which we have no use for.
+    _destroy_cache_entry(cached);
+    _dbgprint(3, "Cached new TLS session with %s.\n", hostname);
+
+    return 1;
+}
+
+
+/**
+ * @brief   Set up a TLS client connection over an existing network socket, without negotiating it yet.
+ * @note    This lets a caller drive the handshake itself, such as over a non-blocking socket.
  * @param   fd  the file descriptor of the network socket over which the TLS session will be initiated.
- * @return  NULL on failure, or the SSL descriptor of the newly established TLS session on success.
- *
+ * @param   hostname    an optional name of the remote host, used to request its certificate and to resume an earlier TLS session with it.
+ * @param   resumed     an optional pointer to a variable that will be set to 1 if a cached TLS session is being offered to the host, or 0 if not.
+ * @return  NULL on failure, or the SSL descriptor of the new, unconnected TLS session on success.
  */
-SSL *_ssl_starttls(int fd) {
+SSL *_ssl_client_new(int fd, const char *hostname, int *resumed) {
 
     SSL_CTX *ctx;
     SSL *result;
+    int res = 0;
 
     if (!(ctx = _ssl_get_client_context())) {
         RET_ERROR_PTR(ERR_UNSPEC, "could not get SSL client context");
@@ -136,11 +258,63 @@ SSL *_ssl_starttls(int fd) {
 
     if (!SSL_set_fd_d(result, fd)) {
         PUSH_ERROR_OPENSSL();
+        SSL_free_d(result);
         RET_ERROR_PTR(ERR_UNSPEC, "could not set SSL connection descriptor");
     }
 
+    if (hostname) {
+
+        if (SSL_ctrl_d(result, SSL_CTRL_SET_TLSEXT_HOSTNAME, TLSEXT_NAMETYPE_host_name, (void *)hostname) != 1) {
+            fprintf(stderr, "Warning: could not set SNI TLS extension for connection.\n");
+        }
+
+        if ((res = _ssl_resume_session(result, hostname)) < 0) {
+            fprintf(stderr, "Warning: could not resume cached TLS session.\n");
+            dump_error_stack();
+            _clear_error_stack();
+        }
+
+    }
+
+    // Ask the server to staple an OCSP response for its certificate to the handshake.
+    if (SSL_ctrl_d(result, SSL_CTRL_SET_TLSEXT_STATUS_REQ_TYPE, TLSEXT_STATUSTYPE_ocsp, NULL) != 1) {
+        fprintf(stderr, "Warning: could not request OCSP stapling for connection.\n");
+    }
+
+    if (resumed) {
+        *resumed = (res > 0) ? 1 : 0;
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief   Negotiate a TLS session over an existing network socket connection.
+ * @note    This function is called immediately after server confirmation of a STARTTLS command receipt.
+ * @param   fd  the file descriptor of the network socket over which the TLS session will be initiated.
+ * @param   hostname    an optional name of the remote host, used to request its certificate and to resume an earlier TLS session with it.
+ * @return  NULL on failure, or the SSL descriptor of the newly established TLS session on success.
+ *
+ */
+SSL *_ssl_starttls(int fd, const char *hostname) {
+
+    SSL *result;
+    int resumed;
+
+    if (!(result = _ssl_client_new(fd, hostname, &resumed))) {
+        RET_ERROR_PTR(ERR_UNSPEC, "could not set up TLS session");
+    }
+
     if (SSL_connect_d(result) <= 0) {
         PUSH_ERROR_OPENSSL();
+
+        // A cached session that the server chokes on isn't offered again.
+        if (resumed) {
+            _remove_cached_object(hostname, &(cached_stores[cached_data_tls_session]));
+        }
+
+        SSL_free_d(result);
         RET_ERROR_PTR(ERR_UNSPEC, "could not establish SSL connection");
     }
 
@@ -161,7 +335,7 @@ SSL *_ssl_connect_host(const char *hostname, unsigned short port, int force_fami
 
     SSL_CTX *ctx;
     SSL *result;
-    int fd;
+    int fd, resumed;
 
     if (!hostname || !port) {
         RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
@@ -191,13 +365,25 @@ SSL *_ssl_connect_host(const char *hostname, unsigned short port, int force_fami
         fprintf(stderr, "Warning: could not set SNI TLS extension for connection.\n");
     }
 
-    // This OCSP stapling callback doesn't do anything at the moment.
-    SSL_ctrl_d(result, SSL_CTRL_SET_TLSEXT_STATUS_REQ_TYPE, TLSEXT_STATUSTYPE_ocsp, NULL);
-    SSL_CTX_callback_ctrl_d(ctx, SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB, (void (*)(void))_ocsp_response_callback);
-    SSL_CTX_ctrl_d(ctx, SSL_CTRL_SET_TLSEXT_STATUS_REQ_CB_ARG, 0, NULL);
+    // Ask the server to staple an OCSP response for its certificate to the handshake.
+    if (SSL_ctrl_d(result, SSL_CTRL_SET_TLSEXT_STATUS_REQ_TYPE, TLSEXT_STATUSTYPE_ocsp, NULL) != 1) {
+        fprintf(stderr, "Warning: could not request OCSP stapling for connection.\n");
+    }
+
+    if ((resumed = _ssl_resume_session(result, hostname)) < 0) {
+        fprintf(stderr, "Warning: could not resume cached TLS session.\n");
+        dump_error_stack();
+        _clear_error_stack();
+    }
 
     if (SSL_connect_d(result) <= 0) {
         PUSH_ERROR_OPENSSL();
+
+        // A cached session that the server chokes on isn't offered again.
+        if (resumed > 0) {
+            _remove_cached_object(hostname, &(cached_stores[cached_data_tls_session]));
+        }
+
         RET_ERROR_PTR(ERR_UNSPEC, "could not establish SSL connection");
     }
 
@@ -417,39 +603,28 @@ int _do_x509_hostname_check(X509 *cert, const char *domain) {
 
 
 /**
- * @brief   Perform OCSP validation on an x509 certificate.
- * @param   connection  a pointer to the SSL connection associated with the peer certificate to be OCSP validated.
- * @param   fallthrough an optional pointer to a variable that will be set if OCSP validation did not fail for various
- *              reasons (ie. OCSP was not available), but validation was not completed.
- * @return  -1 on general error, 0 if the certificate did not pass OCSP validation, or 1 if it did so successfully.
+ * @brief   Find the issuer of a peer certificate, and derive the OCSP certificate ID that its revocation status is looked up by.
+ * @param   connection  a pointer to the SSL connection associated with the peer certificate.
+ * @param   chain   an optional pointer to a variable that will receive the certificate chain presented by the peer.
+ * @param   idbuf   a pointer to a buffer that will receive the id of the certificate's OCSP verdict in the object cache,
+ *              or an empty string if one could not be derived.
+ * @param   idlen   the size, in bytes, of the id buffer.
+ * @return  NULL on failure, or a pointer to a newly allocated OCSP certificate ID on success, which must be freed by the caller.
  */
-int _do_ocsp_validation(SSL *connection, int *fallthrough) {
+OCSP_CERTID *_get_ocsp_cert_id(SSL *connection, STACK_OF(X509) **chain, char *idbuf, size_t idlen) {
 
-    OCSP_REQUEST *request;
-    OCSP_RESPONSE *response = NULL;
-    OCSP_CERTID *cid;
-    OCSP_BASICRESP *basic;
-    OCSP_REQ_CTX *octx;
-    STACK_OF(OPENSSL_STRING) * ocspst;
+    OCSP_CERTID *result;
     STACK_OF(X509) * certstack;
-    ASN1_GENERALIZEDTIME *revtime, *thisupd, *nextupd;
-    X509_STORE *store;
     X509 *cert, *pcert, *issuer = NULL;
-    cached_object_t *cached_ocsp = NULL;
-    BIO *bsock, *dbgbio;
-    struct tm tt;
-    time_t expiration;
-    char cidstr[512], *purl, *phost = NULL, *pport = NULL, *ppath = NULL;
-    int fd, pssl, rcode, status, reason, ret;
 
-    if (!connection) {
-        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    if (!connection || !idbuf || !idlen) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
     }
 
     // Get this certificate and the certificate chain.
     if (!(cert = SSL_get_peer_certificate_d(connection))) {
         PUSH_ERROR_OPENSSL();
-        RET_ERROR_INT(ERR_UNSPEC, "could not retrieve peer certificate for OCSP validation");
+        RET_ERROR_PTR(ERR_UNSPEC, "could not retrieve peer certificate for OCSP validation");
     }
 
     if ((!(certstack = SSL_get_peer_cert_chain_d(connection))) || !sk_num_d((void *)certstack)) {
@@ -458,7 +633,8 @@ int _do_ocsp_validation(SSL *connection, int *fallthrough) {
             PUSH_ERROR_OPENSSL();
         }
 
-        RET_ERROR_INT(ERR_UNSPEC, "could not retrieve peer certificate chain for OCSP validation");
+        X509_free_d(cert);
+        RET_ERROR_PTR(ERR_UNSPEC, "could not retrieve peer certificate chain for OCSP validation");
     }
 
     _dbgprint(4, "OCSP validator: certificate chain contained %u entries.\n", sk_num_d((void *)certstack));
@@ -475,128 +651,301 @@ int _do_ocsp_validation(SSL *connection, int *fallthrough) {
     }
 
     if (!issuer) {
-        RET_ERROR_INT(ERR_UNSPEC, "could not find certificate issuer for OCSP validation");
+        X509_free_d(cert);
+        RET_ERROR_PTR(ERR_UNSPEC, "could not find certificate issuer for OCSP validation");
     }
 
     // Is this the cipher we necessarily want? or NULL?
     // cid = OCSP_onereq_get0_id(one); OCSP_id_get0_info(NULL,&cert_id_md_oid, NULL,NULL, cid); cert_id_md = EVP_get_digestbyobj(cert_id_md_oid);
-    if (!(cid = OCSP_cert_to_id_d(NULL, cert, issuer))) {
+    if (!(result = OCSP_cert_to_id_d(NULL, cert, issuer))) {
         PUSH_ERROR_OPENSSL();
-        RET_ERROR_INT(ERR_UNSPEC, "OCSP validation failed with indeterminate certificate ID");
+        X509_free_d(cert);
+        RET_ERROR_PTR(ERR_UNSPEC, "OCSP validation failed with indeterminate certificate ID");
     }
 
-    memset(cidstr, 0, sizeof(cidstr));
+    memset(idbuf, 0, idlen);
 
-    if (!_get_cache_ocsp_id(cert, cid, cidstr, sizeof(cidstr))) {
+    // Without a cache id, the certificate can still be validated; its verdict just won't be cached.
+    if (!_get_cache_ocsp_id(cert, result, idbuf, idlen)) {
         fprintf(stderr, "Error: unable to derive id string for x509 certificate.\n");
-    } else {
+        dump_error_stack();
+        _clear_error_stack();
+        memset(idbuf, 0, idlen);
+    }
 
-        if ((cached_ocsp = _find_cached_object(cidstr,  &(cached_stores[cached_data_ocsp])))) {
-            response = (OCSP_RESPONSE *)cached_ocsp->data;
-        } else if (get_last_error()) {
-            fprintf(stderr, "Error: could not search object cache for OCSP response.\n");
-            dump_error_stack();
-            _clear_error_stack();
-        }
+    X509_free_d(cert);
 
+    if (chain) {
+        *chain = certstack;
     }
 
-    // If we got a cached OCSP response, then we can skip straight to a very abbreviated form of the verification steps below.
-    // Is the line below the exact logic we want?
-    if (response && (OCSP_response_status_d(response) == OCSP_RESPONSE_STATUS_SUCCESSFUL)) {
-        _dbgprint(2, "Retrieved cached OCSP response.\n");
+    return result;
+}
 
-        if (!(basic = OCSP_response_get1_basic_d(response))) {
-            PUSH_ERROR_OPENSSL();
-            _unlink_object(cached_ocsp, 1, 0);
-            RET_ERROR_INT(ERR_UNSPEC, "unable to inspect basic OCSP response details");
-        }
 
-        // Skip nonce check.
+/**
+ * @brief   Check the revocation status of a certificate reported by an OCSP response.
+ * @param   response    a pointer to the OCSP response to be checked.
+ * @param   cid a pointer to the OCSP certificate ID of the certificate whose status is wanted.
+ * @param   chain   if set, the certificate chain presented by the peer, with which the response's signature is verified against
+ *              the root certificate store; if NULL, the response is taken to have been verified already.
+ * @param   expiration  an optional pointer to a variable that will receive the time of the response's next update,
+ *              until which its verdict holds, or 0 if it has none.
+ * @return  -1 if the response could not be used, 0 if it reported the certificate as revoked or unknown, or 1 if it reported it as good.
+ */
+int _check_ocsp_response(OCSP_RESPONSE *response, OCSP_CERTID *cid, STACK_OF(X509) *chain, time_t *expiration) {
+
+    OCSP_BASICRESP *basic;
+    ASN1_GENERALIZEDTIME *revtime, *thisupd, *nextupd;
+    X509_STORE *store;
+    BIO *dbgbio;
+    struct tm tt;
+    int rcode, status, reason, ret;
+
+    if (!response || !cid) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (expiration) {
+        *expiration = 0;
+    }
+
+    // We probably need a way of returning a much more detailed error message here for another code.
+    if ((rcode = OCSP_response_status_d(response)) != OCSP_RESPONSE_STATUS_SUCCESSFUL) {
+        RET_ERROR_INT_FMT(ERR_UNSPEC, "OCSP response was not successful {code = %u}", rcode);
+    }
+
+    if (!(basic = OCSP_response_get1_basic_d(response))) {
+        PUSH_ERROR_OPENSSL();
+        RET_ERROR_INT(ERR_UNSPEC, "unable to inspect basic OCSP response details");
+    }
+
+    if (chain) {
+
+        // Create the x509 certificate store that will be used for final response validation.
         if (!(store = _get_cert_store())) {
             OCSP_BASICRESP_free_d(basic);
             RET_ERROR_INT(ERR_UNSPEC, "unable to verify OCSP response because of certificate store error");
         }
 
-        if ((ret = OCSP_basic_verify_d(basic, certstack, store, 0)) <= 0) {
-
-            if (ret < 0) {
-                PUSH_ERROR_OPENSSL();
-            }
+        // Do we need any flags? OCSP_TRUSTOTHER?
+        ret = OCSP_basic_verify_d(basic, chain, store, 0);
+        X509_STORE_free_d(store);
 
+        if (ret <= 0) {
+            PUSH_ERROR_OPENSSL();
             OCSP_BASICRESP_free_d(basic);
-            X509_STORE_free_d(store);
-            _unlink_object(cached_ocsp, 1, 0);
+            RET_ERROR_INT(ERR_UNSPEC, "basic OCSP response verification failed");
+        }
+
+    }
+
+    if (OCSP_resp_find_status_d(basic, cid, &status, &reason, &revtime, &thisupd, &nextupd) <= 0) {
+        PUSH_ERROR_OPENSSL();
+        OCSP_BASICRESP_free_d(basic);
+        RET_ERROR_INT(ERR_UNSPEC, "OCSP response did not report the status of the certificate");
+    }
 
-            if (ret < 0) {
-                RET_ERROR_INT(ERR_UNSPEC, "basic OCSP response verification failed");
+    if (_verbose >= 3) {
+
+        if ((dbgbio = BIO_new_fp_d(stderr, BIO_NOCLOSE))) {
+            fprintf(stderr, "--- This OCSP update: ");
+            ASN1_GENERALIZEDTIME_print_d(dbgbio, thisupd);
+
+            if (nextupd) {
+                fprintf(stderr, "\n--- Next OCSP update: ");
+                ASN1_GENERALIZEDTIME_print_d(dbgbio, nextupd);
             }
 
-            return 0;
+            fprintf(stderr, "\n");
+            BIO_free_d(dbgbio);
         }
 
-        X509_STORE_free_d(store);
+    }
 
-        if ((ret = OCSP_resp_find_status_d(basic, cid, &status, &reason, &revtime, &thisupd, &nextupd)) <= 0) {
+    // Requested with a maximum clock skew time of 5 minutes, and ignore the max age option. (maybe we shouldn't).
+    if (OCSP_check_validity_d(thisupd, nextupd, 300, -1) <= 0) {
+        PUSH_ERROR_OPENSSL();
+        OCSP_BASICRESP_free_d(basic);
+        RET_ERROR_INT(ERR_UNSPEC, "OCSP validity check failed");
+    }
 
-            if (ret < 0) {
-                PUSH_ERROR_OPENSSL();
-            }
+    // Finally we need to convert the ASN1 next update time to a time_t to be used as our expiration time.
+    if (expiration && nextupd && nextupd->data && (nextupd->type == V_ASN1_GENERALIZEDTIME)) {
 
-            OCSP_BASICRESP_free_d(basic);
-            _unlink_object(cached_ocsp, 1, 0);
+        // Create a dummy date that is initialized to UTC.
+        memset(&tt, 0, sizeof(tt));
+        gmtime_r(expiration, &tt);
 
-            if (ret < 0) {
-                RET_ERROR_INT(ERR_UNSPEC, "basic OCSP response verification failed");
+        if (sscanf((char *)nextupd->data, "%4d%2d%2d%2d%2d%2d", &(tt.tm_year), &(tt.tm_mon), &(tt.tm_mday), &(tt.tm_hour), &(tt.tm_min), &(tt.tm_sec)) != 6) {
+            fprintf(stderr, "Error parsing ASN1 data of OCSP response next update time; setting expiration to zero.\n");
+        } else {
+            // The year is relative to 1900.
+            tt.tm_year -= 1900;
+            // The month number is zero-indexed.
+            tt.tm_mon--;
+            // The hour is also zero-indexed.
+            tt.tm_hour--;
+
+            if ((*expiration = timegm(&tt)) == (time_t)-1) {
+                fprintf(stderr, "Error: unable to convert OCSP response next update time to valid UTC time.\n");
+                *expiration = 0;
             }
 
-            return 0;
         }
 
-        if (_verbose >= 3) {
+    } else if (expiration) {
+        _dbgprint(1, "OCSP response had no next update time; its verdict will not be cached.\n");
+    }
 
-            if ((dbgbio = BIO_new_fp_d(stderr, BIO_NOCLOSE))) {
-                fprintf(stderr, "--- This OCSP update: ");
-                ASN1_GENERALIZEDTIME_print_d(dbgbio, thisupd);
-                fprintf(stderr, "\n--- Next OCSP update: ");
-                ASN1_GENERALIZEDTIME_print_d(dbgbio, nextupd);
-                fprintf(stderr, "\n");
-                BIO_free_d(dbgbio);
-            }
+    OCSP_BASICRESP_free_d(basic);
 
-        }
+    if (status != V_OCSP_CERTSTATUS_GOOD) {
+        _dbgprint(1, "OCSP response reported certificate status: %s\n", (status == V_OCSP_CERTSTATUS_REVOKED) ? "revoked" : "unknown");
+        return 0;
+    }
 
-        // Requested with a maximum clock skew time of 5 minutes, and ignore the max age option. (maybe we shouldn't).
-        if ((ret = OCSP_check_validity_d(thisupd, nextupd, 300, -1)) <= 0) {
+    return 1;
+}
 
-            if (ret < 0) {
-                PUSH_ERROR_OPENSSL();
-            }
 
-            OCSP_BASICRESP_free_d(basic);
-            _unlink_object(cached_ocsp, 1, 0);
+/**
+ * @brief   Look up the cached OCSP verdict on a certificate.
+ * @note    Responses are only cached once they have been verified, so their signatures aren't checked again.
+ *              The response is checked on a copy, since another thread may replace the cached one in the meantime.
+ *              A cached response that is no longer current is ignored, and left to be replaced or swept from the cache.
+ * @param   cidstr  the id of the certificate's OCSP verdict in the object cache.
+ * @param   cid a pointer to the OCSP certificate ID of the certificate.
+ * @return  -1 if no current verdict was cached, 0 if the certificate was reported as revoked or unknown, or 1 if it was reported as good.
+ */
+int _get_cached_ocsp_verdict(const char *cidstr, OCSP_CERTID *cid) {
 
-            if (ret < 0) {
-                RET_ERROR_INT(ERR_UNSPEC, "OCSP validity check failed");
-            }
+    cached_object_t *cached;
+    int result;
+
+    if (!cidstr || !cid || !strlen(cidstr)) {
+        return -1;
+    }
 
-            return 0;
+    if (!(cached = _lookup_cached_object(cidstr, &(cached_stores[cached_data_ocsp]), 1))) {
+
+        if (get_last_error()) {
+            fprintf(stderr, "Error: could not search object cache for OCSP response.\n");
+            dump_error_stack();
+            _clear_error_stack();
         }
 
-        OCSP_BASICRESP_free_d(basic);
+        return -1;
+    }
+
+    result = _check_ocsp_response((OCSP_RESPONSE *)cached->data, cid, NULL, NULL);
+    _destroy_cache_entry(cached);
+
+    if (result < 0) {
+        _dbgprint(1, "Ignoring cached OCSP response that is no longer current.\n");
+        _clear_error_stack();
+        return -1;
+    }
+
+    _dbgprint(2, "Retrieved cached OCSP response.\n");
+
+    return result;
+}
+
+
+/**
+ * @brief   Cache a verified OCSP response, as the verdict on its certificate until the response's next update.
+ * @note    The object cache takes over the response, which is released if it could not be cached.
+ *              A response already cached for the certificate is replaced and released, rather than kept as a shadow that
+ *              would be persisted in place of the new one. The change is persisted through the cache journal, rather
+ *              than by saving the entire cache for every response.
+ * @param   cidstr  the id of the certificate's OCSP verdict in the object cache, or an empty string if it has none.
+ * @param   response    a pointer to the verified OCSP response to be cached.
+ * @param   expiration  the time of the response's next update, or 0 if it has none.
+ */
+void _cache_ocsp_response(const char *cidstr, OCSP_RESPONSE *response, time_t expiration) {
+
+    // Without a next update time, a response can't be relied upon past the moment it was checked.
+    if (!cidstr || !strlen(cidstr) || !expiration) {
+        OCSP_RESPONSE_free_d(response);
+        return;
+    }
+
+    // No memory leak here because the OCSP response object store is marked "internal" and only a single instance of each record is passed around.
+    if (!_replace_cached_object(cidstr, &(cached_stores[cached_data_ocsp]), 0, expiration, response, 1, 0)) {
+        fprintf(stderr, "Error: unable to add OCSP response to object cache.\n");
+        dump_error_stack();
+        _clear_error_stack();
+        OCSP_RESPONSE_free_d(response);
+        return;
+    }
+
+}
+
+
+/**
+ * @brief   Perform OCSP validation on an x509 certificate.
+ * @note    A cached verdict on the certificate is used if there is one, which includes a response stapled to the TLS handshake
+ *              that passed verification. Only otherwise is the OCSP responder named in the certificate queried.
+ * @param   connection  a pointer to the SSL connection associated with the peer certificate to be OCSP validated.
+ * @param   fallthrough an optional pointer to a variable that will be set if OCSP validation did not fail for various
+ *              reasons (ie. OCSP was not available), but validation was not completed.
+ * @return  -1 on general error, 0 if the certificate did not pass OCSP validation, or 1 if it did so successfully.
+ */
+int _do_ocsp_validation(SSL *connection, int *fallthrough) {
+
+    OCSP_REQUEST *request;
+    OCSP_RESPONSE *response = NULL;
+    OCSP_CERTID *cid;
+    OCSP_BASICRESP *basic;
+    OCSP_REQ_CTX *octx;
+    STACK_OF(OPENSSL_STRING) * ocspst;
+    STACK_OF(X509) * certstack;
+    X509 *cert;
+    BIO *bsock, *dbgbio;
+    time_t expiration;
+    char cidstr[512], *purl, *phost = NULL, *pport = NULL, *ppath = NULL;
+    int fd, pssl, rcode, status, result;
+
+    if (!connection) {
+        RET_ERROR_INT(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(cid = _get_ocsp_cert_id(connection, &certstack, cidstr, sizeof(cidstr)))) {
+        RET_ERROR_INT(ERR_UNSPEC, "could not identify peer certificate for OCSP validation");
+    }
+
+    // If we have a current verdict on the certificate, there's no need to ask its OCSP responder.
+    if ((result = _get_cached_ocsp_verdict(cidstr, cid)) >= 0) {
+        OCSP_CERTID_free_d(cid);
 
         if (fallthrough) {
             *fallthrough = 0;
         }
 
-        _dbgprint(2, "Certificate passed cached OCSP response validation.\n");
+        _dbgprint(2, "Certificate %s cached OCSP response validation.\n", result ? "passed" : "failed");
 
-        return 1;
+        return result;
+    }
+
+    if (!(cert = SSL_get_peer_certificate_d(connection))) {
+        PUSH_ERROR_OPENSSL();
+        OCSP_CERTID_free_d(cid);
+        RET_ERROR_INT(ERR_UNSPEC, "could not retrieve peer certificate for OCSP validation");
     }
 
-    if ((!(ocspst = X509_get1_ocsp_d(cert))) || (!sk_num_d(CHECKED_STACK_OF(OPENSSL_STRING, ocspst)))) {
+    ocspst = X509_get1_ocsp_d(cert);
+    X509_free_d(cert);
+
+    if ((!ocspst) || (!sk_num_d(CHECKED_STACK_OF(OPENSSL_STRING, ocspst)))) {
         // Could not get OCSP URI from certificate.
 
+        if (ocspst) {
+            X509_email_free_d(ocspst);
+        }
+
+        OCSP_CERTID_free_d(cid);
+
         if (fallthrough) {
             *fallthrough = 1;
         }
@@ -617,6 +966,7 @@ int _do_ocsp_validation(SSL *connection, int *fallthrough) {
 
     if (!purl) {
         PUSH_ERROR_SYSCALL("strdup");
+        OCSP_CERTID_free_d(cid);
         RET_ERROR_INT(ERR_NOMEM, "OCSP validation failed because of memory allocation problem");
     }
 
@@ -627,6 +977,7 @@ int _do_ocsp_validation(SSL *connection, int *fallthrough) {
     if (!OCSP_parse_url_d(purl, &phost, &pport, &ppath, &pssl)) {
         PUSH_ERROR_OPENSSL();
         free(purl);
+        OCSP_CERTID_free_d(cid);
         RET_ERROR_INT(ERR_UNSPEC, "OCSP validation failed because of url parsing error");
     }
 
@@ -635,9 +986,11 @@ int _do_ocsp_validation(SSL *connection, int *fallthrough) {
     // Construct the request and attach the certificate ID to it.
     if (!(request = OCSP_REQUEST_new_d())) {
         PUSH_ERROR_OPENSSL();
+        OCSP_CERTID_free_d(cid);
         RET_ERROR_INT(ERR_UNSPEC, "OCSP validation failed because of memory allocation error");
     }
 
+    // From here on, the certificate ID belongs to the request.
     if (!OCSP_request_add0_id_d(request, cid)) {
         PUSH_ERROR_OPENSSL();
         OCSP_REQUEST_free_d(request);
@@ -739,10 +1092,12 @@ int _do_ocsp_validation(SSL *connection, int *fallthrough) {
 
     // Possible return values:
     // -1: no nonce in reply, 1 = nonces match, 2/3 = ignore, 0 = mismatch
-    if (!(status = OCSP_check_nonce_d(request, basic))) {
+    status = OCSP_check_nonce_d(request, basic);
+    OCSP_BASICRESP_free_d(basic);
+
+    if (!status) {
         OCSP_REQUEST_free_d(request);
         OCSP_RESPONSE_free_d(response);
-        OCSP_BASICRESP_free_d(basic);
         RET_ERROR_INT(ERR_UNSPEC, "OCSP verification failed because of response nonce mismatch");
     } else if (status == 1) {
         _dbgprint(2, "Nonce in OCSP response matched request.\n");
@@ -750,145 +1105,31 @@ int _do_ocsp_validation(SSL *connection, int *fallthrough) {
         _dbgprint(1, "Warning: no nonce was found in OCSP response.\n");
     }
 
-    // Create the x509 certificate store that will be used for final response validation.
-    if (!(store = _get_cert_store())) {
-        OCSP_REQUEST_free_d(request);
-        OCSP_RESPONSE_free_d(response);
-        OCSP_BASICRESP_free_d(basic);
-        RET_ERROR_INT(ERR_UNSPEC, "unable to verify OCSP response because of certificate store error");
-    }
-
-    // Do we need any flags? OCSP_TRUSTOTHER?
-    if ((ret = OCSP_basic_verify_d(basic, certstack, store, 0)) <= 0) {
-
-        if (ret < 0) {
-            PUSH_ERROR_OPENSSL();
-        }
-
-        OCSP_REQUEST_free_d(request);
-        OCSP_RESPONSE_free_d(response);
-        X509_STORE_free_d(store);
-        OCSP_BASICRESP_free_d(basic);
-
-        if (ret < 0) {
-            RET_ERROR_INT(ERR_UNSPEC, "basic OCSP response verification failed");
-        }
-
-        return 0;
-    }
-
-    X509_STORE_free_d(store);
-
-    if ((ret = OCSP_resp_find_status_d(basic, cid, &status, &reason, &revtime, &thisupd, &nextupd)) <= 0) {
-
-        if (ret < 0) {
-            PUSH_ERROR_OPENSSL();
-        }
-
-        OCSP_REQUEST_free_d(request);
-        OCSP_RESPONSE_free_d(response);
-        OCSP_BASICRESP_free_d(basic);
-
-        if (ret < 0) {
-            RET_ERROR_INT(ERR_UNSPEC, "basic OCSP response verification failed");
-        }
-
-        return 0;
-    }
-
-    if (_verbose >= 3) {
-
-        if ((dbgbio = BIO_new_fp_d(stderr, BIO_NOCLOSE))) {
-            fprintf(stderr, "--- This OCSP update: ");
-            ASN1_GENERALIZEDTIME_print_d(dbgbio, thisupd);
-            fprintf(stderr, "\n--- Next OCSP update: ");
-            ASN1_GENERALIZEDTIME_print_d(dbgbio, nextupd);
-            fprintf(stderr, "\n");
-            BIO_free_d(dbgbio);
-        }
-
-    }
-
-    // Requested with a maximum clock skew time of 5 minutes, and ignore the max age option. (maybe we shouldn't).
-    status = OCSP_check_validity_d(thisupd, nextupd, 300, -1);
-
+    result = _check_ocsp_response(response, cid, certstack, &expiration);
     OCSP_REQUEST_free_d(request);
 
-    if (status <= 0) {
-
-        if (status < 0) {
-            PUSH_ERROR_OPENSSL();
-        }
-
+    if (result < 0) {
         OCSP_RESPONSE_free_d(response);
-        OCSP_BASICRESP_free_d(basic);
-
-        if (status < 0) {
-            RET_ERROR_INT(ERR_UNSPEC, "OCSP validity check failed");
-        }
-
-        return 0;
+        RET_ERROR_INT(ERR_UNSPEC, "OCSP response validation failed");
     }
 
     //
     // TODO: OPENSSL_free on phost, pport, ppath, etc.
 
-    // We didn't fall through; validation is 100% successful by this point.
+    // We didn't fall through; validation is complete by this point.
     if (fallthrough) {
         *fallthrough = 0;
     }
 
-    _dbgprint(2, "Certificate passed OCSP validation.\n");
-
-    // Finally we need to convert the ASN1 next update time to a time_t to be used as our expiration time.
-    if (nextupd->data && (nextupd->type == V_ASN1_GENERALIZEDTIME)) {
-
-        // Create a dummy date that is initialized to UTC.
-        memset(&tt, 0, sizeof(tt));
-        expiration = 0;
-        gmtime_r(&expiration, &tt);
-
-        if (sscanf((char *)nextupd->data, "%4d%2d%2d%2d%2d%2d", &(tt.tm_year), &(tt.tm_mon), &(tt.tm_mday), &(tt.tm_hour), &(tt.tm_min), &(tt.tm_sec)) != 6) {
-            fprintf(stderr, "Error parsing ASN1 data of OCSP response next update time; setting expiration to zero.\n");
-            expiration = 0;
-        } else {
-            // The year is relative to 1900.
-            tt.tm_year -= 1900;
-            // The month number is zero-indexed.
-            tt.tm_mon--;
-            // The hour is also zero-indexed.
-            tt.tm_hour--;
-
-            if ((expiration = timegm(&tt)) == (time_t)-1) {
-                fprintf(stderr, "Error: unable to convert OCSP response next update time to valid UTC time.\n");
-                expiration = 0;
-            }
-
-        }
-
-    } else {
-        fprintf(stderr, "Error reading OCSP response next update time; setting expiration to zero.\n");
-        expiration = 0;
-    }
-
-    // No memory leak here because the OCSP response object store is marked "internal" and only a single instance of each record is passed around.
-    if (strlen(cidstr) && (!_add_cached_object(cidstr, &(cached_stores[cached_data_ocsp]), 0, expiration, response, 1, 0))) {
-        fprintf(stderr, "Error: unable to add OCSP response to object cache.\n");
-        dump_error_stack();
-        _clear_error_stack();
-        OCSP_RESPONSE_free_d(response);
-        OCSP_BASICRESP_free_d(basic);
-    }
+    _dbgprint(2, "Certificate %s OCSP validation.\n", result ? "passed" : "failed");
 
-    // TODO: memory leak with basic?
+    // The verdict holds until the response's next update, sparing later connections to this server another query.
+    _cache_ocsp_response(cidstr, response, expiration);
 
-    if (_save_cache_contents() < 0) {
-        fprintf(stderr, "Error: unable to save contents of cache to file.\n");
-    }
-
-    return 1;
+    return result;
 }
 
+
 /**
  * @brief   Get the subject common name (CN) attribute of an X509 certificate.
  * @param   cert    a pointer to the X509 certificate to have its subject field parsed.
@@ -1230,23 +1471,32 @@ void _ssl_fd_loop(SSL *connection) {
 
 
 /**
- * @brief   An OCSP stapling rOCSP_REQUEST_freeesponse callback for the TLS subsystem.
- * @note    This function currently does not do anything!
+ * @brief   An OCSP stapling response callback for the TLS subsystem.
+ * @note    A response stapled to the handshake is verified and cached as the verdict on the peer certificate, so that
+ *              _do_ocsp_validation() won't have to query the OCSP responder itself. A stapled response that can't be
+ *              verified is ignored, leaving the responder to be queried instead.
  * @param   s   a pointer to the SSL connection that generated the callback.
- * @param   arg an optional callback parameter that was set by the caller.
- * @return  1 if the OCSP response was valid or 0 if it was not.
+ * @param   arg an optional BIO that stapled responses are printed to at high verbosity levels, instead of stderr.
+ * @return  0 if the stapled response couldn't be parsed or the peer certificate is known not to be in good standing,
+ *              which aborts the handshake, or 1 otherwise.
  */
 int _ocsp_response_callback(SSL *s, void *arg) {
 
     OCSP_RESPONSE *response;
-    const unsigned char *p;
-    int len;
+    OCSP_CERTID *cid;
+    STACK_OF(X509) * chain;
+    BIO *dbgbio;
+    const unsigned char *p = NULL;
+    char cidstr[512];
+    time_t expiration;
+    long len;
+    int result;
 
     len = SSL_ctrl_d(s, SSL_CTRL_GET_TLSEXT_STATUS_REQ_OCSP_RESP, 0, (void *)&p);
 
-    if (!p) {
-        ERR_print_errors_fp_d(stderr);
-        // No OCSP response was sent.
+    // If no OCSP response was sent, the certificate will be checked against the cache or with its OCSP responder later on.
+    if (!p || (len <= 0)) {
+        _dbgprint(3, "No OCSP response was stapled to the TLS handshake.\n");
         return 1;
     }
 
@@ -1256,17 +1506,51 @@ int _ocsp_response_callback(SSL *s, void *arg) {
         return 0;
     }
 
-    if (_verbose >= 3) {
+    if ((_verbose >= 4) && arg) {
         OCSP_RESPONSE_print_d(arg, response, 0);
+    } else if ((_verbose >= 4) && (dbgbio = BIO_new_fp_d(stderr, BIO_NOCLOSE))) {
+        OCSP_RESPONSE_print_d(dbgbio, response, 0);
+        BIO_free_d(dbgbio);
     }
 
-    OCSP_RESPONSE_free_d(response);
+    if (!(cid = _get_ocsp_cert_id(s, &chain, cidstr, sizeof(cidstr)))) {
+        fprintf(stderr, "Warning: could not identify the certificate of a stapled OCSP response.\n");
+        dump_error_stack();
+        _clear_error_stack();
+        OCSP_RESPONSE_free_d(response);
+        return 1;
+    }
+
+    // A current cached verdict spares us from having to verify the stapled response.
+    if ((result = _get_cached_ocsp_verdict(cidstr, cid)) < 0) {
+
+        if ((result = _check_ocsp_response(response, cid, chain, &expiration)) < 0) {
+            fprintf(stderr, "Warning: ignoring stapled OCSP response that could not be verified.\n");
+            dump_error_stack();
+            _clear_error_stack();
+        } else {
+            _dbgprint(2, "Verified stapled OCSP response.\n");
+            _cache_ocsp_response(cidstr, response, expiration);
+            response = NULL;
+        }
+
+    }
+
+    if (response) {
+        OCSP_RESPONSE_free_d(response);
+    }
+
+    OCSP_CERTID_free_d(cid);
+
+    if (!result) {
+        fprintf(stderr, "Error: peer certificate failed OCSP validation of stapled response.\n");
+        return 0;
+    }
 
     return 1;
 }
 
 
-
 /**
  * @brief   A callback handler to destroy an OCSP_RESPONSE object.
  * @note    This is an internal function used by the cache management subsystem.
@@ -1518,3 +1802,101 @@ void *_serialize_ocsp_response_cb(void *record, size_t *outlen) {
     *outlen = res;
     return buf;
 }
+
+
+/**
+ * @brief   A callback handler to destroy a cached TLS session.
+ * @note    This is an internal function used by the cache management subsystem.
+ * @param   record  a pointer to the SSL_SESSION object to be destroyed.
+ */
+void _destroy_tls_session_cb(void *record) {
+
+    SSL_SESSION_free_d((SSL_SESSION *)record);
+}
+
+
+/**
+ * @brief   A callback handler to serialize a cached TLS session.
+ * @note    This is an internal function used by the cache management subsystem.
+ * @param   record  a pointer to the SSL_SESSION object to be serialized.
+ * @param   outlen  a pointer to a variable that will receive the length of the serialized TLS session.
+ * @return  a pointer to a newly allocated buffer holding the serialized SSL_SESSION on success, or NULL on failure.
+ */
+void *_serialize_tls_session_cb(void *record, size_t *outlen) {
+
+    unsigned char *buf = NULL;
+    int res;
+
+    if (!record || !outlen) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if ((res = i2d_SSL_SESSION_d((SSL_SESSION *)record, &buf)) <= 0) {
+        PUSH_ERROR_OPENSSL();
+        RET_ERROR_PTR(ERR_UNSPEC, "could not serialize TLS session");
+    }
+
+    *outlen = res;
+    return buf;
+}
+
+
+/**
+ * @brief   A callback handler to deserialize a cached TLS session.
+ * @note    This is an internal function used by the cache management subsystem.
+ * @param   data    a pointer to a buffer containing the data to be deserialized.
+ * @param   len the length, in bytes, of the data buffer to be deserialized.
+ * @return  a pointer to a newly allocated SSL_SESSION structure on success, or NULL on failure.
+ */
+void *_deserialize_tls_session_cb(void *data, size_t len) {
+
+    SSL_SESSION *session;
+
+    if (!data) {
+        RET_ERROR_PTR(ERR_BAD_PARAM, NULL);
+    }
+
+    if (!(session = d2i_SSL_SESSION_d(NULL, (const unsigned char **)&data, len))) {
+        PUSH_ERROR_OPENSSL();
+        RET_ERROR_PTR(ERR_UNSPEC, "could not deserialize TLS session");
+    }
+
+    return session;
+}
+
+
+/**
+ * @brief   A callback handler to dump a cached TLS session to the console.
+ * @note    This is an internal function used by the cache management subsystem. The session keys are never dumped.
+ * @param   fp  a pointer to the file stream that will receive the dump output.
+ * @param   record  a pointer to the SSL_SESSION object to be dumped.
+ * @param   brief   if set, only print the session id.
+ */
+void _dump_tls_session_cb(FILE *fp, void *record, int brief) {
+
+    SSL_SESSION *session = (SSL_SESSION *)record;
+    const unsigned char *id;
+    unsigned int idlen;
+
+    if (!session) {
+        fprintf(stderr, "Error: could not dump null TLS session.\n");
+        return;
+    }
+
+    id = SSL_SESSION_get_id_d(session, &idlen);
+    fprintf(fp, "session id = ");
+
+    if (!idlen) {
+        fprintf(fp, "(ticket only)");
+    }
+
+    for (unsigned int i = 0; i < idlen; i++) {
+        fprintf(fp, "%.2x", id[i]);
+    }
+
+    if (brief) {
+        return;
+    }
+
+    fprintf(fp, ", established = %ld, timeout = %ld seconds", SSL_SESSION_get_time_d(session), SSL_SESSION_get_timeout_d(session));
+}
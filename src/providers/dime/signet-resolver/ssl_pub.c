@@ -13,8 +13,12 @@ SSL_CTX *ssl_get_client_context(void) {
     PUBLIC_FUNC_IMPL(ssl_get_client_context, );
 }
 
-SSL *ssl_starttls(int fd) {
-    PUBLIC_FUNC_IMPL(ssl_starttls, fd);
+SSL *ssl_starttls(int fd, const char *hostname) {
+    PUBLIC_FUNC_IMPL(ssl_starttls, fd, hostname);
+}
+
+int ssl_set_session_cache(ssl_session_cache_t mode) {
+    PUBLIC_FUNC_IMPL(ssl_set_session_cache, mode);
 }
 
 SSL *ssl_connect_host(const char *hostname, unsigned short port, int force_family) {
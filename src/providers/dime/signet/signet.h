@@ -29,6 +29,7 @@ typedef struct {
                                     /**< If fields[index] is 0 it means that the corresponding field type identifier occurred 0 times.*/
     uint32_t size;                  /**< Combined length of all the fields */
     unsigned char *data;
+    unsigned int refs;              /**< The number of extra references to the signet taken by dime_sgnt_signet_share(). Each one is dropped by a call to destroy. */
 } signet_t;
 
 EC_KEY *                dime_sgnt_enckey_fetch(const signet_t *signet);
@@ -67,6 +68,7 @@ void                    dime_sgnt_signet_dump(FILE *fp, signet_t *signet);
 signet_t *              dime_sgnt_signet_dupe(signet_t *signet);
 signet_t *              dime_sgnt_signet_full_split(const signet_t *signet);
 signet_t *              dime_sgnt_signet_load(const char *filename);
+signet_t *              dime_sgnt_signet_share(signet_t *signet);
 ED25519_KEY *           dime_sgnt_signkey_fetch(const signet_t *signet);
 ED25519_KEY **          dime_sgnt_signkeys_msg_fetch(const signet_t *signet);
 ED25519_KEY **          dime_sgnt_signkeys_signet_fetch(const signet_t *signet);
@@ -79,6 +81,7 @@ const char *            dime_sgnt_state_to_str(signet_state_t state);
 signet_type_t           dime_sgnt_type_get(const signet_t *signet);
 int                     dime_sgnt_type_set(signet_t *signet, signet_type_t type);
 signet_state_t          dime_sgnt_validate_all(const signet_t *signet, const signet_t *previous, const signet_t *orgsig, const unsigned char **dime_pok);
+int                     dime_sgnt_validate_many(const signet_t **signets, const signet_t **previous, const signet_t **orgsigs, const unsigned char ***dime_poks, size_t num, signet_state_t *states);
 
 
 #endif
@@ -1,28 +1,58 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <inttypes.h>
 
 #include <signet-resolver/cache.h>
 #include <signet-resolver/dns.h>
 
 static void usage(const char *progname) {
 
-	fprintf(stderr, "\nUsage: %s [-mkdos] [-v] [-r anchor-file]    where\n", progname);
+	fprintf(stderr, "\nUsage: %s [-mkdost] [-v] [-S | -p] [-r anchor-file]    where\n", progname);
 	fprintf(stderr, " -m   dumps all cached DIME management records.\n");
 	fprintf(stderr, " -k   dumps all cached DNSKEY records.\n");
 	fprintf(stderr, " -d   dumps all cached DS records.\n");
 	fprintf(stderr, " -o   dumps all cached OCSP responses.\n");
 	fprintf(stderr, " -s   dumps all cached signets.\n");
+	fprintf(stderr, " -t   dumps all cached TLS sessions.\n");
 	fprintf(stderr, " -r   specifies a root key anchor file for DNSKEY records to simulate loading.\n");
 	fprintf(stderr, " -v   turns on verbose mode to dump all data associated with the cached object.\n");
+	fprintf(stderr, " -S   prints the number and size of the objects in the selected cached stores instead of their contents.\n");
+	fprintf(stderr, " -p   prints the same statistics as tab-separated values, for consumption by other programs.\n");
 	fprintf(stderr, "\n");
 
 	exit(EXIT_FAILURE);
 }
 
 
+// Short names for the cached stores, used as keys in machine-readable output.
+static const char *store_keys[] = { "unknown", "drec", "dnskey", "ds", "ocsp", "signet", "tls" };
+
+// The hit, miss and churn counters only track the lookups made by the process that holds the cache, and aren't saved with it.
+// All this process ever did was load the cache from disk, so only the size of what it loaded is worth reporting.
+static void dump_stats(cached_data_type_t dtype, int parseable) {
+
+	cached_store_stats_t stats;
+	size_t objects;
+
+	if ((get_cache_stats(dtype, &stats) < 0) || (get_cached_object_count(dtype, &objects) < 0)) {
+		fprintf(stderr, "Error: unable to get statistics for cached store.\n");
+		dump_error_stack();
+		exit(EXIT_FAILURE);
+	}
+
+	if (parseable) {
+		printf("%s\t%zu\t%" PRIu64 "\n", (dtype != cached_data_unknown) ? store_keys[dtype] : "total", objects, stats.bytes);
+		return;
+	}
+
+	printf("--- %s:\n", (dtype != cached_data_unknown) ? cached_stores[dtype].description : "All cached stores");
+	printf("  objects:    %zu (%" PRIu64 " bytes in memory once loaded)\n", objects, stats.bytes);
+}
+
+
 int main(int argc, char *argv[]) {
 
-	unsigned int do_dime = 0, do_dnskey = 0, do_ds = 0, do_ocsp = 0, do_signet = 0, verbose = 0;
+	unsigned int do_dime = 0, do_dnskey = 0, do_ds = 0, do_ocsp = 0, do_signet = 0, do_tls = 0, verbose = 0, stats = 0, parseable = 0;
 	int opt;
 
 	if (load_cache_contents() < 0) {
@@ -31,7 +61,7 @@ int main(int argc, char *argv[]) {
 		exit(EXIT_FAILURE);
 	}
 
-	while ((opt = getopt(argc, argv, "dhkmor:sv")) != -1) {
+	while ((opt = getopt(argc, argv, "dhkmopr:sStv")) != -1) {
 
 		switch (opt) {
 		case 'd':
@@ -49,6 +79,9 @@ int main(int argc, char *argv[]) {
 		case 'o':
 			do_ocsp = 1;
 			break;
+		case 'p':
+			stats = parseable = 1;
+			break;
 		case 'r':
 
 			if (load_dnskey_file(optarg) < 0) {
@@ -61,6 +94,12 @@ int main(int argc, char *argv[]) {
 		case 's':
 			do_signet = 1;
 			break;
+		case 'S':
+			stats = 1;
+			break;
+		case 't':
+			do_tls = 1;
+			break;
 		case 'v':
 			verbose = 1;
 			break;
@@ -71,8 +110,47 @@ int main(int argc, char *argv[]) {
 
 	}
 
+	if (stats) {
+
+		if (parseable) {
+			printf("#store\tobjects\tbytes\n");
+		}
+
+		// Without any stores selected, every store is listed along with the totals.
+		if (!do_ds && !do_dnskey && !do_dime && !do_signet && !do_ocsp && !do_tls) {
+			do_dime = do_dnskey = do_ds = do_ocsp = do_signet = do_tls = 1;
+			dump_stats(cached_data_unknown, parseable);
+		}
+
+		if (do_dime) {
+			dump_stats(cached_data_drec, parseable);
+		}
+
+		if (do_dnskey) {
+			dump_stats(cached_data_dnskey, parseable);
+		}
+
+		if (do_ds) {
+			dump_stats(cached_data_ds, parseable);
+		}
+
+		if (do_ocsp) {
+			dump_stats(cached_data_ocsp, parseable);
+		}
+
+		if (do_signet) {
+			dump_stats(cached_data_signet, parseable);
+		}
+
+		if (do_tls) {
+			dump_stats(cached_data_tls_session, parseable);
+		}
+
+		exit(EXIT_SUCCESS);
+	}
+
 	// If none of the options are set, then we set them all by default.
-	if (!do_ds && !do_dnskey && !do_dime && !do_signet && !do_ocsp) {
+	if (!do_ds && !do_dnskey && !do_dime && !do_signet && !do_ocsp && !do_tls) {
 		_dump_cache(cached_data_unknown, verbose, 1);
 		exit(EXIT_SUCCESS);
 	}
@@ -97,5 +175,9 @@ int main(int argc, char *argv[]) {
 		_dump_cache(cached_data_signet, verbose, 1);
 	}
 
+	if (do_tls) {
+		_dump_cache(cached_data_tls_session, verbose, 1);
+	}
+
 	exit(EXIT_SUCCESS);
 }
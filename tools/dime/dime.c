@@ -14,7 +14,7 @@
 
 static void __attribute__((noreturn)) usage(const char *progname)  {
 
-	fprintf(stderr, "\nUsage: %s [-d dxserver] [-p port] [-i dimefile [-0] [-f fingerprint] [-h or -c] [-e endfp] [-n] [-4 or -6] [-v] <signet>    where\n", progname);
+	fprintf(stderr, "\nUsage: %s [-d dxserver] [-p port] [-i dimefile [-0] [-f fingerprint] [-h or -c] [-e endfp] [-n] [-P] [-4 or -6] [-v] <signet>    where\n", progname);
 	fprintf(stderr, " signet is the name of the user or organizational signet to be looked up.\n");
 	fprintf(stderr, " -h   looks up the chain of custody for the specified signet using the HIST command (requires -f).\n");
 	fprintf(stderr, " -e   can be used with [-h] to specify an optional ending fingerprint for the chain of custody request.\n");
@@ -26,6 +26,7 @@ static void __attribute__((noreturn)) usage(const char *progname)  {
 	fprintf(stderr, " -f   can specifiy an optional signet fingerprint to be used for a standard signet lookup, or\n");
 	fprintf(stderr, "      the mandatory fingerprint needed for a history or verify signet operation.\n");
 	fprintf(stderr, " -n   disables use of the persistent object cache.\n");
+	fprintf(stderr, " -P   prefetches the DNSSEC chain of trust of the DIME record concurrently instead of one zone at a time.\n");
 	fprintf(stderr, " -4   forces ipv4 address resolution (-6 for ipv6).\n");
 	fprintf(stderr, " -v   turns on verbose output (-v can be specified multiple times to increase the debugging level).\n");
 	fprintf(stderr, "\n");
@@ -119,7 +120,7 @@ int main(int argc, char *argv[]) {
 	unsigned short port = 0;
 	int opt, is_org = 0, family = 0, do_hist = 0, do_vrfy = 0, no_trust = 0, no_cache = 0, result, vres;
 
-	while ((opt = getopt(argc, argv, "046d:e:f:i:hcnp:v")) != -1) {
+	while ((opt = getopt(argc, argv, "046d:e:f:i:hcnPp:v")) != -1) {
 
 		switch (opt) {
 		case '0':
@@ -152,6 +153,9 @@ int main(int argc, char *argv[]) {
 		case 'n':
 			no_cache = 1;
 			break;
+		case 'P':
+			_set_dnssec_prefetch(1);
+			break;
 		case 'p':
 
 			if (!(port = atoi(optarg))) {
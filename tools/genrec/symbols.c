@@ -214,6 +214,15 @@ int (*SHA512_Update_d)(SHA512_CTX *c, const void *data, size_t len) = NULL;
 int (*sk_num_d)(const _STACK *) = NULL;
 int (*SSL_get_fd_d)(const SSL *s) = NULL;
 int (*SSL_set_fd_d)(SSL *s, int fd) = NULL;
+SSL_SESSION * (*d2i_SSL_SESSION_d)(SSL_SESSION **a, const unsigned char **pp, long length) = NULL;
+int (*i2d_SSL_SESSION_d)(SSL_SESSION *in, unsigned char **pp) = NULL;
+int (*SSL_set_session_d)(SSL *to, SSL_SESSION *session) = NULL;
+void (*SSL_SESSION_free_d)(SSL_SESSION *ses) = NULL;
+long (*SSL_SESSION_get_time_d)(const SSL_SESSION *s) = NULL;
+long (*SSL_SESSION_get_timeout_d)(const SSL_SESSION *s) = NULL;
+const unsigned char * (*SSL_SESSION_get_id_d)(const SSL_SESSION *s, unsigned int *len) = NULL;
+void (*SSL_CTX_sess_set_new_cb_d)(SSL_CTX *ctx, int (*new_session_cb)(SSL *, SSL_SESSION *)) = NULL;
+const char * (*SSL_get_servername_d)(const SSL *s, const int type) = NULL;
 int (*X509_check_host_d)(X509 *x, const char *chk, size_t chklen, unsigned int flags, char **peername) = NULL;
 int (*X509_check_issued_d)(X509 *issuer, X509 *subject) = NULL;
 int (*X509_NAME_get_index_by_NID_d)(X509_NAME *name, int nid, int lastpos) = NULL;
@@ -239,6 +248,8 @@ void (*ERR_print_errors_fp_d)(FILE *fp) = NULL;
 void (*EVP_CIPHER_CTX_free_d)(EVP_CIPHER_CTX *a) = NULL;
 void (*OCSP_REQUEST_free_d)(OCSP_REQUEST *a) = NULL;
 void (*OCSP_RESPONSE_free_d)(OCSP_RESPONSE *a) = NULL;
+void (*OCSP_CERTID_free_d)(OCSP_CERTID *a) = NULL;
+void (*X509_free_d)(X509 *a) = NULL;
 void (*RSA_free_d)(RSA *r) = NULL;
 void (*SSL_CTX_set_verify_d)(SSL_CTX *ctx, int mode, int (*cb) (int, X509_STORE_CTX *)) = NULL;
 void (*X509_email_free_d)(struct stack_st_OPENSSL_STRING *sk) = NULL;
@@ -370,7 +381,9 @@ bool_t lib_load_openssl(void) {
 		M_BIND(SSL_CTX_set_verify), M_BIND(X509_email_free), M_BIND(X509_STORE_CTX_free), M_BIND(X509_STORE_CTX_set_chain), M_BIND(X509_STORE_free),
 		M_BIND(OCSP_cert_to_id), M_BIND(OCSP_request_add0_id), M_BIND(OCSP_response_get1_basic), M_BIND(sk_value), M_BIND(X509_STORE_CTX_get_current_cert),
 		M_BIND(X509_STORE_add_lookup), M_BIND(X509_LOOKUP_file), M_BIND(X509_NAME_get_entry), M_BIND(X509_STORE_new), M_BIND(ERR_clear_error),
-		M_BIND(ERR_put_error)
+		M_BIND(ERR_put_error), M_BIND(d2i_SSL_SESSION), M_BIND(i2d_SSL_SESSION), M_BIND(SSL_set_session), M_BIND(SSL_SESSION_free),
+		M_BIND(SSL_SESSION_get_time), M_BIND(SSL_SESSION_get_timeout), M_BIND(SSL_SESSION_get_id), M_BIND(SSL_CTX_sess_set_new_cb),
+		M_BIND(SSL_get_servername), M_BIND(OCSP_CERTID_free), M_BIND(X509_free)
 	};
 
 	if (!lib_symbols(sizeof(openssl) / sizeof(symbol_t), openssl)) {
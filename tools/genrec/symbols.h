@@ -223,6 +223,15 @@ extern int (*SHA512_Update_d)(SHA512_CTX *c, const void *data, size_t len);
 extern int (*sk_num_d)(const _STACK *);
 extern int (*SSL_get_fd_d)(const SSL *s);
 extern int (*SSL_set_fd_d)(SSL *s, int fd);
+extern SSL_SESSION * (*d2i_SSL_SESSION_d)(SSL_SESSION **a, const unsigned char **pp, long length);
+extern int (*i2d_SSL_SESSION_d)(SSL_SESSION *in, unsigned char **pp);
+extern int (*SSL_set_session_d)(SSL *to, SSL_SESSION *session);
+extern void (*SSL_SESSION_free_d)(SSL_SESSION *ses);
+extern long (*SSL_SESSION_get_time_d)(const SSL_SESSION *s);
+extern long (*SSL_SESSION_get_timeout_d)(const SSL_SESSION *s);
+extern const unsigned char * (*SSL_SESSION_get_id_d)(const SSL_SESSION *s, unsigned int *len);
+extern void (*SSL_CTX_sess_set_new_cb_d)(SSL_CTX *ctx, int (*new_session_cb)(SSL *, SSL_SESSION *));
+extern const char * (*SSL_get_servername_d)(const SSL *s, const int type);
 extern int (*X509_check_host_d)(X509 *x, const char *chk, size_t chklen, unsigned int flags, char **peername);
 extern int (*X509_check_issued_d)(X509 *issuer, X509 *subject);
 extern int (*X509_NAME_get_index_by_NID_d)(X509_NAME *name, int nid, int lastpos);
@@ -248,6 +257,8 @@ extern void (*ERR_print_errors_fp_d)(FILE *fp);
 extern void (*EVP_CIPHER_CTX_free_d)(EVP_CIPHER_CTX *a);
 extern void (*OCSP_REQUEST_free_d)(OCSP_REQUEST *a);
 extern void (*OCSP_RESPONSE_free_d)(OCSP_RESPONSE *a);
+extern void (*OCSP_CERTID_free_d)(OCSP_CERTID *a);
+extern void (*X509_free_d)(X509 *a);
 extern void (*RSA_free_d)(RSA *r);
 extern void (*SSL_CTX_set_verify_d)(SSL_CTX *ctx, int mode, int (*cb) (int, X509_STORE_CTX *));
 extern void (*X509_email_free_d)(struct stack_st_OPENSSL_STRING *sk);